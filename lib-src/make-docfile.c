@@ -32,6 +32,15 @@ along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.  */
  Then comes F for a function or V for a variable.
  Then comes the function or variable name, terminated with a newline.
  Then comes the documentation for that function or variable.
+
+ Option -x, given the name of a finished doc-string file, makes an
+ index of that file instead.  The first line of the index is the size
+ in bytes of the indexed file.  Then comes a line for each entry:
+ S and the source file name for a file boundary marker, or F or V,
+ the position of the documentation in the indexed file, a space, and
+ the function or variable name.  The position is negated for a variable
+ whose documentation starts with `*'.  Emacs reads the index in place
+ of the doc-string file itself when it records the doc-string positions.
  */
 
 #include <config.h>
@@ -65,6 +74,7 @@ static int scan_lisp_file (const char *filename, const char *mode);
 static int scan_c_file (char *filename, const char *mode);
 static void start_globals (void);
 static void write_globals (void);
+static int index_doc_file (const char *filename);
 
 #include <unistd.h>
 
@@ -164,6 +174,13 @@ main (int argc, char **argv)
 
   set_binary_mode (fileno (stdout), O_BINARY);
 
+  if (argc > i && !strcmp (argv[i], "-x"))
+    {
+      if (argc != i + 2)
+	fatal ("-x needs exactly one doc-string file to index", 0);
+      return (index_doc_file (argv[i + 1]) ? EXIT_FAILURE : EXIT_SUCCESS);
+    }
+
   if (generate_globals)
     start_globals ();
 
@@ -219,6 +236,63 @@ scan_file (char *filename)
     return scan_c_file (filename, "r");
 }
 
+/* Write an index of the doc-string file FILENAME to stdout.
+   Return 1 if the file cannot be read, 0 otherwise.  */
+
+static int
+index_doc_file (const char *filename)
+{
+  FILE *infile;
+  char *buf;
+  long size, pos;
+  size_t nread;
+
+  infile = fopen (filename, "rb");
+  if (infile == NULL)
+    {
+      perror (filename);
+      return 1;
+    }
+  if (fseek (infile, 0, SEEK_END) != 0 || (size = ftell (infile)) < 0
+      || fseek (infile, 0, SEEK_SET) != 0)
+    fatal ("cannot find the size of %s", filename);
+  buf = xmalloc (size + 1);
+  nread = fread (buf, 1, size, infile);
+  fclose (infile);
+  if (nread != (size_t) size)
+    fatal ("error reading %s", filename);
+  buf[size] = 0;
+
+  printf ("%ld\n", size);
+  for (pos = 0; pos < size; pos++)
+    {
+      char *name, *end;
+
+      if (buf[pos] != '\037')
+	continue;
+      name = buf + pos + 2;
+      end = pos + 2 <= size ? memchr (name, '\n', size - (pos + 2)) : NULL;
+      if (end == NULL)
+	fatal ("%s ends in the middle of an entry", filename);
+      if (buf[pos + 1] == 'S')
+	printf ("S%.*s\n", (int) (end - name), name);
+      else if (buf[pos + 1] == 'F' || buf[pos + 1] == 'V')
+	{
+	  long docpos = end + 1 - buf;
+	  if (buf[pos + 1] == 'V' && end[1] == '*')
+	    docpos = -docpos;
+	  printf ("%c%ld %.*s\n", buf[pos + 1], docpos,
+		  (int) (end - name), name);
+	}
+      else
+	fatal ("%s is not a doc-string file", filename);
+      pos = end - buf;
+    }
+
+  free (buf);
+  return 0;
+}
+
 static void
 start_globals (void)
 {
@@ -0,0 +1,765 @@
+;;; byte-native.el --- compile byte code to C  -*- lexical-binding: t -*-
+
+;; Copyright (C) 2014 Free Software Foundation, Inc.
+
+;; Maintainer: emacs-devel@gnu.org
+;; Keywords: lisp, internal
+;; Package: emacs
+
+;; This file is part of GNU Emacs.
+
+;; GNU Emacs is free software: you can redistribute it and/or modify
+;; it under the terms of the GNU General Public License as published by
+;; the Free Software Foundation, either version 3 of the License, or
+;; (at your option) any later version.
+
+;; GNU Emacs is distributed in the hope that it will be useful,
+;; but WITHOUT ANY WARRANTY; without even the implied warranty of
+;; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+;; GNU General Public License for more details.
+
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.
+
+;;; Commentary:
+
+;; This translates the byte-code functions of a byte-compiled file
+;; FOO.elc into C, and compiles that with the system's C compiler into
+;; a shared library FOO.eln.  When Emacs loads FOO.elc, it loads FOO.eln
+;; as well, and runs the native code of a function instead of
+;; interpreting its byte code.
+;;
+;; Each instruction becomes a few lines of C that do what the byte-code
+;; interpreter in bytecode.c does for it, calling the same primitives,
+;; and the stack of the interpreter becomes a local array: since the
+;; stack depth at each instruction is known, so is the array element
+;; that each operand is in.  Native code is found by the contents of
+;; the byte-code string, so a FOO.eln that is out of date does no harm.
+;; A function that uses an instruction this does not handle, or whose
+;; stack depth cannot be worked out, stays byte code.
+;;
+;; The C code includes the headers of Emacs, and works only with the
+;; Emacs it was compiled for.  To compile it, the source tree and the
+;; build tree of that Emacs must still exist; see
+;; `byte-native-include-directories'.
+
+;;; Code:
+
+(defgroup byte-native nil
+  "Compiling byte code to native code."
+  :group 'bytecomp
+  :version "25.1")
+
+(defcustom byte-native-compiler (or (getenv "CC") "cc")
+  "The C compiler that compiles native byte code."
+  :type 'string)
+
+(defcustom byte-native-compiler-flags '("-O2")
+  "Flags to give the C compiler, in addition to those it always gets."
+  :type '(repeat string))
+
+(defun byte-native--default-include-directories ()
+  "Return the directories with the headers that native byte code needs.
+These are the directories of the C sources of Emacs and of gnulib, in
+the build tree and in the source tree."
+  (let ((build (expand-file-name "../" invocation-directory))
+        (source (expand-file-name "../" source-directory))
+        (dirs nil))
+    (dolist (tree (list build source))
+      (dolist (dir '("lib" "src"))
+        (let ((dir (expand-file-name dir tree)))
+          (when (and (file-directory-p dir)
+                     (not (member dir dirs)))
+            (push dir dirs)))))
+    dirs))
+
+(defcustom byte-native-include-directories
+  (byte-native--default-include-directories)
+  "Directories that the C compiler searches for the headers of Emacs.
+These must contain config.h and lisp.h of this very Emacs."
+  :type '(repeat directory))
+
+
+;;; Decoding byte code.
+
+(defconst byte-native--ops
+  (let ((ops (make-vector 256 nil)))
+    (dolist (op
+             '((#o60 effect "handlerlist = handlerlist->next;")
+               (#o70 binary "Fnth") (#o71 pred "SYMBOLP") (#o72 pred "CONSP")
+               (#o73 pred "STRINGP") (#o74 listp) (#o75 eq)
+               (#o76 binary "Fmemq")
+               (#o77 pred "NILP")
+               (#o100 unary "CAR") (#o101 unary "CDR") (#o102 binary "Fcons")
+               (#o103 unary "list1") (#o104 binary "list2")
+               (#o105 many 3 "Flist") (#o106 many 4 "Flist")
+               (#o107 unary "Flength") (#o110 binary "Faref")
+               (#o111 ternary "Faset") (#o112 unary "Fsymbol_value")
+               (#o113 unary "Fsymbol_function") (#o114 binary "Fset")
+               (#o115 binary "Ffset") (#o116 binary "Fget")
+               (#o117 ternary "Fsubstring")
+               (#o120 many 2 "Fconcat") (#o121 many 3 "Fconcat")
+               (#o122 many 4 "Fconcat")
+               (#o123 unary "native_sub1") (#o124 unary "native_add1")
+               (#o125 compare "ARITH_EQUAL") (#o126 compare "ARITH_GRTR")
+               (#o127 compare "ARITH_LESS")
+               (#o130 compare "ARITH_LESS_OR_EQUAL")
+               (#o131 compare "ARITH_GRTR_OR_EQUAL")
+               (#o132 arith "arith_sub2" "Fminus")
+               (#o133 unary "native_negate")
+               (#o134 arith "arith_add2" "Fplus")
+               (#o135 many 2 "Fmax") (#o136 many 2 "Fmin")
+               (#o137 arith "arith_mul2" "Ftimes")
+               (#o140 nullary "native_point")
+               (#o141 effect "record_unwind_current_buffer ();")
+               (#o142 unary "Fgoto_char") (#o143 many 1 "Finsert")
+               (#o144 nullary "native_point_max")
+               (#o145 nullary "native_point_min")
+               (#o146 unary "Fchar_after") (#o147 nullary "Ffollowing_char")
+               (#o150 nullary "Fprevious_char")
+               (#o151 nullary "native_current_column")
+               (#o152 unary "native_indent_to")
+               (#o154 nullary "Feolp") (#o155 nullary "Feobp")
+               (#o156 nullary "Fbolp") (#o157 nullary "Fbobp")
+               (#o160 nullary "Fcurrent_buffer") (#o161 unary "Fset_buffer")
+               (#o162 effect "record_unwind_current_buffer ();")
+               (#o165 unary "Fforward_char") (#o166 unary "Fforward_word")
+               (#o167 binary "Fskip_chars_forward")
+               (#o170 binary "Fskip_chars_backward")
+               (#o171 unary "Fforward_line") (#o172 unary "native_char_syntax")
+               (#o173 binary "Fbuffer_substring")
+               (#o174 binary "Fdelete_region")
+               (#o175 binary "Fnarrow_to_region")
+               (#o176 nullary "Fwiden") (#o177 unary "Fend_of_line")
+               (#o207 return) (#o210 discard) (#o211 dup)
+               (#o212 effect "record_unwind_protect (save_excursion_restore,
+\t\t\t save_excursion_save ());")
+               (#o214 effect "record_unwind_protect (save_restriction_restore,
+\t\t\t save_restriction_save ());")
+               (#o215 binary "native_catch")
+               (#o216 unwind-protect)
+               (#o217 ternary "internal_lisp_condition_case")
+               (#o223 ternary "Fset_marker")
+               (#o224 unary "Fmatch_beginning") (#o225 unary "Fmatch_end")
+               (#o226 unary "Fupcase") (#o227 unary "Fdowncase")
+               (#o230 binary "Fstring_equal") (#o231 binary "Fstring_lessp")
+               (#o232 binary "Fequal") (#o233 binary "Fnthcdr")
+               (#o234 binary "Felt") (#o235 binary "Fmember")
+               (#o236 binary "Fassq") (#o237 unary "Fnreverse")
+               (#o240 binary "Fsetcar") (#o241 binary "Fsetcdr")
+               (#o242 unary "CAR_SAFE") (#o243 unary "CDR_SAFE")
+               (#o244 many 2 "Fnconc")
+               (#o245 arith "arith_div2" "Fquo")
+               (#o246 binary "Frem")
+               (#o247 pred "NUMBERP") (#o250 pred "INTEGERP")))
+      (aset ops (car op) (cdr op)))
+    ops)
+  "The instructions without an operand, indexed by opcode.
+Each element is nil for an instruction that native code does not
+handle, or (KIND ARGS...), which `byte-native--insn-c' turns into C.")
+
+(defun byte-native--operand (bytes pc size)
+  "Return the operand of SIZE bytes at PC in the byte code BYTES."
+  (unless (<= (+ pc size) (length bytes))
+    (throw 'byte-native-unsupported "truncated instruction"))
+  (if (= size 1)
+      (aref bytes pc)
+    (+ (aref bytes pc) (ash (aref bytes (1+ pc)) 8))))
+
+(defun byte-native--decode (bytes)
+  "Decode the byte code BYTES.
+Return a vector with an element for each byte, which is (OP ARG
+NEXT) for the first byte of an instruction and nil for the others.
+OP is a symbol or an element of `byte-native--ops', ARG is the
+operand, if any, and NEXT the position of the next instruction."
+  (let ((insns (make-vector (length bytes) nil))
+        (pc 0))
+    (while (< pc (length bytes))
+      (let ((start pc)
+            (byte (aref bytes pc))
+            op arg)
+        (setq pc (1+ pc))
+        (cond
+         ((< byte #o60)
+          (setq op (aref [stack-ref varref varset varbind call unbind]
+                         (ash byte -3)))
+          (setq arg (logand byte 7))
+          (cond ((= arg 6)
+                 (setq arg (byte-native--operand bytes pc 1))
+                 (setq pc (+ pc 1)))
+                ((= arg 7)
+                 (setq arg (byte-native--operand bytes pc 2))
+                 (setq pc (+ pc 2)))))
+         ((>= byte #o300)
+          (setq op 'constant arg (- byte #o300)))
+         ((memq byte '(#o61 #o62 #o201 #o202 #o203 #o204 #o205 #o206 #o263))
+          (setq op (cdr (assq byte '((#o61 . pushconditioncase)
+                                     (#o62 . pushcatch)
+                                     (#o201 . constant)
+                                     (#o202 . goto)
+                                     (#o203 . gotoifnil)
+                                     (#o204 . gotoifnonnil)
+                                     (#o205 . gotoifnilelsepop)
+                                     (#o206 . gotoifnonnilelsepop)
+                                     (#o263 . stack-set)))))
+          (setq arg (byte-native--operand bytes pc 2))
+          (setq pc (+ pc 2)))
+         ((<= #o252 byte #o256)
+          ;; Relative jumps.
+          (setq op (aref [goto gotoifnil gotoifnonnil gotoifnilelsepop
+                               gotoifnonnilelsepop]
+                         (- byte #o252)))
+          (setq arg (+ start (byte-native--operand bytes pc 1) -126))
+          (setq pc (1+ pc)))
+         ((memq byte '(#o257 #o260 #o261 #o262 #o266))
+          (setq op (cdr (assq byte '((#o257 . list-n)
+                                     (#o260 . concat-n)
+                                     (#o261 . insert-n)
+                                     (#o262 . stack-set)
+                                     (#o266 . discard-n)))))
+          (setq arg (byte-native--operand bytes pc 1))
+          (setq pc (1+ pc)))
+         (t
+          (setq op (aref byte-native--ops byte))
+          (unless op
+            (throw 'byte-native-unsupported
+                   (format "unsupported instruction %d" byte)))
+          (unless (cdr op)
+            (setq op (car op)))))
+        (aset insns start (list op arg pc))))
+    insns))
+
+(defun byte-native--effect (op arg)
+  "Return (POPS . PUSHES) for the instruction OP with operand ARG.
+POPS is the number of values it needs on the stack, and PUSHES the
+change in stack depth plus POPS."
+  (pcase op
+    (`stack-ref (cons (1+ arg) (+ arg 2)))
+    ((or `varref `constant) '(0 . 1))
+    ((or `varset `varbind `discard `unwind-protect) '(1 . 0))
+    (`call (cons (1+ arg) 1))
+    (`unbind '(0 . 0))
+    ((or `list-n `concat-n `insert-n) (cons arg 1))
+    (`stack-set (cons (1+ arg) arg))
+    (`discard-n (let ((n (logand arg #x7f)))
+                  (if (zerop (logand arg #x80))
+                      (cons n 0)
+                    (cons (1+ n) 1))))
+    (`dup '(1 . 2))
+    (`eq '(2 . 1))
+    (`listp '(1 . 1))
+    (`(,kind . ,args)
+     (pcase kind
+       (`effect '(0 . 0))
+       (`nullary '(0 . 1))
+       ((or `unary `pred) '(1 . 1))
+       ((or `binary `arith `compare) '(2 . 1))
+       (`ternary '(3 . 1))
+       (`many (cons (car args) 1))))))
+
+(defun byte-native--depths (insns depth)
+  "Return the stack depths at the instructions INSNS.
+INSNS is a vector made by `byte-native--decode', and DEPTH is the depth
+at entry.  The value is a vector with the depth before each instruction
+that can run, and nil elsewhere."
+  (let ((depths (make-vector (length insns) nil))
+        (work (list (cons 0 depth))))
+    (while work
+      (let* ((pc (caar work))
+             (d (cdar work))
+             (insn (and (< pc (length insns)) (aref insns pc))))
+        (setq work (cdr work))
+        (unless insn
+          (throw 'byte-native-unsupported
+                 (format "no instruction at %d" pc)))
+        (cond
+         ((aref depths pc)
+          (unless (= (aref depths pc) d)
+            (throw 'byte-native-unsupported
+                   (format "inconsistent stack depth at %d" pc))))
+         (t
+          (aset depths pc d)
+          (let ((op (nth 0 insn))
+                (arg (nth 1 insn))
+                (next (nth 2 insn)))
+            (pcase op
+              (`return
+               (when (< d 1)
+                 (throw 'byte-native-unsupported "stack underflow")))
+              (`goto (push (cons arg d) work))
+              ((or `gotoifnil `gotoifnonnil `pushcatch `pushconditioncase)
+               (when (< d 1)
+                 (throw 'byte-native-unsupported "stack underflow"))
+               (push (cons arg (if (memq op '(gotoifnil gotoifnonnil))
+                                   (1- d)
+                                 d))
+                     work)
+               (push (cons next (1- d)) work))
+              ((or `gotoifnilelsepop `gotoifnonnilelsepop)
+               (when (< d 1)
+                 (throw 'byte-native-unsupported "stack underflow"))
+               (push (cons arg d) work)
+               (push (cons next (1- d)) work))
+              (_
+               (let ((effect (byte-native--effect op arg)))
+                 (when (or (< d (car effect))
+                           (and (eq op 'stack-ref) (= arg 0)))
+                   (throw 'byte-native-unsupported "stack underflow"))
+                 (push (cons next (+ d (- (car effect)) (cdr effect)))
+                       work)))))))))
+    depths))
+
+
+;;; Generating C.
+
+(defconst byte-native--preamble
+  "/* Generated by byte-native.el.  Do not edit.  */
+
+#include <config.h>
+#include \"lisp.h\"
+#include \"blockinput.h\"
+#include \"keyboard.h\"
+#include \"buffer.h\"
+#include \"character.h\"
+#include \"syntax.h\"
+
+#if BYTE_MARK_STACK
+# error \"native byte code needs conservative stack marking\"
+#endif
+
+const char native_byte_code_abi[] = NATIVE_BYTE_CODE_ABI;
+
+static void
+native_quit (void)
+{
+  if (!NILP (Vquit_flag) && NILP (Vinhibit_quit))
+    {
+      Lisp_Object flag = Vquit_flag;
+      Vquit_flag = Qnil;
+      if (EQ (Vthrow_on_input, flag))
+	Fthrow (Vthrow_on_input, Qt);
+      Fsignal (Qquit, Qnil);
+    }
+  else if (pending_signals)
+    process_pending_signals ();
+}
+
+static Lisp_Object
+native_varref (Lisp_Object sym)
+{
+  Lisp_Object v;
+  if (!SYMBOLP (sym)
+      || XSYMBOL (sym)->redirect != SYMBOL_PLAINVAL
+      || (v = SYMBOL_VAL (XSYMBOL (sym)), EQ (v, Qunbound)))
+    v = Fsymbol_value (sym);
+  return v;
+}
+
+static void
+native_varset (Lisp_Object sym, Lisp_Object val)
+{
+  if (SYMBOLP (sym)
+      && !EQ (val, Qunbound)
+      && !XSYMBOL (sym)->redirect
+      && !SYMBOL_CONSTANT_P (sym))
+    SET_SYMBOL_VAL (XSYMBOL (sym), val);
+  else
+    set_internal (sym, val, Qnil, 0);
+}
+
+static Lisp_Object
+native_catch (Lisp_Object tag, Lisp_Object body)
+{
+  return internal_catch (tag, eval_sub, body);
+}
+
+static void
+native_bcall0 (Lisp_Object f)
+{
+  Ffuncall (1, &f);
+}
+
+static Lisp_Object
+native_sub1 (Lisp_Object x)
+{
+  return INTEGERP (x) ? make_number (XINT (x) - 1) : Fsub1 (x);
+}
+
+static Lisp_Object
+native_add1 (Lisp_Object x)
+{
+  return INTEGERP (x) ? make_number (XINT (x) + 1) : Fadd1 (x);
+}
+
+static Lisp_Object
+native_negate (Lisp_Object x)
+{
+  return INTEGERP (x) ? make_number (- XINT (x)) : Fminus (1, &x);
+}
+
+static Lisp_Object
+native_compare (Lisp_Object x, Lisp_Object y, enum Arith_Comparison c)
+{
+  Lisp_Object result;
+  if (!arithcompare2 (x, y, c, &result))
+    result = arithcompare (x, y, c);
+  return result;
+}
+
+static Lisp_Object
+native_point (void)
+{
+  return make_number (PT);
+}
+
+static Lisp_Object
+native_point_max (void)
+{
+  return make_number (ZV);
+}
+
+static Lisp_Object
+native_point_min (void)
+{
+  return make_number (BEGV);
+}
+
+static Lisp_Object
+native_current_column (void)
+{
+  return make_number (current_column ());
+}
+
+static Lisp_Object
+native_indent_to (Lisp_Object column)
+{
+  return Findent_to (column, Qnil);
+}
+
+static Lisp_Object
+native_char_syntax (Lisp_Object x)
+{
+  int c;
+  CHECK_CHARACTER (x);
+  c = XFASTINT (x);
+  if (NILP (BVAR (current_buffer, enable_multibyte_characters)))
+    MAKE_CHAR_MULTIBYTE (c);
+  return make_number (syntax_code_spec[SYNTAX (c)]);
+}
+"
+  "The beginning of the C code of native byte code.
+It defines what the generated functions use besides the primitives.")
+
+(defun byte-native--insn-c (op arg d)
+  "Return C code for the instruction OP with operand ARG.
+D is the stack depth before the instruction."
+  (let ((top (1- d)))
+    (pcase op
+      (`stack-ref (format "s[%d] = s[%d];" d (- top arg)))
+      (`varref (format "s[%d] = native_varref (vectorp[%d]);" d arg))
+      (`varset (format "native_varset (vectorp[%d], s[%d]);" arg top))
+      (`varbind (format "specbind (vectorp[%d], s[%d]);" arg top))
+      (`call (format "s[%d] = Ffuncall (%d, &s[%d]);"
+                     (- top arg) (1+ arg) (- top arg)))
+      (`unbind (format "unbind_to (SPECPDL_INDEX () - %d, Qnil);" arg))
+      (`constant (format "s[%d] = vectorp[%d];" d arg))
+      (`goto (format "maybe_gc ();
+  native_quit ();
+  goto L%d;" arg))
+      ((or `gotoifnil `gotoifnonnil `gotoifnilelsepop `gotoifnonnilelsepop)
+       ;; The `elsepop' variants differ only in the stack depth at the
+       ;; target.
+       (format "if (%sNILP (s[%d]))
+    {
+      maybe_gc ();
+      native_quit ();
+      goto L%d;
+    }"
+               (if (memq op '(gotoifnil gotoifnilelsepop)) "" "!") top arg))
+      ((or `pushcatch `pushconditioncase)
+       ;; The address of the stack must escape, so that the C compiler
+       ;; keeps it up to date in memory for the longjmp.
+       (format "{
+    struct handler *c;
+    PUSH_HANDLER (c, s[%d], %s);
+    c->bytecode_top = &s[%d];
+    if (sys_setjmp (c->jmp))
+      {
+	c = handlerlist;
+	handlerlist = c->next;
+	s[%d] = c->val;
+	goto L%d;
+      }
+  }"
+               top (if (eq op 'pushcatch) "CATCHER" "CONDITION_CASE")
+               top top arg))
+      (`return (format "return s[%d];" top))
+      (`discard "")
+      (`dup (format "s[%d] = s[%d];" d top))
+      (`eq (format "s[%d] = EQ (s[%d], s[%d]) ? Qt : Qnil;"
+                   (1- top) (1- top) top))
+      (`listp (format "s[%d] = CONSP (s[%d]) || NILP (s[%d]) ? Qt : Qnil;"
+                      top top top))
+      (`unwind-protect
+       (format "record_unwind_protect (NILP (Ffunctionp (s[%d]))
+\t\t\t ? unwind_body : native_bcall0,
+\t\t\t s[%d]);"
+               top top))
+      ((or `list-n `concat-n `insert-n)
+       (format "s[%d] = %s (%d, &s[%d]);" (- d arg)
+               (cdr (assq op '((list-n . "Flist")
+                               (concat-n . "Fconcat")
+                               (insert-n . "Finsert"))))
+               arg (- d arg)))
+      (`stack-set (format "s[%d] = s[%d];" (- top arg) top))
+      (`discard-n
+       (if (zerop (logand arg #x80))
+           ""
+         (format "s[%d] = s[%d];" (- top (logand arg #x7f)) top)))
+      (`(,kind . ,args)
+       (pcase kind
+         (`effect (car args))
+         (`nullary (format "s[%d] = %s ();" d (car args)))
+         (`unary (format "s[%d] = %s (s[%d]);" top (car args) top))
+         (`pred (format "s[%d] = %s (s[%d]) ? Qt : Qnil;"
+                        top (car args) top))
+         (`binary (format "s[%d] = %s (s[%d], s[%d]);"
+                          (1- top) (car args) (1- top) top))
+         (`ternary (format "s[%d] = %s (s[%d], s[%d], s[%d]);"
+                           (- top 2) (car args) (- top 2) (1- top) top))
+         (`many (let ((bottom (- d (nth 0 args))))
+                  (format "s[%d] = %s (%d, &s[%d]);"
+                          bottom (nth 1 args) (nth 0 args) bottom)))
+         (`arith (format "if (!%s (s[%d], s[%d], &s[%d]))
+    s[%d] = %s (2, &s[%d]);"
+                         (nth 0 args) (1- top) top (1- top)
+                         (1- top) (nth 1 args) (1- top)))
+         (`compare (format "s[%d] = native_compare (s[%d], s[%d], %s);"
+                           (1- top) (1- top) top (car args))))))))
+
+(defun byte-native--function-c (name bytes depth)
+  "Return the C function NAME that runs the byte code BYTES.
+DEPTH is the stack depth at entry.  Throw to `byte-native-unsupported'
+if native code cannot run BYTES."
+  (let* ((insns (byte-native--decode bytes))
+         (depths (byte-native--depths insns depth))
+         (targets (make-bool-vector (length insns) nil))
+         (max (max depth 1))
+         (body nil))
+    (dotimes (pc (length insns))
+      (let ((insn (aref insns pc))
+            (d (aref depths pc)))
+        (when d
+          (when (memq (car insn) '(goto gotoifnil gotoifnonnil
+                                        gotoifnilelsepop gotoifnonnilelsepop
+                                        pushcatch pushconditioncase))
+            (aset targets (nth 1 insn) t))
+          (unless (memq (car insn) '(goto gotoifnil gotoifnonnil
+                                          gotoifnilelsepop gotoifnonnilelsepop
+                                          return pushcatch pushconditioncase))
+            ;; The instruction writes at most up to its depth at exit.
+            (let ((effect (byte-native--effect (nth 0 insn) (nth 1 insn))))
+              (setq max (max max (+ d (- (car effect)) (cdr effect)))))))))
+    (dotimes (pc (length insns))
+      (let ((insn (aref insns pc))
+            (d (aref depths pc)))
+        (when d
+          (when (aref targets pc)
+            (push (format " L%d:;\n" pc) body))
+          (let ((c (byte-native--insn-c (nth 0 insn) (nth 1 insn) d)))
+            (unless (equal c "")
+              (push (concat "  " c "\n") body))))))
+    (concat (format "static Lisp_Object
+%s (Lisp_Object *vectorp, Lisp_Object *args)
+{
+  Lisp_Object s[%d];\n"
+                    name max)
+            (mapconcat (lambda (i) (format "  s[%d] = args[%d];\n" i i))
+                       (number-sequence 0 (1- depth)) "")
+            (apply #'concat (nreverse body))
+            "}\n")))
+
+(defun byte-native--string-c (bytes)
+  "Return the C string literal for the unibyte string BYTES."
+  (let ((parts nil)
+        (i 0))
+    (while (< i (length bytes))
+      (push (apply #'concat
+                   (mapcar (lambda (b) (format "\\%03o" b))
+                           (substring bytes i (min (length bytes) (+ i 16)))))
+            parts)
+      (setq i (+ i 16)))
+    (if parts
+        (mapconcat (lambda (part) (concat "\"" part "\""))
+                   (nreverse parts) "\n     ")
+      "\"\"")))
+
+
+;;; Collecting the byte code of a file.
+
+(defun byte-native--entry-depth (function)
+  "Return the stack depth at entry to the byte-code FUNCTION."
+  (let ((template (aref function 0)))
+    (if (integerp template)
+        (+ (ash template -8)
+           (if (zerop (logand template 128)) 0 1))
+      0)))
+
+(defun byte-native--lazy-code (pos)
+  "Return the code of a lazy-loaded function, as (BYTES . CONSTANTS).
+POS is the file position of the code in the byte-compiled file in the
+current buffer, which holds it quoted like a dynamic doc string."
+  (save-excursion
+    (goto-char (1+ pos))
+    (let ((start (point)))
+      (skip-chars-forward "^\037")
+      (read (replace-regexp-in-string
+             "\001." (lambda (quoted)
+                       (cdr (assq (aref quoted 1) '((?\001 . "\001")
+                                                    (?0 . "\0")
+                                                    (?_ . "\037")))))
+             (buffer-substring start (point)) t t)))))
+
+(defun byte-native--collect (form table seen)
+  "Add the byte-code functions in FORM to TABLE.
+The keys of TABLE are (BYTES . DEPTH), with the unibyte byte code and
+the stack depth at entry of each function.  SEEN is a hash table of the
+conses and vectors already walked, for circular structure.  The
+current buffer holds the byte-compiled file that FORM comes from."
+  (while (and (or (consp form) (vectorp form) (byte-code-function-p form))
+              (not (gethash form seen)))
+    (puthash form t seen)
+    (cond
+     ((consp form)
+      (byte-native--collect (car form) table seen)
+      (setq form (cdr form)))
+     (t
+      (when (byte-code-function-p form)
+        (let ((bytes (aref form 1)))
+          (when (and (consp bytes) (integerp (cdr bytes)))
+            (let ((code (byte-native--lazy-code (cdr bytes))))
+              (setq bytes (car code))
+              (byte-native--collect (cdr code) table seen)))
+          (when (stringp bytes)
+            (when (multibyte-string-p bytes)
+              (setq bytes (string-as-unibyte bytes)))
+            (puthash (cons bytes (byte-native--entry-depth form)) t table))))
+      (dotimes (i (length form))
+        (byte-native--collect (aref form i) table seen))
+      (setq form nil)))))
+
+(defun byte-native--file-functions (file)
+  "Return the byte code of the functions in the byte-compiled FILE.
+The value is a list of (BYTES . DEPTH)."
+  (let ((table (make-hash-table :test 'equal))
+        (seen (make-hash-table :test 'eq))
+        (functions nil))
+    (with-temp-buffer
+      (insert-file-contents-literally file)
+      (goto-char (point-min))
+      (condition-case nil
+          (while t
+            (byte-native--collect (read (current-buffer)) table seen))
+        (end-of-file nil)))
+    (maphash (lambda (key _) (push key functions)) table)
+    (sort functions (lambda (a b) (string< (car a) (car b))))))
+
+
+;;; Compiling.
+
+(defun byte-native--file-c (file)
+  "Return C code for the functions in the byte-compiled FILE.
+The value is (CODE COMPILED TOTAL), where COMPILED is the number of
+functions that have native code and TOTAL the number of functions."
+  (let ((functions (byte-native--file-functions file))
+        (defs nil)
+        (table nil)
+        (n 0))
+    (dolist (function functions)
+      (let* ((name (format "native_%d" n))
+             (def (catch 'byte-native-unsupported
+                    (list (byte-native--function-c name (car function)
+                                                   (cdr function))))))
+        (when (consp def)
+          (push (car def) defs)
+          (push (format "  { %s,\n    %d, %d, %s }"
+                        (byte-native--string-c (car function))
+                        (length (car function)) (cdr function) name)
+                table)
+          (setq n (1+ n)))))
+    (list (concat byte-native--preamble
+                  (mapconcat (lambda (def) (concat "\n" def))
+                             (nreverse defs) "")
+                  "
+const struct native_byte_code native_byte_code_table[] =
+  {\n"
+                  (mapconcat #'identity (nreverse table) ",\n")
+                  (if table "\n" "  { \"\", 0, 0, NULL }\n")
+                  "  };\n\nconst ptrdiff_t native_byte_code_count = "
+                  (number-to-string n) ";\n")
+          n (length functions))))
+
+;;;###autoload
+(defun byte-native-compile-file (file)
+  "Compile the byte code in FILE to native code.
+FILE is a byte-compiled file FOO.elc, or a source file FOO.el, which
+this byte-compiles first.  Write the native code to FOO.eln, which
+`load' loads along with FOO.elc from then on.  Return the name of
+FOO.eln.
+
+An Emacs that has loaded FOO.eln before keeps using the native code
+it loaded then; the new FOO.eln takes effect in the next session."
+  (interactive "fNative compile file: ")
+  (setq file (expand-file-name file))
+  (unless (string-match "\\.elc\\'" file)
+    (require 'bytecomp)
+    (unless (byte-compile-file file)
+      (error "Byte compiling %s failed" file))
+    (setq file (byte-compile-dest-file file)))
+  (let* ((eln (concat (file-name-sans-extension file) ".eln"))
+         (c-file (make-temp-file "byte-native" nil ".c"))
+         ;; Write to a new file and rename it, since this Emacs may have
+         ;; the old FOO.eln mapped.
+         (tmp (make-temp-name (concat eln "-")))
+         (c (byte-native--file-c file)))
+    (unwind-protect
+        (with-temp-buffer
+          (let ((coding-system-for-write 'no-conversion))
+            (write-region (nth 0 c) nil c-file nil 'silent))
+          (unless (eq 0 (apply #'call-process byte-native-compiler nil t nil
+                               (append
+                                (list "-shared" "-fPIC" "-Demacs")
+                                (mapcar (lambda (dir) (concat "-I" dir))
+                                        byte-native-include-directories)
+                                byte-native-compiler-flags
+                                (list "-o" tmp c-file))))
+            (error "Compiling %s failed:\n%s" file (buffer-string)))
+          (rename-file tmp eln t))
+      (delete-file c-file)
+      (when (file-exists-p tmp)
+        (delete-file tmp)))
+    (message "Compiled %d of %d functions in %s to native code"
+             (nth 1 c) (nth 2 c) file)
+    eln))
+
+;;;###autoload
+(defun batch-byte-native-compile ()
+  "Run `byte-native-compile-file' on the files remaining on the command line.
+Use this from the command line, with `-batch'; it kills Emacs when
+done, with exit status 0 if it compiled all files and 1 otherwise.
+For example, invoke \"emacs -batch -f batch-byte-native-compile foo.el\"."
+  (unless noninteractive
+    (error "`batch-byte-native-compile' is to be used only with -batch"))
+  (let ((error nil))
+    (dolist (file command-line-args-left)
+      (condition-case err
+          (byte-native-compile-file file)
+        (error
+         (message "%s: %s" file (error-message-string err))
+         (setq error t))))
+    (setq command-line-args-left nil)
+    (kill-emacs (if error 1 0))))
+
+(provide 'byte-native)
+
+;;; byte-native.el ends here
@@ -675,7 +675,8 @@ SORT-PRED if desired."
 (defun chart-emacs-storage ()
   "Chart the current storage requirements of Emacs."
   (interactive)
-  (let* ((data (garbage-collect)))
+  (let* ((data (delq nil (mapcar (lambda (x) (and (numberp (nth 2 x)) x))
+                               (garbage-collect)))))
     ;; Let's create the chart!
     (chart-bar-quickie 'vertical "Emacs Runtime Storage Usage"
 		       (mapcar (lambda (x) (symbol-name (car x))) data)
@@ -71,7 +71,8 @@
 
 ;; This is a poor man's `last', since we haven't loaded subr.el yet.
 (if (or (equal (member "bootstrap" command-line-args) '("bootstrap"))
-	(equal (member "dump" command-line-args) '("dump")))
+	(equal (member "dump" command-line-args) '("dump"))
+	(equal (member "pdump" command-line-args) '("pdump")))
     (progn
       ;; To reduce the size of dumped Emacs, we avoid making huge char-tables.
       (setq inhibit-load-charset-map t)
@@ -310,7 +311,7 @@ lost after dumping")))
 ;; file primitive.  So the only workable solution to support building
 ;; in non-ASCII directories is to manipulate unibyte strings in the
 ;; current locale's encoding.
-(if (and (member (car (last command-line-args)) '("dump" "bootstrap"))
+(if (and (member (car (last command-line-args)) '("dump" "pdump" "bootstrap"))
 	 (multibyte-string-p default-directory))
     (error "default-directory must be unibyte when dumping Emacs!"))
 
@@ -335,7 +336,7 @@ lost after dumping")))
 
 
 (message "Finding pointers to doc strings...")
-(if (equal (last command-line-args) '("dump"))
+(if (member (car (last command-line-args)) '("dump" "pdump"))
     (Snarf-documentation "DOC")
   (condition-case nil
       (Snarf-documentation "DOC")
@@ -399,6 +400,13 @@ lost after dumping")))
 (if (null (garbage-collect))
     (setq pure-space-overflow t))
 
+(if (equal (last command-line-args) '("pdump"))
+    (progn
+      (message "Dumping into emacs.pdmp")
+      (dump-emacs-portable "emacs.pdmp")
+      (message "%d pure bytes used" pure-bytes-used)
+      (kill-emacs)))
+
 (if (member (car (last command-line-args)) '("dump" "bootstrap"))
     (progn
       (message "Dumping under the name emacs")
@@ -138,7 +138,7 @@ HIST, if non-nil, specifies a history list as with `completing-read'."
 (defun rng-completion-exact-p (string table predicate)
   (cond ((symbolp table)
 	 (funcall table string predicate 'lambda))
-	((vectorp table)
+	((or (vectorp table) (obarrayp table))
 	 (intern-soft string table))
 	(t (assoc string table))))
 
@@ -0,0 +1,289 @@
+/* mod-test.c - Sample module for the dynamic module interface.
+
+Copyright (C) 2014 Free Software Foundation, Inc.
+
+This file is part of GNU Emacs.
+
+GNU Emacs is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+GNU Emacs is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.  */
+
+/* This module shows how to use emacs-module.h, and exercises it for
+   test/automated/emacs-module-tests.el.  Build it with the Makefile
+   in this directory, and load it with (module-load "mod-test.so").  */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <emacs-module.h>
+
+int plugin_is_GPL_compatible;
+
+/* Always return t.  */
+
+static emacs_value
+Fmod_test_return_t (emacs_env *env, ptrdiff_t nargs, emacs_value args[],
+		    void *data)
+{
+  return env->intern (env, "t");
+}
+
+/* Return the sum of two integers.  */
+
+static emacs_value
+Fmod_test_sum (emacs_env *env, ptrdiff_t nargs, emacs_value args[],
+	       void *data)
+{
+  intmax_t a = env->extract_integer (env, args[0]);
+  intmax_t b = env->extract_integer (env, args[1]);
+
+  if (env->non_local_exit_check (env) != emacs_funcall_exit_return)
+    return NULL;
+  return env->make_integer (env, a + b);
+}
+
+/* Return the DATA pointer given to make_function, as an integer.  */
+
+static emacs_value
+Fmod_test_data (emacs_env *env, ptrdiff_t nargs, emacs_value args[],
+		void *data)
+{
+  return env->make_integer (env, (intptr_t) data);
+}
+
+/* Signal (error 56).  */
+
+static emacs_value
+Fmod_test_signal (emacs_env *env, ptrdiff_t nargs, emacs_value args[],
+		  void *data)
+{
+  emacs_value list = env->intern (env, "list");
+  emacs_value fifty_six = env->make_integer (env, 56);
+
+  env->non_local_exit_signal (env, env->intern (env, "error"),
+			      env->funcall (env, list, 1, &fifty_six));
+  return NULL;
+}
+
+/* Throw 65 to the tag `tag'.  */
+
+static emacs_value
+Fmod_test_throw (emacs_env *env, ptrdiff_t nargs, emacs_value args[],
+		 void *data)
+{
+  env->non_local_exit_throw (env, env->intern (env, "tag"),
+			     env->make_integer (env, 65));
+  return NULL;
+}
+
+/* Call the function ARGS[0] without arguments.  Return (normal . VALUE)
+   if it returns VALUE, (signal SYMBOL . DATA) if it signals, and
+   (throw TAG . VALUE) if it throws.  */
+
+static emacs_value
+Fmod_test_non_local_exit_funcall (emacs_env *env, ptrdiff_t nargs,
+				  emacs_value args[], void *data)
+{
+  emacs_value result = env->funcall (env, args[0], 0, NULL);
+  emacs_value symbol, exit_data, cons, pair[2];
+  enum emacs_funcall_exit exit
+    = env->non_local_exit_get (env, &symbol, &exit_data);
+
+  /* Nothing works while the exit is pending, so clear it first.  */
+  env->non_local_exit_clear (env);
+  cons = env->intern (env, "cons");
+  if (exit == emacs_funcall_exit_return)
+    {
+      pair[0] = env->intern (env, "normal");
+      pair[1] = result;
+      return env->funcall (env, cons, 2, pair);
+    }
+  pair[0] = symbol;
+  pair[1] = exit_data;
+  pair[1] = env->funcall (env, cons, 2, pair);
+  pair[0] = env->intern (env, (exit == emacs_funcall_exit_signal
+			       ? "signal" : "throw"));
+  return env->funcall (env, cons, 2, pair);
+}
+
+/* Return a string of 100 `x' characters through a global reference,
+   which stays valid after this function returns.  */
+
+static emacs_value
+Fmod_test_globref_make (emacs_env *env, ptrdiff_t nargs, emacs_value args[],
+			void *data)
+{
+  char buffer[100];
+  emacs_value string, ref;
+
+  memset (buffer, 'x', sizeof buffer);
+  string = env->make_string (env, buffer, sizeof buffer);
+  ref = env->make_global_ref (env, string);
+  env->free_global_ref (env, env->make_global_ref (env, string));
+  return ref;
+}
+
+/* Return a copy of the string ARGS[0] with each `a' replaced by `b'.  */
+
+static emacs_value
+Fmod_test_string_a_to_b (emacs_env *env, ptrdiff_t nargs, emacs_value args[],
+			 void *data)
+{
+  ptrdiff_t size = 0, i;
+  char *buffer;
+  emacs_value result;
+
+  if (!env->copy_string_contents (env, args[0], NULL, &size))
+    return NULL;
+  buffer = malloc (size);
+  if (!buffer)
+    return NULL;
+  env->copy_string_contents (env, args[0], buffer, &size);
+  for (i = 0; i + 1 < size; i++)
+    if (buffer[i] == 'a')
+      buffer[i] = 'b';
+  result = env->make_string (env, buffer, size - 1);
+  free (buffer);
+  return result;
+}
+
+/* Match the pattern ARGS[0] against the string ARGS[1] as the flex
+   completion style does: the characters of the pattern must appear in
+   the string in order, with anything between them.  Return the number
+   of characters skipped after the first match, or nil if there is no
+   match.  Both strings must be shorter than 256 bytes.  */
+
+static emacs_value
+Fmod_test_flex_match (emacs_env *env, ptrdiff_t nargs, emacs_value args[],
+		      void *data)
+{
+  char string[256], pattern[256];
+  ptrdiff_t string_size = sizeof string, pattern_size = sizeof pattern;
+  const char *s, *p;
+  intmax_t gaps = 0;
+
+  if (!env->copy_string_contents (env, args[0], pattern, &pattern_size)
+      || !env->copy_string_contents (env, args[1], string, &string_size))
+    return NULL;
+  for (s = string, p = pattern; *p && *s; s++)
+    if (*s == *p)
+      p++;
+    else if (p != pattern)
+      gaps++;
+  if (*p)
+    return env->intern (env, "nil");
+  return env->make_integer (env, gaps);
+}
+
+/* Fill the vector ARGS[0] with ARGS[1], and return t.  */
+
+static emacs_value
+Fmod_test_vector_fill (emacs_env *env, ptrdiff_t nargs, emacs_value args[],
+		       void *data)
+{
+  ptrdiff_t size = env->vec_size (env, args[0]), i;
+
+  for (i = 0; i < size; i++)
+    env->vec_set (env, args[0], i, args[1]);
+  return env->intern (env, "t");
+}
+
+/* Return t if all elements of the vector ARGS[0] are `eq' to ARGS[1].  */
+
+static emacs_value
+Fmod_test_vector_eq (emacs_env *env, ptrdiff_t nargs, emacs_value args[],
+		     void *data)
+{
+  ptrdiff_t size = env->vec_size (env, args[0]), i;
+
+  for (i = 0; i < size; i++)
+    if (!env->eq (env, env->vec_get (env, args[0], i), args[1]))
+      return env->intern (env, "nil");
+  return env->intern (env, "t");
+}
+
+/* Return the sum of all arguments, which may be floats, as a float.  */
+
+static emacs_value
+Fmod_test_float_sum (emacs_env *env, ptrdiff_t nargs, emacs_value args[],
+		     void *data)
+{
+  emacs_value float_type = env->intern (env, "float");
+  double sum = 0;
+  ptrdiff_t i;
+
+  for (i = 0; i < nargs; i++)
+    if (env->eq (env, env->type_of (env, args[i]), float_type))
+      sum += env->extract_float (env, args[i]);
+    else
+      sum += env->extract_integer (env, args[i]);
+  return env->make_float (env, sum);
+}
+
+/* Bind NAME to FUN.  */
+
+static void
+bind_function (emacs_env *env, const char *name, emacs_value fun)
+{
+  emacs_value args[2];
+
+  args[0] = env->intern (env, name);
+  args[1] = fun;
+  env->funcall (env, env->intern (env, "defalias"), 2, args);
+}
+
+/* Provide FEATURE.  */
+
+static void
+provide (emacs_env *env, const char *feature)
+{
+  emacs_value symbol = env->intern (env, feature);
+
+  env->funcall (env, env->intern (env, "provide"), 1, &symbol);
+}
+
+int
+emacs_module_init (struct emacs_runtime *ert)
+{
+  emacs_env *env;
+
+  if (ert->size < sizeof *ert)
+    return 1;
+  env = ert->get_environment (ert);
+  if (env->size < sizeof *env)
+    return 2;
+
+#define DEFUN(lsym, csym, amin, amax, doc, data)			\
+  bind_function (env, lsym,						\
+		 env->make_function (env, amin, amax, csym, doc, data))
+
+  DEFUN ("mod-test-return-t", Fmod_test_return_t, 1, 1, NULL, NULL);
+  DEFUN ("mod-test-sum", Fmod_test_sum, 2, 2,
+	 "Return A + B.\n\n(fn A B)", NULL);
+  DEFUN ("mod-test-data", Fmod_test_data, 0, 0, NULL, (void *) 42);
+  DEFUN ("mod-test-signal", Fmod_test_signal, 0, 0, NULL, NULL);
+  DEFUN ("mod-test-throw", Fmod_test_throw, 0, 0, NULL, NULL);
+  DEFUN ("mod-test-non-local-exit-funcall", Fmod_test_non_local_exit_funcall,
+	 1, 1, NULL, NULL);
+  DEFUN ("mod-test-globref-make", Fmod_test_globref_make, 0, 0, NULL, NULL);
+  DEFUN ("mod-test-string-a-to-b", Fmod_test_string_a_to_b, 1, 1, NULL, NULL);
+  DEFUN ("mod-test-flex-match", Fmod_test_flex_match, 2, 2, NULL, NULL);
+  DEFUN ("mod-test-vector-fill", Fmod_test_vector_fill, 2, 2, NULL, NULL);
+  DEFUN ("mod-test-vector-eq", Fmod_test_vector_eq, 2, 2, NULL, NULL);
+  DEFUN ("mod-test-float-sum", Fmod_test_float_sum,
+	 0, emacs_variadic_function, NULL, NULL);
+
+#undef DEFUN
+
+  provide (env, "mod-test");
+  return 0;
+}
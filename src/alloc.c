@@ -29,6 +29,7 @@ along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.  */
 
 #ifdef HAVE_PTHREAD
 #include <pthread.h>
+#include <signal.h>		/* For pthread_sigmask.  */
 #endif
 
 #include "lisp.h"
@@ -141,6 +142,20 @@ EMACS_INT memory_full_cons_threshold;
 
 bool gc_in_progress;
 
+/* True while an incremental collection is under way, from its first
+   mark slice until its final phase.  See gc_step_when_idle.  */
+
+bool gc_marking_incrementally;
+
+/* True if the next automatic collection must be a full one.  */
+
+static bool gc_full_pending;
+
+/* Number of bytes of live objects just after the last full
+   collection.  */
+
+static EMACS_INT gc_live_after_full;
+
 /* True means abort if try to GC.
    This is for code which is written on the assumption that
    no GC will happen, so as to verify that assumption.  */
@@ -181,7 +196,7 @@ static ptrdiff_t pure_size;
 /* Number of bytes of pure storage used before pure storage overflowed.
    If this is non-zero, this implies that an overflow occurred.  */
 
-static ptrdiff_t pure_bytes_used_before_overflow;
+ptrdiff_t pure_bytes_used_before_overflow;
 
 /* True if P points into pure space.  */
 
@@ -190,11 +205,18 @@ static ptrdiff_t pure_bytes_used_before_overflow;
 
 /* Index in pure at which next pure Lisp object will be allocated..  */
 
-static ptrdiff_t pure_bytes_used_lisp;
+ptrdiff_t pure_bytes_used_lisp;
 
 /* Number of bytes allocated for non-Lisp objects in pure storage.  */
 
-static ptrdiff_t pure_bytes_used_non_lisp;
+ptrdiff_t pure_bytes_used_non_lisp;
+
+/* The Lisp objects allocated in pure storage, as offsets from `pure'
+   times 8 plus the Lisp type.  Pure storage has no object headers, so
+   this is the only way to find all of them.  */
+
+ptrdiff_t *pure_objects;
+ptrdiff_t pure_objects_used, pure_objects_size;
 
 /* If nonzero, this is a warning delivered by malloc and not yet
    displayed.  */
@@ -271,7 +293,7 @@ static Lisp_Object Qvectors;
 static Lisp_Object Qfloats;
 static Lisp_Object Qintervals;
 static Lisp_Object Qbuffers;
-static Lisp_Object Qstring_bytes, Qvector_slots, Qheap;
+static Lisp_Object Qstring_bytes, Qvector_slots, Qheap, Qsweep_time;
 static Lisp_Object Qgc_cons_threshold;
 Lisp_Object Qautomatic_gc;
 Lisp_Object Qchar_table_extra_slots;
@@ -281,7 +303,7 @@ Lisp_Object Qchar_table_extra_slots;
 static Lisp_Object Qpost_gc_hook;
 
 static void mark_terminals (void);
-static void gc_sweep (void);
+static void gc_sweep (bool);
 static Lisp_Object make_pure_vector (ptrdiff_t);
 static void mark_buffer (struct buffer *);
 
@@ -389,6 +411,53 @@ static void *min_heap_address, *max_heap_address;
 static struct mem_node mem_z;
 #define MEM_NIL &mem_z
 
+/* The granule map.  It divides the address space into granules of
+   MEM_GRANULE_BYTES, and records for each granule how many nodes of
+   the tree overlap it, and which node if only one does.  That lets
+   mem_find do without searching the tree for most addresses.  The
+   tree is still searched for granules shared by several blocks,
+   which happens mostly with small blocks allocated by lisp_malloc.
+
+   A granule is as big as BLOCK_ALIGN, so that each cons or float
+   block gets granules of its own.  The map has three levels, and
+   covers the lower MEM_MAP_ADDRESS_BITS bits of the address space.  */
+
+enum { MEM_GRANULE_BITS = 10,
+       MEM_LEAF_BITS = 12,
+       MEM_MID_BITS = 13,
+       MEM_MAP_ADDRESS_BITS = 48 };
+
+#define MEM_GRANULE_BYTES (1 << MEM_GRANULE_BITS)
+#define MEM_TOP_BITS \
+  (MEM_MAP_ADDRESS_BITS - MEM_GRANULE_BITS - MEM_LEAF_BITS - MEM_MID_BITS)
+
+struct mem_granule
+{
+  /* The node overlapping this granule, or NULL if none or several
+     nodes do, or did since the granule was last unused.  */
+  struct mem_node *node;
+
+  /* How many nodes overlap this granule.  */
+  int count;
+};
+
+struct mem_map_leaf
+{
+  struct mem_granule granules[1 << MEM_LEAF_BITS];
+};
+
+struct mem_map_mid
+{
+  struct mem_map_leaf *leaves[1 << MEM_MID_BITS];
+};
+
+static struct mem_map_mid *mem_map[1 << MEM_TOP_BITS];
+
+/* True if some node could not be recorded in the map, so that
+   mem_find must search the tree.  */
+
+static bool mem_map_incomplete;
+
 static struct mem_node *mem_insert (void *, void *, enum mem_type);
 static void mem_insert_fixup (struct mem_node *);
 static void mem_rotate_left (struct mem_node *);
@@ -411,11 +480,11 @@ struct gcpro *gcprolist;
    value; otherwise some compilers put it into BSS.  */
 
 enum { NSTATICS = 2048 };
-static Lisp_Object *staticvec[NSTATICS] = {&Vpurify_flag};
+Lisp_Object *staticvec[NSTATICS] = {&Vpurify_flag};
 
 /* Index of next unused slot in staticvec.  */
 
-static int staticidx;
+int staticidx;
 
 static void *pure_alloc (size_t, int);
 
@@ -1041,6 +1110,11 @@ aligned_alloc (size_t alignment, size_t size)
 /* BLOCK_ALIGN has to be a power of 2.  */
 #define BLOCK_ALIGN (1 << 10)
 
+#if GC_MARK_STACK || defined GC_MALLOC_CHECK
+/* Each aligned block has granules of its own in the granule map.  */
+verify (BLOCK_ALIGN == MEM_GRANULE_BYTES);
+#endif
+
 /* Padding to leave at the end of a malloc'd block.  This is to give
    malloc a chance to minimize the amount of memory wasted to alignment.
    It should be tuned to the particular malloc library used.
@@ -1595,7 +1669,9 @@ static void
 init_strings (void)
 {
   empty_unibyte_string = make_pure_string ("", 0, 0, 0);
+  staticpro (&empty_unibyte_string);
   empty_multibyte_string = make_pure_string ("", 0, 0, 1);
+  staticpro (&empty_multibyte_string);
 }
 
 
@@ -2356,10 +2432,12 @@ make_formatted_string (char *buf, const char *format, ...)
 /* We store float cells inside of float_blocks, allocating a new
    float_block with malloc whenever necessary.  Float cells reclaimed
    by GC are put on a free list to be reallocated before allocating
-   any new float cells from the latest float_block.  */
+   any new float cells from the latest float_block.  Like conses, live
+   floats stay marked between collections, and so do free ones, so that
+   a minor collection need sweep only the blocks of young floats.  */
 
 #define FLOAT_BLOCK_SIZE					\
-  (((BLOCK_BYTES - sizeof (struct float_block *)		\
+  (((BLOCK_BYTES - 2 * sizeof (struct float_block *)		\
      /* The compiler might add padding at the end.  */		\
      - (sizeof (struct Lisp_Float) - sizeof (bits_word))) * CHAR_BIT) \
    / (sizeof (struct Lisp_Float) * CHAR_BIT + 1))
@@ -2389,6 +2467,9 @@ struct float_block
   struct Lisp_Float floats[FLOAT_BLOCK_SIZE];
   bits_word gcmarkbits[1 + FLOAT_BLOCK_SIZE / BITS_PER_BITS_WORD];
   struct float_block *next;
+  /* Next block in the list of young blocks, or this block if it is
+     the last one; null if this block is not young.  */
+  struct float_block *next_young;
 };
 
 #define FLOAT_MARKED_P(fptr) \
@@ -2412,12 +2493,18 @@ static int float_block_index = FLOAT_BLOCK_SIZE;
 
 static struct Lisp_Float *float_free_list;
 
+/* List of the blocks that have floats allocated since the last
+   collection, chained through their next_young fields.  */
+
+static struct float_block *young_float_blocks;
+
 /* Return a new float object with value FLOAT_VALUE.  */
 
 Lisp_Object
 make_float (double float_value)
 {
   register Lisp_Object val;
+  struct float_block *fblk;
 
   MALLOC_BLOCK_INPUT;
 
@@ -2427,6 +2514,7 @@ make_float (double float_value)
 	 so that we won't use the same field that has the mark bit.  */
       XSETFLOAT (val, float_free_list);
       float_free_list = float_free_list->u.chain;
+      FLOAT_UNMARK (XFLOAT (val));
     }
   else
     {
@@ -2435,6 +2523,7 @@ make_float (double float_value)
 	  struct float_block *new
 	    = lisp_align_malloc (sizeof *new, MEM_TYPE_FLOAT);
 	  new->next = float_block;
+	  new->next_young = NULL;
 	  memset (new->gcmarkbits, 0, sizeof new->gcmarkbits);
 	  float_block = new;
 	  float_block_index = 0;
@@ -2444,12 +2533,20 @@ make_float (double float_value)
       float_block_index++;
     }
 
+  fblk = FLOAT_BLOCK (XFLOAT (val));
+  if (!fblk->next_young)
+    {
+      fblk->next_young = young_float_blocks ? young_float_blocks : fblk;
+      young_float_blocks = fblk;
+    }
+
   MALLOC_UNBLOCK_INPUT;
 
   XFLOAT_INIT (val, float_value);
   eassert (!FLOAT_MARKED_P (XFLOAT (val)));
   consing_since_gc += sizeof (struct Lisp_Float);
   floats_consed++;
+  total_floats++;
   total_free_floats--;
   return val;
 }
@@ -2463,10 +2560,19 @@ make_float (double float_value)
 /* We store cons cells inside of cons_blocks, allocating a new
    cons_block with malloc whenever necessary.  Cons cells reclaimed by
    GC are put on a free list to be reallocated before allocating
-   any new cons cells from the latest cons_block.  */
+   any new cons cells from the latest cons_block.
+
+   Cons cells that survive a collection stay marked until the next
+   full collection; they are the old generation.  A minor collection
+   does not look inside old conses, except those in blocks on the
+   list of dirty blocks, to which XSETCAR and XSETCDR add any block
+   whose old conses are made to point to an object that may be young.
+   Free cons cells are marked too, so that a minor collection need
+   sweep only the blocks on the list of young blocks, which have
+   conses allocated since the last collection.  */
 
 #define CONS_BLOCK_SIZE						\
-  (((BLOCK_BYTES - sizeof (struct cons_block *)			\
+  (((BLOCK_BYTES - 3 * sizeof (struct cons_block *)		\
      /* The compiler might add padding at the end.  */		\
      - (sizeof (struct Lisp_Cons) - sizeof (bits_word))) * CHAR_BIT)	\
    / (sizeof (struct Lisp_Cons) * CHAR_BIT + 1))
@@ -2483,6 +2589,11 @@ struct cons_block
   struct Lisp_Cons conses[CONS_BLOCK_SIZE];
   bits_word gcmarkbits[1 + CONS_BLOCK_SIZE / BITS_PER_BITS_WORD];
   struct cons_block *next;
+  /* Next block in the list of dirty blocks, or this block if it is
+     the last one; null if this block is not dirty.  */
+  struct cons_block *next_dirty;
+  /* Likewise for the list of young blocks.  */
+  struct cons_block *next_young;
 };
 
 #define CONS_MARKED_P(fptr) \
@@ -2506,17 +2617,29 @@ static int cons_block_index = CONS_BLOCK_SIZE;
 
 static struct Lisp_Cons *cons_free_list;
 
+/* List of dirty cons blocks, chained through their next_dirty
+   fields.  */
+
+static struct cons_block *dirty_cons_blocks;
+
+/* List of young cons blocks, chained through their next_young
+   fields.  */
+
+static struct cons_block *young_cons_blocks;
+
 /* Explicitly free a cons cell by putting it on the free-list.  */
 
 void
 free_cons (struct Lisp_Cons *ptr)
 {
+  CONS_MARK (ptr);
   ptr->u.chain = cons_free_list;
 #if GC_MARK_STACK
   ptr->car = Vdead;
 #endif
   cons_free_list = ptr;
   consing_since_gc -= sizeof *ptr;
+  total_conses--;
   total_free_conses++;
 }
 
@@ -2525,6 +2648,7 @@ DEFUN ("cons", Fcons, Scons, 2, 2, 0,
   (Lisp_Object car, Lisp_Object cdr)
 {
   register Lisp_Object val;
+  struct cons_block *cblk;
 
   MALLOC_BLOCK_INPUT;
 
@@ -2534,6 +2658,7 @@ DEFUN ("cons", Fcons, Scons, 2, 2, 0,
 	 so that we won't use the same field that has the mark bit.  */
       XSETCONS (val, cons_free_list);
       cons_free_list = cons_free_list->u.chain;
+      CONS_UNMARK (XCONS (val));
     }
   else
     {
@@ -2543,6 +2668,7 @@ DEFUN ("cons", Fcons, Scons, 2, 2, 0,
 	    = lisp_align_malloc (sizeof *new, MEM_TYPE_CONS);
 	  memset (new->gcmarkbits, 0, sizeof new->gcmarkbits);
 	  new->next = cons_block;
+	  new->next_dirty = new->next_young = NULL;
 	  cons_block = new;
 	  cons_block_index = 0;
 	  total_free_conses += CONS_BLOCK_SIZE;
@@ -2551,12 +2677,21 @@ DEFUN ("cons", Fcons, Scons, 2, 2, 0,
       cons_block_index++;
     }
 
+  cblk = CONS_BLOCK (XCONS (val));
+  if (!cblk->next_young)
+    {
+      cblk->next_young = young_cons_blocks ? young_cons_blocks : cblk;
+      young_cons_blocks = cblk;
+    }
+
   MALLOC_UNBLOCK_INPUT;
 
-  XSETCAR (val, car);
-  XSETCDR (val, cdr);
+  /* A new cons is young, so it needs no write barrier.  */
+  XCONS (val)->car = car;
+  XCONS (val)->u.cdr = cdr;
   eassert (!CONS_MARKED_P (XCONS (val)));
   consing_since_gc += sizeof (struct Lisp_Cons);
+  total_conses++;
   total_free_conses--;
   cons_cells_consed++;
   return val;
@@ -2574,6 +2709,39 @@ check_cons_list (void)
 }
 #endif
 
+/* Called by XSETCAR and XSETCDR before they store an object that may
+   be young into the cons C.  If C is old, put its block on the list of dirty
+   blocks, so that the next minor collection finds what C points to.  */
+
+void
+note_cons_store (Lisp_Object c)
+{
+  struct Lisp_Cons *ptr = XCONS (c);
+  struct cons_block *b;
+  char stack_top_variable;
+
+  /* Everything stored during a collection gets marked anyway.  */
+  if (gc_in_progress || PURE_POINTER_P (ptr))
+    return;
+
+  /* Cons cells made by AUTO_CONS are on the stack, and not in any
+     block.  */
+  if (USE_STACK_CONS
+      && (&stack_top_variable < stack_bottom
+	  ? (&stack_top_variable < (char *) ptr
+	     && (char *) ptr < stack_bottom)
+	  : (stack_bottom <= (char *) ptr
+	     && (char *) ptr < &stack_top_variable)))
+    return;
+
+  b = CONS_BLOCK (ptr);
+  if (!b->next_dirty && CONS_MARKED_P (ptr))
+    {
+      b->next_dirty = dirty_cons_blocks ? dirty_cons_blocks : b;
+      dirty_cons_blocks = b;
+    }
+}
+
 /* Make a list of 1, 2, 3, 4 or 5 specified objects.  */
 
 Lisp_Object
@@ -2855,6 +3023,45 @@ static EMACS_INT total_vectors;
 
 static EMACS_INT total_vector_slots, total_free_vector_slots;
 
+/* A growable set of pointers to objects, kept for the garbage
+   collector.  */
+
+struct gc_set
+{
+  void **items;
+  ptrdiff_t used, size;
+};
+
+/* Add P to SET.  */
+
+static void
+gc_set_add (struct gc_set *set, void *p)
+{
+  if (set->used == set->size)
+    set->items = xpalloc (set->items, &set->size, 1, -1,
+			  sizeof *set->items);
+  set->items[set->used++] = p;
+}
+
+/* Vectors allocated from blocks since the last collection.  */
+
+static struct gc_set young_vectors;
+
+/* Old vectors that may point to young objects; see
+   remember_vector.  */
+
+static struct gc_set dirty_vectors;
+
+/* Pseudovectors whose slots are set without note_vector_store.  Every
+   minor collection looks into them.  */
+
+static struct gc_set traced_vectors;
+
+/* The first large vector allocated before the last collection.  The
+   large vectors before it in the list are young.  */
+
+static struct large_vector *old_large_vectors;
+
 /* Get a new vector block.  */
 
 static struct vector_block *
@@ -2998,9 +3205,78 @@ cleanup_vector (struct Lisp_Vector *vector)
 	  drv->close ((struct font *) vector);
 	}
     }
+  else if (PSEUDOVECTOR_TYPEP (&vector->header, PVEC_HASH_TABLE))
+    {
+      struct Lisp_Hash_Table *h = (struct Lisp_Hash_Table *) vector;
+
+      /* The index arrays of a hash table live outside the Lisp heap.  */
+      xfree (h->hash);
+      xfree (h->next);
+      xfree (h->index);
+    }
+  else if (PSEUDOVECTOR_TYPEP (&vector->header, PVEC_PROCESS))
+    xfree (((struct Lisp_Process *) vector)->read_output_buf);
+}
+
+/* Called by note_vector_store before the old vector V is made to
+   point to an object that may be young.  Unmark V, so that the next
+   minor collection looks into it, and remember it, so that the
+   collection marks it again.  */
+
+void
+remember_vector (struct Lisp_Vector *v)
+{
+  /* Everything stored during a collection gets marked anyway.  */
+  if (gc_in_progress)
+    return;
+  VECTOR_UNMARK (v);
+  gc_set_add (&dirty_vectors, v);
+}
+
+/* Free the unmarked young vectors, for a minor collection.  They go
+   on the free lists without being coalesced with their neighbors,
+   which the next full collection does.  */
+
+static void
+sweep_young_vectors (void)
+{
+  struct large_vector *lv, **lvprev = &large_vectors;
+  struct Lisp_Vector *vector;
+  ptrdiff_t i, nbytes;
+  size_t tmp;
+
+  for (i = 0; i < young_vectors.used; i++)
+    {
+      vector = young_vectors.items[i];
+      if (!VECTOR_MARKED_P (vector))
+	{
+	  cleanup_vector (vector);
+	  nbytes = vector_nbytes (vector);
+	  total_vectors--;
+	  total_vector_slots -= nbytes / word_size;
+	  SETUP_ON_FREE_LIST (vector, nbytes, tmp);
+	}
+    }
+  young_vectors.used = 0;
+
+  for (lv = large_vectors; lv != old_large_vectors; lv = *lvprev)
+    {
+      vector = large_vector_vec (lv);
+      if (VECTOR_MARKED_P (vector))
+	lvprev = &lv->next;
+      else
+	{
+	  total_vectors--;
+	  total_vector_slots -= vector_nbytes (vector) / word_size;
+	  *lvprev = lv->next;
+	  lisp_free (lv);
+	}
+    }
+  old_large_vectors = large_vectors;
 }
 
-/* Reclaim space used by unmarked vectors.  */
+/* Reclaim space used by unmarked vectors.  The vectors that are left
+   stay marked, as part of the old generation.  */
 
 NO_INLINE /* For better stack traces */
 static void
@@ -3009,6 +3285,13 @@ sweep_vectors (void)
   struct vector_block *block, **bprev = &vector_blocks;
   struct large_vector *lv, **lvprev = &large_vectors;
   struct Lisp_Vector *vector, *next;
+  ptrdiff_t i, ntraced = 0;
+
+  /* Forget the traced vectors that are about to be freed.  */
+  for (i = 0; i < traced_vectors.used; i++)
+    if (VECTOR_MARKED_P ((struct Lisp_Vector *) traced_vectors.items[i]))
+      traced_vectors.items[ntraced++] = traced_vectors.items[i];
+  traced_vectors.used = ntraced;
 
   total_vectors = total_vector_slots = total_free_vector_slots = 0;
   memset (vector_free_lists, 0, sizeof (vector_free_lists));
@@ -3025,7 +3308,6 @@ sweep_vectors (void)
 	{
 	  if (VECTOR_MARKED_P (vector))
 	    {
-	      VECTOR_UNMARK (vector);
 	      total_vectors++;
 	      nbytes = vector_nbytes (vector);
 	      total_vector_slots += nbytes / word_size;
@@ -3087,7 +3369,6 @@ sweep_vectors (void)
       vector = large_vector_vec (lv);
       if (VECTOR_MARKED_P (vector))
 	{
-	  VECTOR_UNMARK (vector);
 	  total_vectors++;
 	  if (vector->header.size & PSEUDOVECTOR_FLAG)
 	    {
@@ -3098,8 +3379,8 @@ sweep_vectors (void)
               total_vector_slots += vector_nbytes (vector) / word_size;
 	    }
 	  else
-	    total_vector_slots
-	      += header_size / word_size + vector->header.size;
+	    total_vector_slots += (header_size / word_size
+				   + (vector->header.size & ~ARRAY_MARK_FLAG));
 	  lvprev = &lv->next;
 	}
       else
@@ -3108,6 +3389,7 @@ sweep_vectors (void)
 	  lisp_free (lv);
 	}
     }
+  old_large_vectors = large_vectors;
 }
 
 /* Value is a pointer to a newly allocated Lisp_Vector structure
@@ -3132,7 +3414,10 @@ allocate_vectorlike (ptrdiff_t len)
 #endif
 
       if (nbytes <= VBLOCK_BYTES_MAX)
-	p = allocate_vector_from_block (vroundup (nbytes));
+	{
+	  p = allocate_vector_from_block (vroundup (nbytes));
+	  gc_set_add (&young_vectors, p);
+	}
       else
 	{
 	  struct large_vector *lv
@@ -3143,6 +3428,8 @@ allocate_vectorlike (ptrdiff_t len)
 	  large_vectors = lv;
 	  p = large_vector_vec (lv);
 	}
+      total_vectors++;
+      total_vector_slots += vroundup (nbytes) / word_size;
 
 #ifdef DOUG_LEA_MALLOC
       if (!mmap_lisp_allowed_p ())
@@ -3196,6 +3483,21 @@ allocate_pseudovector (int memlen, int lisplen, enum pvec_type tag)
     v->contents[i] = Qnil;
 
   XSETPVECTYPESIZE (v, tag, lisplen, memlen - lisplen);
+
+  /* C code sets the slots of these directly.  */
+  switch (tag)
+    {
+    case PVEC_PROCESS:
+    case PVEC_FRAME:
+    case PVEC_WINDOW:
+    case PVEC_TERMINAL:
+    case PVEC_WINDOW_CONFIGURATION:
+    case PVEC_OTHER:
+      gc_set_add (&traced_vectors, v);
+      break;
+    default:
+      break;
+    }
   return v;
 }
 
@@ -3405,6 +3707,11 @@ static struct symbol_block *symbol_block_pinned;
 
 static struct Lisp_Symbol *symbol_free_list;
 
+/* Symbols allocated since the last collection, and old symbols that
+   may point to young objects; see remember_symbol.  */
+
+static struct gc_set young_symbols, dirty_symbols;
+
 static void
 set_symbol_name (Lisp_Object sym, Lisp_Object name)
 {
@@ -3446,23 +3753,50 @@ Its value is void, and its function definition and property list are nil.  */)
   MALLOC_UNBLOCK_INPUT;
 
   p = XSYMBOL (val);
+  p->gcmarkbit = false;
   set_symbol_name (val, name);
   set_symbol_plist (val, Qnil);
   p->redirect = SYMBOL_PLAINVAL;
   SET_SYMBOL_VAL (p, Qunbound);
   set_symbol_function (val, Qnil);
   set_symbol_next (val, NULL);
-  p->gcmarkbit = false;
   p->interned = SYMBOL_UNINTERNED;
   p->constant = 0;
   p->declared_special = false;
   p->pinned = false;
+  gc_set_add (&young_symbols, p);
   consing_since_gc += sizeof (struct Lisp_Symbol);
   symbols_consed++;
+  total_symbols++;
   total_free_symbols--;
   return val;
 }
 
+/* Mark symbol SYM as pinned, so that it is marked at every GC cycle
+   even though it is only referenced from pure storage.  Only a full
+   collection marks the pinned symbols.  */
+
+void
+pin_symbol (Lisp_Object sym)
+{
+  XSYMBOL (sym)->pinned = true;
+  symbol_block_pinned = symbol_block;
+  gc_full_pending = true;
+}
+
+/* Called by note_symbol_store before the old symbol SYM is made to
+   point to an object that may be young.  This is like
+   remember_vector.  */
+
+void
+remember_symbol (struct Lisp_Symbol *sym)
+{
+  if (gc_in_progress)
+    return;
+  sym->gcmarkbit = false;
+  gc_set_add (&dirty_symbols, sym);
+}
+
 
 
 /***********************************************************************
@@ -3656,18 +3990,21 @@ free_save_value (Lisp_Object save)
   free_misc (save);
 }
 
-/* Return a Lisp_Misc_Overlay object with specified START, END and PLIST.  */
+/* Return a Lisp_Misc_Overlay object with specified PLIST, not yet in
+   any buffer.  FRONT_ADVANCE and REAR_ADVANCE give the insertion types
+   of its start and end.  */
 
 Lisp_Object
-build_overlay (Lisp_Object start, Lisp_Object end, Lisp_Object plist)
+build_overlay (bool front_advance, bool rear_advance, Lisp_Object plist)
 {
   register Lisp_Object overlay;
+  struct itree_node *node = xmalloc (sizeof *node);
 
   overlay = allocate_misc (Lisp_Misc_Overlay);
-  OVERLAY_START (overlay) = start;
-  OVERLAY_END (overlay) = end;
+  itree_node_init (node, front_advance, rear_advance, overlay);
+  XOVERLAY (overlay)->buffer = NULL;
+  XOVERLAY (overlay)->interval = node;
   set_overlay_plist (overlay, plist);
-  XOVERLAY (overlay)->next = NULL;
   return overlay;
 }
 
@@ -3889,6 +4226,107 @@ mem_init (void)
 }
 
 
+/* Return true if the granule map covers address P.  */
+
+static bool
+mem_mappable_p (void *p)
+{
+  return (uintmax_t) (uintptr_t) p >> MEM_MAP_ADDRESS_BITS == 0;
+}
+
+/* Return the entry of the granule map for address P, which must be
+   mappable.  If the map has no room for it yet, return NULL, or
+   make room if CREATE.  */
+
+static struct mem_granule *
+mem_granule (void *p, bool create)
+{
+  uintmax_t g = (uintmax_t) (uintptr_t) p >> MEM_GRANULE_BITS;
+  struct mem_map_mid **mid = &mem_map[g >> (MEM_LEAF_BITS + MEM_MID_BITS)];
+  struct mem_map_leaf **leaf;
+
+  if (!*mid)
+    {
+      if (!create)
+	return NULL;
+#ifdef GC_MALLOC_CHECK
+      *mid = calloc (1, sizeof **mid);
+      if (*mid == NULL)
+	emacs_abort ();
+#else
+      *mid = xzalloc (sizeof **mid);
+#endif
+    }
+
+  leaf = &(*mid)->leaves[(g >> MEM_LEAF_BITS) & ((1 << MEM_MID_BITS) - 1)];
+  if (!*leaf)
+    {
+      if (!create)
+	return NULL;
+#ifdef GC_MALLOC_CHECK
+      *leaf = calloc (1, sizeof **leaf);
+      if (*leaf == NULL)
+	emacs_abort ();
+#else
+      *leaf = xzalloc (sizeof **leaf);
+#endif
+    }
+
+  return &(*leaf)->granules[g & ((1 << MEM_LEAF_BITS) - 1)];
+}
+
+/* Record in the granule map that node X has been added to the tree,
+   if INCREMENT is 1, or removed from it, if INCREMENT is -1.  */
+
+static void
+mem_map_node (struct mem_node *x, int increment)
+{
+  char *p, *last = (char *) x->end - 1;
+
+  if (mem_map_incomplete)
+    return;
+  if (!mem_mappable_p (x->start) || !mem_mappable_p (last))
+    {
+      mem_map_incomplete = true;
+      return;
+    }
+
+  for (p = x->start;
+       (uintptr_t) p >> MEM_GRANULE_BITS <= (uintptr_t) last >> MEM_GRANULE_BITS;
+       p += MEM_GRANULE_BYTES)
+    {
+      struct mem_granule *g = mem_granule (p, increment > 0);
+
+      g->count += increment;
+      if (increment > 0)
+	g->node = g->count == 1 ? x : NULL;
+      else if (g->node == x)
+	g->node = NULL;
+    }
+}
+
+/* Record in the granule map that the block of node FROM is now
+   described by node TO.  */
+
+static void
+mem_map_move_node (struct mem_node *from, struct mem_node *to)
+{
+  char *p, *last = (char *) to->end - 1;
+
+  if (mem_map_incomplete)
+    return;
+
+  for (p = to->start;
+       (uintptr_t) p >> MEM_GRANULE_BITS <= (uintptr_t) last >> MEM_GRANULE_BITS;
+       p += MEM_GRANULE_BYTES)
+    {
+      struct mem_granule *g = mem_granule (p, false);
+
+      if (g->node == from)
+	g->node = to;
+    }
+}
+
 /* Value is a pointer to the mem_node containing START.  Value is
    MEM_NIL if there is no node in the tree containing START.  */
 
@@ -3900,12 +4338,21 @@ mem_find (void *start)
   if (start < min_heap_address || start > max_heap_address)
     return MEM_NIL;
 
-  /* Make the search always successful to speed up the loop below.  */
-  mem_z.start = start;
-  mem_z.end = (char *) start + 1;
+  if (!mem_map_incomplete)
+    {
+      struct mem_granule *g = mem_granule (start, false);
+
+      if (!g || g->count == 0)
+	return MEM_NIL;
+      if (g->node)
+	return (g->node->start <= start && start < g->node->end
+		? g->node : MEM_NIL);
+    }
 
+  /* Search the tree.  Don't use mem_z as a sentinel, because that
+     would make mem_find unsafe to call from the sweeper threads.  */
   p = mem_root;
-  while (start < p->start || start >= p->end)
+  while (p != MEM_NIL && (start < p->start || start >= p->end))
     p = start < p->start ? p->left : p->right;
   return p;
 }
@@ -3980,6 +4427,7 @@ mem_insert (void *start, void *end, enum mem_type type)
   /* Re-establish red-black tree properties.  */
   mem_insert_fixup (x);
 
+  mem_map_node (x, 1);
   return x;
 }
 
@@ -4141,6 +4589,8 @@ mem_delete (struct mem_node *z)
   if (!z || z == MEM_NIL)
     return;
 
+  mem_map_node (z, -1);
+
   if (z->left == MEM_NIL || z->right == MEM_NIL)
     y = z;
   else
@@ -4171,6 +4621,7 @@ mem_delete (struct mem_node *z)
       z->start = y->start;
       z->end = y->end;
       z->type = y->type;
+      mem_map_move_node (y, z);
     }
 
   if (y->color == MEM_BLACK)
@@ -5066,7 +5517,8 @@ relocatable_string_data_p (const char *str)
 
 /* Allocate room for SIZE bytes from pure Lisp storage and return a
    pointer to it.  TYPE is the Lisp type for which the memory is
-   allocated.  TYPE < 0 means it's not used for a Lisp object.  */
+   allocated.  TYPE < 0 means it's not used for a Lisp object.
+   Record the Lisp objects in `pure_objects'.  */
 
 static void *
 pure_alloc (size_t size, int type)
@@ -5100,7 +5552,17 @@ pure_alloc (size_t size, int type)
   pure_bytes_used = pure_bytes_used_lisp + pure_bytes_used_non_lisp;
 
   if (pure_bytes_used <= pure_size)
-    return result;
+    {
+      if (type >= 0 && !pure_bytes_used_before_overflow)
+	{
+	  if (pure_objects_used == pure_objects_size)
+	    pure_objects = xpalloc (pure_objects, &pure_objects_size, 1, -1,
+				    sizeof *pure_objects);
+	  pure_objects[pure_objects_used++]
+	    = ((char *) result - purebeg) * 8 + type;
+	}
+      return result;
+    }
 
   /* Don't allocate a large amount here,
      because it might get mmap'd and then its address
@@ -5340,12 +5802,10 @@ purecopy (Lisp_Object obj)
     }
   else if (SYMBOLP (obj))
     {
+      /* We can't purify them, but they appear in many pure objects.
+	 Mark them as `pinned' so we know to mark them at every GC cycle.  */
       if (!XSYMBOL (obj)->pinned)
-	{ /* We can't purify them, but they appear in many pure objects.
-	     Mark them as `pinned' so we know to mark them at every GC cycle.  */
-	  XSYMBOL (obj)->pinned = true;
-	  symbol_block_pinned = symbol_block;
-	}
+	pin_symbol (obj);
       return obj;
     }
   else
@@ -5535,69 +5995,466 @@ mark_pinned_symbols (void)
     }
 }
 
-/* Subroutine of Fgarbage_collect that does most of the work.  It is a
-   separate function so that we could limit mark_stack in searching
-   the stack frames below this function, thus avoiding the rare cases
-   where mark_stack finds values that look like live Lisp objects on
-   portions of stack that couldn't possibly contain such live objects.
-   For more details of this, see the discussion at
-   http://lists.gnu.org/archive/html/emacs-devel/2014-05/msg00270.html.  */
-static Lisp_Object
-garbage_collect_1 (void *end)
+/* Forget the old generation, so that a full collection can find out
+   again which objects are live.  */
+
+static void
+unmark_old_generation (void)
 {
-  struct buffer *nextb;
-  char stack_top_variable;
-  ptrdiff_t i;
-  bool message_p;
-  ptrdiff_t count = SPECPDL_INDEX ();
-  struct timespec start;
-  Lisp_Object retval = Qnil;
-  size_t tot_before = 0;
+  struct cons_block *cblk;
+  struct float_block *fblk;
+  struct vector_block *vblk;
+  struct large_vector *lv;
+  struct Lisp_Vector *vector;
+  struct symbol_block *sblk;
+  int i, lim;
 
-  if (abort_on_gc)
-    emacs_abort ();
+  for (cblk = cons_block; cblk; cblk = cblk->next)
+    {
+      memset (cblk->gcmarkbits, 0, sizeof cblk->gcmarkbits);
+      cblk->next_dirty = cblk->next_young = NULL;
+    }
+  dirty_cons_blocks = young_cons_blocks = NULL;
 
-  /* Can't GC if pure storage overflowed because we can't determine
-     if something is a pure object or not.  */
-  if (pure_bytes_used_before_overflow)
-    return Qnil;
+  for (fblk = float_block; fblk; fblk = fblk->next)
+    {
+      memset (fblk->gcmarkbits, 0, sizeof fblk->gcmarkbits);
+      fblk->next_young = NULL;
+    }
+  young_float_blocks = NULL;
 
-  /* Record this function, so it appears on the profiler's backtraces.  */
-  record_in_backtrace (Qautomatic_gc, &Qnil, 0);
+  for (vblk = vector_blocks; vblk; vblk = vblk->next)
+    for (vector = (struct Lisp_Vector *) vblk->data;
+	 VECTOR_IN_BLOCK (vector, vblk);
+	 vector = ADVANCE (vector, vector_nbytes (vector)))
+      VECTOR_UNMARK (vector);
 
-  check_cons_list ();
+  for (lv = large_vectors; lv; lv = lv->next)
+    VECTOR_UNMARK (large_vector_vec (lv));
 
-  /* Don't keep undo information around forever.
-     Do this early on, so it is no problem if the user quits.  */
-  FOR_EACH_BUFFER (nextb)
-    compact_buffer (nextb);
+  lim = symbol_block_index;
+  for (sblk = symbol_block; sblk; sblk = sblk->next)
+    {
+      for (i = 0; i < lim; i++)
+	sblk->symbols[i].s.gcmarkbit = false;
+      lim = SYMBOL_BLOCK_SIZE;
+    }
 
-  if (profiler_memory_running)
-    tot_before = total_bytes_of_live_objects ();
+  young_vectors.used = dirty_vectors.used = 0;
+  young_symbols.used = dirty_symbols.used = 0;
+}
 
-  start = current_timespec ();
+/* Unmark the traced vectors at the start of a minor collection, so
+   that it looks into them again.  */
 
-  /* In case user calls debug_print during GC,
-     don't let that cause a recursive GC.  */
-  consing_since_gc = 0;
+static void
+unmark_traced_vectors (void)
+{
+  ptrdiff_t i;
 
-  /* Save what's currently displayed in the echo area.  */
-  message_p = push_message ();
-  record_unwind_protect_void (pop_message_unwind);
+  for (i = 0; i < traced_vectors.used; i++)
+    VECTOR_UNMARK ((struct Lisp_Vector *) traced_vectors.items[i]);
+}
 
-  /* Save a copy of the contents of the stack, for debugging.  */
-#if MAX_SAVE_STACK > 0
-  if (NILP (Vpurify_flag))
+/* Mark through the marked conses, vectors and symbols that the write
+   barriers have recorded as changed since the last collection or mark
+   slice.  */
+
+static void
+mark_dirty_objects (void)
+{
+  struct cons_block *cblk, *next;
+  ptrdiff_t j;
+  int i;
+
+  for (j = 0; j < dirty_vectors.used; j++)
+    mark_object (make_lisp_ptr (dirty_vectors.items[j], Lisp_Vectorlike));
+  dirty_vectors.used = 0;
+
+  for (j = 0; j < dirty_symbols.used; j++)
+    mark_object (make_lisp_ptr (dirty_symbols.items[j], Lisp_Symbol));
+  dirty_symbols.used = 0;
+
+  /* Free cons cells are marked too; their cars are Vdead.  */
+  for (cblk = dirty_cons_blocks; cblk; cblk = next)
     {
-      char *stack;
-      ptrdiff_t stack_size;
-      if (&stack_top_variable < stack_bottom)
-	{
-	  stack = &stack_top_variable;
-	  stack_size = stack_bottom - &stack_top_variable;
-	}
-      else
-	{
+      next = cblk->next_dirty == cblk ? NULL : cblk->next_dirty;
+      cblk->next_dirty = NULL;
+      for (i = 0; i < CONS_BLOCK_SIZE; i++)
+	if (GETMARKBIT (cblk, i) && !DEADP (cblk->conses[i].car))
+	  {
+	    mark_object (cblk->conses[i].car);
+	    mark_object (cblk->conses[i].u.cdr);
+	  }
+    }
+  dirty_cons_blocks = NULL;
+}
+
+/* Mark what a minor collection keeps besides what is reachable from
+   the roots.  A minor collection frees only the conses, floats,
+   vectors and symbols allocated since the last collection.  The old
+   ones are still marked, and need to be looked into only if they have
+   been made to point to younger objects since then, as recorded by
+   the write barriers, or if they are traced vectors.  Strings,
+   markers and buffers are not generational: stores into them are not
+   tracked, so all of them are kept, and whatever they point to is
+   marked.  */
+
+static void
+mark_for_minor_gc (void)
+{
+#if GC_MARK_STACK
+  struct buffer *buffer;
+  struct marker_block *mblk;
+  struct string_block *stblk;
+  ptrdiff_t j;
+  int i, lim;
+
+  for (j = 0; j < traced_vectors.used; j++)
+    mark_object (make_lisp_ptr (traced_vectors.items[j], Lisp_Vectorlike));
+
+  mark_dirty_objects ();
+
+  FOR_EACH_BUFFER (buffer)
+    if (!VECTOR_MARKED_P (buffer))
+      mark_buffer (buffer);
+
+  lim = marker_block_index;
+  for (mblk = marker_block; mblk; mblk = mblk->next)
+    {
+      for (i = 0; i < lim; i++)
+	if (mblk->markers[i].m.u_any.type != Lisp_Misc_Free)
+	  mark_object (make_lisp_ptr (&mblk->markers[i].m, Lisp_Misc));
+      lim = MARKER_BLOCK_SIZE;
+    }
+
+  for (stblk = string_blocks; stblk; stblk = stblk->next)
+    for (i = 0; i < STRING_BLOCK_SIZE; i++)
+      if (stblk->strings[i].data)
+	mark_object (make_lisp_ptr (&stblk->strings[i], Lisp_String));
+#endif /* GC_MARK_STACK */
+}
+
+/* Return true if the next automatic collection can be a minor one.  */
+
+static bool
+gc_minor_ok (void)
+{
+  return (GC_MARK_STACK && gc_generational && !gc_full_pending
+	  && !gc_marking_incrementally
+	  && NILP (Vpurify_flag) && NILP (Vmemory_full));
+}
+
+/* Incremental collection.  An incremental collection is a full one
+   whose marking is done in slices, between which Lisp code runs.  The
+   write barriers keep the usual tri-color invariant: while a
+   collection is under way, a store into a marked cons, vector or
+   symbol of an object that may not be marked yet records the cons's
+   block or unmarks the vector or symbol, and the next slice looks
+   into it again.  See gc_maybe_young_p.
+
+   Strings, miscellaneous objects and buffers have no write barrier,
+   and a string cannot even stay marked while Lisp code runs, as its
+   mark bit is in its size.  Mark slices therefore leave the ones they
+   reach to the final phase, which is a full collection that goes on
+   from what the slices marked instead of starting afresh.  So do
+   symbols with buffer-local values, whose current bindings change
+   without a barrier.  The final phase also looks again into the
+   traced vectors, and marks the stack and the other roots as
+   usual.  */
+
+/* A growable stack of Lisp objects, kept for the garbage
+   collector.  */
+
+struct gc_stack
+{
+  Lisp_Object *objects;
+  ptrdiff_t used, size;
+};
+
+/* Push OBJ onto STACK.  */
+
+static void
+gc_stack_push (struct gc_stack *stack, Lisp_Object obj)
+{
+  if (stack->used == stack->size)
+    stack->objects = xpalloc (stack->objects, &stack->size, 1, -1,
+			      sizeof *stack->objects);
+  stack->objects[stack->used++] = obj;
+}
+
+/* Objects that mark slices have reached but left for a later slice,
+   because they ran out of time.  */
+
+static struct gc_stack grey_objects;
+
+/* Objects that mark slices have reached but left for the final
+   phase.  */
+
+static struct gc_stack final_objects;
+
+/* True during a mark slice.  */
+
+static bool mark_slice_active;
+
+/* True if the current mark slice has run out of time, so that
+   mark_object just pushes the objects it is given onto
+   grey_objects.  */
+
+static bool mark_slice_over;
+
+/* When the current mark slice runs out of time.  */
+
+static struct timespec mark_slice_end;
+
+/* Check the clock only every this many calls to mark_object.  */
+
+enum { MARK_SLICE_CHECK_INTERVAL = 1000 };
+static int mark_slice_countdown;
+
+/* Called by mark_object during a mark slice, before it marks OBJ.
+   Return true if OBJ is to be marked later instead, by the final
+   phase or by another slice.  */
+
+static bool
+defer_mark (Lisp_Object obj)
+{
+  switch (XTYPE (obj))
+    {
+    case_Lisp_Int:
+      return false;
+
+    case Lisp_String:
+    case Lisp_Misc:
+      gc_stack_push (&final_objects, obj);
+      return true;
+
+    case Lisp_Vectorlike:
+      if (BUFFERP (obj))
+	{
+	  gc_stack_push (&final_objects, obj);
+	  return true;
+	}
+      break;
+
+    case Lisp_Symbol:
+      if (XSYMBOL (obj)->redirect == SYMBOL_LOCALIZED
+	  && !XSYMBOL (obj)->gcmarkbit)
+	{
+	  gc_stack_push (&final_objects, obj);
+	  return true;
+	}
+      break;
+
+    default:
+      break;
+    }
+
+  if (!mark_slice_over && --mark_slice_countdown == 0)
+    {
+      mark_slice_countdown = MARK_SLICE_CHECK_INTERVAL;
+      mark_slice_over = timespec_cmp (mark_slice_end,
+				      current_timespec ()) <= 0;
+    }
+  if (!mark_slice_over)
+    return false;
+  if (!survives_gc_p (obj))
+    gc_stack_push (&grey_objects, obj);
+  return true;
+}
+
+/* Do a mark slice of about MAX_PAUSE seconds, starting an incremental
+   collection if none is under way.  */
+
+static void
+mark_slice (double max_pause)
+{
+  struct timespec start = current_timespec ();
+
+  block_input ();
+  gc_in_progress = 1;
+  mark_slice_end = timespec_add (start, dtotimespec (max_pause));
+  mark_slice_countdown = MARK_SLICE_CHECK_INTERVAL;
+  mark_slice_over = false;
+  mark_slice_active = true;
+
+  if (gc_marking_incrementally)
+    mark_dirty_objects ();
+  else
+    {
+      ptrdiff_t i;
+
+      unmark_old_generation ();
+      gc_marking_incrementally = true;
+      for (i = 0; i < staticidx; i++)
+	mark_object (*staticvec[i]);
+    }
+
+  while (grey_objects.used > 0 && !mark_slice_over)
+    mark_object (grey_objects.objects[--grey_objects.used]);
+
+  mark_slice_active = false;
+  gc_in_progress = 0;
+  unblock_input ();
+
+  if (FLOATP (Vgc_elapsed))
+    {
+      struct timespec since_start = timespec_sub (current_timespec (), start);
+      Vgc_elapsed = make_float (XFLOAT_DATA (Vgc_elapsed)
+				+ timespectod (since_start));
+    }
+}
+
+/* Forget which conses, floats, vectors and symbols are young.  The
+   final phase of an incremental collection does this before its full
+   sweep, as the objects allocated since the collection started are
+   still on the lists of young objects.  */
+
+static void
+forget_young_objects (void)
+{
+  struct cons_block *cblk, *cnext;
+  struct float_block *fblk, *fnext;
+
+  for (cblk = young_cons_blocks; cblk; cblk = cnext)
+    {
+      cnext = cblk->next_young == cblk ? NULL : cblk->next_young;
+      cblk->next_young = NULL;
+    }
+  young_cons_blocks = NULL;
+
+  for (fblk = young_float_blocks; fblk; fblk = fnext)
+    {
+      fnext = fblk->next_young == fblk ? NULL : fblk->next_young;
+      fblk->next_young = NULL;
+    }
+  young_float_blocks = NULL;
+
+  young_vectors.used = young_symbols.used = 0;
+}
+
+/* Mark what the mark slices of an incremental collection have left,
+   as part of its final phase.  */
+
+static void
+finish_incremental_mark (void)
+{
+  ptrdiff_t i;
+
+  /* C code sets the slots of the traced vectors without a write
+     barrier, so look again into the ones that have been marked.  */
+  for (i = 0; i < traced_vectors.used; i++)
+    {
+      struct Lisp_Vector *v = traced_vectors.items[i];
+      if (VECTOR_MARKED_P (v))
+	{
+	  VECTOR_UNMARK (v);
+	  mark_object (make_lisp_ptr (v, Lisp_Vectorlike));
+	}
+    }
+
+  mark_dirty_objects ();
+
+  for (i = 0; i < final_objects.used; i++)
+    {
+      Lisp_Object obj = final_objects.objects[i];
+
+      /* A misc object may have been freed explicitly since.  */
+      if (! (MISCP (obj) && XMISCTYPE (obj) == Lisp_Misc_Free))
+	mark_object (obj);
+    }
+  final_objects.used = 0;
+
+  while (grey_objects.used > 0)
+    mark_object (grey_objects.objects[--grey_objects.used]);
+
+  forget_young_objects ();
+  gc_marking_incrementally = false;
+}
+
+/* Give up the incremental collection under way, if any.  The next
+   full collection starts afresh.  */
+
+static void
+abandon_incremental_gc (void)
+{
+  grey_objects.used = final_objects.used = 0;
+  gc_marking_incrementally = false;
+}
+
+/* Return true if incremental collections are possible.  */
+
+static bool
+gc_incremental_ok (void)
+{
+  return (GC_MARK_STACK && NILP (Vpurify_flag)
+	  && !pure_bytes_used_before_overflow);
+}
+
+/* Subroutine of collect_garbage that does most of the work, doing a
+   minor collection if MINOR.  It is a separate function so that we
+   could limit mark_stack in searching the stack frames below this
+   function, thus avoiding the rare cases where mark_stack finds
+   values that look like live Lisp objects on portions of stack that
+   couldn't possibly contain such live objects.
+   For more details of this, see the discussion at
+   http://lists.gnu.org/archive/html/emacs-devel/2014-05/msg00270.html.  */
+static Lisp_Object
+garbage_collect_1 (void *end, bool minor)
+{
+  struct buffer *nextb;
+  char stack_top_variable;
+  ptrdiff_t i;
+  bool message_p;
+  ptrdiff_t count = SPECPDL_INDEX ();
+  struct timespec start, sweep_start, sweep_time;
+  Lisp_Object retval = Qnil;
+  size_t tot_before = 0;
+
+  if (abort_on_gc)
+    emacs_abort ();
+
+  /* Can't GC if pure storage overflowed because we can't determine
+     if something is a pure object or not.  */
+  if (pure_bytes_used_before_overflow)
+    return Qnil;
+
+  /* Record this function, so it appears on the profiler's backtraces.  */
+  record_in_backtrace (Qautomatic_gc, &Qnil, 0);
+
+  check_cons_list ();
+
+  /* Don't keep undo information around forever.
+     Do this early on, so it is no problem if the user quits.  */
+  FOR_EACH_BUFFER (nextb)
+    compact_buffer (nextb);
+
+  if (profiler_memory_running)
+    tot_before = total_bytes_of_live_objects ();
+
+  start = current_timespec ();
+
+  /* In case user calls debug_print during GC,
+     don't let that cause a recursive GC.  */
+  consing_since_gc = 0;
+
+  /* Save what's currently displayed in the echo area.  */
+  message_p = push_message ();
+  record_unwind_protect_void (pop_message_unwind);
+
+  /* Save a copy of the contents of the stack, for debugging.  */
+#if MAX_SAVE_STACK > 0
+  if (NILP (Vpurify_flag))
+    {
+      char *stack;
+      ptrdiff_t stack_size;
+      if (&stack_top_variable < stack_bottom)
+	{
+	  stack = &stack_top_variable;
+	  stack_size = stack_bottom - &stack_top_variable;
+	}
+      else
+	{
 	  stack = stack_bottom;
 	  stack_size = &stack_top_variable - stack_bottom;
 	}
@@ -5622,6 +6479,15 @@ garbage_collect_1 (void *end)
 
   gc_in_progress = 1;
 
+  /* A minor collection keeps the old generation marked, and so does
+     the final phase of an incremental collection.  */
+  if (minor)
+    unmark_traced_vectors ();
+  else if (gc_marking_incrementally)
+    finish_incremental_mark ();
+  else
+    unmark_old_generation ();
+
   /* Mark all the special slots that serve as the roots of accessibility.  */
 
   mark_buffer (&buffer_defaults);
@@ -5630,10 +6496,15 @@ garbage_collect_1 (void *end)
   for (i = 0; i < staticidx; i++)
     mark_object (*staticvec[i]);
 
-  mark_pinned_symbols ();
+  if (!minor)
+    mark_pinned_symbols ();
   mark_specpdl ();
   mark_terminals ();
   mark_kboards ();
+  mark_regexp_cache ();
+#ifdef HAVE_MODULES
+  mark_modules ();
+#endif
 
 #ifdef USE_GTK
   xg_mark_data ();
@@ -5667,6 +6538,9 @@ garbage_collect_1 (void *end)
   mark_stack (end);
 #endif
 
+  if (minor)
+    mark_for_minor_gc ();
+
   /* Everything is now marked, except for the data in font caches
      and undo lists.  They're compacted by removing an items which
      aren't reachable otherwise.  */
@@ -5682,11 +6556,12 @@ garbage_collect_1 (void *end)
       mark_object (BVAR (nextb, undo_list));
     }
 
-  gc_sweep ();
+  sweep_start = current_timespec ();
+  gc_sweep (minor);
+  sweep_time = timespec_sub (current_timespec (), sweep_start);
 
   /* Clear the mark bits that we set in certain root slots.  */
 
-  unmark_byte_stack ();
   VECTOR_UNMARK (&buffer_defaults);
   VECTOR_UNMARK (&buffer_local_symbols);
 
@@ -5704,6 +6579,16 @@ garbage_collect_1 (void *end)
   if (gc_cons_threshold < GC_DEFAULT_THRESHOLD / 10)
     gc_cons_threshold = GC_DEFAULT_THRESHOLD / 10;
 
+  /* Do a full collection next time if the heap has grown by half
+     since the last full collection.  */
+  {
+    EMACS_INT live = total_bytes_of_live_objects ();
+
+    if (!minor)
+      gc_live_after_full = live;
+    gc_full_pending = live - gc_live_after_full > gc_live_after_full / 2;
+  }
+
   gc_relative_threshold = 0;
   if (FLOATP (Vgc_cons_percentage))
     { /* Set gc_cons_combined_threshold.  */
@@ -5729,7 +6614,7 @@ garbage_collect_1 (void *end)
 
   unbind_to (count, Qnil);
   {
-    Lisp_Object total[11];
+    Lisp_Object total[12];
     int total_size = 10;
 
     total[0] = list4 (Qconses, make_number (sizeof (struct Lisp_Cons)),
@@ -5776,6 +6661,8 @@ garbage_collect_1 (void *end)
                        bounded_number ((mallinfo ().uordblks + 1023) >> 10),
                        bounded_number ((mallinfo ().fordblks + 1023) >> 10));
 #endif
+    total[total_size++] = list2 (Qsweep_time,
+				 make_float (timespectod (sweep_time)));
     retval = Flist (total_size, total);
   }
 
@@ -5810,6 +6697,8 @@ garbage_collect_1 (void *end)
     }
 
   gcs_done++;
+  if (minor)
+    gcs_minor_done++;
 
   /* Collect profiling data.  */
   if (profiler_memory_running)
@@ -5824,22 +6713,11 @@ garbage_collect_1 (void *end)
   return retval;
 }
 
-DEFUN ("garbage-collect", Fgarbage_collect, Sgarbage_collect, 0, 0, "",
-       doc: /* Reclaim storage for Lisp objects no longer needed.
-Garbage collection happens automatically if you cons more than
-`gc-cons-threshold' bytes of Lisp data since previous garbage collection.
-`garbage-collect' normally returns a list with info on amount of space in use,
-where each entry has the form (NAME SIZE USED FREE), where:
-- NAME is a symbol describing the kind of objects this entry represents,
-- SIZE is the number of bytes used by each one,
-- USED is the number of those objects that were found live in the heap,
-- FREE is the number of those objects that are not live but that Emacs
-  keeps around for future allocations (maybe because it does not know how
-  to return them to the OS).
-However, if there was overflow in pure space, `garbage-collect'
-returns nil, because real GC can't be done.
-See Info node `(elisp)Garbage Collection'.  */)
-  (void)
+/* Collect garbage, doing a minor collection if MINOR.  Return the
+   value of `garbage-collect'.  */
+
+static Lisp_Object
+collect_garbage (bool minor)
 {
 #if (GC_MARK_STACK == GC_MAKE_GCPROS_NOOPS		\
      || GC_MARK_STACK == GC_MARK_STACK_CHECK_GCPROS	\
@@ -5897,15 +6775,101 @@ See Info node `(elisp)Garbage Collection'.  */)
   end = stack_grows_down_p ? (char *) &j + sizeof j : (char *) &j;
 #endif /* not GC_SAVE_REGISTERS_ON_STACK */
 #endif /* not HAVE___BUILTIN_UNWIND_INIT */
-  return garbage_collect_1 (end);
+  return garbage_collect_1 (end, minor);
 #elif (GC_MARK_STACK == GC_USE_GCPROS_AS_BEFORE)
   /* Old GCPROs-based method without stack marking.  */
-  return garbage_collect_1 (NULL);
+  return garbage_collect_1 (NULL, minor);
 #else
   emacs_abort ();
 #endif /* GC_MARK_STACK */
 }
 
+DEFUN ("garbage-collect", Fgarbage_collect, Sgarbage_collect, 0, 0, "",
+       doc: /* Reclaim storage for Lisp objects no longer needed.
+Garbage collection happens automatically if you cons more than
+`gc-cons-threshold' bytes of Lisp data since previous garbage collection.
+`garbage-collect' normally returns a list with info on amount of space in use,
+where each entry has the form (NAME SIZE USED FREE), where:
+- NAME is a symbol describing the kind of objects this entry represents,
+- SIZE is the number of bytes used by each one,
+- USED is the number of those objects that were found live in the heap,
+- FREE is the number of those objects that are not live but that Emacs
+  keeps around for future allocations (maybe because it does not know how
+  to return them to the OS).
+The last entry has the form (sweep-time SECONDS), and says how long it
+took to free the objects that are not live.
+However, if there was overflow in pure space, `garbage-collect'
+returns nil, because real GC can't be done.
+This always does a full collection, even if `gc-generational' is
+non-nil, and gives up any incremental collection under way.
+See Info node `(elisp)Garbage Collection'.  */)
+  (void)
+{
+  abandon_incremental_gc ();
+  return collect_garbage (false);
+}
+
+DEFUN ("garbage-collect-step", Fgarbage_collect_step,
+       Sgarbage_collect_step, 0, 1, 0,
+       doc: /* Do a step of an incremental garbage collection.
+Start a new collection if none is under way.  The step marks objects
+for about MAX-PAUSE seconds, which defaults to `gc-max-pause'.  Once
+there is nothing left to mark that way, the next step is the final
+one: it finishes marking, including the objects that are reachable
+only from the stack, and frees the objects that are not live, which
+can take longer.  Return t if the step finished the collection, and
+nil otherwise.
+
+Lisp code can run between steps.  An automatic garbage collection
+that comes due in the meantime finishes the collection.  */)
+  (Lisp_Object max_pause)
+{
+  if (NILP (max_pause))
+    max_pause = Vgc_max_pause;
+  CHECK_NUMBER_OR_FLOAT (max_pause);
+  if (!gc_incremental_ok ())
+    {
+      collect_garbage (false);
+      return Qt;
+    }
+  if (gc_marking_incrementally && grey_objects.used == 0)
+    {
+      collect_garbage (false);
+      return Qt;
+    }
+  mark_slice (max (0, XFLOATINT (max_pause)));
+  return Qnil;
+}
+
+/* Collect garbage because enough consing was done since the last
+   collection.  Do a minor collection if possible.  */
+
+void
+garbage_collect (void)
+{
+  collect_garbage (gc_minor_ok ());
+}
+
+/* Emacs is about to wait for input.  If `gc-max-pause' is a number,
+   and an incremental collection is under way or half of the consing
+   that triggers a collection has been done, do a step of an
+   incremental collection.  Return true if the collection needs more
+   steps.  */
+
+bool
+gc_step_when_idle (void)
+{
+  if (! (NUMBERP (Vgc_max_pause) && gc_incremental_ok ()))
+    return false;
+  if (! (gc_marking_incrementally
+	 || (consing_since_gc > gc_cons_threshold / 2
+	     && consing_since_gc > gc_relative_threshold / 2)
+	 || (!NILP (Vmemory_full)
+	     && consing_since_gc > memory_full_cons_threshold)))
+    return false;
+  return NILP (Fgarbage_collect_step (Qnil));
+}
+
 /* Mark Lisp objects in glyph matrix MATRIX.  Currently the
    only interesting objects referenced from glyphs are strings.  */
 
@@ -6007,18 +6971,27 @@ mark_compiled (struct Lisp_Vector *ptr)
   return size > COMPILED_CONSTANTS ? ptr->contents[COMPILED_CONSTANTS] : Qnil;
 }
 
-/* Mark the chain of overlays starting at PTR.  */
+/* Mark the overlay PTR.  */
 
 static void
 mark_overlay (struct Lisp_Overlay *ptr)
 {
-  for (; ptr && !ptr->gcmarkbit; ptr = ptr->next)
+  ptr->gcmarkbit = 1;
+  mark_object (ptr->plist);
+}
+
+/* Mark all the overlays of BUFFER.  */
+
+static void
+mark_overlays (struct buffer *buffer)
+{
+  struct itree_node *node;
+
+  for (node = itree_first (buffer->overlays); node; node = itree_next (node))
     {
-      ptr->gcmarkbit = 1;
-      /* These two are always markers and can be marked fast.  */
-      XMARKER (ptr->start)->gcmarkbit = 1;
-      XMARKER (ptr->end)->gcmarkbit = 1;
-      mark_object (ptr->plist);
+      struct Lisp_Overlay *ov = XOVERLAY (node->data);
+      if (!ov->gcmarkbit)
+	mark_overlay (ov);
     }
 }
 
@@ -6038,8 +7011,7 @@ mark_buffer (struct buffer *buffer)
      a special way just before the sweep phase, and after stripping
      some of its elements that are not needed any more.  */
 
-  mark_overlay (buffer->overlays_before);
-  mark_overlay (buffer->overlays_after);
+  mark_overlays (buffer);
 
   /* If this is an indirect buffer, mark its base buffer.  */
   if (buffer->base_buffer && !VECTOR_MARKED_P (buffer->base_buffer))
@@ -6163,6 +7135,9 @@ mark_object (Lisp_Object arg)
   if (PURE_POINTER_P (XPNTR (obj)))
     return;
 
+  if (mark_slice_active && defer_mark (obj))
+    return;
+
   last_marked[last_marked_index++] = obj;
   if (last_marked_index == LAST_MARKED_SIZE)
     last_marked_index = 0;
@@ -6388,6 +7363,18 @@ mark_object (Lisp_Object arg)
 	    break;
 	  default: emacs_abort ();
 	  }
+	if (mark_slice_active)
+	  {
+	    /* Leave the name to defer_mark, and the next symbols in
+	       this bucket too.  */
+	    mark_object (ptr->name);
+	    if (ptr->next)
+	      {
+		obj = make_lisp_ptr (ptr->next, Lisp_Symbol);
+		goto loop;
+	      }
+	    break;
+	  }
 	if (!PURE_POINTER_P (XSTRING (ptr->name)))
 	  MARK_STRING (XSTRING (ptr->name));
 	MARK_INTERVAL_TREE (string_intervals (ptr->name));
@@ -6422,119 +7409,544 @@ mark_object (Lisp_Object arg)
 	  mark_overlay (XOVERLAY (obj));
 	  break;
 
-	default:
-	  emacs_abort ();
-	}
-      break;
+	default:
+	  emacs_abort ();
+	}
+      break;
+
+    case Lisp_Cons:
+      {
+	register struct Lisp_Cons *ptr = XCONS (obj);
+	if (CONS_MARKED_P (ptr))
+	  break;
+	CHECK_ALLOCATED_AND_LIVE (live_cons_p);
+	CONS_MARK (ptr);
+	/* If the cdr is nil, avoid recursion for the car.  */
+	if (EQ (ptr->u.cdr, Qnil))
+	  {
+	    obj = ptr->car;
+	    cdr_count = 0;
+	    goto loop;
+	  }
+	mark_object (ptr->car);
+	obj = ptr->u.cdr;
+	cdr_count++;
+	if (cdr_count == mark_object_loop_halt)
+	  emacs_abort ();
+	goto loop;
+      }
+
+    case Lisp_Float:
+      CHECK_ALLOCATED_AND_LIVE (live_float_p);
+      FLOAT_MARK (XFLOAT (obj));
+      break;
+
+    case_Lisp_Int:
+      break;
+
+    default:
+      emacs_abort ();
+    }
+
+#undef CHECK_LIVE
+#undef CHECK_ALLOCATED
+#undef CHECK_ALLOCATED_AND_LIVE
+}
+/* Mark the Lisp pointers in the terminal objects.
+   Called by Fgarbage_collect.  */
+
+static void
+mark_terminals (void)
+{
+  struct terminal *t;
+  for (t = terminal_list; t; t = t->next_terminal)
+    {
+      eassert (t->name != NULL);
+#ifdef HAVE_WINDOW_SYSTEM
+      /* If a terminal object is reachable from a stacpro'ed object,
+	 it might have been marked already.  Make sure the image cache
+	 gets marked.  */
+      mark_image_cache (t->image_cache);
+#endif /* HAVE_WINDOW_SYSTEM */
+      if (!VECTOR_MARKED_P (t))
+	mark_vectorlike ((struct Lisp_Vector *)t);
+    }
+}
+
+
+
+/* Value is non-zero if OBJ will survive the current GC because it's
+   either marked or does not need to be marked to survive.  */
+
+bool
+survives_gc_p (Lisp_Object obj)
+{
+  bool survives_p;
+
+  switch (XTYPE (obj))
+    {
+    case_Lisp_Int:
+      survives_p = 1;
+      break;
+
+    case Lisp_Symbol:
+      survives_p = XSYMBOL (obj)->gcmarkbit;
+      break;
+
+    case Lisp_Misc:
+      survives_p = XMISCANY (obj)->gcmarkbit;
+      break;
+
+    case Lisp_String:
+      survives_p = STRING_MARKED_P (XSTRING (obj));
+      break;
+
+    case Lisp_Vectorlike:
+      survives_p = SUBRP (obj) || VECTOR_MARKED_P (XVECTOR (obj));
+      break;
+
+    case Lisp_Cons:
+      survives_p = CONS_MARKED_P (XCONS (obj));
+      break;
+
+    case Lisp_Float:
+      survives_p = FLOAT_MARKED_P (XFLOAT (obj));
+      break;
+
+    default:
+      emacs_abort ();
+    }
+
+  return survives_p || PURE_POINTER_P ((void *) XPNTR (obj));
+}
+
+
+
+
+/* Sweeping the blocks of conses, floats and symbols.
+
+   These blocks are swept one at a time by sweep_block, possibly by
+   several threads at once.  Sweeping a block touches only the objects
+   in it: it chains the free ones into a list of their own, and counts
+   them.  Afterwards, sweep_conses and friends join these lists in
+   block order, and free the blocks that are entirely free, in the
+   main thread.  The result is the same as if the blocks had been
+   swept one after another.
+
+   The objects freed are marked, so that a minor collection, which
+   sweeps only the young blocks, does not free them again.  A minor
+   collection frees the young symbols in sweep_symbols instead, as
+   there are usually few of them.  */
+
+enum sweep_kind { SWEEP_CONSES, SWEEP_FLOATS, SWEEP_SYMBOLS };
+
+struct sweep_task
+{
+  /* The block to sweep, and how many objects in it are in use.  */
+  void *block;
+  int lim;
+  enum sweep_kind kind;
+
+  /* The free objects of the block, chained from HEAD to TAIL.  */
+  void *head, *tail;
+
+  /* How many objects in the block are free, and how many are live.  */
+  int nfree, nused;
+
+  /* True if a free symbol in the block has a buffer-local value.  */
+  bool localized;
+};
+
+/* The blocks to sweep, conses first, then floats, then symbols, each
+   in the order of their block list.  */
+
+static struct sweep_task *sweep_tasks;
+static ptrdiff_t sweep_tasks_used, sweep_tasks_size;
+
+/* Where the floats and the symbols start in sweep_tasks.  */
+
+static ptrdiff_t sweep_floats_start, sweep_symbols_start;
+
+/* Sweep this many blocks as a unit of work.  */
+
+enum { SWEEP_CHUNK_SIZE = 16 };
+
+/* Don't bother with other threads if there are fewer blocks than
+   this.  */
+
+enum { SWEEP_PARALLEL_MIN = 4 * SWEEP_CHUNK_SIZE };
+
+static void
+sweep_cons_block (struct sweep_task *task)
+{
+  struct cons_block *cblk = task->block;
+  int lim = task->lim;
+  struct Lisp_Cons *free_list = NULL, *last = NULL;
+  int i, this_free = 0, num_used = 0;
+  int ilim = (lim + BITS_PER_BITS_WORD - 1) / BITS_PER_BITS_WORD;
+
+  /* Scan the mark bits an int at a time.  */
+  for (i = 0; i < ilim; i++)
+    {
+      if (cblk->gcmarkbits[i] == BITS_WORD_MAX)
+	{
+	  /* Fast path - all cons cells for this int are marked.
+	     They stay marked, as part of the old generation.  */
+	  num_used += BITS_PER_BITS_WORD;
+	}
+      else
+	{
+	  /* Some cons cells for this int are not marked.
+	     Find which ones, and free them.  */
+	  int start, pos, stop;
+
+	  start = i * BITS_PER_BITS_WORD;
+	  stop = lim - start;
+	  if (stop > BITS_PER_BITS_WORD)
+	    stop = BITS_PER_BITS_WORD;
+	  stop += start;
+
+	  for (pos = start; pos < stop; pos++)
+	    {
+	      if (!CONS_MARKED_P (&cblk->conses[pos]))
+		{
+		  this_free++;
+		  SETMARKBIT (cblk, pos);
+		  if (!free_list)
+		    last = &cblk->conses[pos];
+		  cblk->conses[pos].u.chain = free_list;
+		  free_list = &cblk->conses[pos];
+#if GC_MARK_STACK
+		  free_list->car = Vdead;
+#endif
+		}
+	      else
+		num_used++;
+	    }
+	}
+    }
+
+  task->head = free_list;
+  task->tail = last;
+  task->nfree = this_free;
+  task->nused = num_used;
+}
+
+static void
+sweep_float_block (struct sweep_task *task)
+{
+  struct float_block *fblk = task->block;
+  struct Lisp_Float *free_list = NULL, *last = NULL;
+  int i, this_free = 0, num_used = 0;
+
+  for (i = 0; i < task->lim; i++)
+    if (!FLOAT_MARKED_P (&fblk->floats[i]))
+      {
+	this_free++;
+	SETMARKBIT (fblk, i);
+	if (!free_list)
+	  last = &fblk->floats[i];
+	fblk->floats[i].u.chain = free_list;
+	free_list = &fblk->floats[i];
+      }
+    else
+      num_used++;
+
+  task->head = free_list;
+  task->tail = last;
+  task->nfree = this_free;
+  task->nused = num_used;
+}
+
+static void
+sweep_symbol_block (struct sweep_task *task)
+{
+  struct symbol_block *sblk = task->block;
+  union aligned_Lisp_Symbol *sym = sblk->symbols;
+  union aligned_Lisp_Symbol *end = sym + task->lim;
+  struct Lisp_Symbol *free_list = NULL, *last = NULL;
+  int this_free = 0, num_used = 0;
+  bool localized = false;
+
+  for (; sym < end; ++sym)
+    {
+      if (!sym->s.gcmarkbit)
+	{
+	  /* The buffer-local value is freed later, by the main
+	     thread.  */
+	  if (sym->s.redirect == SYMBOL_LOCALIZED)
+	    localized = true;
+	  if (!free_list)
+	    last = &sym->s;
+	  sym->s.next = free_list;
+	  free_list = &sym->s;
+#if GC_MARK_STACK
+	  free_list->function = Vdead;
+#endif
+	  ++this_free;
+	}
+      else
+	{
+	  ++num_used;
+	  /* Attempt to catch bogus objects.  */
+	  eassert (valid_lisp_object_p (sym->s.function) >= 1);
+	}
+    }
+
+  task->head = free_list;
+  task->tail = last;
+  task->nfree = this_free;
+  task->nused = num_used;
+  task->localized = localized;
+}
+
+/* Sweep the blocks of tasks START (inclusive) to END (exclusive).  */
+
+static void
+sweep_blocks (ptrdiff_t start, ptrdiff_t end)
+{
+  struct sweep_task *task;
+
+  for (task = sweep_tasks + start; task < sweep_tasks + end; task++)
+    switch (task->kind)
+      {
+      case SWEEP_CONSES:
+	sweep_cons_block (task);
+	break;
+      case SWEEP_FLOATS:
+	sweep_float_block (task);
+	break;
+      case SWEEP_SYMBOLS:
+	sweep_symbol_block (task);
+	break;
+      }
+}
+
+static void
+add_sweep_task (void *block, int lim, enum sweep_kind kind)
+{
+  struct sweep_task *task;
+
+  if (sweep_tasks_used == sweep_tasks_size)
+    sweep_tasks = xpalloc (sweep_tasks, &sweep_tasks_size, 1, -1,
+			   sizeof *sweep_tasks);
+  task = &sweep_tasks[sweep_tasks_used++];
+  task->block = block;
+  task->lim = lim;
+  task->kind = kind;
+  task->localized = false;
+}
+
+#ifdef HAVE_PTHREAD
+
+/* The sweeper threads.  They wait on sweep_work for sweep_generation
+   to change, and then take chunks of SWEEP_CHUNK_SIZE tasks until
+   there are none left.  The main thread waits on sweep_done for all
+   the chunks to be swept.  All of this is protected by
+   sweep_mutex.  */
+
+static pthread_mutex_t sweep_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sweep_work = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t sweep_done = PTHREAD_COND_INITIALIZER;
+
+/* Incremented each time there are blocks to sweep.  */
+
+static EMACS_INT sweep_generation;
+
+/* The next task to take, and how many tasks have been swept.  */
+
+static ptrdiff_t sweep_next_task, sweep_tasks_swept;
 
-    case Lisp_Cons:
-      {
-	register struct Lisp_Cons *ptr = XCONS (obj);
-	if (CONS_MARKED_P (ptr))
-	  break;
-	CHECK_ALLOCATED_AND_LIVE (live_cons_p);
-	CONS_MARK (ptr);
-	/* If the cdr is nil, avoid recursion for the car.  */
-	if (EQ (ptr->u.cdr, Qnil))
-	  {
-	    obj = ptr->car;
-	    cdr_count = 0;
-	    goto loop;
-	  }
-	mark_object (ptr->car);
-	obj = ptr->u.cdr;
-	cdr_count++;
-	if (cdr_count == mark_object_loop_halt)
-	  emacs_abort ();
-	goto loop;
-      }
+/* The number of sweeper threads started, and how many of them take
+   part in the current sweep.  */
 
-    case Lisp_Float:
-      CHECK_ALLOCATED_AND_LIVE (live_float_p);
-      FLOAT_MARK (XFLOAT (obj));
-      break;
+static int sweep_threads_started, sweep_threads_active;
 
-    case_Lisp_Int:
-      break;
+/* The most threads that gc-sweep-threads can ask for.  */
 
-    default:
-      emacs_abort ();
-    }
+enum { SWEEP_THREADS_MAX = 64 };
 
-#undef CHECK_LIVE
-#undef CHECK_ALLOCATED
-#undef CHECK_ALLOCATED_AND_LIVE
-}
-/* Mark the Lisp pointers in the terminal objects.
-   Called by Fgarbage_collect.  */
+/* Take chunks of tasks and sweep them until there are none left.
+   Call with sweep_mutex locked.  */
 
 static void
-mark_terminals (void)
+sweep_chunks (void)
 {
-  struct terminal *t;
-  for (t = terminal_list; t; t = t->next_terminal)
+  while (sweep_next_task < sweep_tasks_used)
     {
-      eassert (t->name != NULL);
-#ifdef HAVE_WINDOW_SYSTEM
-      /* If a terminal object is reachable from a stacpro'ed object,
-	 it might have been marked already.  Make sure the image cache
-	 gets marked.  */
-      mark_image_cache (t->image_cache);
-#endif /* HAVE_WINDOW_SYSTEM */
-      if (!VECTOR_MARKED_P (t))
-	mark_vectorlike ((struct Lisp_Vector *)t);
+      ptrdiff_t start = sweep_next_task;
+      ptrdiff_t end = min (start + SWEEP_CHUNK_SIZE, sweep_tasks_used);
+
+      sweep_next_task = end;
+      pthread_mutex_unlock (&sweep_mutex);
+      sweep_blocks (start, end);
+      pthread_mutex_lock (&sweep_mutex);
+      sweep_tasks_swept += end - start;
+      if (sweep_tasks_swept == sweep_tasks_used)
+	pthread_cond_signal (&sweep_done);
     }
 }
 
+static void *
+sweep_thread (void *arg)
+{
+  int index = (intptr_t) arg;
+  EMACS_INT generation = 0;
 
+  pthread_mutex_lock (&sweep_mutex);
+  for (;;)
+    {
+      while (generation == sweep_generation)
+	pthread_cond_wait (&sweep_work, &sweep_mutex);
+      generation = sweep_generation;
+      if (index < sweep_threads_active)
+	sweep_chunks ();
+    }
+  return NULL;
+}
 
-/* Value is non-zero if OBJ will survive the current GC because it's
-   either marked or does not need to be marked to survive.  */
+/* Start sweeper threads until there are N of them.  Return how many
+   there are.  */
 
-bool
-survives_gc_p (Lisp_Object obj)
+static int
+start_sweep_threads (int n)
 {
-  bool survives_p;
+  sigset_t all, old;
 
-  switch (XTYPE (obj))
+  n = min (n, SWEEP_THREADS_MAX);
+  if (sweep_threads_started >= n)
+    return sweep_threads_started;
+
+  /* Signals are for the main thread.  */
+  sigfillset (&all);
+  pthread_sigmask (SIG_BLOCK, &all, &old);
+  while (sweep_threads_started < n)
     {
-    case_Lisp_Int:
-      survives_p = 1;
-      break;
+      pthread_t thread;
+      pthread_attr_t attr;
+      bool ok;
 
-    case Lisp_Symbol:
-      survives_p = XSYMBOL (obj)->gcmarkbit;
-      break;
+      if (pthread_attr_init (&attr) != 0)
+	break;
+      pthread_attr_setdetachstate (&attr, PTHREAD_CREATE_DETACHED);
+      ok = (pthread_create (&thread, &attr, sweep_thread,
+			    (void *) (intptr_t) sweep_threads_started)
+	    == 0);
+      pthread_attr_destroy (&attr);
+      if (!ok)
+	break;
+      sweep_threads_started++;
+    }
+  pthread_sigmask (SIG_SETMASK, &old, NULL);
+  return sweep_threads_started;
+}
 
-    case Lisp_Misc:
-      survives_p = XMISCANY (obj)->gcmarkbit;
-      break;
+#endif /* HAVE_PTHREAD */
 
-    case Lisp_String:
-      survives_p = STRING_MARKED_P (XSTRING (obj));
-      break;
+/* Sweep all the blocks of conses, floats and symbols, or only the
+   young blocks of conses and floats if MINOR, using the sweeper
+   threads if there are enough blocks.  */
 
-    case Lisp_Vectorlike:
-      survives_p = SUBRP (obj) || VECTOR_MARKED_P (XVECTOR (obj));
-      break;
+static void
+sweep_all_blocks (bool minor)
+{
+  struct cons_block *cblk;
+  struct float_block *fblk;
+  struct symbol_block *sblk;
+  int lim;
 
-    case Lisp_Cons:
-      survives_p = CONS_MARKED_P (XCONS (obj));
-      break;
+  sweep_tasks_used = 0;
 
-    case Lisp_Float:
-      survives_p = FLOAT_MARKED_P (XFLOAT (obj));
-      break;
+  if (minor)
+    {
+      for (cblk = young_cons_blocks; cblk;
+	   cblk = cblk->next_young == cblk ? NULL : cblk->next_young)
+	add_sweep_task (cblk, (cblk == cons_block
+			       ? cons_block_index : CONS_BLOCK_SIZE),
+			SWEEP_CONSES);
+
+      sweep_floats_start = sweep_tasks_used;
+      for (fblk = young_float_blocks; fblk;
+	   fblk = fblk->next_young == fblk ? NULL : fblk->next_young)
+	add_sweep_task (fblk, (fblk == float_block
+			       ? float_block_index : FLOAT_BLOCK_SIZE),
+			SWEEP_FLOATS);
+
+      sweep_symbols_start = sweep_tasks_used;
+    }
+  else
+    {
+      lim = cons_block_index;
+      for (cblk = cons_block; cblk; cblk = cblk->next)
+	{
+	  add_sweep_task (cblk, lim, SWEEP_CONSES);
+	  lim = CONS_BLOCK_SIZE;
+	}
 
-    default:
-      emacs_abort ();
+      sweep_floats_start = sweep_tasks_used;
+      lim = float_block_index;
+      for (fblk = float_block; fblk; fblk = fblk->next)
+	{
+	  add_sweep_task (fblk, lim, SWEEP_FLOATS);
+	  lim = FLOAT_BLOCK_SIZE;
+	}
+
+      sweep_symbols_start = sweep_tasks_used;
+      lim = symbol_block_index;
+      for (sblk = symbol_block; sblk; sblk = sblk->next)
+	{
+	  add_sweep_task (sblk, lim, SWEEP_SYMBOLS);
+	  lim = SYMBOL_BLOCK_SIZE;
+	}
     }
 
-  return survives_p || PURE_POINTER_P ((void *) XPNTR (obj));
+#ifdef HAVE_PTHREAD
+  /* Threads started before dumping would not survive it.  */
+  if (initialized && gc_sweep_threads > 0
+      && sweep_tasks_used >= SWEEP_PARALLEL_MIN
+      && start_sweep_threads (gc_sweep_threads) > 0)
+    {
+      pthread_mutex_lock (&sweep_mutex);
+      sweep_next_task = sweep_tasks_swept = 0;
+      sweep_threads_active = min (gc_sweep_threads, sweep_threads_started);
+      sweep_generation++;
+      pthread_cond_broadcast (&sweep_work);
+      sweep_chunks ();
+      while (sweep_tasks_swept < sweep_tasks_used)
+	pthread_cond_wait (&sweep_done, &sweep_mutex);
+      pthread_mutex_unlock (&sweep_mutex);
+      return;
+    }
+#endif
+
+  sweep_blocks (0, sweep_tasks_used);
 }
 
+/* Add the conses freed in the young blocks to the free list, for a
+   minor collection.  */
 
-
+static void
+sweep_young_conses (void)
+{
+  struct sweep_task *task;
+  struct cons_block *cblk, *next;
+
+  for (task = sweep_tasks; task < sweep_tasks + sweep_floats_start; task++)
+    if (task->head)
+      {
+	((struct Lisp_Cons *) task->tail)->u.chain = cons_free_list;
+	cons_free_list = task->head;
+	total_conses -= task->nfree;
+	total_free_conses += task->nfree;
+      }
+
+  for (cblk = young_cons_blocks; cblk; cblk = next)
+    {
+      next = cblk->next_young == cblk ? NULL : cblk->next_young;
+      cblk->next_young = NULL;
+    }
+  young_cons_blocks = NULL;
+}
 
 NO_INLINE /* For better stack traces */
 static void
@@ -6542,72 +7954,31 @@ sweep_conses (void)
 {
   struct cons_block *cblk;
   struct cons_block **cprev = &cons_block;
-  int lim = cons_block_index;
+  struct sweep_task *task = sweep_tasks;
   EMACS_INT num_free = 0, num_used = 0;
 
   cons_free_list = 0;
 
-  for (cblk = cons_block; cblk; cblk = *cprev)
+  for (cblk = cons_block; cblk; cblk = *cprev, task++)
     {
-      int i = 0;
-      int this_free = 0;
-      int ilim = (lim + BITS_PER_BITS_WORD - 1) / BITS_PER_BITS_WORD;
-
-      /* Scan the mark bits an int at a time.  */
-      for (i = 0; i < ilim; i++)
-        {
-          if (cblk->gcmarkbits[i] == BITS_WORD_MAX)
-            {
-              /* Fast path - all cons cells for this int are marked.  */
-              cblk->gcmarkbits[i] = 0;
-              num_used += BITS_PER_BITS_WORD;
-            }
-          else
-            {
-              /* Some cons cells for this int are not marked.
-                 Find which ones, and free them.  */
-              int start, pos, stop;
-
-              start = i * BITS_PER_BITS_WORD;
-              stop = lim - start;
-              if (stop > BITS_PER_BITS_WORD)
-                stop = BITS_PER_BITS_WORD;
-              stop += start;
-
-              for (pos = start; pos < stop; pos++)
-                {
-                  if (!CONS_MARKED_P (&cblk->conses[pos]))
-                    {
-                      this_free++;
-                      cblk->conses[pos].u.chain = cons_free_list;
-                      cons_free_list = &cblk->conses[pos];
-#if GC_MARK_STACK
-                      cons_free_list->car = Vdead;
-#endif
-                    }
-                  else
-                    {
-                      num_used++;
-                      CONS_UNMARK (&cblk->conses[pos]);
-                    }
-                }
-            }
-        }
-
-      lim = CONS_BLOCK_SIZE;
+      eassert (task->block == cblk);
+      num_used += task->nused;
       /* If this block contains only free conses and we have already
          seen more than two blocks worth of free conses then deallocate
          this block.  */
-      if (this_free == CONS_BLOCK_SIZE && num_free > CONS_BLOCK_SIZE)
+      if (task->nfree == CONS_BLOCK_SIZE && num_free > CONS_BLOCK_SIZE)
         {
           *cprev = cblk->next;
-          /* Unhook from the free list.  */
-          cons_free_list = cblk->conses[0].u.chain;
           lisp_align_free (cblk);
         }
       else
         {
-          num_free += this_free;
+          if (task->head)
+            {
+              ((struct Lisp_Cons *) task->tail)->u.chain = cons_free_list;
+              cons_free_list = task->head;
+            }
+          num_free += task->nfree;
           cprev = &cblk->next;
         }
     }
@@ -6615,47 +7986,63 @@ sweep_conses (void)
   total_free_conses = num_free;
 }
 
+/* Likewise for the floats.  */
+
+static void
+sweep_young_floats (void)
+{
+  struct sweep_task *task;
+  struct float_block *fblk, *next;
+
+  for (task = sweep_tasks + sweep_floats_start;
+       task < sweep_tasks + sweep_symbols_start; task++)
+    if (task->head)
+      {
+	((struct Lisp_Float *) task->tail)->u.chain = float_free_list;
+	float_free_list = task->head;
+	total_floats -= task->nfree;
+	total_free_floats += task->nfree;
+      }
+
+  for (fblk = young_float_blocks; fblk; fblk = next)
+    {
+      next = fblk->next_young == fblk ? NULL : fblk->next_young;
+      fblk->next_young = NULL;
+    }
+  young_float_blocks = NULL;
+}
+
 NO_INLINE /* For better stack traces */
 static void
 sweep_floats (void)
 {
   register struct float_block *fblk;
   struct float_block **fprev = &float_block;
-  register int lim = float_block_index;
+  struct sweep_task *task = sweep_tasks + sweep_floats_start;
   EMACS_INT num_free = 0, num_used = 0;
 
   float_free_list = 0;
 
-  for (fblk = float_block; fblk; fblk = *fprev)
+  for (fblk = float_block; fblk; fblk = *fprev, task++)
     {
-      register int i;
-      int this_free = 0;
-      for (i = 0; i < lim; i++)
-        if (!FLOAT_MARKED_P (&fblk->floats[i]))
-          {
-            this_free++;
-            fblk->floats[i].u.chain = float_free_list;
-            float_free_list = &fblk->floats[i];
-          }
-        else
-          {
-            num_used++;
-            FLOAT_UNMARK (&fblk->floats[i]);
-          }
-      lim = FLOAT_BLOCK_SIZE;
+      eassert (task->block == fblk);
+      num_used += task->nused;
       /* If this block contains only free floats and we have already
          seen more than two blocks worth of free floats then deallocate
          this block.  */
-      if (this_free == FLOAT_BLOCK_SIZE && num_free > FLOAT_BLOCK_SIZE)
+      if (task->nfree == FLOAT_BLOCK_SIZE && num_free > FLOAT_BLOCK_SIZE)
         {
           *fprev = fblk->next;
-          /* Unhook from the free list.  */
-          float_free_list = fblk->floats[0].u.chain;
           lisp_align_free (fblk);
         }
       else
         {
-          num_free += this_free;
+          if (task->head)
+            {
+              ((struct Lisp_Float *) task->tail)->u.chain = float_free_list;
+              float_free_list = task->head;
+            }
+          num_free += task->nfree;
           fprev = &fblk->next;
         }
     }
@@ -6714,59 +8101,74 @@ sweep_intervals (void)
   total_free_intervals = num_free;
 }
 
+/* Free the unmarked young symbols, for a minor collection.  */
+
+static void
+sweep_young_symbols (void)
+{
+  ptrdiff_t i;
+
+  for (i = 0; i < young_symbols.used; i++)
+    {
+      struct Lisp_Symbol *sym = young_symbols.items[i];
+
+      if (!sym->gcmarkbit)
+	{
+	  if (sym->redirect == SYMBOL_LOCALIZED)
+	    xfree (SYMBOL_BLV (sym));
+	  sym->next = symbol_free_list;
+	  symbol_free_list = sym;
+#if GC_MARK_STACK
+	  sym->function = Vdead;
+#endif
+	  total_symbols--;
+	  total_free_symbols++;
+	}
+    }
+  young_symbols.used = 0;
+}
+
 NO_INLINE /* For better stack traces */
 static void
 sweep_symbols (void)
 {
   register struct symbol_block *sblk;
   struct symbol_block **sprev = &symbol_block;
-  register int lim = symbol_block_index;
+  struct sweep_task *task = sweep_tasks + sweep_symbols_start;
   EMACS_INT num_free = 0, num_used = 0;
 
   symbol_free_list = NULL;
 
-  for (sblk = symbol_block; sblk; sblk = *sprev)
+  for (sblk = symbol_block; sblk; sblk = *sprev, task++)
     {
-      int this_free = 0;
-      union aligned_Lisp_Symbol *sym = sblk->symbols;
-      union aligned_Lisp_Symbol *end = sym + lim;
+      eassert (task->block == sblk);
+      num_used += task->nused;
 
-      for (; sym < end; ++sym)
+      if (task->localized)
         {
-          if (!sym->s.gcmarkbit)
-            {
-              if (sym->s.redirect == SYMBOL_LOCALIZED)
-                xfree (SYMBOL_BLV (&sym->s));
-              sym->s.next = symbol_free_list;
-              symbol_free_list = &sym->s;
-#if GC_MARK_STACK
-              symbol_free_list->function = Vdead;
-#endif
-              ++this_free;
-            }
-          else
-            {
-              ++num_used;
-              sym->s.gcmarkbit = 0;
-              /* Attempt to catch bogus objects.  */
-              eassert (valid_lisp_object_p (sym->s.function) >= 1);
-            }
+          struct Lisp_Symbol *sym;
+
+          for (sym = task->head; sym; sym = sym->next)
+            if (sym->redirect == SYMBOL_LOCALIZED)
+              xfree (SYMBOL_BLV (sym));
         }
 
-      lim = SYMBOL_BLOCK_SIZE;
       /* If this block contains only free symbols and we have already
          seen more than two blocks worth of free symbols then deallocate
          this block.  */
-      if (this_free == SYMBOL_BLOCK_SIZE && num_free > SYMBOL_BLOCK_SIZE)
+      if (task->nfree == SYMBOL_BLOCK_SIZE && num_free > SYMBOL_BLOCK_SIZE)
         {
           *sprev = sblk->next;
-          /* Unhook from the free list.  */
-          symbol_free_list = sblk->symbols[0].s.next;
           lisp_free (sblk);
         }
       else
         {
-          num_free += this_free;
+          if (task->head)
+            {
+              ((struct Lisp_Symbol *) task->tail)->next = symbol_free_list;
+              symbol_free_list = task->head;
+            }
+          num_free += task->nfree;
           sprev = &sblk->next;
         }
     }
@@ -6799,6 +8201,13 @@ sweep_misc (void)
             {
               if (mblk->markers[i].m.u_any.type == Lisp_Misc_Marker)
                 unchain_marker (&mblk->markers[i].m.u_marker);
+              else if (mblk->markers[i].m.u_any.type == Lisp_Misc_Overlay)
+                {
+                  /* A live buffer keeps its overlays alive, so this
+                     one is not in any tree.  */
+                  eassert (!mblk->markers[i].m.u_overlay.buffer);
+                  xfree (mblk->markers[i].m.u_overlay.interval);
+                }
               /* Set the type of the freed object to Lisp_Misc_Free.
                  We could leave the type alone, since nobody checks it,
                  but this might catch bugs faster.  */
@@ -6858,23 +8267,151 @@ sweep_buffers (void)
       }
 }
 
-/* Sweep: find all structures not marked, and free them.  */
+#ifdef GC_CHECK_GENERATIONS
+
+/* Abort unless OBJ survives the current collection.  */
+
+static void
+check_survives (Lisp_Object obj)
+{
+  if (!survives_gc_p (obj))
+    emacs_abort ();
+}
+
+/* Check the slots of VECTOR, if it is marked.  */
+
+static void
+check_vector_generation (struct Lisp_Vector *vector)
+{
+  ptrdiff_t size = vector->header.size & ~ARRAY_MARK_FLAG;
+  ptrdiff_t i, start = 0;
+
+  if (!VECTOR_MARKED_P (vector)
+      || PSEUDOVECTOR_TYPEP (&vector->header, PVEC_BOOL_VECTOR))
+    return;
+  if (size & PSEUDOVECTOR_FLAG)
+    {
+      if (PSEUDOVECTOR_TYPEP (&vector->header, PVEC_SUB_CHAR_TABLE))
+	start = SUB_CHAR_TABLE_OFFSET;
+      size &= PSEUDOVECTOR_SIZE_MASK;
+    }
+  for (i = start; i < size; i++)
+    check_survives (vector->contents[i]);
+}
+
+/* Check that the marked conses, vectors and symbols point only to
+   objects that survive the current minor collection, which would not
+   be the case if a store into an old object escaped the write
+   barriers.  */
+
+static void
+check_generations (void)
+{
+  struct cons_block *cblk;
+  struct vector_block *vblk;
+  struct large_vector *lv;
+  struct symbol_block *sblk;
+  struct Lisp_Vector *vector;
+  int i, lim;
+
+  lim = cons_block_index;
+  for (cblk = cons_block; cblk; cblk = cblk->next)
+    {
+      for (i = 0; i < lim; i++)
+	if (GETMARKBIT (cblk, i) && !DEADP (cblk->conses[i].car))
+	  {
+	    check_survives (cblk->conses[i].car);
+	    check_survives (cblk->conses[i].u.cdr);
+	  }
+      lim = CONS_BLOCK_SIZE;
+    }
+
+  for (vblk = vector_blocks; vblk; vblk = vblk->next)
+    for (vector = (struct Lisp_Vector *) vblk->data;
+	 VECTOR_IN_BLOCK (vector, vblk);
+	 vector = ADVANCE (vector, vector_nbytes (vector)))
+      check_vector_generation (vector);
+
+  for (lv = large_vectors; lv; lv = lv->next)
+    check_vector_generation (large_vector_vec (lv));
+
+  lim = symbol_block_index;
+  for (sblk = symbol_block; sblk; sblk = sblk->next)
+    {
+      for (i = 0; i < lim; i++)
+	{
+	  struct Lisp_Symbol *sym = &sblk->symbols[i].s;
+
+	  if (!sym->gcmarkbit)
+	    continue;
+	  check_survives (sym->name);
+	  check_survives (sym->function);
+	  check_survives (sym->plist);
+	  if (sym->next)
+	    check_survives (make_lisp_ptr (sym->next, Lisp_Symbol));
+	  switch (sym->redirect)
+	    {
+	    case SYMBOL_PLAINVAL:
+	      check_survives (SYMBOL_VAL (sym));
+	      break;
+	    case SYMBOL_VARALIAS:
+	      check_survives (make_lisp_ptr (SYMBOL_ALIAS (sym),
+					     Lisp_Symbol));
+	      break;
+	    case SYMBOL_LOCALIZED:
+	      check_survives (SYMBOL_BLV (sym)->where);
+	      check_survives (SYMBOL_BLV (sym)->valcell);
+	      check_survives (SYMBOL_BLV (sym)->defcell);
+	      break;
+	    case SYMBOL_FORWARDED:
+	      break;
+	    }
+	}
+      lim = SYMBOL_BLOCK_SIZE;
+    }
+}
+
+#endif /* GC_CHECK_GENERATIONS */
+
+/* Sweep: find all structures not marked, and free them.  If MINOR,
+   free only the young conses, floats, symbols and vectors.  */
 static void
-gc_sweep (void)
+gc_sweep (bool minor)
 {
   /* Remove or mark entries in weak hash tables.
      This must be done before any object is unmarked.  */
   sweep_weak_hash_tables ();
+  sweep_byte_code_cache ();
+
+#ifdef GC_CHECK_GENERATIONS
+  if (minor)
+    check_generations ();
+#endif
 
+  sweep_all_blocks (minor);
   sweep_strings ();
   check_string_bytes (!noninteractive);
-  sweep_conses ();
-  sweep_floats ();
+  if (minor)
+    {
+      sweep_young_conses ();
+      sweep_young_floats ();
+    }
+  else
+    {
+      sweep_conses ();
+      sweep_floats ();
+    }
   sweep_intervals ();
-  sweep_symbols ();
+  if (minor)
+    sweep_young_symbols ();
+  else
+    sweep_symbols ();
   sweep_misc ();
   sweep_buffers ();
-  sweep_vectors ();
+  if (minor)
+    sweep_young_vectors ();
+  else
+    sweep_vectors ();
   check_string_bytes (!noninteractive);
 }
 
@@ -7187,6 +8724,18 @@ init_alloc (void)
 #endif
   Vgc_elapsed = make_float (0.0);
   gcs_done = 0;
+  gcs_minor_done = 0;
+
+#if defined HAVE_PTHREAD && defined _SC_NPROCESSORS_ONLN
+  /* Leave one processor for the main thread.  */
+  {
+    long int nprocs = sysconf (_SC_NPROCESSORS_ONLN);
+    gc_sweep_threads = clip_to_bounds (0, nprocs - 1, 8);
+  }
+#endif
+
+  /* Mark bits left over from dumping are meaningless now.  */
+  gc_full_pending = true;
 
 #if USE_VALGRIND
   valgrind_p = RUNNING_ON_VALGRIND != 0;
@@ -7281,6 +8830,7 @@ do hash-consing of the objects allocated to pure space.  */);
   DEFSYM (Qstring_bytes, "string-bytes");
   DEFSYM (Qvector_slots, "vector-slots");
   DEFSYM (Qheap, "heap");
+  DEFSYM (Qsweep_time, "sweep-time");
   DEFSYM (Qautomatic_gc, "Automatic GC");
 
   DEFSYM (Qgc_cons_threshold, "gc-cons-threshold");
@@ -7291,6 +8841,49 @@ do hash-consing of the objects allocated to pure space.  */);
 The time is in seconds as a floating point value.  */);
   DEFVAR_INT ("gcs-done", gcs_done,
 	      doc: /* Accumulated number of garbage collections done.  */);
+  DEFVAR_INT ("gcs-minor-done", gcs_minor_done,
+	      doc: /* Accumulated number of minor garbage collections done.
+These are included in `gcs-done'.  */);
+
+  DEFVAR_BOOL ("gc-generational", gc_generational,
+	       doc: /* Non-nil means automatic garbage collections are usually minor.
+A minor collection frees only the cons cells, floats, vectors and
+symbols allocated since the previous collection, and does not look
+into older ones unless they have been modified since then.  This
+makes collections much faster when there are many long-lived objects.
+Strings, markers and buffers are not generational: a minor collection
+looks at all of them and frees none, so its time still grows with the
+number of live strings.
+
+A full collection is done instead when the heap has grown by half
+since the previous full collection.  Calling `garbage-collect' always
+does a full collection.  */);
+  gc_generational = true;
+
+  DEFVAR_INT ("gc-sweep-threads", gc_sweep_threads,
+	      doc: /* Number of threads that help sweep the heap.
+Garbage collection frees cons cells, floats and symbols in parallel
+with this many threads besides the main one, if there are enough of
+them to be worth it.  If zero, the main thread frees them alone.
+The default depends on the number of processors.  */);
+  gc_sweep_threads = 0;
+
+  DEFVAR_LISP ("gc-max-pause", Vgc_max_pause,
+	       doc: /* If a number, collect garbage in steps of this many seconds when idle.
+When Emacs waits for input and half of `gc-cons-threshold' has been
+consed, it starts an incremental garbage collection, and does steps of
+it for as long as it keeps waiting; see `garbage-collect-step'.
+Between steps, it runs timers and handles subprocess output, and it
+stops as soon as there is input.  The commands that follow run while
+the collection is under way.
+
+Only marking is split into steps.  The final step, which marks the
+stack, strings, markers and buffers, and frees the objects that are not
+live, is done in one go and can take longer than this.
+
+If nil, collect garbage only when `gc-cons-threshold' is reached.  A
+value of 0.016 keeps the other steps within one frame at 60 Hz.  */);
+  Vgc_max_pause = Qnil;
 
   defsubr (&Scons);
   defsubr (&Slist);
@@ -7305,6 +8898,7 @@ The time is in seconds as a floating point value.  */);
   defsubr (&Smake_marker);
   defsubr (&Spurecopy);
   defsubr (&Sgarbage_collect);
+  defsubr (&Sgarbage_collect_step);
   defsubr (&Smemory_limit);
   defsubr (&Smemory_info);
   defsubr (&Smemory_use_counts);
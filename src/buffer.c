@@ -35,6 +35,7 @@ along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.  */
 #include "character.h"
 #include "buffer.h"
 #include "region-cache.h"
+#include "line-index.h"
 #include "indent.h"
 #include "blockinput.h"
 #include "keyboard.h"
@@ -151,7 +152,6 @@ static Lisp_Object Qoverwrite_mode, Qfraction;
 
 static void alloc_buffer_text (struct buffer *, ptrdiff_t);
 static void free_buffer_text (struct buffer *b);
-static struct Lisp_Overlay * copy_overlays (struct buffer *, struct Lisp_Overlay *);
 static void modify_overlay (struct buffer *, ptrdiff_t, ptrdiff_t);
 static Lisp_Object buffer_lisp_local_variables (struct buffer *, bool);
 
@@ -592,6 +592,10 @@ even if it is dead.  The return value is never nil.  */)
   *(BUF_GPT_ADDR (b)) = *(BUF_Z_ADDR (b)) = 0; /* Put an anchor '\0'.  */
   b->text->inhibit_shrinking = false;
   b->text->redisplay = false;
+  b->text->checkpoints = NULL;
+  b->text->ncheckpoints = 0;
+  b->text->checkpoints_size = 0;
+  b->text->line_index = NULL;
 
   b->newline_cache = 0;
   b->width_run_cache = 0;
@@ -611,6 +615,7 @@ even if it is dead.  The return value is never nil.  */)
 
   bset_undo_list (b, SREF (name, 0) != ' ' ? Qnil : Qt);
 
+  b->overlays = NULL;
   reset_buffer (b);
   reset_buffer_local_variables (b, 1);
 
@@ -628,59 +633,52 @@ even if it is dead.  The return value is never nil.  */)
 }
 
 
-/* Return a list of overlays which is a copy of the overlay list
-   LIST, but for buffer B.  */
+/* Add OV to the overlays of B, as the range from BEGIN to END.  */
 
-static struct Lisp_Overlay *
-copy_overlays (struct buffer *b, struct Lisp_Overlay *list)
+void
+add_buffer_overlay (struct buffer *b, struct Lisp_Overlay *ov,
+		    ptrdiff_t begin, ptrdiff_t end)
 {
-  struct Lisp_Overlay *result = NULL, *tail = NULL;
-
-  for (; list; list = list->next)
-    {
-      Lisp_Object overlay, start, end;
-      struct Lisp_Marker *m;
-
-      eassert (MARKERP (list->start));
-      m = XMARKER (list->start);
-      start = build_marker (b, m->charpos, m->bytepos);
-      XMARKER (start)->insertion_type = m->insertion_type;
-
-      eassert (MARKERP (list->end));
-      m = XMARKER (list->end);
-      end = build_marker (b, m->charpos, m->bytepos);
-      XMARKER (end)->insertion_type = m->insertion_type;
-
-      overlay = build_overlay (start, end, Fcopy_sequence (list->plist));
-      if (tail)
-	tail = tail->next = XOVERLAY (overlay);
-      else
-	result = tail = XOVERLAY (overlay);
-    }
-
-  return result;
+  eassert (!ov->buffer);
+  if (!b->overlays)
+    b->overlays = itree_create ();
+  ov->buffer = b;
+  itree_insert (b->overlays, ov->interval, begin, end);
 }
 
-/* Set an appropriate overlay of B.  */
+/* Remove OV from the overlays of its buffer.  */
 
 static void
-set_buffer_overlays_before (struct buffer *b, struct Lisp_Overlay *o)
+remove_buffer_overlay (struct Lisp_Overlay *ov)
 {
-  b->overlays_before = o;
+  eassert (ov->buffer);
+  itree_remove (ov->buffer->overlays, ov->interval);
+  ov->buffer = NULL;
 }
 
+/* Give buffer TO a copy of each overlay of buffer FROM.  */
+
 static void
-set_buffer_overlays_after (struct buffer *b, struct Lisp_Overlay *o)
+copy_overlays (struct buffer *from, struct buffer *to)
 {
-  b->overlays_after = o;
+  struct itree_node *node;
+
+  for (node = itree_first (from->overlays); node; node = itree_next (node))
+    {
+      Lisp_Object overlay
+	= build_overlay (node->front_advance, node->rear_advance,
+			 Fcopy_sequence (OVERLAY_PLIST (node->data)));
+      add_buffer_overlay (to, XOVERLAY (overlay),
+			  itree_node_begin (from->overlays, node),
+			  itree_node_end (from->overlays, node));
+    }
 }
 
 /* Clone per-buffer values of buffer FROM.
 
    Buffer TO gets the same per-buffer values as FROM, with the
    following exceptions: (1) TO's name is left untouched, (2) markers
-   are copied and made to refer to TO, and (3) overlay lists are
-   copied.  */
+   are copied and made to refer to TO, and (3) overlays are copied.  */
 
 static void
 clone_per_buffer_values (struct buffer *from, struct buffer *to)
@@ -709,8 +707,7 @@ clone_per_buffer_values (struct buffer *from, struct buffer *to)
 
   memcpy (to->local_flags, from->local_flags, sizeof to->local_flags);
 
-  set_buffer_overlays_before (to, copy_overlays (to, from->overlays_before));
-  set_buffer_overlays_after (to, copy_overlays (to, from->overlays_after));
+  copy_overlays (from, to);
 
   /* Get (a copy of) the alist of Lisp-level local variables of FROM
      and install that in TO.  */
@@ -829,6 +826,7 @@ CLONE nil means the indirect buffer's state is reset to default values.  */)
   /* An indirect buffer shares undo list of its base (Bug#18180).  */
   bset_undo_list (b, BVAR (b->base_buffer, undo_list));
 
+  b->overlays = NULL;
   reset_buffer (b);
   reset_buffer_local_variables (b, 1);
 
@@ -895,52 +893,43 @@ CLONE nil means the indirect buffer's state is reset to default values.  */)
   return buf;
 }
 
-/* Mark OV as no longer associated with B.  */
+/* Detach all overlays from B, leaving its overlay tree empty.  */
 
 static void
-drop_overlay (struct buffer *b, struct Lisp_Overlay *ov)
+detach_overlays (struct buffer *b)
 {
-  eassert (b == XBUFFER (Fmarker_buffer (ov->start)));
-  modify_overlay (b, marker_position (ov->start),
-		  marker_position (ov->end));
-  unchain_marker (XMARKER (ov->start));
-  unchain_marker (XMARKER (ov->end));
+  struct itree_node *node;
 
+  for (node = itree_first (b->overlays); node; node = itree_next (node))
+    XOVERLAY (node->data)->buffer = NULL;
+  if (b->overlays)
+    itree_clear (b->overlays);
 }
 
-/* Delete all overlays of B and reset it's overlay lists.  */
+/* Delete all overlays of B.  */
 
 void
 delete_all_overlays (struct buffer *b)
 {
-  struct Lisp_Overlay *ov, *next;
+  struct itree_node *node;
+  ptrdiff_t begin = PTRDIFF_MAX, end = 0;
 
-  /* FIXME: Since each drop_overlay will scan BUF_MARKERS to unlink its
-     markers, we have an unneeded O(N^2) behavior here.  */
-  for (ov = b->overlays_before; ov; ov = next)
-    {
-      drop_overlay (b, ov);
-      next = ov->next;
-      ov->next = NULL;
-    }
+  if (itree_empty_p (b->overlays))
+    return;
 
-  for (ov = b->overlays_after; ov; ov = next)
+  for (node = itree_first (b->overlays); node; node = itree_next (node))
     {
-      drop_overlay (b, ov);
-      next = ov->next;
-      ov->next = NULL;
+      begin = min (begin, itree_node_begin (b->overlays, node));
+      end = max (end, itree_node_end (b->overlays, node));
     }
-
-  set_buffer_overlays_before (b, NULL);
-  set_buffer_overlays_after (b, NULL);
+  modify_overlay (b, begin, end);
+  detach_overlays (b);
 }
 
 /* Reinitialize everything about a buffer except its name and contents
    and local variables.
-   If called on an already-initialized buffer, the list of overlays
-   should be deleted before calling this function, otherwise we end up
-   with overlays that claim to belong to the buffer but the buffer
-   claims it doesn't belong to it.  */
+   If called on an already-initialized buffer, its overlays should be
+   deleted before calling this function; their tree is left alone.  */
 
 void
 reset_buffer (register struct buffer *b)
@@ -960,9 +949,6 @@ reset_buffer (register struct buffer *b)
   b->auto_save_failure_time = 0;
   bset_auto_save_file_name (b, Qnil);
   bset_read_only (b, Qnil);
-  set_buffer_overlays_before (b, NULL);
-  set_buffer_overlays_after (b, NULL);
-  b->overlay_center = BEG;
   bset_mark_active (b, Qnil);
   bset_point_before_scroll (b, Qnil);
   bset_file_format (b, Qnil);
@@ -1052,6 +1038,7 @@ reset_buffer_local_variables (struct buffer *b, bool permanent_too)
 	  bset_local_var_alist (b, XCDR (tmp));
 	else
 	  XSETCDR (last, XCDR (tmp));
+      clear_local_var_cache (b);
     }
 
   for (i = 0; i < last_per_buffer_idx; ++i)
@@ -1196,7 +1183,7 @@ buffer_local_value (Lisp_Object variable, Lisp_Object buffer)
       { /* Look in local_var_alist.  */
 	struct Lisp_Buffer_Local_Value *blv = SYMBOL_BLV (sym);
 	XSETSYMBOL (variable, sym); /* Update In case of aliasing.  */
-	result = Fassoc (variable, BVAR (buf, local_var_alist));
+	result = buffer_local_binding (buf, variable);
 	if (!NILP (result))
 	  {
 	    if (blv->fwd)
@@ -1873,8 +1860,12 @@ cleaning up all windows currently displaying the buffer to be killed. */)
     }
   /* Since we've unlinked the markers, the overlays can't be here any more
      either.  */
-  b->overlays_before = NULL;
-  b->overlays_after = NULL;
+  if (b->overlays)
+    {
+      detach_overlays (b);
+      itree_destroy (b->overlays);
+      b->overlays = NULL;
+    }
 
   /* Reset the local variables, so that this buffer's local values
      won't be protected from GC.  They would be protected
@@ -2332,9 +2323,7 @@ DEFUN ("buffer-swap-text", Fbuffer_swap_text, Sbuffer_swap_text,
   swapfield (bidi_paragraph_cache, struct region_cache *);
   current_buffer->prevent_redisplay_optimizations_p = 1;
   other_buffer->prevent_redisplay_optimizations_p = 1;
-  swapfield (overlays_before, struct Lisp_Overlay *);
-  swapfield (overlays_after, struct Lisp_Overlay *);
-  swapfield (overlay_center, ptrdiff_t);
+  swapfield (overlays, struct itree_tree *);
   swapfield_ (undo_list, Lisp_Object);
   swapfield_ (mark, Lisp_Object);
   swapfield_ (enable_multibyte_characters, Lisp_Object);
@@ -2357,6 +2346,7 @@ DEFUN ("buffer-swap-text", Fbuffer_swap_text, Sbuffer_swap_text,
   other_buffer->text->end_unchanged = other_buffer->text->gpt;
   {
     struct Lisp_Marker *m;
+    struct itree_node *node;
     for (m = BUF_MARKERS (current_buffer); m; m = m->next)
       if (m->buffer == other_buffer)
 	m->buffer = current_buffer;
@@ -2371,6 +2361,12 @@ DEFUN ("buffer-swap-text", Fbuffer_swap_text, Sbuffer_swap_text,
 	/* Since there's no indirect buffer in sight, markers on
 	   BUF_MARKERS(buf) should either be for `buf' or dead.  */
 	eassert (!m->buffer);
+    for (node = itree_first (current_buffer->overlays); node;
+	 node = itree_next (node))
+      XOVERLAY (node->data)->buffer = current_buffer;
+    for (node = itree_first (other_buffer->overlays); node;
+	 node = itree_next (node))
+      XOVERLAY (node->data)->buffer = other_buffer;
   }
   { /* Some of the C code expects that both window markers of a
        live window points to that window's buffer.  So since we
@@ -2419,6 +2415,58 @@ DEFUN ("buffer-swap-text", Fbuffer_swap_text, Sbuffer_swap_text,
   return Qnil;
 }
 
+/* Convert the overlay positions of B, which shares the text of the
+   current buffer, from characters to bytes if MULTIBYTE is false, or
+   from bytes to characters if it is true.  In the first case this must
+   be called while the text is still multibyte, in the second after it
+   has become multibyte.  */
+
+static void
+convert_buffer_overlays (struct buffer *b, bool multibyte)
+{
+  struct itree_node **nodes, *node;
+  ptrdiff_t *positions, n, i;
+  USE_SAFE_ALLOCA;
+
+  if (itree_empty_p (b->overlays))
+    return;
+
+  n = b->overlays->size;
+  SAFE_NALLOCA (nodes, 1, n);
+  SAFE_NALLOCA (positions, 2, n);
+  for (i = 0, node = itree_first (b->overlays); node;
+       i++, node = itree_next (node))
+    {
+      nodes[i] = node;
+      positions[2 * i] = itree_node_begin (b->overlays, node);
+      positions[2 * i + 1] = itree_node_end (b->overlays, node);
+    }
+  itree_clear (b->overlays);
+
+  for (i = 0; i < 2 * n; i++)
+    positions[i] = (multibyte
+		    ? BYTE_TO_CHAR (advance_to_char_boundary (positions[i]))
+		    : CHAR_TO_BYTE (positions[i]));
+  for (i = 0; i < n; i++)
+    itree_insert (b->overlays, nodes[i], positions[2 * i],
+		  positions[2 * i + 1]);
+  SAFE_FREE ();
+}
+
+/* Convert the overlays of the current buffer and of its indirect
+   buffers, as convert_buffer_overlays does.  */
+
+static void
+set_overlays_multibyte (bool multibyte)
+{
+  struct buffer *other;
+
+  convert_buffer_overlays (current_buffer, multibyte);
+  FOR_EACH_BUFFER (other)
+    if (other->base_buffer == current_buffer && BUFFER_LIVE_P (other))
+      convert_buffer_overlays (other, multibyte);
+}
+
 DEFUN ("set-buffer-multibyte", Fset_buffer_multibyte, Sset_buffer_multibyte,
        1, 1, 0,
        doc: /* Set the multibyte flag of the current buffer to FLAG.
@@ -2474,6 +2522,7 @@ current buffer is cleared.  */)
       /* Do this first, so it can use CHAR_TO_BYTE
 	 to calculate the old correspondences.  */
       set_intervals_multibyte (0);
+      set_overlays_multibyte (0);
 
       bset_enable_multibyte_characters (current_buffer, Qnil);
 
@@ -2666,6 +2715,7 @@ current buffer is cleared.  */)
       /* Do this last, so it can calculate the new correspondences
 	 between chars and bytes.  */
       set_intervals_multibyte (1);
+      set_overlays_multibyte (1);
     }
 
   if (!EQ (old_undo, Qt))
@@ -2802,8 +2852,8 @@ overlays_at (EMACS_INT pos, bool extend, Lisp_Object **vec_ptr,
 	     ptrdiff_t *len_ptr,
 	     ptrdiff_t *next_ptr, ptrdiff_t *prev_ptr, bool change_req)
 {
-  Lisp_Object overlay, start, end;
-  struct Lisp_Overlay *tail;
+  struct itree_iterator iter;
+  struct itree_node *node;
   ptrdiff_t idx = 0;
   ptrdiff_t len = *len_ptr;
   Lisp_Object *vec = *vec_ptr;
@@ -2811,29 +2861,21 @@ overlays_at (EMACS_INT pos, bool extend, Lisp_Object **vec_ptr,
   ptrdiff_t prev = BEGV;
   bool inhibit_storing = 0;
 
-  for (tail = current_buffer->overlays_before; tail; tail = tail->next)
+  /* The overlays that touch POS come first in this search.  If we
+     need NEXT, the first one that starts after POS gives it.  */
+  itree_iterator_start (&iter, current_buffer->overlays,
+			pos, next_ptr ? max (pos, ZV) : pos, true);
+  while ((node = itree_iterator_next (&iter)))
     {
-      ptrdiff_t startpos, endpos;
-
-      XSETMISC (overlay, tail);
-
-      start = OVERLAY_START (overlay);
-      end = OVERLAY_END (overlay);
-      endpos = OVERLAY_POSITION (end);
-      if (endpos < pos)
+      if (node->begin > pos)
 	{
-	  if (prev < endpos)
-	    prev = endpos;
+	  next = min (next, node->begin);
 	  break;
 	}
-      startpos = OVERLAY_POSITION (start);
-      /* This one ends at or after POS
-	 so its start counts for PREV_PTR if it's before POS.  */
-      if (prev < startpos && startpos < pos)
-	prev = startpos;
-      if (endpos == pos)
-	continue;
-      if (startpos <= pos)
+      if (node->begin == node->end && !change_req)
+	/* An empty overlay at POS.  */
+	prev = max (prev, node->begin);
+      if (pos < node->end)
 	{
 	  if (idx == len)
 	    {
@@ -2851,57 +2893,30 @@ overlays_at (EMACS_INT pos, bool extend, Lisp_Object **vec_ptr,
 	    }
 
 	  if (!inhibit_storing)
-	    vec[idx] = overlay;
+	    vec[idx] = node->data;
 	  /* Keep counting overlays even if we can't return them all.  */
 	  idx++;
 	}
-      else if (startpos < next)
-	next = startpos;
     }
 
-  for (tail = current_buffer->overlays_after; tail; tail = tail->next)
+  /* PREV is the last end before POS, or the last start before POS of
+     an overlay that reaches POS.  Each candidate found narrows the
+     search to the overlays that could still beat it.  */
+  if (prev_ptr && prev < pos)
     {
-      ptrdiff_t startpos, endpos;
-
-      XSETMISC (overlay, tail);
-
-      start = OVERLAY_START (overlay);
-      end = OVERLAY_END (overlay);
-      startpos = OVERLAY_POSITION (start);
-      if (pos < startpos)
-	{
-	  if (startpos < next)
-	    next = startpos;
-	  break;
-	}
-      endpos = OVERLAY_POSITION (end);
-      if (pos < endpos)
+      itree_iterator_start (&iter, current_buffer->overlays,
+			    prev + 1, pos - 1, false);
+      while ((node = itree_iterator_next (&iter)))
 	{
-	  if (idx == len)
+	  ptrdiff_t candidate = node->end < pos ? node->end : node->begin;
+	  if (candidate > prev)
 	    {
-	      if (extend)
-		{
-		  vec = xpalloc (vec, len_ptr, 1, OVERLAY_COUNT_MAX,
-				 sizeof *vec);
-		  *vec_ptr = vec;
-		  len = *len_ptr;
-		}
-	      else
-		inhibit_storing = 1;
+	      prev = candidate;
+	      if (prev + 1 > pos - 1)
+		break;
+	      itree_iterator_narrow (&iter, prev + 1, pos - 1);
 	    }
-
-	  if (!inhibit_storing)
-	    vec[idx] = overlay;
-	  idx++;
-
-	  if (startpos < pos && startpos > prev)
-	    prev = startpos;
 	}
-      else if (endpos < pos && endpos > prev)
-	prev = endpos;
-      else if (endpos == pos && startpos > prev
-	       && (!change_req || startpos < pos))
-	prev = startpos;
     }
 
   if (next_ptr)
@@ -2910,18 +2925,13 @@ overlays_at (EMACS_INT pos, bool extend, Lisp_Object **vec_ptr,
     *prev_ptr = prev;
   return idx;
 }
-
+
 /* Find all the overlays in the current buffer that overlap the range
    BEG-END, or are empty at BEG, or are empty at END provided END
    denotes the position at the end of the current buffer.
 
    Return the number found, and store them in a vector in *VEC_PTR.
    Store in *LEN_PTR the size allocated for the vector.
-   Store in *NEXT_PTR the next position after POS where an overlay starts,
-     or ZV if there are no more overlays.
-   Store in *PREV_PTR the previous position before POS where an overlay ends,
-     or BEGV if there are no previous overlays.
-   NEXT_PTR and/or PREV_PTR may be 0, meaning don't store that info.
 
    *VEC_PTR and *LEN_PTR should contain a valid vector and size
    when this function is called.
@@ -2933,35 +2943,22 @@ overlays_at (EMACS_INT pos, bool extend, Lisp_Object **vec_ptr,
 
 static ptrdiff_t
 overlays_in (EMACS_INT beg, EMACS_INT end, bool extend,
-	     Lisp_Object **vec_ptr, ptrdiff_t *len_ptr,
-	     ptrdiff_t *next_ptr, ptrdiff_t *prev_ptr)
+	     Lisp_Object **vec_ptr, ptrdiff_t *len_ptr)
 {
-  Lisp_Object overlay, ostart, oend;
-  struct Lisp_Overlay *tail;
+  struct itree_iterator iter;
+  struct itree_node *node;
   ptrdiff_t idx = 0;
   ptrdiff_t len = *len_ptr;
   Lisp_Object *vec = *vec_ptr;
-  ptrdiff_t next = ZV;
-  ptrdiff_t prev = BEGV;
   bool inhibit_storing = 0;
   bool end_is_Z = end == Z;
 
-  for (tail = current_buffer->overlays_before; tail; tail = tail->next)
+  itree_iterator_start (&iter, current_buffer->overlays,
+			min (beg, end), max (beg, end), true);
+  while ((node = itree_iterator_next (&iter)))
     {
-      ptrdiff_t startpos, endpos;
-
-      XSETMISC (overlay, tail);
+      ptrdiff_t startpos = node->begin, endpos = node->end;
 
-      ostart = OVERLAY_START (overlay);
-      oend = OVERLAY_END (overlay);
-      endpos = OVERLAY_POSITION (oend);
-      if (endpos < beg)
-	{
-	  if (prev < endpos)
-	    prev = endpos;
-	  break;
-	}
-      startpos = OVERLAY_POSITION (ostart);
       /* Count an interval if it overlaps the range, is empty at the
 	 start of the range, or is empty at END provided END denotes the
 	 end of the buffer.  */
@@ -2985,62 +2982,12 @@ overlays_in (EMACS_INT beg, EMACS_INT end, bool extend,
 	    }
 
 	  if (!inhibit_storing)
-	    vec[idx] = overlay;
+	    vec[idx] = node->data;
 	  /* Keep counting overlays even if we can't return them all.  */
 	  idx++;
 	}
-      else if (startpos < next)
-	next = startpos;
     }
 
-  for (tail = current_buffer->overlays_after; tail; tail = tail->next)
-    {
-      ptrdiff_t startpos, endpos;
-
-      XSETMISC (overlay, tail);
-
-      ostart = OVERLAY_START (overlay);
-      oend = OVERLAY_END (overlay);
-      startpos = OVERLAY_POSITION (ostart);
-      if (end < startpos)
-	{
-	  if (startpos < next)
-	    next = startpos;
-	  break;
-	}
-      endpos = OVERLAY_POSITION (oend);
-      /* Count an interval if it overlaps the range, is empty at the
-	 start of the range, or is empty at END provided END denotes the
-	 end of the buffer.  */
-      if ((beg < endpos && startpos < end)
-	  || (startpos == endpos
-	      && (beg == endpos || (end_is_Z && endpos == end))))
-	{
-	  if (idx == len)
-	    {
-	      if (extend)
-		{
-		  vec = xpalloc (vec, len_ptr, 1, OVERLAY_COUNT_MAX,
-				 sizeof *vec);
-		  *vec_ptr = vec;
-		  len = *len_ptr;
-		}
-	      else
-		inhibit_storing = 1;
-	    }
-
-	  if (!inhibit_storing)
-	    vec[idx] = overlay;
-	  idx++;
-	}
-      else if (endpos < beg && endpos > prev)
-	prev = endpos;
-    }
-
-  if (next_ptr)
-    *next_ptr = next;
-  if (prev_ptr)
-    *prev_ptr = prev;
   return idx;
 }
 
@@ -3051,8 +2998,8 @@ overlays_in (EMACS_INT beg, EMACS_INT end, bool extend,
 bool
 mouse_face_overlay_overlaps (Lisp_Object overlay)
 {
-  ptrdiff_t start = OVERLAY_POSITION (OVERLAY_START (overlay));
-  ptrdiff_t end = OVERLAY_POSITION (OVERLAY_END (overlay));
+  ptrdiff_t start = OVERLAY_START (overlay);
+  ptrdiff_t end = OVERLAY_END (overlay);
   ptrdiff_t n, i, size;
   Lisp_Object *v, tem;
   Lisp_Object vbuf[10];
@@ -3060,11 +3007,11 @@ mouse_face_overlay_overlaps (Lisp_Object overlay)
 
   size = ARRAYELTS (vbuf);
   v = vbuf;
-  n = overlays_in (start, end, 0, &v, &size, NULL, NULL);
+  n = overlays_in (start, end, 0, &v, &size);
   if (n > size)
     {
       SAFE_NALLOCA (v, 1, n);
-      overlays_in (start, end, 0, &v, &n, NULL, NULL);
+      overlays_in (start, end, 0, &v, &n);
     }
 
   for (i = 0; i < n; ++i)
@@ -3078,44 +3025,21 @@ mouse_face_overlay_overlaps (Lisp_Object overlay)
 }
 
 
-
+
 /* Fast function to just test if we're at an overlay boundary.  */
 bool
 overlay_touches_p (ptrdiff_t pos)
 {
-  Lisp_Object overlay;
-  struct Lisp_Overlay *tail;
+  struct itree_iterator iter;
+  struct itree_node *node;
 
-  for (tail = current_buffer->overlays_before; tail; tail = tail->next)
-    {
-      ptrdiff_t endpos;
-
-      XSETMISC (overlay ,tail);
-      eassert (OVERLAYP (overlay));
-
-      endpos = OVERLAY_POSITION (OVERLAY_END (overlay));
-      if (endpos < pos)
-	break;
-      if (endpos == pos || OVERLAY_POSITION (OVERLAY_START (overlay)) == pos)
-	return 1;
-    }
-
-  for (tail = current_buffer->overlays_after; tail; tail = tail->next)
-    {
-      ptrdiff_t startpos;
-
-      XSETMISC (overlay, tail);
-      eassert (OVERLAYP (overlay));
-
-      startpos = OVERLAY_POSITION (OVERLAY_START (overlay));
-      if (pos < startpos)
-	break;
-      if (startpos == pos || OVERLAY_POSITION (OVERLAY_END (overlay)) == pos)
-	return 1;
-    }
+  itree_iterator_start (&iter, current_buffer->overlays, pos, pos, true);
+  while ((node = itree_iterator_next (&iter)))
+    if (node->begin == pos || node->end == pos)
+      return 1;
   return 0;
 }
-
+
 struct sortvec
 {
   Lisp_Object overlay;
@@ -3174,8 +3098,8 @@ sort_overlays (Lisp_Object *overlay_vec, ptrdiff_t noverlays, struct window *w)
 
       overlay = overlay_vec[i];
       if (OVERLAYP (overlay)
-	  && OVERLAY_POSITION (OVERLAY_START (overlay)) > 0
-	  && OVERLAY_POSITION (OVERLAY_END (overlay)) > 0)
+	  && OVERLAY_START (overlay) > 0
+	  && OVERLAY_END (overlay) > 0)
 	{
 	  /* If we're interested in a specific window, then ignore
 	     overlays that are limited to some other window.  */
@@ -3190,8 +3114,8 @@ sort_overlays (Lisp_Object *overlay_vec, ptrdiff_t noverlays, struct window *w)
 
 	  /* This overlay is good and counts: put it into sortvec.  */
 	  sortvec[j].overlay = overlay;
-	  sortvec[j].beg = OVERLAY_POSITION (OVERLAY_START (overlay));
-	  sortvec[j].end = OVERLAY_POSITION (OVERLAY_END (overlay));
+	  sortvec[j].beg = OVERLAY_START (overlay);
+	  sortvec[j].end = OVERLAY_END (overlay);
 	  tem = Foverlay_get (overlay, Qpriority);
 	  if (NILP (tem))
 	    {
@@ -3324,49 +3248,21 @@ ptrdiff_t
 overlay_strings (ptrdiff_t pos, struct window *w, unsigned char **pstr)
 {
   Lisp_Object overlay, window, str;
-  struct Lisp_Overlay *ov;
+  struct itree_iterator iter;
+  struct itree_node *node;
   ptrdiff_t startpos, endpos;
   bool multibyte = ! NILP (BVAR (current_buffer, enable_multibyte_characters));
 
   overlay_heads.used = overlay_heads.bytes = 0;
   overlay_tails.used = overlay_tails.bytes = 0;
-  for (ov = current_buffer->overlays_before; ov; ov = ov->next)
+  itree_iterator_start (&iter, current_buffer->overlays, pos, pos, true);
+  while ((node = itree_iterator_next (&iter)))
     {
-      XSETMISC (overlay, ov);
+      overlay = node->data;
       eassert (OVERLAYP (overlay));
 
-      startpos = OVERLAY_POSITION (OVERLAY_START (overlay));
-      endpos = OVERLAY_POSITION (OVERLAY_END (overlay));
-      if (endpos < pos)
-	break;
-      if (endpos != pos && startpos != pos)
-	continue;
-      window = Foverlay_get (overlay, Qwindow);
-      if (WINDOWP (window) && XWINDOW (window) != w)
-	continue;
-      if (startpos == pos
-	  && (str = Foverlay_get (overlay, Qbefore_string), STRINGP (str)))
-	record_overlay_string (&overlay_heads, str,
-			       (startpos == endpos
-				? Foverlay_get (overlay, Qafter_string)
-				: Qnil),
-			       Foverlay_get (overlay, Qpriority),
-			       endpos - startpos);
-      else if (endpos == pos
-	  && (str = Foverlay_get (overlay, Qafter_string), STRINGP (str)))
-	record_overlay_string (&overlay_tails, str, Qnil,
-			       Foverlay_get (overlay, Qpriority),
-			       endpos - startpos);
-    }
-  for (ov = current_buffer->overlays_after; ov; ov = ov->next)
-    {
-      XSETMISC (overlay, ov);
-      eassert (OVERLAYP (overlay));
-
-      startpos = OVERLAY_POSITION (OVERLAY_START (overlay));
-      endpos = OVERLAY_POSITION (OVERLAY_END (overlay));
-      if (startpos > pos)
-	break;
+      startpos = node->begin;
+      endpos = node->end;
       if (endpos != pos && startpos != pos)
 	continue;
       window = Foverlay_get (overlay, Qwindow);
@@ -3442,385 +3338,129 @@ overlay_strings (ptrdiff_t pos, struct window *w, unsigned char **pstr)
   return 0;
 }
 
-/* Shift overlays in BUF's overlay lists, to center the lists at POS.  */
+/* Adjust the overlays of the current buffer, and of all other buffers
+   sharing its text, for the insertion of LENGTH characters at POS.
+   Overlay ends at POS move past the new text if they are advancing or
+   if BEFORE_MARKERS, just like markers do.  */
 
 void
-recenter_overlay_lists (struct buffer *buf, ptrdiff_t pos)
+adjust_overlays_for_insert (ptrdiff_t pos, ptrdiff_t length,
+			    bool before_markers)
 {
-  Lisp_Object overlay, beg, end;
-  struct Lisp_Overlay *prev, *tail, *next;
-
-  /* See if anything in overlays_before should move to overlays_after.  */
+  struct buffer *base = (current_buffer->base_buffer
+			 ? current_buffer->base_buffer : current_buffer);
 
-  /* We don't strictly need prev in this loop; it should always be nil.
-     But we use it for symmetry and in case that should cease to be true
-     with some future change.  */
-  prev = NULL;
-  for (tail = buf->overlays_before; tail; prev = tail, tail = next)
+  itree_insert_gap (base->overlays, pos, length, before_markers);
+  if (base->indirections > 0)
     {
-      next = tail->next;
-      XSETMISC (overlay, tail);
-      eassert (OVERLAYP (overlay));
-
-      beg = OVERLAY_START (overlay);
-      end = OVERLAY_END (overlay);
-
-      if (OVERLAY_POSITION (end) > pos)
-	{
-	  /* OVERLAY needs to be moved.  */
-	  ptrdiff_t where = OVERLAY_POSITION (beg);
-	  struct Lisp_Overlay *other, *other_prev;
-
-	  /* Splice the cons cell TAIL out of overlays_before.  */
-	  if (prev)
-	    prev->next = next;
-	  else
-	    set_buffer_overlays_before (buf, next);
-
-	  /* Search thru overlays_after for where to put it.  */
-	  other_prev = NULL;
-	  for (other = buf->overlays_after; other;
-	       other_prev = other, other = other->next)
-	    {
-	      Lisp_Object otherbeg, otheroverlay;
-
-	      XSETMISC (otheroverlay, other);
-	      eassert (OVERLAYP (otheroverlay));
-
-	      otherbeg = OVERLAY_START (otheroverlay);
-	      if (OVERLAY_POSITION (otherbeg) >= where)
-		break;
-	    }
-
-	  /* Add TAIL to overlays_after before OTHER.  */
-	  tail->next = other;
-	  if (other_prev)
-	    other_prev->next = tail;
-	  else
-	    set_buffer_overlays_after (buf, tail);
-	  tail = prev;
-	}
-      else
-	/* We've reached the things that should stay in overlays_before.
-	   All the rest of overlays_before must end even earlier,
-	   so stop now.  */
-	break;
-    }
-
-  /* See if anything in overlays_after should be in overlays_before.  */
-  prev = NULL;
-  for (tail = buf->overlays_after; tail; prev = tail, tail = next)
-    {
-      next = tail->next;
-      XSETMISC (overlay, tail);
-      eassert (OVERLAYP (overlay));
-
-      beg = OVERLAY_START (overlay);
-      end = OVERLAY_END (overlay);
-
-      /* Stop looking, when we know that nothing further
-	 can possibly end before POS.  */
-      if (OVERLAY_POSITION (beg) > pos)
-	break;
-
-      if (OVERLAY_POSITION (end) <= pos)
-	{
-	  /* OVERLAY needs to be moved.  */
-	  ptrdiff_t where = OVERLAY_POSITION (end);
-	  struct Lisp_Overlay *other, *other_prev;
-
-	  /* Splice the cons cell TAIL out of overlays_after.  */
-	  if (prev)
-	    prev->next = next;
-	  else
-	    set_buffer_overlays_after (buf, next);
-
-	  /* Search thru overlays_before for where to put it.  */
-	  other_prev = NULL;
-	  for (other = buf->overlays_before; other;
-	       other_prev = other, other = other->next)
-	    {
-	      Lisp_Object otherend, otheroverlay;
-
-	      XSETMISC (otheroverlay, other);
-	      eassert (OVERLAYP (otheroverlay));
-
-	      otherend = OVERLAY_END (otheroverlay);
-	      if (OVERLAY_POSITION (otherend) <= where)
-		break;
-	    }
-
-	  /* Add TAIL to overlays_before before OTHER.  */
-	  tail->next = other;
-	  if (other_prev)
-	    other_prev->next = tail;
-	  else
-	    set_buffer_overlays_before (buf, tail);
-	  tail = prev;
-	}
+      struct buffer *b;
+      FOR_EACH_BUFFER (b)
+	if (b->base_buffer == base)
+	  itree_insert_gap (b->overlays, pos, length, before_markers);
     }
-
-  buf->overlay_center = pos;
 }
 
-void
-adjust_overlays_for_insert (ptrdiff_t pos, ptrdiff_t length)
-{
-  /* After an insertion, the lists are still sorted properly,
-     but we may need to update the value of the overlay center.  */
-  if (current_buffer->overlay_center >= pos)
-    current_buffer->overlay_center += length;
-}
+/* Likewise for the deletion of the LENGTH characters after POS.  */
 
 void
 adjust_overlays_for_delete (ptrdiff_t pos, ptrdiff_t length)
 {
-  if (current_buffer->overlay_center < pos)
-    /* The deletion was to our right.  No change needed; the before- and
-       after-lists are still consistent.  */
-    ;
-  else if (current_buffer->overlay_center - pos > length)
-    /* The deletion was to our left.  We need to adjust the center value
-       to account for the change in position, but the lists are consistent
-       given the new value.  */
-    current_buffer->overlay_center -= length;
-  else
-    /* We're right in the middle.  There might be things on the after-list
-       that now belong on the before-list.  Recentering will move them,
-       and also update the center point.  */
-    recenter_overlay_lists (current_buffer, pos);
-}
-
-/* Fix up overlays that were garbled as a result of permuting markers
-   in the range START through END.  Any overlay with at least one
-   endpoint in this range will need to be unlinked from the overlay
-   list and reinserted in its proper place.
-   Such an overlay might even have negative size at this point.
-   If so, we'll make the overlay empty. */
-void
-fix_start_end_in_overlays (register ptrdiff_t start, register ptrdiff_t end)
-{
-  Lisp_Object overlay;
-  struct Lisp_Overlay *before_list IF_LINT (= NULL);
-  struct Lisp_Overlay *after_list IF_LINT (= NULL);
-  /* These are either nil, indicating that before_list or after_list
-     should be assigned, or the cons cell the cdr of which should be
-     assigned.  */
-  struct Lisp_Overlay *beforep = NULL, *afterp = NULL;
-  /* 'Parent', likewise, indicates a cons cell or
-     current_buffer->overlays_before or overlays_after, depending
-     which loop we're in.  */
-  struct Lisp_Overlay *tail, *parent;
-  ptrdiff_t startpos, endpos;
+  struct buffer *base = (current_buffer->base_buffer
+			 ? current_buffer->base_buffer : current_buffer);
 
-  /* This algorithm shifts links around instead of consing and GCing.
-     The loop invariant is that before_list (resp. after_list) is a
-     well-formed list except that its last element, the CDR of beforep
-     (resp. afterp) if beforep (afterp) isn't nil or before_list
-     (after_list) if it is, is still uninitialized.  So it's not a bug
-     that before_list isn't initialized, although it may look
-     strange.  */
-  for (parent = NULL, tail = current_buffer->overlays_before; tail;)
+  itree_delete_gap (base->overlays, pos, length);
+  if (base->indirections > 0)
     {
-      XSETMISC (overlay, tail);
-
-      endpos = OVERLAY_POSITION (OVERLAY_END (overlay));
-      startpos = OVERLAY_POSITION (OVERLAY_START (overlay));
-
-      /* If the overlay is backwards, make it empty.  */
-      if (endpos < startpos)
-	{
-	  startpos = endpos;
-	  Fset_marker (OVERLAY_START (overlay), make_number (startpos),
-		       Qnil);
-	}
-
-      if (endpos < start)
-	break;
-
-      if (endpos < end
-	  || (startpos >= start && startpos < end))
-	{
-	  /* Add it to the end of the wrong list.  Later on,
-	     recenter_overlay_lists will move it to the right place.  */
-	  if (endpos < current_buffer->overlay_center)
-	    {
-	      if (!afterp)
-		after_list = tail;
-	      else
-		afterp->next = tail;
-	      afterp = tail;
-	    }
-	  else
-	    {
-	      if (!beforep)
-		before_list = tail;
-	      else
-		beforep->next = tail;
-	      beforep = tail;
-	    }
-	  if (!parent)
-	    set_buffer_overlays_before (current_buffer, tail->next);
-	  else
-	    parent->next = tail->next;
-	  tail = tail->next;
-	}
-      else
-	parent = tail, tail = parent->next;
+      struct buffer *b;
+      FOR_EACH_BUFFER (b)
+	if (b->base_buffer == base)
+	  itree_delete_gap (b->overlays, pos, length);
     }
-  for (parent = NULL, tail = current_buffer->overlays_after; tail;)
-    {
-      XSETMISC (overlay, tail);
+}
 
-      startpos = OVERLAY_POSITION (OVERLAY_START (overlay));
-      endpos = OVERLAY_POSITION (OVERLAY_END (overlay));
+/* Return where the text at POS ends up when the regions START1 - END1
+   and START2 - END2 are swapped, like transpose_markers does.  */
 
-      /* If the overlay is backwards, make it empty.  */
-      if (endpos < startpos)
-	{
-	  startpos = endpos;
-	  Fset_marker (OVERLAY_START (overlay), make_number (startpos),
-		       Qnil);
-	}
+static ptrdiff_t
+transpose_position (ptrdiff_t pos, ptrdiff_t start1, ptrdiff_t end1,
+		    ptrdiff_t start2, ptrdiff_t end2)
+{
+  if (pos < start1 || pos >= end2)
+    return pos;
+  else if (pos < end1)
+    return pos + (end2 - end1);
+  else if (pos < start2)
+    return pos + (end2 - start2) - (end1 - start1);
+  else
+    return pos - (start2 - start1);
+}
 
-      if (startpos >= end)
-	break;
+/* Subroutine of transpose_overlays: move the overlays of B.  */
 
-      if (startpos >= start
-	  || (endpos >= start && endpos < end))
-	{
-	  if (endpos < current_buffer->overlay_center)
-	    {
-	      if (!afterp)
-		after_list = tail;
-	      else
-		afterp->next = tail;
-	      afterp = tail;
-	    }
-	  else
-	    {
-	      if (!beforep)
-		before_list = tail;
-	      else
-		beforep->next = tail;
-	      beforep = tail;
-	    }
-	  if (!parent)
-	    set_buffer_overlays_after (current_buffer, tail->next);
-	  else
-	    parent->next = tail->next;
-	  tail = tail->next;
-	}
-      else
-	parent = tail, tail = parent->next;
-    }
+static void
+transpose_buffer_overlays (struct buffer *b, ptrdiff_t start1,
+			   ptrdiff_t end1, ptrdiff_t start2, ptrdiff_t end2)
+{
+  struct itree_iterator iter;
+  struct itree_node *node, **nodes;
+  ptrdiff_t n = 0, i;
+  USE_SAFE_ALLOCA;
 
-  /* Splice the constructed (wrong) lists into the buffer's lists,
-     and let the recenter function make it sane again.  */
-  if (beforep)
-    {
-      beforep->next = current_buffer->overlays_before;
-      set_buffer_overlays_before (current_buffer, before_list);
-    }
+  /* Find the overlays with at least one end in the text that moves.
+     They have to come out of the tree, since their order may change;
+     some of them may even come out backwards.  */
+  itree_iterator_start (&iter, b->overlays, start1, end2, true);
+  while ((node = itree_iterator_next (&iter)))
+    if ((start1 <= node->begin && node->begin < end2) || node->end < end2)
+      n++;
+  if (n == 0)
+    return;
 
-  if (afterp)
+  SAFE_NALLOCA (nodes, 1, n);
+  n = 0;
+  itree_iterator_start (&iter, b->overlays, start1, end2, true);
+  while ((node = itree_iterator_next (&iter)))
+    if ((start1 <= node->begin && node->begin < end2) || node->end < end2)
+      nodes[n++] = node;
+
+  for (i = 0; i < n; i++)
     {
-      afterp->next = current_buffer->overlays_after;
-      set_buffer_overlays_after (current_buffer, after_list);
+      ptrdiff_t begin = transpose_position (nodes[i]->begin,
+					    start1, end1, start2, end2);
+      ptrdiff_t end = transpose_position (nodes[i]->end,
+					  start1, end1, start2, end2);
+      itree_remove (b->overlays, nodes[i]);
+      /* If the overlay is backwards, make it empty.  */
+      nodes[i]->begin = min (begin, end);
+      nodes[i]->end = end;
     }
-  recenter_overlay_lists (current_buffer, current_buffer->overlay_center);
+  for (i = 0; i < n; i++)
+    itree_insert (b->overlays, nodes[i], nodes[i]->begin, nodes[i]->end);
+  SAFE_FREE ();
 }
 
-/* We have two types of overlay: the one whose ending marker is
-   after-insertion-marker (this is the usual case) and the one whose
-   ending marker is before-insertion-marker.  When `overlays_before'
-   contains overlays of the latter type and the former type in this
-   order and both overlays end at inserting position, inserting a text
-   increases only the ending marker of the latter type, which results
-   in incorrect ordering of `overlays_before'.
-
-   This function fixes ordering of overlays in the slot
-   `overlays_before' of the buffer *BP.  Before the insertion, `point'
-   was at PREV, and now is at POS.  */
+/* Move the overlays of the current buffer, and of all other buffers
+   sharing its text, after the regions START1 - END1 and START2 - END2
+   have been swapped.  Overlay ends move along with the text they are
+   at, the same way transpose_markers moves markers.  */
 
 void
-fix_overlays_before (struct buffer *bp, ptrdiff_t prev, ptrdiff_t pos)
-{
-  /* If parent is nil, replace overlays_before; otherwise, parent->next.  */
-  struct Lisp_Overlay *tail = bp->overlays_before, *parent = NULL, *right_pair;
-  Lisp_Object tem;
-  ptrdiff_t end IF_LINT (= 0);
-
-  /* After the insertion, the several overlays may be in incorrect
-     order.  The possibility is that, in the list `overlays_before',
-     an overlay which ends at POS appears after an overlay which ends
-     at PREV.  Since POS is greater than PREV, we must fix the
-     ordering of these overlays, by moving overlays ends at POS before
-     the overlays ends at PREV.  */
-
-  /* At first, find a place where disordered overlays should be linked
-     in.  It is where an overlay which end before POS exists. (i.e. an
-     overlay whose ending marker is after-insertion-marker if disorder
-     exists).  */
-  while (tail
-	 && (XSETMISC (tem, tail),
-	     (end = OVERLAY_POSITION (OVERLAY_END (tem))) >= pos))
-    {
-      parent = tail;
-      tail = tail->next;
-    }
-
-  /* If we don't find such an overlay,
-     or the found one ends before PREV,
-     or the found one is the last one in the list,
-     we don't have to fix anything.  */
-  if (!tail || end < prev || !tail->next)
-    return;
-
-  right_pair = parent;
-  parent = tail;
-  tail = tail->next;
+transpose_overlays (ptrdiff_t start1, ptrdiff_t end1,
+		    ptrdiff_t start2, ptrdiff_t end2)
+{
+  struct buffer *base = (current_buffer->base_buffer
+			 ? current_buffer->base_buffer : current_buffer);
 
-  /* Now, end position of overlays in the list TAIL should be before
-     or equal to PREV.  In the loop, an overlay which ends at POS is
-     moved ahead to the place indicated by the CDR of RIGHT_PAIR.  If
-     we found an overlay which ends before PREV, the remaining
-     overlays are in correct order.  */
-  while (tail)
+  transpose_buffer_overlays (base, start1, end1, start2, end2);
+  if (base->indirections > 0)
     {
-      XSETMISC (tem, tail);
-      end = OVERLAY_POSITION (OVERLAY_END (tem));
-
-      if (end == pos)
-	{			/* This overlay is disordered. */
-	  struct Lisp_Overlay *found = tail;
-
-	  /* Unlink the found overlay.  */
-	  tail = found->next;
-	  parent->next = tail;
-	  /* Move an overlay at RIGHT_PLACE to the next of the found one,
-	     and link it into the right place.  */
-	  if (!right_pair)
-	    {
-	      found->next = bp->overlays_before;
-	      set_buffer_overlays_before (bp, found);
-	    }
-	  else
-	    {
-	      found->next = right_pair->next;
-	      right_pair->next = found;
-	    }
-	}
-      else if (end == prev)
-	{
-	  parent = tail;
-	  tail = tail->next;
-	}
-      else			/* No more disordered overlay. */
-	break;
+      struct buffer *b;
+      FOR_EACH_BUFFER (b)
+	if (b->base_buffer == base)
+	  transpose_buffer_overlays (b, start1, end1, start2, end2);
     }
 }
-
+
 DEFUN ("overlayp", Foverlayp, Soverlayp, 1, 1, 0,
        doc: /* Return t if OBJECT is an overlay.  */)
   (Lisp_Object object)
@@ -3864,33 +3504,14 @@ for the rear of the overlay advance when text is inserted there
     }
 
   b = XBUFFER (buffer);
+  if (! BUFFER_LIVE_P (b))
+    error ("Attempt to create an overlay in a dead buffer");
 
-  beg = Fset_marker (Fmake_marker (), beg, buffer);
-  end = Fset_marker (Fmake_marker (), end, buffer);
-
-  if (!NILP (front_advance))
-    XMARKER (beg)->insertion_type = 1;
-  if (!NILP (rear_advance))
-    XMARKER (end)->insertion_type = 1;
-
-  overlay = build_overlay (beg, end, Qnil);
-
-  /* Put the new overlay on the wrong list.  */
-  end = OVERLAY_END (overlay);
-  if (OVERLAY_POSITION (end) < b->overlay_center)
-    {
-      eassert (b->overlays_after || (XOVERLAY (overlay)->next == NULL));
-      XOVERLAY (overlay)->next = b->overlays_after;
-      set_buffer_overlays_after (b, XOVERLAY (overlay));
-    }
-  else
-    {
-      eassert (b->overlays_before || (XOVERLAY (overlay)->next == NULL));
-      XOVERLAY (overlay)->next = b->overlays_before;
-      set_buffer_overlays_before (b, XOVERLAY (overlay));
-    }
-  /* This puts it in the right list, and in the right order.  */
-  recenter_overlay_lists (b, b->overlay_center);
+  overlay = build_overlay (!NILP (front_advance), !NILP (rear_advance),
+			   Qnil);
+  add_buffer_overlay (b, XOVERLAY (overlay),
+		      clip_to_bounds (BUF_BEG (b), XINT (beg), BUF_Z (b)),
+		      clip_to_bounds (BUF_BEG (b), XINT (end), BUF_Z (b)));
 
   /* We don't need to redisplay the region covered by the overlay, because
      the overlay has no properties at the moment.  */
@@ -3917,35 +3538,6 @@ modify_overlay (struct buffer *buf, ptrdiff_t start, ptrdiff_t end)
   ++BUF_OVERLAY_MODIFF (buf);
 }
 
-/* Remove OVERLAY from LIST.  */
-
-static struct Lisp_Overlay *
-unchain_overlay (struct Lisp_Overlay *list, struct Lisp_Overlay *overlay)
-{
-  register struct Lisp_Overlay *tail, **prev = &list;
-
-  for (tail = list; tail; prev = &tail->next, tail = *prev)
-    if (tail == overlay)
-      {
-	*prev = overlay->next;
-	overlay->next = NULL;
-	break;
-      }
-  return list;
-}
-
-/* Remove OVERLAY from both overlay lists of B.  */
-
-static void
-unchain_both (struct buffer *b, Lisp_Object overlay)
-{
-  struct Lisp_Overlay *ov = XOVERLAY (overlay);
-
-  set_buffer_overlays_before (b, unchain_overlay (b->overlays_before, ov));
-  set_buffer_overlays_after (b, unchain_overlay (b->overlays_after, ov));
-  eassert (XOVERLAY (overlay)->next == NULL);
-}
-
 DEFUN ("move-overlay", Fmove_overlay, Smove_overlay, 3, 4, 0,
        doc: /* Set the endpoints of OVERLAY to BEG and END in BUFFER.
 If BUFFER is omitted, leave OVERLAY in the same buffer it inhabits now.
@@ -3960,7 +3552,7 @@ buffer.  */)
 
   CHECK_OVERLAY (overlay);
   if (NILP (buffer))
-    buffer = Fmarker_buffer (OVERLAY_START (overlay));
+    buffer = Foverlay_buffer (overlay);
   if (NILP (buffer))
     XSETBUFFER (buffer, current_buffer);
   CHECK_BUFFER (buffer);
@@ -3984,25 +3576,22 @@ buffer.  */)
 
   specbind (Qinhibit_quit, Qt);
 
-  obuffer = Fmarker_buffer (OVERLAY_START (overlay));
+  obuffer = Foverlay_buffer (overlay);
   b = XBUFFER (buffer);
 
   if (!NILP (obuffer))
     {
       ob = XBUFFER (obuffer);
 
-      o_beg = OVERLAY_POSITION (OVERLAY_START (overlay));
-      o_end = OVERLAY_POSITION (OVERLAY_END (overlay));
+      o_beg = OVERLAY_START (overlay);
+      o_end = OVERLAY_END (overlay);
 
-      unchain_both (ob, overlay);
+      remove_buffer_overlay (XOVERLAY (overlay));
     }
 
-  /* Set the overlay boundaries, which may clip them.  */
-  Fset_marker (OVERLAY_START (overlay), beg, buffer);
-  Fset_marker (OVERLAY_END (overlay), end, buffer);
-
-  n_beg = marker_position (OVERLAY_START (overlay));
-  n_end = marker_position (OVERLAY_END (overlay));
+  /* Set the overlay boundaries, clipping them to the buffer.  */
+  n_beg = clip_to_bounds (BUF_BEG (b), XINT (beg), BUF_Z (b));
+  n_end = clip_to_bounds (BUF_BEG (b), XINT (end), BUF_Z (b));
 
   /* If the overlay has changed buffers, do a thorough redisplay.  */
   if (!EQ (buffer, obuffer))
@@ -4028,23 +3617,9 @@ buffer.  */)
   /* Delete the overlay if it is empty after clipping and has the
      evaporate property.  */
   if (n_beg == n_end && !NILP (Foverlay_get (overlay, Qevaporate)))
-    return unbind_to (count, Fdelete_overlay (overlay));
-
-  /* Put the overlay into the new buffer's overlay lists, first on the
-     wrong list.  */
-  if (n_end < b->overlay_center)
-    {
-      XOVERLAY (overlay)->next = b->overlays_after;
-      set_buffer_overlays_after (b, XOVERLAY (overlay));
-    }
-  else
-    {
-      XOVERLAY (overlay)->next = b->overlays_before;
-      set_buffer_overlays_before (b, XOVERLAY (overlay));
-    }
+    return unbind_to (count, Qnil);
 
-  /* This puts it in the right list, and in the right order.  */
-  recenter_overlay_lists (b, b->overlay_center);
+  add_buffer_overlay (b, XOVERLAY (overlay), n_beg, n_end);
 
   return unbind_to (count, overlay);
 }
@@ -4059,15 +3634,15 @@ DEFUN ("delete-overlay", Fdelete_overlay, Sdelete_overlay, 1, 1, 0,
 
   CHECK_OVERLAY (overlay);
 
-  buffer = Fmarker_buffer (OVERLAY_START (overlay));
+  buffer = Foverlay_buffer (overlay);
   if (NILP (buffer))
     return Qnil;
 
   b = XBUFFER (buffer);
   specbind (Qinhibit_quit, Qt);
 
-  unchain_both (b, overlay);
-  drop_overlay (b, XOVERLAY (overlay));
+  modify_overlay (b, OVERLAY_START (overlay), OVERLAY_END (overlay));
+  remove_buffer_overlay (XOVERLAY (overlay));
 
   /* When deleting an overlay with before or after strings, turn off
      display optimizations for the affected buffer, on the basis that
@@ -4098,8 +3673,10 @@ DEFUN ("overlay-start", Foverlay_start, Soverlay_start, 1, 1, 0,
   (Lisp_Object overlay)
 {
   CHECK_OVERLAY (overlay);
+  if (! OVERLAY_BUFFER (overlay))
+    return Qnil;
 
-  return (Fmarker_position (OVERLAY_START (overlay)));
+  return make_number (OVERLAY_START (overlay));
 }
 
 DEFUN ("overlay-end", Foverlay_end, Soverlay_end, 1, 1, 0,
@@ -4107,8 +3684,10 @@ DEFUN ("overlay-end", Foverlay_end, Soverlay_end, 1, 1, 0,
   (Lisp_Object overlay)
 {
   CHECK_OVERLAY (overlay);
+  if (! OVERLAY_BUFFER (overlay))
+    return Qnil;
 
-  return (Fmarker_position (OVERLAY_END (overlay)));
+  return make_number (OVERLAY_END (overlay));
 }
 
 DEFUN ("overlay-buffer", Foverlay_buffer, Soverlay_buffer, 1, 1, 0,
@@ -4116,9 +3695,14 @@ DEFUN ("overlay-buffer", Foverlay_buffer, Soverlay_buffer, 1, 1, 0,
 Return nil if OVERLAY has been deleted.  */)
   (Lisp_Object overlay)
 {
+  Lisp_Object buffer;
+
   CHECK_OVERLAY (overlay);
+  if (! OVERLAY_BUFFER (overlay))
+    return Qnil;
 
-  return Fmarker_buffer (OVERLAY_START (overlay));
+  XSETBUFFER (buffer, OVERLAY_BUFFER (overlay));
+  return buffer;
 }
 
 DEFUN ("overlay-properties", Foverlay_properties, Soverlay_properties, 1, 1, 0,
@@ -4191,8 +3775,7 @@ end of the buffer.  */)
 
   /* Put all the overlays we want in a vector in overlay_vec.
      Store the length in len.  */
-  noverlays = overlays_in (XINT (beg), XINT (end), 1, &overlay_vec, &len,
-			   NULL, NULL);
+  noverlays = overlays_in (XINT (beg), XINT (end), 1, &overlay_vec, &len);
 
   /* Make a list of them all.  */
   result = Flist (noverlays, overlay_vec);
@@ -4230,11 +3813,7 @@ the value is (point-max).  */)
      use its ending point instead.  */
   for (i = 0; i < noverlays; i++)
     {
-      Lisp_Object oend;
-      ptrdiff_t oendpos;
-
-      oend = OVERLAY_END (overlay_vec[i]);
-      oendpos = OVERLAY_POSITION (oend);
+      ptrdiff_t oendpos = OVERLAY_END (overlay_vec[i]);
       if (oendpos < endpos)
 	endpos = oendpos;
     }
@@ -4281,44 +3860,33 @@ the value is (point-min).  */)
 
 DEFUN ("overlay-lists", Foverlay_lists, Soverlay_lists, 0, 0, 0,
        doc: /* Return a pair of lists giving all the overlays of the current buffer.
-The car has all the overlays before the overlay center;
-the cdr has all the overlays after the overlay center.
-Recentering overlays moves overlays between these lists.
+The car has all the overlays of the buffer, in order of their start
+position; the cdr is always nil.  This function used to split the
+overlays at the overlay center, which no longer exists.
 The lists you get are copies, so that changing them has no effect.
 However, the overlays you get are the real objects that the buffer uses.  */)
   (void)
 {
-  struct Lisp_Overlay *ol;
-  Lisp_Object before = Qnil, after = Qnil, tmp;
+  struct itree_node *node;
+  Lisp_Object overlays = Qnil;
 
-  for (ol = current_buffer->overlays_before; ol; ol = ol->next)
-    {
-      XSETMISC (tmp, ol);
-      before = Fcons (tmp, before);
-    }
-  for (ol = current_buffer->overlays_after; ol; ol = ol->next)
-    {
-      XSETMISC (tmp, ol);
-      after = Fcons (tmp, after);
-    }
+  for (node = itree_first (current_buffer->overlays); node;
+       node = itree_next (node))
+    overlays = Fcons (node->data, overlays);
 
-  return Fcons (Fnreverse (before), Fnreverse (after));
+  return Fcons (Fnreverse (overlays), Qnil);
 }
 
 DEFUN ("overlay-recenter", Foverlay_recenter, Soverlay_recenter, 1, 1, 0,
        doc: /* Recenter the overlays of the current buffer around position POS.
-That makes overlay lookup faster for positions near POS (but perhaps slower
-for positions far away from POS).  */)
+This function does nothing: overlay lookup is equally fast everywhere.
+It is kept for compatibility.  */)
   (Lisp_Object pos)
 {
-  ptrdiff_t p;
   CHECK_NUMBER_COERCE_MARKER (pos);
-
-  p = clip_to_bounds (PTRDIFF_MIN, XINT (pos), PTRDIFF_MAX);
-  recenter_overlay_lists (current_buffer, p);
   return Qnil;
 }
-
+
 DEFUN ("overlay-get", Foverlay_get, Soverlay_get, 2, 2, 0,
        doc: /* Get the property of overlay OVERLAY with property name PROP.  */)
   (Lisp_Object overlay, Lisp_Object prop)
@@ -4337,7 +3905,7 @@ VALUE will be returned.*/)
 
   CHECK_OVERLAY (overlay);
 
-  buffer = Fmarker_buffer (OVERLAY_START (overlay));
+  buffer = Foverlay_buffer (overlay);
 
   for (tail = XOVERLAY (overlay)->plist;
        CONSP (tail) && CONSP (XCDR (tail));
@@ -4357,11 +3925,9 @@ VALUE will be returned.*/)
     {
       if (changed)
 	modify_overlay (XBUFFER (buffer),
-			marker_position (OVERLAY_START (overlay)),
-			marker_position (OVERLAY_END   (overlay)));
+			OVERLAY_START (overlay), OVERLAY_END (overlay));
       if (EQ (prop, Qevaporate) && ! NILP (value)
-	  && (OVERLAY_POSITION (OVERLAY_START (overlay))
-	      == OVERLAY_POSITION (OVERLAY_END (overlay))))
+	  && OVERLAY_START (overlay) == OVERLAY_END (overlay))
 	Fdelete_overlay (overlay);
     }
 
@@ -4420,13 +3986,13 @@ report_overlay_modification (Lisp_Object start, Lisp_Object end, bool after,
 			     Lisp_Object arg1, Lisp_Object arg2, Lisp_Object arg3)
 {
   Lisp_Object prop, overlay;
-  struct Lisp_Overlay *tail;
+  struct itree_iterator iter;
+  struct itree_node *node;
   /* True if this change is an insertion.  */
   bool insertion = (after ? XFASTINT (arg3) == 0 : EQ (start, end));
   struct gcpro gcpro1, gcpro2, gcpro3, gcpro4;
 
   overlay = Qnil;
-  tail = NULL;
 
   /* We used to run the functions as soon as we found them and only register
      them in last_overlay_modification_hooks for the purpose of the `after'
@@ -4441,56 +4007,13 @@ report_overlay_modification (Lisp_Object start, Lisp_Object end, bool after,
       /* We are being called before a change.
 	 Scan the overlays to find the functions to call.  */
       last_overlay_modification_hooks_used = 0;
-      for (tail = current_buffer->overlays_before; tail; tail = tail->next)
+      itree_iterator_start (&iter, current_buffer->overlays,
+			    XFASTINT (start), XFASTINT (end), true);
+      while ((node = itree_iterator_next (&iter)))
 	{
-	  ptrdiff_t startpos, endpos;
-	  Lisp_Object ostart, oend;
-
-	  XSETMISC (overlay, tail);
+	  ptrdiff_t startpos = node->begin, endpos = node->end;
 
-	  ostart = OVERLAY_START (overlay);
-	  oend = OVERLAY_END (overlay);
-	  endpos = OVERLAY_POSITION (oend);
-	  if (XFASTINT (start) > endpos)
-	    break;
-	  startpos = OVERLAY_POSITION (ostart);
-	  if (insertion && (XFASTINT (start) == startpos
-			    || XFASTINT (end) == startpos))
-	    {
-	      prop = Foverlay_get (overlay, Qinsert_in_front_hooks);
-	      if (!NILP (prop))
-		add_overlay_mod_hooklist (prop, overlay);
-	    }
-	  if (insertion && (XFASTINT (start) == endpos
-			    || XFASTINT (end) == endpos))
-	    {
-	      prop = Foverlay_get (overlay, Qinsert_behind_hooks);
-	      if (!NILP (prop))
-		add_overlay_mod_hooklist (prop, overlay);
-	    }
-	  /* Test for intersecting intervals.  This does the right thing
-	     for both insertion and deletion.  */
-	  if (XFASTINT (end) > startpos && XFASTINT (start) < endpos)
-	    {
-	      prop = Foverlay_get (overlay, Qmodification_hooks);
-	      if (!NILP (prop))
-		add_overlay_mod_hooklist (prop, overlay);
-	    }
-	}
-
-      for (tail = current_buffer->overlays_after; tail; tail = tail->next)
-	{
-	  ptrdiff_t startpos, endpos;
-	  Lisp_Object ostart, oend;
-
-	  XSETMISC (overlay, tail);
-
-	  ostart = OVERLAY_START (overlay);
-	  oend = OVERLAY_END (overlay);
-	  startpos = OVERLAY_POSITION (ostart);
-	  endpos = OVERLAY_POSITION (oend);
-	  if (XFASTINT (end) < startpos)
-	    break;
+	  overlay = node->data;
 	  if (insertion && (XFASTINT (start) == startpos
 			    || XFASTINT (end) == startpos))
 	    {
@@ -4567,34 +4090,16 @@ call_overlay_mod_hooks (Lisp_Object list, Lisp_Object overlay, bool after,
 void
 evaporate_overlays (ptrdiff_t pos)
 {
-  Lisp_Object overlay, hit_list;
-  struct Lisp_Overlay *tail;
+  Lisp_Object hit_list;
+  struct itree_iterator iter;
+  struct itree_node *node;
 
   hit_list = Qnil;
-  if (pos <= current_buffer->overlay_center)
-    for (tail = current_buffer->overlays_before; tail; tail = tail->next)
-      {
-	ptrdiff_t endpos;
-	XSETMISC (overlay, tail);
-	endpos = OVERLAY_POSITION (OVERLAY_END (overlay));
-	if (endpos < pos)
-	  break;
-	if (endpos == pos && OVERLAY_POSITION (OVERLAY_START (overlay)) == pos
-	    && ! NILP (Foverlay_get (overlay, Qevaporate)))
-	  hit_list = Fcons (overlay, hit_list);
-      }
-  else
-    for (tail = current_buffer->overlays_after; tail; tail = tail->next)
-      {
-	ptrdiff_t startpos;
-	XSETMISC (overlay, tail);
-	startpos = OVERLAY_POSITION (OVERLAY_START (overlay));
-	if (startpos > pos)
-	  break;
-	if (startpos == pos && OVERLAY_POSITION (OVERLAY_END (overlay)) == pos
-	    && ! NILP (Foverlay_get (overlay, Qevaporate)))
-	  hit_list = Fcons (overlay, hit_list);
-      }
+  itree_iterator_start (&iter, current_buffer->overlays, pos, pos, true);
+  while ((node = itree_iterator_next (&iter)))
+    if (node->begin == pos && node->end == pos
+	&& ! NILP (Foverlay_get (node->data, Qevaporate)))
+      hit_list = Fcons (node->data, hit_list);
   for (; CONSP (hit_list); hit_list = XCDR (hit_list))
     Fdelete_overlay (XCAR (hit_list));
 }
@@ -5035,6 +4540,12 @@ free_buffer_text (struct buffer *b)
 #endif
 
   BUF_BEG_ADDR (b) = NULL;
+
+  xfree (b->text->checkpoints);
+  b->text->checkpoints = NULL;
+  b->text->ncheckpoints = 0;
+  b->text->checkpoints_size = 0;
+  free_line_index (b->text);
   unblock_input ();
 }
 
@@ -5094,9 +4605,7 @@ init_buffer_once (void)
   bset_mark_active (&buffer_defaults, Qnil);
   bset_file_format (&buffer_defaults, Qnil);
   bset_auto_save_file_format (&buffer_defaults, Qt);
-  set_buffer_overlays_before (&buffer_defaults, NULL);
-  set_buffer_overlays_after (&buffer_defaults, NULL);
-  buffer_defaults.overlay_center = BEG;
+  buffer_defaults.overlays = NULL;
 
   XSETFASTINT (BVAR (&buffer_defaults, tab_width), 8);
   bset_truncate_lines (&buffer_defaults, Qnil);
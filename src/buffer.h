@@ -21,6 +21,8 @@ along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.  */
 #include <sys/types.h>
 #include <time.h>
 
+#include "itree.h"
+
 INLINE_HEADER_BEGIN
 
 /* Accessing the parameters of the current buffer.  */
@@ -416,6 +418,15 @@ extern void enlarge_buffer_text (struct buffer *, ptrdiff_t);
 /* This data structure describes the actual text contents of a buffer.
    It is shared between indirect buffers and their base buffer.  */
 
+/* A character position in a multibyte buffer together with the byte
+   position it corresponds to.  */
+
+struct charpos_checkpoint
+{
+  ptrdiff_t charpos;
+  ptrdiff_t bytepos;
+};
+
 struct buffer_text
   {
     /* Actual address of buffer contents.  If REL_ALLOC is defined,
@@ -472,6 +483,19 @@ struct buffer_text
        to move a marker within a buffer.  */
     struct Lisp_Marker *markers;
 
+    /* Known correspondences between character and byte positions,
+       sorted by position and spaced roughly CHARPOS_INDEX_INTERVAL
+       bytes apart, used to convert between the two quickly in large
+       multibyte buffers.  NCHECKPOINTS entries are in use out of
+       CHECKPOINTS_SIZE allocated.  See marker.c.  */
+    struct charpos_checkpoint *checkpoints;
+    ptrdiff_t ncheckpoints;
+    ptrdiff_t checkpoints_size;
+
+    /* Index of the newlines of the text, or NULL if it has not been
+       needed yet.  See line-index.c.  */
+    struct line_index *line_index;
+
     /* Usually false.  Temporarily true in decode_coding_gap to
        prevent Fgarbage_collect from shrinking the gap and losing
        not-yet-decoded bytes.  */
@@ -485,6 +509,21 @@ struct buffer_text
 
 #define BVAR(buf, field) ((buf)->INTERNAL_FIELD (field))
 
+/* Number of entries in the cache of local variable bindings of a
+   buffer.  Must be a power of 2.  */
+
+enum { LOCAL_VAR_CACHE_SIZE = 16 };
+
+/* An entry in that cache.  BINDING is the element of the buffer's
+   local_var_alist for SYMBOL, or nil if the buffer has no local
+   binding for SYMBOL.  */
+
+struct local_var_cache_entry
+{
+  Lisp_Object symbol;
+  Lisp_Object binding;
+};
+
 /* This is the structure that the buffer Lisp object points to.  */
 
 struct buffer
@@ -856,16 +895,15 @@ struct buffer
   /* Non-zero whenever the narrowing is changed in this buffer.  */
   bool_bf clip_changed : 1;
 
-  /* List of overlays that end at or before the current center,
-     in order of end-position.  */
-  struct Lisp_Overlay *overlays_before;
+  /* The overlays of this buffer, or NULL if it never had any.  */
+  struct itree_tree *overlays;
 
-  /* List of overlays that end after  the current center,
-     in order of start-position.  */
-  struct Lisp_Overlay *overlays_after;
-
-  /* Position where the overlay lists are centered.  */
-  ptrdiff_t overlay_center;
+  /* Direct-mapped cache of lookups in local_var_alist, indexed by a
+     hash of the symbol.  It saves walking the alist each time a
+     buffer-local variable is swapped in for this buffer.  The cache
+     is cleared whenever local_var_alist is changed, so it need not be
+     marked by GC: the bindings in it are reachable from the alist.  */
+  struct local_var_cache_entry local_var_cache[LOCAL_VAR_CACHE_SIZE];
 
   /* Changes in the buffer are recorded here for undo, and t means
      don't record anything.  This information belongs to the base
@@ -939,9 +977,17 @@ bset_last_selected_window (struct buffer *b, Lisp_Object val)
   b->INTERNAL_FIELD (last_selected_window) = val;
 }
 INLINE void
+clear_local_var_cache (struct buffer *b)
+{
+  int i;
+  for (i = 0; i < LOCAL_VAR_CACHE_SIZE; i++)
+    b->local_var_cache[i].symbol = Qnil;
+}
+INLINE void
 bset_local_var_alist (struct buffer *b, Lisp_Object val)
 {
   b->INTERNAL_FIELD (local_var_alist) = val;
+  clear_local_var_cache (b);
 }
 INLINE void
 bset_mark_active (struct buffer *b, Lisp_Object val)
@@ -1069,6 +1115,8 @@ extern struct buffer buffer_local_flags;
 
 extern struct buffer buffer_local_symbols;
 
+extern void add_buffer_overlay (struct buffer *, struct Lisp_Overlay *,
+				ptrdiff_t, ptrdiff_t);
 extern void delete_all_overlays (struct buffer *);
 extern void reset_buffer (struct buffer *);
 extern void compact_buffer (struct buffer *);
@@ -1076,14 +1124,12 @@ extern void evaporate_overlays (ptrdiff_t);
 extern ptrdiff_t overlays_at (EMACS_INT, bool, Lisp_Object **,
 			      ptrdiff_t *, ptrdiff_t *, ptrdiff_t *, bool);
 extern ptrdiff_t sort_overlays (Lisp_Object *, ptrdiff_t, struct window *);
-extern void recenter_overlay_lists (struct buffer *, ptrdiff_t);
 extern ptrdiff_t overlay_strings (ptrdiff_t, struct window *, unsigned char **);
 extern void validate_region (Lisp_Object *, Lisp_Object *);
 extern void set_buffer_internal_1 (struct buffer *);
 extern void set_buffer_temp (struct buffer *);
 extern Lisp_Object buffer_local_value (Lisp_Object, Lisp_Object);
 extern void record_buffer (Lisp_Object);
-extern void fix_overlays_before (struct buffer *, ptrdiff_t, ptrdiff_t);
 extern void mmap_set_vars (bool);
 extern void restore_buffer (Lisp_Object);
 extern void set_buffer_if_live (Lisp_Object);
@@ -1177,7 +1223,26 @@ set_buffer_intervals (struct buffer *b, INTERVAL i)
 INLINE bool
 buffer_has_overlays (void)
 {
-  return current_buffer->overlays_before || current_buffer->overlays_after;
+  return !itree_empty_p (current_buffer->overlays);
+}
+
+/* Return the element of B's local_var_alist for SYMBOL, or nil if B
+   has no local binding for SYMBOL.  This is like assq_no_quit, but
+   looks in B's cache of local variable bindings first.  */
+
+INLINE Lisp_Object
+buffer_local_binding (struct buffer *b, Lisp_Object symbol)
+{
+  uintptr_t hash = (uintptr_t) XSYMBOL (symbol) / sizeof (struct Lisp_Symbol);
+  struct local_var_cache_entry *entry
+    = &b->local_var_cache[hash & (LOCAL_VAR_CACHE_SIZE - 1)];
+
+  if (!EQ (entry->symbol, symbol))
+    {
+      entry->binding = assq_no_quit (symbol, BVAR (b, local_var_alist));
+      entry->symbol = symbol;
+    }
+  return entry->binding;
 }
 
 /* Return character code of multi-byte form at byte position POS.  If POS
@@ -1228,25 +1293,54 @@ buffer_window_count (struct buffer *b)
 
 /* Overlays */
 
-/* Return the marker that stands for where OV starts in the buffer.  */
+/* Return the buffer OV belongs to, or NULL if it has been deleted.  */
+
+INLINE struct buffer *
+OVERLAY_BUFFER (Lisp_Object ov)
+{
+  return XOVERLAY (ov)->buffer;
+}
+
+/* Return the position where OV starts in its buffer, or -1 if it has
+   been deleted.  */
 
-#define OVERLAY_START(OV) XOVERLAY (OV)->start
+INLINE ptrdiff_t
+OVERLAY_START (Lisp_Object ov)
+{
+  struct buffer *b = OVERLAY_BUFFER (ov);
+  return b ? itree_node_begin (b->overlays, XOVERLAY (ov)->interval) : -1;
+}
 
-/* Return the marker that stands for where OV ends in the buffer.  */
+/* Return the position where OV ends in its buffer, or -1 if it has
+   been deleted.  */
 
-#define OVERLAY_END(OV) XOVERLAY (OV)->end
+INLINE ptrdiff_t
+OVERLAY_END (Lisp_Object ov)
+{
+  struct buffer *b = OVERLAY_BUFFER (ov);
+  return b ? itree_node_end (b->overlays, XOVERLAY (ov)->interval) : -1;
+}
 
 /* Return the plist of overlay OV.  */
 
 #define OVERLAY_PLIST(OV) XOVERLAY (OV)->plist
 
-/* Return the actual buffer position for the marker P.
-   We assume you know which buffer it's pointing into.  */
+/* Return true if OV's start (resp. end) advances past text inserted
+   exactly there, like a marker of insertion type t.  */
+
+INLINE bool
+OVERLAY_FRONT_ADVANCE_P (Lisp_Object ov)
+{
+  return XOVERLAY (ov)->interval->front_advance;
+}
+
+INLINE bool
+OVERLAY_REAR_ADVANCE_P (Lisp_Object ov)
+{
+  return XOVERLAY (ov)->interval->rear_advance;
+}
 
-#define OVERLAY_POSITION(P) \
- (MARKERP (P) ? marker_position (P) : (emacs_abort (), 0))
 
-
 /***********************************************************************
 			Buffer-local Variables
  ***********************************************************************/
@@ -35,6 +35,10 @@ by Hallvard:
 
 #include <config.h>
 
+#ifdef HAVE_NATIVE_BYTE_CODE
+#include <dlfcn.h>
+#endif
+
 #include "lisp.h"
 #include "blockinput.h"
 #include "character.h"
@@ -296,29 +300,46 @@ enum byte_code_op
 #endif
 };
 
+/* Opcodes that occur only in decoded byte code, see below.  Those
+   with two names stand for the byte codes whose names they combine,
+   executed one after the other.  */
+
+#define BYTE_INSNS							\
+DEFINE (Binvalid, 0400)							\
+DEFINE (Beq_gotoifnil, 0401)						\
+DEFINE (Bdup_gotoifnil, 0402)						\
+DEFINE (Bvarref_gotoifnil, 0403)					\
+DEFINE (Bvarref_car, 0404)						\
+DEFINE (Bstack_ref_car, 0405)						\
+DEFINE (Bcall_discard, 0406)
+
+enum byte_insn_op
+{
+#define DEFINE(name, value) name = value,
+    BYTE_INSNS
+#undef DEFINE
+
+    BYTE_INSN_LIMIT
+};
+
 /* Whether to maintain a `top' and `bottom' field in the stack frame.  */
 #define BYTE_MAINTAIN_TOP (BYTE_CODE_SAFE || BYTE_MARK_STACK)
-
+
 /* Structure describing a value stack used during byte-code execution
    in Fbyte_code.  */
 
 struct byte_stack
 {
-  /* Program counter.  This points into the byte_string below
-     and is relocated when that string is relocated.  */
-  const unsigned char *pc;
-
   /* Top and bottom of stack.  The bottom points to an area of memory
      allocated with alloca in Fbyte_code.  */
 #if BYTE_MAINTAIN_TOP
   Lisp_Object *top, *bottom;
 #endif
 
-  /* The string containing the byte-code, and its current address.
-     Storing this here protects it from GC because mark_byte_stack
-     marks it.  */
+  /* The string containing the byte-code.  Storing this here protects
+     it from GC because mark_byte_stack marks it, and with it the
+     decoded byte code that is being executed.  */
   Lisp_Object byte_string;
-  const unsigned char *byte_string_start;
 
 #if BYTE_MARK_STACK
   /* The vector of constants used during byte-code execution.  Storing
@@ -338,7 +359,7 @@ struct byte_stack
 
 struct byte_stack *byte_stack_list;
 
-
+
 /* Mark objects on byte_stack_list.  Called during GC.  */
 
 #if BYTE_MARK_STACK
@@ -368,38 +389,515 @@ mark_byte_stack (void)
 }
 #endif
 
-/* Unmark objects in the stacks on byte_stack_list.  Relocate program
-   counters.  Called when GC has completed.  */
+
+/* Decoded byte code.
+
+   Before a byte-code string is executed, it is decoded into an array
+   of instructions, each with an opcode and an operand.  Byte codes
+   that have several forms, such as Bvarref1 ... Bvarref7 or
+   Bconstant2, are decoded to the basic form with the operand in the
+   instruction.  The relative jumps BRgoto etc. are decoded to the
+   corresponding absolute jumps, and the operand of a jump is the index
+   of the instruction it jumps to.
+
+   When one instruction is commonly followed by another, such as Beq
+   by Bgotoifnil, the first is replaced by a superinstruction that does
+   the work of both, and skips the second.  The second one stays in
+   place, since it may be the target of a jump, and the
+   superinstruction gets its operand from there.
+
+   The threaded interpreter replaces each opcode with the address of
+   the code that executes it, the first time the byte code runs.
+
+   Decoded byte code is kept in byte_code_cache, which is indexed by
+   the address of the byte-code string.  An entry stays there until
+   the string is garbage collected.
+
+   If a .eln file has native code for the same bytes, the entry points
+   to it, and exec_byte_code runs that instead of the instructions.  */
+
+struct byte_insn
+{
+  union
+  {
+    int op;
+    const void *label;
+  } u;
+  ptrdiff_t arg;
+};
+
+struct decoded_byte_code
+{
+  /* The string this was decoded from, and its length in bytes.  */
+  struct Lisp_String *string;
+  ptrdiff_t nbytes;
+
+  /* A copy of the string's bytes, which follows INSNS.  `aset' and
+     `fillarray' can change the string in place, so the cache compares
+     this with the string before using the entry.  */
+  unsigned char *bytes;
+
+  /* Next entry in the same bucket of byte_code_cache.  */
+  struct decoded_byte_code *next;
+
+  /* True if the opcodes have been replaced by addresses.  */
+  bool linked;
+
+#ifdef HAVE_NATIVE_BYTE_CODE
+  /* The native code for these bytes, or null.  */
+  struct native_function *native;
+#endif
+
+  /* Number of instructions, including the final Binvalid.  */
+  ptrdiff_t ninsns;
+
+  struct byte_insn insns[FLEXIBLE_ARRAY_MEMBER];
+};
+
+/* Hash table of decoded byte code.  Its size is a power of 2.  */
+
+static struct decoded_byte_code **byte_code_cache;
+static ptrdiff_t byte_code_cache_size;
+
+/* Number of entries in byte_code_cache.  */
+
+static ptrdiff_t byte_code_cache_count;
+
+/* Return the bucket of byte_code_cache for the string S.  */
+
+static struct decoded_byte_code **
+byte_code_cache_bucket (struct Lisp_String *s)
+{
+  return &byte_code_cache[((uintptr_t) s / sizeof *s)
+			  & (byte_code_cache_size - 1)];
+}
+
+/* Double the size of byte_code_cache.  */
+
+static void
+grow_byte_code_cache (void)
+{
+  struct decoded_byte_code **old = byte_code_cache;
+  ptrdiff_t i, old_size = byte_code_cache_size;
+
+  byte_code_cache_size = old_size ? 2 * old_size : 512;
+  byte_code_cache = xnmalloc (byte_code_cache_size, sizeof *byte_code_cache);
+  memset (byte_code_cache, 0, byte_code_cache_size * sizeof *byte_code_cache);
+
+  for (i = 0; i < old_size; i++)
+    while (old[i])
+      {
+	struct decoded_byte_code *code = old[i];
+	struct decoded_byte_code **bucket = byte_code_cache_bucket (code->string);
+	old[i] = code->next;
+	code->next = *bucket;
+	*bucket = code;
+      }
+  xfree (old);
+}
+
+/* Free the decoded byte code of strings that are about to be freed.
+   Called by the GC after marking, before strings are swept.  */
 
 void
-unmark_byte_stack (void)
+sweep_byte_code_cache (void)
 {
-  struct byte_stack *stack;
+  ptrdiff_t i;
 
-  for (stack = byte_stack_list; stack; stack = stack->next)
+  for (i = 0; i < byte_code_cache_size; i++)
     {
-      if (stack->byte_string_start != SDATA (stack->byte_string))
+      struct decoded_byte_code **prev = &byte_code_cache[i], *code;
+
+      while ((code = *prev))
 	{
-	  ptrdiff_t offset = stack->pc - stack->byte_string_start;
-	  stack->byte_string_start = SDATA (stack->byte_string);
-	  stack->pc = stack->byte_string_start + offset;
+	  Lisp_Object string;
+	  XSETSTRING (string, code->string);
+	  if (survives_gc_p (string))
+	    prev = &code->next;
+	  else
+	    {
+	      *prev = code->next;
+	      xfree (code);
+	      byte_code_cache_count--;
+	    }
 	}
     }
 }
 
-
-/* Fetch the next byte from the bytecode stream.  */
+#ifdef HAVE_NATIVE_BYTE_CODE
+
+/* Native code loaded from .eln files, in a hash table indexed by the
+   contents of the byte code it was compiled from.  All native
+   functions for the same bytes are in one chain, since the same byte
+   code can be compiled for different stack depths at entry.  Native
+   code is never unloaded.  */
+
+struct native_function
+{
+  const struct native_byte_code *code;
 
+  /* The next function for the same bytes.  */
+  struct native_function *next_depth;
+
+  /* The next function for other bytes in the same bucket.  */
+  struct native_function *next;
+};
+
+static struct native_function **native_functions;
+static ptrdiff_t native_functions_size, native_functions_count;
+
+/* Return the bucket of native_functions for the NBYTES at BYTES.  */
+
+static struct native_function **
+native_function_bucket (const char *bytes, ptrdiff_t nbytes)
+{
+  return &native_functions[hash_string (bytes, nbytes)
+			   & (native_functions_size - 1)];
+}
+
+/* Return the chain of native functions for the NBYTES at BYTES.  */
+
+static struct native_function *
+find_native_function (const char *bytes, ptrdiff_t nbytes)
+{
+  struct native_function *f;
+
+  if (native_functions_size)
+    for (f = *native_function_bucket (bytes, nbytes); f; f = f->next)
+      if (f->code->nbytes == nbytes && !memcmp (f->code->bytes, bytes, nbytes))
+	return f;
+  return NULL;
+}
+
+/* Add the native function CODE, unless there already is one for the
+   same bytes and depth.  */
+
+static void
+add_native_function (const struct native_byte_code *code)
+{
+  struct native_function *same, *f, **bucket;
+
+  if (native_functions_count >= native_functions_size)
+    {
+      struct native_function **old = native_functions;
+      ptrdiff_t i, old_size = native_functions_size;
+
+      native_functions_size = old_size ? 2 * old_size : 256;
+      native_functions = xnmalloc (native_functions_size,
+				   sizeof *native_functions);
+      memset (native_functions, 0,
+	      native_functions_size * sizeof *native_functions);
+      for (i = 0; i < old_size; i++)
+	while (old[i])
+	  {
+	    f = old[i];
+	    old[i] = f->next;
+	    bucket = native_function_bucket (f->code->bytes, f->code->nbytes);
+	    f->next = *bucket;
+	    *bucket = f;
+	  }
+      xfree (old);
+    }
+
+  same = find_native_function (code->bytes, code->nbytes);
+  for (f = same; f; f = f->next_depth)
+    if (f->code->depth == code->depth)
+      return;
+
+  f = xmalloc (sizeof *f);
+  f->code = code;
+  if (same)
+    {
+      f->next_depth = same->next_depth;
+      same->next_depth = f;
+      f->next = NULL;
+    }
+  else
+    {
+      f->next_depth = NULL;
+      bucket = native_function_bucket (code->bytes, code->nbytes);
+      f->next = *bucket;
+      *bucket = f;
+      native_functions_count++;
+    }
+}
+
+#endif /* HAVE_NATIVE_BYTE_CODE */
+
+/* Return true if OP is the opcode of a byte code.  */
+
+static bool
+byte_code_defined_p (int op)
+{
+  switch (op)
+    {
+#define DEFINE(name, value) case name:
+      BYTE_CODES
+#undef DEFINE
 #ifdef BYTE_CODE_SAFE
-#define FETCH (eassert (stack.byte_string_start == SDATA (stack.byte_string)), *stack.pc++)
-#else
-#define FETCH *stack.pc++
+    case Bscan_buffer:
+    case Bset_mark:
 #endif
+      /* Bstack_ref with an operand of 0 is not valid; Bdup is used
+	 instead.  */
+      return op != Bstack_ref;
+
+    default:
+      return Bconstant < op && op <= 0377;
+    }
+}
+
+/* Return the number of operand bytes that follow the opcode OP.  */
+
+static int
+byte_code_operand_length (int op)
+{
+  switch (op)
+    {
+    case Bstack_ref6: case Bvarref6: case Bvarset6: case Bvarbind6:
+    case Bcall6: case Bunbind6:
+    case BRgoto: case BRgotoifnil: case BRgotoifnonnil:
+    case BRgotoifnilelsepop: case BRgotoifnonnilelsepop:
+    case BlistN: case BconcatN: case BinsertN:
+    case Bstack_set: case BdiscardN:
+      return 1;
+
+    case Bstack_ref7: case Bvarref7: case Bvarset7: case Bvarbind7:
+    case Bcall7: case Bunbind7:
+    case Bpushconditioncase: case Bpushcatch:
+    case Bconstant2: case Bgoto: case Bgotoifnil: case Bgotoifnonnil:
+    case Bgotoifnilelsepop: case Bgotoifnonnilelsepop:
+    case Bstack_set2:
+      return 2;
+
+    default:
+      return 0;
+    }
+}
+
+/* If the instruction OP is commonly followed by NEXT, return the
+   superinstruction that executes both.  Otherwise return OP.  */
+
+static int
+byte_code_superinstruction (int op, int next)
+{
+#ifndef BYTE_CODE_METER
+  switch (op)
+    {
+    case Beq:
+      if (next == Bgotoifnil)
+	return Beq_gotoifnil;
+      break;
+
+    case Bdup:
+      if (next == Bgotoifnil)
+	return Bdup_gotoifnil;
+      break;
+
+    case Bvarref:
+      if (next == Bgotoifnil)
+	return Bvarref_gotoifnil;
+      if (next == Bcar)
+	return Bvarref_car;
+      break;
+
+    case Bstack_ref:
+      if (next == Bcar)
+	return Bstack_ref_car;
+      break;
+
+    case Bcall:
+      if (next == Bdiscard)
+	return Bcall_discard;
+      break;
+    }
+#endif
+
+  return op;
+}
+
+/* Decode the byte-code string BYTESTR, which must be unibyte.  */
+
+static struct decoded_byte_code *
+decode_byte_code (Lisp_Object bytestr)
+{
+  const unsigned char *bytes = SDATA (bytestr);
+  ptrdiff_t nbytes = SBYTES (bytestr);
+  ptrdiff_t i, n, ninsns, *insn_at;
+  struct decoded_byte_code *code;
+  USE_SAFE_ALLOCA;
+
+  /* Find the index of the instruction that starts at each byte, or -1
+     if none does.  Execution that runs off the end of the byte code
+     continues with an extra Binvalid instruction, which jumps to
+     invalid places go to as well.  */
+  SAFE_NALLOCA (insn_at, 1, nbytes + 1);
+  for (i = 0; i <= nbytes; i++)
+    insn_at[i] = -1;
+  for (i = ninsns = 0; i < nbytes; ninsns++)
+    {
+      insn_at[i] = ninsns;
+      i += 1 + byte_code_operand_length (bytes[i]);
+    }
+  insn_at[nbytes] = ninsns;
+
+  code = xmalloc (offsetof (struct decoded_byte_code, insns)
+		  + (ninsns + 1) * sizeof *code->insns + nbytes);
+  code->string = XSTRING (bytestr);
+  code->nbytes = nbytes;
+  code->bytes = (unsigned char *) &code->insns[ninsns + 1];
+  memcpy (code->bytes, bytes, nbytes);
+  code->linked = false;
+  code->ninsns = ninsns + 1;
+#ifdef HAVE_NATIVE_BYTE_CODE
+  code->native = find_native_function ((const char *) bytes, nbytes);
+#endif
+
+  for (i = n = 0; i < nbytes; n++)
+    {
+      struct byte_insn *insn = &code->insns[n];
+      int op = bytes[i];
+      int length = byte_code_operand_length (op);
+      ptrdiff_t operand, target = 0;
+      bool jump = true;
 
-/* Fetch two bytes from the bytecode stream and make a 16-bit number
-   out of them.  */
+      if (nbytes - i <= length)
+	{
+	  /* The operand is missing.  */
+	  insn->u.op = Binvalid;
+	  insn->arg = i;
+	  i = nbytes;
+	  continue;
+	}
+      operand = (length == 0 ? 0
+		 : length == 1 ? bytes[i + 1]
+		 : bytes[i + 1] + (bytes[i + 2] << 8));
+
+      switch (op)
+	{
+	case Bgoto: case Bgotoifnil: case Bgotoifnonnil:
+	case Bgotoifnilelsepop: case Bgotoifnonnilelsepop:
+	case Bpushconditioncase: case Bpushcatch:
+	  target = operand;
+	  break;
 
-#define FETCH2 (op = FETCH, op + (FETCH << 8))
+	  /* A relative jump's offset is from the byte after the opcode,
+	     biased by 127.  */
+	case BRgoto:
+	  op = Bgoto;
+	  target = i + operand - 126;
+	  break;
+	case BRgotoifnil:
+	  op = Bgotoifnil;
+	  target = i + operand - 126;
+	  break;
+	case BRgotoifnonnil:
+	  op = Bgotoifnonnil;
+	  target = i + operand - 126;
+	  break;
+	case BRgotoifnilelsepop:
+	  op = Bgotoifnilelsepop;
+	  target = i + operand - 126;
+	  break;
+	case BRgotoifnonnilelsepop:
+	  op = Bgotoifnonnilelsepop;
+	  target = i + operand - 126;
+	  break;
+
+	default:
+	  jump = false;
+	  break;
+	}
+
+      if (jump)
+	{
+	  insn->u.op = op;
+	  insn->arg = (0 <= target && target <= nbytes && insn_at[target] >= 0
+		       ? insn_at[target] : ninsns);
+	}
+      else if (!byte_code_defined_p (op))
+	{
+	  insn->u.op = Binvalid;
+	  insn->arg = i;
+	}
+      else if (op >= Bconstant)
+	{
+	  insn->u.op = Bconstant;
+	  insn->arg = op - Bconstant;
+	}
+      else if (op == Bconstant2)
+	{
+	  insn->u.op = Bconstant;
+	  insn->arg = operand;
+	}
+      else if (op == Bstack_set2)
+	{
+	  insn->u.op = Bstack_set;
+	  insn->arg = operand;
+	}
+      else if (op < Bpophandler)
+	{
+	  /* Bstack_ref, Bvarref, Bvarset, Bvarbind, Bcall and Bunbind
+	     have their operand in the low 3 bits of the opcode, except
+	     that 6 and 7 mean a 1- or 2-byte operand follows.  */
+	  insn->u.op = op & ~7;
+	  insn->arg = (op & 7) < 6 ? op & 7 : operand;
+	}
+      else
+	{
+	  insn->u.op = op;
+	  insn->arg = operand;
+	}
+
+      i += 1 + length;
+    }
+
+  code->insns[ninsns].u.op = Binvalid;
+  code->insns[ninsns].arg = nbytes;
+
+  for (n = 0; n < ninsns; n++)
+    code->insns[n].u.op = byte_code_superinstruction (code->insns[n].u.op,
+						      code->insns[n + 1].u.op);
+
+  SAFE_FREE ();
+  return code;
+}
+
+/* Return the decoded form of the byte-code string BYTESTR, which must
+   be unibyte.  */
+
+static struct decoded_byte_code *
+get_decoded_byte_code (Lisp_Object bytestr)
+{
+  struct Lisp_String *s = XSTRING (bytestr);
+  struct decoded_byte_code **bucket, *code;
+
+  if (byte_code_cache_size)
+    for (bucket = byte_code_cache_bucket (s); (code = *bucket);
+	 bucket = &code->next)
+      if (code->string == s)
+	{
+	  /* A unibyte string cannot change its length in place, but its
+	     bytes can change.  */
+	  eassert (code->nbytes == SBYTES (bytestr));
+	  if (!memcmp (code->bytes, SDATA (bytestr), code->nbytes))
+	    return code;
+
+	  *bucket = code->next;
+	  xfree (code);
+	  byte_code_cache_count--;
+	  break;
+	}
+
+  code = decode_byte_code (bytestr);
+  if (byte_code_cache_count >= byte_code_cache_size)
+    grow_byte_code_cache ();
+  bucket = byte_code_cache_bucket (s);
+  code->next = *bucket;
+  *bucket = code;
+  byte_code_cache_count++;
+  return code;
+}
 
 /* Push x onto the execution stack.  This used to be #define PUSH(x)
    (*++stackp = (x)) This oddity is necessary because Alliant can't be
@@ -442,19 +940,6 @@ unmark_byte_stack (void)
    AFTER_POTENTIAL_GC ();	\
  } while (0)
 
-/* Check for jumping out of range.  */
-
-#ifdef BYTE_CODE_SAFE
-
-#define CHECK_RANGE(ARG) \
-  if (ARG >= bytestr_length) emacs_abort ()
-
-#else /* not BYTE_CODE_SAFE */
-
-#define CHECK_RANGE(ARG)
-
-#endif /* not BYTE_CODE_SAFE */
-
 /* A version of the QUIT macro which makes sure that the stack top is
    set before signaling `quit'.  */
 
@@ -475,6 +960,20 @@ unmark_byte_stack (void)
   } while (0)
 
 
+/* Set V to the value of the variable SYM, the operand of Bvarref.  */
+
+#define VARREF(sym, v)						\
+  do {								\
+    if (!SYMBOLP (sym)						\
+	|| XSYMBOL (sym)->redirect != SYMBOL_PLAINVAL		\
+	|| (v = SYMBOL_VAL (XSYMBOL (sym)), EQ (v, Qunbound)))	\
+      {								\
+	BEFORE_POTENTIAL_GC ();					\
+	v = Fsymbol_value (sym);				\
+	AFTER_POTENTIAL_GC ();					\
+      }								\
+  } while (0)
+
 DEFUN ("byte-code", Fbyte_code, Sbyte_code, 3, 3, 0,
        doc: /* Function used internally in byte-compiled code.
 The first argument, BYTESTR, is a string of byte code;
@@ -508,19 +1007,24 @@ exec_byte_code (Lisp_Object bytestr, Lisp_Object vector, Lisp_Object maxdepth,
 #ifdef BYTE_CODE_METER
   int volatile this_op = 0;
   int prev_op;
-#endif
   int op;
-  /* Lisp_Object v1, v2; */
+#endif
   Lisp_Object *vectorp;
 #ifdef BYTE_CODE_SAFE
   ptrdiff_t const_length;
   Lisp_Object *stacke;
-  ptrdiff_t bytestr_length;
 #endif
   struct byte_stack stack;
   Lisp_Object *top;
   Lisp_Object result;
   enum handlertype type;
+  struct decoded_byte_code *code;
+  /* The instruction being executed, and the next one.  */
+  const struct byte_insn *insn, *pc;
+#ifdef HAVE_NATIVE_BYTE_CODE
+  /* The bottom of the stack, where the arguments are pushed.  */
+  Lisp_Object *args_bottom;
+#endif
 
 #if 0 /* CHECK_FRAME_FONT */
  {
@@ -530,6 +1034,66 @@ exec_byte_code (Lisp_Object bytestr, Lisp_Object vector, Lisp_Object maxdepth,
        && FRAME_FONT (f)->direction != 1)
      emacs_abort ();
  }
+#endif
+
+  /* The interpreter can be compiled one of two ways: as an ordinary
+     switch-based interpreter, or as a threaded interpreter.  The
+     threaded interpreter relies on GCC's computed goto extension, so
+     it is not available everywhere.  Threading provides a performance
+     boost.  These macros are how we allow the code to be compiled both
+     ways.  */
+#ifdef BYTE_CODE_THREADED
+  /* The CASE macro introduces an instruction's body.  It is either a
+     label or a case label.  */
+#define CASE(OP) insn_ ## OP
+  /* NEXT is invoked at the end of an instruction to go to the next
+     instruction.  It is either a computed goto, or a plain break.  */
+#define NEXT goto *(insn = pc++)->u.label
+  /* FIRST is like NEXT, but is only used at the start of the
+     interpreter body.  In the switch-based interpreter it is the
+     switch, so the threaded definition must include a semicolon.  */
+#define FIRST NEXT;
+  /* This introduces the instruction that reports an invalid opcode,
+     which also serves as the default case.  */
+#define CASE_ABORT CASE (Binvalid): CASE (default)
+#else
+  /* See above for the meaning of the various defines.  */
+#define CASE(OP) case OP
+#define NEXT break
+#define FIRST switch (insn->u.op)
+#define CASE_ABORT case Binvalid: default
+#endif
+
+#ifdef BYTE_CODE_THREADED
+
+  /* A convenience define that saves us a lot of typing and makes
+     the table clearer.  */
+#define LABEL(OP) [OP] = &&insn_ ## OP
+
+#if 4 < __GNUC__ + (6 <= __GNUC_MINOR__)
+# pragma GCC diagnostic push
+# pragma GCC diagnostic ignored "-Woverride-init"
+#elif defined __clang__
+# pragma GCC diagnostic push
+# pragma GCC diagnostic ignored "-Winitializer-overrides"
+#endif
+
+  /* This is the dispatch table for the threaded interpreter.  The
+     decoder never produces the opcodes that have no entry.  */
+  static const void *const targets[BYTE_INSN_LIMIT] =
+    {
+      [0 ... (BYTE_INSN_LIMIT - 1)] = &&insn_default,
+
+#define DEFINE(name, value) LABEL (name) ,
+      BYTE_CODES
+      BYTE_INSNS
+#undef DEFINE
+    };
+
+#if 4 < __GNUC__ + (6 <= __GNUC_MINOR__) || defined __clang__
+# pragma GCC diagnostic pop
+#endif
+
 #endif
 
   CHECK_STRING (bytestr);
@@ -548,19 +1112,30 @@ exec_byte_code (Lisp_Object bytestr, Lisp_Object vector, Lisp_Object maxdepth,
        convert them back to the originally intended unibyte form.  */
     bytestr = Fstring_as_unibyte (bytestr);
 
-#ifdef BYTE_CODE_SAFE
-  bytestr_length = SBYTES (bytestr);
+  code = get_decoded_byte_code (bytestr);
+#ifdef BYTE_CODE_THREADED
+  if (!code->linked)
+    {
+      ptrdiff_t i;
+      for (i = 0; i < code->ninsns; i++)
+	code->insns[i].u.label = targets[code->insns[i].u.op];
+      code->linked = true;
+    }
 #endif
+  pc = code->insns;
+
   vectorp = XVECTOR (vector)->contents;
 
   stack.byte_string = bytestr;
-  stack.pc = stack.byte_string_start = SDATA (bytestr);
 #if BYTE_MARK_STACK
   stack.constants = vector;
 #endif
   if (MAX_ALLOCA / word_size <= XFASTINT (maxdepth))
     memory_full (SIZE_MAX);
   top = alloca ((XFASTINT (maxdepth) + 1) * sizeof *top);
+#ifdef HAVE_NATIVE_BYTE_CODE
+  args_bottom = top + 1;
+#endif
 #if BYTE_MAINTAIN_TOP
   stack.bottom = top + 1;
   stack.top = NULL;
@@ -617,6 +1192,21 @@ exec_byte_code (Lisp_Object bytestr, Lisp_Object vector, Lisp_Object maxdepth,
       error ("Unknown args template!");
     }
 
+#ifdef HAVE_NATIVE_BYTE_CODE
+  /* Run native code instead, if there is some for this many values
+     on the stack.  */
+  {
+    struct native_function *f;
+
+    for (f = code->native; f; f = f->next_depth)
+      if (f->code->depth == top + 1 - args_bottom)
+	{
+	  result = f->code->function (vectorp, args_bottom);
+	  goto exit;
+	}
+  }
+#endif
+
   while (1)
     {
 #ifdef BYTE_CODE_SAFE
@@ -626,139 +1216,48 @@ exec_byte_code (Lisp_Object bytestr, Lisp_Object vector, Lisp_Object maxdepth,
 	emacs_abort ();
 #endif
 
-#ifdef BYTE_CODE_METER
-      prev_op = this_op;
-      this_op = op = FETCH;
-      METER_CODE (prev_op, op);
-#else
 #ifndef BYTE_CODE_THREADED
-      op = FETCH;
-#endif
-#endif
-
-      /* The interpreter can be compiled one of two ways: as an
-	 ordinary switch-based interpreter, or as a threaded
-	 interpreter.  The threaded interpreter relies on GCC's
-	 computed goto extension, so it is not available everywhere.
-	 Threading provides a performance boost.  These macros are how
-	 we allow the code to be compiled both ways.  */
-#ifdef BYTE_CODE_THREADED
-      /* The CASE macro introduces an instruction's body.  It is
-	 either a label or a case label.  */
-#define CASE(OP) insn_ ## OP
-      /* NEXT is invoked at the end of an instruction to go to the
-	 next instruction.  It is either a computed goto, or a
-	 plain break.  */
-#define NEXT goto *(targets[op = FETCH])
-      /* FIRST is like NEXT, but is only used at the start of the
-	 interpreter body.  In the switch-based interpreter it is the
-	 switch, so the threaded definition must include a semicolon.  */
-#define FIRST NEXT;
-      /* Most cases are labeled with the CASE macro, above.
-	 CASE_DEFAULT is one exception; it is used if the interpreter
-	 being built requires a default case.  The threaded
-	 interpreter does not, because the dispatch table is
-	 completely filled.  */
-#define CASE_DEFAULT
-      /* This introduces an instruction that is known to call abort.  */
-#define CASE_ABORT CASE (Bstack_ref): CASE (default)
-#else
-      /* See above for the meaning of the various defines.  */
-#define CASE(OP) case OP
-#define NEXT break
-#define FIRST switch (op)
-#define CASE_DEFAULT case 255: default:
-#define CASE_ABORT case 0
+      insn = pc++;
 #endif
-
-#ifdef BYTE_CODE_THREADED
-
-      /* A convenience define that saves us a lot of typing and makes
-	 the table clearer.  */
-#define LABEL(OP) [OP] = &&insn_ ## OP
-
-#if 4 < __GNUC__ + (6 <= __GNUC_MINOR__)
-# pragma GCC diagnostic push
-# pragma GCC diagnostic ignored "-Woverride-init"
-#elif defined __clang__
-# pragma GCC diagnostic push
-# pragma GCC diagnostic ignored "-Winitializer-overrides"
-#endif
-
-      /* This is the dispatch table for the threaded interpreter.  */
-      static const void *const targets[256] =
-	{
-	  [0 ... (Bconstant - 1)] = &&insn_default,
-	  [Bconstant ... 255] = &&insn_Bconstant,
-
-#define DEFINE(name, value) LABEL (name) ,
-	  BYTE_CODES
-#undef DEFINE
-	};
-
-#if 4 < __GNUC__ + (6 <= __GNUC_MINOR__) || defined __clang__
-# pragma GCC diagnostic pop
-#endif
-
+#ifdef BYTE_CODE_METER
+      prev_op = this_op;
+      this_op = op = insn->u.op;
+      if (op < Binvalid)
+	METER_CODE (prev_op, op);
 #endif
 
-
+      /* Byte codes that have several forms, such as Bvarref1
+	 ... Bvarref7, are all decoded to the basic form, so their
+	 labels are just placeholders in the dispatch table.  The
+	 operand of the instruction is INSN->arg, and PC points to the
+	 next instruction.  */
       FIRST
 	{
-	CASE (Bvarref7):
-	  op = FETCH2;
-	  goto varref;
-
 	CASE (Bvarref):
 	CASE (Bvarref1):
 	CASE (Bvarref2):
 	CASE (Bvarref3):
 	CASE (Bvarref4):
 	CASE (Bvarref5):
-	  op = op - Bvarref;
-	  goto varref;
-
-	/* This seems to be the most frequently executed byte-code
-	   among the Bvarref's, so avoid a goto here.  */
 	CASE (Bvarref6):
-	  op = FETCH;
-	varref:
+	CASE (Bvarref7):
 	  {
-	    Lisp_Object v1, v2;
-
-	    v1 = vectorp[op];
-	    if (SYMBOLP (v1))
-	      {
-		if (XSYMBOL (v1)->redirect != SYMBOL_PLAINVAL
-		    || (v2 = SYMBOL_VAL (XSYMBOL (v1)),
-			EQ (v2, Qunbound)))
-		  {
-		    BEFORE_POTENTIAL_GC ();
-		    v2 = Fsymbol_value (v1);
-		    AFTER_POTENTIAL_GC ();
-		  }
-	      }
-	    else
-	      {
-		BEFORE_POTENTIAL_GC ();
-		v2 = Fsymbol_value (v1);
-		AFTER_POTENTIAL_GC ();
-	      }
+	    Lisp_Object v1 = vectorp[insn->arg], v2;
+	    VARREF (v1, v2);
 	    PUSH (v2);
 	    NEXT;
 	  }
 
 	CASE (Bgotoifnil):
+	CASE (BRgotoifnil):
 	  {
 	    Lisp_Object v1;
 	    MAYBE_GC ();
-	    op = FETCH2;
 	    v1 = POP;
 	    if (NILP (v1))
 	      {
 		BYTE_CODE_QUIT;
-		CHECK_RANGE (op);
-		stack.pc = stack.byte_string_start + op;
+		pc = code->insns + insn->arg;
 	      }
 	    NEXT;
 	  }
@@ -819,20 +1318,12 @@ exec_byte_code (Lisp_Object bytestr, Lisp_Object vector, Lisp_Object maxdepth,
 	CASE (Bvarset3):
 	CASE (Bvarset4):
 	CASE (Bvarset5):
-	  op -= Bvarset;
-	  goto varset;
-
-	CASE (Bvarset7):
-	  op = FETCH2;
-	  goto varset;
-
 	CASE (Bvarset6):
-	  op = FETCH;
-	varset:
+	CASE (Bvarset7):
 	  {
 	    Lisp_Object sym, val;
 
-	    sym = vectorp[op];
+	    sym = vectorp[insn->arg];
 	    val = TOP;
 
 	    /* Inline the most common case.  */
@@ -861,47 +1352,31 @@ exec_byte_code (Lisp_Object bytestr, Lisp_Object vector, Lisp_Object maxdepth,
 
 	/* ------------------ */
 
-	CASE (Bvarbind6):
-	  op = FETCH;
-	  goto varbind;
-
-	CASE (Bvarbind7):
-	  op = FETCH2;
-	  goto varbind;
-
 	CASE (Bvarbind):
 	CASE (Bvarbind1):
 	CASE (Bvarbind2):
 	CASE (Bvarbind3):
 	CASE (Bvarbind4):
 	CASE (Bvarbind5):
-	  op -= Bvarbind;
-	varbind:
+	CASE (Bvarbind6):
+	CASE (Bvarbind7):
 	  /* Specbind can signal and thus GC.  */
 	  BEFORE_POTENTIAL_GC ();
-	  specbind (vectorp[op], POP);
+	  specbind (vectorp[insn->arg], POP);
 	  AFTER_POTENTIAL_GC ();
 	  NEXT;
 
-	CASE (Bcall6):
-	  op = FETCH;
-	  goto docall;
-
-	CASE (Bcall7):
-	  op = FETCH2;
-	  goto docall;
-
 	CASE (Bcall):
 	CASE (Bcall1):
 	CASE (Bcall2):
 	CASE (Bcall3):
 	CASE (Bcall4):
 	CASE (Bcall5):
-	  op -= Bcall;
-	docall:
+	CASE (Bcall6):
+	CASE (Bcall7):
 	  {
 	    BEFORE_POTENTIAL_GC ();
-	    DISCARD (op);
+	    DISCARD (insn->arg);
 #ifdef BYTE_CODE_METER
 	    if (byte_metering_on && SYMBOLP (TOP))
 	      {
@@ -917,29 +1392,21 @@ exec_byte_code (Lisp_Object bytestr, Lisp_Object vector, Lisp_Object maxdepth,
 		  }
 	      }
 #endif
-	    TOP = Ffuncall (op + 1, &TOP);
+	    TOP = Ffuncall (insn->arg + 1, &TOP);
 	    AFTER_POTENTIAL_GC ();
 	    NEXT;
 	  }
 
-	CASE (Bunbind6):
-	  op = FETCH;
-	  goto dounbind;
-
-	CASE (Bunbind7):
-	  op = FETCH2;
-	  goto dounbind;
-
 	CASE (Bunbind):
 	CASE (Bunbind1):
 	CASE (Bunbind2):
 	CASE (Bunbind3):
 	CASE (Bunbind4):
 	CASE (Bunbind5):
-	  op -= Bunbind;
-	dounbind:
+	CASE (Bunbind6):
+	CASE (Bunbind7):
 	  BEFORE_POTENTIAL_GC ();
-	  unbind_to (SPECPDL_INDEX () - op, Qnil);
+	  unbind_to (SPECPDL_INDEX () - insn->arg, Qnil);
 	  AFTER_POTENTIAL_GC ();
 	  NEXT;
 
@@ -952,118 +1419,141 @@ exec_byte_code (Lisp_Object bytestr, Lisp_Object vector, Lisp_Object maxdepth,
 	  NEXT;
 
 	CASE (Bgoto):
+	CASE (BRgoto):
 	  MAYBE_GC ();
 	  BYTE_CODE_QUIT;
-	  op = FETCH2;    /* pc = FETCH2 loses since FETCH2 contains pc++ */
-	  CHECK_RANGE (op);
-	  stack.pc = stack.byte_string_start + op;
+	  pc = code->insns + insn->arg;
 	  NEXT;
 
 	CASE (Bgotoifnonnil):
+	CASE (BRgotoifnonnil):
 	  {
 	    Lisp_Object v1;
 	    MAYBE_GC ();
-	    op = FETCH2;
 	    v1 = POP;
 	    if (!NILP (v1))
 	      {
 		BYTE_CODE_QUIT;
-		CHECK_RANGE (op);
-		stack.pc = stack.byte_string_start + op;
+		pc = code->insns + insn->arg;
 	      }
 	    NEXT;
 	  }
 
 	CASE (Bgotoifnilelsepop):
+	CASE (BRgotoifnilelsepop):
 	  MAYBE_GC ();
-	  op = FETCH2;
 	  if (NILP (TOP))
 	    {
 	      BYTE_CODE_QUIT;
-	      CHECK_RANGE (op);
-	      stack.pc = stack.byte_string_start + op;
+	      pc = code->insns + insn->arg;
 	    }
 	  else DISCARD (1);
 	  NEXT;
 
 	CASE (Bgotoifnonnilelsepop):
+	CASE (BRgotoifnonnilelsepop):
 	  MAYBE_GC ();
-	  op = FETCH2;
 	  if (!NILP (TOP))
 	    {
 	      BYTE_CODE_QUIT;
-	      CHECK_RANGE (op);
-	      stack.pc = stack.byte_string_start + op;
+	      pc = code->insns + insn->arg;
 	    }
 	  else DISCARD (1);
 	  NEXT;
 
-	CASE (BRgoto):
-	  MAYBE_GC ();
-	  BYTE_CODE_QUIT;
-	  stack.pc += (int) *stack.pc - 127;
+	CASE (Breturn):
+	  result = POP;
+	  goto exit;
+
+	CASE (Bdiscard):
+	  DISCARD (1);
 	  NEXT;
 
-	CASE (BRgotoifnil):
-	  {
-	    Lisp_Object v1;
-	    MAYBE_GC ();
-	    v1 = POP;
-	    if (NILP (v1))
-	      {
-		BYTE_CODE_QUIT;
-		stack.pc += (int) *stack.pc - 128;
-	      }
-	    stack.pc++;
-	    NEXT;
-	  }
+	/* Superinstructions.  The operand of the second instruction is
+	   PC->arg, and PC must be advanced past it unless jumping.  */
 
-	CASE (BRgotoifnonnil):
+	CASE (Beq_gotoifnil):
 	  {
-	    Lisp_Object v1;
+	    Lisp_Object v1, v2;
 	    MAYBE_GC ();
 	    v1 = POP;
-	    if (!NILP (v1))
+	    v2 = POP;
+	    if (!EQ (v1, v2))
 	      {
 		BYTE_CODE_QUIT;
-		stack.pc += (int) *stack.pc - 128;
+		pc = code->insns + pc->arg;
 	      }
-	    stack.pc++;
+	    else
+	      pc++;
 	    NEXT;
 	  }
 
-	CASE (BRgotoifnilelsepop):
+	CASE (Bdup_gotoifnil):
 	  MAYBE_GC ();
-	  op = *stack.pc++;
 	  if (NILP (TOP))
 	    {
 	      BYTE_CODE_QUIT;
-	      stack.pc += op - 128;
+	      pc = code->insns + pc->arg;
 	    }
-	  else DISCARD (1);
+	  else
+	    pc++;
 	  NEXT;
 
-	CASE (BRgotoifnonnilelsepop):
-	  MAYBE_GC ();
-	  op = *stack.pc++;
-	  if (!NILP (TOP))
-	    {
-	      BYTE_CODE_QUIT;
-	      stack.pc += op - 128;
-	    }
-	  else DISCARD (1);
-	  NEXT;
+	CASE (Bvarref_gotoifnil):
+	  {
+	    Lisp_Object v1 = vectorp[insn->arg], v2;
+	    VARREF (v1, v2);
+	    MAYBE_GC ();
+	    if (NILP (v2))
+	      {
+		BYTE_CODE_QUIT;
+		pc = code->insns + pc->arg;
+	      }
+	    else
+	      pc++;
+	    NEXT;
+	  }
 
-	CASE (Breturn):
-	  result = POP;
-	  goto exit;
+	CASE (Bvarref_car):
+	  {
+	    Lisp_Object v1 = vectorp[insn->arg], v2;
+	    VARREF (v1, v2);
+	    if (CONSP (v2))
+	      PUSH (XCAR (v2));
+	    else if (NILP (v2))
+	      PUSH (Qnil);
+	    else
+	      {
+		BEFORE_POTENTIAL_GC ();
+		wrong_type_argument (Qlistp, v2);
+	      }
+	    pc++;
+	    NEXT;
+	  }
 
-	CASE (Bdiscard):
-	  DISCARD (1);
-	  NEXT;
+	CASE (Bstack_ref_car):
+	  {
+	    Lisp_Object v1 = top[-insn->arg];
+	    if (CONSP (v1))
+	      PUSH (XCAR (v1));
+	    else if (NILP (v1))
+	      PUSH (Qnil);
+	    else
+	      {
+		BEFORE_POTENTIAL_GC ();
+		wrong_type_argument (Qlistp, v1);
+	      }
+	    pc++;
+	    NEXT;
+	  }
 
-	CASE (Bconstant2):
-	  PUSH (vectorp[FETCH2]);
+	CASE (Bcall_discard):
+	  BEFORE_POTENTIAL_GC ();
+	  DISCARD (insn->arg);
+	  Ffuncall (insn->arg + 1, &TOP);
+	  AFTER_POTENTIAL_GC ();
+	  DISCARD (1);
+	  pc++;
 	  NEXT;
 
 	CASE (Bsave_excursion):
@@ -1110,29 +1600,22 @@ exec_byte_code (Lisp_Object bytestr, Lisp_Object vector, Lisp_Object maxdepth,
 	  {
 	    struct handler *c;
 	    Lisp_Object tag;
-	    int dest;
 
 	    type = CONDITION_CASE;
 	  pushhandler:
 	    tag = POP;
-	    dest = FETCH2;
 
 	    PUSH_HANDLER (c, tag, type);
-	    c->bytecode_dest = dest;
+	    c->bytecode_dest = insn->arg;
 	    c->bytecode_top = top;
 
 	    if (sys_setjmp (c->jmp))
 	      {
 		struct handler *c = handlerlist;
-		int dest;
 		top = c->bytecode_top;
-		dest = c->bytecode_dest;
 		handlerlist = c->next;
 		PUSH (c->val);
-		CHECK_RANGE (dest);
-		/* Might have been re-set by longjmp!  */
-		stack.byte_string_start = SDATA (stack.byte_string);
-		stack.pc = stack.byte_string_start + dest;
+		pc = code->insns + c->bytecode_dest;
 	      }
 
 	    NEXT;
@@ -1255,9 +1738,8 @@ exec_byte_code (Lisp_Object bytestr, Lisp_Object vector, Lisp_Object maxdepth,
 	  NEXT;
 
 	CASE (BlistN):
-	  op = FETCH;
-	  DISCARD (op - 1);
-	  TOP = Flist (op, &TOP);
+	  DISCARD (insn->arg - 1);
+	  TOP = Flist (insn->arg, &TOP);
 	  NEXT;
 
 	CASE (Blength):
@@ -1360,10 +1842,9 @@ exec_byte_code (Lisp_Object bytestr, Lisp_Object vector, Lisp_Object maxdepth,
 	  NEXT;
 
 	CASE (BconcatN):
-	  op = FETCH;
 	  BEFORE_POTENTIAL_GC ();
-	  DISCARD (op - 1);
-	  TOP = Fconcat (op, &TOP);
+	  DISCARD (insn->arg - 1);
+	  TOP = Fconcat (insn->arg, &TOP);
 	  AFTER_POTENTIAL_GC ();
 	  NEXT;
 
@@ -1405,70 +1886,77 @@ exec_byte_code (Lisp_Object bytestr, Lisp_Object vector, Lisp_Object maxdepth,
 
 	CASE (Beqlsign):
 	  {
-	    Lisp_Object v1, v2;
-	    BEFORE_POTENTIAL_GC ();
-	    v2 = POP; v1 = TOP;
-	    CHECK_NUMBER_OR_FLOAT_COERCE_MARKER (v1);
-	    CHECK_NUMBER_OR_FLOAT_COERCE_MARKER (v2);
-	    AFTER_POTENTIAL_GC ();
-	    if (FLOATP (v1) || FLOATP (v2))
+	    Lisp_Object v1;
+	    v1 = POP;
+	    if (! arithcompare2 (TOP, v1, ARITH_EQUAL, &TOP))
 	      {
-		double f1, f2;
-
-		f1 = (FLOATP (v1) ? XFLOAT_DATA (v1) : XINT (v1));
-		f2 = (FLOATP (v2) ? XFLOAT_DATA (v2) : XINT (v2));
-		TOP = (f1 == f2 ? Qt : Qnil);
+		BEFORE_POTENTIAL_GC ();
+		TOP = arithcompare (TOP, v1, ARITH_EQUAL);
+		AFTER_POTENTIAL_GC ();
 	      }
-	    else
-	      TOP = (XINT (v1) == XINT (v2) ? Qt : Qnil);
 	    NEXT;
 	  }
 
 	CASE (Bgtr):
 	  {
 	    Lisp_Object v1;
-	    BEFORE_POTENTIAL_GC ();
 	    v1 = POP;
-	    TOP = arithcompare (TOP, v1, ARITH_GRTR);
-	    AFTER_POTENTIAL_GC ();
+	    if (! arithcompare2 (TOP, v1, ARITH_GRTR, &TOP))
+	      {
+		BEFORE_POTENTIAL_GC ();
+		TOP = arithcompare (TOP, v1, ARITH_GRTR);
+		AFTER_POTENTIAL_GC ();
+	      }
 	    NEXT;
 	  }
 
 	CASE (Blss):
 	  {
 	    Lisp_Object v1;
-	    BEFORE_POTENTIAL_GC ();
 	    v1 = POP;
-	    TOP = arithcompare (TOP, v1, ARITH_LESS);
-	    AFTER_POTENTIAL_GC ();
+	    if (! arithcompare2 (TOP, v1, ARITH_LESS, &TOP))
+	      {
+		BEFORE_POTENTIAL_GC ();
+		TOP = arithcompare (TOP, v1, ARITH_LESS);
+		AFTER_POTENTIAL_GC ();
+	      }
 	    NEXT;
 	  }
 
 	CASE (Bleq):
 	  {
 	    Lisp_Object v1;
-	    BEFORE_POTENTIAL_GC ();
 	    v1 = POP;
-	    TOP = arithcompare (TOP, v1, ARITH_LESS_OR_EQUAL);
-	    AFTER_POTENTIAL_GC ();
+	    if (! arithcompare2 (TOP, v1, ARITH_LESS_OR_EQUAL, &TOP))
+	      {
+		BEFORE_POTENTIAL_GC ();
+		TOP = arithcompare (TOP, v1, ARITH_LESS_OR_EQUAL);
+		AFTER_POTENTIAL_GC ();
+	      }
 	    NEXT;
 	  }
 
 	CASE (Bgeq):
 	  {
 	    Lisp_Object v1;
-	    BEFORE_POTENTIAL_GC ();
 	    v1 = POP;
-	    TOP = arithcompare (TOP, v1, ARITH_GRTR_OR_EQUAL);
-	    AFTER_POTENTIAL_GC ();
+	    if (! arithcompare2 (TOP, v1, ARITH_GRTR_OR_EQUAL, &TOP))
+	      {
+		BEFORE_POTENTIAL_GC ();
+		TOP = arithcompare (TOP, v1, ARITH_GRTR_OR_EQUAL);
+		AFTER_POTENTIAL_GC ();
+	      }
 	    NEXT;
 	  }
 
 	CASE (Bdiff):
-	  BEFORE_POTENTIAL_GC ();
 	  DISCARD (1);
-	  TOP = Fminus (2, &TOP);
-	  AFTER_POTENTIAL_GC ();
+	  if (! arith_sub2 (TOP, top[1], &TOP))
+	    {
+	      BEFORE_POTENTIAL_GC ();
+	      TOP = Fminus (2, &TOP);
+	      AFTER_POTENTIAL_GC ();
+	    }
 	  NEXT;
 
 	CASE (Bnegate):
@@ -1490,10 +1978,13 @@ exec_byte_code (Lisp_Object bytestr, Lisp_Object vector, Lisp_Object maxdepth,
 	  }
 
 	CASE (Bplus):
-	  BEFORE_POTENTIAL_GC ();
 	  DISCARD (1);
-	  TOP = Fplus (2, &TOP);
-	  AFTER_POTENTIAL_GC ();
+	  if (! arith_add2 (TOP, top[1], &TOP))
+	    {
+	      BEFORE_POTENTIAL_GC ();
+	      TOP = Fplus (2, &TOP);
+	      AFTER_POTENTIAL_GC ();
+	    }
 	  NEXT;
 
 	CASE (Bmax):
@@ -1511,17 +2002,23 @@ exec_byte_code (Lisp_Object bytestr, Lisp_Object vector, Lisp_Object maxdepth,
 	  NEXT;
 
 	CASE (Bmult):
-	  BEFORE_POTENTIAL_GC ();
 	  DISCARD (1);
-	  TOP = Ftimes (2, &TOP);
-	  AFTER_POTENTIAL_GC ();
+	  if (! arith_mul2 (TOP, top[1], &TOP))
+	    {
+	      BEFORE_POTENTIAL_GC ();
+	      TOP = Ftimes (2, &TOP);
+	      AFTER_POTENTIAL_GC ();
+	    }
 	  NEXT;
 
 	CASE (Bquo):
-	  BEFORE_POTENTIAL_GC ();
 	  DISCARD (1);
-	  TOP = Fquo (2, &TOP);
-	  AFTER_POTENTIAL_GC ();
+	  if (! arith_div2 (TOP, top[1], &TOP))
+	    {
+	      BEFORE_POTENTIAL_GC ();
+	      TOP = Fquo (2, &TOP);
+	      AFTER_POTENTIAL_GC ();
+	    }
 	  NEXT;
 
 	CASE (Brem):
@@ -1555,10 +2052,9 @@ exec_byte_code (Lisp_Object bytestr, Lisp_Object vector, Lisp_Object maxdepth,
 	  NEXT;
 
 	CASE (BinsertN):
-	  op = FETCH;
 	  BEFORE_POTENTIAL_GC ();
-	  DISCARD (op - 1);
-	  TOP = Finsert (op, &TOP);
+	  DISCARD (insn->arg - 1);
+	  TOP = Finsert (insn->arg, &TOP);
 	  AFTER_POTENTIAL_GC ();
 	  NEXT;
 
@@ -1943,75 +2439,61 @@ exec_byte_code (Lisp_Object bytestr, Lisp_Object vector, Lisp_Object maxdepth,
 #endif
 
 	CASE_ABORT:
-	  /* Actually this is Bstack_ref with offset 0, but we use Bdup
-	     for that instead.  */
-	  /* CASE (Bstack_ref): */
-         call3 (intern ("error"),
-                build_string ("Invalid byte opcode: op=%s, ptr=%d"),
-                make_number (op),
-                make_number ((stack.pc - 1) - stack.byte_string_start));
+	  /* This is an undefined opcode, or Bstack_ref with offset 0,
+	     for which Bdup is used instead, or the end of the byte code.
+	     The operand is the position of the opcode.  */
+	  {
+	    ptrdiff_t pos = insn->arg;
+	    call3 (intern ("error"),
+		   build_string ("Invalid byte opcode: op=%s, ptr=%d"),
+		   make_number (pos < SBYTES (stack.byte_string)
+				? SREF (stack.byte_string, pos) : 0),
+		   make_number (pos));
+	  }
 
 	  /* Handy byte-codes for lexical binding.  */
+	CASE (Bstack_ref):
 	CASE (Bstack_ref1):
 	CASE (Bstack_ref2):
 	CASE (Bstack_ref3):
 	CASE (Bstack_ref4):
 	CASE (Bstack_ref5):
-	  {
-	    Lisp_Object *ptr = top - (op - Bstack_ref);
-	    PUSH (*ptr);
-	    NEXT;
-	  }
 	CASE (Bstack_ref6):
-	  {
-	    Lisp_Object *ptr = top - (FETCH);
-	    PUSH (*ptr);
-	    NEXT;
-	  }
 	CASE (Bstack_ref7):
 	  {
-	    Lisp_Object *ptr = top - (FETCH2);
+	    Lisp_Object *ptr = top - insn->arg;
 	    PUSH (*ptr);
 	    NEXT;
 	  }
 	CASE (Bstack_set):
+	CASE (Bstack_set2):
 	  /* stack-set-0 = discard; stack-set-1 = discard-1-preserve-tos.  */
 	  {
-	    Lisp_Object *ptr = top - (FETCH);
+	    Lisp_Object *ptr = top - insn->arg;
 	    *ptr = POP;
 	    NEXT;
 	  }
-	CASE (Bstack_set2):
+	CASE (BdiscardN):
 	  {
-	    Lisp_Object *ptr = top - (FETCH2);
-	    *ptr = POP;
+	    ptrdiff_t n = insn->arg;
+	    if (n & 0x80)
+	      {
+		n &= 0x7F;
+		top[-n] = TOP;
+	      }
+	    DISCARD (n);
 	    NEXT;
 	  }
-	CASE (BdiscardN):
-	  op = FETCH;
-	  if (op & 0x80)
-	    {
-	      op &= 0x7F;
-	      top[-op] = TOP;
-	    }
-	  DISCARD (op);
-	  NEXT;
 
-	CASE_DEFAULT
 	CASE (Bconstant):
+	CASE (Bconstant2):
 #ifdef BYTE_CODE_SAFE
-	  if (op < Bconstant)
-	    {
-	      emacs_abort ();
-	    }
-	  if ((op -= Bconstant) >= const_length)
+	  if (insn->arg >= const_length)
 	    {
 	      emacs_abort ();
 	    }
-	  PUSH (vectorp[op]);
-#else
-	  PUSH (vectorp[op - Bconstant]);
 #endif
+	  PUSH (vectorp[insn->arg]);
 	  NEXT;
 	}
     }
@@ -2031,10 +2513,114 @@ exec_byte_code (Lisp_Object bytestr, Lisp_Object vector, Lisp_Object maxdepth,
   return result;
 }
 
+#ifdef HAVE_NATIVE_BYTE_CODE
+
+/* Load the native code for the byte-compiled file FILE, if there is
+   any that this Emacs can use.  It is in the file named like FILE,
+   but with the extension .eln instead of .elc.  Native code is used
+   only for byte code with the very same bytes, so it does no harm if
+   FILE has been recompiled since; and if it cannot be loaded, the byte
+   code is interpreted as usual.  */
+
+void
+load_native_byte_code (Lisp_Object file)
+{
+  ptrdiff_t nbytes = SBYTES (file), i, *count;
+  Lisp_Object native;
+  void *handle;
+  const char *abi;
+  const struct native_byte_code *table;
+
+  /* Native code keeps its stack where only conservative stack
+     marking finds it.  */
+  if (BYTE_MARK_STACK || !load_native_code
+      || ! (nbytes > 4 && !memcmp (SDATA (file) + nbytes - 4, ".elc", 4)))
+    return;
+
+  /* dlopen searches the library path for a name without a slash.
+     For a name it has loaded before, it returns the library it loaded
+     then, so a .eln file that changes later takes effect only in the
+     next session.  */
+  native = concat2 (Fsubstring (file, make_number (0), make_number (-4)),
+		    build_string (".eln"));
+  native = Fexpand_file_name (native, Qnil);
+  handle = dlopen (SSDATA (ENCODE_FILE (native)), RTLD_NOW | RTLD_LOCAL);
+  if (!handle)
+    return;
+  abi = dlsym (handle, "native_byte_code_abi");
+  table = dlsym (handle, "native_byte_code_table");
+  count = dlsym (handle, "native_byte_code_count");
+  if (! (abi && table && count && !strcmp (abi, NATIVE_BYTE_CODE_ABI)))
+    {
+      dlclose (handle);
+      return;
+    }
+
+  for (i = 0; i < *count; i++)
+    add_native_function (&table[i]);
+
+  /* Byte code that has been decoded already can use it too.  */
+  for (i = 0; i < byte_code_cache_size; i++)
+    {
+      struct decoded_byte_code *code;
+
+      for (code = byte_code_cache[i]; code; code = code->next)
+	if (!code->native)
+	  code->native = find_native_function ((const char *) code->bytes,
+					       code->nbytes);
+    }
+}
+
+#endif /* HAVE_NATIVE_BYTE_CODE */
+
+DEFUN ("native-byte-code-p", Fnative_byte_code_p, Snative_byte_code_p,
+       1, 1, 0,
+       doc: /* Return t if the byte-code function FUNCTION runs as native code.
+Native code comes from a .eln file, which `load' loads along with the
+.elc file that defines FUNCTION; see `byte-native-compile-file'.  */)
+  (Lisp_Object function)
+{
+#ifdef HAVE_NATIVE_BYTE_CODE
+  Lisp_Object bytestr, template;
+  ptrdiff_t depth = 0;
+  struct native_function *f;
+
+  if (!COMPILEDP (function))
+    return Qnil;
+  if (CONSP (AREF (function, COMPILED_BYTECODE)))
+    Ffetch_bytecode (function);
+  bytestr = AREF (function, COMPILED_BYTECODE);
+  if (!STRINGP (bytestr))
+    return Qnil;
+  if (STRING_MULTIBYTE (bytestr))
+    bytestr = Fstring_as_unibyte (bytestr);
+
+  /* This is how many values exec_byte_code pushes for the arguments.  */
+  template = AREF (function, COMPILED_ARGLIST);
+  if (INTEGERP (template))
+    depth = (XINT (template) >> 8) + ((XINT (template) & 128) != 0);
+
+  for (f = get_decoded_byte_code (bytestr)->native; f; f = f->next_depth)
+    if (f->code->depth == depth)
+      return Qt;
+#endif
+  return Qnil;
+}
+
 void
 syms_of_bytecode (void)
 {
   defsubr (&Sbyte_code);
+  defsubr (&Snative_byte_code_p);
+
+#ifdef HAVE_NATIVE_BYTE_CODE
+  DEFVAR_BOOL ("load-native-code", load_native_code,
+	       doc: /* Non-nil means `load' loads native code along with byte code.
+When `load' loads a byte-compiled file FOO.elc, it first loads native
+code for its functions from FOO.eln, if that exists and was compiled
+for this Emacs.  `byte-native-compile-file' makes such files.  */);
+  load_native_code = true;
+#endif
 
 #ifdef BYTE_CODE_METER
 
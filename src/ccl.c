@@ -1933,7 +1933,7 @@ setup_ccl_program (struct ccl_program *ccl, Lisp_Object ccl_prog)
       if (! VECTORP (ccl_prog))
 	return false;
       vp = XVECTOR (ccl_prog);
-      ccl->size = vp->header.size;
+      ccl->size = ASIZE (ccl_prog);
       ccl->prog = vp->contents;
       ccl->eof_ic = XINT (vp->contents[CCL_HEADER_EOF]);
       ccl->buf_magnification = XINT (vp->contents[CCL_HEADER_BUF_MAG]);
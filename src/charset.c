@@ -63,8 +63,9 @@ Lisp_Object Vcharset_hash_table;
 /* Table of struct charset.  */
 struct charset *charset_table;
 
-static ptrdiff_t charset_table_size;
-static int charset_table_used;
+/* Allocated and used number of its entries.  */
+ptrdiff_t charset_table_size;
+int charset_table_used;
 
 Lisp_Object Qcharsetp;
 
@@ -2357,6 +2358,9 @@ syms_of_charset (void)
   staticpro (&Vcharset_ordered_list);
   Vcharset_ordered_list = Qnil;
 
+  staticpro (&Vcharset_non_preferred_head);
+  Vcharset_non_preferred_head = Qnil;
+
   staticpro (&Viso_2022_charset_list);
   Viso_2022_charset_list = Qnil;
 
@@ -2438,6 +2442,24 @@ the value may be a list of mnemonics.  */);
 			       128, 255, -1, 0, -1, 0, 1,
 			       MAX_5_BYTE_CHAR + 1);
   charset_unibyte = charset_iso_8859_1;
+
+  /* The portable dumper saves charset_table itself.  */
+  pdumper_remember_scalar (&charset_ascii, sizeof charset_ascii);
+  pdumper_remember_scalar (&charset_eight_bit, sizeof charset_eight_bit);
+  pdumper_remember_scalar (&charset_iso_8859_1, sizeof charset_iso_8859_1);
+  pdumper_remember_scalar (&charset_unicode, sizeof charset_unicode);
+  pdumper_remember_scalar (&charset_emacs, sizeof charset_emacs);
+  pdumper_remember_scalar (&charset_jisx0201_roman,
+			   sizeof charset_jisx0201_roman);
+  pdumper_remember_scalar (&charset_jisx0208_1978,
+			   sizeof charset_jisx0208_1978);
+  pdumper_remember_scalar (&charset_jisx0208, sizeof charset_jisx0208);
+  pdumper_remember_scalar (&charset_ksc5601, sizeof charset_ksc5601);
+  pdumper_remember_scalar (&charset_unibyte, sizeof charset_unibyte);
+  pdumper_remember_scalar (&charset_ordered_list_tick,
+			   sizeof charset_ordered_list_tick);
+  pdumper_remember_scalar (emacs_mule_charset, sizeof emacs_mule_charset);
+  pdumper_remember_scalar (iso_charset_table, sizeof iso_charset_table);
 }
 
 #endif /* emacs */
@@ -93,11 +93,13 @@ CHECK_CHAR_TABLE (Lisp_Object x)
 static void
 set_char_table_ascii (Lisp_Object table, Lisp_Object val)
 {
+  note_vector_store (XVECTOR (table), val);
   XCHAR_TABLE (table)->ascii = val;
 }
 static void
 set_char_table_parent (Lisp_Object table, Lisp_Object val)
 {
+  note_vector_store (XVECTOR (table), val);
   XCHAR_TABLE (table)->parent = val;
 }
 
@@ -8021,6 +8021,70 @@ decode_coding_gap (struct coding_system *coding,
 }
 
 
+/* Return true if CODING might decode some text, as one block of a
+   longer stream, into exactly the same bytes; see
+   decode_coding_as_is.  */
+
+bool
+coding_may_decode_as_is (struct coding_system *coding)
+{
+  Lisp_Object attrs = CODING_ID_ATTRS (coding->id);
+
+  return (! disable_ascii_optimization
+	  && ! CODING_REQUIRE_DETECTION (coding)
+	  && ! (coding->mode & CODING_MODE_LAST_BLOCK)
+	  && ! NILP (CODING_ATTR_ASCII_COMPAT (attrs))
+	  && NILP (CODING_ATTR_POST_READ (attrs))
+	  && NILP (get_translation_table (attrs, 0, NULL))
+	  && SYMBOLP (CODING_ID_EOL_TYPE (coding->id)));
+}
+
+/* If decoding the NBYTES bytes at SRC by CODING, as one block of a
+   longer stream, would produce exactly those bytes in a multibyte
+   buffer, return the number of characters they hold.  Otherwise,
+   return -1.  This is the case for ASCII text, and for complete UTF-8
+   sequences if CODING is UTF-8 without a signature, as long as no
+   end-of-line conversion applies.  */
+
+ptrdiff_t
+decode_coding_as_is (struct coding_system *coding,
+		     const unsigned char *src, ptrdiff_t nbytes)
+{
+  Lisp_Object eol_type;
+  ptrdiff_t chars;
+
+  if (nbytes <= 0 || ! coding_may_decode_as_is (coding))
+    return -1;
+
+  coding->src_object = Qnil;
+  coding->source = src;
+  coding->src_bytes = nbytes;
+  coding->src_pos = coding->src_pos_byte = 0;
+  coding->head_ascii = -1;
+  coding->eol_seen = EOL_SEEN_NONE;
+  chars = check_ascii (coding);
+  if (chars != nbytes)
+    {
+      Lisp_Object attrs = CODING_ID_ATTRS (coding->id);
+
+      if (EQ (CODING_ATTR_TYPE (attrs), Qutf_8)
+	  && CODING_UTF_8_BOM (coding) == utf_without_bom)
+	chars = check_utf_8 (coding);
+      else
+	chars = -1;
+    }
+
+  eol_type = CODING_ID_EOL_TYPE (coding->id);
+  if (chars >= 0 && ! inhibit_eol_conversion && ! EQ (eol_type, Qunix)
+      && memchr (src, '\r', nbytes))
+    chars = -1;
+
+  coding->head_ascii = -1;
+  coding->eol_seen = EOL_SEEN_NONE;
+  return chars;
+}
+
+
 /* Decode the text in the range FROM/FROM_BYTE and TO/TO_BYTE in
    SRC_OBJECT into DST_OBJECT by coding context CODING.
 
@@ -10817,6 +10881,23 @@ init_coding_once (void)
 
 #ifdef emacs
 
+/* Set up the coding systems of the coding categories again after
+   loading a portable dump, which saved only their raw contents.  */
+
+static void
+reset_coding_after_pdumper_load (void)
+{
+  int i;
+
+  for (i = 0; i < coding_category_max; i++)
+    {
+      int id = coding_categories[i].id;
+
+      if (id >= 0)
+	setup_coding_system (CODING_ID_NAME (id), &coding_categories[i]);
+    }
+}
+
 void
 syms_of_coding (void)
 {
@@ -11371,6 +11452,11 @@ character.");
   system_eol_type = Qunix;
 #endif
   staticpro (&system_eol_type);
+
+  pdumper_remember_scalar (coding_priorities, sizeof coding_priorities);
+  pdumper_remember_scalar (coding_categories, sizeof coding_categories);
+  pdumper_remember_scalar (emacs_mule_bytes, sizeof emacs_mule_bytes);
+  pdumper_do_after_load (reset_coding_after_pdumper_load);
 }
 
 char *
@@ -710,6 +710,9 @@ extern Lisp_Object complement_process_encoding_system (Lisp_Object);
 
 extern void decode_coding_gap (struct coding_system *,
 			       ptrdiff_t, ptrdiff_t);
+extern bool coding_may_decode_as_is (struct coding_system *);
+extern ptrdiff_t decode_coding_as_is (struct coding_system *,
+				      const unsigned char *, ptrdiff_t);
 extern void decode_coding_object (struct coding_system *,
                                   Lisp_Object, ptrdiff_t, ptrdiff_t,
                                   ptrdiff_t, ptrdiff_t, Lisp_Object);
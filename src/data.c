@@ -80,7 +80,7 @@ static Lisp_Object Qoverlay, Qwindow_configuration;
 static Lisp_Object Qprocess, Qmarker;
 static Lisp_Object Qcompiled_function, Qframe;
 Lisp_Object Qbuffer;
-static Lisp_Object Qchar_table, Qbool_vector, Qhash_table;
+static Lisp_Object Qchar_table, Qbool_vector, Qhash_table, Qobarray;
 static Lisp_Object Qsubrp;
 static Lisp_Object Qmany, Qunevalled;
 Lisp_Object Qfont_spec, Qfont_entity, Qfont_object;
@@ -297,6 +297,8 @@ for example, (type-of 1) returns `integer'.  */)
 	return Qframe;
       if (HASH_TABLE_P (object))
 	return Qhash_table;
+      if (OBARRAYP (object))
+	return Qobarray;
       if (FONT_SPEC_P (object))
 	return Qfont_spec;
       if (FONT_ENTITY_P (object))
@@ -1179,7 +1181,7 @@ swap_in_symval_forwarding (struct Lisp_Symbol *symbol, struct Lisp_Buffer_Local_
 	  }
 	else
 	  {
-	    tem1 = assq_no_quit (var, BVAR (current_buffer, local_var_alist));
+	    tem1 = buffer_local_binding (current_buffer, var);
 	    set_blv_where (blv, Fcurrent_buffer ());
 	  }
       }
@@ -1314,10 +1316,9 @@ set_internal (Lisp_Object symbol, Lisp_Object newval, Lisp_Object where,
 
 	    /* Find the new binding.  */
 	    XSETSYMBOL (symbol, sym); /* May have changed via aliasing.  */
-	    tem1 = assq_no_quit (symbol,
-				 (blv->frame_local
-				  ? XFRAME (where)->param_alist
-				  : BVAR (XBUFFER (where), local_var_alist)));
+	    tem1 = (blv->frame_local
+		    ? assq_no_quit (symbol, XFRAME (where)->param_alist)
+		    : buffer_local_binding (XBUFFER (where), symbol));
 	    set_blv_where (blv, where);
 	    blv->found = 1;
 
@@ -1970,23 +1971,18 @@ BUFFER defaults to the current buffer.  */)
     case SYMBOL_PLAINVAL: return Qnil;
     case SYMBOL_LOCALIZED:
       {
-	Lisp_Object tail, elt, tmp;
+	Lisp_Object tmp;
 	struct Lisp_Buffer_Local_Value *blv = SYMBOL_BLV (sym);
 	XSETBUFFER (tmp, buf);
 	XSETSYMBOL (variable, sym); /* Update in case of aliasing.  */
 
 	if (EQ (blv->where, tmp)) /* The binding is already loaded.  */
 	  return blv_found (blv) ? Qt : Qnil;
-	else
-	  for (tail = BVAR (buf, local_var_alist); CONSP (tail); tail = XCDR (tail))
-	    {
-	      elt = XCAR (tail);
-	      if (EQ (variable, XCAR (elt)))
-		{
-		  eassert (!blv->frame_local);
-		  return Qt;
-		}
-	    }
+	else if (!NILP (buffer_local_binding (buf, variable)))
+	  {
+	    eassert (!blv->frame_local);
+	    return Qt;
+	  }
 	return Qnil;
       }
     case SYMBOL_FORWARDED:
@@ -2337,6 +2333,10 @@ arithcompare (Lisp_Object num1, Lisp_Object num2, enum Arith_Comparison comparis
 {
   double f1 = 0, f2 = 0;
   bool floatp = 0;
+  Lisp_Object result;
+
+  if (arithcompare2 (num1, num2, comparison, &result))
+    return result;
 
   CHECK_NUMBER_OR_FLOAT_COERCE_MARKER (num1);
   CHECK_NUMBER_OR_FLOAT_COERCE_MARKER (num2);
@@ -2794,6 +2794,9 @@ DEFUN ("+", Fplus, Splus, 0, MANY, 0,
 usage: (+ &rest NUMBERS-OR-MARKERS)  */)
   (ptrdiff_t nargs, Lisp_Object *args)
 {
+  Lisp_Object result;
+  if (nargs == 2 && arith_add2 (args[0], args[1], &result))
+    return result;
   return arith_driver (Aadd, nargs, args);
 }
 
@@ -2804,6 +2807,9 @@ subtracts all but the first from the first.
 usage: (- &optional NUMBER-OR-MARKER &rest MORE-NUMBERS-OR-MARKERS)  */)
   (ptrdiff_t nargs, Lisp_Object *args)
 {
+  Lisp_Object result;
+  if (nargs == 2 && arith_sub2 (args[0], args[1], &result))
+    return result;
   return arith_driver (Asub, nargs, args);
 }
 
@@ -2812,6 +2818,9 @@ DEFUN ("*", Ftimes, Stimes, 0, MANY, 0,
 usage: (* &rest NUMBERS-OR-MARKERS)  */)
   (ptrdiff_t nargs, Lisp_Object *args)
 {
+  Lisp_Object result;
+  if (nargs == 2 && arith_mul2 (args[0], args[1], &result))
+    return result;
   return arith_driver (Amult, nargs, args);
 }
 
@@ -2822,6 +2831,9 @@ usage: (/ DIVIDEND &rest DIVISORS)  */)
   (ptrdiff_t nargs, Lisp_Object *args)
 {
   ptrdiff_t argnum;
+  Lisp_Object result;
+  if (nargs == 2 && arith_div2 (args[0], args[1], &result))
+    return result;
   for (argnum = 2; argnum < nargs; argnum++)
     if (FLOATP (args[argnum]))
       return float_arith_driver (0, 0, Adiv, nargs, args);
@@ -3605,6 +3617,7 @@ syms_of_data (void)
   DEFSYM (Qchar_table, "char-table");
   DEFSYM (Qbool_vector, "bool-vector");
   DEFSYM (Qhash_table, "hash-table");
+  DEFSYM (Qobarray, "obarray");
   DEFSYM (Qmisc, "misc");
 
   DEFSYM (Qdefun, "defun");
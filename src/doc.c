@@ -25,8 +25,12 @@ along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.  */
 #include <sys/file.h>	/* Must be after sys/types.h for USG.  */
 #include <fcntl.h>
 #include <unistd.h>
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#endif
 
 #include <c-ctype.h>
+#include <stat-time.h>
 
 #include "lisp.h"
 #include "character.h"
@@ -42,6 +46,128 @@ static ptrdiff_t get_doc_string_buffer_size;
 
 static unsigned char *read_bytecode_pointer;
 
+/* The standard DOC file.  get_doc_string and Snarf-documentation keep
+   it open and in memory from one call to the next, so that fetching
+   many doc strings in a row reads the file only once.  */
+static struct
+{
+  /* The name the file was opened under, or NULL if none is open.  */
+  char *name;
+  int fd;
+  /* The size and modification time of the file when it was read.  */
+  ptrdiff_t size;
+  struct timespec mtime;
+  /* The contents of the file, mapped if MAPPED, else malloced.  */
+  char *data;
+  bool mapped;
+} doc_file;
+
+/* Read SIZE bytes from the file open on FD into a new malloced buffer,
+   and add a null byte.  Return the buffer, or NULL if the file could not
+   be read; in that case errno says why.  */
+
+static char *
+read_whole_file (int fd, ptrdiff_t size)
+{
+  char *buf = xmalloc (size + 1);
+  ptrdiff_t nread;
+
+  for (nread = 0; nread < size; )
+    {
+      ptrdiff_t n = emacs_read (fd, buf + nread, size - nread);
+      if (n <= 0)
+	{
+	  int read_errno = n == 0 ? EIO : errno;
+	  xfree (buf);
+	  errno = read_errno;
+	  return NULL;
+	}
+      nread += n;
+    }
+  buf[size] = 0;
+  return buf;
+}
+
+/* Forget the DOC file in doc_file, closing it.  */
+
+static void
+release_doc_file (void)
+{
+  if (!doc_file.name)
+    return;
+#ifdef HAVE_MMAP
+  if (doc_file.mapped)
+    munmap (doc_file.data, doc_file.size);
+  else
+#endif
+    xfree (doc_file.data);
+  emacs_close (doc_file.fd);
+  xfree (doc_file.name);
+  doc_file.name = NULL;
+}
+
+/* Make doc_file describe the DOC file named NAME.  Reuse the copy that
+   is already in memory if it has the same name and the file has not
+   changed since it was read.  Return false, with errno set, if NAME
+   cannot be opened or read.  */
+
+static bool
+open_doc_file (char const *name)
+{
+  struct stat st;
+  int fd, open_errno;
+  char *data;
+  bool mapped = false;
+
+  if (doc_file.name && !strcmp (doc_file.name, name))
+    {
+      if (fstat (doc_file.fd, &st) == 0 && st.st_size == doc_file.size
+	  && timespec_cmp (get_stat_mtime (&st), doc_file.mtime) == 0)
+	return true;
+    }
+  release_doc_file ();
+
+  fd = emacs_open (name, O_RDONLY, 0);
+  if (fd < 0)
+    return false;
+  if (fstat (fd, &st) != 0)
+    goto fail;
+  if (min (PTRDIFF_MAX - 1, SIZE_MAX - 1) < st.st_size)
+    {
+      errno = EOVERFLOW;
+      goto fail;
+    }
+
+  data = NULL;
+#ifdef HAVE_MMAP
+  if (st.st_size != 0)
+    {
+      data = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      mapped = data != MAP_FAILED;
+      if (!mapped)
+	data = NULL;
+    }
+#endif
+  if (!data)
+    data = read_whole_file (fd, st.st_size);
+  if (!data)
+    goto fail;
+
+  doc_file.name = xstrdup (name);
+  doc_file.fd = fd;
+  doc_file.size = st.st_size;
+  doc_file.mtime = get_stat_mtime (&st);
+  doc_file.data = data;
+  doc_file.mapped = mapped;
+  return true;
+
+ fail:
+  open_errno = errno;
+  emacs_close (fd);
+  errno = open_errno;
+  return false;
+}
+
 /* `readchar' in lread.c calls back here to fetch the next byte.
    If UNREADFLAG is 1, we unread a byte.  */
 
@@ -129,6 +255,64 @@ get_doc_string (Lisp_Object filepos, bool unibyte, bool definition)
       name = SSDATA (file);
     }
 
+  if (INTEGERP (filepos))
+    {
+      char *start, *end, *q;
+
+      if (!open_doc_file (name))
+	{
+#ifndef CANNOT_DUMP
+	  if (!NILP (Vpurify_flag))
+	    {
+	      /* Preparing to dump; DOC file is probably not installed.
+		 So check in ../etc.  */
+	      strcpy (name, "../etc/");
+	      strcat (name, SSDATA (file));
+	      if (open_doc_file (name))
+		goto opened;
+	    }
+#endif
+	  SAFE_FREE ();
+	  AUTO_STRING (cannot_open, "Cannot open doc string file \"");
+	  AUTO_STRING (quote_nl, "\"\n");
+	  return concat3 (cannot_open, file, quote_nl);
+	}
+    opened:
+      if (doc_file.size < position)
+	error ("Position %"pI"d out of range in doc string file \"%s\"",
+	       position, name);
+      SAFE_FREE ();
+
+      /* Sanity checking.  The doc string must come right after the
+	 line that holds ^_, F or V, and the name.  */
+      start = doc_file.data + position;
+      if (position == 0 || start[-1] != '\n')
+	return Qnil;
+      for (q = start - 2; doc_file.data < q && *q > ' '; q--)
+	continue;
+      if (*q != '\037')
+	return Qnil;
+
+      /* Copy the doc string into get_doc_string_buffer, so that the
+	 quoting can be undone in place below.  Grow the buffer by at
+	 least 16k, as the loop below does: that loop expects the first
+	 block it reads from a file to fit.  */
+      end = memchr (start, '\037', doc_file.size - position);
+      if (!end)
+	end = doc_file.data + doc_file.size;
+      if (get_doc_string_buffer_size <= end - start)
+	get_doc_string_buffer
+	  = xpalloc (get_doc_string_buffer, &get_doc_string_buffer_size,
+		     max (16 * 1024,
+			  end - start + 1 - get_doc_string_buffer_size),
+		     -1, 1);
+      memcpy (get_doc_string_buffer, start, end - start);
+      p = get_doc_string_buffer + (end - start);
+      *p = 0;
+      offset = 0;
+      goto unquote;
+    }
+
   fd = emacs_open (name, O_RDONLY, 0);
   if (fd < 0)
     {
@@ -211,35 +395,25 @@ get_doc_string (Lisp_Object filepos, bool unibyte, bool definition)
   SAFE_FREE ();
 
   /* Sanity checking.  */
-  if (CONSP (filepos))
-    {
-      int test = 1;
-      /* A dynamic docstring should be either at the very beginning of a "#@
-	 comment" or right after a dynamic docstring delimiter (in case we
-	 pack several such docstrings within the same comment).  */
-      if (get_doc_string_buffer[offset - test] != '\037')
-	{
-	  if (get_doc_string_buffer[offset - test++] != ' ')
-	    return Qnil;
-	  while (get_doc_string_buffer[offset - test] >= '0'
-		 && get_doc_string_buffer[offset - test] <= '9')
-	    test++;
-	  if (get_doc_string_buffer[offset - test++] != '@'
-	      || get_doc_string_buffer[offset - test] != '#')
-	    return Qnil;
-	}
-    }
-  else
-    {
-      int test = 1;
-      if (get_doc_string_buffer[offset - test++] != '\n')
-	return Qnil;
-      while (get_doc_string_buffer[offset - test] > ' ')
-	test++;
-      if (get_doc_string_buffer[offset - test] != '\037')
-	return Qnil;
-    }
-
+  {
+    int test = 1;
+    /* A dynamic docstring should be either at the very beginning of a "#@
+       comment" or right after a dynamic docstring delimiter (in case we
+       pack several such docstrings within the same comment).  */
+    if (get_doc_string_buffer[offset - test] != '\037')
+      {
+	if (get_doc_string_buffer[offset - test++] != ' ')
+	  return Qnil;
+	while (get_doc_string_buffer[offset - test] >= '0'
+	       && get_doc_string_buffer[offset - test] <= '9')
+	  test++;
+	if (get_doc_string_buffer[offset - test++] != '@'
+	    || get_doc_string_buffer[offset - test] != '#')
+	  return Qnil;
+      }
+  }
+
+ unquote:
   /* Scan the text and perform quoting with ^A (char code 1).
      ^A^A becomes ^A, ^A0 becomes a null char, and ^A_ becomes a ^_.  */
   from = get_doc_string_buffer + offset;
@@ -543,6 +717,155 @@ store_function_docstring (Lisp_Object obj, ptrdiff_t offset)
 }
 
 
+/* Record an entry of the DOC file: a function or variable doc string
+   at position POS, or a source file boundary, according to TYPE, which
+   is 'F', 'V' or 'S'.  NAME, of NAMELEN bytes, is the name of the
+   function, variable or source file.  POS is negative for a variable
+   whose doc string starts with `*'.  *SKIP_FILE says whether the
+   entries come from a source file that is not part of this Emacs.  */
+
+static void
+snarf_entry (char type, char const *name, ptrdiff_t namelen, EMACS_INT pos,
+	     bool *skip_file, Lisp_Object delayed_init)
+{
+  Lisp_Object sym;
+
+  /* See if this is a file name, and if it is a file in build-files.  */
+  if (type == 'S')
+    {
+      *skip_file = 0;
+      if (namelen > 2 && name[namelen - 2] == '.'
+	  && (name[namelen - 1] == 'o' || name[namelen - 1] == 'c'))
+	{
+	  USE_SAFE_ALLOCA;
+	  char *fromfile = SAFE_ALLOCA (namelen + 1);
+	  memcpy (fromfile, name, namelen);
+	  fromfile[namelen] = 0;
+	  if (fromfile[namelen - 1] == 'c')
+	    fromfile[namelen - 1] = 'o';
+
+	  *skip_file = NILP (Fmember (build_string (fromfile),
+				      Vbuild_files));
+	  SAFE_FREE ();
+	}
+      /* Otherwise it is just a source file name boundary marker.  */
+      return;
+    }
+
+  /* Check skip_file so that when a function is defined several
+     times in different files (typically, once in xterm, once in
+     w32term, ...), we only pay attention to the one that
+     matters.  */
+  if (*skip_file)
+    return;
+  sym = oblookup (Vobarray, name,
+		  multibyte_chars_in_text ((unsigned char *) name, namelen),
+		  namelen);
+  if (!SYMBOLP (sym))
+    return;
+
+  /* Attach a docstring to a variable?  */
+  if (type == 'V')
+    {
+      /* Install file-position as variable-documentation property.  */
+      if (!NILP (Fboundp (sym))
+	  || !NILP (Fmemq (sym, delayed_init)))
+	Fput (sym, Qvariable_documentation, make_number (pos));
+    }
+
+  /* Attach a docstring to a function?  */
+  else if (type == 'F')
+    {
+      if (!NILP (Ffboundp (sym)))
+	store_function_docstring (sym, pos);
+    }
+
+  else
+    error ("DOC file invalid at position %"pI"d", eabs (pos));
+}
+
+/* Parse the decimal integer, possibly negative, at *P, and advance *P
+   past it.  Return false if there is no integer at *P, or if it does
+   not fit in a fixnum.  */
+
+static bool
+parse_index_number (char **p, EMACS_INT *n)
+{
+  char *q = *p;
+  bool negative = *q == '-';
+  EMACS_INT value = 0;
+
+  q += negative;
+  if (! ('0' <= *q && *q <= '9'))
+    return false;
+  for (; '0' <= *q && *q <= '9'; q++)
+    {
+      if ((MOST_POSITIVE_FIXNUM - (*q - '0')) / 10 < value)
+	return false;
+      value = 10 * value + (*q - '0');
+    }
+  *n = negative ? - value : value;
+  *p = q;
+  return true;
+}
+
+/* Record the doc string positions listed in the index of the DOC file
+   in doc_file, which is the file INDEX_NAME; see make-docfile.c for the
+   format of the index.  Return false if there is no such index or it
+   does not match the DOC file; the caller must then scan the DOC file
+   itself.  */
+
+static bool
+snarf_doc_index (char const *index_name, Lisp_Object delayed_init)
+{
+  struct stat st;
+  int fd;
+  char *buf, *p, *end, *eol;
+  EMACS_INT size, pos;
+  bool skip_file = 0, ok = false;
+  ptrdiff_t count = SPECPDL_INDEX ();
+
+  fd = emacs_open (index_name, O_RDONLY, 0);
+  if (fd < 0)
+    return false;
+  record_unwind_protect_int (close_file_unwind, fd);
+  if (fstat (fd, &st) != 0
+      || min (PTRDIFF_MAX - 1, SIZE_MAX - 1) < st.st_size
+      /* An index older than the DOC file is out of date.  */
+      || timespec_cmp (get_stat_mtime (&st), doc_file.mtime) < 0)
+    goto done;
+  buf = read_whole_file (fd, st.st_size);
+  if (!buf)
+    goto done;
+  record_unwind_protect_ptr (xfree, buf);
+
+  /* The index starts with the size of the DOC file it indexes.  */
+  p = buf;
+  end = buf + st.st_size;
+  if (! (parse_index_number (&p, &size) && *p == '\n'
+	 && size == doc_file.size))
+    goto done;
+
+  for (p++; p < end; p = eol + 1)
+    {
+      char type = *p++;
+      eol = memchr (p, '\n', end - p);
+      if (!eol)
+	goto done;
+      pos = 0;
+      if (type != 'S'
+	  && ! (parse_index_number (&p, &pos) && *p++ == ' '
+		&& eabs (pos) <= doc_file.size))
+	goto done;
+      snarf_entry (type, p, eol - p, pos, &skip_file, delayed_init);
+    }
+  ok = true;
+
+ done:
+  unbind_to (count, Qnil);
+  return ok;
+}
+
 DEFUN ("Snarf-documentation", Fsnarf_documentation, Ssnarf_documentation,
        1, 1, 0,
        doc: /* Used during Emacs initialization to scan the `etc/DOC...' file.
@@ -551,17 +874,14 @@ records them in function and variable definitions.
 The function takes one argument, FILENAME, a string;
 it specifies the file name (without a directory) of the DOC file.
 That file is found in `../etc' now; later, when the dumped Emacs is run,
-the same file name is found in the `doc-directory'.  */)
+the same file name is found in the `doc-directory'.
+If the index of the DOC file that make-docfile writes, FILENAME.idx,
+is in the same directory and up to date, this reads the positions of
+the doc strings from the index instead of scanning the whole file.  */)
   (Lisp_Object filename)
 {
-  int fd;
-  char buf[1024 + 1];
-  int filled;
-  EMACS_INT pos;
-  Lisp_Object sym;
-  char *p, *name;
+  char *p, *end, *eol, *name;
   bool skip_file = 0;
-  ptrdiff_t count;
   char const *dirname;
   ptrdiff_t dirlen;
   /* Preloaded defcustoms using custom-initialize-delay are added to
@@ -591,9 +911,8 @@ the same file name is found in the `doc-directory'.  */)
       dirlen = SBYTES (Vdoc_directory);
     }
 
-  count = SPECPDL_INDEX ();
   USE_SAFE_ALLOCA;
-  name = SAFE_ALLOCA (dirlen + SBYTES (filename) + 1);
+  name = SAFE_ALLOCA (dirlen + SBYTES (filename) + sizeof ".idx");
   strcpy (name, dirname);
   strcat (name, SSDATA (filename)); 	/*** Add this line ***/
 
@@ -610,97 +929,41 @@ the same file name is found in the `doc-directory'.  */)
       Vbuild_files = Fpurecopy (Vbuild_files);
     }
 
-  fd = emacs_open (name, O_RDONLY, 0);
-  if (fd < 0)
+  /* Read the file afresh, in case it has been replaced since
+     get_doc_string last looked at it.  */
+  release_doc_file ();
+  if (!open_doc_file (name))
     {
       int open_errno = errno;
       report_file_errno ("Opening doc string file", build_string (name),
 			 open_errno);
     }
-  record_unwind_protect_int (close_file_unwind, fd);
   Vdoc_file_name = filename;
-  filled = 0;
-  pos = 0;
-  while (1)
-    {
-      register char *end;
-      if (filled < 512)
-	filled += emacs_read (fd, &buf[filled], sizeof buf - 1 - filled);
-      if (!filled)
-	break;
 
-      buf[filled] = 0;
-      end = buf + (filled < 512 ? filled : filled - 128);
-      p = memchr (buf, '\037', end - buf);
-      /* p points to ^_Ffunctionname\n or ^_Vvarname\n or ^_Sfilename\n.  */
-      if (p)
-	{
-	  end = strchr (p, '\n');
-
-          /* See if this is a file name, and if it is a file in build-files.  */
-          if (p[1] == 'S')
-            {
-              skip_file = 0;
-              if (end - p > 4 && end[-2] == '.'
-                  && (end[-1] == 'o' || end[-1] == 'c'))
-                {
-                  ptrdiff_t len = end - p - 2;
-                  char *fromfile = SAFE_ALLOCA (len + 1);
-                  memcpy (fromfile, &p[2], len);
-                  fromfile[len] = 0;
-                  if (fromfile[len-1] == 'c')
-                    fromfile[len-1] = 'o';
-
-                  skip_file = NILP (Fmember (build_string (fromfile),
-                                             Vbuild_files));
-                }
-            }
-
-	  sym = oblookup (Vobarray, p + 2,
-			  multibyte_chars_in_text ((unsigned char *) p + 2,
-						   end - p - 2),
-			  end - p - 2);
-	  /* Check skip_file so that when a function is defined several
-	     times in different files (typically, once in xterm, once in
-	     w32term, ...), we only pay attention to the one that
-	     matters.  */
-	  if (! skip_file && SYMBOLP (sym))
-	    {
-	      /* Attach a docstring to a variable?  */
-	      if (p[1] == 'V')
-		{
-		  /* Install file-position as variable-documentation property
-		     and make it negative for a user-variable
-		     (doc starts with a `*').  */
-                  if (!NILP (Fboundp (sym))
-                      || !NILP (Fmemq (sym, delayed_init)))
-                    Fput (sym, Qvariable_documentation,
-                          make_number ((pos + end + 1 - buf)
-                                       * (end[1] == '*' ? -1 : 1)));
-		}
-
-	      /* Attach a docstring to a function?  */
-	      else if (p[1] == 'F')
-                {
-                  if (!NILP (Ffboundp (sym)))
-                    store_function_docstring (sym, pos + end + 1 - buf);
-                }
-	      else if (p[1] == 'S')
-		; /* Just a source file name boundary marker.  Ignore it.  */
-
-	      else
-		error ("DOC file invalid at position %"pI"d", pos);
-	    }
-	}
-      pos += end - buf;
-      filled -= end - buf;
-      memmove (buf, end, filled);
-    }
+  strcat (name, ".idx");
+  if (!snarf_doc_index (name, delayed_init))
+    for (p = doc_file.data, end = p + doc_file.size;
+	 (p = memchr (p, '\037', end - p));
+	 p = eol)
+      {
+	/* P points to ^_Ffunctionname\n or ^_Vvarname\n or ^_Sfilename\n.
+	   The doc string starts after the newline; make its position
+	   negative for a user variable (doc starts with a `*').  */
+	EMACS_INT pos;
+	eol = memchr (p, '\n', end - p);
+	if (!eol || eol - p < 2)
+	  error ("DOC file invalid at position %"pI"d",
+		 (EMACS_INT) (p - doc_file.data));
+	pos = eol + 1 - doc_file.data;
+	if (p[1] == 'V' && eol + 1 < end && eol[1] == '*')
+	  pos = -pos;
+	snarf_entry (p[1], p + 2, eol - p - 2, pos, &skip_file, delayed_init);
+      }
 
   SAFE_FREE ();
-  return unbind_to (count, Qnil);
+  return Qnil;
 }
-
+
 DEFUN ("substitute-command-keys", Fsubstitute_command_keys,
        Ssubstitute_command_keys, 1, 1, 0,
        doc: /* Substitute key descriptions for command names in STRING.
@@ -982,3 +1245,13 @@ syms_of_doc (void)
   defsubr (&Ssnarf_documentation);
   defsubr (&Ssubstitute_command_keys);
 }
+
+/* Forget any DOC file that get_doc_string or Snarf-documentation
+   left open; when Emacs starts from a dump, it belongs to the
+   process that made the dump.  */
+
+void
+init_doc (void)
+{
+  doc_file.name = NULL;
+}
@@ -326,48 +326,18 @@ If you set the marker not to point anywhere, the buffer will have no mark.  */)
 static ptrdiff_t
 overlays_around (EMACS_INT pos, Lisp_Object *vec, ptrdiff_t len)
 {
-  Lisp_Object overlay, start, end;
-  struct Lisp_Overlay *tail;
-  ptrdiff_t startpos, endpos;
+  struct itree_iterator iter;
+  struct itree_node *node;
   ptrdiff_t idx = 0;
 
-  for (tail = current_buffer->overlays_before; tail; tail = tail->next)
+  itree_iterator_start (&iter, current_buffer->overlays, pos, pos, true);
+  while ((node = itree_iterator_next (&iter)))
     {
-      XSETMISC (overlay, tail);
-
-      end = OVERLAY_END (overlay);
-      endpos = OVERLAY_POSITION (end);
-      if (endpos < pos)
-	  break;
-      start = OVERLAY_START (overlay);
-      startpos = OVERLAY_POSITION (start);
-      if (startpos <= pos)
-	{
-	  if (idx < len)
-	    vec[idx] = overlay;
-	  /* Keep counting overlays even if we can't return them all.  */
-	  idx++;
-	}
-    }
-
-  for (tail = current_buffer->overlays_after; tail; tail = tail->next)
-    {
-      XSETMISC (overlay, tail);
-
-      start = OVERLAY_START (overlay);
-      startpos = OVERLAY_POSITION (start);
-      if (pos < startpos)
-	break;
-      end = OVERLAY_END (overlay);
-      endpos = OVERLAY_POSITION (end);
-      if (pos <= endpos)
-	{
-	  if (idx < len)
-	    vec[idx] = overlay;
-	  idx++;
-	}
+      if (idx < len)
+	vec[idx] = node->data;
+      /* Keep counting overlays even if we can't return them all.  */
+      idx++;
     }
-
   return idx;
 }
 
@@ -428,11 +398,10 @@ at POSITION.  */)
 	  if (!NILP (tem))
 	    {
 	      /* Check the overlay is indeed active at point.  */
-	      Lisp_Object start = OVERLAY_START (ol), finish = OVERLAY_END (ol);
-	      if ((OVERLAY_POSITION (start) == posn
-		   && XMARKER (start)->insertion_type == 1)
-		  || (OVERLAY_POSITION (finish) == posn
-		      && XMARKER (finish)->insertion_type == 0))
+	      if ((OVERLAY_START (ol) == posn
+		   && OVERLAY_FRONT_ADVANCE_P (ol))
+		  || (OVERLAY_END (ol) == posn
+		      && !OVERLAY_REAR_ADVANCE_P (ol)))
 		; /* The overlay will not cover a char inserted at point.  */
 	      else
 		{
@@ -4598,6 +4567,9 @@ Transposing beyond buffer boundaries is an error.  */)
     {
       modify_text (start1, end2);
       record_change (start1, len1 + len2);
+      /* Character and byte positions no longer correspond the same
+         way between the regions.  */
+      adjust_charpos_index (start1_byte, end2_byte, 0, 0);
 
       tmp_interval1 = copy_intervals (cur_intv, start1, len1);
       tmp_interval2 = copy_intervals (cur_intv, start2, len2);
@@ -4657,6 +4629,7 @@ Transposing beyond buffer boundaries is an error.  */)
           modify_text (start2, end2);
           record_change (start1, len1);
           record_change (start2, len2);
+          adjust_charpos_index (start1_byte, end2_byte, 0, 0);
           tmp_interval1 = copy_intervals (cur_intv, start1, len1);
           tmp_interval2 = copy_intervals (cur_intv, start2, len2);
 
@@ -4689,6 +4662,7 @@ Transposing beyond buffer boundaries is an error.  */)
 
           modify_text (start1, end2);
           record_change (start1, (end2 - start1));
+          adjust_charpos_index (start1_byte, end2_byte, 0, 0);
           tmp_interval1 = copy_intervals (cur_intv, start1, len1);
           tmp_interval_mid = copy_intervals (cur_intv, end1, len_mid);
           tmp_interval2 = copy_intervals (cur_intv, start2, len2);
@@ -4721,6 +4695,7 @@ Transposing beyond buffer boundaries is an error.  */)
 
           record_change (start1, (end2 - start1));
           modify_text (start1, end2);
+          adjust_charpos_index (start1_byte, end2_byte, 0, 0);
 
           tmp_interval1 = copy_intervals (cur_intv, start1, len1);
           tmp_interval_mid = copy_intervals (cur_intv, end1, len_mid);
@@ -4760,7 +4735,7 @@ Transposing beyond buffer boundaries is an error.  */)
       transpose_markers (start1, end1, start2, end2,
 			 start1_byte, start1_byte + len1_byte,
 			 start2_byte, start2_byte + len2_byte);
-      fix_start_end_in_overlays (start1, end2);
+      transpose_overlays (start1, end1, start2, end2);
     }
 
   signal_after_change (start1, end2 - start1, end2 - start1);
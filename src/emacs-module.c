@@ -0,0 +1,834 @@
+/* emacs-module.c - Module loading and runtime implementation
+
+Copyright (C) 2014 Free Software Foundation, Inc.
+
+This file is part of GNU Emacs.
+
+GNU Emacs is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+GNU Emacs is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.  */
+
+/* A dynamic module sees Emacs only through the function table of an
+   environment, declared in emacs-module.h.  Each call into a module,
+   be it `emacs_module_init' or a function the module defined, gets an
+   environment of its own, which lives on the C stack of the caller
+   and is finalized when the call returns.
+
+   The values an environment hands out are slots holding a
+   Lisp_Object, in frames that belong to the environment; GC marks the
+   frames of all live environments.  A global reference is a slot of
+   its own, kept in the hash table module_global_refs.
+
+   Every environment function that can signal or throw runs under a
+   condition-case for all errors and a CATCHER_ALL for all throws, so
+   that no longjmp ever crosses module code.  A signal or throw caught
+   there becomes the pending non-local exit of the environment, which
+   the caller of the module function re-signals or re-throws once the
+   module has returned.  */
+
+#include <config.h>
+
+#ifdef HAVE_MODULES
+
+#include "emacs-module.h"
+
+#include <dlfcn.h>
+
+#include "lisp.h"
+#include "blockinput.h"
+#include "coding.h"
+#include "keyboard.h"	/* For poll_suppress_count, used by PUSH_HANDLER.  */
+
+static Lisp_Object Qmodule_error, Qmodule_open_failed;
+static Lisp_Object Qmodule_not_gpl_compatible, Qmodule_init_failed;
+static Lisp_Object Qinternal_module_call, Qargs, Qmany;
+
+/* A value, as seen by a module.  */
+struct emacs_value_tag { Lisp_Object v; };
+
+/* Values are allocated in frames of this many.  */
+enum { value_frame_size = 512 };
+
+struct emacs_value_frame
+{
+  struct emacs_value_tag objects[value_frame_size];
+
+  /* The number of slots in use.  */
+  int offset;
+
+  struct emacs_value_frame *next;
+};
+
+struct emacs_env_private
+{
+  enum emacs_funcall_exit pending_non_local_exit;
+
+  /* The error symbol and data of a pending signal, or the tag and
+     value of a pending throw.  */
+  struct emacs_value_tag non_local_exit_symbol, non_local_exit_data;
+
+  /* The frames of values; the first one is allocated along with the
+     environment, the others with xmalloc.  */
+  struct emacs_value_frame initial_frame;
+  struct emacs_value_frame *current_frame;
+
+  /* The next environment out, in the chain of live environments.  */
+  struct emacs_env_private *next;
+};
+
+struct emacs_runtime_private
+{
+  emacs_env *env;
+};
+
+/* The innermost live environment.  Environments nest, since a module
+   function can call Lisp that calls another module function.  */
+static struct emacs_env_private *live_environments;
+
+/* A function defined by a module.  */
+struct module_function
+{
+  ptrdiff_t min_arity, max_arity;
+  emacs_subr subr;
+  void *data;
+};
+
+/* All functions that modules have defined.  A module function is a
+   closure that calls `internal--module-call' with its index in this
+   table, so that no pointer ever leaks into Lisp.  Functions are never
+   freed, since nothing tells when the closure for one is gone.  */
+static struct module_function *module_functions;
+static ptrdiff_t module_functions_used, module_functions_size;
+
+/* A global reference.  */
+struct module_global_ref
+{
+  struct emacs_value_tag value;
+  ptrdiff_t refcount;
+};
+
+/* Maps each object that has global references to a save value
+   pointing to its struct module_global_ref.  The table keeps the
+   objects alive.  */
+static Lisp_Object module_global_refs;
+
+
+/* Values.  */
+
+static Lisp_Object
+value_to_lisp (emacs_value v)
+{
+  return v->v;
+}
+
+/* Return a new value of ENV for O.  */
+
+static emacs_value
+lisp_to_value (emacs_env *env, Lisp_Object o)
+{
+  struct emacs_env_private *p = env->private_members;
+  struct emacs_value_frame *frame = p->current_frame;
+
+  if (frame->offset == value_frame_size)
+    {
+      frame = xmalloc (sizeof *frame);
+      frame->offset = 0;
+      frame->next = NULL;
+      p->current_frame->next = frame;
+      p->current_frame = frame;
+    }
+  frame->objects[frame->offset].v = o;
+  return &frame->objects[frame->offset++];
+}
+
+/* Mark the values of all live environments.  */
+
+void
+mark_modules (void)
+{
+  struct emacs_env_private *p;
+
+  for (p = live_environments; p; p = p->next)
+    {
+      struct emacs_value_frame *frame;
+      int i;
+
+      mark_object (p->non_local_exit_symbol.v);
+      mark_object (p->non_local_exit_data.v);
+      for (frame = &p->initial_frame; frame; frame = frame->next)
+	for (i = 0; i < frame->offset; i++)
+	  mark_object (frame->objects[i].v);
+    }
+}
+
+
+/* Non-local exits.  */
+
+static void
+module_non_local_exit_set (emacs_env *env, enum emacs_funcall_exit exit,
+			   Lisp_Object symbol, Lisp_Object data)
+{
+  struct emacs_env_private *p = env->private_members;
+
+  if (p->pending_non_local_exit == emacs_funcall_exit_return)
+    {
+      p->pending_non_local_exit = exit;
+      p->non_local_exit_symbol.v = symbol;
+      p->non_local_exit_data.v = data;
+    }
+}
+
+/* Pop the innermost handler, and return the value it caught.  */
+
+static Lisp_Object
+module_pop_handler (void)
+{
+  Lisp_Object val = handlerlist->val;
+  handlerlist = handlerlist->next;
+  return val;
+}
+
+/* Begin the body of an environment function of ENV.  If an exit is
+   already pending, return ERROR_RETVAL right away.  Otherwise set up
+   the handlers that turn a signal or a throw out of the body into a
+   pending exit, and return ERROR_RETVAL then.  The body must not
+   return; it must end with MODULE_FUNCTION_END, which removes the
+   handlers.  */
+
+#define MODULE_FUNCTION_BEGIN(error_retval)				\
+  struct handler *internal_handler;					\
+  if (env->private_members->pending_non_local_exit			\
+      != emacs_funcall_exit_return)					\
+    return error_retval;						\
+  PUSH_HANDLER (internal_handler, Qt, CONDITION_CASE);			\
+  if (sys_setjmp (internal_handler->jmp))				\
+    {									\
+      Lisp_Object err = module_pop_handler ();				\
+      module_non_local_exit_set (env, emacs_funcall_exit_signal,	\
+				 XCAR (err), XCDR (err));		\
+      return error_retval;						\
+    }									\
+  PUSH_HANDLER (internal_handler, Qt, CATCHER_ALL);			\
+  if (sys_setjmp (internal_handler->jmp))				\
+    {									\
+      Lisp_Object thrown = module_pop_handler ();			\
+      module_pop_handler ();						\
+      module_non_local_exit_set (env, emacs_funcall_exit_throw,		\
+				 XCAR (thrown), XCDR (thrown));		\
+      return error_retval;						\
+    }									\
+  do { } while (false)
+
+#define MODULE_FUNCTION_END()					\
+  (module_pop_handler (), module_pop_handler ())
+
+static enum emacs_funcall_exit
+module_non_local_exit_check (emacs_env *env)
+{
+  return env->private_members->pending_non_local_exit;
+}
+
+static void
+module_non_local_exit_clear (emacs_env *env)
+{
+  struct emacs_env_private *p = env->private_members;
+
+  p->pending_non_local_exit = emacs_funcall_exit_return;
+  p->non_local_exit_symbol.v = p->non_local_exit_data.v = Qnil;
+}
+
+static enum emacs_funcall_exit
+module_non_local_exit_get (emacs_env *env, emacs_value *sym, emacs_value *data)
+{
+  struct emacs_env_private *p = env->private_members;
+
+  /* Make new values, which stay valid after non_local_exit_clear.
+     lisp_to_value cannot signal, so it is safe even though an exit is
+     pending.  */
+  if (p->pending_non_local_exit != emacs_funcall_exit_return)
+    {
+      *sym = lisp_to_value (env, p->non_local_exit_symbol.v);
+      *data = lisp_to_value (env, p->non_local_exit_data.v);
+    }
+  return p->pending_non_local_exit;
+}
+
+static void
+module_non_local_exit_signal (emacs_env *env, emacs_value sym,
+			      emacs_value data)
+{
+  module_non_local_exit_set (env, emacs_funcall_exit_signal,
+			     value_to_lisp (sym), value_to_lisp (data));
+}
+
+static void
+module_non_local_exit_throw (emacs_env *env, emacs_value tag,
+			     emacs_value value)
+{
+  module_non_local_exit_set (env, emacs_funcall_exit_throw,
+			     value_to_lisp (tag), value_to_lisp (value));
+}
+
+
+/* Global references.  */
+
+static emacs_value
+module_make_global_ref (emacs_env *env, emacs_value ref)
+{
+  struct module_global_ref *gref;
+  MODULE_FUNCTION_BEGIN (NULL);
+  {
+    struct Lisp_Hash_Table *h = XHASH_TABLE (module_global_refs);
+    Lisp_Object obj = value_to_lisp (ref);
+    EMACS_UINT hash;
+    ptrdiff_t i = hash_lookup (h, obj, &hash);
+
+    if (i >= 0)
+      {
+	gref = XSAVE_POINTER (HASH_VALUE (h, i), 0);
+	gref->refcount++;
+      }
+    else
+      {
+	gref = xmalloc (sizeof *gref);
+	gref->value.v = obj;
+	gref->refcount = 1;
+	hash_put (h, obj, make_save_ptr (gref), hash);
+      }
+  }
+  MODULE_FUNCTION_END ();
+  return &gref->value;
+}
+
+static void
+module_free_global_ref (emacs_env *env, emacs_value ref)
+{
+  MODULE_FUNCTION_BEGIN ();
+  {
+    struct Lisp_Hash_Table *h = XHASH_TABLE (module_global_refs);
+    Lisp_Object obj = value_to_lisp (ref);
+    ptrdiff_t i = hash_lookup (h, obj, NULL);
+
+    if (i >= 0)
+      {
+	struct module_global_ref *gref = XSAVE_POINTER (HASH_VALUE (h, i), 0);
+	if (--gref->refcount == 0)
+	  {
+	    Fremhash (obj, module_global_refs);
+	    xfree (gref);
+	  }
+      }
+  }
+  MODULE_FUNCTION_END ();
+}
+
+
+/* Strings.  */
+
+/* Return a Lisp string for the LENGTH bytes of UTF-8 at STR.  */
+
+static Lisp_Object
+module_decode_utf_8 (const char *str, ptrdiff_t length)
+{
+  return code_convert_string_norecord (make_unibyte_string (str, length),
+				       Qutf_8, false);
+}
+
+static emacs_value
+module_make_string (emacs_env *env, const char *str, ptrdiff_t length)
+{
+  emacs_value result;
+  MODULE_FUNCTION_BEGIN (NULL);
+  if (! (0 <= length && length <= STRING_BYTES_BOUND))
+    xsignal0 (Qoverflow_error);
+  result = lisp_to_value (env, module_decode_utf_8 (str, length));
+  MODULE_FUNCTION_END ();
+  return result;
+}
+
+static bool
+module_copy_string_contents (emacs_env *env, emacs_value value, char *buffer,
+			     ptrdiff_t *length)
+{
+  MODULE_FUNCTION_BEGIN (false);
+  {
+    Lisp_Object string = value_to_lisp (value);
+    ptrdiff_t size;
+
+    CHECK_STRING (string);
+    /* Unibyte strings hold raw bytes, which go unchanged.  */
+    if (STRING_MULTIBYTE (string))
+      string = ENCODE_UTF_8 (string);
+    size = SBYTES (string) + 1;
+    if (buffer && *length < size)
+      {
+	*length = size;
+	args_out_of_range (value_to_lisp (value), make_fixnum_or_float (size));
+      }
+    if (buffer)
+      memcpy (buffer, SDATA (string), size);
+    *length = size;
+  }
+  MODULE_FUNCTION_END ();
+  return true;
+}
+
+
+/* Functions.  */
+
+static emacs_value
+module_make_function (emacs_env *env, ptrdiff_t min_arity,
+		      ptrdiff_t max_arity, emacs_subr subr,
+		      const char *documentation, void *data)
+{
+  emacs_value result;
+  MODULE_FUNCTION_BEGIN (NULL);
+  {
+    Lisp_Object body, fun;
+    struct module_function *f;
+
+    if (! (0 <= min_arity
+	   && (max_arity < 0
+	       ? max_arity == emacs_variadic_function
+	       : min_arity <= max_arity)))
+      args_out_of_range (make_fixnum_or_float (min_arity),
+			 make_fixnum_or_float (max_arity));
+    if (module_functions_used == module_functions_size)
+      module_functions = xpalloc (module_functions, &module_functions_size,
+				  1, MOST_POSITIVE_FIXNUM,
+				  sizeof *module_functions);
+    f = &module_functions[module_functions_used];
+    f->min_arity = min_arity;
+    f->max_arity = max_arity;
+    f->subr = subr;
+    f->data = data;
+
+    /* (closure (t) (&rest args) DOC
+         (apply #'internal--module-call INDEX args))  */
+    body = list1 (list4 (Qapply, list2 (Qfunction, Qinternal_module_call),
+			 make_number (module_functions_used), Qargs));
+    if (documentation)
+      body = Fcons (module_decode_utf_8 (documentation,
+					 strlen (documentation)),
+		    body);
+    fun = Fcons (Qclosure, Fcons (list1 (Qt),
+				  Fcons (list2 (Qand_rest, Qargs), body)));
+    module_functions_used++;
+    result = lisp_to_value (env, fun);
+  }
+  MODULE_FUNCTION_END ();
+  return result;
+}
+
+static emacs_value
+module_funcall (emacs_env *env, emacs_value fun, ptrdiff_t nargs,
+		emacs_value args[])
+{
+  emacs_value result;
+  MODULE_FUNCTION_BEGIN (NULL);
+  {
+    Lisp_Object *newargs;
+    ptrdiff_t i;
+    USE_SAFE_ALLOCA;
+
+    if (! (0 <= nargs && nargs < PTRDIFF_MAX))
+      xsignal0 (Qoverflow_error);
+    SAFE_ALLOCA_LISP (newargs, 1 + nargs);
+    newargs[0] = value_to_lisp (fun);
+    for (i = 0; i < nargs; i++)
+      newargs[1 + i] = value_to_lisp (args[i]);
+    result = lisp_to_value (env, Ffuncall (1 + nargs, newargs));
+    SAFE_FREE ();
+  }
+  MODULE_FUNCTION_END ();
+  return result;
+}
+
+static emacs_value
+module_intern (emacs_env *env, const char *name)
+{
+  emacs_value result;
+  MODULE_FUNCTION_BEGIN (NULL);
+  result = lisp_to_value (env, intern (name));
+  MODULE_FUNCTION_END ();
+  return result;
+}
+
+
+/* Type conversion.  */
+
+static emacs_value
+module_type_of (emacs_env *env, emacs_value value)
+{
+  emacs_value result;
+  MODULE_FUNCTION_BEGIN (NULL);
+  result = lisp_to_value (env, Ftype_of (value_to_lisp (value)));
+  MODULE_FUNCTION_END ();
+  return result;
+}
+
+/* These two cannot fail, but their arguments can be null values from
+   functions that did nothing because an exit was pending.  */
+
+static bool
+module_is_not_nil (emacs_env *env, emacs_value value)
+{
+  return (env->private_members->pending_non_local_exit
+	  == emacs_funcall_exit_return
+	  && !NILP (value_to_lisp (value)));
+}
+
+static bool
+module_eq (emacs_env *env, emacs_value a, emacs_value b)
+{
+  return (env->private_members->pending_non_local_exit
+	  == emacs_funcall_exit_return
+	  && EQ (value_to_lisp (a), value_to_lisp (b)));
+}
+
+static intmax_t
+module_extract_integer (emacs_env *env, emacs_value value)
+{
+  intmax_t result;
+  MODULE_FUNCTION_BEGIN (0);
+  {
+    Lisp_Object n = value_to_lisp (value);
+    CHECK_NUMBER (n);
+    result = XINT (n);
+  }
+  MODULE_FUNCTION_END ();
+  return result;
+}
+
+static emacs_value
+module_make_integer (emacs_env *env, intmax_t n)
+{
+  emacs_value result;
+  MODULE_FUNCTION_BEGIN (NULL);
+  if (! (MOST_NEGATIVE_FIXNUM <= n && n <= MOST_POSITIVE_FIXNUM))
+    xsignal0 (Qoverflow_error);
+  result = lisp_to_value (env, make_number (n));
+  MODULE_FUNCTION_END ();
+  return result;
+}
+
+static double
+module_extract_float (emacs_env *env, emacs_value value)
+{
+  double result;
+  MODULE_FUNCTION_BEGIN (0);
+  {
+    Lisp_Object x = value_to_lisp (value);
+    CHECK_TYPE (FLOATP (x), Qfloatp, x);
+    result = XFLOAT_DATA (x);
+  }
+  MODULE_FUNCTION_END ();
+  return result;
+}
+
+static emacs_value
+module_make_float (emacs_env *env, double d)
+{
+  emacs_value result;
+  MODULE_FUNCTION_BEGIN (NULL);
+  result = lisp_to_value (env, make_float (d));
+  MODULE_FUNCTION_END ();
+  return result;
+}
+
+
+/* Vectors.  */
+
+/* Check that VECTOR is a vector with an element I.  */
+
+static void
+module_check_vector_index (Lisp_Object vector, ptrdiff_t i)
+{
+  CHECK_VECTOR (vector);
+  if (! (0 <= i && i < ASIZE (vector)))
+    args_out_of_range (vector, make_fixnum_or_float (i));
+}
+
+static void
+module_vec_set (emacs_env *env, emacs_value vector, ptrdiff_t i,
+		emacs_value value)
+{
+  MODULE_FUNCTION_BEGIN ();
+  {
+    Lisp_Object v = value_to_lisp (vector);
+    module_check_vector_index (v, i);
+    ASET (v, i, value_to_lisp (value));
+  }
+  MODULE_FUNCTION_END ();
+}
+
+static emacs_value
+module_vec_get (emacs_env *env, emacs_value vector, ptrdiff_t i)
+{
+  emacs_value result;
+  MODULE_FUNCTION_BEGIN (NULL);
+  {
+    Lisp_Object v = value_to_lisp (vector);
+    module_check_vector_index (v, i);
+    result = lisp_to_value (env, AREF (v, i));
+  }
+  MODULE_FUNCTION_END ();
+  return result;
+}
+
+static ptrdiff_t
+module_vec_size (emacs_env *env, emacs_value vector)
+{
+  ptrdiff_t result;
+  MODULE_FUNCTION_BEGIN (0);
+  {
+    Lisp_Object v = value_to_lisp (vector);
+    CHECK_VECTOR (v);
+    result = ASIZE (v);
+  }
+  MODULE_FUNCTION_END ();
+  return result;
+}
+
+
+/* Environments.  */
+
+static void
+initialize_environment (emacs_env *env, struct emacs_env_private *priv)
+{
+  priv->pending_non_local_exit = emacs_funcall_exit_return;
+  priv->non_local_exit_symbol.v = priv->non_local_exit_data.v = Qnil;
+  priv->initial_frame.offset = 0;
+  priv->initial_frame.next = NULL;
+  priv->current_frame = &priv->initial_frame;
+  priv->next = live_environments;
+  live_environments = priv;
+
+  env->size = sizeof *env;
+  env->private_members = priv;
+  env->make_global_ref = module_make_global_ref;
+  env->free_global_ref = module_free_global_ref;
+  env->non_local_exit_check = module_non_local_exit_check;
+  env->non_local_exit_clear = module_non_local_exit_clear;
+  env->non_local_exit_get = module_non_local_exit_get;
+  env->non_local_exit_signal = module_non_local_exit_signal;
+  env->non_local_exit_throw = module_non_local_exit_throw;
+  env->make_function = module_make_function;
+  env->funcall = module_funcall;
+  env->intern = module_intern;
+  env->type_of = module_type_of;
+  env->is_not_nil = module_is_not_nil;
+  env->eq = module_eq;
+  env->extract_integer = module_extract_integer;
+  env->make_integer = module_make_integer;
+  env->extract_float = module_extract_float;
+  env->make_float = module_make_float;
+  env->copy_string_contents = module_copy_string_contents;
+  env->make_string = module_make_string;
+  env->vec_set = module_vec_set;
+  env->vec_get = module_vec_get;
+  env->vec_size = module_vec_size;
+}
+
+/* Unwind-protect function that finalizes the environment ARG.  */
+
+static void
+finalize_environment (void *arg)
+{
+  emacs_env *env = arg;
+  struct emacs_env_private *priv = env->private_members;
+  struct emacs_value_frame *frame, *next;
+
+  eassert (live_environments == priv);
+  live_environments = priv->next;
+  for (frame = priv->initial_frame.next; frame; frame = next)
+    {
+      next = frame->next;
+      xfree (frame);
+    }
+}
+
+/* Finalize the environment ENV, which was set up at SPECPDL index
+   COUNT, and re-signal or re-throw its pending exit, if any.  */
+
+static void
+module_finish (emacs_env *env, ptrdiff_t count)
+{
+  struct emacs_env_private *priv = env->private_members;
+  enum emacs_funcall_exit exit = priv->pending_non_local_exit;
+  Lisp_Object symbol = priv->non_local_exit_symbol.v;
+  Lisp_Object data = priv->non_local_exit_data.v;
+
+  unbind_to (count, Qnil);
+  if (exit == emacs_funcall_exit_signal)
+    xsignal (symbol, data);
+  else if (exit == emacs_funcall_exit_throw)
+    Fthrow (symbol, data);
+}
+
+static emacs_env *
+module_get_environment (struct emacs_runtime *ert)
+{
+  return ert->private_members->env;
+}
+
+DEFUN ("internal--module-call", Finternal_module_call,
+       Sinternal_module_call, 1, MANY, 0,
+       doc: /* Call the module function with index INDEX on ARGS.
+This is an internal function; functions defined by modules call it.
+usage: (internal--module-call INDEX &rest ARGS)  */)
+  (ptrdiff_t nargs, Lisp_Object *args)
+{
+  ptrdiff_t count = SPECPDL_INDEX ();
+  ptrdiff_t n = nargs - 1, i;
+  struct module_function f;
+  emacs_env env;
+  struct emacs_env_private priv;
+  emacs_value *values, ret;
+  Lisp_Object result = Qnil;
+  USE_SAFE_ALLOCA;
+
+  CHECK_RANGED_INTEGER (args[0], 0, module_functions_used - 1);
+  /* Copy the function, since calling it can grow the table.  */
+  f = module_functions[XINT (args[0])];
+  if (n < f.min_arity || (0 <= f.max_arity && f.max_arity < n))
+    xsignal2 (Qwrong_number_of_arguments,
+	      Fcons (make_number (f.min_arity),
+		     f.max_arity < 0 ? Qmany : make_number (f.max_arity)),
+	      make_number (n));
+
+  initialize_environment (&env, &priv);
+  record_unwind_protect_ptr (finalize_environment, &env);
+  SAFE_NALLOCA (values, 1, n);
+  for (i = 0; i < n; i++)
+    values[i] = lisp_to_value (&env, args[1 + i]);
+
+  ret = f.subr (&env, n, values, f.data);
+
+  if (priv.pending_non_local_exit == emacs_funcall_exit_return)
+    {
+      if (!ret)
+	module_non_local_exit_set (&env, emacs_funcall_exit_signal,
+				   Qmodule_error,
+				   list1 (build_string ("Module function"
+							" returned no value")));
+      else
+	result = value_to_lisp (ret);
+    }
+  module_finish (&env, count);
+  SAFE_FREE ();
+  return result;
+}
+
+DEFUN ("module-load", Fmodule_load, Smodule_load, 1, 1, 0,
+       doc: /* Load the dynamic module FILE.
+FILE is the file name of a shared library that defines the symbol
+`plugin_is_GPL_compatible' and the function `emacs_module_init'.
+Call `emacs_module_init', through which the module defines its
+functions, and return t.
+
+Signal `module-open-failed' if FILE cannot be loaded,
+`module-not-gpl-compatible' if it does not define
+`plugin_is_GPL_compatible', and `module-init-failed' if
+`emacs_module_init' is missing or fails.  An error or throw from Lisp
+code that `emacs_module_init' calls propagates as usual.  */)
+  (Lisp_Object file)
+{
+  ptrdiff_t count = SPECPDL_INDEX ();
+  void *handle;
+  emacs_init_function module_init;
+  struct emacs_runtime runtime;
+  struct emacs_runtime_private rt;
+  emacs_env env;
+  struct emacs_env_private priv;
+  int status;
+
+  CHECK_STRING (file);
+  file = Fexpand_file_name (file, Qnil);
+  handle = dlopen (SSDATA (ENCODE_FILE (file)), RTLD_LAZY);
+  if (!handle)
+    {
+      const char *err = dlerror ();
+      xsignal2 (Qmodule_open_failed, file,
+		err ? build_string (err) : Qnil);
+    }
+  if (!dlsym (handle, "plugin_is_GPL_compatible"))
+    xsignal1 (Qmodule_not_gpl_compatible, file);
+  module_init = (emacs_init_function) dlsym (handle, "emacs_module_init");
+  if (!module_init)
+    xsignal2 (Qmodule_init_failed, file,
+	      build_string ("No emacs_module_init function"));
+
+  initialize_environment (&env, &priv);
+  record_unwind_protect_ptr (finalize_environment, &env);
+  rt.env = &env;
+  runtime.size = sizeof runtime;
+  runtime.private_members = &rt;
+  runtime.get_environment = module_get_environment;
+
+  status = module_init (&runtime);
+
+  if (status != 0 && priv.pending_non_local_exit == emacs_funcall_exit_return)
+    module_non_local_exit_set (&env, emacs_funcall_exit_signal,
+			       Qmodule_init_failed,
+			       list2 (file, make_number (status)));
+  module_finish (&env, count);
+  return Qt;
+}
+
+void
+syms_of_module (void)
+{
+  DEFSYM (Qmodule_error, "module-error");
+  Fput (Qmodule_error, Qerror_conditions,
+	Fpurecopy (list2 (Qmodule_error, Qerror)));
+  Fput (Qmodule_error, Qerror_message,
+	build_pure_c_string ("Module error"));
+
+  DEFSYM (Qmodule_open_failed, "module-open-failed");
+  Fput (Qmodule_open_failed, Qerror_conditions,
+	Fpurecopy (list3 (Qmodule_open_failed, Qmodule_error, Qerror)));
+  Fput (Qmodule_open_failed, Qerror_message,
+	build_pure_c_string ("Module could not be opened"));
+
+  DEFSYM (Qmodule_not_gpl_compatible, "module-not-gpl-compatible");
+  Fput (Qmodule_not_gpl_compatible, Qerror_conditions,
+	Fpurecopy (list3 (Qmodule_not_gpl_compatible, Qmodule_error,
+			  Qerror)));
+  Fput (Qmodule_not_gpl_compatible, Qerror_message,
+	build_pure_c_string ("Module is not GPL compatible"));
+
+  DEFSYM (Qmodule_init_failed, "module-init-failed");
+  Fput (Qmodule_init_failed, Qerror_conditions,
+	Fpurecopy (list3 (Qmodule_init_failed, Qmodule_error, Qerror)));
+  Fput (Qmodule_init_failed, Qerror_message,
+	build_pure_c_string ("Module initialization failed"));
+
+  DEFSYM (Qinternal_module_call, "internal--module-call");
+  DEFSYM (Qargs, "args");
+  DEFSYM (Qmany, "many");
+
+  DEFVAR_LISP ("module-file-suffix", Vmodule_file_suffix,
+	       doc: /* Suffix of the file names of dynamic modules.  */);
+  Vmodule_file_suffix = build_pure_c_string (MODULES_SUFFIX);
+
+  staticpro (&module_global_refs);
+  module_global_refs = make_hash_table (hashtest_eql, make_number (16),
+					make_float (DEFAULT_REHASH_SIZE),
+					make_float (DEFAULT_REHASH_THRESHOLD),
+					Qnil);
+
+  defsubr (&Smodule_load);
+  defsubr (&Sinternal_module_call);
+}
+
+#endif /* HAVE_MODULES */
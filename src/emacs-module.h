@@ -0,0 +1,220 @@
+/* emacs-module.h - GNU Emacs module API.
+
+Copyright (C) 2014 Free Software Foundation, Inc.
+
+This file is part of GNU Emacs.
+
+GNU Emacs is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+GNU Emacs is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.  */
+
+/* This is the only header a module needs.  It must not depend on any
+   other header of Emacs, since it is installed on its own.
+
+   A module is a shared library that defines the symbol
+   `plugin_is_GPL_compatible' and the function `emacs_module_init'.
+   `module-load' calls emacs_module_init with a struct emacs_runtime,
+   from which the module gets an environment: a table of functions
+   through which it creates Lisp values, inspects them, calls Lisp
+   functions and defines its own functions.
+
+   The interface is versioned by the SIZE members of the structures.
+   New members are only ever added at the end, so a module built
+   against this header works with any later Emacs, and can check
+   whether an Emacs provides a member it needs by comparing SIZE with
+   the offset of that member.  */
+
+#ifndef EMACS_MODULE_H
+#define EMACS_MODULE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* The version of this interface.  A module built against a version
+   works with Emacsen that implement that version or a later one.  */
+#define EMACS_MODULE_API_VERSION 1
+
+/* The environment of the current call into the module.  */
+typedef struct emacs_env_1 emacs_env;
+
+/* A Lisp value.  Values belong to the environment that produced them,
+   and are valid until the call into the module that the environment
+   was made for returns, unless they are global references.  A null
+   pointer is never a valid value.  */
+typedef struct emacs_value_tag *emacs_value;
+
+/* The maximum arity of a function taking any number of arguments.  */
+enum emacs_arity { emacs_variadic_function = -2 };
+
+/* What `emacs_module_init' gets from Emacs.  */
+struct emacs_runtime
+{
+  /* Structure size, for versioning.  */
+  ptrdiff_t size;
+
+  /* Private data; users should not touch this.  */
+  struct emacs_runtime_private *private_members;
+
+  /* Return the environment of the runtime.  */
+  emacs_env *(*get_environment) (struct emacs_runtime *ert);
+};
+
+/* Every module defines this function.  It returns 0 on success, and
+   anything else makes `module-load' signal `module-init-failed'.  */
+typedef int (*emacs_init_function) (struct emacs_runtime *ert);
+
+/* A function defined by a module.  ARGS holds NARGS values; DATA is
+   the pointer given to `make_function'.  */
+typedef emacs_value (*emacs_subr) (emacs_env *env,
+				   ptrdiff_t nargs, emacs_value args[],
+				   void *data);
+
+/* How a function called through the environment exited.  */
+enum emacs_funcall_exit
+{
+  /* Function has returned normally.  */
+  emacs_funcall_exit_return = 0,
+
+  /* Function has signaled an error using `signal'.  */
+  emacs_funcall_exit_signal = 1,
+
+  /* Function has exited using `throw'.  */
+  emacs_funcall_exit_throw = 2
+};
+
+/* The functions of an environment.
+
+   A Lisp error or throw never unwinds through module code.  Instead,
+   the environment function that caused it returns, with a null value
+   if it returns a value, and records the exit as pending.  As long as
+   an exit is pending, all other functions do nothing and return a
+   null value, except the non_local_exit_* functions.  When control
+   returns to Emacs with an exit pending, Emacs signals the error or
+   throws to the tag at that point.  */
+struct emacs_env_1
+{
+  /* Structure size, for versioning.  */
+  ptrdiff_t size;
+
+  /* Private data; users should not touch this.  */
+  struct emacs_env_private *private_members;
+
+  /* Memory management.  A global reference keeps a value alive and
+     valid across calls, until it has been freed as many times as it
+     was made.  */
+
+  emacs_value (*make_global_ref) (emacs_env *env,
+				  emacs_value any_reference);
+
+  void (*free_global_ref) (emacs_env *env,
+			   emacs_value global_reference);
+
+  /* Non-local exit handling.  */
+
+  enum emacs_funcall_exit (*non_local_exit_check) (emacs_env *env);
+
+  void (*non_local_exit_clear) (emacs_env *env);
+
+  /* If an exit is pending, store the error symbol and data of a signal,
+     or the tag and value of a throw, in *SYMBOL and *DATA.  */
+  enum emacs_funcall_exit (*non_local_exit_get)
+    (emacs_env *env,
+     emacs_value *non_local_exit_symbol_out,
+     emacs_value *non_local_exit_data_out);
+
+  void (*non_local_exit_signal) (emacs_env *env,
+				 emacs_value non_local_exit_symbol,
+				 emacs_value non_local_exit_data);
+
+  void (*non_local_exit_throw) (emacs_env *env,
+				emacs_value tag,
+				emacs_value value);
+
+  /* Function registration.  Return a Lisp function that calls FUNCTION
+     with DATA; it accepts from MIN_ARITY to MAX_ARITY arguments, or any
+     number if MAX_ARITY is emacs_variadic_function.  DOCUMENTATION is
+     its UTF-8 doc string, or NULL.  Give the function a name by calling
+     `defalias' or `fset' on it.  */
+
+  emacs_value (*make_function) (emacs_env *env,
+				ptrdiff_t min_arity,
+				ptrdiff_t max_arity,
+				emacs_subr function,
+				const char *documentation,
+				void *data);
+
+  emacs_value (*funcall) (emacs_env *env,
+			  emacs_value function,
+			  ptrdiff_t nargs,
+			  emacs_value args[]);
+
+  /* Return the symbol named SYMBOL_NAME, interning it if needed.  */
+  emacs_value (*intern) (emacs_env *env,
+			 const char *symbol_name);
+
+  /* Type conversion.  */
+
+  emacs_value (*type_of) (emacs_env *env,
+			  emacs_value value);
+
+  bool (*is_not_nil) (emacs_env *env, emacs_value value);
+
+  bool (*eq) (emacs_env *env, emacs_value a, emacs_value b);
+
+  intmax_t (*extract_integer) (emacs_env *env, emacs_value value);
+
+  emacs_value (*make_integer) (emacs_env *env, intmax_t value);
+
+  double (*extract_float) (emacs_env *env, emacs_value value);
+
+  emacs_value (*make_float) (emacs_env *env, double value);
+
+  /* Copy the contents of the Lisp string VALUE to BUFFER as a
+     null-terminated UTF-8 string, and store the number of bytes
+     copied, including the null byte, in *SIZE_INOUT.  If BUFFER is
+     NULL, only store the size needed.  If the string does not fit in
+     the *SIZE_INOUT bytes of BUFFER, store the size needed, signal
+     `args-out-of-range' and return false.  */
+  bool (*copy_string_contents) (emacs_env *env,
+				emacs_value value,
+				char *buffer,
+				ptrdiff_t *size_inout);
+
+  /* Return a Lisp string made from the LENGTH bytes of UTF-8 text at
+     CONTENTS; CONTENTS need not be null-terminated.  */
+  emacs_value (*make_string) (emacs_env *env,
+			      const char *contents, ptrdiff_t length);
+
+  /* Vector functions.  */
+
+  void (*vec_set) (emacs_env *env, emacs_value vector, ptrdiff_t i,
+		   emacs_value value);
+
+  emacs_value (*vec_get) (emacs_env *env, emacs_value vector, ptrdiff_t i);
+
+  ptrdiff_t (*vec_size) (emacs_env *env, emacs_value vector);
+};
+
+/* Every module defines these.  */
+extern int plugin_is_GPL_compatible;
+extern int emacs_module_init (struct emacs_runtime *ert);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* EMACS_MODULE_H */
@@ -241,6 +241,7 @@ Initialization options:\n\
 --daemon                    start a server in the background\n\
 --debug-init                enable Emacs Lisp debugger for init file\n\
 --display, -d DISPLAY       use X server DISPLAY\n\
+--dump-file FILE            start from the portable dump in FILE\n\
 ",
     "\
 --no-desktop                do not load a saved desktop\n\
@@ -701,6 +702,155 @@ close_output_streams (void)
      _exit (EXIT_FAILURE);
 }
 
+/* Intern the names of the standard functions and variables that main
+   does not define before init_alloc, and define standard keys.  The
+   basic levels of Lisp must come first.  */
+
+static void
+define_lisp_primitives (void)
+{
+  syms_of_chartab ();
+  syms_of_lread ();
+  syms_of_print ();
+  syms_of_eval ();
+  syms_of_floatfns ();
+
+  syms_of_buffer ();
+  syms_of_bytecode ();
+  syms_of_callint ();
+  syms_of_casefiddle ();
+  syms_of_casetab ();
+  syms_of_category ();
+  syms_of_ccl ();
+  syms_of_character ();
+  syms_of_cmds ();
+  syms_of_dired ();
+  syms_of_display ();
+  syms_of_doc ();
+  syms_of_editfns ();
+  syms_of_emacs ();
+  syms_of_filelock ();
+  syms_of_indent ();
+  syms_of_insdel ();
+  /* syms_of_keymap (); */
+  syms_of_macros ();
+  syms_of_marker ();
+  syms_of_line_index ();
+  syms_of_minibuf ();
+  syms_of_process ();
+  syms_of_pdumper ();
+  syms_of_search ();
+  syms_of_worker ();
+  syms_of_json ();
+#ifdef HAVE_MODULES
+  syms_of_module ();
+#endif
+  syms_of_frame ();
+  syms_of_syntax ();
+  syms_of_terminal ();
+  syms_of_term ();
+  syms_of_undo ();
+#ifdef HAVE_SOUND
+  syms_of_sound ();
+#endif
+  syms_of_textprop ();
+  syms_of_composite ();
+#ifdef WINDOWSNT
+  syms_of_ntproc ();
+#endif /* WINDOWSNT */
+#if defined CYGWIN
+  syms_of_cygw32 ();
+#endif
+  syms_of_window ();
+  syms_of_xdisp ();
+  syms_of_font ();
+#ifdef HAVE_WINDOW_SYSTEM
+  syms_of_fringe ();
+  syms_of_image ();
+#endif /* HAVE_WINDOW_SYSTEM */
+#ifdef HAVE_X_WINDOWS
+  syms_of_xterm ();
+  syms_of_xfns ();
+  syms_of_xmenu ();
+  syms_of_fontset ();
+  syms_of_xsettings ();
+#ifdef HAVE_X_SM
+  syms_of_xsmfns ();
+#endif
+#ifdef HAVE_X11
+  syms_of_xselect ();
+#endif
+#endif /* HAVE_X_WINDOWS */
+
+#ifdef HAVE_LIBXML2
+  syms_of_xml ();
+#endif
+
+#ifdef HAVE_ZLIB
+  syms_of_decompress ();
+#endif
+
+  syms_of_menu ();
+
+#ifdef HAVE_NTGUI
+  syms_of_w32term ();
+  syms_of_w32fns ();
+  syms_of_w32menu ();
+  syms_of_fontset ();
+#endif /* HAVE_NTGUI */
+
+#if defined WINDOWSNT || defined HAVE_NTGUI
+  syms_of_w32select ();
+#endif
+
+#ifdef MSDOS
+  syms_of_xmenu ();
+  syms_of_dosfns ();
+  syms_of_msdos ();
+  syms_of_win16select ();
+#endif	/* MSDOS */
+
+#ifdef HAVE_NS
+  syms_of_nsterm ();
+  syms_of_nsfns ();
+  syms_of_nsmenu ();
+  syms_of_nsselect ();
+  syms_of_fontset ();
+#endif /* HAVE_NS */
+
+#ifdef HAVE_GNUTLS
+  syms_of_gnutls ();
+#endif
+
+#ifdef HAVE_GFILENOTIFY
+  syms_of_gfilenotify ();
+#endif /* HAVE_GFILENOTIFY */
+
+#ifdef HAVE_INOTIFY
+  syms_of_inotify ();
+#endif /* HAVE_INOTIFY */
+
+#ifdef HAVE_DBUS
+  syms_of_dbusbind ();
+#endif /* HAVE_DBUS */
+
+#ifdef WINDOWSNT
+  syms_of_ntterm ();
+#ifdef HAVE_W32NOTIFY
+  syms_of_w32notify ();
+#endif /* HAVE_W32NOTIFY */
+#endif /* WINDOWSNT */
+
+  syms_of_profiler ();
+
+  keys_of_casefiddle ();
+  keys_of_cmds ();
+  keys_of_buffer ();
+  keys_of_keyboard ();
+  keys_of_keymap ();
+  keys_of_window ();
+}
+
 /* ARGSUSED */
 int
 main (int argc, char **argv)
@@ -726,6 +876,9 @@ main (int argc, char **argv)
   /* If we use --chdir, this records the original directory.  */
   char *original_pwd = 0;
 
+  /* The portable dump file to load, if any.  */
+  char *dump_file = 0;
+
 #if GC_MARK_STACK
   stack_base = &dummy;
 #endif
@@ -832,7 +985,22 @@ main (int argc, char **argv)
         }
     }
 
+  if (argmatch (argv, argc, "-dump-file", "--dump-file", 4, &dump_file,
+		&skip_args))
+    {
+      if (initialized)
+	{
+	  fprintf (stderr, "%s: --dump-file is only valid for temacs\n",
+		   argv[0]);
+	  exit (1);
+	}
+#ifndef CANNOT_DUMP
+      might_dump = false;
+#endif
+    }
+
   dumping = !initialized && (strcmp (argv[argc - 1], "dump") == 0
+			     || strcmp (argv[argc - 1], "pdump") == 0
 			     || strcmp (argv[argc - 1], "bootstrap") == 0);
 
 #ifdef HAVE_PERSONALITY_LINUX32
@@ -1197,6 +1365,18 @@ Using an Emacs configured with --with-x-toolkit=lucid does not have this problem
 #endif /* HAVE_WINDOW_SYSTEM */
     }
 
+  if (dump_file)
+    {
+      /* Define everything as for dumping, then replace the Lisp world
+	 with the one saved in DUMP_FILE.  From here on, Emacs starts up
+	 as a dumped Emacs would.  */
+      syms_of_callproc ();
+      define_lisp_primitives ();
+      pdumper_load (dump_file);
+      noninteractive1 = noninteractive;
+      initialized = 1;
+    }
+
   init_alloc ();
 
   if (do_initial_setlocale)
@@ -1377,6 +1557,7 @@ Using an Emacs configured with --with-x-toolkit=lucid does not have this problem
     }
 
   init_callproc ();	/* Must follow init_cmdargs but not init_sys_modes.  */
+  init_doc ();
   init_fileio ();
   init_lread ();
 #ifdef WINDOWSNT
@@ -1388,143 +1569,7 @@ Using an Emacs configured with --with-x-toolkit=lucid does not have this problem
      define standard keys.  */
 
   if (!initialized)
-    {
-      /* The basic levels of Lisp must come first.  Note that
-	 syms_of_data and some others have already been called.  */
-      syms_of_chartab ();
-      syms_of_lread ();
-      syms_of_print ();
-      syms_of_eval ();
-      syms_of_floatfns ();
-
-      syms_of_buffer ();
-      syms_of_bytecode ();
-      syms_of_callint ();
-      syms_of_casefiddle ();
-      syms_of_casetab ();
-      syms_of_category ();
-      syms_of_ccl ();
-      syms_of_character ();
-      syms_of_cmds ();
-      syms_of_dired ();
-      syms_of_display ();
-      syms_of_doc ();
-      syms_of_editfns ();
-      syms_of_emacs ();
-      syms_of_filelock ();
-      syms_of_indent ();
-      syms_of_insdel ();
-      /* syms_of_keymap (); */
-      syms_of_macros ();
-      syms_of_marker ();
-      syms_of_minibuf ();
-      syms_of_process ();
-      syms_of_search ();
-      syms_of_frame ();
-      syms_of_syntax ();
-      syms_of_terminal ();
-      syms_of_term ();
-      syms_of_undo ();
-#ifdef HAVE_SOUND
-      syms_of_sound ();
-#endif
-      syms_of_textprop ();
-      syms_of_composite ();
-#ifdef WINDOWSNT
-      syms_of_ntproc ();
-#endif /* WINDOWSNT */
-#if defined CYGWIN
-      syms_of_cygw32 ();
-#endif
-      syms_of_window ();
-      syms_of_xdisp ();
-      syms_of_font ();
-#ifdef HAVE_WINDOW_SYSTEM
-      syms_of_fringe ();
-      syms_of_image ();
-#endif /* HAVE_WINDOW_SYSTEM */
-#ifdef HAVE_X_WINDOWS
-      syms_of_xterm ();
-      syms_of_xfns ();
-      syms_of_xmenu ();
-      syms_of_fontset ();
-      syms_of_xsettings ();
-#ifdef HAVE_X_SM
-      syms_of_xsmfns ();
-#endif
-#ifdef HAVE_X11
-      syms_of_xselect ();
-#endif
-#endif /* HAVE_X_WINDOWS */
-
-#ifdef HAVE_LIBXML2
-      syms_of_xml ();
-#endif
-
-#ifdef HAVE_ZLIB
-      syms_of_decompress ();
-#endif
-
-      syms_of_menu ();
-
-#ifdef HAVE_NTGUI
-      syms_of_w32term ();
-      syms_of_w32fns ();
-      syms_of_w32menu ();
-      syms_of_fontset ();
-#endif /* HAVE_NTGUI */
-
-#if defined WINDOWSNT || defined HAVE_NTGUI
-      syms_of_w32select ();
-#endif
-
-#ifdef MSDOS
-      syms_of_xmenu ();
-      syms_of_dosfns ();
-      syms_of_msdos ();
-      syms_of_win16select ();
-#endif	/* MSDOS */
-
-#ifdef HAVE_NS
-      syms_of_nsterm ();
-      syms_of_nsfns ();
-      syms_of_nsmenu ();
-      syms_of_nsselect ();
-      syms_of_fontset ();
-#endif /* HAVE_NS */
-
-#ifdef HAVE_GNUTLS
-      syms_of_gnutls ();
-#endif
-
-#ifdef HAVE_GFILENOTIFY
-      syms_of_gfilenotify ();
-#endif /* HAVE_GFILENOTIFY */
-
-#ifdef HAVE_INOTIFY
-      syms_of_inotify ();
-#endif /* HAVE_INOTIFY */
-
-#ifdef HAVE_DBUS
-      syms_of_dbusbind ();
-#endif /* HAVE_DBUS */
-
-#ifdef WINDOWSNT
-      syms_of_ntterm ();
-#ifdef HAVE_W32NOTIFY
-      syms_of_w32notify ();
-#endif /* HAVE_W32NOTIFY */
-#endif /* WINDOWSNT */
-
-      syms_of_profiler ();
-
-      keys_of_casefiddle ();
-      keys_of_cmds ();
-      keys_of_buffer ();
-      keys_of_keyboard ();
-      keys_of_keymap ();
-      keys_of_window ();
-    }
+    define_lisp_primitives ();
   else
     {
       /* Initialization that must be done even if the global variable
@@ -1642,6 +1687,7 @@ static const struct standard_args standard_args[] =
 {
   { "-version", "--version", 150, 0 },
   { "-chdir", "--chdir", 130, 1 },
+  { "-dump-file", "--dump-file", 125, 1 },
   { "-t", "--terminal", 120, 1 },
   { "-nw", "--no-window-system", 110, 0 },
   { "-nw", "--no-windows", 110, 0 },
@@ -2000,6 +2000,11 @@ sort_vector (Lisp_Object vector, Lisp_Object predicate)
   for (ptrdiff_t i = 0; i < halflen; i++)
     tmp[i] = make_number (0);
   sort_vector_inplace (predicate, len, XVECTOR (vector)->contents, tmp);
+  /* PREDICATE may have run a step of an incremental garbage
+     collection that looked into VECTOR while some of its elements
+     were only in TMP.  Have the collection look into it again.  */
+  if (XVECTOR (vector)->header.size & ARRAY_MARK_FLAG)
+    remember_vector (XVECTOR (vector));
   SAFE_FREE ();
   UNGCPRO;
 }
@@ -2325,10 +2330,9 @@ internal_equal (Lisp_Object o1, Lisp_Object o2, int depth, bool props,
 	return 0;
       if (OVERLAYP (o1))
 	{
-	  if (!internal_equal (OVERLAY_START (o1), OVERLAY_START (o2),
-			       depth + 1, props, ht)
-	      || !internal_equal (OVERLAY_END (o1), OVERLAY_END (o2),
-				  depth + 1, props, ht))
+	  if (OVERLAY_BUFFER (o1) != OVERLAY_BUFFER (o2)
+	      || OVERLAY_START (o1) != OVERLAY_START (o2)
+	      || OVERLAY_END (o1) != OVERLAY_END (o2))
 	    return 0;
 	  o1 = XOVERLAY (o1)->plist;
 	  o2 = XOVERLAY (o2)->plist;
@@ -3618,37 +3622,23 @@ CHECK_HASH_TABLE (Lisp_Object x)
 static void
 set_hash_key_and_value (struct Lisp_Hash_Table *h, Lisp_Object key_and_value)
 {
+  note_vector_store ((struct Lisp_Vector *) h, key_and_value);
   h->key_and_value = key_and_value;
 }
 static void
-set_hash_next (struct Lisp_Hash_Table *h, Lisp_Object next)
+set_hash_next_slot (struct Lisp_Hash_Table *h, ptrdiff_t idx, ptrdiff_t val)
 {
-  h->next = next;
+  h->next[idx] = val;
 }
 static void
-set_hash_next_slot (struct Lisp_Hash_Table *h, ptrdiff_t idx, Lisp_Object val)
+set_hash_hash_slot (struct Lisp_Hash_Table *h, ptrdiff_t idx, EMACS_UINT val)
 {
-  gc_aset (h->next, idx, val);
+  h->hash[idx] = val;
 }
 static void
-set_hash_hash (struct Lisp_Hash_Table *h, Lisp_Object hash)
+set_hash_index_slot (struct Lisp_Hash_Table *h, ptrdiff_t idx, ptrdiff_t val)
 {
-  h->hash = hash;
-}
-static void
-set_hash_hash_slot (struct Lisp_Hash_Table *h, ptrdiff_t idx, Lisp_Object val)
-{
-  gc_aset (h->hash, idx, val);
-}
-static void
-set_hash_index (struct Lisp_Hash_Table *h, Lisp_Object index)
-{
-  h->index = index;
-}
-static void
-set_hash_index_slot (struct Lisp_Hash_Table *h, ptrdiff_t idx, Lisp_Object val)
-{
-  gc_aset (h->index, idx, val);
+  h->index[idx] = val;
 }
 
 /* If OBJ is a Lisp hash table, return a pointer to its struct
@@ -3896,21 +3886,34 @@ make_hash_table (struct hash_table_test test,
   /* Allocate a table and initialize it.  */
   h = allocate_hash_table ();
 
+  /* Clear the native arrays first, so that cleanup_vector can free a
+     table that xmalloc failed to complete.  */
+  h->hash = NULL;
+  h->next = NULL;
+  h->index = NULL;
+
   /* Initialize hash table slots.  */
   h->test = test;
   h->weak = weak;
   h->rehash_threshold = rehash_threshold;
   h->rehash_size = rehash_size;
   h->count = 0;
+  h->size = sz;
+  h->index_size = index_size;
   h->key_and_value = Fmake_vector (make_number (2 * sz), Qnil);
-  h->hash = Fmake_vector (size, Qnil);
-  h->next = Fmake_vector (size, Qnil);
-  h->index = Fmake_vector (make_number (index_size), Qnil);
+  h->hash = xnmalloc (sz, sizeof *h->hash);
+  h->next = xnmalloc (sz, sizeof *h->next);
+  h->index = xnmalloc (index_size, sizeof *h->index);
 
   /* Set up the free list.  */
-  for (i = 0; i < sz - 1; ++i)
-    set_hash_next_slot (h, i, make_number (i + 1));
-  h->next_free = make_number (0);
+  for (i = 0; i < sz; ++i)
+    {
+      h->hash[i] = HASH_UNUSED;
+      h->next[i] = i < sz - 1 ? i + 1 : -1;
+    }
+  for (i = 0; i < index_size; ++i)
+    h->index[i] = -1;
+  h->next_free = 0;
 
   XSET_HASH_TABLE (table, h);
   eassert (HASH_TABLE_P (table));
@@ -3940,10 +3943,16 @@ copy_hash_table (struct Lisp_Hash_Table *h1)
 
   h2 = allocate_hash_table ();
   *h2 = *h1;
+  h2->hash = NULL;
+  h2->next = NULL;
+  h2->index = NULL;
   h2->key_and_value = Fcopy_sequence (h1->key_and_value);
-  h2->hash = Fcopy_sequence (h1->hash);
-  h2->next = Fcopy_sequence (h1->next);
-  h2->index = Fcopy_sequence (h1->index);
+  h2->hash = xnmalloc (h1->size, sizeof *h2->hash);
+  memcpy (h2->hash, h1->hash, h1->size * sizeof *h2->hash);
+  h2->next = xnmalloc (h1->size, sizeof *h2->next);
+  memcpy (h2->next, h1->next, h1->size * sizeof *h2->next);
+  h2->index = xnmalloc (h1->index_size, sizeof *h2->index);
+  memcpy (h2->index, h1->index, h1->index_size * sizeof *h2->index);
   XSET_HASH_TABLE (table, h2);
 
   /* Maybe add this hash table to the list of all weak hash tables.  */
@@ -3957,17 +3966,63 @@ copy_hash_table (struct Lisp_Hash_Table *h1)
 }
 
 
+/* Complete hash table H, whose key_and_value vector, size and index
+   size are set, and whose hash vector is allocated and holds
+   HASH_UNUSED for the unused slots, as when H has just been loaded
+   from a dump.  Compute the hash codes, collision chains and free list
+   afresh.  Each entry keeps its slot, so that indices into H that are
+   recorded elsewhere stay valid.  */
+
+void
+rebuild_hash_table (struct Lisp_Hash_Table *h)
+{
+  ptrdiff_t i;
+
+  h->next = xnmalloc (h->size, sizeof *h->next);
+  h->index = xnmalloc (h->index_size, sizeof *h->index);
+  for (i = 0; i < h->index_size; i++)
+    set_hash_index_slot (h, i, -1);
+
+  /* Chain the unused slots in increasing order, as make_hash_table
+     does.  */
+  h->count = 0;
+  h->next_free = -1;
+  for (i = h->size - 1; i >= 0; i--)
+    if (h->hash[i] == HASH_UNUSED)
+      {
+	set_hash_next_slot (h, i, h->next_free);
+	h->next_free = i;
+      }
+    else
+      {
+	EMACS_UINT hash = h->test.hashfn (&h->test, HASH_KEY (h, i));
+	ptrdiff_t start_of_bucket = hash % h->index_size;
+
+	set_hash_hash_slot (h, i, hash);
+	set_hash_next_slot (h, i, HASH_INDEX (h, start_of_bucket));
+	set_hash_index_slot (h, start_of_bucket, i);
+	h->count++;
+      }
+
+  if (!NILP (h->weak))
+    {
+      h->next_weak = weak_hash_tables;
+      weak_hash_tables = h;
+    }
+}
+
+
 /* Resize hash table H if it's too full.  If H cannot be resized
    because it's already too large, throw an error.  */
 
 static void
 maybe_resize_hash_table (struct Lisp_Hash_Table *h)
 {
-  if (NILP (h->next_free))
+  if (h->next_free < 0)
     {
       ptrdiff_t old_size = HASH_TABLE_SIZE (h);
       EMACS_INT new_size, index_size, nsize;
-      ptrdiff_t i;
+      ptrdiff_t i, *index;
       double index_float;
 
       if (INTEGERP (h->rehash_size))
@@ -3984,6 +4039,11 @@ maybe_resize_hash_table (struct Lisp_Hash_Table *h)
 	  else
 	    new_size = INDEX_SIZE_BOUND + 1;
 	}
+      /* Grow by at least half, as larger_vector does; this keeps
+	 tables with a small integer rehash size from resizing on
+	 nearly every insertion.  */
+      if (new_size - old_size < old_size >> 1)
+	new_size = old_size + (old_size >> 1);
       index_float = new_size / XFLOAT_DATA (h->rehash_threshold);
       index_size = (index_float < INDEX_SIZE_BOUND + 1
 		    ? next_almost_prime (index_float)
@@ -4002,38 +4062,33 @@ maybe_resize_hash_table (struct Lisp_Hash_Table *h)
 
       set_hash_key_and_value (h, larger_vector (h->key_and_value,
 						2 * (new_size - old_size), -1));
-      set_hash_next (h, larger_vector (h->next, new_size - old_size, -1));
-      set_hash_hash (h, larger_vector (h->hash, new_size - old_size, -1));
-      set_hash_index (h, Fmake_vector (make_number (index_size), Qnil));
+      h->next = xnrealloc (h->next, new_size, sizeof *h->next);
+      h->hash = xnrealloc (h->hash, new_size, sizeof *h->hash);
+      index = xnmalloc (index_size, sizeof *index);
+      for (i = 0; i < index_size; ++i)
+	index[i] = -1;
+      xfree (h->index);
+      h->index = index;
+      h->size = new_size;
+      h->index_size = index_size;
 
       /* Update the free list.  Do it so that new entries are added at
          the end of the free list.  This makes some operations like
          maphash faster.  */
-      for (i = old_size; i < new_size - 1; ++i)
-	set_hash_next_slot (h, i, make_number (i + 1));
-
-      if (!NILP (h->next_free))
+      for (i = old_size; i < new_size; ++i)
 	{
-	  Lisp_Object last, next;
-
-	  last = h->next_free;
-	  while (next = HASH_NEXT (h, XFASTINT (last)),
-		 !NILP (next))
-	    last = next;
-
-	  set_hash_next_slot (h, XFASTINT (last), make_number (old_size));
+	  h->hash[i] = HASH_UNUSED;
+	  h->next[i] = i < new_size - 1 ? i + 1 : -1;
 	}
-      else
-	XSETFASTINT (h->next_free, old_size);
+      h->next_free = old_size;
 
       /* Rehash.  */
       for (i = 0; i < old_size; ++i)
-	if (!NILP (HASH_HASH (h, i)))
+	if (HASH_ENTRY_USED_P (h, i))
 	  {
-	    EMACS_UINT hash_code = XUINT (HASH_HASH (h, i));
-	    ptrdiff_t start_of_bucket = hash_code % ASIZE (h->index);
+	    ptrdiff_t start_of_bucket = HASH_HASH (h, i) % h->index_size;
 	    set_hash_next_slot (h, i, HASH_INDEX (h, start_of_bucket));
-	    set_hash_index_slot (h, start_of_bucket, make_number (i));
+	    set_hash_index_slot (h, start_of_bucket, i);
 	  }
     }
 }
@@ -4047,30 +4102,23 @@ ptrdiff_t
 hash_lookup (struct Lisp_Hash_Table *h, Lisp_Object key, EMACS_UINT *hash)
 {
   EMACS_UINT hash_code;
-  ptrdiff_t start_of_bucket;
-  Lisp_Object idx;
+  ptrdiff_t start_of_bucket, i;
 
   hash_code = h->test.hashfn (&h->test, key);
   eassert ((hash_code & ~INTMASK) == 0);
   if (hash)
     *hash = hash_code;
 
-  start_of_bucket = hash_code % ASIZE (h->index);
-  idx = HASH_INDEX (h, start_of_bucket);
+  start_of_bucket = hash_code % h->index_size;
 
-  /* We need not gcpro idx since it's either an integer or nil.  */
-  while (!NILP (idx))
-    {
-      ptrdiff_t i = XFASTINT (idx);
-      if (EQ (key, HASH_KEY (h, i))
-	  || (h->test.cmpfn
-	      && hash_code == XUINT (HASH_HASH (h, i))
-	      && h->test.cmpfn (&h->test, key, HASH_KEY (h, i))))
-	break;
-      idx = HASH_NEXT (h, i);
-    }
+  for (i = HASH_INDEX (h, start_of_bucket); 0 <= i; i = HASH_NEXT (h, i))
+    if (EQ (key, HASH_KEY (h, i))
+	|| (h->test.cmpfn
+	    && hash_code == HASH_HASH (h, i)
+	    && h->test.cmpfn (&h->test, key, HASH_KEY (h, i))))
+      break;
 
-  return NILP (idx) ? -1 : XFASTINT (idx);
+  return i;
 }
 
 
@@ -4091,18 +4139,18 @@ hash_put (struct Lisp_Hash_Table *h, Lisp_Object key, Lisp_Object value,
   h->count++;
 
   /* Store key/value in the key_and_value vector.  */
-  i = XFASTINT (h->next_free);
+  i = h->next_free;
   h->next_free = HASH_NEXT (h, i);
   set_hash_key_slot (h, i, key);
   set_hash_value_slot (h, i, value);
 
   /* Remember its hash code.  */
-  set_hash_hash_slot (h, i, make_number (hash));
+  set_hash_hash_slot (h, i, hash);
 
   /* Add new entry to its collision chain.  */
-  start_of_bucket = hash % ASIZE (h->index);
+  start_of_bucket = hash % h->index_size;
   set_hash_next_slot (h, i, HASH_INDEX (h, start_of_bucket));
-  set_hash_index_slot (h, start_of_bucket, make_number (i));
+  set_hash_index_slot (h, start_of_bucket, i);
   return i;
 }
 
@@ -4113,47 +4161,39 @@ static void
 hash_remove_from_table (struct Lisp_Hash_Table *h, Lisp_Object key)
 {
   EMACS_UINT hash_code;
-  ptrdiff_t start_of_bucket;
-  Lisp_Object idx, prev;
+  ptrdiff_t start_of_bucket, i, prev;
 
   hash_code = h->test.hashfn (&h->test, key);
   eassert ((hash_code & ~INTMASK) == 0);
-  start_of_bucket = hash_code % ASIZE (h->index);
-  idx = HASH_INDEX (h, start_of_bucket);
-  prev = Qnil;
+  start_of_bucket = hash_code % h->index_size;
+  prev = -1;
 
-  /* We need not gcpro idx, prev since they're either integers or nil.  */
-  while (!NILP (idx))
+  for (i = HASH_INDEX (h, start_of_bucket); 0 <= i; i = HASH_NEXT (h, i))
     {
-      ptrdiff_t i = XFASTINT (idx);
-
       if (EQ (key, HASH_KEY (h, i))
 	  || (h->test.cmpfn
-	      && hash_code == XUINT (HASH_HASH (h, i))
+	      && hash_code == HASH_HASH (h, i)
 	      && h->test.cmpfn (&h->test, key, HASH_KEY (h, i))))
 	{
 	  /* Take entry out of collision chain.  */
-	  if (NILP (prev))
+	  if (prev < 0)
 	    set_hash_index_slot (h, start_of_bucket, HASH_NEXT (h, i));
 	  else
-	    set_hash_next_slot (h, XFASTINT (prev), HASH_NEXT (h, i));
+	    set_hash_next_slot (h, prev, HASH_NEXT (h, i));
 
 	  /* Clear slots in key_and_value and add the slots to
 	     the free list.  */
 	  set_hash_key_slot (h, i, Qnil);
 	  set_hash_value_slot (h, i, Qnil);
-	  set_hash_hash_slot (h, i, Qnil);
+	  set_hash_hash_slot (h, i, HASH_UNUSED);
 	  set_hash_next_slot (h, i, h->next_free);
-	  h->next_free = make_number (i);
+	  h->next_free = i;
 	  h->count--;
 	  eassert (h->count >= 0);
 	  break;
 	}
-      else
-	{
-	  prev = idx;
-	  idx = HASH_NEXT (h, i);
-	}
+
+      prev = i;
     }
 }
 
@@ -4169,16 +4209,16 @@ hash_clear (struct Lisp_Hash_Table *h)
 
       for (i = 0; i < size; ++i)
 	{
-	  set_hash_next_slot (h, i, i < size - 1 ? make_number (i + 1) : Qnil);
+	  set_hash_next_slot (h, i, i < size - 1 ? i + 1 : -1);
 	  set_hash_key_slot (h, i, Qnil);
 	  set_hash_value_slot (h, i, Qnil);
-	  set_hash_hash_slot (h, i, Qnil);
+	  set_hash_hash_slot (h, i, HASH_UNUSED);
 	}
 
-      for (i = 0; i < ASIZE (h->index); ++i)
-	ASET (h->index, i, Qnil);
+      for (i = 0; i < h->index_size; ++i)
+	set_hash_index_slot (h, i, -1);
 
-      h->next_free = make_number (0);
+      h->next_free = 0;
       h->count = 0;
     }
 }
@@ -4200,19 +4240,18 @@ sweep_weak_table (struct Lisp_Hash_Table *h, bool remove_entries_p)
   ptrdiff_t bucket, n;
   bool marked;
 
-  n = ASIZE (h->index) & ~ARRAY_MARK_FLAG;
+  n = h->index_size;
   marked = 0;
 
   for (bucket = 0; bucket < n; ++bucket)
     {
-      Lisp_Object idx, next, prev;
+      ptrdiff_t i, next, prev;
 
       /* Follow collision chain, removing entries that
 	 don't survive this garbage collection.  */
-      prev = Qnil;
-      for (idx = HASH_INDEX (h, bucket); !NILP (idx); idx = next)
+      prev = -1;
+      for (i = HASH_INDEX (h, bucket); 0 <= i; i = next)
 	{
-	  ptrdiff_t i = XFASTINT (idx);
 	  bool key_known_to_survive_p = survives_gc_p (HASH_KEY (h, i));
 	  bool value_known_to_survive_p = survives_gc_p (HASH_VALUE (h, i));
 	  bool remove_p;
@@ -4235,25 +4274,25 @@ sweep_weak_table (struct Lisp_Hash_Table *h, bool remove_entries_p)
 	      if (remove_p)
 		{
 		  /* Take out of collision chain.  */
-		  if (NILP (prev))
+		  if (prev < 0)
 		    set_hash_index_slot (h, bucket, next);
 		  else
-		    set_hash_next_slot (h, XFASTINT (prev), next);
+		    set_hash_next_slot (h, prev, next);
 
 		  /* Add to free list.  */
 		  set_hash_next_slot (h, i, h->next_free);
-		  h->next_free = idx;
+		  h->next_free = i;
 
 		  /* Clear key, value, and hash.  */
 		  set_hash_key_slot (h, i, Qnil);
 		  set_hash_value_slot (h, i, Qnil);
-		  set_hash_hash_slot (h, i, Qnil);
+		  set_hash_hash_slot (h, i, HASH_UNUSED);
 
 		  h->count--;
 		}
 	      else
 		{
-		  prev = idx;
+		  prev = i;
 		}
 	    }
 	  else
@@ -4778,7 +4817,7 @@ FUNCTION is called with two arguments, KEY and VALUE.
   ptrdiff_t i;
 
   for (i = 0; i < HASH_TABLE_SIZE (h); ++i)
-    if (!NILP (HASH_HASH (h, i)))
+    if (HASH_ENTRY_USED_P (h, i))
       {
 	args[0] = function;
 	args[1] = HASH_KEY (h, i);
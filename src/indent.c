@@ -114,7 +114,7 @@ disptab_matches_widthtab (struct Lisp_Char_Table *disptab, struct Lisp_Vector *w
 {
   int i;
 
-  eassert (widthtab->header.size == 256);
+  eassert ((widthtab->header.size & ~ARRAY_MARK_FLAG) == 256);
 
   for (i = 0; i < 256; i++)
     if (character_width (i, disptab)
@@ -135,7 +135,7 @@ recompute_width_table (struct buffer *buf, struct Lisp_Char_Table *disptab)
   if (!VECTORP (BVAR (buf, width_table)))
     bset_width_table (buf, make_uninit_vector (256));
   widthtab = XVECTOR (BVAR (buf, width_table));
-  eassert (widthtab->header.size == 256);
+  eassert ((widthtab->header.size & ~ARRAY_MARK_FLAG) == 256);
 
   for (i = 0; i < 256; i++)
     XSETFASTINT (widthtab->contents[i], character_width (i, disptab));
@@ -227,9 +227,6 @@ skip_invisible (ptrdiff_t pos, ptrdiff_t *next_boundary_p, ptrdiff_t to, Lisp_Ob
   XSETFASTINT (position, pos);
   XSETBUFFER (buffer, current_buffer);
 
-  /* Give faster response for overlay lookup near POS.  */
-  recenter_overlay_lists (current_buffer, pos);
-
   /* We must not advance farther than the next overlay change.
      The overlay change might change the invisible property;
      or there might be overlay strings to be displayed there.  */
@@ -501,7 +498,7 @@ check_display_width (ptrdiff_t pos, ptrdiff_t col, ptrdiff_t *endpos)
 	{
 	  ptrdiff_t start;
 	  if (OVERLAYP (overlay))
-	    *endpos = OVERLAY_POSITION (OVERLAY_END (overlay));
+	    *endpos = OVERLAY_END (overlay);
 	  else
 	    get_property_and_range (pos, Qdisplay, &val, &start, endpos, Qnil);
 	  return width;
@@ -29,6 +29,7 @@ along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.  */
 #include "window.h"
 #include "blockinput.h"
 #include "region-cache.h"
+#include "line-index.h"
 
 static void insert_from_string_1 (Lisp_Object, ptrdiff_t, ptrdiff_t, ptrdiff_t,
 				  ptrdiff_t, bool, bool);
@@ -237,6 +238,8 @@ adjust_markers_for_delete (ptrdiff_t from, ptrdiff_t from_byte,
   ptrdiff_t charpos;
 
   adjust_suspend_auto_hscroll (from, to);
+  adjust_charpos_index (from_byte, to_byte, from - to, from_byte - to_byte);
+  line_index_adjust (from_byte, to_byte, 0);
   for (m = BUF_MARKERS (current_buffer); m; m = m->next)
     {
       charpos = m->charpos;
@@ -272,11 +275,12 @@ adjust_markers_for_insert (ptrdiff_t from, ptrdiff_t from_byte,
 			   ptrdiff_t to, ptrdiff_t to_byte, bool before_markers)
 {
   struct Lisp_Marker *m;
-  bool adjusted = 0;
   ptrdiff_t nchars = to - from;
   ptrdiff_t nbytes = to_byte - from_byte;
 
   adjust_suspend_auto_hscroll (from, to);
+  adjust_charpos_index (from_byte, from_byte, nchars, nbytes);
+  line_index_adjust (from_byte, from_byte, nbytes);
   for (m = BUF_MARKERS (current_buffer); m; m = m->next)
     {
       eassert (m->bytepos >= m->charpos
@@ -288,8 +292,6 @@ adjust_markers_for_insert (ptrdiff_t from, ptrdiff_t from_byte,
 	    {
 	      m->bytepos = to_byte;
 	      m->charpos = to;
-	      if (m->insertion_type)
-		adjusted = 1;
 	    }
 	}
       else if (m->bytepos > from_byte)
@@ -298,15 +300,6 @@ adjust_markers_for_insert (ptrdiff_t from, ptrdiff_t from_byte,
 	  m->charpos += nchars;
 	}
     }
-
-  /* Adjusting only markers whose insertion-type is t may result in
-     - disordered start and end in overlays, and
-     - disordered overlays in the slot `overlays_before' of current_buffer.  */
-  if (adjusted)
-    {
-      fix_start_end_in_overlays (from, to);
-      fix_overlays_before (current_buffer, from, to);
-    }
 }
 
 /* Adjust point for an insertion of NBYTES bytes, which are NCHARS characters.
@@ -343,6 +336,8 @@ adjust_markers_for_replace (ptrdiff_t from, ptrdiff_t from_byte,
   ptrdiff_t diff_bytes = new_bytes - old_bytes;
 
   adjust_suspend_auto_hscroll (from, from + old_chars);
+  adjust_charpos_index (from_byte, prev_to_byte, diff_chars, diff_bytes);
+  line_index_adjust (from_byte, prev_to_byte, new_bytes);
   for (m = BUF_MARKERS (current_buffer); m; m = m->next)
     {
       if (m->bytepos >= prev_to_byte)
@@ -360,6 +355,33 @@ adjust_markers_for_replace (ptrdiff_t from, ptrdiff_t from_byte,
   check_markers ();
 }
 
+/* Update the position and line indexes of the current buffer for a
+   replacement that does not adjust the markers.  The arguments are as
+   for adjust_markers_for_replace.  */
+
+static void
+adjust_indexes_for_replace (ptrdiff_t from_byte,
+			    ptrdiff_t old_chars, ptrdiff_t old_bytes,
+			    ptrdiff_t new_chars, ptrdiff_t new_bytes)
+{
+  adjust_charpos_index (from_byte, from_byte + old_bytes,
+			new_chars - old_chars, new_bytes - old_bytes);
+  line_index_adjust (from_byte, from_byte + old_bytes, new_bytes);
+}
+
+/* Adjust overlays for a replacement of the OLD_CHARS characters at
+   FROM by NEW_CHARS new ones, the same way adjust_markers_for_replace
+   adjusts markers: ends at FROM stay put, ends inside the old text
+   collapse to FROM, and ends after it move along with the text.  */
+
+static void
+adjust_overlays_for_replace (ptrdiff_t from, ptrdiff_t old_chars,
+			     ptrdiff_t new_chars)
+{
+  adjust_overlays_for_insert (from + old_chars, new_chars, true);
+  adjust_overlays_for_delete (from, old_chars);
+}
+
 
 void
 buffer_overflow (void)
@@ -827,7 +849,7 @@ insert_1_both (const char *string,
   if (Z - GPT < END_UNCHANGED)
     END_UNCHANGED = Z - GPT;
 
-  adjust_overlays_for_insert (PT, nchars);
+  adjust_overlays_for_insert (PT, nchars, before_markers);
   adjust_markers_for_insert (PT, PT_BYTE,
 			     PT + nchars, PT_BYTE + nbytes,
 			     before_markers);
@@ -956,7 +978,7 @@ insert_from_string_1 (Lisp_Object string, ptrdiff_t pos, ptrdiff_t pos_byte,
   if (Z - GPT < END_UNCHANGED)
     END_UNCHANGED = Z - GPT;
 
-  adjust_overlays_for_insert (PT, nchars);
+  adjust_overlays_for_insert (PT, nchars, before_markers);
   adjust_markers_for_insert (PT, PT_BYTE, PT + nchars,
 			     PT_BYTE + outgoing_nbytes,
 			     before_markers);
@@ -1011,7 +1033,7 @@ insert_from_gap (ptrdiff_t nchars, ptrdiff_t nbytes, bool text_at_gap_tail)
 
   eassert (GPT <= GPT_BYTE);
 
-  adjust_overlays_for_insert (ins_charpos, nchars);
+  adjust_overlays_for_insert (ins_charpos, nchars, false);
   adjust_markers_for_insert (ins_charpos, ins_bytepos,
 			     ins_charpos + nchars, ins_bytepos + nbytes, 0);
 
@@ -1028,6 +1050,76 @@ insert_from_gap (ptrdiff_t nchars, ptrdiff_t nbytes, bool text_at_gap_tail)
   check_markers ();
 }
 
+/* Like insert_from_gap, but for text that is at GPT_ADDR with the gap
+   at point, and inserted the way `insert-before-markers' would insert
+   it.  Move point after the text and run the after-change hooks.
+   The caller must make sure that modifying the buffer at point runs
+   no Lisp code before the text is inserted; see
+   insertion_may_run_lisp.  */
+
+void
+insert_from_gap_before_markers (ptrdiff_t nchars, ptrdiff_t nbytes)
+{
+  ptrdiff_t opoint = PT;
+
+  if (NILP (BVAR (current_buffer, enable_multibyte_characters)))
+    nchars = nbytes;
+
+  eassert (PT == GPT && nbytes <= GAP_SIZE);
+  prepare_to_modify_buffer (PT, PT, NULL);
+
+  record_insert (PT, nchars);
+  MODIFF++;
+  CHARS_MODIFF = MODIFF;
+
+  GAP_SIZE -= nbytes;
+  GPT += nchars;
+  ZV += nchars;
+  Z += nchars;
+  GPT_BYTE += nbytes;
+  ZV_BYTE += nbytes;
+  Z_BYTE += nbytes;
+  if (GAP_SIZE > 0) *(GPT_ADDR) = 0; /* Put an anchor.  */
+
+  eassert (GPT <= GPT_BYTE);
+
+  if (Z - GPT < END_UNCHANGED)
+    END_UNCHANGED = Z - GPT;
+
+  adjust_overlays_for_insert (PT, nchars, true);
+  adjust_markers_for_insert (PT, PT_BYTE, PT + nchars, PT_BYTE + nbytes, true);
+  offset_intervals (current_buffer, PT, nchars);
+  graft_intervals_into_buffer (NULL, PT, nchars, current_buffer, 0);
+  adjust_point (nchars, nbytes);
+
+  check_markers ();
+
+  signal_after_change (opoint, 0, PT - opoint);
+  update_compositions (opoint, PT, CHECK_BORDER);
+}
+
+/* Return true if prepare_to_modify_buffer, called for an insertion
+   into the current buffer, might run Lisp code or signal an error,
+   apart from checking `buffer-read-only'.  */
+
+bool
+insertion_may_run_lisp (void)
+{
+  struct buffer *base_buffer = (current_buffer->base_buffer
+				? current_buffer->base_buffer
+				: current_buffer);
+
+  if (buffer_intervals (current_buffer))
+    return true;
+  if (inhibit_modification_hooks)
+    return false;
+  return (!NILP (BVAR (base_buffer, file_truename))
+	  || !NILP (BVAR (current_buffer, mark_active))
+	  || (MODIFF <= SAVE_MODIFF && !NILP (Vfirst_change_hook))
+	  || !NILP (Vbefore_change_functions)
+	  || buffer_has_overlays ());
+}
+
 /* Insert text from BUF, NCHARS characters starting at CHARPOS, into the
    current buffer.  If the text in BUF has properties, they are absorbed
    into the current buffer.
@@ -1153,7 +1245,7 @@ insert_from_buffer_1 (struct buffer *buf,
   if (Z - GPT < END_UNCHANGED)
     END_UNCHANGED = Z - GPT;
 
-  adjust_overlays_for_insert (PT, nchars);
+  adjust_overlays_for_insert (PT, nchars, false);
   adjust_markers_for_insert (PT, PT_BYTE, PT + nchars,
 			     PT_BYTE + outgoing_nbytes,
 			     0);
@@ -1218,10 +1310,10 @@ adjust_after_replace (ptrdiff_t from, ptrdiff_t from_byte,
     record_delete (from, prev_text, false);
   record_insert (from, len);
 
-  if (len > nchars_del)
-    adjust_overlays_for_insert (from, len - nchars_del);
-  else if (len < nchars_del)
-    adjust_overlays_for_delete (from, nchars_del - len);
+  if (nchars_del > 0)
+    adjust_overlays_for_replace (from, nchars_del, len);
+  else
+    adjust_overlays_for_insert (from, len, false);
 
   offset_intervals (current_buffer, from, len - nchars_del);
 
@@ -1398,11 +1490,13 @@ replace_range (ptrdiff_t from, ptrdiff_t to, Lisp_Object new,
   if (markers)
     adjust_markers_for_replace (from, from_byte, nchars_del, nbytes_del,
 				inschars, outgoing_insbytes);
+  else
+    adjust_indexes_for_replace (from_byte, nchars_del, nbytes_del,
+				inschars, outgoing_insbytes);
 
-  /* Adjust the overlay center as needed.  This must be done after
-     adjusting the markers that bound the overlays.  */
-  adjust_overlays_for_delete (from, nchars_del);
-  adjust_overlays_for_insert (from, inschars);
+  /* The overlays move like markers do.  */
+  if (markers)
+    adjust_overlays_for_replace (from, nchars_del, inschars);
 
   offset_intervals (current_buffer, from, inschars - nchars_del);
 
@@ -1513,16 +1607,14 @@ replace_range_2 (ptrdiff_t from, ptrdiff_t from_byte,
   /* Adjust markers for the deletion and the insertion.  */
   if (markers
       && ! (nchars_del == 1 && inschars == 1 && nbytes_del == insbytes))
-    adjust_markers_for_replace (from, from_byte, nchars_del, nbytes_del,
-				inschars, insbytes);
-
-  /* Adjust the overlay center as needed.  This must be done after
-     adjusting the markers that bound the overlays.  */
-  if (nchars_del != inschars)
     {
-      adjust_overlays_for_insert (from, inschars);
-      adjust_overlays_for_delete (from + inschars, nchars_del);
+      adjust_markers_for_replace (from, from_byte, nchars_del, nbytes_del,
+				  inschars, insbytes);
+      adjust_overlays_for_replace (from, nchars_del, inschars);
     }
+  else
+    adjust_indexes_for_replace (from_byte, nchars_del, nbytes_del,
+				inschars, insbytes);
 
   offset_intervals (current_buffer, from, inschars - nchars_del);
 
@@ -1911,6 +2003,9 @@ invalidate_buffer_caches (struct buffer *buf, ptrdiff_t start, ptrdiff_t end)
     invalidate_region_cache (buf,
                              buf->width_run_cache,
                              start - BUF_BEG (buf), BUF_Z (buf) - end);
+  if (buf->text->line_index)
+    line_index_invalidate (buf, buf_charpos_to_bytepos (buf, start),
+			   buf_charpos_to_bytepos (buf, end));
 }
 
 /* These macros work with an argument named `preserve_ptr'
@@ -0,0 +1,807 @@
+/* Interval trees for buffer overlays.
+
+Copyright (C) 2014 Free Software Foundation, Inc.
+
+This file is part of GNU Emacs.
+
+GNU Emacs is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+GNU Emacs is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.  */
+
+/* The overlays of a buffer used to be kept in two sorted lists split
+   at a movable "center", so that lookups near the center were cheap
+   but every lookup elsewhere, and every change of the text, cost time
+   proportional to the number of overlays.  This file implements the
+   augmented red-black tree that replaces those lists.
+
+   Each node is keyed by its BEGIN position and stores the maximum END
+   of its subtree in LIMIT, so that the nodes intersecting a range can
+   be enumerated in O(log N + K) time.  Insertion and deletion of text
+   are handled by shifting whole subtrees with a lazily propagated
+   OFFSET, touching only the O(log N) nodes on the search path plus
+   the K nodes that actually straddle the change.
+
+   Nodes are not allocated here; they are embedded in (or owned by)
+   the objects they describe, and this file only links them.  */
+
+#include <config.h>
+
+#include "lisp.h"
+#include "itree.h"
+
+/* Return a new, empty tree.  */
+
+struct itree_tree *
+itree_create (void)
+{
+  struct itree_tree *tree = xmalloc (sizeof *tree);
+  tree->root = NULL;
+  tree->otick = 1;
+  tree->size = 0;
+  return tree;
+}
+
+/* Unlink all nodes of TREE, leaving it empty.  The nodes themselves
+   are not freed.  */
+
+void
+itree_clear (struct itree_tree *tree)
+{
+  struct itree_node *node = tree->root;
+
+  /* Walk the tree in post-order, cutting each node loose once both of
+     its subtrees have been dealt with.  */
+  while (node)
+    {
+      if (node->left)
+	node = node->left;
+      else if (node->right)
+	node = node->right;
+      else
+	{
+	  struct itree_node *parent = node->parent;
+	  if (parent)
+	    {
+	      if (parent->left == node)
+		parent->left = NULL;
+	      else
+		parent->right = NULL;
+	    }
+	  node->parent = NULL;
+	  node = parent;
+	}
+    }
+  tree->root = NULL;
+  tree->size = 0;
+}
+
+/* Free TREE, which must be empty.  */
+
+void
+itree_destroy (struct itree_tree *tree)
+{
+  eassert (tree->root == NULL);
+  xfree (tree);
+}
+
+/* Initialize NODE, which is not in any tree, to represent DATA.
+   FRONT_ADVANCE and REAR_ADVANCE say whether its ends move when text
+   is inserted exactly at them.  */
+
+void
+itree_node_init (struct itree_node *node, bool front_advance,
+		 bool rear_advance, Lisp_Object data)
+{
+  node->parent = node->left = node->right = NULL;
+  node->begin = node->end = node->limit = -1;
+  node->offset = 0;
+  node->otick = 0;
+  node->data = data;
+  node->red = false;
+  node->front_advance = front_advance;
+  node->rear_advance = rear_advance;
+}
+
+
+/***********************************************************************
+			    Offsets and limits
+ ***********************************************************************/
+
+/* Shift all positions in the subtree rooted at NODE by DELTA.  The
+   children get the shift later, via itree_push.  */
+
+static void
+itree_shift (struct itree_node *node, ptrdiff_t delta)
+{
+  if (node)
+    {
+      node->begin += delta;
+      node->end += delta;
+      node->limit += delta;
+      node->offset += delta;
+    }
+}
+
+/* Hand NODE's pending offset down to its children.  The caller must
+   make sure that NODE's own positions are exact, i.e. that all of its
+   ancestors have already been pushed.  */
+
+static void
+itree_push (struct itree_node *node)
+{
+  if (node->offset)
+    {
+      itree_shift (node->left, node->offset);
+      itree_shift (node->right, node->offset);
+      node->offset = 0;
+    }
+}
+
+/* Recompute the LIMIT of NODE from its END and its children.  This
+   works whether or not NODE has a pending offset.  */
+
+static void
+itree_update_limit (struct itree_node *node)
+{
+  ptrdiff_t limit = node->end;
+
+  if (node->left && node->left->limit + node->offset > limit)
+    limit = node->left->limit + node->offset;
+  if (node->right && node->right->limit + node->offset > limit)
+    limit = node->right->limit + node->offset;
+  node->limit = limit;
+}
+
+/* Make the positions of NODE, a member of TREE, exact by pushing down
+   the pending offsets of all of its ancestors.  */
+
+static void
+itree_validate (struct itree_tree *tree, struct itree_node *node)
+{
+  if (node->otick == tree->otick)
+    return;
+  if (node->parent)
+    {
+      itree_validate (tree, node->parent);
+      itree_push (node->parent);
+    }
+  node->otick = tree->otick;
+}
+
+/* Return the start position of NODE, a member of TREE.  */
+
+ptrdiff_t
+itree_node_begin (struct itree_tree *tree, struct itree_node *node)
+{
+  itree_validate (tree, node);
+  return node->begin;
+}
+
+/* Return the end position of NODE, a member of TREE.  */
+
+ptrdiff_t
+itree_node_end (struct itree_tree *tree, struct itree_node *node)
+{
+  itree_validate (tree, node);
+  return node->end;
+}
+
+
+/***********************************************************************
+			   Red-black tree code
+ ***********************************************************************/
+
+/* Make CHILD take the place of OLD as a child of PARENT in TREE.  */
+
+static void
+itree_replace_child (struct itree_tree *tree, struct itree_node *parent,
+		     struct itree_node *old, struct itree_node *child)
+{
+  if (!parent)
+    tree->root = child;
+  else if (parent->left == old)
+    parent->left = child;
+  else
+    parent->right = child;
+  if (child)
+    child->parent = parent;
+}
+
+/* Rotate the subtree rooted at NODE to the left.  NODE's positions
+   must be exact.  */
+
+static void
+itree_rotate_left (struct itree_tree *tree, struct itree_node *node)
+{
+  struct itree_node *right = node->right;
+
+  itree_push (node);
+  itree_push (right);
+
+  node->right = right->left;
+  if (right->left)
+    right->left->parent = node;
+  itree_replace_child (tree, node->parent, node, right);
+  right->left = node;
+  node->parent = right;
+
+  itree_update_limit (node);
+  itree_update_limit (right);
+}
+
+/* Rotate the subtree rooted at NODE to the right.  NODE's positions
+   must be exact.  */
+
+static void
+itree_rotate_right (struct itree_tree *tree, struct itree_node *node)
+{
+  struct itree_node *left = node->left;
+
+  itree_push (node);
+  itree_push (left);
+
+  node->left = left->right;
+  if (left->right)
+    left->right->parent = node;
+  itree_replace_child (tree, node->parent, node, left);
+  left->right = node;
+  node->parent = left;
+
+  itree_update_limit (node);
+  itree_update_limit (left);
+}
+
+/* Restore the red-black properties after NODE has been inserted.  */
+
+static void
+itree_insert_fix (struct itree_tree *tree, struct itree_node *node)
+{
+  while (node->parent && node->parent->red)
+    {
+      struct itree_node *parent = node->parent;
+      struct itree_node *grandparent = parent->parent;
+
+      if (parent == grandparent->left)
+	{
+	  struct itree_node *uncle = grandparent->right;
+
+	  if (uncle && uncle->red)
+	    {
+	      parent->red = false;
+	      uncle->red = false;
+	      grandparent->red = true;
+	      node = grandparent;
+	    }
+	  else
+	    {
+	      if (node == parent->right)
+		{
+		  node = parent;
+		  itree_rotate_left (tree, node);
+		  parent = node->parent;
+		}
+	      parent->red = false;
+	      grandparent->red = true;
+	      itree_rotate_right (tree, grandparent);
+	    }
+	}
+      else
+	{
+	  struct itree_node *uncle = grandparent->left;
+
+	  if (uncle && uncle->red)
+	    {
+	      parent->red = false;
+	      uncle->red = false;
+	      grandparent->red = true;
+	      node = grandparent;
+	    }
+	  else
+	    {
+	      if (node == parent->left)
+		{
+		  node = parent;
+		  itree_rotate_right (tree, node);
+		  parent = node->parent;
+		}
+	      parent->red = false;
+	      grandparent->red = true;
+	      itree_rotate_left (tree, grandparent);
+	    }
+	}
+    }
+  tree->root->red = false;
+}
+
+/* Insert NODE, which must not be in any tree, into TREE as the range
+   from BEGIN to END.  */
+
+void
+itree_insert (struct itree_tree *tree, struct itree_node *node,
+	      ptrdiff_t begin, ptrdiff_t end)
+{
+  struct itree_node *parent = NULL;
+  struct itree_node *child = tree->root;
+
+  eassert (begin <= end);
+  eassert (!node->parent && !node->left && !node->right);
+
+  node->begin = begin;
+  node->end = end;
+  node->limit = end;
+  node->offset = 0;
+
+  /* Find the insertion point, making positions exact on the way down
+     and widening the limits of the future ancestors.  */
+  while (child)
+    {
+      itree_push (child);
+      if (child->limit < end)
+	child->limit = end;
+      parent = child;
+      child = begin < child->begin ? child->left : child->right;
+    }
+
+  node->parent = parent;
+  if (!parent)
+    tree->root = node;
+  else if (begin < parent->begin)
+    parent->left = node;
+  else
+    parent->right = node;
+  node->red = true;
+  node->otick = tree->otick;
+  tree->size++;
+
+  itree_insert_fix (tree, node);
+}
+
+/* Restore the red-black properties after a black node has been
+   removed from below PARENT; NODE, possibly null, is the child of
+   PARENT that is now one black node short.  */
+
+static void
+itree_remove_fix (struct itree_tree *tree, struct itree_node *node,
+		  struct itree_node *parent)
+{
+  while (parent && (!node || !node->red))
+    {
+      if (node == parent->left)
+	{
+	  struct itree_node *other = parent->right;
+
+	  if (other->red)
+	    {
+	      other->red = false;
+	      parent->red = true;
+	      itree_rotate_left (tree, parent);
+	      other = parent->right;
+	    }
+
+	  if ((!other->left || !other->left->red)
+	      && (!other->right || !other->right->red))
+	    {
+	      other->red = true;
+	      node = parent;
+	      parent = node->parent;
+	    }
+	  else
+	    {
+	      if (!other->right || !other->right->red)
+		{
+		  other->left->red = false;
+		  other->red = true;
+		  itree_rotate_right (tree, other);
+		  other = parent->right;
+		}
+	      other->red = parent->red;
+	      parent->red = false;
+	      if (other->right)
+		other->right->red = false;
+	      itree_rotate_left (tree, parent);
+	      node = tree->root;
+	      parent = NULL;
+	    }
+	}
+      else
+	{
+	  struct itree_node *other = parent->left;
+
+	  if (other->red)
+	    {
+	      other->red = false;
+	      parent->red = true;
+	      itree_rotate_right (tree, parent);
+	      other = parent->left;
+	    }
+
+	  if ((!other->right || !other->right->red)
+	      && (!other->left || !other->left->red))
+	    {
+	      other->red = true;
+	      node = parent;
+	      parent = node->parent;
+	    }
+	  else
+	    {
+	      if (!other->left || !other->left->red)
+		{
+		  other->right->red = false;
+		  other->red = true;
+		  itree_rotate_left (tree, other);
+		  other = parent->left;
+		}
+	      other->red = parent->red;
+	      parent->red = false;
+	      if (other->left)
+		other->left->red = false;
+	      itree_rotate_right (tree, parent);
+	      node = tree->root;
+	      parent = NULL;
+	    }
+	}
+    }
+
+  if (node)
+    node->red = false;
+}
+
+/* Remove NODE from TREE.  */
+
+void
+itree_remove (struct itree_tree *tree, struct itree_node *node)
+{
+  struct itree_node *splice, *subtree, *parent, *p;
+  bool removed_black;
+
+  eassert (node->parent || tree->root == node);
+
+  /* Make the positions of NODE, of its children and of its successor
+     exact, so that nodes can be moved around freely below.  */
+  itree_validate (tree, node);
+  itree_push (node);
+
+  if (!node->left || !node->right)
+    splice = node;
+  else
+    {
+      splice = node->right;
+      itree_push (splice);
+      while (splice->left)
+	{
+	  splice = splice->left;
+	  itree_push (splice);
+	}
+    }
+
+  /* SPLICE has at most one child; cut it out of the tree.  */
+  subtree = splice->left ? splice->left : splice->right;
+  parent = splice->parent;
+  removed_black = !splice->red;
+  itree_replace_child (tree, parent, splice, subtree);
+
+  /* If SPLICE is NODE's successor, let it take NODE's place.  */
+  if (splice != node)
+    {
+      if (parent == node)
+	parent = splice;
+      splice->left = node->left;
+      if (splice->left)
+	splice->left->parent = splice;
+      splice->right = node->right;
+      if (splice->right)
+	splice->right->parent = splice;
+      splice->red = node->red;
+      itree_replace_child (tree, node->parent, node, splice);
+    }
+
+  for (p = parent; p; p = p->parent)
+    itree_update_limit (p);
+
+  if (removed_black)
+    itree_remove_fix (tree, subtree, parent);
+
+  node->parent = node->left = node->right = NULL;
+  tree->size--;
+}
+
+
+/***********************************************************************
+			      Text changes
+ ***********************************************************************/
+
+/* Subroutine of itree_insert_gap.  Adjust the subtree rooted at NODE,
+   whose positions are exact, for the insertion of LENGTH characters at
+   POS.  No node in the subtree starts at POS and has to move.  */
+
+static void
+itree_insert_gap_1 (struct itree_node *node, ptrdiff_t pos,
+		    ptrdiff_t length, bool before_markers)
+{
+  itree_push (node);
+  if (node->begin > pos)
+    {
+      /* Everything in the right subtree moves as a whole.  */
+      itree_shift (node->right, length);
+      node->begin += length;
+      node->end += length;
+      if (node->left)
+	itree_insert_gap_1 (node->left, pos, length, before_markers);
+    }
+  else
+    {
+      if (node->end > pos
+	  || (node->end == pos && (before_markers || node->rear_advance)))
+	node->end += length;
+      if (node->right)
+	itree_insert_gap_1 (node->right, pos, length, before_markers);
+      /* Nodes to the left start at or before POS; only those that
+	 reach POS can be affected.  */
+      if (node->left && node->left->limit >= pos)
+	itree_insert_gap_1 (node->left, pos, length, before_markers);
+    }
+  itree_update_limit (node);
+}
+
+/* Adjust the nodes of TREE for the insertion of LENGTH characters at
+   POS.  Ends of nodes at POS move past the inserted text if they are
+   advancing (see itree_node_init) or if BEFORE_MARKERS is true.  An
+   empty node whose front advances but whose rear doesn't stays empty,
+   before the new text.  */
+
+void
+itree_insert_gap (struct itree_tree *tree, ptrdiff_t pos, ptrdiff_t length,
+		  bool before_markers)
+{
+  struct itree_iterator iter;
+  struct itree_node *node;
+  struct itree_node *movebuf[16];
+  struct itree_node **moving = movebuf;
+  ptrdiff_t nmoving = 0, nalloc = ARRAYELTS (movebuf), i;
+
+  if (itree_empty_p (tree) || length <= 0)
+    return;
+
+  /* Nodes starting at POS whose start moves would end up out of order
+     among the ones that stay; take them out and put them back
+     afterwards.  */
+  itree_iterator_start (&iter, tree, pos, pos, true);
+  while ((node = itree_iterator_next (&iter)))
+    if (node->begin == pos
+	&& (before_markers
+	    || (node->front_advance
+		&& (node->begin != node->end || node->rear_advance))))
+      {
+	if (nmoving == nalloc)
+	  {
+	    if (moving == movebuf)
+	      {
+		moving = xnmalloc (2 * nalloc, sizeof *moving);
+		memcpy (moving, movebuf, sizeof movebuf);
+		nalloc *= 2;
+	      }
+	    else
+	      moving = xpalloc (moving, &nalloc, 1, -1, sizeof *moving);
+	  }
+	moving[nmoving++] = node;
+      }
+
+  for (i = 0; i < nmoving; i++)
+    {
+      /* Remember the end position; the tree forgets it on removal.  */
+      ptrdiff_t end = moving[i]->end;
+      itree_remove (tree, moving[i]);
+      moving[i]->end = end;
+    }
+
+  if (tree->root)
+    itree_insert_gap_1 (tree->root, pos, length, before_markers);
+  tree->otick++;
+
+  for (i = 0; i < nmoving; i++)
+    itree_insert (tree, moving[i], pos + length, moving[i]->end + length);
+
+  if (moving != movebuf)
+    xfree (moving);
+}
+
+/* Subroutine of itree_delete_gap.  Adjust the subtree rooted at NODE,
+   whose positions are exact, for the deletion of the LENGTH characters
+   after POS.  */
+
+static void
+itree_delete_gap_1 (struct itree_node *node, ptrdiff_t pos,
+		    ptrdiff_t length)
+{
+  ptrdiff_t del_end = pos + length;
+
+  itree_push (node);
+  if (node->begin >= del_end)
+    {
+      itree_shift (node->right, -length);
+      node->begin -= length;
+      node->end -= length;
+      if (node->left)
+	itree_delete_gap_1 (node->left, pos, length);
+    }
+  else
+    {
+      if (node->begin > pos)
+	node->begin = pos;
+      if (node->end >= del_end)
+	node->end -= length;
+      else if (node->end > pos)
+	node->end = pos;
+      if (node->right)
+	itree_delete_gap_1 (node->right, pos, length);
+      if (node->left && node->left->limit > pos)
+	itree_delete_gap_1 (node->left, pos, length);
+    }
+  itree_update_limit (node);
+}
+
+/* Adjust the nodes of TREE for the deletion of the LENGTH characters
+   after POS.  Positions inside the deleted text collapse to POS.
+   Since this never changes the relative order of the starts, no node
+   has to be moved.  */
+
+void
+itree_delete_gap (struct itree_tree *tree, ptrdiff_t pos, ptrdiff_t length)
+{
+  if (itree_empty_p (tree) || length <= 0)
+    return;
+
+  itree_delete_gap_1 (tree->root, pos, length);
+  tree->otick++;
+}
+
+
+/***********************************************************************
+				Searching
+ ***********************************************************************/
+
+/* Return the first node in ascending order, in the subtree rooted at
+   NODE, that could intersect a range starting at BEGIN.  NODE's
+   positions must be exact and its LIMIT at least BEGIN.  */
+
+static struct itree_node *
+itree_leftmost (struct itree_node *node, ptrdiff_t begin)
+{
+  itree_push (node);
+  while (node->left && node->left->limit >= begin)
+    {
+      node = node->left;
+      itree_push (node);
+    }
+  return node;
+}
+
+/* Likewise for descending order and the range BEGIN to END.  */
+
+static struct itree_node *
+itree_rightmost (struct itree_node *node, ptrdiff_t begin, ptrdiff_t end)
+{
+  for (;;)
+    {
+      itree_push (node);
+      if (node->begin > end)
+	{
+	  /* NODE and its right subtree lie beyond the range.  */
+	  if (node->left && node->left->limit >= begin)
+	    node = node->left;
+	  else
+	    return node;
+	}
+      else if (node->right && node->right->limit >= begin)
+	node = node->right;
+      else
+	return node;
+    }
+}
+
+/* Return the node that follows NODE in the search ITER, without
+   checking whether it intersects the range.  */
+
+static struct itree_node *
+itree_iterator_successor (struct itree_iterator *iter,
+			  struct itree_node *node)
+{
+  itree_push (node);
+  if (iter->ascending)
+    {
+      if (node->right && node->right->limit >= iter->begin)
+	return itree_leftmost (node->right, iter->begin);
+      while (node->parent && node == node->parent->right)
+	node = node->parent;
+    }
+  else
+    {
+      if (node->left && node->left->limit >= iter->begin)
+	return itree_rightmost (node->left, iter->begin, iter->end);
+      while (node->parent && node == node->parent->left)
+	node = node->parent;
+    }
+  return node->parent;
+}
+
+/* Start ITER on a search of TREE for the nodes intersecting the range
+   from BEGIN to END inclusive, in order of increasing start position
+   if ASCENDING, and of decreasing start position otherwise.  */
+
+void
+itree_iterator_start (struct itree_iterator *iter, struct itree_tree *tree,
+		      ptrdiff_t begin, ptrdiff_t end, bool ascending)
+{
+  iter->begin = begin;
+  iter->end = end;
+  iter->ascending = ascending;
+  iter->node = NULL;
+  if (!itree_empty_p (tree) && tree->root->limit >= begin)
+    iter->node = (ascending
+		  ? itree_leftmost (tree->root, begin)
+		  : itree_rightmost (tree->root, begin, end));
+}
+
+/* Return the next node found by ITER, or NULL if there are no more.
+   The positions of the node returned are exact.  */
+
+struct itree_node *
+itree_iterator_next (struct itree_iterator *iter)
+{
+  struct itree_node *node;
+
+  while ((node = iter->node))
+    {
+      if (iter->ascending && node->begin > iter->end)
+	{
+	  /* All the remaining nodes start after the range.  */
+	  iter->node = NULL;
+	  return NULL;
+	}
+      iter->node = itree_iterator_successor (iter, node);
+      if (node->begin <= iter->end && node->end >= iter->begin)
+	return node;
+    }
+  return NULL;
+}
+
+/* Return the first node of TREE in tree order, or NULL if TREE is
+   empty.  Use this and itree_next to visit every node without caring
+   about positions.  */
+
+struct itree_node *
+itree_first (struct itree_tree *tree)
+{
+  struct itree_node *node = tree ? tree->root : NULL;
+
+  if (node)
+    while (node->left)
+      node = node->left;
+  return node;
+}
+
+/* Return the node after NODE in tree order, or NULL.  */
+
+struct itree_node *
+itree_next (struct itree_node *node)
+{
+  if (node->right)
+    {
+      node = node->right;
+      while (node->left)
+	node = node->left;
+      return node;
+    }
+  while (node->parent && node == node->parent->right)
+    node = node->parent;
+  return node->parent;
+}
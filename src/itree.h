@@ -0,0 +1,136 @@
+/* Interval trees for buffer overlays.
+
+Copyright (C) 2014 Free Software Foundation, Inc.
+
+This file is part of GNU Emacs.
+
+GNU Emacs is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+GNU Emacs is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef EMACS_ITREE_H
+#define EMACS_ITREE_H
+
+#include <stddef.h>
+
+INLINE_HEADER_BEGIN
+
+/* An interval tree is a red-black tree of nodes, each representing
+   a closed range [BEGIN, END] of character positions, ordered by
+   BEGIN.  Every node also records the largest END found in its
+   subtree (LIMIT), which lets searches skip whole subtrees that end
+   before the range of interest.
+
+   Buffer text changes shift every node that lies after the change.
+   Rather than visiting all of them, the shift is recorded in the
+   OFFSET field of the root of each subtree that moves as a whole,
+   and pushed down to the children lazily, whenever a search or an
+   update walks through that node.  The position fields of a node are
+   therefore exact only when all of its ancestors have a zero OFFSET;
+   use itree_node_begin and itree_node_end to read them from outside
+   this module.  */
+
+struct itree_node
+{
+  /* The tree links.  PARENT is NULL for the root.  */
+  struct itree_node *parent;
+  struct itree_node *left;
+  struct itree_node *right;
+
+  /* The range covered by this node, and the largest END in the
+     subtree rooted here.  All three are relative to the pending
+     offsets of the ancestors.  */
+  ptrdiff_t begin;
+  ptrdiff_t end;
+  ptrdiff_t limit;
+
+  /* Amount to add to all positions in both child subtrees.  */
+  ptrdiff_t offset;
+
+  /* Value of the tree's OTICK when BEGIN and END were last known to
+     be exact.  */
+  uintmax_t otick;
+
+  /* The Lisp object this node belongs to; an overlay, for buffers.  */
+  Lisp_Object data;
+
+  bool_bf red : 1;
+  /* Whether BEGIN (resp. END) moves when text is inserted exactly
+     there, like the insertion type of a marker.  */
+  bool_bf front_advance : 1;
+  bool_bf rear_advance : 1;
+};
+
+struct itree_tree
+{
+  struct itree_node *root;
+  /* Incremented whenever some node gets a new pending offset.  */
+  uintmax_t otick;
+  /* Number of nodes in the tree.  */
+  ptrdiff_t size;
+};
+
+/* State of a search for the nodes whose range intersects [BEGIN, END].
+   The search may be narrowed while it is running by moving BEGIN
+   forward or END backward.  The tree must not be modified while a
+   search is in progress.  */
+
+struct itree_iterator
+{
+  struct itree_node *node;
+  ptrdiff_t begin;
+  ptrdiff_t end;
+  bool ascending;
+};
+
+extern struct itree_tree *itree_create (void);
+extern void itree_clear (struct itree_tree *);
+extern void itree_destroy (struct itree_tree *);
+extern void itree_node_init (struct itree_node *, bool, bool, Lisp_Object);
+extern void itree_insert (struct itree_tree *, struct itree_node *,
+			  ptrdiff_t, ptrdiff_t);
+extern void itree_remove (struct itree_tree *, struct itree_node *);
+extern ptrdiff_t itree_node_begin (struct itree_tree *, struct itree_node *);
+extern ptrdiff_t itree_node_end (struct itree_tree *, struct itree_node *);
+extern void itree_insert_gap (struct itree_tree *, ptrdiff_t, ptrdiff_t,
+			      bool);
+extern void itree_delete_gap (struct itree_tree *, ptrdiff_t, ptrdiff_t);
+extern void itree_iterator_start (struct itree_iterator *,
+				  struct itree_tree *, ptrdiff_t, ptrdiff_t,
+				  bool);
+extern struct itree_node *itree_iterator_next (struct itree_iterator *);
+extern struct itree_node *itree_first (struct itree_tree *);
+extern struct itree_node *itree_next (struct itree_node *);
+
+/* Return true if TREE contains no nodes.  */
+
+INLINE bool
+itree_empty_p (struct itree_tree *tree)
+{
+  return !tree || !tree->root;
+}
+
+/* Restrict the search of ITER to nodes intersecting [BEGIN, END].
+   The new range must lie within the old one.  */
+
+INLINE void
+itree_iterator_narrow (struct itree_iterator *iter,
+		       ptrdiff_t begin, ptrdiff_t end)
+{
+  eassert (iter->begin <= begin && end <= iter->end);
+  iter->begin = begin;
+  iter->end = end;
+}
+
+INLINE_HEADER_END
+
+#endif /* EMACS_ITREE_H */
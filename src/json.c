@@ -0,0 +1,1296 @@
+/* JSON parsing and serialization.
+
+Copyright (C) 2014 Free Software Foundation, Inc.
+
+This file is part of GNU Emacs.
+
+GNU Emacs is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+GNU Emacs is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.  */
+
+/* The parser reads UTF-8 text straight from a string or from the text
+   of a buffer, on both sides of the gap, and builds the Lisp objects
+   as it goes.  Valid UTF-8 for a character other than a surrogate is
+   the same as the internal representation of that character, so
+   strings need no decoding beyond their escape sequences.  The
+   serializer writes UTF-8 into a malloc'd buffer, from which
+   `json-serialize' makes a string and `json-insert' inserts text.  */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <ftoastr.h>
+
+#include "lisp.h"
+#include "character.h"
+#include "buffer.h"
+#include "composite.h"
+
+static Lisp_Object Qjson_error, Qjson_parse_error, Qjson_end_of_file;
+static Lisp_Object Qjson_trailing_content, Qjson_object_too_deep;
+static Lisp_Object Qjson_value_p, Qutf_8_string_p;
+static Lisp_Object QCobject_type, QCarray_type, QCnull_object, QCfalse_object;
+static Lisp_Object QCnull, QCfalse;
+static Lisp_Object Qhash_table, Qalist, Qplist, Qarray, Qlist;
+
+/* How deeply arrays and objects may nest, when parsing and when
+   serializing.  This bounds the recursion of both.  */
+enum { JSON_MAX_DEPTH = 10000 };
+
+enum json_object_type
+  {
+    json_object_hashtable,
+    json_object_alist,
+    json_object_plist
+  };
+
+enum json_array_type
+  {
+    json_array_array,
+    json_array_list
+  };
+
+struct json_configuration
+{
+  enum json_object_type object_type;
+  enum json_array_type array_type;
+  Lisp_Object null_object;
+  Lisp_Object false_object;
+};
+
+/* Set up CONF from the NARGS keyword arguments at ARGS.  If
+   PARSE_OBJECT_TYPES, accept :object-type and :array-type too.  */
+
+static void
+json_parse_args (ptrdiff_t nargs, Lisp_Object *args,
+		 struct json_configuration *conf, bool parse_object_types)
+{
+  ptrdiff_t i;
+
+  conf->object_type = json_object_hashtable;
+  conf->array_type = json_array_array;
+  conf->null_object = QCnull;
+  conf->false_object = QCfalse;
+
+  if (nargs % 2 != 0)
+    signal_error ("Odd number of keyword arguments", Flist (nargs, args));
+
+  /* Go backwards, so that the first occurrence of a keyword wins.  */
+  for (i = nargs; i > 0; i -= 2)
+    {
+      Lisp_Object key = args[i - 2], value = args[i - 1];
+      if (parse_object_types && EQ (key, QCobject_type))
+	{
+	  if (EQ (value, Qhash_table))
+	    conf->object_type = json_object_hashtable;
+	  else if (EQ (value, Qalist))
+	    conf->object_type = json_object_alist;
+	  else if (EQ (value, Qplist))
+	    conf->object_type = json_object_plist;
+	  else
+	    signal_error ("Invalid :object-type", value);
+	}
+      else if (parse_object_types && EQ (key, QCarray_type))
+	{
+	  if (EQ (value, Qarray))
+	    conf->array_type = json_array_array;
+	  else if (EQ (value, Qlist))
+	    conf->array_type = json_array_list;
+	  else
+	    signal_error ("Invalid :array-type", value);
+	}
+      else if (EQ (key, QCnull_object))
+	conf->null_object = value;
+      else if (EQ (key, QCfalse_object))
+	conf->false_object = value;
+      else
+	signal_error ("Invalid keyword argument", key);
+    }
+}
+
+/* If the bytes from P to END start with the UTF-8 sequence of a
+   character other than ASCII and the surrogates, return its length,
+   else 0.  */
+
+static int
+json_utf_8_length (unsigned char const *p, unsigned char const *end)
+{
+  int c = p[0], len, i;
+  unsigned char min = 0x80, max = 0xBF;
+
+  if (0xC2 <= c && c <= 0xDF)
+    len = 2;
+  else if (0xE0 <= c && c <= 0xEF)
+    {
+      len = 3;
+      if (c == 0xE0)
+	min = 0xA0;
+      else if (c == 0xED)
+	max = 0x9F;
+    }
+  else if (0xF0 <= c && c <= 0xF4)
+    {
+      len = 4;
+      if (c == 0xF0)
+	min = 0x90;
+      else if (c == 0xF4)
+	max = 0x8F;
+    }
+  else
+    return 0;
+
+  if (end - p < len || p[1] < min || max < p[1])
+    return 0;
+  for (i = 2; i < len; i++)
+    if ((p[i] & 0xC0) != 0x80)
+      return 0;
+  return len;
+}
+
+
+/* Parsing.  */
+
+struct json_parser
+{
+  /* The input that is left: the bytes from INPUT_CURRENT to INPUT_END,
+     and then those from SECONDARY_BEGIN to SECONDARY_END.  For a
+     buffer, the second part is the text after the gap.  */
+  unsigned char const *input_begin, *input_current, *input_end;
+  unsigned char const *secondary_begin, *secondary_end;
+
+  /* The byte offset of INPUT_BEGIN in the input.  */
+  ptrdiff_t input_offset;
+
+  /* The string or buffer being parsed, and the byte position in it
+     where the input starts.  */
+  Lisp_Object object;
+  ptrdiff_t start_byte;
+
+  struct json_configuration conf;
+
+  /* How many arrays and objects enclose the current value.  */
+  int depth;
+
+  /* The elements of the arrays and the members of the objects being
+     parsed, innermost last.  */
+  Lisp_Object stack;
+  ptrdiff_t stack_used;
+
+  /* Scratch space for the bytes of strings and numbers.  */
+  unsigned char *buf;
+  ptrdiff_t buf_size;
+};
+
+static void
+json_parser_done (void *parser)
+{
+  struct json_parser *p = parser;
+  xfree (p->buf);
+#ifdef REL_ALLOC
+  if (BUFFERP (p->object))
+    r_alloc_inhibit_buffer_relocation (0);
+#endif
+}
+
+/* Return the byte offset in the input of the next byte to read.  */
+
+static ptrdiff_t
+json_offset (struct json_parser *p)
+{
+  return p->input_offset + (p->input_current - p->input_begin);
+}
+
+/* Signal ERROR, a json-parse-error, with MESSAGE and the position of
+   the byte at OFFSET in the input.  */
+
+static _Noreturn void
+json_signal_error_at (struct json_parser *p, ptrdiff_t offset,
+		      Lisp_Object error, const char *message)
+{
+  ptrdiff_t byte = p->start_byte + offset, pos;
+
+  if (BUFFERP (p->object))
+    {
+      if (!NILP (BVAR (current_buffer, enable_multibyte_characters)))
+	while (BEGV_BYTE < byte && byte < ZV_BYTE
+	       && !CHAR_HEAD_P (FETCH_BYTE (byte)))
+	  byte--;
+      pos = BYTE_TO_CHAR (byte);
+    }
+  else
+    {
+      if (STRING_MULTIBYTE (p->object))
+	while (0 < byte && byte < SBYTES (p->object)
+	       && !CHAR_HEAD_P (SREF (p->object, byte)))
+	  byte--;
+      pos = string_byte_to_char (p->object, byte);
+    }
+  xsignal2 (error, build_string (message), make_number (pos));
+}
+
+/* Signal ERROR with MESSAGE and the position where parsing stopped.  */
+
+static _Noreturn void
+json_signal_error (struct json_parser *p, Lisp_Object error,
+		   const char *message)
+{
+  json_signal_error_at (p, json_offset (p), error, message);
+}
+
+/* Move on to the second part of the input, if there is one.  */
+
+static bool
+json_input_switch (struct json_parser *p)
+{
+  if (!p->secondary_begin)
+    return false;
+  p->input_offset += p->input_end - p->input_begin;
+  p->input_begin = p->input_current = p->secondary_begin;
+  p->input_end = p->secondary_end;
+  p->secondary_begin = p->secondary_end = NULL;
+  return p->input_current < p->input_end;
+}
+
+/* Read the next byte, or return -1 at the end of the input.  */
+
+static int
+json_input_get (struct json_parser *p)
+{
+  if (p->input_current == p->input_end && !json_input_switch (p))
+    return -1;
+  return *p->input_current++;
+}
+
+/* Return the next byte without reading it, or -1 at the end.  */
+
+static int
+json_input_peek (struct json_parser *p)
+{
+  if (p->input_current == p->input_end && !json_input_switch (p))
+    return -1;
+  return *p->input_current;
+}
+
+/* Read the next byte, signaling an error at the end of the input.  */
+
+static int
+json_input_get_more (struct json_parser *p)
+{
+  int c = json_input_get (p);
+  if (c < 0)
+    json_signal_error (p, Qjson_end_of_file, "Unexpected end of input");
+  return c;
+}
+
+/* Skip white space, and read and return the byte after it, or -1.  */
+
+static int
+json_skip_whitespace (struct json_parser *p)
+{
+  int c;
+  do
+    c = json_input_get (p);
+  while (c == ' ' || c == '\t' || c == '\n' || c == '\r');
+  return c;
+}
+
+/* Make room for N more bytes after the first USED in the scratch
+   buffer.  */
+
+static void
+json_buf_reserve (struct json_parser *p, ptrdiff_t used, ptrdiff_t n)
+{
+  if (p->buf_size - used < n)
+    p->buf = xpalloc (p->buf, &p->buf_size, n - (p->buf_size - used), -1, 1);
+}
+
+static void
+json_push (struct json_parser *p, Lisp_Object obj)
+{
+  if (p->stack_used == ASIZE (p->stack))
+    p->stack = larger_vector (p->stack, 1, -1);
+  ASET (p->stack, p->stack_used++, obj);
+}
+
+/* Read the four hexadecimal digits of a \u escape.  */
+
+static int
+json_parse_hex (struct json_parser *p)
+{
+  int i, c, value = 0;
+
+  for (i = 0; i < 4; i++)
+    {
+      c = json_input_get_more (p);
+      if ('0' <= c && c <= '9')
+	c -= '0';
+      else if ('a' <= c && c <= 'f')
+	c -= 'a' - 10;
+      else if ('A' <= c && c <= 'F')
+	c -= 'A' - 10;
+      else
+	json_signal_error (p, Qjson_parse_error, "Invalid \\u escape");
+      value = (value << 4) | c;
+    }
+  return value;
+}
+
+/* Read the rest of a string, whose opening quote has been read, into
+   the scratch buffer after its first START bytes.  Return the number
+   of bytes of the string, and store its number of characters in
+   *NCHARS.  */
+
+static ptrdiff_t
+json_parse_string_bytes (struct json_parser *p, ptrdiff_t start,
+			 ptrdiff_t *nchars)
+{
+  ptrdiff_t n = start, chars = 0;
+
+  while (true)
+    {
+      unsigned char const *s = p->input_current, *q = s;
+      int c;
+
+      /* Copy a run of ASCII that needs no escaping in one go.  */
+      while (q < p->input_end && 0x20 <= *q && *q < 0x80
+	     && *q != '"' && *q != '\\')
+	q++;
+      if (q != s)
+	{
+	  json_buf_reserve (p, n, q - s);
+	  memcpy (p->buf + n, s, q - s);
+	  n += q - s;
+	  chars += q - s;
+	  p->input_current = q;
+	}
+
+      c = json_input_get (p);
+      if (c < 0)
+	json_signal_error (p, Qjson_end_of_file, "Unterminated string");
+      json_buf_reserve (p, n, MAX_MULTIBYTE_LENGTH);
+      if (c == '"')
+	break;
+      else if (c == '\\')
+	{
+	  c = json_input_get_more (p);
+	  switch (c)
+	    {
+	    case '"': case '\\': case '/': break;
+	    case 'b': c = '\b'; break;
+	    case 'f': c = '\f'; break;
+	    case 'n': c = '\n'; break;
+	    case 'r': c = '\r'; break;
+	    case 't': c = '\t'; break;
+	    case 'u':
+	      c = json_parse_hex (p);
+	      if (0xDC00 <= c && c <= 0xDFFF)
+		json_signal_error (p, Qjson_parse_error,
+				   "Invalid surrogate in \\u escape");
+	      if (0xD800 <= c && c <= 0xDBFF)
+		{
+		  int low;
+		  if (json_input_get_more (p) != '\\'
+		      || json_input_get_more (p) != 'u')
+		    json_signal_error (p, Qjson_parse_error,
+				       "Invalid surrogate in \\u escape");
+		  low = json_parse_hex (p);
+		  if (! (0xDC00 <= low && low <= 0xDFFF))
+		    json_signal_error (p, Qjson_parse_error,
+				       "Invalid surrogate in \\u escape");
+		  c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+		}
+	      break;
+	    default:
+	      json_signal_error (p, Qjson_parse_error,
+				 "Invalid escape sequence");
+	    }
+	  n += CHAR_STRING (c, p->buf + n);
+	}
+      else if (c < 0x20)
+	json_signal_error (p, Qjson_parse_error,
+			   "Control character in string");
+      else if (c < 0x80)
+	p->buf[n++] = c;
+      else
+	{
+	  /* Copy the UTF-8 sequence, which can straddle the gap, byte
+	     by byte.  */
+	  unsigned char seq[4];
+	  int i, len = (c < 0xE0 ? 2 : c < 0xF0 ? 3 : 4);
+	  ptrdiff_t seq_start = json_offset (p) - 1;
+	  seq[0] = c;
+	  for (i = 1; i < len; i++)
+	    {
+	      int c1 = json_input_peek (p);
+	      if (c1 < 0)
+		break;
+	      seq[i] = c1;
+	      p->input_current++;
+	    }
+	  if (json_utf_8_length (seq, seq + i) != len)
+	    json_signal_error_at (p, seq_start, Qjson_parse_error,
+				  "Invalid UTF-8");
+	  memcpy (p->buf + n, seq, len);
+	  n += len;
+	}
+      chars++;
+    }
+
+  *nchars = chars;
+  return n - start;
+}
+
+static Lisp_Object
+json_parse_string (struct json_parser *p)
+{
+  ptrdiff_t nchars, nbytes = json_parse_string_bytes (p, 0, &nchars);
+  return make_specified_string ((char *) p->buf, nchars, nbytes,
+				nchars != nbytes);
+}
+
+/* Return the symbol whose name has the NBYTES bytes and NCHARS
+   characters at the start of the scratch buffer.  */
+
+static Lisp_Object
+json_intern (struct json_parser *p, ptrdiff_t nchars, ptrdiff_t nbytes)
+{
+  Lisp_Object obarray = check_obarray (Vobarray);
+  Lisp_Object sym = oblookup (obarray, (char *) p->buf, nchars, nbytes);
+  if (SYMBOLP (sym))
+    return sym;
+  return Fintern (make_specified_string ((char *) p->buf, nchars, nbytes,
+					 nchars != nbytes),
+		  obarray);
+}
+
+/* Read the rest of a number whose first byte is C.  */
+
+static Lisp_Object
+json_parse_number (struct json_parser *p, int c)
+{
+  ptrdiff_t n = 0;
+  bool negative = c == '-', is_float = false;
+
+  /* Add C to the number in the scratch buffer, and read the next byte
+     if it is a digit.  */
+#define ADD_BYTE(c)					\
+  do {							\
+    json_buf_reserve (p, n, 2);				\
+    p->buf[n++] = (c);					\
+  } while (false)
+#define ADD_DIGITS()					\
+  do {							\
+    int d = json_input_peek (p);			\
+    if (! ('0' <= d && d <= '9'))			\
+      json_signal_error (p, Qjson_parse_error,		\
+			 "Invalid number");		\
+    do {						\
+      ADD_BYTE (d);					\
+      p->input_current++;				\
+      d = json_input_peek (p);				\
+    } while ('0' <= d && d <= '9');			\
+  } while (false)
+
+  if (negative)
+    {
+      ADD_BYTE (c);
+      c = json_input_get_more (p);
+    }
+  if (c == '0')
+    ADD_BYTE (c);
+  else if ('1' <= c && c <= '9')
+    {
+      /* Put C back and read it as the first digit.  This is safe,
+	 since reading C moved to the part of the input it is in.  */
+      p->input_current--;
+      ADD_DIGITS ();
+    }
+  else
+    json_signal_error (p, Qjson_parse_error, "Invalid number");
+
+  if (json_input_peek (p) == '.')
+    {
+      is_float = true;
+      ADD_BYTE ('.');
+      p->input_current++;
+      ADD_DIGITS ();
+    }
+  c = json_input_peek (p);
+  if (c == 'e' || c == 'E')
+    {
+      is_float = true;
+      ADD_BYTE ('e');
+      p->input_current++;
+      c = json_input_peek (p);
+      if (c == '+' || c == '-')
+	{
+	  ADD_BYTE (c);
+	  p->input_current++;
+	}
+      ADD_DIGITS ();
+    }
+#undef ADD_DIGITS
+#undef ADD_BYTE
+  p->buf[n] = '\0';
+
+  if (!is_float)
+    {
+      /* Return an integer if it fits in a fixnum.  */
+      EMACS_INT value = 0;
+      ptrdiff_t i;
+      for (i = negative; i < n; i++)
+	{
+	  int digit = p->buf[i] - '0';
+	  if ((MOST_POSITIVE_FIXNUM - digit + negative) / 10 < value)
+	    break;
+	  value = value * 10 + digit;
+	}
+      if (i == n)
+	return make_number (negative ? -value : value);
+    }
+  return make_float (strtod ((char *) p->buf, NULL));
+}
+
+/* Read the rest of the literal whose first byte C has been read,
+   which should be REST.  */
+
+static void
+json_parse_literal (struct json_parser *p, const char *rest)
+{
+  for (; *rest; rest++)
+    if (json_input_get_more (p) != *rest)
+      json_signal_error (p, Qjson_parse_error, "Invalid literal");
+}
+
+static Lisp_Object json_parse_value (struct json_parser *, int);
+
+static void
+json_enter (struct json_parser *p)
+{
+  if (JSON_MAX_DEPTH <= p->depth)
+    json_signal_error (p, Qjson_object_too_deep,
+		       "Arrays and objects nest too deeply");
+  p->depth++;
+}
+
+/* Read the rest of an array, whose opening bracket has been read.  */
+
+static Lisp_Object
+json_parse_array (struct json_parser *p)
+{
+  ptrdiff_t base = p->stack_used, n, i;
+  Lisp_Object result;
+  int c;
+
+  json_enter (p);
+  c = json_skip_whitespace (p);
+  if (c != ']')
+    while (true)
+      {
+	json_push (p, json_parse_value (p, c));
+	c = json_skip_whitespace (p);
+	if (c == ']')
+	  break;
+	if (c != ',')
+	  json_signal_error (p, c < 0 ? Qjson_end_of_file : Qjson_parse_error,
+			     "Expected `,' or `]'");
+	c = json_skip_whitespace (p);
+      }
+
+  n = p->stack_used - base;
+  if (p->conf.array_type == json_array_array)
+    {
+      result = make_uninit_vector (n);
+      for (i = 0; i < n; i++)
+	ASET (result, i, AREF (p->stack, base + i));
+    }
+  else
+    {
+      result = Qnil;
+      for (i = n - 1; 0 <= i; i--)
+	result = Fcons (AREF (p->stack, base + i), result);
+    }
+  p->stack_used = base;
+  p->depth--;
+  return result;
+}
+
+/* Read the rest of an object, whose opening brace has been read.  */
+
+static Lisp_Object
+json_parse_object (struct json_parser *p)
+{
+  ptrdiff_t base = p->stack_used, n, i;
+  Lisp_Object result;
+  int c;
+
+  json_enter (p);
+  c = json_skip_whitespace (p);
+  if (c != '}')
+    while (true)
+      {
+	Lisp_Object key;
+	ptrdiff_t nchars, nbytes;
+
+	if (c != '"')
+	  json_signal_error (p, c < 0 ? Qjson_end_of_file : Qjson_parse_error,
+			     "Expected a string key");
+	switch (p->conf.object_type)
+	  {
+	  case json_object_hashtable:
+	    key = json_parse_string (p);
+	    break;
+	  case json_object_alist:
+	    nbytes = json_parse_string_bytes (p, 0, &nchars);
+	    key = json_intern (p, nchars, nbytes);
+	    break;
+	  default:
+	    json_buf_reserve (p, 0, 1);
+	    p->buf[0] = ':';
+	    nbytes = json_parse_string_bytes (p, 1, &nchars);
+	    key = json_intern (p, nchars + 1, nbytes + 1);
+	    break;
+	  }
+	json_push (p, key);
+
+	c = json_skip_whitespace (p);
+	if (c != ':')
+	  json_signal_error (p, c < 0 ? Qjson_end_of_file : Qjson_parse_error,
+			     "Expected `:'");
+	json_push (p, json_parse_value (p, json_skip_whitespace (p)));
+
+	c = json_skip_whitespace (p);
+	if (c == '}')
+	  break;
+	if (c != ',')
+	  json_signal_error (p, c < 0 ? Qjson_end_of_file : Qjson_parse_error,
+			     "Expected `,' or `}'");
+	c = json_skip_whitespace (p);
+      }
+
+  n = p->stack_used - base;
+  switch (p->conf.object_type)
+    {
+    case json_object_hashtable:
+      {
+	struct Lisp_Hash_Table *h;
+	result = make_hash_table (hashtest_equal, make_number (n / 2),
+				  make_float (DEFAULT_REHASH_SIZE),
+				  make_float (DEFAULT_REHASH_THRESHOLD),
+				  Qnil);
+	h = XHASH_TABLE (result);
+	/* The last member with a given key wins.  */
+	for (i = 0; i < n; i += 2)
+	  {
+	    EMACS_UINT hash;
+	    Lisp_Object key = AREF (p->stack, base + i);
+	    ptrdiff_t j = hash_lookup (h, key, &hash);
+	    if (0 <= j)
+	      set_hash_value_slot (h, j, AREF (p->stack, base + i + 1));
+	    else
+	      hash_put (h, key, AREF (p->stack, base + i + 1), hash);
+	  }
+      }
+      break;
+
+    case json_object_alist:
+      result = Qnil;
+      for (i = n - 2; 0 <= i; i -= 2)
+	result = Fcons (Fcons (AREF (p->stack, base + i),
+			       AREF (p->stack, base + i + 1)),
+			result);
+      break;
+
+    default:
+      result = Qnil;
+      for (i = n - 1; 0 <= i; i--)
+	result = Fcons (AREF (p->stack, base + i), result);
+      break;
+    }
+  p->stack_used = base;
+  p->depth--;
+  return result;
+}
+
+/* Read the rest of the value whose first byte C has been read.  */
+
+static Lisp_Object
+json_parse_value (struct json_parser *p, int c)
+{
+  switch (c)
+    {
+    case '{':
+      return json_parse_object (p);
+    case '[':
+      return json_parse_array (p);
+    case '"':
+      return json_parse_string (p);
+    case 't':
+      json_parse_literal (p, "rue");
+      return Qt;
+    case 'f':
+      json_parse_literal (p, "alse");
+      return p->conf.false_object;
+    case 'n':
+      json_parse_literal (p, "ull");
+      return p->conf.null_object;
+    case '-': case '0': case '1': case '2': case '3': case '4':
+    case '5': case '6': case '7': case '8': case '9':
+      return json_parse_number (p, c);
+    case -1:
+      json_signal_error (p, Qjson_end_of_file, "Unexpected end of input");
+    default:
+      json_signal_error (p, Qjson_parse_error, "Invalid value");
+    }
+}
+
+/* Set up P to parse OBJECT, from the NBYTES bytes at BEGIN and the
+   SECONDARY_BYTES bytes at SECONDARY, which start at byte position
+   START_BYTE of OBJECT.  Arrange to clean up P on unwinding.  */
+
+static void
+json_parser_init (struct json_parser *p, Lisp_Object object,
+		  ptrdiff_t start_byte,
+		  unsigned char const *begin, ptrdiff_t nbytes,
+		  unsigned char const *secondary, ptrdiff_t secondary_bytes)
+{
+  p->input_begin = p->input_current = begin;
+  p->input_end = begin + nbytes;
+  p->secondary_begin = secondary_bytes ? secondary : NULL;
+  p->secondary_end = secondary_bytes ? secondary + secondary_bytes : NULL;
+  p->input_offset = 0;
+  p->object = object;
+  p->start_byte = start_byte;
+  p->depth = 0;
+  p->stack = Fmake_vector (make_number (64), Qnil);
+  p->stack_used = 0;
+  p->buf = NULL;
+  p->buf_size = 0;
+#ifdef REL_ALLOC
+  /* Keep ralloc.c from moving the text while the parser points into
+     it.  */
+  if (BUFFERP (object))
+    r_alloc_inhibit_buffer_relocation (1);
+#endif
+  record_unwind_protect_ptr (json_parser_done, p);
+}
+
+DEFUN ("json-parse-string", Fjson_parse_string, Sjson_parse_string,
+       1, MANY, 0,
+       doc: /* Parse the JSON STRING into a Lisp object.
+STRING must hold exactly one JSON value, optionally surrounded by
+white space; if it is unibyte, it must be UTF-8.  This is an
+experimental function that is a faster replacement for `json-read'
+from json.el.
+
+The arguments ARGS are a list of keyword/argument pairs:
+
+The keyword argument `:object-type' specifies which Lisp type is used
+to represent objects; it can be `hash-table', `alist' or `plist'.  It
+defaults to `hash-table'.  Hash tables use `equal' and have string
+keys; when an object has several members with the same key, the last
+one wins.  Alists have symbols as keys, and plists keywords; they keep
+all the members, in order.
+
+The keyword argument `:array-type' specifies which Lisp type is used
+to represent arrays; it can be `array' (the default) or `list'.
+
+The keyword argument `:null-object' specifies which object to use
+to represent a JSON null value.  It defaults to `:null'.
+
+The keyword argument `:false-object' specifies which object to use to
+represent a JSON false value.  It defaults to `:false'.
+
+JSON true is t.  A number is an integer if it has neither a fraction
+nor an exponent and fits in a fixnum, and a float otherwise.
+
+Signal a `json-parse-error' if STRING is not valid JSON.  Its data are
+a message and the position in STRING where parsing stopped.
+usage: (json-parse-string STRING &rest ARGS) */)
+  (ptrdiff_t nargs, Lisp_Object *args)
+{
+  ptrdiff_t count = SPECPDL_INDEX ();
+  Lisp_Object string = args[0], result;
+  struct json_parser p;
+  int c;
+
+  CHECK_STRING (string);
+  json_parse_args (nargs - 1, args + 1, &p.conf, true);
+  json_parser_init (&p, string, 0, SDATA (string), SBYTES (string), NULL, 0);
+
+  result = json_parse_value (&p, json_skip_whitespace (&p));
+  c = json_skip_whitespace (&p);
+  if (0 <= c)
+    {
+      p.input_current--;
+      json_signal_error (&p, Qjson_trailing_content,
+			 "Trailing content after the value");
+    }
+  return unbind_to (count, result);
+}
+
+DEFUN ("json-parse-buffer", Fjson_parse_buffer, Sjson_parse_buffer,
+       0, MANY, 0,
+       doc: /* Read the JSON value at point and return it as a Lisp object.
+Skip white space, parse one value from the text of the current buffer
+that follows, and move point to the end of that value.  This reads
+the text where it is, without copying it.  The arguments ARGS are
+keyword/argument pairs, as for `json-parse-string'.
+
+Signal a `json-parse-error' if the text is not valid JSON; its data
+are a message and the position where parsing stopped.  Point does not
+move then.
+usage: (json-parse-buffer &rest ARGS) */)
+  (ptrdiff_t nargs, Lisp_Object *args)
+{
+  ptrdiff_t count = SPECPDL_INDEX ();
+  Lisp_Object buffer, result;
+  ptrdiff_t gpt = GPT_BYTE, end, pos_byte;
+  struct json_parser p;
+
+  XSETBUFFER (buffer, current_buffer);
+  json_parse_args (nargs, args, &p.conf, true);
+  if (PT_BYTE < gpt && gpt < ZV_BYTE)
+    json_parser_init (&p, buffer, PT_BYTE,
+		      PT_ADDR, gpt - PT_BYTE, GAP_END_ADDR, ZV_BYTE - gpt);
+  else
+    json_parser_init (&p, buffer, PT_BYTE,
+		      PT_ADDR, ZV_BYTE - PT_BYTE, NULL, 0);
+
+  result = json_parse_value (&p, json_skip_whitespace (&p));
+  end = json_offset (&p);
+  unbind_to (count, Qnil);
+
+  pos_byte = PT_BYTE + end;
+  SET_PT_BOTH (BYTE_TO_CHAR (pos_byte), pos_byte);
+  return result;
+}
+
+
+/* Serialization.  */
+
+struct json_out
+{
+  /* The UTF-8 text written so far: SIZE bytes, which make CHARS
+     characters, in a buffer of CAPACITY bytes.  */
+  unsigned char *buf;
+  ptrdiff_t size, capacity, chars;
+
+  struct json_configuration conf;
+  int depth;
+};
+
+static void
+json_out_done (void *out)
+{
+  xfree (((struct json_out *) out)->buf);
+}
+
+/* Make room for N more bytes.  */
+
+static void
+json_out_reserve (struct json_out *jo, ptrdiff_t n)
+{
+  if (jo->capacity - jo->size < n)
+    jo->buf = xpalloc (jo->buf, &jo->capacity,
+		       n - (jo->capacity - jo->size), -1, 1);
+}
+
+static void
+json_out_ascii (struct json_out *jo, const char *s, ptrdiff_t n)
+{
+  json_out_reserve (jo, n);
+  memcpy (jo->buf + jo->size, s, n);
+  jo->size += n;
+  jo->chars += n;
+}
+
+static void
+json_out_byte (struct json_out *jo, int c)
+{
+  json_out_reserve (jo, 1);
+  jo->buf[jo->size++] = c;
+  jo->chars++;
+}
+
+/* Write STRING, from byte START on, as a JSON string.  Its text must
+   be valid Unicode; unibyte text must be UTF-8.  */
+
+static void
+json_out_string (struct json_out *jo, Lisp_Object string, ptrdiff_t start)
+{
+  unsigned char const *p = SDATA (string) + start;
+  unsigned char const *end = SDATA (string) + SBYTES (string);
+
+  json_out_reserve (jo, end - p + 2);
+  json_out_byte (jo, '"');
+  while (p < end)
+    {
+      int c = *p;
+      if (c < 0x80)
+	{
+	  if (c < 0x20 || c == '"' || c == '\\')
+	    {
+	      char esc[7];
+	      int len;
+	      switch (c)
+		{
+		case '"': case '\\':
+		  esc[1] = c; len = 2; break;
+		case '\b': esc[1] = 'b'; len = 2; break;
+		case '\f': esc[1] = 'f'; len = 2; break;
+		case '\n': esc[1] = 'n'; len = 2; break;
+		case '\r': esc[1] = 'r'; len = 2; break;
+		case '\t': esc[1] = 't'; len = 2; break;
+		default:
+		  len = sprintf (esc, "\\u%04x", (unsigned) c);
+		  break;
+		}
+	      esc[0] = '\\';
+	      json_out_ascii (jo, esc, len);
+	    }
+	  else
+	    json_out_byte (jo, c);
+	  p++;
+	}
+      else
+	{
+	  int len = json_utf_8_length (p, end);
+	  if (len == 0)
+	    wrong_type_argument (Qutf_8_string_p, string);
+	  json_out_reserve (jo, len);
+	  memcpy (jo->buf + jo->size, p, len);
+	  jo->size += len;
+	  jo->chars++;
+	  p += len;
+	}
+    }
+  json_out_byte (jo, '"');
+}
+
+static void json_out_value (struct json_out *, Lisp_Object);
+
+static void
+json_out_enter (struct json_out *jo)
+{
+  if (JSON_MAX_DEPTH <= jo->depth)
+    xsignal2 (Qjson_object_too_deep,
+	      build_string ("Arrays and objects nest too deeply"),
+	      make_number (jo->depth));
+  jo->depth++;
+}
+
+/* Write the member KEY: VALUE of an object, preceded by a comma unless
+   it is the FIRST one.  KEY is a string, of which the first KEY_START
+   bytes are not part of the key.  */
+
+static void
+json_out_member (struct json_out *jo, bool first, Lisp_Object key,
+		 ptrdiff_t key_start, Lisp_Object value)
+{
+  if (!first)
+    json_out_byte (jo, ',');
+  json_out_string (jo, key, key_start);
+  json_out_byte (jo, ':');
+  json_out_value (jo, value);
+}
+
+/* Write a hash table with string keys as an object.  */
+
+static void
+json_out_hash_table (struct json_out *jo, Lisp_Object table)
+{
+  struct Lisp_Hash_Table *h = XHASH_TABLE (table);
+  ptrdiff_t i;
+  bool first = true;
+
+  json_out_enter (jo);
+  json_out_byte (jo, '{');
+  for (i = 0; i < HASH_TABLE_SIZE (h); i++)
+    if (HASH_ENTRY_USED_P (h, i))
+      {
+	Lisp_Object key = HASH_KEY (h, i);
+	CHECK_STRING (key);
+	json_out_member (jo, first, key, 0, HASH_VALUE (h, i));
+	first = false;
+      }
+  json_out_byte (jo, '}');
+  jo->depth--;
+}
+
+/* Alists and plists with more members than this use a hash table to
+   skip duplicate keys, rather than looking at all earlier keys.  */
+enum { JSON_LINEAR_KEYS = 16 };
+
+/* Write an alist with symbol keys, or if PLIST a plist, as an object.
+   Only the first member with a given key counts.  The leading colon
+   of a keyword in a plist is not part of the key.  */
+
+static void
+json_out_list_object (struct json_out *jo, Lisp_Object list, bool plist)
+{
+  EMACS_INT n = XFASTINT (Fsafe_length (list)), i;
+  Lisp_Object tail = list, seen = Qnil;
+  bool first = true;
+
+  if (plist)
+    n /= 2;
+  if (JSON_LINEAR_KEYS < n)
+    seen = make_hash_table (hashtest_eql, make_number (n),
+			    make_float (DEFAULT_REHASH_SIZE),
+			    make_float (DEFAULT_REHASH_THRESHOLD),
+			    Qnil);
+
+  json_out_enter (jo);
+  json_out_byte (jo, '{');
+  for (i = 0; i < n; i++)
+    {
+      Lisp_Object key, value, t;
+      bool duplicate = false;
+
+      if (plist)
+	{
+	  key = XCAR (tail);
+	  value = XCAR (XCDR (tail));
+	}
+      else
+	{
+	  Lisp_Object member = XCAR (tail);
+	  CHECK_CONS (member);
+	  key = XCAR (member);
+	  value = XCDR (member);
+	}
+      CHECK_SYMBOL (key);
+
+      if (NILP (seen))
+	for (t = list; !EQ (t, tail); t = plist ? XCDR (XCDR (t)) : XCDR (t))
+	  {
+	    if (EQ (plist ? XCAR (t) : XCAR (XCAR (t)), key))
+	      {
+		duplicate = true;
+		break;
+	      }
+	  }
+      else
+	{
+	  struct Lisp_Hash_Table *h = XHASH_TABLE (seen);
+	  EMACS_UINT hash;
+	  duplicate = 0 <= hash_lookup (h, key, &hash);
+	  if (!duplicate)
+	    hash_put (h, key, Qt, hash);
+	}
+
+      if (!duplicate)
+	{
+	  Lisp_Object name = SYMBOL_NAME (key);
+	  json_out_member (jo, first, name,
+			   plist && SREF (name, 0) == ':', value);
+	  first = false;
+	}
+      tail = plist ? XCDR (XCDR (tail)) : XCDR (tail);
+    }
+  if (!NILP (tail))
+    wrong_type_argument (Qlistp, list);
+  json_out_byte (jo, '}');
+  jo->depth--;
+}
+
+static void
+json_out_value (struct json_out *jo, Lisp_Object obj)
+{
+  if (EQ (obj, jo->conf.null_object))
+    json_out_ascii (jo, "null", 4);
+  else if (EQ (obj, jo->conf.false_object))
+    json_out_ascii (jo, "false", 5);
+  else if (EQ (obj, Qt))
+    json_out_ascii (jo, "true", 4);
+  else if (INTEGERP (obj))
+    {
+      char buf[INT_BUFSIZE_BOUND (EMACS_INT)];
+      json_out_ascii (jo, buf, sprintf (buf, "%"pI"d", XINT (obj)));
+    }
+  else if (FLOATP (obj))
+    {
+      char buf[DBL_BUFSIZE_BOUND + 2];
+      double d = XFLOAT_DATA (obj);
+      int len;
+      /* JSON has no infinities and no NaNs.  */
+      if (! (d - d == 0))
+	wrong_type_argument (Qjson_value_p, obj);
+      len = dtoastr (buf, DBL_BUFSIZE_BOUND, 0, 0, d);
+      /* Keep it a float when it is read back.  */
+      if (!strpbrk (buf, ".e"))
+	{
+	  strcpy (buf + len, ".0");
+	  len += 2;
+	}
+      json_out_ascii (jo, buf, len);
+    }
+  else if (STRINGP (obj))
+    json_out_string (jo, obj, 0);
+  else if (VECTORP (obj))
+    {
+      ptrdiff_t i;
+      json_out_enter (jo);
+      json_out_byte (jo, '[');
+      for (i = 0; i < ASIZE (obj); i++)
+	{
+	  if (i)
+	    json_out_byte (jo, ',');
+	  json_out_value (jo, AREF (obj, i));
+	}
+      json_out_byte (jo, ']');
+      jo->depth--;
+    }
+  else if (HASH_TABLE_P (obj))
+    json_out_hash_table (jo, obj);
+  else if (NILP (obj))
+    json_out_ascii (jo, "{}", 2);
+  else if (CONSP (obj) && CONSP (XCAR (obj)))
+    json_out_list_object (jo, obj, false);
+  else if (CONSP (obj) && SYMBOLP (XCAR (obj)))
+    {
+      if (XFASTINT (Fsafe_length (obj)) % 2 != 0)
+	wrong_type_argument (Qjson_value_p, obj);
+      json_out_list_object (jo, obj, true);
+    }
+  else
+    wrong_type_argument (Qjson_value_p, obj);
+}
+
+/* Serialize OBJECT into JO, according to the keyword arguments
+   NARGS and ARGS.  Arrange to free the text on unwinding.  */
+
+static void
+json_serialize (struct json_out *jo, Lisp_Object object,
+		ptrdiff_t nargs, Lisp_Object *args)
+{
+  jo->buf = NULL;
+  jo->size = jo->capacity = jo->chars = 0;
+  jo->depth = 0;
+  record_unwind_protect_ptr (json_out_done, jo);
+  json_parse_args (nargs, args, &jo->conf, false);
+  json_out_value (jo, object);
+}
+
+DEFUN ("json-serialize", Fjson_serialize, Sjson_serialize, 1, MANY, 0,
+       doc: /* Return the JSON representation of OBJECT as a string.
+OBJECT must be t, a number, a string, a vector, a hash table, an
+alist, a plist, or the null or false object described below.
+
+t becomes JSON true.  Vectors become arrays.  Hash tables, alists and
+plists become objects: the keys of a hash table must be strings, those
+of an alist symbols, and those of a plist symbols, usually keywords,
+whose leading colon is dropped.  When an alist or plist has several
+members with the same key, only the first one is used.  nil is an
+empty object.  Floats must be finite.  Strings must be valid Unicode;
+unibyte strings must be UTF-8.
+
+The arguments ARGS are a list of keyword/argument pairs:
+
+The keyword argument `:null-object' specifies which object to use
+to represent a JSON null value.  It defaults to `:null'.
+
+The keyword argument `:false-object' specifies which object to use to
+represent a JSON false value.  It defaults to `:false'.
+
+The result contains no white space.
+usage: (json-serialize OBJECT &rest ARGS) */)
+  (ptrdiff_t nargs, Lisp_Object *args)
+{
+  ptrdiff_t count = SPECPDL_INDEX ();
+  struct json_out jo;
+
+  json_serialize (&jo, args[0], nargs - 1, args + 1);
+  return unbind_to (count, make_specified_string ((char *) jo.buf, jo.chars,
+						  jo.size,
+						  jo.chars != jo.size));
+}
+
+DEFUN ("json-insert", Fjson_insert, Sjson_insert, 1, MANY, 0,
+       doc: /* Insert the JSON representation of OBJECT before point.
+This is the same as (insert (json-serialize OBJECT ARGS...)), but
+faster.  See `json-serialize' for OBJECT and ARGS.
+usage: (json-insert OBJECT &rest ARGS) */)
+  (ptrdiff_t nargs, Lisp_Object *args)
+{
+  ptrdiff_t count = SPECPDL_INDEX ();
+  struct json_out jo;
+
+  json_serialize (&jo, args[0], nargs - 1, args + 1);
+  if (jo.size > 0)
+    {
+      ptrdiff_t opoint = PT;
+      insert_1_both ((char *) jo.buf, jo.chars, jo.size, 0, 1, 0);
+      signal_after_change (opoint, 0, PT - opoint);
+      update_compositions (opoint, PT, CHECK_BORDER);
+    }
+  return unbind_to (count, Qnil);
+}
+
+void
+syms_of_json (void)
+{
+  DEFSYM (QCobject_type, ":object-type");
+  DEFSYM (QCarray_type, ":array-type");
+  DEFSYM (QCnull_object, ":null-object");
+  DEFSYM (QCfalse_object, ":false-object");
+  DEFSYM (QCnull, ":null");
+  DEFSYM (QCfalse, ":false");
+  DEFSYM (Qhash_table, "hash-table");
+  DEFSYM (Qalist, "alist");
+  DEFSYM (Qplist, "plist");
+  DEFSYM (Qarray, "array");
+  DEFSYM (Qlist, "list");
+  DEFSYM (Qjson_value_p, "json-value-p");
+  DEFSYM (Qutf_8_string_p, "utf-8-string-p");
+
+  DEFSYM (Qjson_error, "json-error");
+  DEFSYM (Qjson_parse_error, "json-parse-error");
+  DEFSYM (Qjson_end_of_file, "json-end-of-file");
+  DEFSYM (Qjson_trailing_content, "json-trailing-content");
+  DEFSYM (Qjson_object_too_deep, "json-object-too-deep");
+
+  Fput (Qjson_error, Qerror_conditions,
+	Fpurecopy (list2 (Qjson_error, Qerror)));
+  Fput (Qjson_error, Qerror_message,
+	build_pure_c_string ("JSON error"));
+
+  Fput (Qjson_parse_error, Qerror_conditions,
+	Fpurecopy (list3 (Qjson_parse_error, Qjson_error, Qerror)));
+  Fput (Qjson_parse_error, Qerror_message,
+	build_pure_c_string ("Could not parse JSON"));
+
+  Fput (Qjson_end_of_file, Qerror_conditions,
+	Fpurecopy (list4 (Qjson_end_of_file, Qjson_parse_error, Qjson_error,
+			  Qerror)));
+  Fput (Qjson_end_of_file, Qerror_message,
+	build_pure_c_string ("End of JSON input"));
+
+  Fput (Qjson_trailing_content, Qerror_conditions,
+	Fpurecopy (list4 (Qjson_trailing_content, Qjson_parse_error,
+			  Qjson_error, Qerror)));
+  Fput (Qjson_trailing_content, Qerror_message,
+	build_pure_c_string ("Trailing content after JSON value"));
+
+  Fput (Qjson_object_too_deep, Qerror_conditions,
+	Fpurecopy (list3 (Qjson_object_too_deep, Qjson_error, Qerror)));
+  Fput (Qjson_object_too_deep, Qerror_message,
+	build_pure_c_string ("JSON arrays and objects nest too deeply"));
+
+  defsubr (&Sjson_parse_string);
+  defsubr (&Sjson_parse_buffer);
+  defsubr (&Sjson_serialize);
+  defsubr (&Sjson_insert);
+}
@@ -325,6 +325,7 @@ static Lisp_Object Qdbus_event;
 static Lisp_Object Qfile_notify;
 #endif /* USE_FILE_NOTIFY */
 static Lisp_Object Qconfig_changed_event;
+static Lisp_Object Qworker_event;
 
 /* Lisp_Object Qmouse_movement; - also an event header */
 
@@ -1757,8 +1758,8 @@ adjust_point_for_property (ptrdiff_t last_pt, bool modified)
 	  && display_prop_intangible_p (val, overlay, PT, PT_BYTE)
 	  && (!OVERLAYP (overlay)
 	      ? get_property_and_range (PT, Qdisplay, &val, &beg, &end, Qnil)
-	      : (beg = OVERLAY_POSITION (OVERLAY_START (overlay)),
-		 end = OVERLAY_POSITION (OVERLAY_END (overlay))))
+	      : (beg = OVERLAY_START (overlay),
+		 end = OVERLAY_END (overlay)))
 	  && (beg < PT /* && end > PT   <- It's always the case.  */
 	      || (beg <= PT && STRINGP (val) && SCHARS (val) == 0)))
 	{
@@ -2809,6 +2810,18 @@ read_char (int commandflag, Lisp_Object map,
       /* delay_level is 4 for files under around 50k, 7 at 100k,
 	 9 at 200k, 11 at 300k, and 12 at 500k.  It is 15 at 1 meg.  */
 
+      /* Use the wait for input to collect garbage a step at a time,
+	 if that is enabled.  Between steps, run timers and handle
+	 subprocess output, and stop as soon as there is input.  */
+      if (NUMBERP (Vgc_max_pause))
+	{
+	  save_getcjmp (save_jump);
+	  restore_getcjmp (local_getcjmp);
+	  while (!detect_input_pending_run_timers (0) && gc_step_when_idle ())
+	    wait_reading_process_output (-1, 0, -1, true, Qnil, NULL, 0);
+	  restore_getcjmp (save_jump);
+	}
+
       /* Auto save if enough time goes by without input.  */
       if (commandflag != 0 && commandflag != -2
 	  && num_nonmacro_input_events > last_auto_save
@@ -4169,7 +4182,8 @@ kbd_buffer_get_event (KBOARD **kbp,
 	  kbd_fetch_ptr = event + 1;
 	}
 #endif
-      else if (event->kind == CONFIG_CHANGED_EVENT)
+      else if (event->kind == CONFIG_CHANGED_EVENT
+	       || event->kind == WORKER_EVENT)
 	{
 	  obj = make_lispy_event (event);
 	  kbd_fetch_ptr = event + 1;
@@ -5759,7 +5773,7 @@ make_lispy_event (struct input_event *event)
 	    else
 	      double_click_count = 1;
 	    button_down_time = event->timestamp;
-	    *start_pos_ptr = Fcopy_alist (position);
+	    ASET (button_down_location, button, Fcopy_alist (position));
 	    ignore_mouse_drag_p = 0;
 	  }
 
@@ -6103,6 +6117,9 @@ make_lispy_event (struct input_event *event)
 	return list3 (Qconfig_changed_event,
 		      event->arg, event->frame_or_window);
 
+    case WORKER_EVENT:
+      return Fcons (Qworker_event, event->arg);
+
       /* The 'kind' field of the event is something we don't recognize.  */
     default:
       emacs_abort ();
@@ -9751,7 +9768,7 @@ read_key_sequence (Lisp_Object *keybuf, int bufsize, Lisp_Object prompt,
 	      /* Treat uppercase keys as shifted.  */
 	      || (INTEGERP (key)
 		  && (KEY_TO_CHAR (key)
-		      < XCHAR_TABLE (BVAR (current_buffer, downcase_table))->header.size)
+		      < ASIZE (BVAR (current_buffer, downcase_table)))
 		  && uppercasep (KEY_TO_CHAR (key))))
 	    {
 	      Lisp_Object new_key
@@ -11081,6 +11098,7 @@ syms_of_keyboard (void)
   DEFSYM (Qdrag_n_drop, "drag-n-drop");
   DEFSYM (Qsave_session, "save-session");
   DEFSYM (Qconfig_changed_event, "config-changed-event");
+  DEFSYM (Qworker_event, "worker-event");
   DEFSYM (Qmenu_enable, "menu-enable");
 
 #ifdef HAVE_NTGUI
@@ -11853,6 +11871,8 @@ keys_of_keyboard (void)
 
   initial_define_lispy_key (Vspecial_event_map, "config-changed-event",
 			    "ignore");
+  initial_define_lispy_key (Vspecial_event_map, "worker-event",
+			    "worker-handle-event");
 #if defined (WINDOWSNT)
   initial_define_lispy_key (Vspecial_event_map, "language-change",
 			    "ignore");
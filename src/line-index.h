@@ -0,0 +1,56 @@
+/* Header file: Indexing the newlines of a buffer.
+
+Copyright (C) 2014 Free Software Foundation, Inc.
+
+This file is part of GNU Emacs.
+
+GNU Emacs is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+GNU Emacs is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef EMACS_LINE_INDEX_H
+#define EMACS_LINE_INDEX_H
+
+struct buffer;
+struct buffer_text;
+
+/* Free the line index of the buffer text T, if any.  */
+extern void free_line_index (struct buffer_text *t);
+
+/* Update the line index of the current buffer, if it has one, for a
+   change that replaced the bytes between FROM_BYTE and TO_BYTE with
+   NBYTES new bytes.  */
+extern void line_index_adjust (ptrdiff_t from_byte, ptrdiff_t to_byte,
+			       ptrdiff_t nbytes);
+
+/* Note that the bytes of buffer B between FROM_BYTE and TO_BYTE may
+   change in place, without any change in their number.  */
+extern void line_index_invalidate (struct buffer *b, ptrdiff_t from_byte,
+				   ptrdiff_t to_byte);
+
+/* Return true if looking for COUNT newlines between positions FROM
+   and TO of the current buffer is better done with
+   line_index_find_newline than by scanning the text.  FROM and TO may
+   be either character or byte positions; this is only a heuristic.  */
+extern bool line_index_useful_p (ptrdiff_t from, ptrdiff_t to,
+				 ptrdiff_t count);
+
+/* Like find_newline, but using byte positions and the line index:
+   look for COUNT newlines from START_BYTE, not going past LIMIT_BYTE,
+   and return the byte position after the last one, storing in
+   *SHORTAGE the number of newlines that could not be found.  */
+extern ptrdiff_t line_index_find_newline (ptrdiff_t start_byte,
+					  ptrdiff_t limit_byte,
+					  ptrdiff_t count,
+					  ptrdiff_t *shortage);
+
+#endif /* EMACS_LINE_INDEX_H */
@@ -340,8 +340,6 @@ error !;
 #define lisp_h_MARKERP(x) (MISCP (x) && XMISCTYPE (x) == Lisp_Misc_Marker)
 #define lisp_h_MISCP(x) (XTYPE (x) == Lisp_Misc)
 #define lisp_h_NILP(x) EQ (x, Qnil)
-#define lisp_h_SET_SYMBOL_VAL(sym, v) \
-   (eassert ((sym)->redirect == SYMBOL_PLAINVAL), (sym)->val.value = (v))
 #define lisp_h_SYMBOL_CONSTANT_P(sym) (XSYMBOL (sym)->constant)
 #define lisp_h_SYMBOL_VAL(sym) \
    (eassert ((sym)->redirect == SYMBOL_PLAINVAL), (sym)->val.value)
@@ -386,7 +384,6 @@ error !;
 # define MARKERP(x) lisp_h_MARKERP (x)
 # define MISCP(x) lisp_h_MISCP (x)
 # define NILP(x) lisp_h_NILP (x)
-# define SET_SYMBOL_VAL(sym, v) lisp_h_SET_SYMBOL_VAL (sym, v)
 # define SYMBOL_CONSTANT_P(sym) lisp_h_SYMBOL_CONSTANT_P (sym)
 # define SYMBOL_VAL(sym) lisp_h_SYMBOL_VAL (sym)
 # define SYMBOLP(x) lisp_h_SYMBOLP (x)
@@ -606,6 +603,7 @@ enum pvec_type
   PVEC_TERMINAL,
   PVEC_WINDOW_CONFIGURATION,
   PVEC_SUBR,
+  PVEC_OBARRAY,
   PVEC_OTHER,
   /* These should be last, check internal_equal to see why.  */
   PVEC_COMPILED,
@@ -777,6 +775,7 @@ INLINE Lisp_Object CHAR_TABLE_REF_ASCII (Lisp_Object, ptrdiff_t);
 INLINE bool (CONSP) (Lisp_Object);
 INLINE bool (FLOATP) (Lisp_Object);
 INLINE bool functionp (Lisp_Object);
+INLINE bool gc_maybe_young_p (Lisp_Object);
 INLINE bool (INTEGERP) (Lisp_Object);
 INLINE bool (MARKERP) (Lisp_Object);
 INLINE bool (MISCP) (Lisp_Object);
@@ -1027,18 +1026,26 @@ xcdr_addr (Lisp_Object c)
 LISP_MACRO_DEFUN (XCAR, Lisp_Object, (Lisp_Object c), (c))
 LISP_MACRO_DEFUN (XCDR, Lisp_Object, (Lisp_Object c), (c))
 
-/* Use these to set the fields of a cons cell.
+/* Defined in alloc.c.  */
+extern void note_cons_store (Lisp_Object);
+
+/* Use these to set the fields of a cons cell.  They tell the garbage
+   collector when a cons may start pointing to a younger object.
 
    Note that both arguments may refer to the same object, so 'n'
    should not be read after 'c' is first modified.  */
 INLINE void
 XSETCAR (Lisp_Object c, Lisp_Object n)
 {
+  if (gc_maybe_young_p (n))
+    note_cons_store (c);
   *xcar_addr (c) = n;
 }
 INLINE void
 XSETCDR (Lisp_Object c, Lisp_Object n)
 {
+  if (gc_maybe_young_p (n))
+    note_cons_store (c);
   *xcdr_addr (c) = n;
 }
 
@@ -1185,7 +1192,9 @@ STRING_SET_CHARS (Lisp_Object string, ptrdiff_t newsize)
 struct vectorlike_header
   {
     /* The only field contains various pieces of information:
-       - The MSB (ARRAY_MARK_FLAG) holds the gcmarkbit.
+       - The MSB (ARRAY_MARK_FLAG) holds the gcmarkbit.  Vectors
+         that survive a collection stay marked until the next full
+         collection, so use ASIZE rather than reading the size here.
        - The next bit (PSEUDOVECTOR_FLAG) indicates whether this is a plain
          vector (0) or a pseudovector (1).
        - If PSEUDOVECTOR_FLAG is 0, the rest holds the size (number
@@ -1332,13 +1341,28 @@ aref_addr (Lisp_Object array, ptrdiff_t idx)
 INLINE ptrdiff_t
 ASIZE (Lisp_Object array)
 {
-  return XVECTOR (array)->header.size;
+  return XVECTOR (array)->header.size & ~ARRAY_MARK_FLAG;
+}
+
+/* Defined in alloc.c.  */
+extern void remember_vector (struct Lisp_Vector *);
+
+/* Call this before storing VAL into a slot of the vector-like object
+   V, unless V was allocated since the last garbage collection.  It
+   tells the collector when an old V may start pointing to a younger
+   object.  */
+INLINE void
+note_vector_store (struct Lisp_Vector *v, Lisp_Object val)
+{
+  if ((v->header.size & ARRAY_MARK_FLAG) && gc_maybe_young_p (val))
+    remember_vector (v);
 }
 
 INLINE void
 ASET (Lisp_Object array, ptrdiff_t idx, Lisp_Object val)
 {
   eassert (0 <= idx && idx < ASIZE (array));
+  note_vector_store (XVECTOR (array), val);
   XVECTOR (array)->contents[idx] = val;
 }
 
@@ -1346,8 +1370,9 @@ INLINE void
 gc_aset (Lisp_Object array, ptrdiff_t idx, Lisp_Object val)
 {
   /* Like ASET, but also can be used in the garbage collector:
-     sweep_weak_table calls set_hash_key etc. while the table is marked.  */
-  eassert (0 <= idx && idx < (ASIZE (array) & ~ARRAY_MARK_FLAG));
+     sweep_weak_table calls set_hash_key etc. while the table is marked.
+     The caller takes care of the write barrier.  */
+  eassert (0 <= idx && idx < ASIZE (array));
   XVECTOR (array)->contents[idx] = val;
 }
 
@@ -1634,19 +1659,63 @@ SYMBOL_FWD (struct Lisp_Symbol *sym)
   return sym->val.fwd;
 }
 
-LISP_MACRO_DEFUN_VOID (SET_SYMBOL_VAL,
-		       (struct Lisp_Symbol *sym, Lisp_Object v), (sym, v))
+/* Defined in alloc.c.  */
+extern bool gc_marking_incrementally;
+
+/* Return true if OBJ may have been allocated since the last garbage
+   collection, as an object that a minor collection can free.  Strings
+   and miscellaneous objects are not in this set, as every collection
+   marks all of them.  Neither are marked symbols, such as nil.
+   While an incremental collection is under way, OBJ may also be an
+   object that it has not marked yet, and then strings and
+   miscellaneous objects count too.  */
+
+INLINE bool
+gc_maybe_young_p (Lisp_Object obj)
+{
+  return (CONSP (obj) || FLOATP (obj) || VECTORLIKEP (obj)
+	  || (SYMBOLP (obj) && !XSYMBOL (obj)->gcmarkbit)
+	  || (gc_marking_incrementally && (STRINGP (obj) || MISCP (obj))));
+}
+
+/* Defined in alloc.c.  */
+extern void remember_symbol (struct Lisp_Symbol *);
+
+/* Call this before making the symbol SYM point to VAL.  It tells the
+   garbage collector when an old SYM may start pointing to a younger
+   object.  */
 
+INLINE void
+note_symbol_store (struct Lisp_Symbol *sym, Lisp_Object val)
+{
+  if (sym->gcmarkbit && gc_maybe_young_p (val))
+    remember_symbol (sym);
+}
+
+INLINE void
+SET_SYMBOL_VAL (struct Lisp_Symbol *sym, Lisp_Object v)
+{
+  eassert (sym->redirect == SYMBOL_PLAINVAL);
+  note_symbol_store (sym, v);
+  sym->val.value = v;
+}
 INLINE void
 SET_SYMBOL_ALIAS (struct Lisp_Symbol *sym, struct Lisp_Symbol *v)
 {
   eassert (sym->redirect == SYMBOL_VARALIAS);
+  note_symbol_store (sym, make_lisp_ptr (v, Lisp_Symbol));
   sym->val.alias = v;
 }
 INLINE void
 SET_SYMBOL_BLV (struct Lisp_Symbol *sym, struct Lisp_Buffer_Local_Value *v)
 {
   eassert (sym->redirect == SYMBOL_LOCALIZED);
+  /* The buffer-local value of an old symbol may point to young
+     objects through its default cell.  Later changes to V need no
+     barrier: its cells are conses, and it points otherwise only to
+     buffers and frames, which every collection marks.  */
+  if (sym->gcmarkbit)
+    remember_symbol (sym);
   sym->val.blv = v;
 }
 INLINE void
@@ -1687,6 +1756,50 @@ LISP_MACRO_DEFUN (SYMBOL_CONSTANT_P, int, (Lisp_Object sym), (sym))
 #define DEFSYM(sym, name)						\
   do { (sym) = intern_c_string ((name)); staticpro (&(sym)); } while (false)
 
+/* An obarray made by `obarray-make', such as the initial obarray.
+   Its buckets are resized as symbols are interned in it.  A plain
+   vector can also serve as an obarray; it is its own fixed-size
+   vector of buckets.  */
+
+struct Lisp_Obarray
+  {
+    struct vectorlike_header header;
+
+    /* Vector of buckets.  Each bucket is 0 or the first symbol of a
+       chain linked through the `next' fields of the symbols.  */
+    Lisp_Object buckets;
+
+    /* The rest of the fields are not Lisp objects.  */
+
+    /* Number of symbols interned in the obarray.  */
+    ptrdiff_t count;
+
+    /* Number of iterations over the buckets in progress.  The buckets
+       are not resized while this is nonzero.  */
+    ptrdiff_t holds;
+  };
+
+INLINE bool
+OBARRAYP (Lisp_Object x)
+{
+  return PSEUDOVECTORP (x, PVEC_OBARRAY);
+}
+
+INLINE struct Lisp_Obarray *
+XOBARRAY (Lisp_Object a)
+{
+  eassert (OBARRAYP (a));
+  return XUNTAG (a, Lisp_Vectorlike);
+}
+
+/* Return the vector of buckets of OBARRAY.  */
+
+INLINE Lisp_Object
+obarray_buckets (Lisp_Object obarray)
+{
+  return OBARRAYP (obarray) ? XOBARRAY (obarray)->buckets : obarray;
+}
+
 
 /***********************************************************************
 			     Hash Tables
@@ -1730,23 +1843,6 @@ struct Lisp_Hash_Table
      ratio, a float.  */
   Lisp_Object rehash_threshold;
 
-  /* Vector of hash codes.  If hash[I] is nil, this means that the
-     I-th entry is unused.  */
-  Lisp_Object hash;
-
-  /* Vector used to chain entries.  If entry I is free, next[I] is the
-     entry number of the next free item.  If entry I is non-free,
-     next[I] is the index of the next entry in the collision chain.  */
-  Lisp_Object next;
-
-  /* Index of first free entry in free list.  */
-  Lisp_Object next_free;
-
-  /* Bucket vector.  A non-nil entry is the index of the first item in
-     a collision chain.  This vector's size can be larger than the
-     hash table size to reduce collisions.  */
-  Lisp_Object index;
-
   /* Only the fields above are traced normally by the GC.  The ones below
      `count' are special and are either ignored by the GC or traced in
      a special way (e.g. because of weakness).  */
@@ -1754,6 +1850,30 @@ struct Lisp_Hash_Table
   /* Number of key/value entries in the table.  */
   ptrdiff_t count;
 
+  /* Number of entries the table has room for.  */
+  ptrdiff_t size;
+
+  /* Index of first free entry in free list, or -1 if the table is
+     full.  */
+  ptrdiff_t next_free;
+
+  /* Array of SIZE hash codes.  If hash[I] is HASH_UNUSED, this means
+     that the I-th entry is unused.  */
+  EMACS_UINT *hash;
+
+  /* Array of SIZE entry numbers used to chain entries.  If entry I is
+     free, next[I] is the entry number of the next free item.  If
+     entry I is non-free, next[I] is the entry number of the next entry
+     in the collision chain.  -1 ends either chain.  */
+  ptrdiff_t *next;
+
+  /* Bucket array of INDEX_SIZE entry numbers.  A non-negative entry is
+     the number of the first item in a collision chain.  This array's
+     size can be larger than the hash table size to reduce
+     collisions.  */
+  ptrdiff_t *index;
+  ptrdiff_t index_size;
+
   /* Vector of keys and values.  The key of item I is found at index
      2 * I, the value is found at index 2 * I + 1.
      This is gc_marked specially if the table is weak.  */
@@ -1798,33 +1918,45 @@ HASH_VALUE (struct Lisp_Hash_Table *h, ptrdiff_t idx)
 }
 
 /* Value is the index of the next entry following the one at IDX
-   in hash table H.  */
-INLINE Lisp_Object
+   in hash table H, or -1 if there is none.  */
+INLINE ptrdiff_t
 HASH_NEXT (struct Lisp_Hash_Table *h, ptrdiff_t idx)
 {
-  return AREF (h->next, idx);
+  return h->next[idx];
 }
 
+/* The hash code of an unused entry.  Hash codes of keys fit in a
+   fixnum, so they are never equal to it.  */
+#define HASH_UNUSED ((EMACS_UINT) -1)
+
 /* Value is the hash code computed for entry IDX in hash table H.  */
-INLINE Lisp_Object
+INLINE EMACS_UINT
 HASH_HASH (struct Lisp_Hash_Table *h, ptrdiff_t idx)
 {
-  return AREF (h->hash, idx);
+  return h->hash[idx];
+}
+
+/* Value is true if entry IDX in hash table H holds a key and value.  */
+INLINE bool
+HASH_ENTRY_USED_P (struct Lisp_Hash_Table *h, ptrdiff_t idx)
+{
+  return h->hash[idx] != HASH_UNUSED;
 }
 
 /* Value is the index of the element in hash table H that is the
-   start of the collision list at index IDX in the index vector of H.  */
-INLINE Lisp_Object
+   start of the collision list at index IDX in the index array of H,
+   or -1 if that list is empty.  */
+INLINE ptrdiff_t
 HASH_INDEX (struct Lisp_Hash_Table *h, ptrdiff_t idx)
 {
-  return AREF (h->index, idx);
+  return h->index[idx];
 }
 
 /* Value is the size of hash table H.  */
 INLINE ptrdiff_t
 HASH_TABLE_SIZE (struct Lisp_Hash_Table *h)
 {
-  return ASIZE (h->next);
+  return h->size;
 }
 
 /* Default size for hash tables if not specified.  */
@@ -1908,27 +2040,18 @@ struct Lisp_Marker
   ptrdiff_t bytepos;
 };
 
-/* START and END are markers in the overlay's buffer, and
-   PLIST is the overlay's property list.  */
+/* BUFFER is the buffer the overlay belongs to, or NULL if it has been
+   deleted, and PLIST is the overlay's property list.  INTERVAL is the
+   node that represents the overlay in BUFFER's overlay tree; its range
+   gives the overlay's start and end positions, see itree.h.  The node
+   is allocated along with the overlay and freed when it is swept.  */
 struct Lisp_Overlay
-/* An overlay's real data content is:
-   - plist
-   - buffer (really there are two buffer pointers, one per marker,
-     and both points to the same buffer)
-   - insertion type of both ends (per-marker fields)
-   - start & start byte (of start marker)
-   - end & end byte (of end marker)
-   - next (singly linked list of overlays)
-   - next fields of start and end markers (singly linked list of markers).
-   I.e. 9words plus 2 bits, 3words of which are for external linked lists.
-*/
   {
     ENUM_BF (Lisp_Misc_Type) type : 16;	/* = Lisp_Misc_Overlay */
     bool_bf gcmarkbit : 1;
     unsigned spacer : 15;
-    struct Lisp_Overlay *next;
-    Lisp_Object start;
-    Lisp_Object end;
+    struct buffer *buffer;
+    struct itree_node *interval;
     Lisp_Object plist;
   };
 
@@ -2883,13 +3006,17 @@ SPECPDL_INDEX (void)
    hold VAL while the stack is unwound; `val' is returned as the value
    of the catch form.
 
+   A handler of type CATCHER_ALL catches every throw; its `val' is then
+   (TAG . VAL).  Module functions use it so that no throw unwinds
+   through module code.
+
    All the other members are concerned with restoring the interpreter
    state.
 
    Members are volatile if their values need to survive _longjmp when
    a 'struct handler' is a local variable.  */
 
-enum handlertype { CATCHER, CONDITION_CASE };
+enum handlertype { CATCHER, CONDITION_CASE, CATCHER_ALL };
 
 struct handler
 {
@@ -3244,6 +3371,11 @@ extern int gcpro_level;
 /* Call staticpro (&var) to protect static variable `var'.  */
 
 void staticpro (Lisp_Object *);
+
+/* Addresses of the staticpro'd variables, and how many there are.  */
+
+extern Lisp_Object *staticvec[];
+extern int staticidx;
 
 /* Declare a Lisp-callable function.  The MAXARGS parameter has the same
    meaning as in the DEFUN macro, and is used to construct a prototype.  */
@@ -3263,21 +3395,31 @@ struct frame;
 INLINE void
 vcopy (Lisp_Object v, ptrdiff_t offset, Lisp_Object *args, ptrdiff_t count)
 {
+  ptrdiff_t i;
+
   eassert (0 <= offset && 0 <= count && offset + count <= ASIZE (v));
+  for (i = 0; i < count; i++)
+    note_vector_store (XVECTOR (v), args[i]);
   memcpy (XVECTOR (v)->contents + offset, args, count * sizeof *args);
 }
 
-/* Functions to modify hash tables.  */
+/* Functions to modify hash tables.  Every garbage collection looks at
+   all the entries of the weak tables, so only the other tables need
+   the write barrier.  */
 
 INLINE void
 set_hash_key_slot (struct Lisp_Hash_Table *h, ptrdiff_t idx, Lisp_Object val)
 {
+  if (NILP (h->weak))
+    note_vector_store (XVECTOR (h->key_and_value), val);
   gc_aset (h->key_and_value, 2 * idx, val);
 }
 
 INLINE void
 set_hash_value_slot (struct Lisp_Hash_Table *h, ptrdiff_t idx, Lisp_Object val)
 {
+  if (NILP (h->weak))
+    note_vector_store (XVECTOR (h->key_and_value), val);
   gc_aset (h->key_and_value, 2 * idx + 1, val);
 }
 
@@ -3287,18 +3429,22 @@ set_hash_value_slot (struct Lisp_Hash_Table *h, ptrdiff_t idx, Lisp_Object val)
 INLINE void
 set_symbol_function (Lisp_Object sym, Lisp_Object function)
 {
+  note_symbol_store (XSYMBOL (sym), function);
   XSYMBOL (sym)->function = function;
 }
 
 INLINE void
 set_symbol_plist (Lisp_Object sym, Lisp_Object plist)
 {
+  note_symbol_store (XSYMBOL (sym), plist);
   XSYMBOL (sym)->plist = plist;
 }
 
 INLINE void
 set_symbol_next (Lisp_Object sym, struct Lisp_Symbol *next)
 {
+  if (next)
+    note_symbol_store (XSYMBOL (sym), make_lisp_ptr (next, Lisp_Symbol));
   XSYMBOL (sym)->next = next;
 }
 
@@ -3341,11 +3487,13 @@ set_string_intervals (Lisp_Object s, INTERVAL i)
 INLINE void
 set_char_table_defalt (Lisp_Object table, Lisp_Object val)
 {
+  note_vector_store (XVECTOR (table), val);
   XCHAR_TABLE (table)->defalt = val;
 }
 INLINE void
 set_char_table_purpose (Lisp_Object table, Lisp_Object val)
 {
+  note_vector_store (XVECTOR (table), val);
   XCHAR_TABLE (table)->purpose = val;
 }
 
@@ -3355,6 +3503,7 @@ INLINE void
 set_char_table_extras (Lisp_Object table, ptrdiff_t idx, Lisp_Object val)
 {
   eassert (0 <= idx && idx < CHAR_TABLE_EXTRA_SLOTS (XCHAR_TABLE (table)));
+  note_vector_store (XVECTOR (table), val);
   XCHAR_TABLE (table)->extras[idx] = val;
 }
 
@@ -3362,12 +3511,14 @@ INLINE void
 set_char_table_contents (Lisp_Object table, ptrdiff_t idx, Lisp_Object val)
 {
   eassert (0 <= idx && idx < (1 << CHARTAB_SIZE_BITS_0));
+  note_vector_store (XVECTOR (table), val);
   XCHAR_TABLE (table)->contents[idx] = val;
 }
 
 INLINE void
 set_sub_char_table_contents (Lisp_Object table, ptrdiff_t idx, Lisp_Object val)
 {
+  note_vector_store (XVECTOR (table), val);
   XSUB_CHAR_TABLE (table)->contents[idx] = val;
 }
 
@@ -3490,6 +3641,7 @@ Lisp_Object make_hash_table (struct hash_table_test, Lisp_Object, Lisp_Object,
 ptrdiff_t hash_lookup (struct Lisp_Hash_Table *, Lisp_Object, EMACS_UINT *);
 ptrdiff_t hash_put (struct Lisp_Hash_Table *, Lisp_Object, Lisp_Object,
 		    EMACS_UINT);
+extern void rebuild_hash_table (struct Lisp_Hash_Table *);
 extern struct hash_table_test hashtest_eql, hashtest_equal;
 extern void validate_subarray (Lisp_Object, Lisp_Object, Lisp_Object,
 			       ptrdiff_t, ptrdiff_t *, ptrdiff_t *);
@@ -3546,6 +3698,8 @@ extern void insert_and_inherit (const char *, ptrdiff_t);
 extern void insert_1_both (const char *, ptrdiff_t, ptrdiff_t,
 			   bool, bool, bool);
 extern void insert_from_gap (ptrdiff_t, ptrdiff_t, bool text_at_gap_tail);
+extern void insert_from_gap_before_markers (ptrdiff_t, ptrdiff_t);
+extern bool insertion_may_run_lisp (void);
 extern void insert_from_string (Lisp_Object, ptrdiff_t, ptrdiff_t,
 				ptrdiff_t, ptrdiff_t, bool);
 extern void insert_from_buffer (struct buffer *, ptrdiff_t, ptrdiff_t, bool);
@@ -3644,6 +3798,8 @@ extern void allocate_string_data (struct Lisp_String *, EMACS_INT, EMACS_INT);
 extern void malloc_warning (const char *);
 extern _Noreturn void memory_full (size_t);
 extern _Noreturn void buffer_memory_full (ptrdiff_t);
+extern void garbage_collect (void);
+extern bool gc_step_when_idle (void);
 extern bool survives_gc_p (Lisp_Object);
 extern void mark_object (Lisp_Object);
 #if defined REL_ALLOC && !defined SYSTEM_MALLOC && !defined HYBRID_MALLOC
@@ -3793,7 +3949,8 @@ extern Lisp_Object make_save_funcptr_ptr_obj (void (*) (void), void *,
 					      Lisp_Object);
 extern Lisp_Object make_save_memory (Lisp_Object *, ptrdiff_t);
 extern void free_save_value (Lisp_Object);
-extern Lisp_Object build_overlay (Lisp_Object, Lisp_Object, Lisp_Object);
+extern Lisp_Object build_overlay (bool, bool, Lisp_Object);
+extern void pin_symbol (Lisp_Object);
 extern void free_marker (Lisp_Object);
 extern void free_cons (struct Lisp_Cons *);
 extern void init_alloc_once (void);
@@ -3867,6 +4024,7 @@ extern Lisp_Object Qvariable_documentation, Qstandard_input;
 extern Lisp_Object Qbackquote, Qcomma, Qcomma_at, Qcomma_dot, Qfunction;
 extern Lisp_Object Qlexical_binding;
 extern Lisp_Object check_obarray (Lisp_Object);
+extern void hold_obarray (Lisp_Object);
 extern Lisp_Object intern_1 (const char *, ptrdiff_t);
 extern Lisp_Object intern_c_string_1 (const char *, ptrdiff_t);
 extern Lisp_Object intern_driver (Lisp_Object, Lisp_Object, ptrdiff_t);
@@ -3994,9 +4152,9 @@ extern void syms_of_editfns (void);
 /* Defined in buffer.c.  */
 extern bool mouse_face_overlay_overlaps (Lisp_Object);
 extern _Noreturn void nsberror (Lisp_Object);
-extern void adjust_overlays_for_insert (ptrdiff_t, ptrdiff_t);
+extern void adjust_overlays_for_insert (ptrdiff_t, ptrdiff_t, bool);
 extern void adjust_overlays_for_delete (ptrdiff_t, ptrdiff_t);
-extern void fix_start_end_in_overlays (ptrdiff_t, ptrdiff_t);
+extern void transpose_overlays (ptrdiff_t, ptrdiff_t, ptrdiff_t, ptrdiff_t);
 extern void report_overlay_modification (Lisp_Object, Lisp_Object, bool,
                                          Lisp_Object, Lisp_Object, Lisp_Object);
 extern bool overlay_touches_p (ptrdiff_t);
@@ -4012,6 +4170,7 @@ extern void keys_of_buffer (void);
 extern ptrdiff_t marker_position (Lisp_Object);
 extern ptrdiff_t marker_byte_position (Lisp_Object);
 extern void clear_charpos_cache (struct buffer *);
+extern void adjust_charpos_index (ptrdiff_t, ptrdiff_t, ptrdiff_t, ptrdiff_t);
 extern ptrdiff_t buf_charpos_to_bytepos (struct buffer *, ptrdiff_t);
 extern ptrdiff_t buf_bytepos_to_charpos (struct buffer *, ptrdiff_t);
 extern void unchain_marker (struct Lisp_Marker *marker);
@@ -4022,6 +4181,10 @@ extern Lisp_Object set_marker_restricted_both (Lisp_Object, Lisp_Object,
 extern Lisp_Object build_marker (struct buffer *, ptrdiff_t, ptrdiff_t);
 extern void syms_of_marker (void);
 
+/* Defined in line-index.c.  */
+
+extern void syms_of_line_index (void);
+
 /* Defined in fileio.c.  */
 
 extern Lisp_Object Qfile_error;
@@ -4050,6 +4213,7 @@ extern Lisp_Object Qdelete_file;
 
 /* Defined in search.c.  */
 extern void shrink_regexp_cache (void);
+extern void mark_regexp_cache (void);
 extern void restore_search_regs (void);
 extern void record_unwind_save_match_data (void);
 struct re_registers;
@@ -4229,10 +4393,29 @@ extern void init_callproc (void);
 extern void set_initial_environment (void);
 extern void syms_of_callproc (void);
 
+/* Defined in pdumper.c.  */
+extern void pdumper_remember_scalar (void *, ptrdiff_t);
+extern void pdumper_do_after_load (void (*) (void));
+extern void pdumper_load (const char *);
+extern void syms_of_pdumper (void);
+
+/* Defined in worker.c.  */
+extern void syms_of_worker (void);
+
+/* Defined in json.c.  */
+extern void syms_of_json (void);
+
+#ifdef HAVE_MODULES
+/* Defined in emacs-module.c.  */
+extern void mark_modules (void);
+extern void syms_of_module (void);
+#endif
+
 /* Defined in doc.c.  */
 extern Lisp_Object Qfunction_documentation;
 extern Lisp_Object read_doc_string (Lisp_Object);
 extern Lisp_Object get_doc_string (Lisp_Object, bool, bool);
+extern void init_doc (void);
 extern void syms_of_doc (void);
 extern int read_bytecode_char (bool);
 
@@ -4242,10 +4425,37 @@ extern struct byte_stack *byte_stack_list;
 #if BYTE_MARK_STACK
 extern void mark_byte_stack (void);
 #endif
-extern void unmark_byte_stack (void);
+extern void sweep_byte_code_cache (void);
 extern Lisp_Object exec_byte_code (Lisp_Object, Lisp_Object, Lisp_Object,
 				   Lisp_Object, ptrdiff_t, Lisp_Object *);
 
+#ifdef HAVE_NATIVE_BYTE_CODE
+/* A function compiled from byte code to native code by
+   byte-native.el.  A file FOO.eln of native code, loaded along with
+   FOO.elc, holds a table of these.  */
+struct native_byte_code
+{
+  /* The byte-code string it was compiled from.  */
+  const char *bytes;
+  ptrdiff_t nbytes;
+
+  /* The stack depth at entry, that is, the number of values that the
+     arguments template pushes.  */
+  ptrdiff_t depth;
+
+  /* Run the byte code.  VECTORP points to the contents of the
+     constants vector, and ARGS to the DEPTH values on the stack at
+     entry.  */
+  Lisp_Object (*function) (Lisp_Object *vectorp, Lisp_Object *args);
+};
+
+/* A .eln file works only with the Emacs it was compiled for.  */
+#define NATIVE_BYTE_CODE_ABI \
+  "1 " PACKAGE_VERSION " " EMACS_CONFIGURATION " " EMACS_CONFIG_OPTIONS
+
+extern void load_native_byte_code (Lisp_Object);
+#endif
+
 /* Defined in macros.c.  */
 extern void init_macros (void);
 extern void syms_of_macros (void);
@@ -4713,7 +4923,7 @@ maybe_gc (void)
        && consing_since_gc > gc_relative_threshold)
       || (!NILP (Vmemory_full)
 	  && consing_since_gc > memory_full_cons_threshold))
-    Fgarbage_collect ();
+    garbage_collect ();
 }
 
 INLINE bool
@@ -4748,6 +4958,149 @@ functionp (Lisp_Object object)
     return false;
 }
 
+/* Return true if A * B overflows EMACS_INT, and store the product in
+   *R otherwise.  Use the compiler's builtin if there is one.  */
+#if 5 <= __GNUC__
+# define EMACS_INT_MULTIPLY_OVERFLOW(a, b, r) __builtin_mul_overflow (a, b, r)
+#elif defined __has_builtin
+# if __has_builtin (__builtin_mul_overflow)
+#  define EMACS_INT_MULTIPLY_OVERFLOW(a, b, r) __builtin_mul_overflow (a, b, r)
+# endif
+#endif
+#ifndef EMACS_INT_MULTIPLY_OVERFLOW
+# define EMACS_INT_MULTIPLY_OVERFLOW(a, b, r) \
+   (INT_MULTIPLY_OVERFLOW (a, b) || (*(r) = (a) * (b), false))
+#endif
+
+/* Return the value of the number X as a double.  */
+
+INLINE double
+arith_float (Lisp_Object x)
+{
+  return FLOATP (x) ? XFLOAT_DATA (x) : XINT (x);
+}
+
+/* Fast paths for arithmetic on two numbers, used by the byte-code
+   interpreter and by the arithmetic functions in data.c.  Each stores
+   the result of the operation on X and Y in *RESULT and returns true,
+   if X and Y are fixnums whose result is a fixnum, or numbers at
+   least one of which is a float.  Otherwise it returns false, and the
+   caller must use the general function, such as Fplus, which coerces
+   markers, signals errors and wraps around on overflow.  Sums and
+   differences of two fixnums cannot overflow EMACS_INT.  */
+
+INLINE bool
+arith_add2 (Lisp_Object x, Lisp_Object y, Lisp_Object *result)
+{
+  if (INTEGERP (x) && INTEGERP (y))
+    {
+      EMACS_INT r = XINT (x) + XINT (y);
+      if (FIXNUM_OVERFLOW_P (r))
+	return false;
+      *result = make_number (r);
+    }
+  else if (NUMBERP (x) && NUMBERP (y))
+    /* Add to 0.0 first, as float_arith_driver does; this matters
+       only if X and Y are both -0.0.  */
+    *result = make_float (0.0 + arith_float (x) + arith_float (y));
+  else
+    return false;
+  return true;
+}
+
+INLINE bool
+arith_sub2 (Lisp_Object x, Lisp_Object y, Lisp_Object *result)
+{
+  if (INTEGERP (x) && INTEGERP (y))
+    {
+      EMACS_INT r = XINT (x) - XINT (y);
+      if (FIXNUM_OVERFLOW_P (r))
+	return false;
+      *result = make_number (r);
+    }
+  else if (NUMBERP (x) && NUMBERP (y))
+    *result = make_float (arith_float (x) - arith_float (y));
+  else
+    return false;
+  return true;
+}
+
+INLINE bool
+arith_mul2 (Lisp_Object x, Lisp_Object y, Lisp_Object *result)
+{
+  if (INTEGERP (x) && INTEGERP (y))
+    {
+      EMACS_INT r;
+      if (EMACS_INT_MULTIPLY_OVERFLOW (XINT (x), XINT (y), &r)
+	  || FIXNUM_OVERFLOW_P (r))
+	return false;
+      *result = make_number (r);
+    }
+  else if (NUMBERP (x) && NUMBERP (y))
+    *result = make_float (arith_float (x) * arith_float (y));
+  else
+    return false;
+  return true;
+}
+
+/* Only fixnums have a fast path for division.  Fquo signals an
+   error for a zero divisor.  */
+
+INLINE bool
+arith_div2 (Lisp_Object x, Lisp_Object y, Lisp_Object *result)
+{
+  if (INTEGERP (x) && INTEGERP (y) && XINT (y) != 0)
+    {
+      EMACS_INT r = XINT (x) / XINT (y);
+      if (FIXNUM_OVERFLOW_P (r))
+	return false;
+      *result = make_number (r);
+      return true;
+    }
+  return false;
+}
+
+INLINE bool
+arithcompare2 (Lisp_Object x, Lisp_Object y,
+	       enum Arith_Comparison comparison, Lisp_Object *result)
+{
+  bool value;
+
+  if (INTEGERP (x) && INTEGERP (y))
+    {
+      EMACS_INT a = XINT (x), b = XINT (y);
+      switch (comparison)
+	{
+	case ARITH_EQUAL: value = a == b; break;
+	case ARITH_NOTEQUAL: value = a != b; break;
+	case ARITH_LESS: value = a < b; break;
+	case ARITH_GRTR: value = a > b; break;
+	case ARITH_LESS_OR_EQUAL: value = a <= b; break;
+	case ARITH_GRTR_OR_EQUAL: value = a >= b; break;
+	default: return false;
+	}
+    }
+  else if (NUMBERP (x) && NUMBERP (y))
+    {
+      double a = arith_float (x), b = arith_float (y);
+      switch (comparison)
+	{
+	case ARITH_EQUAL: value = a == b; break;
+	case ARITH_NOTEQUAL: value = a != b; break;
+	case ARITH_LESS: value = a < b; break;
+	case ARITH_GRTR: value = a > b; break;
+	case ARITH_LESS_OR_EQUAL: value = a <= b; break;
+	case ARITH_GRTR_OR_EQUAL: value = a >= b; break;
+	default: return false;
+	}
+    }
+  else
+    return false;
+
+  *result = value ? Qt : Qnil;
+  return true;
+}
+
 INLINE_HEADER_END
 
 #endif /* EMACS_LISP_H */
@@ -56,6 +56,10 @@ along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.  */
 
 #include <fcntl.h>
 
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#endif
+
 #ifdef HAVE_FSEEKO
 #define file_offset off_t
 #define file_tell ftello
@@ -98,6 +102,25 @@ static Lisp_Object read_objects;
 /* File for get_file_char to read from.  Use by load.  */
 static FILE *instream;
 
+/* The contents of a byte-compiled file that load has mapped into
+   memory.  While a file is mapped, it is read from POS instead of
+   from INSTREAM, which stays at the start of the file.  */
+struct mapped_file
+{
+  unsigned char const *start;
+  unsigned char const *pos;
+  unsigned char const *end;
+};
+
+/* The mapped contents of INSTREAM, or NULL if it is not mapped.  */
+static struct mapped_file *inmap;
+
+/* Statistics of the files read by load, for `load-statistics'.  */
+static EMACS_INT load_files_read, load_files_mapped;
+static EMACS_INT load_bytes_mapped;
+static struct timespec load_read_time;
+static Lisp_Object QCfiles, QCmapped_files, QCmapped_bytes, QCread_time;
+
 /* For use within read-from-string (this reader is non-reentrant!!)  */
 static ptrdiff_t read_from_string_index;
 static ptrdiff_t read_from_string_index_byte;
@@ -142,7 +165,8 @@ static Lisp_Object Vloads_in_progress;
 static int read_emacs_mule_char (int, int (*) (int, Lisp_Object),
                                  Lisp_Object);
 
-static void readevalloop (Lisp_Object, FILE *, Lisp_Object, bool,
+static void readevalloop (Lisp_Object, FILE *, struct mapped_file *,
+                          Lisp_Object, bool,
                           Lisp_Object, Lisp_Object,
                           Lisp_Object, Lisp_Object);
 
@@ -261,6 +285,15 @@ readchar (Lisp_Object readcharfun, bool *multibyte)
 
   if (EQ (readcharfun, Qget_file_char))
     {
+      /* Most of a byte-compiled file is ASCII; return it straight
+	 from the mapped contents.  */
+      if (inmap && unread_char < 0 && inmap->pos < inmap->end
+	  && ASCII_CHAR_P (*inmap->pos))
+	{
+	  if (multibyte)
+	    *multibyte = 1;
+	  return *inmap->pos++;
+	}
       readbyte = readbyte_from_file;
       goto read_multibyte;
     }
@@ -352,7 +385,9 @@ readchar (Lisp_Object readcharfun, bool *multibyte)
 static void
 skip_dyn_bytes (Lisp_Object readcharfun, ptrdiff_t n)
 {
-  if (FROM_FILE_P (readcharfun))
+  if (FROM_FILE_P (readcharfun) && inmap)
+    inmap->pos += min (n, inmap->end - inmap->pos);
+  else if (FROM_FILE_P (readcharfun))
     {
       block_input ();		/* FIXME: Not sure if it's needed.  */
       fseek (instream, n, SEEK_CUR);
@@ -375,7 +410,9 @@ skip_dyn_bytes (Lisp_Object readcharfun, ptrdiff_t n)
 static void
 skip_dyn_eof (Lisp_Object readcharfun)
 {
-  if (FROM_FILE_P (readcharfun))
+  if (FROM_FILE_P (readcharfun) && inmap)
+    inmap->pos = inmap->end;
+  else if (FROM_FILE_P (readcharfun))
     {
       block_input ();		/* FIXME: Not sure if it's needed.  */
       fseek (instream, 0, SEEK_END);
@@ -454,6 +491,16 @@ readbyte_for_lambda (int c, Lisp_Object readcharfun)
 static int
 readbyte_from_file (int c, Lisp_Object readcharfun)
 {
+  if (inmap)
+    {
+      if (c >= 0)
+	{
+	  inmap->pos--;
+	  return 0;
+	}
+      return inmap->pos < inmap->end ? *inmap->pos++ : -1;
+    }
+
   if (c >= 0)
     {
       block_input ();
@@ -776,6 +823,8 @@ DEFUN ("get-file-char", Fget_file_char, Sget_file_char, 0, 0, 0,
   (void)
 {
   register Lisp_Object val;
+  if (inmap)
+    return make_number (inmap->pos < inmap->end ? *inmap->pos++ : EOF);
   block_input ();
   XSETINT (val, getc (instream));
   unblock_input ();
@@ -975,6 +1024,48 @@ load_warn_old_style_backquotes (Lisp_Object file)
     }
 }
 
+#ifdef HAVE_MMAP
+
+/* Unmap MAP, a file that load mapped into memory.  */
+
+static void
+unmap_file (void *map)
+{
+  struct mapped_file *m = map;
+
+  if (inmap == m)
+    inmap = NULL;
+  munmap ((void *) m->start, m->end - m->start);
+}
+
+/* Map the contents of STREAM into memory and describe them in *MAP.
+   Return MAP, or NULL if STREAM cannot be mapped and must be read
+   with stdio instead.  The mapping lasts until the current binding
+   stack is unwound.  */
+
+static struct mapped_file *
+map_file (FILE *stream, struct mapped_file *map)
+{
+  struct stat st;
+  void *start;
+
+  if (fstat (fileno (stream), &st) != 0 || ! S_ISREG (st.st_mode)
+      || st.st_size == 0 || min (PTRDIFF_MAX, SIZE_MAX) < st.st_size)
+    return NULL;
+  start = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno (stream), 0);
+  if (start == MAP_FAILED)
+    return NULL;
+  map->start = map->pos = start;
+  map->end = map->start + st.st_size;
+  record_unwind_protect_ptr (unmap_file, map);
+
+  load_files_mapped++;
+  load_bytes_mapped += st.st_size;
+  return map;
+}
+
+#endif /* HAVE_MMAP */
+
 DEFUN ("get-load-suffixes", Fget_load_suffixes, Sget_load_suffixes, 0, 0, 0,
        doc: /* Return the suffixes that `load' should try if a suffix is \
 required.
@@ -1045,6 +1136,7 @@ Return t if the file exists and loads successfully.  */)
    Lisp_Object nosuffix, Lisp_Object must_suffix)
 {
   FILE *stream;
+  struct mapped_file map, *mapped = NULL;
   int fd;
   int fd_index;
   ptrdiff_t count = SPECPDL_INDEX ();
@@ -1332,6 +1424,20 @@ Return t if the file exists and loads successfully.  */)
     report_file_error ("Opening stdio stream", file);
   set_unwind_protect_ptr (fd_index, fclose_unwind, stream);
 
+#ifdef HAVE_MMAP
+  /* Read byte-compiled files straight from memory; see readchar.  */
+  if (compiled)
+    mapped = map_file (stream, &map);
+#endif
+  load_files_read++;
+
+#ifdef HAVE_NATIVE_BYTE_CODE
+  /* Load native code first, so that the byte code finds it when it
+     is first decoded.  Native code cannot be dumped.  */
+  if (compiled && NILP (Vpurify_flag))
+    load_native_byte_code (found);
+#endif
+
   if (! NILP (Vpurify_flag))
     Vpreloaded_file_list = Fcons (Fpurecopy (file), Vpreloaded_file_list);
 
@@ -1354,19 +1460,20 @@ Return t if the file exists and loads successfully.  */)
   specbind (Qload_in_progress, Qt);
 
   instream = stream;
+  inmap = mapped;
   if (lisp_file_lexically_bound_p (Qget_file_char))
     Fset (Qlexical_binding, Qt);
 
   if (! version || version >= 22)
-    readevalloop (Qget_file_char, stream, hist_file_name,
+    readevalloop (Qget_file_char, stream, mapped, hist_file_name,
 		  0, Qnil, Qnil, Qnil, Qnil);
   else
     {
       /* We can't handle a file which was compiled with
 	 byte-compile-dynamic by older version of Emacs.  */
       specbind (Qload_force_doc_strings, Qt);
-      readevalloop (Qget_emacs_mule_file_char, stream, hist_file_name,
-		    0, Qnil, Qnil, Qnil, Qnil);
+      readevalloop (Qget_emacs_mule_file_char, stream, mapped,
+		    hist_file_name, 0, Qnil, Qnil, Qnil, Qnil);
     }
   unbind_to (count, Qnil);
 
@@ -1400,6 +1507,33 @@ Return t if the file exists and loads successfully.  */)
 
   return Qt;
 }
+
+DEFUN ("load-statistics", Fload_statistics, Sload_statistics, 0, 1, 0,
+       doc: /* Return statistics about the files that `load' has read.
+The value is a list (:files FILES :mapped-files MAPPED-FILES
+:mapped-bytes MAPPED-BYTES :read-time READ-TIME), where FILES is the
+number of files that `load' read itself rather than through
+`load-source-file-function', MAPPED-FILES is the number of those that
+were byte-compiled files read straight from memory, MAPPED-BYTES is
+their total size, and READ-TIME is the number of seconds spent reading
+forms from the files, not counting the time to evaluate them.
+If RESET is non-nil, start counting again from zero afterwards.  */)
+  (Lisp_Object reset)
+{
+  Lisp_Object val
+    = listn (CONSTYPE_HEAP, 8,
+	     QCfiles, make_fixnum_or_float (load_files_read),
+	     QCmapped_files, make_fixnum_or_float (load_files_mapped),
+	     QCmapped_bytes, make_fixnum_or_float (load_bytes_mapped),
+	     QCread_time, make_float (timespectod (load_read_time)));
+
+  if (!NILP (reset))
+    {
+      load_files_read = load_files_mapped = load_bytes_mapped = 0;
+      load_read_time = make_timespec (0, 0);
+    }
+  return val;
+}
 
 static bool
 complete_filename_p (Lisp_Object pathname)
@@ -1798,12 +1932,16 @@ readevalloop_eager_expand_eval (Lisp_Object val, Lisp_Object macroexpand)
    for this invocation.
    READFUN, if non-nil, is used instead of `read'.
 
+   STREAM is the file that load is reading, if any, and MAP its
+   contents if load has mapped it into memory.
+
    START, END specify region to read in current buffer (from eval-region).
    If the input is not from a buffer, they must be nil.  */
 
 static void
 readevalloop (Lisp_Object readcharfun,
 	      FILE *stream,
+	      struct mapped_file *map,
 	      Lisp_Object sourcename,
 	      bool printflag,
 	      Lisp_Object unibyte, Lisp_Object readfun,
@@ -1820,6 +1958,7 @@ readevalloop (Lisp_Object readcharfun,
   bool whole_buffer = 0;
   /* True on the first time around.  */
   bool first_sexp = 1;
+  struct timespec read_start;
   Lisp_Object macroexpand = intern ("internal-macroexpand-for-load");
 
   if (NILP (Ffboundp (macroexpand))
@@ -1907,6 +2046,8 @@ readevalloop (Lisp_Object readcharfun,
 	whole_buffer = (PT == BEG && ZV == Z);
 
       instream = stream;
+      inmap = map;
+      read_start = current_timespec ();
     read_next:
       c = READCHAR;
       if (c == ';')
@@ -1953,6 +2094,11 @@ readevalloop (Lisp_Object readcharfun,
 	    val = read_internal_start (readcharfun, Qnil, Qnil);
 	}
 
+      if (stream)
+	load_read_time = timespec_add (load_read_time,
+				       timespec_sub (current_timespec (),
+						     read_start));
+
       if (!NILP (start) && continue_reading_p)
 	start = Fpoint_marker ();
 
@@ -2024,7 +2170,7 @@ This function preserves the position of point.  */)
   record_unwind_protect (save_excursion_restore, save_excursion_save ());
   BUF_TEMP_SET_PT (XBUFFER (buf), BUF_BEGV (XBUFFER (buf)));
   specbind (Qlexical_binding, lisp_file_lexically_bound_p (buf) ? Qt : Qnil);
-  readevalloop (buf, 0, filename,
+  readevalloop (buf, 0, NULL, filename,
 		!NILP (printflag), unibyte, Qnil, Qnil, Qnil);
   unbind_to (count, Qnil);
 
@@ -2059,7 +2205,7 @@ This function does not move point.  */)
   specbind (Qeval_buffer_list, Fcons (cbuf, Veval_buffer_list));
 
   /* `readevalloop' calls functions which check the type of start and end.  */
-  readevalloop (cbuf, 0, BVAR (XBUFFER (cbuf), filename),
+  readevalloop (cbuf, 0, NULL, BVAR (XBUFFER (cbuf), filename),
 		!NILP (printflag), Qnil, read_function,
 		start, end);
 
@@ -2638,7 +2784,7 @@ read1 (Lisp_Object readcharfun, int *pch, bool first_in_list)
 		  tbl = make_uninit_sub_char_table (depth, min_char);
 		  for (i = 0; i < size; i++)
 		    {
-		      XSUB_CHAR_TABLE (tbl)->contents[i] = XCAR (tmp);
+		      set_sub_char_table_contents (tbl, i, XCAR (tmp));
 		      cell = XCONS (tmp), tmp = XCDR (tmp);
 		      free_cons (cell);
 		    }
@@ -2690,7 +2836,7 @@ read1 (Lisp_Object readcharfun, int *pch, bool first_in_list)
 	  struct Lisp_Vector *vec;
 	  tmp = read_vector (readcharfun, 1);
 	  vec = XVECTOR (tmp);
-	  if (vec->header.size == 0)
+	  if (ASIZE (tmp) == 0)
 	    invalid_syntax ("Empty byte-code object");
 	  make_byte_code (vec);
 	  return tmp;
@@ -2796,13 +2942,24 @@ read1 (Lisp_Object readcharfun, int *pch, bool first_in_list)
 		  saved_doc_string_size = nskip + extra;
 		}
 
-	      saved_doc_string_position = file_tell (instream);
+	      if (inmap)
+		{
+		  /* Copy that many bytes of the mapped file at once.  */
+		  saved_doc_string_position = inmap->pos - inmap->start;
+		  i = min (nskip, inmap->end - inmap->pos);
+		  memcpy (saved_doc_string, inmap->pos, i);
+		  inmap->pos += i;
+		}
+	      else
+		{
+		  saved_doc_string_position = file_tell (instream);
 
-	      /* Copy that many characters into saved_doc_string.  */
-	      block_input ();
-	      for (i = 0; i < nskip && c >= 0; i++)
-		saved_doc_string[i] = c = getc (instream);
-	      unblock_input ();
+		  /* Copy that many characters into saved_doc_string.  */
+		  block_input ();
+		  for (i = 0; i < nskip && c >= 0; i++)
+		    saved_doc_string[i] = c = getc (instream);
+		  unblock_input ();
+		}
 
 	      saved_doc_string_length = i;
 	    }
@@ -3119,6 +3276,25 @@ read1 (Lisp_Object readcharfun, int *pch, bool first_in_list)
 		  force_multibyte = 1;
 	      }
 	    nchars++;
+
+	    if (EQ (readcharfun, Qget_file_char) && inmap && unread_char < 0)
+	      {
+		/* Copy the plain ASCII that follows in the mapped file
+		   all at once, as far as READ_BUFFER has room.  This is
+		   most of the text of doc strings and byte-code.  */
+		unsigned char const *q = inmap->pos;
+		unsigned char const *lim = q + min (inmap->end - q, end - p);
+		ptrdiff_t n;
+
+		while (q < lim && ASCII_CHAR_P (*q) && *q != '"' && *q != '\\')
+		  q++;
+		n = q - inmap->pos;
+		memcpy (p, inmap->pos, n);
+		p += n;
+		nchars += n;
+		readchar_count += n;
+		inmap->pos = q;
+	      }
 	  }
 
 	if (ch < 0)
@@ -3772,6 +3948,16 @@ read_list (bool flag, Lisp_Object readcharfun)
 
 static Lisp_Object initial_obarray;
 
+/* Initial number of buckets of `obarray', and of an obarray made by
+   `obarray-make' with no size.  */
+
+#define OBARRAY_SIZE 1511
+#define OBARRAY_DEFAULT_SIZE 31
+
+static Lisp_Object Qobarrayp;
+static Lisp_Object QCsymbols, QCbuckets, QCload_factor, QClongest_chain;
+static Lisp_Object QCempty_buckets;
+
 /* `oblookup' stores the bucket number here, for the sake of Funintern.  */
 
 static size_t oblookup_last_bucket_number;
@@ -3782,21 +3968,108 @@ static size_t oblookup_last_bucket_number;
 Lisp_Object
 check_obarray (Lisp_Object obarray)
 {
-  if (!VECTORP (obarray) || ASIZE (obarray) == 0)
+  if (!OBARRAYP (obarray) && (!VECTORP (obarray) || ASIZE (obarray) == 0))
     {
       /* If Vobarray is now invalid, force it to be valid.  */
       if (EQ (Vobarray, obarray)) Vobarray = initial_obarray;
-      wrong_type_argument (Qvectorp, obarray);
+      wrong_type_argument (Qobarrayp, obarray);
     }
   return obarray;
 }
 
+static void
+set_obarray_buckets (struct Lisp_Obarray *o, Lisp_Object buckets)
+{
+  note_vector_store ((struct Lisp_Vector *) o, buckets);
+  o->buckets = buckets;
+}
+
+/* Return a new obarray with SIZE buckets.  */
+
+static Lisp_Object
+make_obarray (ptrdiff_t size)
+{
+  struct Lisp_Obarray *o
+    = ALLOCATE_PSEUDOVECTOR (struct Lisp_Obarray, count, PVEC_OBARRAY);
+  Lisp_Object obarray;
+
+  set_obarray_buckets (o, Fmake_vector (make_number (size), make_number (0)));
+  o->count = 0;
+  o->holds = 0;
+  XSETPSEUDOVECTOR (obarray, o, PVEC_OBARRAY);
+  return obarray;
+}
+
+/* Rehash the symbols of obarray O into enough buckets that there is
+   at most one symbol per bucket on average.  */
+
+static void
+grow_obarray (struct Lisp_Obarray *o)
+{
+  Lisp_Object old = o->buckets, buckets, tail;
+  ptrdiff_t oldsize = ASIZE (old), size = oldsize, i;
+  struct Lisp_Symbol *sym, *next;
+
+  /* The count can be much larger than the size if symbols were
+     interned while the obarray was held.  */
+  do
+    {
+      if (min (MOST_POSITIVE_FIXNUM, PTRDIFF_MAX / word_size) / 2 < size)
+	break;
+      size = 2 * size + 1;
+    }
+  while (size < o->count);
+  if (size == oldsize)
+    return;
+  buckets = Fmake_vector (make_number (size), make_number (0));
+
+  for (i = 0; i < oldsize; i++)
+    {
+      tail = AREF (old, i);
+      for (sym = SYMBOLP (tail) ? XSYMBOL (tail) : NULL; sym; sym = next)
+	{
+	  Lisp_Object name = sym->name, symbol, first;
+	  ptrdiff_t j = hash_string (SSDATA (name), SBYTES (name)) % size;
+
+	  next = sym->next;
+	  XSETSYMBOL (symbol, sym);
+	  first = AREF (buckets, j);
+	  set_symbol_next (symbol, SYMBOLP (first) ? XSYMBOL (first) : NULL);
+	  ASET (buckets, j, symbol);
+	}
+    }
+
+  set_obarray_buckets (o, buckets);
+}
+
+static void
+release_obarray (void *o)
+{
+  ((struct Lisp_Obarray *) o)->holds--;
+}
+
+/* Keep the buckets of OBARRAY from being resized, so that they can be
+   walked while calling Lisp code that may intern symbols.  The hold
+   is released when the binding stack is unwound to its current
+   level.  */
+
+void
+hold_obarray (Lisp_Object obarray)
+{
+  if (OBARRAYP (obarray))
+    {
+      struct Lisp_Obarray *o = XOBARRAY (obarray);
+      o->holds++;
+      record_unwind_protect_ptr (release_obarray, o);
+    }
+}
+
 /* Intern a symbol with name STRING in OBARRAY using bucket INDEX.  */
 
 Lisp_Object
 intern_driver (Lisp_Object string, Lisp_Object obarray, ptrdiff_t index)
 {
-  Lisp_Object *ptr, sym = Fmake_symbol (string);
+  Lisp_Object buckets, first, sym = Fmake_symbol (string);
 
   XSYMBOL (sym)->interned = (EQ (obarray, initial_obarray)
 			     ? SYMBOL_INTERNED_IN_INITIAL_OBARRAY
@@ -3809,9 +4082,18 @@ intern_driver (Lisp_Object string, Lisp_Object obarray, ptrdiff_t index)
       SET_SYMBOL_VAL (XSYMBOL (sym), sym);
     }
 
-  ptr = aref_addr (obarray, index);
-  set_symbol_next (sym, SYMBOLP (*ptr) ? XSYMBOL (*ptr) : NULL);
-  *ptr = sym;
+  buckets = obarray_buckets (obarray);
+  first = AREF (buckets, index);
+  set_symbol_next (sym, SYMBOLP (first) ? XSYMBOL (first) : NULL);
+  ASET (buckets, index, sym);
+
+  /* Keep the average length of the chains of buckets below 1.  */
+  if (OBARRAYP (obarray))
+    {
+      struct Lisp_Obarray *o = XOBARRAY (obarray);
+      if (++o->count > ASIZE (o->buckets) && o->holds == 0)
+	grow_obarray (o);
+    }
   return sym;
 }
 
@@ -3900,11 +4182,12 @@ OBARRAY, if nil, defaults to the value of the variable `obarray'.
 usage: (unintern NAME OBARRAY)  */)
   (Lisp_Object name, Lisp_Object obarray)
 {
-  register Lisp_Object string, tem;
+  register Lisp_Object string, tem, buckets;
   size_t hash;
 
   if (NILP (obarray)) obarray = Vobarray;
   obarray = check_obarray (obarray);
+  buckets = obarray_buckets (obarray);
 
   if (SYMBOLP (name))
     string = SYMBOL_NAME (name);
@@ -3933,23 +4216,25 @@ usage: (unintern NAME OBARRAY)  */)
   XSYMBOL (tem)->interned = SYMBOL_UNINTERNED;
 
   hash = oblookup_last_bucket_number;
+  if (OBARRAYP (obarray))
+    XOBARRAY (obarray)->count--;
 
-  if (EQ (AREF (obarray, hash), tem))
+  if (EQ (AREF (buckets, hash), tem))
     {
       if (XSYMBOL (tem)->next)
 	{
 	  Lisp_Object sym;
 	  XSETSYMBOL (sym, XSYMBOL (tem)->next);
-	  ASET (obarray, hash, sym);
+	  ASET (buckets, hash, sym);
 	}
       else
-	ASET (obarray, hash, make_number (0));
+	ASET (buckets, hash, make_number (0));
     }
   else
     {
       Lisp_Object tail, following;
 
-      for (tail = AREF (obarray, hash);
+      for (tail = AREF (buckets, hash);
 	   XSYMBOL (tail)->next;
 	   tail = following)
 	{
@@ -3980,7 +4265,7 @@ oblookup (Lisp_Object obarray, register const char *ptr, ptrdiff_t size, ptrdiff
   register Lisp_Object tail;
   Lisp_Object bucket, tem;
 
-  obarray = check_obarray (obarray);
+  obarray = obarray_buckets (check_obarray (obarray));
   obsize = ASIZE (obarray);
 
   /* This is sometimes needed in the middle of GC.  */
@@ -4009,12 +4294,15 @@ oblookup (Lisp_Object obarray, register const char *ptr, ptrdiff_t size, ptrdiff
 void
 map_obarray (Lisp_Object obarray, void (*fn) (Lisp_Object, Lisp_Object), Lisp_Object arg)
 {
-  ptrdiff_t i;
-  register Lisp_Object tail;
-  CHECK_VECTOR (obarray);
-  for (i = ASIZE (obarray) - 1; i >= 0; i--)
+  ptrdiff_t i, count = SPECPDL_INDEX ();
+  register Lisp_Object tail, buckets;
+
+  obarray = check_obarray (obarray);
+  hold_obarray (obarray);
+  buckets = obarray_buckets (obarray);
+  for (i = ASIZE (buckets) - 1; i >= 0; i--)
     {
-      tail = AREF (obarray, i);
+      tail = AREF (buckets, i);
       if (SYMBOLP (tail))
 	while (1)
 	  {
@@ -4024,6 +4312,7 @@ map_obarray (Lisp_Object obarray, void (*fn) (Lisp_Object, Lisp_Object), Lisp_Ob
 	    XSETSYMBOL (tail, XSYMBOL (tail)->next);
 	  }
     }
+  unbind_to (count, Qnil);
 }
 
 static void
@@ -4044,17 +4333,77 @@ OBARRAY defaults to the value of `obarray'.  */)
   return Qnil;
 }
 
-#define OBARRAY_SIZE 1511
+DEFUN ("obarray-make", Fobarray_make, Sobarray_make, 0, 1, 0,
+       doc: /* Return a new obarray.
+Optional argument SIZE is the number of symbols expected to be
+interned in it.  The obarray grows as needed, whatever SIZE is.  */)
+  (Lisp_Object size)
+{
+  if (NILP (size))
+    return make_obarray (OBARRAY_DEFAULT_SIZE);
+  CHECK_NATNUM (size);
+  return make_obarray (max (1, min (XFASTINT (size),
+				    PTRDIFF_MAX / word_size / 2)));
+}
+
+DEFUN ("obarrayp", Fobarrayp, Sobarrayp, 1, 1, 0,
+       doc: /* Return t if OBJECT is an obarray made by `obarray-make'.
+A nonempty vector can also serve as an obarray, but its size is fixed,
+and this function returns nil for it.  */)
+  (Lisp_Object object)
+{
+  return OBARRAYP (object) ? Qt : Qnil;
+}
+
+DEFUN ("obarray-statistics", Fobarray_statistics, Sobarray_statistics,
+       0, 1, 0,
+       doc: /* Return statistics about the buckets of OBARRAY.
+OBARRAY defaults to the value of `obarray'.  The value is a list
+\(:symbols SYMBOLS :buckets BUCKETS :load-factor LOAD-FACTOR
+ :longest-chain LONGEST-CHAIN :empty-buckets EMPTY-BUCKETS),
+where SYMBOLS is the number of symbols interned in OBARRAY, BUCKETS is
+the number of buckets, LOAD-FACTOR is the average number of symbols
+per bucket, LONGEST-CHAIN is the largest number of symbols in one
+bucket, and EMPTY-BUCKETS is the number of buckets with no symbols.
+An obarray made by `obarray-make' gets more buckets when LOAD-FACTOR
+exceeds 1.0.  */)
+  (Lisp_Object obarray)
+{
+  Lisp_Object buckets, tail;
+  ptrdiff_t i, size, symbols = 0, longest = 0, empty = 0;
+
+  if (NILP (obarray)) obarray = Vobarray;
+  obarray = check_obarray (obarray);
+  buckets = obarray_buckets (obarray);
+  size = ASIZE (buckets);
+
+  for (i = 0; i < size; i++)
+    {
+      ptrdiff_t length = 0;
+      struct Lisp_Symbol *sym;
+
+      tail = AREF (buckets, i);
+      for (sym = SYMBOLP (tail) ? XSYMBOL (tail) : NULL; sym; sym = sym->next)
+	length++;
+      symbols += length;
+      longest = max (longest, length);
+      empty += length == 0;
+    }
+
+  return listn (CONSTYPE_HEAP, 10,
+		QCsymbols, make_number (symbols),
+		QCbuckets, make_number (size),
+		QCload_factor, make_float ((double) symbols / size),
+		QClongest_chain, make_number (longest),
+		QCempty_buckets, make_number (empty));
+}
 
 void
 init_obarray (void)
 {
-  Lisp_Object oblength;
   ptrdiff_t size = 100 + MAX_MULTIBYTE_LENGTH;
 
-  XSETFASTINT (oblength, OBARRAY_SIZE);
-
-  Vobarray = Fmake_vector (oblength, make_number (0));
+  Vobarray = make_obarray (OBARRAY_SIZE);
   initial_obarray = Vobarray;
   staticpro (&initial_obarray);
 
@@ -4482,6 +4831,7 @@ syms_of_lread (void)
   defsubr (&Sunintern);
   defsubr (&Sget_load_suffixes);
   defsubr (&Sload);
+  defsubr (&Sload_statistics);
   defsubr (&Seval_buffer);
   defsubr (&Seval_region);
   defsubr (&Sread_char);
@@ -4489,13 +4839,17 @@ syms_of_lread (void)
   defsubr (&Sread_event);
   defsubr (&Sget_file_char);
   defsubr (&Smapatoms);
+  defsubr (&Sobarray_make);
+  defsubr (&Sobarrayp);
+  defsubr (&Sobarray_statistics);
   defsubr (&Slocate_file_internal);
 
   DEFVAR_LISP ("obarray", Vobarray,
 	       doc: /* Symbol table for use by `intern' and `read'.
-It is a vector whose length ought to be prime for best results.
-The vector's contents don't make sense if examined from Lisp programs;
-to find all the symbols in an obarray, use `mapatoms'.  */);
+It is an obarray made by `obarray-make', or a vector whose length ought
+to be prime for best results.  The vector's contents don't make sense
+if examined from Lisp programs; to find all the symbols in an obarray,
+use `mapatoms'.  */);
 
   DEFVAR_LISP ("values", Vvalues,
 	       doc: /* List of values of all expressions which were read, evaluated and printed.
@@ -4761,4 +5115,16 @@ that are loaded before your customizations are read!  */);
   DEFSYM (Qweakness, "weakness");
   DEFSYM (Qrehash_size, "rehash-size");
   DEFSYM (Qrehash_threshold, "rehash-threshold");
+
+  DEFSYM (Qobarrayp, "obarrayp");
+  DEFSYM (QCsymbols, ":symbols");
+  DEFSYM (QCbuckets, ":buckets");
+  DEFSYM (QCload_factor, ":load-factor");
+  DEFSYM (QClongest_chain, ":longest-chain");
+  DEFSYM (QCempty_buckets, ":empty-buckets");
+
+  DEFSYM (QCfiles, ":files");
+  DEFSYM (QCmapped_files, ":mapped-files");
+  DEFSYM (QCmapped_bytes, ":mapped-bytes");
+  DEFSYM (QCread_time, ":read-time");
 }
@@ -74,14 +74,228 @@ clear_charpos_cache (struct buffer *b)
 {
   if (cached_buffer == b)
     cached_buffer = 0;
+  b->text->ncheckpoints = 0;
+}
+
+/* The position index.
+
+   Besides the places listed below, each buffer text records an array
+   of checkpoints, sorted by position, whose character and byte
+   positions are known to correspond.  Whenever a conversion has to
+   count characters over a long stretch of text, it adds a checkpoint
+   every CHARPOS_INDEX_INTERVAL bytes, so a later conversion anywhere
+   in that stretch finds a close checkpoint by binary search and never
+   needs to count more than about CHARPOS_INDEX_INTERVAL bytes.
+   Buffer changes keep the array up to date via adjust_charpos_index.  */
+
+enum { CHARPOS_INDEX_INTERVAL = 16 * 1024 };
+
+/* Return the index of the last checkpoint of T that is at or before
+   POS, a byte position if BYTES and a character position otherwise,
+   or -1 if there is none.  */
+
+static ptrdiff_t
+charpos_index_search (struct buffer_text *t, ptrdiff_t pos, bool bytes)
+{
+  ptrdiff_t lo = 0, hi = t->ncheckpoints;
+
+  while (lo < hi)
+    {
+      ptrdiff_t mid = lo + (hi - lo) / 2;
+      struct charpos_checkpoint *c = &t->checkpoints[mid];
+
+      if ((bytes ? c->bytepos : c->charpos) <= pos)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+  return lo - 1;
+}
+
+/* Insert N uninitialized checkpoints before index I of T.  */
+
+static void
+charpos_index_open (struct buffer_text *t, ptrdiff_t i, ptrdiff_t n)
+{
+  ptrdiff_t room = t->checkpoints_size - t->ncheckpoints;
+
+  if (room < n)
+    t->checkpoints = xpalloc (t->checkpoints, &t->checkpoints_size,
+			      n - room, -1, sizeof *t->checkpoints);
+  memmove (t->checkpoints + i + n, t->checkpoints + i,
+	   (t->ncheckpoints - i) * sizeof *t->checkpoints);
+  t->ncheckpoints += n;
+}
+
+/* Remove the N checkpoints of T starting at index I.  */
+
+static void
+charpos_index_close (struct buffer_text *t, ptrdiff_t i, ptrdiff_t n)
+{
+  memmove (t->checkpoints + i, t->checkpoints + i + n,
+	   (t->ncheckpoints - i - n) * sizeof *t->checkpoints);
+  t->ncheckpoints -= n;
+}
+
+/* Count a conversion of POS, a byte position if BYTES and a character
+   position otherwise, as a hit or a miss of the position index of T,
+   given that I is the index of the last checkpoint at or before POS.
+   Return true for a hit.  */
+
+static bool
+charpos_index_hit (struct buffer_text *t, ptrdiff_t i, ptrdiff_t pos,
+		   bool bytes)
+{
+  struct charpos_checkpoint *c = t->checkpoints;
+  bool hit = ((0 <= i
+	       && pos - (bytes ? c[i].bytepos : c[i].charpos)
+	          <= CHARPOS_INDEX_INTERVAL)
+	      || (i + 1 < t->ncheckpoints
+		  && (bytes ? c[i + 1].bytepos : c[i + 1].charpos) - pos
+		     <= CHARPOS_INDEX_INTERVAL));
+
+  if (hit)
+    position_index_hits++;
+  else
+    position_index_misses++;
+  return hit;
+}
+
+/* Count characters in B forward from the known position *CHARPOS,
+   *BYTEPOS to TARGET, a byte position if BYTES and a character
+   position otherwise, and store the position reached back into
+   *CHARPOS and *BYTEPOS.  LIMIT_BYTE is a known position past TARGET
+   such that the index has no checkpoints between *BYTEPOS and
+   LIMIT_BYTE; if TARGET is far away, checkpoints are added on the
+   way.  */
+
+static void
+charpos_scan_forward (struct buffer *b, ptrdiff_t *charpos,
+		      ptrdiff_t *bytepos, ptrdiff_t target, bool bytes,
+		      ptrdiff_t limit_byte)
+{
+  struct buffer_text *t = b->text;
+  ptrdiff_t c = *charpos, c_byte = *bytepos;
+  ptrdiff_t span = limit_byte - c_byte;
+  ptrdiff_t room, i = 0, n = 0;
+  ptrdiff_t next_checkpoint = PTRDIFF_MAX;
+
+  /* Bound the number of checkpoints by the distance to TARGET.  */
+  if (bytes)
+    span = min (span, target - c_byte);
+  else if (target - c < span / MAX_MULTIBYTE_LENGTH)
+    span = (target - c) * MAX_MULTIBYTE_LENGTH;
+  room = span / CHARPOS_INDEX_INTERVAL;
+
+  if (room > 0)
+    {
+      i = charpos_index_search (t, c_byte, true) + 1;
+      charpos_index_open (t, i, room);
+      next_checkpoint = c_byte + CHARPOS_INDEX_INTERVAL;
+    }
+
+  while ((bytes ? c_byte : c) < target)
+    {
+      c++;
+      BUF_INC_POS (b, c_byte);
+      if (c_byte >= next_checkpoint && n < room)
+	{
+	  t->checkpoints[i + n].charpos = c;
+	  t->checkpoints[i + n].bytepos = c_byte;
+	  n++;
+	  next_checkpoint = c_byte + CHARPOS_INDEX_INTERVAL;
+	}
+    }
+
+  if (room > 0)
+    charpos_index_close (t, i + n, room - n);
+
+  *charpos = c;
+  *bytepos = c_byte;
+}
+
+/* Likewise, but count backward from *CHARPOS, *BYTEPOS to TARGET,
+   where LIMIT_BYTE is a known position before TARGET.  */
+
+static void
+charpos_scan_backward (struct buffer *b, ptrdiff_t *charpos,
+		       ptrdiff_t *bytepos, ptrdiff_t target, bool bytes,
+		       ptrdiff_t limit_byte)
+{
+  struct buffer_text *t = b->text;
+  ptrdiff_t c = *charpos, c_byte = *bytepos;
+  ptrdiff_t span = c_byte - limit_byte;
+  ptrdiff_t room, i = 0, n = 0;
+  ptrdiff_t next_checkpoint = PTRDIFF_MIN;
+
+  if (bytes)
+    span = min (span, c_byte - target);
+  else if (c - target < span / MAX_MULTIBYTE_LENGTH)
+    span = (c - target) * MAX_MULTIBYTE_LENGTH;
+  room = span / CHARPOS_INDEX_INTERVAL;
+
+  if (room > 0)
+    {
+      i = charpos_index_search (t, c_byte - 1, true) + 1;
+      charpos_index_open (t, i, room);
+      next_checkpoint = c_byte - CHARPOS_INDEX_INTERVAL;
+    }
+
+  /* Checkpoints are found in descending order here, so fill the
+     new slots from the end.  */
+  while ((bytes ? c_byte : c) > target)
+    {
+      c--;
+      BUF_DEC_POS (b, c_byte);
+      if (c_byte <= next_checkpoint && n < room)
+	{
+	  n++;
+	  t->checkpoints[i + room - n].charpos = c;
+	  t->checkpoints[i + room - n].bytepos = c_byte;
+	  next_checkpoint = c_byte - CHARPOS_INDEX_INTERVAL;
+	}
+    }
+
+  if (room > 0)
+    charpos_index_close (t, i, room - n);
+
+  *charpos = c;
+  *bytepos = c_byte;
+}
+
+/* Update the position index of the current buffer for a change that
+   replaced the text between FROM_BYTE and TO_BYTE with text that is
+   NCHARS characters and NBYTES bytes longer (or shorter, if they are
+   negative).  Checkpoints inside the changed text are discarded, and
+   those after it move with the text.  */
+
+void
+adjust_charpos_index (ptrdiff_t from_byte, ptrdiff_t to_byte,
+		      ptrdiff_t nchars, ptrdiff_t nbytes)
+{
+  struct buffer_text *t = current_buffer->text;
+  ptrdiff_t i, j;
+
+  if (t->ncheckpoints == 0)
+    return;
+
+  i = charpos_index_search (t, from_byte, true) + 1;
+  j = charpos_index_search (t, to_byte, true) + 1;
+  charpos_index_close (t, i, j - i);
+  for (; i < t->ncheckpoints; i++)
+    {
+      t->checkpoints[i].charpos += nchars;
+      t->checkpoints[i].bytepos += nbytes;
+    }
 }
 
 /* Converting between character positions and byte positions.  */
 
 /* There are several places in the buffer where we know
    the correspondence: BEG, BEGV, PT, GPT, ZV and Z,
-   and everywhere there is a marker.  So we find the one of these places
-   that is closest to the specified position, and scan from there.  */
+   everywhere there is a marker, and at the checkpoints of the position
+   index.  So we find the one of these places that is closest to the
+   specified position, and scan from there.  */
 
 /* This macro is a subroutine of buf_charpos_to_bytepos.
    Note that it is desirable that BYTEPOS is not evaluated
@@ -141,6 +355,8 @@ buf_charpos_to_bytepos (struct buffer *b, ptrdiff_t charpos)
   struct Lisp_Marker *tail;
   ptrdiff_t best_above, best_above_byte;
   ptrdiff_t best_below, best_below_byte;
+  ptrdiff_t i;
+  bool index_hit;
 
   eassert (BUF_BEG (b) <= charpos && charpos <= BUF_Z (b));
 
@@ -173,16 +389,28 @@ buf_charpos_to_bytepos (struct buffer *b, ptrdiff_t charpos)
   if (b == cached_buffer && BUF_MODIFF (b) == cached_modiff)
     CONSIDER (cached_charpos, cached_bytepos);
 
-  for (tail = BUF_MARKERS (b); tail; tail = tail->next)
-    {
-      CONSIDER (tail->charpos, tail->bytepos);
-
-      /* If we are down to a range of 50 chars,
-	 don't bother checking any other markers;
-	 scan the intervening chars directly now.  */
-      if (best_above - best_below < 50)
-	break;
-    }
+  i = charpos_index_search (b->text, charpos, false);
+  index_hit = charpos_index_hit (b->text, i, charpos, false);
+  if (0 <= i)
+    CONSIDER (b->text->checkpoints[i].charpos,
+	      b->text->checkpoints[i].bytepos);
+  if (i + 1 < b->text->ncheckpoints)
+    CONSIDER (b->text->checkpoints[i + 1].charpos,
+	      b->text->checkpoints[i + 1].bytepos);
+
+  /* With a checkpoint that close, walking the markers would
+     usually cost more than it saves.  */
+  if (!index_hit)
+    for (tail = BUF_MARKERS (b); tail; tail = tail->next)
+      {
+	CONSIDER (tail->charpos, tail->bytepos);
+
+	/* If we are down to a range of 50 chars,
+	   don't bother checking any other markers;
+	   scan the intervening chars directly now.  */
+	if (best_above - best_below < 50)
+	  break;
+      }
 
   /* We get here if we did not exactly hit one of the known places.
      We have one known above and one known below.
@@ -190,19 +418,8 @@ buf_charpos_to_bytepos (struct buffer *b, ptrdiff_t charpos)
 
   if (charpos - best_below < best_above - charpos)
     {
-      bool record = charpos - best_below > 5000;
-
-      while (best_below != charpos)
-	{
-	  best_below++;
-	  BUF_INC_POS (b, best_below_byte);
-	}
-
-      /* If this position is quite far from the nearest known position,
-	 cache the correspondence by creating a marker here.
-	 It will last until the next GC.  */
-      if (record)
-	build_marker (b, best_below, best_below_byte);
+      charpos_scan_forward (b, &best_below, &best_below_byte,
+			    charpos, false, best_above_byte);
 
       byte_char_debug_check (b, best_below, best_below_byte);
 
@@ -215,19 +432,8 @@ buf_charpos_to_bytepos (struct buffer *b, ptrdiff_t charpos)
     }
   else
     {
-      bool record = best_above - charpos > 5000;
-
-      while (best_above != charpos)
-	{
-	  best_above--;
-	  BUF_DEC_POS (b, best_above_byte);
-	}
-
-      /* If this position is quite far from the nearest known position,
-	 cache the correspondence by creating a marker here.
-	 It will last until the next GC.  */
-      if (record)
-	build_marker (b, best_above, best_above_byte);
+      charpos_scan_backward (b, &best_above, &best_above_byte,
+			     charpos, false, best_below_byte);
 
       byte_char_debug_check (b, best_above, best_above_byte);
 
@@ -293,6 +499,8 @@ buf_bytepos_to_charpos (struct buffer *b, ptrdiff_t bytepos)
   struct Lisp_Marker *tail;
   ptrdiff_t best_above, best_above_byte;
   ptrdiff_t best_below, best_below_byte;
+  ptrdiff_t i;
+  bool index_hit;
 
   eassert (BUF_BEG_BYTE (b) <= bytepos && bytepos <= BUF_Z_BYTE (b));
 
@@ -316,16 +524,26 @@ buf_bytepos_to_charpos (struct buffer *b, ptrdiff_t bytepos)
   if (b == cached_buffer && BUF_MODIFF (b) == cached_modiff)
     CONSIDER (cached_bytepos, cached_charpos);
 
-  for (tail = BUF_MARKERS (b); tail; tail = tail->next)
-    {
-      CONSIDER (tail->bytepos, tail->charpos);
-
-      /* If we are down to a range of 50 chars,
-	 don't bother checking any other markers;
-	 scan the intervening chars directly now.  */
-      if (best_above - best_below < 50)
-	break;
-    }
+  i = charpos_index_search (b->text, bytepos, true);
+  index_hit = charpos_index_hit (b->text, i, bytepos, true);
+  if (0 <= i)
+    CONSIDER (b->text->checkpoints[i].bytepos,
+	      b->text->checkpoints[i].charpos);
+  if (i + 1 < b->text->ncheckpoints)
+    CONSIDER (b->text->checkpoints[i + 1].bytepos,
+	      b->text->checkpoints[i + 1].charpos);
+
+  if (!index_hit)
+    for (tail = BUF_MARKERS (b); tail; tail = tail->next)
+      {
+	CONSIDER (tail->bytepos, tail->charpos);
+
+	/* If we are down to a range of 50 chars,
+	   don't bother checking any other markers;
+	   scan the intervening chars directly now.  */
+	if (best_above - best_below < 50)
+	  break;
+      }
 
   /* We get here if we did not exactly hit one of the known places.
      We have one known above and one known below.
@@ -333,21 +551,8 @@ buf_bytepos_to_charpos (struct buffer *b, ptrdiff_t bytepos)
 
   if (bytepos - best_below_byte < best_above_byte - bytepos)
     {
-      bool record = bytepos - best_below_byte > 5000;
-
-      while (best_below_byte < bytepos)
-	{
-	  best_below++;
-	  BUF_INC_POS (b, best_below_byte);
-	}
-
-      /* If this position is quite far from the nearest known position,
-	 cache the correspondence by creating a marker here.
-	 It will last until the next GC.
-	 But don't do it if BUF_MARKERS is nil;
-	 that is a signal from Fset_buffer_multibyte.  */
-      if (record && BUF_MARKERS (b))
-	build_marker (b, best_below, best_below_byte);
+      charpos_scan_forward (b, &best_below, &best_below_byte,
+			    bytepos, true, best_above_byte);
 
       byte_char_debug_check (b, best_below, best_below_byte);
 
@@ -360,21 +565,8 @@ buf_bytepos_to_charpos (struct buffer *b, ptrdiff_t bytepos)
     }
   else
     {
-      bool record = best_above_byte - bytepos > 5000;
-
-      while (best_above_byte > bytepos)
-	{
-	  best_above--;
-	  BUF_DEC_POS (b, best_above_byte);
-	}
-
-      /* If this position is quite far from the nearest known position,
-	 cache the correspondence by creating a marker here.
-	 It will last until the next GC.
-	 But don't do it if BUF_MARKERS is nil;
-	 that is a signal from Fset_buffer_multibyte.  */
-      if (record && BUF_MARKERS (b))
-	build_marker (b, best_above, best_above_byte);
+      charpos_scan_backward (b, &best_above, &best_above_byte,
+			     bytepos, true, best_below_byte);
 
       byte_char_debug_check (b, best_above, best_above_byte);
 
@@ -765,4 +957,21 @@ syms_of_marker (void)
   defsubr (&Smarker_insertion_type);
   defsubr (&Sset_marker_insertion_type);
   defsubr (&Sbuffer_has_markers_at);
+
+  DEFVAR_INT ("position-index-hits", position_index_hits,
+	      doc: /* Number of position conversions helped by the position index.
+This counts the conversions between character and byte positions in
+multibyte buffers that found a checkpoint of the buffer's position
+index close to the position being converted.  Conversions in buffers
+whose characters are all single-byte are not counted.  See also
+`position-index-misses'.  */);
+  position_index_hits = 0;
+
+  DEFVAR_INT ("position-index-misses", position_index_misses,
+	      doc: /* Number of position conversions not helped by the position index.
+This counts the conversions between character and byte positions in
+multibyte buffers that had to count characters starting from some
+place other than a nearby checkpoint of the position index.  See also
+`position-index-hits'.  */);
+  position_index_misses = 0;
 }
@@ -1225,12 +1225,13 @@ is used to further constrain the set of candidates.  */)
   ptrdiff_t compare, matchsize;
   enum { function_table, list_table, obarray_table, hash_table}
     type = (HASH_TABLE_P (collection) ? hash_table
-	    : VECTORP (collection) ? obarray_table
+	    : VECTORP (collection) || OBARRAYP (collection) ? obarray_table
 	    : ((NILP (collection)
 		|| (CONSP (collection) && !FUNCTIONP (collection)))
 	       ? list_table : function_table));
   ptrdiff_t idx = 0, obsize = 0;
   int matchcount = 0;
+  ptrdiff_t count = SPECPDL_INDEX ();
   ptrdiff_t bindcount = -1;
   Lisp_Object bucket, zero, end, tem;
   struct gcpro gcpro1, gcpro2, gcpro3, gcpro4;
@@ -1247,6 +1248,9 @@ is used to further constrain the set of candidates.  */)
   if (type == obarray_table)
     {
       collection = check_obarray (collection);
+      /* PREDICATE might intern symbols.  */
+      hold_obarray (collection);
+      collection = obarray_buckets (collection);
       obsize = ASIZE (collection);
       bucket = AREF (collection, idx);
     }
@@ -1290,7 +1294,7 @@ is used to further constrain the set of candidates.  */)
       else /* if (type == hash_table) */
 	{
 	  while (idx < HASH_TABLE_SIZE (XHASH_TABLE (collection))
-		 && NILP (HASH_HASH (XHASH_TABLE (collection), idx)))
+		 && !HASH_ENTRY_USED_P (XHASH_TABLE (collection), idx))
 	    idx++;
 	  if (idx >= HASH_TABLE_SIZE (XHASH_TABLE (collection)))
 	    break;
@@ -1424,10 +1428,7 @@ is used to further constrain the set of candidates.  */)
 	}
     }
 
-  if (bindcount >= 0) {
-    unbind_to (bindcount, Qnil);
-    bindcount = -1;
-  }
+  unbind_to (count, Qnil);
 
   if (NILP (bestmatch))
     return Qnil;		/* No completions found.  */
@@ -1485,9 +1486,10 @@ with a space are ignored unless STRING itself starts with a space.  */)
   Lisp_Object tail, elt, eltstring;
   Lisp_Object allmatches;
   int type = HASH_TABLE_P (collection) ? 3
-    : VECTORP (collection) ? 2
+    : VECTORP (collection) || OBARRAYP (collection) ? 2
     : NILP (collection) || (CONSP (collection) && !FUNCTIONP (collection));
   ptrdiff_t idx = 0, obsize = 0;
+  ptrdiff_t count = SPECPDL_INDEX ();
   ptrdiff_t bindcount = -1;
   Lisp_Object bucket, tem, zero;
   struct gcpro gcpro1, gcpro2, gcpro3, gcpro4;
@@ -1503,6 +1505,9 @@ with a space are ignored unless STRING itself starts with a space.  */)
   if (type == 2)
     {
       collection = check_obarray (collection);
+      /* PREDICATE might intern symbols.  */
+      hold_obarray (collection);
+      collection = obarray_buckets (collection);
       obsize = ASIZE (collection);
       bucket = AREF (collection, idx);
     }
@@ -1546,7 +1551,7 @@ with a space are ignored unless STRING itself starts with a space.  */)
       else /* if (type == 3) */
 	{
 	  while (idx < HASH_TABLE_SIZE (XHASH_TABLE (collection))
-		 && NILP (HASH_HASH (XHASH_TABLE (collection), idx)))
+		 && !HASH_ENTRY_USED_P (XHASH_TABLE (collection), idx))
 	    idx++;
 	  if (idx >= HASH_TABLE_SIZE (XHASH_TABLE (collection)))
 	    break;
@@ -1622,10 +1627,7 @@ with a space are ignored unless STRING itself starts with a space.  */)
 	}
     }
 
-  if (bindcount >= 0) {
-    unbind_to (bindcount, Qnil);
-    bindcount = -1;
-  }
+  unbind_to (count, Qnil);
 
   return Fnreverse (allmatches);
 }
@@ -1721,7 +1723,7 @@ the values STRING, PREDICATE and `lambda'.  */)
       if (NILP (tem))
 	return Qnil;
     }
-  else if (VECTORP (collection))
+  else if (VECTORP (collection) || OBARRAYP (collection))
     {
       /* Bypass intern-soft as that loses for nil.  */
       tem = oblookup (collection,
@@ -1743,9 +1745,10 @@ the values STRING, PREDICATE and `lambda'.  */)
 
       if (completion_ignore_case && !SYMBOLP (tem))
 	{
-	  for (i = ASIZE (collection) - 1; i >= 0; i--)
+	  Lisp_Object buckets = obarray_buckets (collection);
+	  for (i = ASIZE (buckets) - 1; i >= 0; i--)
 	    {
-	      tail = AREF (collection, i);
+	      tail = AREF (buckets, i);
 	      if (SYMBOLP (tail))
 		while (1)
 		  {
@@ -1776,7 +1779,7 @@ the values STRING, PREDICATE and `lambda'.  */)
 	tem = HASH_KEY (h, i);
       else
 	for (i = 0; i < HASH_TABLE_SIZE (h); ++i)
-	  if (!NILP (HASH_HASH (h, i))
+	  if (HASH_ENTRY_USED_P (h, i)
 	      && (key = HASH_KEY (h, i),
 		  SYMBOLP (key) ? key = Fsymbol_name (key) : key,
 		  STRINGP (key))
@@ -0,0 +1,2072 @@
+/* Portable dumping of the Lisp world.
+
+Copyright (C) 2014 Free Software Foundation, Inc.
+
+This file is part of GNU Emacs.
+
+GNU Emacs is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+GNU Emacs is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.  */
+
+/* `dump-emacs' relies on unexec, which rewrites the running
+   executable and needs intimate knowledge of the platform's object
+   file format and malloc.  The portable dumper instead writes the
+   Lisp objects reachable from the roots of the garbage collector to
+   an ordinary file, and `temacs --dump-file FILE' reads them back at
+   startup, before the rest of the initialization that a dumped Emacs
+   does.
+
+   A dump file starts with a header that identifies the Emacs that
+   wrote it, followed by these sections, all of 64-bit words:
+
+   - The objects, one record per object, in breadth-first order from
+     the roots.  Each record starts with a word holding its kind and
+     its length in words; the index of a record is the object's ID.
+
+   - The Lisp and the other parts of pure storage, copied as they are,
+     followed by the list of the Lisp objects in it and two tables of
+     relocations for pure storage: one for the words that point within
+     it, which must be adjusted if `pure' is at a different address,
+     and one for the words that point to heap objects or into the
+     executable.  All the objects in pure storage are relocated, not
+     just the ones reachable from the roots, since C variables that
+     are not roots, or not yet set when the dump is loaded, can point
+     to any of them.
+
+   - The roots: the values of the staticpro'd variables, the Lisp
+     slots of the default buffers and of the initial frame, windows
+     and terminal, the doc strings of the primitives, the charset
+     table, and C variables whose contents some other file asked to
+     have saved with pdumper_remember_scalar.
+
+   A value in the dump is a fixnum if its low bit is set.  Otherwise
+   it refers to a heap object by ID, to an address in pure storage or
+   in the executable by offset, or to one of the objects that the
+   loading Emacs creates afresh, like the initial frame; the Lisp type
+   is kept along with the reference.
+
+   Loading does not map the objects in place: it allocates each object
+   in the ordinary heap and fills it in, so that the garbage collector
+   treats the loaded objects like any others.  The primitives, the
+   symbols interned by C code and the initial frame of the loading
+   Emacs are reused rather than copied, so that the C variables that
+   point to them stay valid.  A dump file can only be loaded by the
+   same executable that wrote it.  */
+
+#include <config.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#endif
+
+#include "lisp.h"
+#include "puresize.h"
+#include "character.h"
+#include "buffer.h"
+#include "charset.h"
+#include "coding.h"
+#include "intervals.h"
+#include "itree.h"
+#include "frame.h"
+#include "window.h"
+#include "termhooks.h"
+
+/* The kinds of records in the objects section.  */
+
+enum dump_kind
+  {
+    DUMP_CONS,
+    DUMP_FLOAT,
+    DUMP_STRING,
+    DUMP_SYMBOL,
+    DUMP_VECTOR,
+    DUMP_BOOL_VECTOR,
+    DUMP_HASH_TABLE,
+    DUMP_BUFFER,
+    DUMP_MARKER,
+    DUMP_OVERLAY
+  };
+
+/* Where a value in the dump refers to.  */
+
+enum dump_space
+  {
+    /* An object in the objects section, by ID.  */
+    DUMP_HEAP,
+    /* An address in pure storage, by offset from `pure'.  */
+    DUMP_PURE,
+    /* An address in the executable, by offset from `dump_reference'.  */
+    DUMP_EMACS,
+    /* An object that the loading Emacs makes itself.  */
+    DUMP_FRESH
+  };
+
+/* The objects that the loading Emacs makes itself, in the order of
+   their indices in a DUMP_FRESH reference.  */
+
+enum dump_fresh
+  {
+    DUMP_FRESH_FRAME,
+    DUMP_FRESH_ROOT_WINDOW,
+    DUMP_FRESH_MINIBUFFER_WINDOW,
+    DUMP_FRESH_TERMINAL,
+    DUMP_FRESH_UNBOUND,
+    DUMP_NFRESH
+  };
+
+/* A value in the dump is a fixnum if its low bit is set.  Otherwise,
+   its next DUMP_TYPE_BITS bits are the Lisp type, the next
+   DUMP_SPACE_BITS the space it refers to, and the rest the ID or
+   offset in that space.  */
+
+enum
+  {
+    DUMP_TYPE_SHIFT = 1,
+    DUMP_SPACE_SHIFT = 4,
+    DUMP_PAYLOAD_SHIFT = 6
+  };
+
+/* The header of a record is its kind and its length in words, kind
+   included, shifted by this much.  */
+
+enum { DUMP_LENGTH_SHIFT = 8 };
+
+/* Bits of the flags word of a symbol record.  */
+
+enum
+  {
+    DUMP_SYMBOL_PINNED = 1 << 8,
+    DUMP_SYMBOL_DECLARED_SPECIAL = 1 << 9,
+    DUMP_SYMBOL_HAS_NAME = 1 << 10
+  };
+
+/* The magic string at the start of a dump file.  */
+
+static char const dump_magic[16] = "!EmacsPDump2\n";
+
+/* A section of a dump file: its offset in bytes and its size in
+   words.  */
+
+struct dump_section
+{
+  uint64_t offset;
+  uint64_t nwords;
+};
+
+/* The header of a dump file.  */
+
+struct dump_header
+{
+  char magic[sizeof dump_magic];
+  char version[32];
+
+  /* What the loading Emacs must agree with for the dump to make
+     sense: a few sizes, and the offset of a function from
+     `dump_reference'.  */
+  uint64_t fingerprint[8];
+
+  /* Where `dump_reference' and `pure' were in the dumping Emacs.  */
+  uint64_t dump_reference;
+  uint64_t pure;
+
+  /* How much pure storage was in use.  */
+  uint64_t pure_bytes_used_lisp;
+  uint64_t pure_bytes_used_non_lisp;
+
+  uint64_t nobjects;
+  struct dump_section objects;
+  struct dump_section pure_lisp;
+  struct dump_section pure_non_lisp;
+  struct dump_section pure_objects;
+  struct dump_section internal_relocs;
+  struct dump_section external_relocs;
+  struct dump_section roots;
+};
+
+/* An object in the executable, relative to which other addresses in
+   the executable are recorded.  */
+
+static char dump_reference;
+
+/* Return the offset of P from `dump_reference'.  */
+
+static int64_t
+emacs_offset (void const *p)
+{
+  return (intptr_t) p - (intptr_t) &dump_reference;
+}
+
+/* Return the address at OFFSET from `dump_reference'.  */
+
+static void *
+emacs_ptr (int64_t offset)
+{
+  return &dump_reference + offset;
+}
+
+/* C variables whose contents are saved in a dump, and restored when
+   it is loaded.  */
+
+enum { MAX_REMEMBERED_SCALARS = 32 };
+
+static struct
+{
+  void *address;
+  ptrdiff_t nbytes;
+} remembered_scalars[MAX_REMEMBERED_SCALARS];
+
+static int nremembered_scalars;
+
+/* Functions to call after loading a dump.  */
+
+enum { MAX_AFTER_LOAD_HOOKS = 8 };
+
+static void (*after_load_hooks[MAX_AFTER_LOAD_HOOKS]) (void);
+
+static int nafter_load_hooks;
+
+/* Statistics about loading the dump that Emacs started from.  */
+
+static char *loaded_dump_file;
+static ptrdiff_t loaded_dump_objects;
+static struct timespec loaded_dump_time;
+
+static Lisp_Object QCdump_file, QCobjects, QCload_time;
+
+/* Save the NBYTES bytes at ADDRESS, which are in a C variable that
+   holds no pointers, in a portable dump, and restore them when the
+   dump is loaded.  Call this when Emacs defines its primitives, as
+   in a syms_of_* function.  */
+
+void
+pdumper_remember_scalar (void *address, ptrdiff_t nbytes)
+{
+  if (nremembered_scalars == MAX_REMEMBERED_SCALARS)
+    emacs_abort ();
+  remembered_scalars[nremembered_scalars].address = address;
+  remembered_scalars[nremembered_scalars].nbytes = nbytes;
+  nremembered_scalars++;
+}
+
+/* Call FUNCTION once a portable dump has been loaded, to recompute C
+   data that the dump does not hold.  */
+
+void
+pdumper_do_after_load (void (*function) (void))
+{
+  if (nafter_load_hooks == MAX_AFTER_LOAD_HOOKS)
+    emacs_abort ();
+  after_load_hooks[nafter_load_hooks++] = function;
+}
+
+
+/***********************************************************************
+			      Dumping
+ ***********************************************************************/
+
+/* A growable array of words.  */
+
+struct dump_words
+{
+  uint64_t *words;
+  ptrdiff_t nwords, size;
+};
+
+/* A hash table from addresses to indices.  */
+
+struct dump_map
+{
+  struct dump_map_entry
+  {
+    void const *key;
+    ptrdiff_t value;
+  } *entries;
+  ptrdiff_t size, count;
+};
+
+/* A queue of objects.  */
+
+struct dump_queue
+{
+  Lisp_Object *objects;
+  ptrdiff_t head, tail, size;
+};
+
+/* Values in the map of a dump context for objects that are not in
+   the objects section.  */
+
+enum
+  {
+    DUMP_SEEN_PURE = -1,
+    DUMP_SEEN_SUBR = -2
+  };
+
+struct dump_context
+{
+  /* The sections being written.  */
+  struct dump_words objects, pure_objects, internal_relocs, external_relocs;
+  struct dump_words roots;
+
+  /* The objects already seen, with their IDs.  */
+  struct dump_map map;
+
+  /* The uninterned symbols held by staticpro'd variables, with the
+     offsets of the variables.  */
+  struct dump_map hints;
+
+  /* The objects waiting to be written, and the objects in pure
+     storage waiting to be scanned for relocations.  */
+  struct dump_queue queue, pure_queue;
+
+  /* The primitives referred to.  */
+  struct Lisp_Subr **subrs;
+  ptrdiff_t nsubrs, subrs_size;
+
+  /* The number of objects given an ID.  */
+  ptrdiff_t nobjects;
+
+  /* The objects that the loading Emacs makes itself.  */
+  Lisp_Object fresh[DUMP_NFRESH];
+};
+
+/* Append N zero words to OUT, and return the first of them.  */
+
+static uint64_t *
+dump_reserve (struct dump_words *out, ptrdiff_t n)
+{
+  uint64_t *p;
+
+  if (out->size - out->nwords < n)
+    out->words = xpalloc (out->words, &out->size, n - (out->size - out->nwords),
+			  -1, sizeof *out->words);
+  p = out->words + out->nwords;
+  memset (p, 0, n * sizeof *p);
+  out->nwords += n;
+  return p;
+}
+
+static void
+dump_put (struct dump_words *out, uint64_t word)
+{
+  *dump_reserve (out, 1) = word;
+}
+
+/* Append the NBYTES bytes at P to OUT, padded to a whole number of
+   words.  */
+
+static void
+dump_put_bytes (struct dump_words *out, void const *p, ptrdiff_t nbytes)
+{
+  memcpy (dump_reserve (out, (nbytes + 7) / 8), p, nbytes);
+}
+
+static ptrdiff_t
+dump_map_hash (struct dump_map *map, void const *key)
+{
+  uint64_t h = (uintptr_t) key;
+  h = (h >> 3) * 0x9e3779b97f4a7c15;
+  return (h >> 32) & (map->size - 1);
+}
+
+/* Store in *VALUE the index of KEY in MAP, and return true if it is
+   there.  */
+
+static bool
+dump_map_get (struct dump_map *map, void const *key, ptrdiff_t *value)
+{
+  ptrdiff_t i;
+
+  if (!map->size)
+    return false;
+  for (i = dump_map_hash (map, key); map->entries[i].key;
+       i = (i + 1) & (map->size - 1))
+    if (map->entries[i].key == key)
+      {
+	*value = map->entries[i].value;
+	return true;
+      }
+  return false;
+}
+
+/* Add KEY, which must not be in MAP yet, with VALUE.  */
+
+static void
+dump_map_put (struct dump_map *map, void const *key, ptrdiff_t value)
+{
+  ptrdiff_t i;
+
+  if (2 * (map->count + 1) > map->size)
+    {
+      struct dump_map_entry *old = map->entries;
+      ptrdiff_t old_size = map->size;
+
+      map->size = old_size ? 2 * old_size : 1024;
+      map->entries = xzalloc (map->size * sizeof *map->entries);
+      map->count = 0;
+      for (i = 0; i < old_size; i++)
+	if (old[i].key)
+	  dump_map_put (map, old[i].key, old[i].value);
+      xfree (old);
+    }
+  for (i = dump_map_hash (map, key); map->entries[i].key;
+       i = (i + 1) & (map->size - 1))
+    continue;
+  map->entries[i].key = key;
+  map->entries[i].value = value;
+  map->count++;
+}
+
+static void
+dump_enqueue (struct dump_queue *queue, Lisp_Object obj)
+{
+  if (queue->tail == queue->size)
+    queue->objects = xpalloc (queue->objects, &queue->size, 1, -1,
+			      sizeof *queue->objects);
+  queue->objects[queue->tail++] = obj;
+}
+
+static uint64_t
+dump_ref (enum Lisp_Type type, enum dump_space space, int64_t payload)
+{
+  return (((uint64_t) payload << DUMP_PAYLOAD_SHIFT)
+	  | (space << DUMP_SPACE_SHIFT) | (type << DUMP_TYPE_SHIFT));
+}
+
+static _Noreturn void
+dump_unsupported (Lisp_Object obj)
+{
+  error ("Cannot dump an object of type `%s'",
+	 SDATA (SYMBOL_NAME (Ftype_of (obj))));
+}
+
+/* Return the encoding of OBJ in the dump, and arrange for OBJ to be
+   dumped if it has not been seen yet.  */
+
+static uint64_t
+dump_value (struct dump_context *ctx, Lisp_Object obj)
+{
+  enum Lisp_Type type = XTYPE (obj);
+  void *p;
+  ptrdiff_t id, i;
+
+  if (INTEGERP (obj))
+    return ((uint64_t) XINT (obj) << 1) | 1;
+
+  for (i = 0; i < DUMP_NFRESH; i++)
+    if (EQ (obj, ctx->fresh[i]))
+      return dump_ref (type, DUMP_FRESH, i);
+
+  p = XPNTR (obj);
+  if (PURE_P (obj))
+    {
+      if (!dump_map_get (&ctx->map, p, &id))
+	{
+	  dump_map_put (&ctx->map, p, DUMP_SEEN_PURE);
+	  dump_enqueue (&ctx->pure_queue, obj);
+	}
+      return dump_ref (type, DUMP_PURE, (char *) p - (char *) pure);
+    }
+
+  if (SUBRP (obj))
+    {
+      if (!dump_map_get (&ctx->map, p, &id))
+	{
+	  dump_map_put (&ctx->map, p, DUMP_SEEN_SUBR);
+	  if (ctx->nsubrs == ctx->subrs_size)
+	    ctx->subrs = xpalloc (ctx->subrs, &ctx->subrs_size, 1, -1,
+				  sizeof *ctx->subrs);
+	  ctx->subrs[ctx->nsubrs++] = p;
+	}
+      return dump_ref (type, DUMP_EMACS, emacs_offset (p));
+    }
+  if (p == &buffer_defaults || p == &buffer_local_symbols)
+    return dump_ref (type, DUMP_EMACS, emacs_offset (p));
+  if (FRAMEP (obj) || WINDOWP (obj) || TERMINALP (obj))
+    error ("Cannot dump a frame, window or terminal other than the initial ones");
+
+  if (!dump_map_get (&ctx->map, p, &id))
+    {
+      id = ctx->nobjects++;
+      dump_map_put (&ctx->map, p, id);
+      dump_enqueue (&ctx->queue, obj);
+    }
+  return dump_ref (type, DUMP_HEAP, id);
+}
+
+/* Start a record of KIND, and return where it starts.  */
+
+static ptrdiff_t
+dump_begin (struct dump_context *ctx, enum dump_kind kind)
+{
+  ptrdiff_t start = ctx->objects.nwords;
+  dump_put (&ctx->objects, kind);
+  return start;
+}
+
+/* Finish the record that starts at START.  */
+
+static void
+dump_end (struct dump_context *ctx, ptrdiff_t start)
+{
+  ctx->objects.words[start]
+    |= (uint64_t) (ctx->objects.nwords - start) << DUMP_LENGTH_SHIFT;
+}
+
+static void
+dump_put_value (struct dump_context *ctx, Lisp_Object obj)
+{
+  dump_put (&ctx->objects, dump_value (ctx, obj));
+}
+
+/* Where dump_interval writes.  traverse_intervals passes no context
+   pointer to its callback.  */
+
+static struct dump_context *dump_intervals_context;
+static ptrdiff_t dump_intervals_count;
+
+static void
+dump_interval (INTERVAL i, Lisp_Object arg)
+{
+  struct dump_context *ctx = dump_intervals_context;
+
+  if (!NILP (i->plist))
+    {
+      dump_put (&ctx->objects, i->position);
+      dump_put (&ctx->objects, i->position + LENGTH (i));
+      dump_put_value (ctx, i->plist);
+      dump_intervals_count++;
+    }
+}
+
+/* Write the number of intervals of TREE that have properties, and
+   their start, end and properties.  TREE starts at position START.  */
+
+static void
+dump_intervals (struct dump_context *ctx, INTERVAL tree, ptrdiff_t start)
+{
+  ptrdiff_t count_index = ctx->objects.nwords;
+
+  dump_put (&ctx->objects, 0);
+  dump_intervals_context = ctx;
+  dump_intervals_count = 0;
+  if (tree)
+    traverse_intervals (tree, start, dump_interval, Qnil);
+  ctx->objects.words[count_index] = dump_intervals_count;
+}
+
+static void
+dump_string (struct dump_context *ctx, Lisp_Object string)
+{
+  struct Lisp_String *s = XSTRING (string);
+
+  dump_put (&ctx->objects, s->size);
+  dump_put (&ctx->objects, s->size_byte);
+  dump_put_bytes (&ctx->objects, s->data, SBYTES (string));
+  dump_intervals (ctx, string_intervals (string), 0);
+}
+
+/* Write the value of the C variable that FWD forwards to.  */
+
+static void
+dump_fwd_value (struct dump_context *ctx, union Lisp_Fwd *fwd)
+{
+  switch (XFWDTYPE (fwd))
+    {
+    case Lisp_Fwd_Int:
+      dump_put (&ctx->objects, *fwd->u_intfwd.intvar);
+      break;
+    case Lisp_Fwd_Bool:
+      dump_put (&ctx->objects, *fwd->u_boolfwd.boolvar);
+      break;
+    case Lisp_Fwd_Obj:
+      dump_put_value (ctx, *fwd->u_objfwd.objvar);
+      break;
+    default:
+      /* The value is in a buffer or a keyboard.  */
+      dump_put (&ctx->objects, 0);
+      break;
+    }
+}
+
+static void
+dump_symbol (struct dump_context *ctx, Lisp_Object symbol)
+{
+  struct Lisp_Symbol *s = XSYMBOL (symbol);
+  struct dump_words *out = &ctx->objects;
+  struct Lisp_Buffer_Local_Value *blv;
+  ptrdiff_t hint = 0;
+  bool has_name = (s->interned == SYMBOL_INTERNED_IN_INITIAL_OBARRAY
+		   || dump_map_get (&ctx->hints, s, &hint));
+
+  dump_put (out, (s->redirect | s->constant << 3 | s->interned << 5
+		  | (s->pinned ? DUMP_SYMBOL_PINNED : 0)
+		  | (s->declared_special ? DUMP_SYMBOL_DECLARED_SPECIAL : 0)
+		  | (has_name ? DUMP_SYMBOL_HAS_NAME : 0)));
+  dump_put_value (ctx, s->name);
+  dump_put_value (ctx, s->function);
+  dump_put_value (ctx, s->plist);
+  dump_put (out, (s->next
+		  ? dump_value (ctx, make_lisp_ptr (s->next, Lisp_Symbol))
+		  : dump_value (ctx, make_number (0))));
+
+  /* The loading Emacs reuses the symbol of the same name that it has
+     made itself, if any, so record the name and where to look.  */
+  if (has_name)
+    {
+      dump_put (out, hint);
+      dump_put (out, SCHARS (s->name));
+      dump_put (out, SBYTES (s->name));
+      dump_put_bytes (out, SDATA (s->name), SBYTES (s->name));
+    }
+
+  switch (s->redirect)
+    {
+    case SYMBOL_PLAINVAL:
+      dump_put_value (ctx, SYMBOL_VAL (s));
+      break;
+    case SYMBOL_VARALIAS:
+      dump_put_value (ctx, make_lisp_ptr (SYMBOL_ALIAS (s), Lisp_Symbol));
+      break;
+    case SYMBOL_LOCALIZED:
+      blv = SYMBOL_BLV (s);
+      dump_put (out, (blv->local_if_set | blv->frame_local << 1
+		      | blv->found << 2 | (blv->fwd != NULL) << 3));
+      dump_put (out, blv->fwd ? emacs_offset (blv->fwd) : 0);
+      dump_put_value (ctx, blv->where);
+      dump_put_value (ctx, blv->defcell);
+      dump_put_value (ctx, blv->valcell);
+      if (blv->fwd)
+	dump_fwd_value (ctx, blv->fwd);
+      break;
+    case SYMBOL_FORWARDED:
+      dump_put (out, emacs_offset (SYMBOL_FWD (s)));
+      dump_fwd_value (ctx, SYMBOL_FWD (s));
+      break;
+    default:
+      emacs_abort ();
+    }
+}
+
+static void
+dump_vector (struct dump_context *ctx, Lisp_Object vector)
+{
+  struct Lisp_Vector *v = XVECTOR (vector);
+  ptrdiff_t size = v->header.size & ~ARRAY_MARK_FLAG;
+  ptrdiff_t nlisp = size, nraw = 0, nrest = 0, i;
+
+  if (size & PSEUDOVECTOR_FLAG)
+    {
+      nlisp = size & PSEUDOVECTOR_SIZE_MASK;
+      nrest = (size & PSEUDOVECTOR_REST_MASK) >> PSEUDOVECTOR_SIZE_BITS;
+      if (PSEUDOVECTOR_TYPEP (&v->header, PVEC_SUB_CHAR_TABLE))
+	nraw = SUB_CHAR_TABLE_OFFSET;
+      else if (!(PSEUDOVECTOR_TYPEP (&v->header, PVEC_COMPILED)
+		 || PSEUDOVECTOR_TYPEP (&v->header, PVEC_CHAR_TABLE)
+		 || PSEUDOVECTOR_TYPEP (&v->header, PVEC_OBARRAY)
+		 || (PSEUDOVECTOR_TYPEP (&v->header, PVEC_FONT) && !nrest)))
+	dump_unsupported (vector);
+    }
+
+  dump_put (&ctx->objects, size);
+  dump_put_bytes (&ctx->objects, v->contents, nraw * word_size);
+  for (i = nraw; i < nlisp; i++)
+    dump_put_value (ctx, v->contents[i]);
+  dump_put_bytes (&ctx->objects, v->contents + nlisp, nrest * word_size);
+}
+
+static void
+dump_hash_table (struct dump_context *ctx, Lisp_Object table)
+{
+  struct Lisp_Hash_Table *h = XHASH_TABLE (table);
+  struct dump_words *out = &ctx->objects;
+  uint64_t *used;
+  ptrdiff_t i;
+
+  dump_put_value (ctx, h->weak);
+  dump_put_value (ctx, h->rehash_size);
+  dump_put_value (ctx, h->rehash_threshold);
+  dump_put_value (ctx, h->key_and_value);
+  dump_put_value (ctx, h->test.name);
+  dump_put_value (ctx, h->test.user_hash_function);
+  dump_put_value (ctx, h->test.user_cmp_function);
+  dump_put (out, emacs_offset (h->test.cmpfn));
+  dump_put (out, emacs_offset (h->test.hashfn));
+  dump_put (out, h->size);
+  dump_put (out, h->index_size);
+  used = dump_reserve (out, (h->size + 63) / 64);
+  for (i = 0; i < h->size; i++)
+    if (HASH_ENTRY_USED_P (h, i))
+      used[i / 64] |= (uint64_t) 1 << (i % 64);
+}
+
+static void
+dump_buffer (struct dump_context *ctx, Lisp_Object buffer)
+{
+  struct buffer *b = XBUFFER (buffer);
+  struct dump_words *out = &ctx->objects;
+  Lisp_Object name = BVAR (b, name);
+  ptrdiff_t gap, nbytes, i, count_index;
+  struct itree_node *node;
+  char *text;
+
+  if (!BUFFER_LIVE_P (b))
+    error ("Cannot dump a killed buffer");
+  if (b->base_buffer)
+    error ("Cannot dump indirect buffer %s", SDATA (name));
+
+  /* The name comes first, so that the buffer can be made before any
+     other object is filled in.  */
+  dump_put (out, SCHARS (name));
+  dump_put (out, SBYTES (name));
+  dump_put (out, STRING_MULTIBYTE (name));
+  dump_put_bytes (out, SDATA (name), SBYTES (name));
+
+  for (i = 0; i < BUFFER_LISP_SIZE; i++)
+    dump_put_value (ctx, ((struct Lisp_Vector *) b)->contents[i]);
+  dump_put_value (ctx, BVAR (b, undo_list));
+
+  dump_put (out, b->pt);
+  dump_put (out, b->pt_byte);
+  dump_put (out, b->begv);
+  dump_put (out, b->begv_byte);
+  dump_put (out, b->zv);
+  dump_put (out, b->zv_byte);
+  dump_put_bytes (out, b->local_flags, sizeof b->local_flags);
+  dump_put (out, b->modtime.tv_sec);
+  dump_put (out, b->modtime.tv_nsec);
+  dump_put (out, b->modtime_size);
+  dump_put (out, b->auto_save_modified);
+  dump_put (out, b->display_error_modiff);
+  dump_put (out, b->auto_save_failure_time);
+  dump_put (out, b->last_window_start);
+
+  dump_put (out, BUF_Z (b));
+  dump_put (out, BUF_Z_BYTE (b));
+  dump_put (out, BUF_MODIFF (b));
+  dump_put (out, BUF_CHARS_MODIFF (b));
+  dump_put (out, BUF_SAVE_MODIFF (b));
+  dump_put (out, BUF_OVERLAY_MODIFF (b));
+  dump_put (out, BUF_COMPACT (b));
+
+  /* The text, without the gap.  */
+  gap = BUF_GPT_BYTE (b) - BUF_BEG_BYTE (b);
+  nbytes = BUF_Z_BYTE (b) - BUF_BEG_BYTE (b);
+  text = (char *) dump_reserve (out, (nbytes + 7) / 8);
+  memcpy (text, BUF_BEG_ADDR (b), gap);
+  memcpy (text + gap, BUF_GAP_END_ADDR (b), nbytes - gap);
+
+  dump_intervals (ctx, buffer_intervals (b), BUF_BEG (b));
+
+  count_index = out->nwords;
+  dump_put (out, 0);
+  for (node = itree_first (b->overlays); node; node = itree_next (node))
+    {
+      dump_put_value (ctx, node->data);
+      out->words[count_index]++;
+    }
+}
+
+static void
+dump_marker (struct dump_context *ctx, Lisp_Object marker)
+{
+  struct Lisp_Marker *m = XMARKER (marker);
+  Lisp_Object buffer = Qnil;
+
+  if (m->buffer)
+    XSETBUFFER (buffer, m->buffer);
+  dump_put_value (ctx, buffer);
+  dump_put (&ctx->objects, m->charpos);
+  dump_put (&ctx->objects, m->bytepos);
+  dump_put (&ctx->objects, m->insertion_type | m->need_adjustment << 1);
+}
+
+static void
+dump_overlay (struct dump_context *ctx, Lisp_Object overlay)
+{
+  struct Lisp_Overlay *ov = XOVERLAY (overlay);
+  struct itree_node *node = ov->interval;
+  Lisp_Object buffer = Qnil;
+
+  if (ov->buffer)
+    XSETBUFFER (buffer, ov->buffer);
+  dump_put_value (ctx, buffer);
+  dump_put (&ctx->objects, OVERLAY_START (overlay));
+  dump_put (&ctx->objects, OVERLAY_END (overlay));
+  dump_put (&ctx->objects, node->front_advance | node->rear_advance << 1);
+  dump_put_value (ctx, ov->plist);
+}
+
+/* Write the record of OBJ, which is not in pure storage.  */
+
+static void
+dump_object (struct dump_context *ctx, Lisp_Object obj)
+{
+  ptrdiff_t start;
+
+  switch (XTYPE (obj))
+    {
+    case Lisp_Cons:
+      start = dump_begin (ctx, DUMP_CONS);
+      dump_put_value (ctx, XCAR (obj));
+      dump_put_value (ctx, XCDR (obj));
+      break;
+
+    case Lisp_Float:
+      {
+	double d = XFLOAT_DATA (obj);
+	start = dump_begin (ctx, DUMP_FLOAT);
+	dump_put_bytes (&ctx->objects, &d, sizeof d);
+      }
+      break;
+
+    case Lisp_String:
+      start = dump_begin (ctx, DUMP_STRING);
+      dump_string (ctx, obj);
+      break;
+
+    case Lisp_Symbol:
+      start = dump_begin (ctx, DUMP_SYMBOL);
+      dump_symbol (ctx, obj);
+      break;
+
+    case Lisp_Misc:
+      if (MARKERP (obj))
+	{
+	  start = dump_begin (ctx, DUMP_MARKER);
+	  dump_marker (ctx, obj);
+	}
+      else if (OVERLAYP (obj))
+	{
+	  start = dump_begin (ctx, DUMP_OVERLAY);
+	  dump_overlay (ctx, obj);
+	}
+      else
+	dump_unsupported (obj);
+      break;
+
+    case Lisp_Vectorlike:
+      if (BOOL_VECTOR_P (obj))
+	{
+	  EMACS_INT nbits = bool_vector_size (obj);
+	  start = dump_begin (ctx, DUMP_BOOL_VECTOR);
+	  dump_put (&ctx->objects, nbits);
+	  dump_put_bytes (&ctx->objects, bool_vector_data (obj),
+			  bool_vector_words (nbits) * sizeof (bits_word));
+	}
+      else if (HASH_TABLE_P (obj))
+	{
+	  start = dump_begin (ctx, DUMP_HASH_TABLE);
+	  dump_hash_table (ctx, obj);
+	}
+      else if (BUFFERP (obj))
+	{
+	  start = dump_begin (ctx, DUMP_BUFFER);
+	  dump_buffer (ctx, obj);
+	}
+      else
+	{
+	  start = dump_begin (ctx, DUMP_VECTOR);
+	  dump_vector (ctx, obj);
+	}
+      break;
+
+    default:
+      dump_unsupported (obj);
+    }
+
+  dump_end (ctx, start);
+}
+
+/* Record the relocation of the word at P in pure storage, which holds
+   the Lisp object OBJ if RAW is false, or the address OBJ points to if
+   RAW is true.  */
+
+static void
+dump_pure_reloc (struct dump_context *ctx, void *p, Lisp_Object obj,
+		 void *address)
+{
+  uint64_t offset = (char *) p - (char *) pure;
+
+  if (address)
+    {
+      if ((uintptr_t) address - (uintptr_t) pure < PURESIZE)
+	dump_put (&ctx->internal_relocs, offset << 1 | 1);
+      else
+	{
+	  dump_put (&ctx->external_relocs, offset << 1 | 1);
+	  dump_put (&ctx->external_relocs, emacs_offset (address));
+	}
+    }
+  else if (!INTEGERP (obj))
+    {
+      uint64_t value = dump_value (ctx, obj);
+
+      if (PURE_P (obj))
+	dump_put (&ctx->internal_relocs, offset << 1);
+      else
+	{
+	  dump_put (&ctx->external_relocs, offset << 1);
+	  dump_put (&ctx->external_relocs, value);
+	}
+    }
+}
+
+/* Record the relocations of OBJ, which is in pure storage.  */
+
+static void
+dump_pure_object (struct dump_context *ctx, Lisp_Object obj)
+{
+  ptrdiff_t size, i;
+
+  switch (XTYPE (obj))
+    {
+    case Lisp_Cons:
+      dump_pure_reloc (ctx, &XCONS (obj)->car, XCAR (obj), NULL);
+      dump_pure_reloc (ctx, &XCONS (obj)->u.cdr, XCDR (obj), NULL);
+      break;
+
+    case Lisp_Float:
+      break;
+
+    case Lisp_String:
+      eassert (!string_intervals (obj));
+      dump_pure_reloc (ctx, &XSTRING (obj)->data, Qnil, SDATA (obj));
+      break;
+
+    case Lisp_Vectorlike:
+      size = ASIZE (obj);
+      if (size & PSEUDOVECTOR_FLAG)
+	size &= PSEUDOVECTOR_SIZE_MASK;
+      for (i = 0; i < size; i++)
+	dump_pure_reloc (ctx, &XVECTOR (obj)->contents[i], AREF (obj, i), NULL);
+      break;
+
+    default:
+      dump_unsupported (obj);
+    }
+}
+
+/* Queue all the objects in pure storage to be scanned for
+   relocations, and list them.  */
+
+static void
+dump_pure_objects (struct dump_context *ctx)
+{
+  ptrdiff_t i;
+
+  for (i = 0; i < pure_objects_used; i++)
+    {
+      char *p = (char *) pure + (pure_objects[i] >> 3);
+
+      dump_map_put (&ctx->map, p, DUMP_SEEN_PURE);
+      dump_enqueue (&ctx->pure_queue,
+		    make_lisp_ptr (p, pure_objects[i] & 7));
+      dump_put (&ctx->pure_objects, pure_objects[i]);
+    }
+}
+
+/* Write the values of the N Lisp slots starting at SLOTS to the roots
+   section.  */
+
+static void
+dump_root_slots (struct dump_context *ctx, Lisp_Object *slots, ptrdiff_t n)
+{
+  ptrdiff_t i;
+
+  dump_put (&ctx->roots, n);
+  for (i = 0; i < n; i++)
+    dump_put (&ctx->roots, dump_value (ctx, slots[i]));
+}
+
+/* The number of Lisp slots of the pseudovector P.  */
+
+static ptrdiff_t
+pseudovector_lisp_size (void *p)
+{
+  return ((struct vectorlike_header *) p)->size & PSEUDOVECTOR_SIZE_MASK;
+}
+
+static void
+dump_roots (struct dump_context *ctx)
+{
+  struct dump_words *out = &ctx->roots;
+  Lisp_Object current;
+  ptrdiff_t i;
+
+  /* Note where the uninterned symbols held by staticpro'd variables
+     are, so that the loading Emacs can reuse its own.  */
+  for (i = 0; i < staticidx; i++)
+    {
+      Lisp_Object v = *staticvec[i];
+      ptrdiff_t hint;
+
+      if (SYMBOLP (v) && XSYMBOL (v)->interned == SYMBOL_UNINTERNED
+	  && !dump_map_get (&ctx->hints, XSYMBOL (v), &hint))
+	dump_map_put (&ctx->hints, XSYMBOL (v), emacs_offset (staticvec[i]));
+    }
+
+  dump_put (out, staticidx);
+  for (i = 0; i < staticidx; i++)
+    {
+      dump_put (out, emacs_offset (staticvec[i]));
+      dump_put (out, dump_value (ctx, *staticvec[i]));
+    }
+
+  dump_root_slots (ctx, ((struct Lisp_Vector *) &buffer_defaults)->contents,
+		   BUFFER_LISP_SIZE);
+  dump_put (out, dump_value (ctx, BVAR (&buffer_defaults, undo_list)));
+  dump_root_slots (ctx,
+		   ((struct Lisp_Vector *) &buffer_local_symbols)->contents,
+		   BUFFER_LISP_SIZE);
+  dump_put (out, dump_value (ctx, BVAR (&buffer_local_symbols, undo_list)));
+
+  XSETBUFFER (current, current_buffer);
+  dump_put (out, dump_value (ctx, current));
+
+  for (i = 0; i < DUMP_FRESH_UNBOUND; i++)
+    {
+      void *p = XPNTR (ctx->fresh[i]);
+      dump_root_slots (ctx, ((struct Lisp_Vector *) p)->contents,
+		       pseudovector_lisp_size (p));
+    }
+}
+
+/* Write the roots that are only complete once all the objects have
+   been written.  */
+
+static void
+dump_late_roots (struct dump_context *ctx)
+{
+  struct dump_words *out = &ctx->roots;
+  ptrdiff_t i, count_index;
+
+  /* Only the doc strings that `Snarf-documentation' has replaced by
+     positions in the DOC file need saving.  */
+  count_index = out->nwords;
+  dump_put (out, 0);
+  for (i = 0; i < ctx->nsubrs; i++)
+    if ((intptr_t) ctx->subrs[i]->doc < 0)
+      {
+	dump_put (out, emacs_offset (ctx->subrs[i]));
+	dump_put (out, (intptr_t) ctx->subrs[i]->doc);
+	out->words[count_index]++;
+      }
+
+  dump_put (out, charset_table_used);
+  for (i = 0; i < charset_table_used; i++)
+    {
+      struct charset *charset = &charset_table[i];
+
+      /* A charset has a code space mask only if its code space is not
+	 linear; otherwise the pointer is garbage.  */
+      dump_put_bytes (out, charset, sizeof *charset);
+      if (!charset->code_linear_p)
+	dump_put_bytes (out, charset->code_space_mask, 256);
+    }
+
+  dump_put (out, nremembered_scalars);
+  for (i = 0; i < nremembered_scalars; i++)
+    {
+      dump_put (out, emacs_offset (remembered_scalars[i].address));
+      dump_put (out, remembered_scalars[i].nbytes);
+      dump_put_bytes (out, remembered_scalars[i].address,
+		      remembered_scalars[i].nbytes);
+    }
+}
+
+/* Write all the objects that have been queued, and scan the queued
+   objects in pure storage.  */
+
+static void
+dump_drain (struct dump_context *ctx)
+{
+  while (ctx->queue.head < ctx->queue.tail
+	 || ctx->pure_queue.head < ctx->pure_queue.tail)
+    if (ctx->pure_queue.head < ctx->pure_queue.tail)
+      dump_pure_object (ctx, ctx->pure_queue.objects[ctx->pure_queue.head++]);
+    else
+      dump_object (ctx, ctx->queue.objects[ctx->queue.head++]);
+}
+
+static void
+dump_free_context (void *arg)
+{
+  struct dump_context *ctx = arg;
+
+  xfree (ctx->objects.words);
+  xfree (ctx->pure_objects.words);
+  xfree (ctx->internal_relocs.words);
+  xfree (ctx->external_relocs.words);
+  xfree (ctx->roots.words);
+  xfree (ctx->map.entries);
+  xfree (ctx->hints.entries);
+  xfree (ctx->queue.objects);
+  xfree (ctx->pure_queue.objects);
+  xfree (ctx->subrs);
+}
+
+/* Write the NBYTES bytes at P to FD, and update *OFFSET.  */
+
+static void
+dump_write (int fd, void const *p, ptrdiff_t nbytes, uint64_t *offset,
+	    Lisp_Object filename)
+{
+  if (emacs_write (fd, p, nbytes) != nbytes)
+    report_file_error ("Writing dump file", filename);
+  *offset += nbytes;
+}
+
+static void
+dump_write_section (int fd, struct dump_section *section, void const *p,
+		    ptrdiff_t nwords, uint64_t *offset, Lisp_Object filename)
+{
+  section->offset = *offset;
+  section->nwords = nwords;
+  dump_write (fd, p, nwords * sizeof (uint64_t), offset, filename);
+}
+
+/* Fill in the fingerprint of this executable.  */
+
+static void
+dump_fingerprint (uint64_t fingerprint[8])
+{
+  fingerprint[0] = sizeof (struct Lisp_Symbol);
+  fingerprint[1] = sizeof (struct Lisp_Hash_Table);
+  fingerprint[2] = sizeof (struct buffer);
+  fingerprint[3] = sizeof (struct charset);
+  fingerprint[4] = PURESIZE;
+  fingerprint[5] = BUFFER_LISP_SIZE;
+  fingerprint[6] = emacs_offset (Fcons);
+  fingerprint[7] = emacs_offset (&buffer_defaults);
+}
+
+DEFUN ("dump-emacs-portable", Fdump_emacs_portable, Sdump_emacs_portable,
+       1, 1, 0,
+       doc: /* Dump the current state of Emacs into the portable dump FILENAME.
+Unlike `dump-emacs', this writes no executable: run the `temacs' that
+made the dump with the option `--dump-file FILENAME' to start from the
+state saved in it.  The dump can only be loaded by that executable.
+
+Processes, frames other than the initial frame, and killed or indirect
+buffers cannot be dumped.  This is used in the file `loadup.el' when
+building Emacs.  You must run Emacs in batch mode in order to dump it.  */)
+  (Lisp_Object filename)
+{
+  ptrdiff_t count = SPECPDL_INDEX ();
+  struct dump_context context, *ctx = &context;
+  struct dump_header header;
+  Lisp_Object tem, frame, encoded;
+  uint64_t offset = sizeof header;
+  int fd;
+  char *purebeg = (char *) pure;
+  ptrdiff_t pure_size = PURESIZE;
+  static char const padding[8];
+
+  check_pure_size ();
+
+  if (! noninteractive)
+    error ("Dumping Emacs works only in batch mode");
+  if (pure_bytes_used_before_overflow)
+    error ("Pure storage overflowed; Emacs cannot be dumped");
+
+  frame = Vframe_list;
+  if (!CONSP (frame) || !NILP (XCDR (frame)))
+    error ("Cannot dump Emacs with more than one frame");
+  frame = XCAR (frame);
+
+  CHECK_STRING (filename);
+  filename = Fexpand_file_name (filename, Qnil);
+  encoded = ENCODE_FILE (filename);
+
+  /* Bind `command-line-processed' to nil before dumping,
+     so that the dumped Emacs will process its command line
+     and set up to work with X windows if appropriate.  */
+  specbind (intern ("command-line-processed"), Qnil);
+
+  tem = Vpurify_flag;
+  Vpurify_flag = Qnil;
+  Fgarbage_collect ();
+
+  memset (ctx, 0, sizeof *ctx);
+  record_unwind_protect_ptr (dump_free_context, ctx);
+  ctx->fresh[DUMP_FRESH_FRAME] = frame;
+  ctx->fresh[DUMP_FRESH_ROOT_WINDOW] = XFRAME (frame)->root_window;
+  ctx->fresh[DUMP_FRESH_MINIBUFFER_WINDOW] = XFRAME (frame)->minibuffer_window;
+  XSETTERMINAL (ctx->fresh[DUMP_FRESH_TERMINAL],
+		FRAME_TERMINAL (XFRAME (frame)));
+  ctx->fresh[DUMP_FRESH_UNBOUND] = Qunbound;
+
+  dump_pure_objects (ctx);
+  dump_roots (ctx);
+  dump_drain (ctx);
+  dump_late_roots (ctx);
+
+  memset (&header, 0, sizeof header);
+  memcpy (header.magic, dump_magic, sizeof dump_magic);
+  strncpy (header.version, PACKAGE_VERSION, sizeof header.version - 1);
+  dump_fingerprint (header.fingerprint);
+  header.dump_reference = (uintptr_t) &dump_reference;
+  header.pure = (uintptr_t) pure;
+  header.pure_bytes_used_lisp = pure_bytes_used_lisp;
+  header.pure_bytes_used_non_lisp = pure_bytes_used_non_lisp;
+  header.nobjects = ctx->nobjects;
+
+  fd = emacs_open (SSDATA (encoded), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (fd < 0)
+    report_file_error ("Opening dump file", filename);
+  record_unwind_protect_int (close_file_unwind, fd);
+
+  /* Write the header last, once the sections are known.  */
+  if (lseek (fd, offset, SEEK_SET) < 0)
+    report_file_error ("Writing dump file", filename);
+  dump_write_section (fd, &header.objects, ctx->objects.words,
+		      ctx->objects.nwords, &offset, filename);
+  header.pure_lisp.offset = offset;
+  header.pure_lisp.nwords = (pure_bytes_used_lisp + 7) / 8;
+  dump_write (fd, purebeg, pure_bytes_used_lisp, &offset, filename);
+  dump_write (fd, padding, header.pure_lisp.nwords * 8 - pure_bytes_used_lisp,
+	      &offset, filename);
+  header.pure_non_lisp.offset = offset;
+  header.pure_non_lisp.nwords = (pure_bytes_used_non_lisp + 7) / 8;
+  dump_write (fd, purebeg + pure_size - pure_bytes_used_non_lisp,
+	      pure_bytes_used_non_lisp, &offset, filename);
+  dump_write (fd, padding,
+	      header.pure_non_lisp.nwords * 8 - pure_bytes_used_non_lisp,
+	      &offset, filename);
+  dump_write_section (fd, &header.pure_objects, ctx->pure_objects.words,
+		      ctx->pure_objects.nwords, &offset, filename);
+  dump_write_section (fd, &header.internal_relocs, ctx->internal_relocs.words,
+		      ctx->internal_relocs.nwords, &offset, filename);
+  dump_write_section (fd, &header.external_relocs, ctx->external_relocs.words,
+		      ctx->external_relocs.nwords, &offset, filename);
+  dump_write_section (fd, &header.roots, ctx->roots.words, ctx->roots.nwords,
+		      &offset, filename);
+  if (lseek (fd, 0, SEEK_SET) < 0)
+    report_file_error ("Writing dump file", filename);
+  dump_write (fd, &header, sizeof header, &offset, filename);
+
+  Vpurify_flag = tem;
+
+  return unbind_to (count, Qnil);
+}
+
+
+/***********************************************************************
+			      Loading
+ ***********************************************************************/
+
+/* Objects whose completion must wait until all the objects have been
+   filled in, with their records.  */
+
+struct load_list
+{
+  struct load_item
+  {
+    Lisp_Object object;
+    uint64_t const *data;
+  } *items;
+  ptrdiff_t n, size;
+};
+
+struct load_context
+{
+  /* The name of the dump file, for error messages.  */
+  char const *file;
+
+  /* The address of each object, by ID, and their number.  */
+  void **objects;
+  ptrdiff_t nobjects;
+
+  /* The objects that the loading Emacs made itself.  */
+  Lisp_Object fresh[DUMP_NFRESH];
+
+  struct load_list buffers, markers, overlays, strings, hash_tables;
+};
+
+static _Noreturn void
+load_error (struct load_context *l, char const *message)
+{
+  fatal ("%s: %s", l->file, message);
+}
+
+static void
+load_defer (struct load_list *list, Lisp_Object obj, uint64_t const *data)
+{
+  if (list->n == list->size)
+    list->items = xpalloc (list->items, &list->size, 1, -1,
+			   sizeof *list->items);
+  list->items[list->n].object = obj;
+  list->items[list->n].data = data;
+  list->n++;
+}
+
+/* Return the Lisp object that W encodes.  */
+
+static Lisp_Object
+load_value (struct load_context *l, uint64_t w)
+{
+  enum Lisp_Type type = (w >> DUMP_TYPE_SHIFT) & 7;
+  uint64_t payload = w >> DUMP_PAYLOAD_SHIFT;
+
+  if (w & 1)
+    return make_number ((int64_t) w >> 1);
+  switch ((w >> DUMP_SPACE_SHIFT) & 3)
+    {
+    case DUMP_HEAP:
+      return make_lisp_ptr (l->objects[payload], type);
+    case DUMP_PURE:
+      return make_lisp_ptr ((char *) pure + payload, type);
+    case DUMP_EMACS:
+      return make_lisp_ptr (emacs_ptr ((int64_t) w >> DUMP_PAYLOAD_SHIFT),
+			    type);
+    default:
+      return l->fresh[payload];
+    }
+}
+
+/* The number of words that NBYTES bytes take in a dump.  */
+
+static ptrdiff_t
+load_nwords (ptrdiff_t nbytes)
+{
+  return (nbytes + 7) / 8;
+}
+
+/* Make the buffer whose record is at P, or find the buffer of the
+   same name that this Emacs made itself.  */
+
+static void
+load_make_buffer (struct load_context *l, ptrdiff_t id, uint64_t const *p)
+{
+  Lisp_Object name = make_specified_string ((char const *) (p + 4), p[1],
+					    p[2], p[3]);
+  l->objects[id] = XBUFFER (Fget_buffer_create (name));
+}
+
+/* Allocate the object whose record is at P, other than a symbol or a
+   buffer, and fill in what refers to no other object.  */
+
+static void
+load_allocate (struct load_context *l, ptrdiff_t id, uint64_t const *p)
+{
+  Lisp_Object obj;
+
+  switch (p[0] & 0xff)
+    {
+    case DUMP_CONS:
+      obj = Fcons (Qnil, Qnil);
+      break;
+
+    case DUMP_FLOAT:
+      {
+	double d;
+	memcpy (&d, p + 1, sizeof d);
+	obj = make_float (d);
+      }
+      break;
+
+    case DUMP_STRING:
+      {
+	ptrdiff_t size = p[1], size_byte = p[2];
+
+	if (size_byte < 0)
+	  obj = make_uninit_string (size);
+	else
+	  obj = make_uninit_multibyte_string (size, size_byte);
+	memcpy (SDATA (obj), p + 3, SBYTES (obj));
+      }
+      break;
+
+    case DUMP_VECTOR:
+      {
+	ptrdiff_t size = p[1];
+	struct Lisp_Vector *v;
+
+	if (size & PSEUDOVECTOR_FLAG)
+	  {
+	    ptrdiff_t nlisp = size & PSEUDOVECTOR_SIZE_MASK;
+	    ptrdiff_t nrest = ((size & PSEUDOVECTOR_REST_MASK)
+			       >> PSEUDOVECTOR_SIZE_BITS);
+	    v = allocate_pseudovector (nlisp + nrest, nlisp,
+				       ((size & PVEC_TYPE_MASK)
+					>> PSEUDOVECTOR_AREA_BITS));
+	    v->header.size = size;
+	  }
+	else
+	  v = allocate_vector (size);
+	XSETVECTOR (obj, v);
+      }
+      break;
+
+    case DUMP_BOOL_VECTOR:
+      obj = make_uninit_bool_vector (p[1]);
+      memcpy (bool_vector_data (obj), p + 2,
+	      bool_vector_words (p[1]) * sizeof (bits_word));
+      break;
+
+    case DUMP_HASH_TABLE:
+      {
+	struct Lisp_Hash_Table *h = allocate_hash_table ();
+	h->hash = NULL;
+	h->next = h->index = NULL;
+	h->next_weak = NULL;
+	XSET_HASH_TABLE (obj, h);
+      }
+      break;
+
+    case DUMP_MARKER:
+      obj = Fmake_marker ();
+      break;
+
+    case DUMP_OVERLAY:
+      obj = build_overlay (p[4] & 1, (p[4] >> 1) & 1, Qnil);
+      break;
+
+    default:
+      load_error (l, "invalid object");
+    }
+
+  l->objects[id] = XPNTR (obj);
+}
+
+/* Make the symbol whose record is at P, or find the symbol of the
+   same name that this Emacs made itself.  */
+
+static void
+load_make_symbol (struct load_context *l, ptrdiff_t id, uint64_t const *p)
+{
+  Lisp_Object sym = Qnil;
+  bool found = false;
+
+  if (p[1] & DUMP_SYMBOL_HAS_NAME)
+    {
+      int64_t hint = p[6];
+      ptrdiff_t nchars = p[7], nbytes = p[8];
+      char const *name = (char const *) (p + 9);
+
+      if (hint)
+	sym = *(Lisp_Object *) emacs_ptr (hint);
+      else
+	sym = oblookup (Vobarray, name, nchars, nbytes);
+      found = (SYMBOLP (sym)
+	       && XSYMBOL (sym)->interned == ((p[1] >> 5) & 3)
+	       && SBYTES (SYMBOL_NAME (sym)) == nbytes
+	       && !memcmp (SDATA (SYMBOL_NAME (sym)), name, nbytes));
+    }
+  if (!found)
+    sym = Fmake_symbol (empty_unibyte_string);
+  l->objects[id] = XSYMBOL (sym);
+}
+
+/* Set the C variable that FWD forwards to from W.  */
+
+static void
+load_fwd_value (struct load_context *l, union Lisp_Fwd *fwd, uint64_t w)
+{
+  switch (XFWDTYPE (fwd))
+    {
+    case Lisp_Fwd_Int:
+      *fwd->u_intfwd.intvar = w;
+      break;
+    case Lisp_Fwd_Bool:
+      *fwd->u_boolfwd.boolvar = w;
+      break;
+    case Lisp_Fwd_Obj:
+      *fwd->u_objfwd.objvar = load_value (l, w);
+      break;
+    default:
+      break;
+    }
+}
+
+static void
+load_symbol (struct load_context *l, Lisp_Object symbol, uint64_t const *p)
+{
+  struct Lisp_Symbol *s = XSYMBOL (symbol);
+  uint64_t flags = p[1];
+  Lisp_Object next = load_value (l, p[5]);
+  struct Lisp_Buffer_Local_Value *blv;
+
+  s->constant = (flags >> 3) & 3;
+  s->interned = (flags >> 5) & 3;
+  s->declared_special = (flags & DUMP_SYMBOL_DECLARED_SPECIAL) != 0;
+  s->name = load_value (l, p[2]);
+  s->function = load_value (l, p[3]);
+  s->plist = load_value (l, p[4]);
+  s->next = INTEGERP (next) ? NULL : XSYMBOL (next);
+  if (flags & DUMP_SYMBOL_PINNED)
+    pin_symbol (symbol);
+
+  p += 6;
+  if (flags & DUMP_SYMBOL_HAS_NAME)
+    p += 3 + load_nwords (p[2]);
+
+  switch (flags & 7)
+    {
+    case SYMBOL_PLAINVAL:
+      s->redirect = SYMBOL_PLAINVAL;
+      SET_SYMBOL_VAL (s, load_value (l, p[0]));
+      break;
+    case SYMBOL_VARALIAS:
+      s->redirect = SYMBOL_VARALIAS;
+      SET_SYMBOL_ALIAS (s, XSYMBOL (load_value (l, p[0])));
+      break;
+    case SYMBOL_LOCALIZED:
+      blv = (s->redirect == SYMBOL_LOCALIZED ? SYMBOL_BLV (s)
+	     : xmalloc (sizeof *blv));
+      blv->local_if_set = p[0] & 1;
+      blv->frame_local = (p[0] >> 1) & 1;
+      blv->found = (p[0] >> 2) & 1;
+      blv->fwd = p[0] & 8 ? emacs_ptr (p[1]) : NULL;
+      blv->where = load_value (l, p[2]);
+      blv->defcell = load_value (l, p[3]);
+      blv->valcell = load_value (l, p[4]);
+      if (blv->fwd)
+	load_fwd_value (l, blv->fwd, p[5]);
+      s->redirect = SYMBOL_LOCALIZED;
+      SET_SYMBOL_BLV (s, blv);
+      break;
+    case SYMBOL_FORWARDED:
+      s->redirect = SYMBOL_FORWARDED;
+      SET_SYMBOL_FWD (s, emacs_ptr (p[0]));
+      load_fwd_value (l, SYMBOL_FWD (s), p[1]);
+      break;
+    default:
+      load_error (l, "invalid symbol");
+    }
+}
+
+/* Fill in the object OBJ from the record at P.  */
+
+static void
+load_fill (struct load_context *l, Lisp_Object obj, uint64_t const *p)
+{
+  ptrdiff_t i;
+
+  switch (p[0] & 0xff)
+    {
+    case DUMP_CONS:
+      XCONS (obj)->car = load_value (l, p[1]);
+      XCONS (obj)->u.cdr = load_value (l, p[2]);
+      break;
+
+    case DUMP_STRING:
+      if (p[3 + load_nwords (SBYTES (obj))])
+	load_defer (&l->strings, obj, p);
+      break;
+
+    case DUMP_SYMBOL:
+      load_symbol (l, obj, p);
+      break;
+
+    case DUMP_VECTOR:
+      {
+	struct Lisp_Vector *v = XVECTOR (obj);
+	ptrdiff_t size = p[1];
+	ptrdiff_t nlisp = size, nraw = 0, nrest = 0;
+
+	if (size & PSEUDOVECTOR_FLAG)
+	  {
+	    nlisp = size & PSEUDOVECTOR_SIZE_MASK;
+	    nrest = (size & PSEUDOVECTOR_REST_MASK) >> PSEUDOVECTOR_SIZE_BITS;
+	    if (PSEUDOVECTOR_TYPEP (&v->header, PVEC_SUB_CHAR_TABLE))
+	      nraw = SUB_CHAR_TABLE_OFFSET;
+	  }
+	p += 2;
+	memcpy (v->contents, p, nraw * word_size);
+	for (i = nraw; i < nlisp; i++)
+	  v->contents[i] = load_value (l, p[i]);
+	memcpy (v->contents + nlisp, p + nlisp, nrest * word_size);
+	if (PSEUDOVECTOR_TYPEP (&v->header, PVEC_OBARRAY))
+	  ((struct Lisp_Obarray *) v)->holds = 0;
+      }
+      break;
+
+    case DUMP_HASH_TABLE:
+      {
+	struct Lisp_Hash_Table *h = XHASH_TABLE (obj);
+
+	h->weak = load_value (l, p[1]);
+	h->rehash_size = load_value (l, p[2]);
+	h->rehash_threshold = load_value (l, p[3]);
+	h->key_and_value = load_value (l, p[4]);
+	h->test.name = load_value (l, p[5]);
+	h->test.user_hash_function = load_value (l, p[6]);
+	h->test.user_cmp_function = load_value (l, p[7]);
+	h->test.cmpfn = emacs_ptr (p[8]);
+	h->test.hashfn = emacs_ptr (p[9]);
+	h->size = p[10];
+	h->index_size = p[11];
+	h->hash = xnmalloc (h->size, sizeof *h->hash);
+	for (i = 0; i < h->size; i++)
+	  h->hash[i] = (p[12 + i / 64] >> (i % 64) & 1) ? 0 : HASH_UNUSED;
+	load_defer (&l->hash_tables, obj, p);
+      }
+      break;
+
+    case DUMP_BUFFER:
+      {
+	struct buffer *b = XBUFFER (obj);
+	uint64_t const *slots;
+
+	p += 4 + load_nwords (p[2]);
+	slots = p;
+	for (i = 0; i < BUFFER_LISP_SIZE; i++)
+	  ((struct Lisp_Vector *) b)->contents[i] = load_value (l, p[i]);
+	p += BUFFER_LISP_SIZE + 1;
+	memcpy (b->local_flags, p + 6, sizeof b->local_flags);
+	p += 6 + load_nwords (sizeof b->local_flags);
+	b->modtime.tv_sec = p[0];
+	b->modtime.tv_nsec = p[1];
+	b->modtime_size = p[2];
+	b->auto_save_modified = p[3];
+	b->display_error_modiff = p[4];
+	b->auto_save_failure_time = p[5];
+	b->last_window_start = p[6];
+	load_defer (&l->buffers, obj, slots);
+      }
+      break;
+
+    case DUMP_MARKER:
+      XMARKER (obj)->insertion_type = p[4] & 1;
+      XMARKER (obj)->need_adjustment = (p[4] >> 1) & 1;
+      if (!NILP (load_value (l, p[1])))
+	load_defer (&l->markers, obj, p);
+      break;
+
+    case DUMP_OVERLAY:
+      XOVERLAY (obj)->plist = load_value (l, p[5]);
+      if (!NILP (load_value (l, p[1])))
+	load_defer (&l->overlays, obj, p);
+      break;
+
+    default:
+      break;
+    }
+}
+
+/* Give OBJECT, a string or buffer, the properties of the N intervals
+   at P.  */
+
+static void
+load_intervals (struct load_context *l, Lisp_Object object,
+		uint64_t const *p, ptrdiff_t n)
+{
+  ptrdiff_t i;
+
+  for (i = 0; i < n; i++, p += 3)
+    set_text_properties (make_number (p[0]), make_number (p[1]),
+			 load_value (l, p[2]), object, Qnil);
+}
+
+/* Give buffer BUFFER its text and the rest of its state, from its
+   record, which continues at P with the Lisp slots.  */
+
+static void
+load_finish_buffer (struct load_context *l, Lisp_Object buffer,
+		    uint64_t const *p)
+{
+  struct buffer *b = XBUFFER (buffer);
+  Lisp_Object undo_list = load_value (l, p[BUFFER_LISP_SIZE]);
+  uint64_t const *pos = p + BUFFER_LISP_SIZE + 1;
+  uint64_t const *text = pos + 6 + load_nwords (sizeof b->local_flags) + 7;
+  ptrdiff_t z = text[0], z_byte = text[1];
+
+  /* Put the text back without recording it for undo or running any
+     hooks.  The buffer's local variables are already as the dumping
+     Emacs had them, so make it current without swapping them.  */
+  current_buffer = b;
+  bset_undo_list (b, Qt);
+  SET_BUF_BEGV_BOTH (b, BEG, BEG_BYTE);
+  SET_BUF_ZV_BOTH (b, BUF_Z (b), BUF_Z_BYTE (b));
+  if (BUF_Z (b) > BEG)
+    del_range_1 (BEG, BUF_Z (b), false, false);
+  if (z > BEG)
+    insert_1_both ((char const *) (text + 7), z - BEG, z_byte - BEG_BYTE,
+		   false, false, false);
+  p = text + 7 + load_nwords (z_byte - BEG_BYTE);
+  load_intervals (l, buffer, p + 1, p[0]);
+
+  SET_BUF_BEGV_BOTH (b, pos[2], pos[3]);
+  SET_BUF_ZV_BOTH (b, pos[4], pos[5]);
+  SET_BUF_PT_BOTH (b, pos[0], pos[1]);
+  BUF_MODIFF (b) = text[2];
+  BUF_CHARS_MODIFF (b) = text[3];
+  BUF_SAVE_MODIFF (b) = text[4];
+  BUF_OVERLAY_MODIFF (b) = text[5];
+  BUF_COMPACT (b) = text[6];
+  bset_undo_list (b, undo_list);
+  clear_local_var_cache (b);
+}
+
+/* Set the N Lisp slots starting at SLOTS from the roots at *P, and
+   advance *P past them.  */
+
+static void
+load_root_slots (struct load_context *l, Lisp_Object *slots, ptrdiff_t n,
+		 uint64_t const **p)
+{
+  ptrdiff_t i;
+
+  if ((*p)[0] != n)
+    load_error (l, "dump file does not match this Emacs");
+  for (i = 0; i < n; i++)
+    slots[i] = load_value (l, (*p)[1 + i]);
+  *p += 1 + n;
+}
+
+/* Restore the roots from the section at P.  */
+
+static void
+load_roots (struct load_context *l, uint64_t const *p)
+{
+  struct dump_map protected;
+  Lisp_Object current;
+  ptrdiff_t i, n, dummy;
+
+  /* The staticpro'd variables.  This Emacs has not run the parts of
+     initialization that only temacs runs, so protect the variables
+     that those would have.  */
+  memset (&protected, 0, sizeof protected);
+  for (i = 0; i < staticidx; i++)
+    dump_map_put (&protected, staticvec[i], i);
+  for (n = *p++; n > 0; n--, p += 2)
+    {
+      Lisp_Object *address = emacs_ptr (p[0]);
+      *address = load_value (l, p[1]);
+      if (!dump_map_get (&protected, address, &dummy))
+	staticpro (address);
+    }
+  xfree (protected.entries);
+
+  load_root_slots (l, ((struct Lisp_Vector *) &buffer_defaults)->contents,
+		   BUFFER_LISP_SIZE, &p);
+  bset_undo_list (&buffer_defaults, load_value (l, *p++));
+  load_root_slots (l, ((struct Lisp_Vector *) &buffer_local_symbols)->contents,
+		   BUFFER_LISP_SIZE, &p);
+  bset_undo_list (&buffer_local_symbols, load_value (l, *p++));
+
+  current = load_value (l, *p++);
+
+  for (i = 0; i < DUMP_FRESH_UNBOUND; i++)
+    {
+      void *v = XPNTR (l->fresh[i]);
+      load_root_slots (l, ((struct Lisp_Vector *) v)->contents,
+		       pseudovector_lisp_size (v), &p);
+    }
+
+  /* Now that the windows show the buffers they showed when Emacs was
+     dumped, count them again.  */
+  {
+    struct buffer *b;
+    FOR_EACH_BUFFER (b)
+      b->window_count = 0;
+    for (i = DUMP_FRESH_ROOT_WINDOW; i <= DUMP_FRESH_MINIBUFFER_WINDOW; i++)
+      {
+	Lisp_Object contents = XWINDOW (l->fresh[i])->contents;
+	if (BUFFERP (contents))
+	  XBUFFER (contents)->window_count++;
+      }
+  }
+
+  for (n = *p++; n > 0; n--, p += 2)
+    {
+      struct Lisp_Subr *subr = emacs_ptr (p[0]);
+      subr->doc = (char const *) (intptr_t) p[1];
+    }
+
+  n = *p++;
+  if (n > charset_table_size)
+    {
+      charset_table = xnmalloc (n, sizeof *charset_table);
+      charset_table_size = n;
+    }
+  charset_table_used = n;
+  for (i = 0; i < n; i++)
+    {
+      struct charset *charset = &charset_table[i];
+
+      memcpy (charset, p, sizeof *charset);
+      p += load_nwords (sizeof *charset);
+      if (!charset->code_linear_p)
+	{
+	  charset->code_space_mask = xmalloc (256);
+	  memcpy (charset->code_space_mask, p, 256);
+	  p += load_nwords (256);
+	}
+    }
+
+  for (n = *p++; n > 0; n--)
+    {
+      ptrdiff_t nbytes = p[1];
+      memcpy (emacs_ptr (p[0]), p + 2, nbytes);
+      p += 2 + load_nwords (nbytes);
+    }
+
+  /* The variables of the buffer that was current are already in
+     place, so do not swap them.  */
+  current_buffer = XBUFFER (current);
+}
+
+/* Load the portable dump in FILE, replacing the Lisp world that this
+   Emacs has defined so far.  Report a fatal error if FILE cannot be
+   loaded.  */
+
+void
+pdumper_load (const char *file)
+{
+  struct load_context context, *l = &context;
+  struct timespec start = current_timespec ();
+  struct dump_header const *header;
+  uint64_t const *words, *p, *end, **records;
+  EMACS_INT threshold;
+  Lisp_Object frame;
+  uint64_t fingerprint[8];
+  char *base, *purebeg = (char *) pure;
+  intptr_t delta;
+  struct stat st;
+  ptrdiff_t i, size;
+  int fd;
+
+  memset (l, 0, sizeof *l);
+  l->file = file;
+
+  fd = emacs_open (file, O_RDONLY, 0);
+  if (fd < 0 || fstat (fd, &st) != 0)
+    fatal ("%s: %s", file, strerror (errno));
+  if (st.st_size < sizeof *header || PTRDIFF_MAX < st.st_size)
+    load_error (l, "not a dump file");
+  size = st.st_size;
+#ifdef HAVE_MMAP
+  base = mmap (NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (base == MAP_FAILED)
+    fatal ("%s: %s", file, strerror (errno));
+#else
+  base = xmalloc (size);
+  for (i = 0; i < size; )
+    {
+      ptrdiff_t nread = emacs_read (fd, base + i, size - i);
+      if (nread <= 0)
+	fatal ("%s: %s", file, nread < 0 ? strerror (errno) : "truncated");
+      i += nread;
+    }
+#endif
+  emacs_close (fd);
+
+  header = (struct dump_header const *) base;
+  words = (uint64_t const *) base;
+  if (memcmp (header->magic, dump_magic, sizeof dump_magic) != 0)
+    load_error (l, "not a dump file");
+  dump_fingerprint (fingerprint);
+  if (strcmp (header->version, PACKAGE_VERSION) != 0
+      || memcmp (header->fingerprint, fingerprint, sizeof fingerprint) != 0
+      || PURESIZE < header->pure_bytes_used_lisp
+		    + header->pure_bytes_used_non_lisp)
+    load_error (l, "dump file was not made by this Emacs");
+  if (header->roots.offset + header->roots.nwords * 8 != size)
+    load_error (l, "dump file is truncated");
+
+  /* Nothing that the dump holds is reachable until the roots are
+     restored, so do not collect garbage until then.  */
+  gc_cons_threshold = MOST_POSITIVE_FIXNUM;
+
+  frame = XCAR (Vframe_list);
+  l->fresh[DUMP_FRESH_FRAME] = frame;
+  l->fresh[DUMP_FRESH_ROOT_WINDOW] = XFRAME (frame)->root_window;
+  l->fresh[DUMP_FRESH_MINIBUFFER_WINDOW] = XFRAME (frame)->minibuffer_window;
+  XSETTERMINAL (l->fresh[DUMP_FRESH_TERMINAL],
+		FRAME_TERMINAL (XFRAME (frame)));
+  l->fresh[DUMP_FRESH_UNBOUND] = Qunbound;
+
+  /* Find the records.  */
+  l->nobjects = header->nobjects;
+  l->objects = xnmalloc (l->nobjects, sizeof *l->objects);
+  records = xnmalloc (l->nobjects, sizeof *records);
+  p = words + header->objects.offset / 8;
+  end = p + header->objects.nwords;
+  for (i = 0; i < l->nobjects; i++)
+    {
+      records[i] = p;
+      if (p >= end || (p[0] >> DUMP_LENGTH_SHIFT) == 0)
+	load_error (l, "dump file is corrupt");
+      p += p[0] >> DUMP_LENGTH_SHIFT;
+    }
+
+  /* Make the objects.  The buffers come first, since making a buffer
+     makes other objects; then the symbols, which may be found in this
+     Emacs's obarray under names in pure storage that the dump's pure
+     storage is about to replace.  */
+  for (i = 0; i < l->nobjects; i++)
+    if ((records[i][0] & 0xff) == DUMP_BUFFER)
+      load_make_buffer (l, i, records[i]);
+  for (i = 0; i < l->nobjects; i++)
+    if ((records[i][0] & 0xff) == DUMP_SYMBOL)
+      load_make_symbol (l, i, records[i]);
+  for (i = 0; i < l->nobjects; i++)
+    if ((records[i][0] & 0xff) != DUMP_BUFFER
+	&& (records[i][0] & 0xff) != DUMP_SYMBOL)
+      load_allocate (l, i, records[i]);
+
+  /* Replace pure storage, and relocate it.  */
+  delta = (intptr_t) pure - (intptr_t) header->pure;
+  memcpy (purebeg, base + header->pure_lisp.offset,
+	  header->pure_bytes_used_lisp);
+  memcpy (purebeg + PURESIZE - header->pure_bytes_used_non_lisp,
+	  base + header->pure_non_lisp.offset,
+	  header->pure_bytes_used_non_lisp);
+  pure_bytes_used_lisp = header->pure_bytes_used_lisp;
+  pure_bytes_used_non_lisp = header->pure_bytes_used_non_lisp;
+  if (pure_objects_size < header->pure_objects.nwords)
+    pure_objects = xpalloc (pure_objects, &pure_objects_size,
+			    header->pure_objects.nwords - pure_objects_size,
+			    -1, sizeof *pure_objects);
+  pure_objects_used = header->pure_objects.nwords;
+  p = words + header->pure_objects.offset / 8;
+  for (i = 0; i < pure_objects_used; i++)
+    pure_objects[i] = p[i];
+  if (delta)
+    for (p = words + header->internal_relocs.offset / 8,
+	   end = p + header->internal_relocs.nwords;
+	 p < end; p++)
+      {
+	void *address = purebeg + (*p >> 1);
+
+	if (*p & 1)
+	  *(char **) address += delta;
+	else
+	  {
+	    Lisp_Object obj = *(Lisp_Object *) address;
+	    *(Lisp_Object *) address
+	      = make_lisp_ptr ((char *) XPNTR (obj) + delta, XTYPE (obj));
+	  }
+      }
+  for (p = words + header->external_relocs.offset / 8,
+	 end = p + header->external_relocs.nwords;
+       p < end; p += 2)
+    {
+      void *address = purebeg + (p[0] >> 1);
+
+      if (p[0] & 1)
+	*(void **) address = emacs_ptr (p[1]);
+      else
+	*(Lisp_Object *) address = load_value (l, p[1]);
+    }
+
+  /* Fill in the objects.  */
+  for (i = 0; i < l->nobjects; i++)
+    {
+      enum Lisp_Type type;
+
+      switch (records[i][0] & 0xff)
+	{
+	case DUMP_CONS: type = Lisp_Cons; break;
+	case DUMP_FLOAT: type = Lisp_Float; break;
+	case DUMP_STRING: type = Lisp_String; break;
+	case DUMP_SYMBOL: type = Lisp_Symbol; break;
+	case DUMP_MARKER: case DUMP_OVERLAY: type = Lisp_Misc; break;
+	default: type = Lisp_Vectorlike; break;
+	}
+      load_fill (l, make_lisp_ptr (l->objects[i], type), records[i]);
+    }
+
+  /* Filling in the symbols restored the variables, this one
+     included; keep it for when loading is done.  */
+  threshold = gc_cons_threshold;
+  gc_cons_threshold = MOST_POSITIVE_FIXNUM;
+
+  load_roots (l, words + header->roots.offset / 8);
+
+  for (i = 0; i < l->buffers.n; i++)
+    {
+      struct buffer *old = current_buffer;
+      load_finish_buffer (l, l->buffers.items[i].object,
+			  l->buffers.items[i].data);
+      current_buffer = old;
+    }
+  for (i = 0; i < l->markers.n; i++)
+    {
+      uint64_t const *q = l->markers.items[i].data;
+      set_marker_both (l->markers.items[i].object, load_value (l, q[1]),
+		       q[2], q[3]);
+    }
+  for (i = 0; i < l->overlays.n; i++)
+    {
+      uint64_t const *q = l->overlays.items[i].data;
+      add_buffer_overlay (XBUFFER (load_value (l, q[1])),
+			  XOVERLAY (l->overlays.items[i].object), q[2], q[3]);
+    }
+  for (i = 0; i < l->strings.n; i++)
+    {
+      Lisp_Object string = l->strings.items[i].object;
+      uint64_t const *q = l->strings.items[i].data;
+
+      q += 3 + load_nwords (SBYTES (string));
+      load_intervals (l, string, q + 1, q[0]);
+    }
+  for (i = 0; i < l->hash_tables.n; i++)
+    rebuild_hash_table (XHASH_TABLE (l->hash_tables.items[i].object));
+
+  for (i = 0; i < nafter_load_hooks; i++)
+    after_load_hooks[i] ();
+
+  gc_cons_threshold = threshold;
+
+  xfree (l->objects);
+  xfree (records);
+  xfree (l->buffers.items);
+  xfree (l->markers.items);
+  xfree (l->overlays.items);
+  xfree (l->strings.items);
+  xfree (l->hash_tables.items);
+#ifdef HAVE_MMAP
+  munmap (base, size);
+#else
+  xfree (base);
+#endif
+
+  loaded_dump_file = xstrdup (file);
+  loaded_dump_objects = l->nobjects;
+  loaded_dump_time = timespec_sub (current_timespec (), start);
+}
+
+DEFUN ("pdumper-stats", Fpdumper_stats, Spdumper_stats, 0, 0, 0,
+       doc: /* Return statistics about the portable dump Emacs started from.
+The value is nil if Emacs did not start from a portable dump.
+Otherwise, it is a property list with these properties:
+
+:dump-file  The name of the dump file.
+:objects    The number of objects read from the dump file.
+:load-time  The time it took to load the dump file, in seconds.  */)
+  (void)
+{
+  if (!loaded_dump_file)
+    return Qnil;
+  return listn (CONSTYPE_HEAP, 6, QCdump_file, build_string (loaded_dump_file),
+	       QCobjects, make_number (loaded_dump_objects),
+	       QCload_time, make_float (timespectod (loaded_dump_time)));
+}
+
+void
+syms_of_pdumper (void)
+{
+  DEFSYM (QCdump_file, ":dump-file");
+  DEFSYM (QCobjects, ":objects");
+  DEFSYM (QCload_time, ":load-time");
+
+  defsubr (&Sdump_emacs_portable);
+  defsubr (&Spdumper_stats);
+}
@@ -498,8 +498,7 @@ temp_output_buffer_setup (const char *bufname)
   bset_read_only (current_buffer, Qnil);
   bset_filename (current_buffer, Qnil);
   bset_undo_list (current_buffer, Qt);
-  eassert (current_buffer->overlays_before == NULL);
-  eassert (current_buffer->overlays_after == NULL);
+  eassert (!buffer_has_overlays ());
   bset_enable_multibyte_characters
     (current_buffer, BVAR (&buffer_defaults, enable_multibyte_characters));
   specbind (Qinhibit_read_only, Qt);
@@ -1129,7 +1128,7 @@ print (Lisp_Object obj, Lisp_Object printcharfun, bool escapeflag)
 	  ptrdiff_t i;
 
 	  for (i = 0; i < HASH_TABLE_SIZE (h); ++i)
-	    if (!NILP (HASH_HASH (h, i))
+	    if (HASH_ENTRY_USED_P (h, i)
 		&& EQ (HASH_VALUE (h, i), Qt))
 	      Fremhash (HASH_KEY (h, i), Vprint_number_table);
 	}
@@ -1837,7 +1836,7 @@ print_object (Lisp_Object obj, Lisp_Object printcharfun, bool escapeflag)
 	      PRINTCHAR (' ');
 	      strout (SDATA (SYMBOL_NAME (h->weak)), -1, -1, printcharfun);
 	      PRINTCHAR (' ');
-	      len = sprintf (buf, "%"pD"d/%"pD"d", h->count, ASIZE (h->next));
+	      len = sprintf (buf, "%"pD"d/%"pD"d", h->count, HASH_TABLE_SIZE (h));
 	      strout (buf, len, len, printcharfun);
 	    }
 	  len = sprintf (buf, " %p>", ptr);
@@ -1846,7 +1845,7 @@ print_object (Lisp_Object obj, Lisp_Object printcharfun, bool escapeflag)
 	  /* Implement a readable output, e.g.:
 	    #s(hash-table size 2 test equal data (k1 v1 k2 v2)) */
 	  /* Always print the size.  */
-	  len = sprintf (buf, "#s(hash-table size %"pD"d", ASIZE (h->next));
+	  len = sprintf (buf, "#s(hash-table size %"pD"d", HASH_TABLE_SIZE (h));
 	  strout (buf, len, len, printcharfun);
 
 	  if (!NILP (h->test.name))
@@ -1886,7 +1885,7 @@ print_object (Lisp_Object obj, Lisp_Object printcharfun, bool escapeflag)
 
 	  PRINTCHAR ('(');
 	  for (i = 0; i < size; i++)
-	    if (!NILP (HASH_HASH (h, i)))
+	    if (HASH_ENTRY_USED_P (h, i))
 	      {
 		if (i) PRINTCHAR (' ');
 		print_object (HASH_KEY (h, i), printcharfun, escapeflag);
@@ -1918,6 +1917,12 @@ print_object (Lisp_Object obj, Lisp_Object printcharfun, bool escapeflag)
 	{
 	  strout ("#<window-configuration>", -1, -1, printcharfun);
 	}
+      else if (OBARRAYP (obj))
+	{
+	  int len = sprintf (buf, "#<obarray n=%"pD"d>",
+			     XOBARRAY (obj)->count);
+	  strout (buf, len, len, printcharfun);
+	}
       else if (FRAMEP (obj))
 	{
 	  int len;
@@ -2051,16 +2056,14 @@ print_object (Lisp_Object obj, Lisp_Object printcharfun, bool escapeflag)
 
 	case Lisp_Misc_Overlay:
 	  strout ("#<overlay ", -1, -1, printcharfun);
-	  if (! XMARKER (OVERLAY_START (obj))->buffer)
+	  if (! OVERLAY_BUFFER (obj))
 	    strout ("in no buffer", -1, -1, printcharfun);
 	  else
 	    {
 	      int len = sprintf (buf, "from %"pD"d to %"pD"d in ",
-				 marker_position (OVERLAY_START (obj)),
-				 marker_position (OVERLAY_END   (obj)));
+				 OVERLAY_START (obj), OVERLAY_END (obj));
 	      strout (buf, len, len, printcharfun);
-	      print_string (BVAR (XMARKER (OVERLAY_START (obj))->buffer, name),
-			    printcharfun);
+	      print_string (BVAR (OVERLAY_BUFFER (obj), name), printcharfun);
 	    }
 	  PRINTCHAR ('>');
 	  break;
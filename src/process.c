@@ -88,6 +88,13 @@ along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.  */
 #include <pty.h>
 #endif
 
+/* Wait for descriptors through epoll where it is available.  GLib and
+   Nextstep builds must wait in xg_select and ns_select instead.  */
+#if defined HAVE_EPOLL && !defined HAVE_GLIB && !defined HAVE_NS
+#define USE_EPOLL
+#include <sys/epoll.h>
+#endif
+
 #include <c-ctype.h>
 #include <sig2str.h>
 #include <verify.h>
@@ -258,6 +265,12 @@ enum { SELECT_CAN_DO_WRITE_MASK = true };
 # define HAVE_SEQPACKET
 #endif
 
+/* Bounds on the number of bytes read from a process at once.  */
+enum { READ_OUTPUT_MIN = 4096, READ_OUTPUT_MAX_MAX = INT_MAX / 2 };
+
+/* Room for the decoding carryover at the start of a read buffer.  */
+#define MAX_CARRYOVER (sizeof ((struct coding_system *) 0)->carryover)
+
 #if !defined (ADAPTIVE_READ_BUFFERING) && !defined (NO_ADAPTIVE_READ_BUFFERING)
 #define ADAPTIVE_READ_BUFFERING
 #endif
@@ -459,6 +472,195 @@ static struct fd_callback_data
   int condition; /* mask of the defines above.  */
 } fd_callback_info[FD_SETSIZE];
 
+#ifdef USE_EPOLL
+
+/* The epoll instance that holds the descriptors in input_wait_mask and
+   write_mask, or -1 if waiting must use pselect.  */
+static int epoll_fd = -1;
+
+/* Indexed by descriptor, the events (FOR_READ, FOR_WRITE) that
+   input_wait_mask and write_mask ask for, and the ones epoll_fd is
+   told to report.  The latter lack the events of a descriptor that
+   was ready while nobody waited for it, so that a level-triggered
+   epoll_fd does not report it over and over.  Such a descriptor is
+   "parked" in epoll_parked until it is waited for again.  */
+static unsigned char epoll_wanted[FD_SETSIZE];
+static unsigned char epoll_armed[FD_SETSIZE];
+static int epoll_parked[FD_SETSIZE];
+static int epoll_parked_count;
+
+/* The largest number of events to get from one epoll_wait.  */
+enum { EPOLL_MAX_EVENTS = 64 };
+
+/* Give up on epoll_fd; wait with pselect from now on.  */
+
+static void
+stop_epoll (void)
+{
+  emacs_close (epoll_fd);
+  epoll_fd = -1;
+}
+
+/* Tell epoll_fd to report EVENTS (FOR_READ, FOR_WRITE) for FD.  */
+
+static void
+arm_epoll_desc (int fd, int events)
+{
+  struct epoll_event ev;
+  int op;
+
+  if (events == epoll_armed[fd])
+    return;
+
+  ev.events = ((events & FOR_READ ? EPOLLIN : 0)
+	       | (events & FOR_WRITE ? EPOLLOUT : 0));
+  ev.data.fd = fd;
+  op = (!events ? EPOLL_CTL_DEL
+	: epoll_armed[fd] ? EPOLL_CTL_MOD : EPOLL_CTL_ADD);
+  if (epoll_ctl (epoll_fd, op, fd, &ev) != 0)
+    {
+      /* A descriptor closed and reopened behind our back may have
+	 left the set, or still be in it.  */
+      if (op == EPOLL_CTL_MOD && errno == ENOENT)
+	op = EPOLL_CTL_ADD;
+      else if (op == EPOLL_CTL_ADD && errno == EEXIST)
+	op = EPOLL_CTL_MOD;
+      else
+	op = -1;
+      if (op < 0 || epoll_ctl (epoll_fd, op, fd, &ev) != 0)
+	{
+	  /* Closing a descriptor removes it from the set anyway.  Any
+	     other failure, such as EPERM for a regular file, means
+	     epoll cannot wait for the descriptor as select does.  */
+	  if (events)
+	    {
+	      stop_epoll ();
+	      return;
+	    }
+	}
+    }
+  epoll_armed[fd] = events;
+}
+
+/* Update epoll_fd after FD was added to or removed from
+   input_wait_mask or write_mask.  */
+
+static void
+update_epoll_desc (int fd)
+{
+  if (epoll_fd < 0)
+    return;
+  epoll_wanted[fd] = ((FD_ISSET (fd, &input_wait_mask) ? FOR_READ : 0)
+		      | (FD_ISSET (fd, &write_mask) ? FOR_WRITE : 0));
+  arm_epoll_desc (fd, epoll_wanted[fd]);
+}
+
+/* Arm the parked descriptors that are in RFDS or WFDS (which may be
+   null), because they are waited for now.  */
+
+static void
+unpark_epoll_descs (fd_set *rfds, fd_set *wfds)
+{
+  int i = 0;
+
+  while (i < epoll_parked_count && 0 <= epoll_fd)
+    {
+      int fd = epoll_parked[i];
+      int waited = ((FD_ISSET (fd, rfds) ? FOR_READ : 0)
+		    | (wfds && FD_ISSET (fd, wfds) ? FOR_WRITE : 0));
+      arm_epoll_desc (fd, epoll_armed[fd] | (epoll_wanted[fd] & waited));
+      if (epoll_armed[fd] == epoll_wanted[fd])
+	epoll_parked[i] = epoll_parked[--epoll_parked_count];
+      else
+	i++;
+    }
+}
+
+/* Like pselect with no signal mask, but wait through epoll_fd.  RFDS
+   and WFDS (which may be null) must be subsets of input_wait_mask and
+   write_mask.  Store the ready descriptors into READY as well, and
+   their number into *NREADY.  */
+
+static int
+epoll_select (fd_set *rfds, fd_set *wfds, struct timespec const *timeout,
+	      int *ready, int *nready)
+{
+  struct epoll_event events[EPOLL_MAX_EVENTS];
+  fd_set rwait, wwait;
+  int i, n, ms, nfds;
+
+  /* Round the timeout up to whole milliseconds, so that a short
+     timeout does not turn into busy waiting.  */
+  ms = (timeout->tv_sec < INT_MAX / 1000 - 1
+	? timeout->tv_sec * 1000 + (timeout->tv_nsec + 999999) / 1000000
+	: INT_MAX);
+  n = epoll_wait (epoll_fd, events, EPOLL_MAX_EVENTS, ms);
+
+  rwait = *rfds;
+  FD_ZERO (rfds);
+  if (wfds)
+    {
+      wwait = *wfds;
+      FD_ZERO (wfds);
+    }
+  *nready = 0;
+  if (n < 0)
+    return n;
+
+  nfds = 0;
+  for (i = 0; i < n; i++)
+    {
+      int fd = events[i].data.fd;
+      int armed = epoll_armed[fd];
+      int unwaited = 0;
+      bool waited = false;
+
+      if (armed & FOR_READ
+	  && events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+	{
+	  if (FD_ISSET (fd, &rwait))
+	    {
+	      FD_SET (fd, rfds);
+	      nfds++;
+	      waited = true;
+	    }
+	  else
+	    unwaited |= FOR_READ;
+	}
+      if (armed & FOR_WRITE
+	  && events[i].events & (EPOLLOUT | EPOLLHUP | EPOLLERR))
+	{
+	  if (wfds && FD_ISSET (fd, &wwait))
+	    {
+	      FD_SET (fd, wfds);
+	      nfds++;
+	      waited = true;
+	    }
+	  else
+	    unwaited |= FOR_WRITE;
+	}
+
+      if (waited)
+	ready[(*nready)++] = fd;
+      if (unwaited && 0 <= epoll_fd)
+	{
+	  if (epoll_armed[fd] == epoll_wanted[fd])
+	    epoll_parked[epoll_parked_count++] = fd;
+	  arm_epoll_desc (fd, epoll_armed[fd] & ~unwaited);
+	}
+    }
+  return nfds;
+}
+
+#else
+
+static void
+update_epoll_desc (int fd)
+{
+}
+
+#endif /* USE_EPOLL */
+
 
 /* Add a file descriptor FD to be monitored for when read is possible.
    When read is possible, call FUNC with argument DATA.  */
@@ -495,6 +697,7 @@ void
 add_write_fd (int fd, fd_callback func, void *data)
 {
   FD_SET (fd, &write_mask);
+  update_epoll_desc (fd);
   if (fd > max_input_desc)
     max_input_desc = fd;
 
@@ -525,6 +728,7 @@ void
 delete_write_fd (int fd)
 {
   FD_CLR (fd, &write_mask);
+  update_epoll_desc (fd);
   fd_callback_info[fd].condition &= ~FOR_WRITE;
   if (fd_callback_info[fd].condition == 0)
     {
@@ -735,6 +939,8 @@ make_process (Lisp_Object name)
   p->outfd = -1;
   for (i = 0; i < PROCESS_OPEN_FDS; i++)
     p->open_fd[i] = -1;
+  p->read_output_max = clip_to_bounds (1, read_process_output_max,
+				       READ_OUTPUT_MAX_MAX);
 
 #ifdef HAVE_GNUTLS
   p->gnutls_initstage = GNUTLS_STAGE_EMPTY;
@@ -1075,6 +1281,7 @@ The string argument is normally a multibyte string, except:
 	{
 	  FD_CLR (p->infd, &input_wait_mask);
 	  FD_CLR (p->infd, &non_keyboard_wait_mask);
+	  update_epoll_desc (p->infd);
 	}
       else if (EQ (p->filter, Qt)
 	       /* Network or serial process not stopped:  */
@@ -1082,6 +1289,7 @@ The string argument is normally a multibyte string, except:
 	{
 	  FD_SET (p->infd, &input_wait_mask);
 	  FD_SET (p->infd, &non_keyboard_wait_mask);
+	  update_epoll_desc (p->infd);
 	}
     }
 
@@ -1203,6 +1411,33 @@ DEFUN ("process-query-on-exit-flag",
   return (XPROCESS (process)->kill_without_query ? Qnil : Qt);
 }
 
+DEFUN ("set-process-read-output-max",
+       Fset_process_read_output_max, Sset_process_read_output_max,
+       2, 2, 0,
+       doc: /* Set the largest chunk of output read from PROCESS at once to SIZE.
+Emacs reads output from PROCESS in chunks of 4096 bytes at first, and
+doubles the chunk size, up to SIZE bytes, while the process keeps
+producing enough output to fill each chunk.  Larger chunks mean fewer
+calls to the process filter.  This function returns SIZE.  */)
+  (register Lisp_Object process, Lisp_Object size)
+{
+  CHECK_PROCESS (process);
+  CHECK_RANGED_INTEGER (size, 1, READ_OUTPUT_MAX_MAX);
+  XPROCESS (process)->read_output_max = XINT (size);
+  return size;
+}
+
+DEFUN ("process-read-output-max",
+       Fprocess_read_output_max, Sprocess_read_output_max,
+       1, 1, 0,
+       doc: /* Return the largest chunk of output read from PROCESS at once.
+See `set-process-read-output-max'.  */)
+  (register Lisp_Object process)
+{
+  CHECK_PROCESS (process);
+  return make_number (XPROCESS (process)->read_output_max);
+}
+
 DEFUN ("process-contact", Fprocess_contact, Sprocess_contact,
        1, 2, 0,
        doc: /* Return the contact info of PROCESS; t for a real child.
@@ -1302,7 +1537,7 @@ Returns nil if format of ADDRESS is invalid.  */)
   if (VECTORP (address))  /* AF_INET or AF_INET6 */
     {
       register struct Lisp_Vector *p = XVECTOR (address);
-      ptrdiff_t size = p->header.size;
+      ptrdiff_t size = ASIZE (address);
       Lisp_Object args[10];
       int nargs, i;
       char const *format;
@@ -1720,6 +1955,7 @@ create_process (Lisp_Object process, char **new_argv, Lisp_Object current_dir)
 
   FD_SET (inchannel, &input_wait_mask);
   FD_SET (inchannel, &non_keyboard_wait_mask);
+  update_epoll_desc (inchannel);
   if (inchannel > max_process_desc)
     max_process_desc = inchannel;
 
@@ -1952,6 +2188,7 @@ create_pty (Lisp_Object process)
 
       FD_SET (pty_fd, &input_wait_mask);
       FD_SET (pty_fd, &non_keyboard_wait_mask);
+      update_epoll_desc (pty_fd);
       if (pty_fd > max_process_desc)
 	max_process_desc = pty_fd;
 
@@ -2054,13 +2291,13 @@ get_lisp_to_sockaddr_size (Lisp_Object address, int *familyp)
   if (VECTORP (address))
     {
       p = XVECTOR (address);
-      if (p->header.size == 5)
+      if (ASIZE (address) == 5)
 	{
 	  *familyp = AF_INET;
 	  return sizeof (struct sockaddr_in);
 	}
 #ifdef AF_INET6
-      else if (p->header.size == 9)
+      else if (ASIZE (address) == 9)
 	{
 	  *familyp = AF_INET6;
 	  return sizeof (struct sockaddr_in6);
@@ -2079,10 +2316,10 @@ get_lisp_to_sockaddr_size (Lisp_Object address, int *familyp)
     {
       struct sockaddr *sa;
       p = XVECTOR (XCDR (address));
-      if (MAX_ALLOCA - sizeof sa->sa_family < p->header.size)
+      if (MAX_ALLOCA - sizeof sa->sa_family < ASIZE (XCDR (address)))
 	return 0;
       *familyp = XINT (XCAR (address));
-      return p->header.size + sizeof (sa->sa_family);
+      return ASIZE (XCDR (address)) + sizeof (sa->sa_family);
     }
   return 0;
 }
@@ -2607,6 +2844,7 @@ usage:  (make-serial-process &rest ARGS)  */)
     {
       FD_SET (fd, &input_wait_mask);
       FD_SET (fd, &non_keyboard_wait_mask);
+      update_epoll_desc (fd);
     }
 
   if (BUFFERP (buffer))
@@ -3413,6 +3651,7 @@ usage: (make-network-process &rest ARGS)  */)
 	{
 	  FD_SET (inch, &connect_wait_mask);
 	  FD_SET (inch, &write_mask);
+	  update_epoll_desc (inch);
 	  num_pending_connects++;
 	}
     }
@@ -3425,6 +3664,7 @@ usage: (make-network-process &rest ARGS)  */)
       {
 	FD_SET (inch, &input_wait_mask);
 	FD_SET (inch, &non_keyboard_wait_mask);
+	update_epoll_desc (inch);
       }
 
   if (inch > max_process_desc)
@@ -3884,10 +4124,29 @@ deactivate_process (Lisp_Object proc)
 
   /* Beware SIGCHLD hereabouts. */
 
+  /* Stop waiting for the input descriptor before closing it, so that
+     it leaves the epoll set even if another descriptor still refers
+     to the same file.  */
+  inchannel = p->infd;
+  if (inchannel >= 0)
+    {
+      FD_CLR (inchannel, &input_wait_mask);
+      FD_CLR (inchannel, &non_keyboard_wait_mask);
+#ifdef NON_BLOCKING_CONNECT
+      if (FD_ISSET (inchannel, &connect_wait_mask))
+	{
+	  FD_CLR (inchannel, &connect_wait_mask);
+	  FD_CLR (inchannel, &write_mask);
+	  if (--num_pending_connects < 0)
+	    emacs_abort ();
+	}
+#endif
+      update_epoll_desc (inchannel);
+    }
+
   for (i = 0; i < PROCESS_OPEN_FDS; i++)
     close_process_fd (&p->open_fd[i]);
 
-  inchannel = p->infd;
   if (inchannel >= 0)
     {
       p->infd  = -1;
@@ -3901,17 +4160,6 @@ deactivate_process (Lisp_Object proc)
 	}
 #endif
       chan_process[inchannel] = Qnil;
-      FD_CLR (inchannel, &input_wait_mask);
-      FD_CLR (inchannel, &non_keyboard_wait_mask);
-#ifdef NON_BLOCKING_CONNECT
-      if (FD_ISSET (inchannel, &connect_wait_mask))
-	{
-	  FD_CLR (inchannel, &connect_wait_mask);
-	  FD_CLR (inchannel, &write_mask);
-	  if (--num_pending_connects < 0)
-	    emacs_abort ();
-	}
-#endif
       if (inchannel == max_process_desc)
 	{
 	  /* We just closed the highest-numbered process input descriptor,
@@ -4180,6 +4428,7 @@ server_accept_connection (Lisp_Object server, int channel)
     {
       FD_SET (s, &input_wait_mask);
       FD_SET (s, &non_keyboard_wait_mask);
+      update_epoll_desc (s);
     }
 
   if (s > max_process_desc)
@@ -4238,6 +4487,46 @@ wait_reading_process_output_1 (void)
 {
 }
 
+/* Wait until a descriptor in RFDS is ready for reading or one in WFDS
+   (which may be null) for writing, or until TIMEOUT elapses.  NFDS is
+   one more than the largest descriptor in them.  Leave the ready
+   descriptors in RFDS and WFDS, also store them into READY and their
+   number into *NREADY, and return a value as pselect does.  If
+   MAY_USE_EPOLL, RFDS and WFDS are subsets of input_wait_mask and
+   write_mask, and epoll can wait for them.  */
+
+static int
+wait_for_descs (int nfds, fd_set *rfds, fd_set *wfds,
+		struct timespec const *timeout, bool may_use_epoll,
+		int *ready, int *nready)
+{
+  int fd, n;
+
+#ifdef USE_EPOLL
+  if (may_use_epoll && 0 <= epoll_fd)
+    {
+      unpark_epoll_descs (rfds, wfds);
+      if (0 <= epoll_fd)
+	return epoll_select (rfds, wfds, timeout, ready, nready);
+    }
+#endif
+
+#if defined (HAVE_NS)
+  n = ns_select
+#elif defined (HAVE_GLIB)
+  n = xg_select
+#else
+  n = pselect
+#endif
+    (nfds, rfds, wfds, NULL, timeout, NULL);
+
+  *nready = 0;
+  for (fd = 0; 0 < n && fd < nfds; fd++)
+    if (FD_ISSET (fd, rfds) || (wfds && FD_ISSET (fd, wfds)))
+      ready[(*nready)++] = fd;
+  return n;
+}
+
 /* Read and dispose of subprocess output while waiting for timeout to
    elapse and/or keyboard input to be available.
 
@@ -4284,6 +4573,9 @@ wait_reading_process_output (intmax_t time_limit, int nsecs, int read_kbd,
   int channel, nfds;
   fd_set Available;
   fd_set Writeok;
+  /* The descriptors found ready by the last wait.  */
+  int ready[FD_SETSIZE];
+  int nready, i;
   bool check_write;
   int check_delay;
   bool no_avail;
@@ -4551,6 +4843,7 @@ wait_reading_process_output (intmax_t time_limit, int nsecs, int read_kbd,
 	 triggered by processing X events).  In the latter case, set
 	 nfds to 1 to avoid breaking the loop.  */
       no_avail = 0;
+      nready = 0;
       if ((read_kbd || !NILP (wait_for_cell))
 	  && detect_input_pending ())
 	{
@@ -4596,17 +4889,10 @@ wait_reading_process_output (intmax_t time_limit, int nsecs, int read_kbd,
 	    }
 #endif
 
-#if defined (HAVE_NS)
-          nfds = ns_select
-#elif defined (HAVE_GLIB)
-	  nfds = xg_select
-#else
-	  nfds = pselect
-#endif
-            (max (max_process_desc, max_input_desc) + 1,
-             &Available,
-             (check_write ? &Writeok : 0),
-             NULL, &timeout, NULL);
+	  nfds = wait_for_descs (max (max_process_desc, max_input_desc) + 1,
+				 &Available, (check_write ? &Writeok : 0),
+				 &timeout, !(wait_proc && just_wait_proc),
+				 ready, &nready);
 
 #ifdef HAVE_GNUTLS
           /* GnuTLS buffers data internally.  In lowat mode it leaves
@@ -4636,6 +4922,7 @@ wait_reading_process_output (intmax_t time_limit, int nsecs, int read_kbd,
 			    nfds++;
 			    eassert (p->infd == channel);
 			    FD_SET (p->infd, &Available);
+			    ready[nready++] = p->infd;
 			  }
 		      }
 		}
@@ -4653,6 +4940,7 @@ wait_reading_process_output (intmax_t time_limit, int nsecs, int read_kbd,
 		      eassert (0 <= wait_proc->infd);
 		      /* Set to Available.  */
 		      FD_SET (wait_proc->infd, &Available);
+		      ready[nready++] = wait_proc->infd;
 		    }
 		}
 	    }
@@ -4755,9 +5043,13 @@ wait_reading_process_output (intmax_t time_limit, int nsecs, int read_kbd,
       if (no_avail || nfds == 0)
 	continue;
 
-      for (channel = 0; channel <= max_input_desc; ++channel)
+      /* Look only at the descriptors found ready.  */
+      for (i = 0; i < nready; i++)
         {
-          struct fd_callback_data *d = &fd_callback_info[channel];
+	  struct fd_callback_data *d;
+
+	  channel = ready[i];
+	  d = &fd_callback_info[channel];
           if (d->func
 	      && ((d->condition & FOR_READ
 		   && FD_ISSET (channel, &Available))
@@ -4766,8 +5058,9 @@ wait_reading_process_output (intmax_t time_limit, int nsecs, int read_kbd,
             d->func (channel, d->data);
 	}
 
-      for (channel = 0; channel <= max_process_desc; channel++)
+      for (i = 0; i < nready; i++)
 	{
+	  channel = ready[i];
 	  if (FD_ISSET (channel, &Available)
 	      && FD_ISSET (channel, &non_keyboard_wait_mask)
               && !FD_ISSET (channel, &non_process_wait_mask))
@@ -4836,6 +5129,7 @@ wait_reading_process_output (intmax_t time_limit, int nsecs, int read_kbd,
 		     signal once.  */
 		  FD_CLR (channel, &input_wait_mask);
 		  FD_CLR (channel, &non_keyboard_wait_mask);
+		  update_epoll_desc (channel);
 
 		  if (p->pid == -2)
 		    {
@@ -4871,6 +5165,7 @@ wait_reading_process_output (intmax_t time_limit, int nsecs, int read_kbd,
 
 	      FD_CLR (channel, &connect_wait_mask);
               FD_CLR (channel, &write_mask);
+              update_epoll_desc (channel);
 	      if (--num_pending_connects < 0)
 		emacs_abort ();
 
@@ -4923,6 +5218,7 @@ wait_reading_process_output (intmax_t time_limit, int nsecs, int read_kbd,
 		    {
 		      FD_SET (p->infd, &input_wait_mask);
 		      FD_SET (p->infd, &non_keyboard_wait_mask);
+		      update_epoll_desc (p->infd);
 		    }
 		}
 	    }
@@ -4965,17 +5261,114 @@ read_process_output_error_handler (Lisp_Object error_val)
 
 static void
 read_and_dispose_of_process_output (struct Lisp_Process *p, char *chars,
-				    ssize_t nbytes,
+				    ssize_t nbytes, ptrdiff_t nchars,
 				    struct coding_system *coding);
+static Lisp_Object insert_process_output_from_gap (Lisp_Object);
+
+/* Return the buffer to read output from process P into, and store
+   the number of bytes to read in *READMAX.  The buffer starts at
+   READ_OUTPUT_MIN bytes and doubles, up to P's read_output_max, each
+   time the previous read filled it.  */
+
+static char *
+process_read_buffer (struct Lisp_Process *p, ptrdiff_t *readmax)
+{
+  ptrdiff_t size = p->read_output_size;
+
+  if (!p->read_output_buf)
+    size = READ_OUTPUT_MIN;
+  else if (p->read_output_full)
+    size = size <= p->read_output_max / 2 ? size * 2 : p->read_output_max;
+  size = min (size, p->read_output_max);
+  p->read_output_full = false;
+
+  if (size != p->read_output_size || !p->read_output_buf)
+    {
+      /* The old buffer holds nothing that is still needed; any
+	 decoding carryover is kept in p->decoding_buf.  */
+      xfree (p->read_output_buf);
+      p->read_output_buf = xmalloc (MAX_CARRYOVER + size);
+      p->read_output_size = size;
+    }
+  *readmax = size;
+  return p->read_output_buf;
+}
+
+/* If the next READMAX bytes of output from process P on CHANNEL can
+   be read straight into P's buffer, get that buffer ready for it and
+   return it.  Otherwise, return NULL.
+
+   That is possible when P has the default filter, so that its output
+   is only inserted in its buffer, when CODING would decode the output
+   to the same bytes (see decode_coding_as_is), and when inserting
+   text in the buffer runs no Lisp code before the insertion.  The gap
+   is then moved to where the output goes, and made large enough.  */
+
+static struct buffer *
+prepare_direct_process_output (struct Lisp_Process *p, int channel,
+			       struct coding_system *coding,
+			       ptrdiff_t readmax)
+{
+  struct buffer *b, *old_buffer = current_buffer;
+  struct Lisp_Marker *m = XMARKER (p->mark);
+  ptrdiff_t pos, pos_byte;
+
+  if (! EQ (p->filter, Qinternal_default_process_filter)
+      || ! BUFFERP (p->buffer)
+      || ! BUFFER_LIVE_P (XBUFFER (p->buffer))
+      || p->decoding_carryover > 0
+      || proc_buffered_char[channel] >= 0
+#ifdef DATAGRAM_SOCKETS
+      || DATAGRAM_CHAN_P (channel)
+#endif
+      || ! coding_may_decode_as_is (coding))
+    return NULL;
+
+  b = XBUFFER (p->buffer);
+  if (m->buffer && m->buffer != b)
+    return NULL;
+
+  set_buffer_internal (b);
+  if (insertion_may_run_lisp ())
+    b = NULL;
+  else
+    {
+      /* This is where internal-default-process-filter puts point.  */
+      if (m->buffer)
+	{
+	  pos = clip_to_bounds (BEGV, marker_position (p->mark), ZV);
+	  pos_byte = clip_to_bounds (BEGV_BYTE,
+				     marker_byte_position (p->mark), ZV_BYTE);
+	}
+      else
+	{
+	  pos = ZV;
+	  pos_byte = ZV_BYTE;
+	}
+      move_gap_both (pos, pos_byte);
+      if (GAP_SIZE < readmax)
+	make_gap (readmax - GAP_SIZE);
+      /* Don't let the gap shrink while the output is in it.  */
+      b->text->inhibit_shrinking = 1;
+    }
+  set_buffer_internal (old_buffer);
+  return b;
+}
 
 /* Read pending output from the process channel,
    starting with our buffered-ahead character if we have one.
    Yield number of decoded characters read.
 
-   This function reads at most 4096 characters.
+   This function reads at most P->read_output_max characters, and
+   fewer until earlier reads show that the process produces a lot of
+   output; see process_read_buffer.
    If you want to read all available subprocess output,
    you must call it repeatedly until it returns zero.
 
+   If the process has no filter and its output needs no decoding, the
+   output is read directly into the process buffer; see
+   prepare_direct_process_output.
+
    The characters read are decoded according to PROC's coding-system
    for decoding.  */
 
@@ -4986,10 +5379,15 @@ read_process_output (Lisp_Object proc, int channel)
   struct Lisp_Process *p = XPROCESS (proc);
   struct coding_system *coding = proc_decode_coding_system[channel];
   int carryover = p->decoding_carryover;
-  enum { readmax = 4096 };
+  ptrdiff_t readmax;
   ptrdiff_t count = SPECPDL_INDEX ();
   Lisp_Object odeactivate;
-  char chars[sizeof coding->carryover + readmax];
+  char *chars = process_read_buffer (p, &readmax);
+  struct buffer *direct = (carryover ? NULL
+			   : prepare_direct_process_output (p, channel,
+							    coding, readmax));
+  char *dst = direct ? (char *) BUF_GPT_ADDR (direct) : chars + carryover;
+  ptrdiff_t nchars = -1;
 
   if (carryover)
     /* See the comment above.  */
@@ -5014,12 +5412,11 @@ read_process_output (Lisp_Object proc, int channel)
 	}
 #ifdef HAVE_GNUTLS
       if (p->gnutls_p && p->gnutls_state)
-	nbytes = emacs_gnutls_read (p, chars + carryover + buffered,
-				    readmax - buffered);
+	nbytes = emacs_gnutls_read (p, dst + buffered, readmax - buffered);
       else
 #endif
-	nbytes = emacs_read (channel, chars + carryover + buffered,
-			     readmax - buffered);
+	nbytes = emacs_read (channel, dst + buffered, readmax - buffered);
+      p->read_output_full = nbytes == readmax - buffered;
 #ifdef ADAPTIVE_READ_BUFFERING
       if (nbytes > 0 && p->adaptive_read_buffering)
 	{
@@ -5053,6 +5450,20 @@ read_process_output (Lisp_Object proc, int channel)
 
   p->decoding_carryover = 0;
 
+  if (direct)
+    {
+      /* Use the output where it is if it needs no decoding, and
+	 otherwise move it to where it can be decoded.  */
+      nchars = decode_coding_as_is (coding, (unsigned char *) dst, nbytes);
+      if (nchars < 0)
+	{
+	  if (nbytes > 0)
+	    memcpy (chars, dst, nbytes);
+	  direct->text->inhibit_shrinking = 0;
+	  direct = NULL;
+	}
+    }
+
   /* At this point, NBYTES holds number of bytes just received
      (including the one in proc_buffered_char[channel]).  */
   if (nbytes <= 0)
@@ -5071,7 +5482,10 @@ read_process_output (Lisp_Object proc, int channel)
      friends don't expect current-buffer to be changed from under them.  */
   record_unwind_current_buffer ();
 
-  read_and_dispose_of_process_output (p, chars, nbytes, coding);
+  read_and_dispose_of_process_output (p, direct ? NULL : chars, nbytes,
+				      nchars, coding);
+  if (direct)
+    direct->text->inhibit_shrinking = 0;
 
   /* Handling the process output should not deactivate the mark.  */
   Vdeactivate_mark = odeactivate;
@@ -5080,9 +5494,15 @@ read_process_output (Lisp_Object proc, int channel)
   return nbytes;
 }
 
+/* Decode the NBYTES bytes of output from process P at CHARS, and pass
+   them to P's filter.  If CHARS is null, the output is instead NCHARS
+   characters in NBYTES bytes that need no decoding and that have been
+   read into the gap of P's buffer, where P's output goes; see
+   prepare_direct_process_output.  */
+
 static void
 read_and_dispose_of_process_output (struct Lisp_Process *p, char *chars,
-				    ssize_t nbytes,
+				    ssize_t nbytes, ptrdiff_t nchars,
 				    struct coding_system *coding)
 {
   Lisp_Object outstream = p->filter;
@@ -5121,51 +5541,65 @@ read_and_dispose_of_process_output (struct Lisp_Process *p, char *chars,
      save the match data in a special nonrecursive fashion.  */
   running_asynch_code = 1;
 
-  decode_coding_c_string (coding, (unsigned char *) chars, nbytes, Qt);
-  text = coding->dst_object;
-  Vlast_coding_system_used = CODING_ID_NAME (coding->id);
-  /* A new coding system might be found.  */
-  if (!EQ (p->decode_coding_system, Vlast_coding_system_used))
+  if (!chars)
+    {
+      /* The output is already in place in P's buffer.  */
+      Vlast_coding_system_used = CODING_ID_NAME (coding->id);
+      internal_condition_case_1 (insert_process_output_from_gap,
+				 list3 (make_lisp_proc (p),
+					make_number (nchars),
+					make_number (nbytes)),
+				 !NILP (Vdebug_on_error) ? Qnil : Qerror,
+				 read_process_output_error_handler);
+    }
+  else
     {
-      pset_decode_coding_system (p, Vlast_coding_system_used);
+      decode_coding_c_string (coding, (unsigned char *) chars, nbytes, Qt);
+      text = coding->dst_object;
+      Vlast_coding_system_used = CODING_ID_NAME (coding->id);
+      /* A new coding system might be found.  */
+      if (!EQ (p->decode_coding_system, Vlast_coding_system_used))
+	{
+	  pset_decode_coding_system (p, Vlast_coding_system_used);
 
-      /* Don't call setup_coding_system for
-	 proc_decode_coding_system[channel] here.  It is done in
-	 detect_coding called via decode_coding above.  */
+	  /* Don't call setup_coding_system for
+	     proc_decode_coding_system[channel] here.  It is done in
+	     detect_coding called via decode_coding above.  */
 
-      /* If a coding system for encoding is not yet decided, we set
-	 it as the same as coding-system for decoding.
+	  /* If a coding system for encoding is not yet decided, we set
+	     it as the same as coding-system for decoding.
 
-	 But, before doing that we must check if
-	 proc_encode_coding_system[p->outfd] surely points to a
-	 valid memory because p->outfd will be changed once EOF is
-	 sent to the process.  */
-      if (NILP (p->encode_coding_system) && p->outfd >= 0
-	  && proc_encode_coding_system[p->outfd])
-	{
-	  pset_encode_coding_system
-	    (p, coding_inherit_eol_type (Vlast_coding_system_used, Qnil));
-	  setup_coding_system (p->encode_coding_system,
-			       proc_encode_coding_system[p->outfd]);
+	     But, before doing that we must check if
+	     proc_encode_coding_system[p->outfd] surely points to a
+	     valid memory because p->outfd will be changed once EOF is
+	     sent to the process.  */
+	  if (NILP (p->encode_coding_system) && p->outfd >= 0
+	      && proc_encode_coding_system[p->outfd])
+	    {
+	      pset_encode_coding_system
+		(p, coding_inherit_eol_type (Vlast_coding_system_used, Qnil));
+	      setup_coding_system (p->encode_coding_system,
+				   proc_encode_coding_system[p->outfd]);
+	    }
 	}
-    }
 
-  if (coding->carryover_bytes > 0)
-    {
-      if (SCHARS (p->decoding_buf) < coding->carryover_bytes)
-	pset_decoding_buf (p, make_uninit_string (coding->carryover_bytes));
-      memcpy (SDATA (p->decoding_buf), coding->carryover,
-	      coding->carryover_bytes);
-      p->decoding_carryover = coding->carryover_bytes;
+      if (coding->carryover_bytes > 0)
+	{
+	  if (SCHARS (p->decoding_buf) < coding->carryover_bytes)
+	    pset_decoding_buf (p, make_uninit_string (coding->carryover_bytes));
+	  memcpy (SDATA (p->decoding_buf), coding->carryover,
+		  coding->carryover_bytes);
+	  p->decoding_carryover = coding->carryover_bytes;
+	}
+      if (SBYTES (text) > 0)
+	/* FIXME: It's wrong to wrap or not based on debug-on-error, and
+	   sometimes it's simply wrong to wrap (e.g. when called from
+	   accept-process-output).  */
+	internal_condition_case_1 (read_process_output_call,
+				   list3 (outstream, make_lisp_proc (p), text),
+				   !NILP (Vdebug_on_error) ? Qnil : Qerror,
+				   read_process_output_error_handler);
     }
-  if (SBYTES (text) > 0)
-    /* FIXME: It's wrong to wrap or not based on debug-on-error, and
-       sometimes it's simply wrong to wrap (e.g. when called from
-       accept-process-output).  */
-    internal_condition_case_1 (read_process_output_call,
-			       list3 (outstream, make_lisp_proc (p), text),
-			       !NILP (Vdebug_on_error) ? Qnil : Qerror,
-			       read_process_output_error_handler);
 
   /* If we saved the match data nonrecursively, restore it now.  */
   restore_search_regs ();
@@ -5188,20 +5622,17 @@ read_and_dispose_of_process_output (struct Lisp_Process *p, char *chars,
       record_asynch_buffer_change ();
 }
 
-DEFUN ("internal-default-process-filter", Finternal_default_process_filter,
-       Sinternal_default_process_filter, 2, 2, 0,
-       doc: /* Function used as default process filter.
-This inserts the process's output into its buffer, if there is one.
-Otherwise it discards the output.  */)
-  (Lisp_Object proc, Lisp_Object text)
+/* Insert TEXT, output from process P, into P's buffer, if it has one.
+   If TEXT is nil, the output is instead NCHARS characters in NBYTES
+   bytes that have been read into the gap of P's buffer, at the
+   position where they are to be inserted.  */
+
+static void
+insert_process_output (struct Lisp_Process *p, Lisp_Object text,
+		       ptrdiff_t nchars, ptrdiff_t nbytes)
 {
-  struct Lisp_Process *p;
   ptrdiff_t opoint;
 
-  CHECK_PROCESS (proc);
-  p = XPROCESS (proc);
-  CHECK_STRING (text);
-
   if (!NILP (p->buffer) && BUFFER_LIVE_P (XBUFFER (p->buffer)))
     {
       Lisp_Object old_read_only;
@@ -5236,16 +5667,21 @@ Otherwise it discards the output.  */)
       if (! (BEGV <= PT && PT <= ZV))
 	Fwiden ();
 
-      /* Adjust the multibyteness of TEXT to that of the buffer.  */
-      if (NILP (BVAR (current_buffer, enable_multibyte_characters))
-	  != ! STRING_MULTIBYTE (text))
-	text = (STRING_MULTIBYTE (text)
-		? Fstring_as_unibyte (text)
-		: Fstring_to_multibyte (text));
       /* Insert before markers in case we are inserting where
 	 the buffer's mark is, and the user's next command is Meta-y.  */
-      insert_from_string_before_markers (text, 0, 0,
-					 SCHARS (text), SBYTES (text), 0);
+      if (NILP (text))
+	insert_from_gap_before_markers (nchars, nbytes);
+      else
+	{
+	  /* Adjust the multibyteness of TEXT to that of the buffer.  */
+	  if (NILP (BVAR (current_buffer, enable_multibyte_characters))
+	      != ! STRING_MULTIBYTE (text))
+	    text = (STRING_MULTIBYTE (text)
+		    ? Fstring_as_unibyte (text)
+		    : Fstring_to_multibyte (text));
+	  insert_from_string_before_markers (text, 0, 0,
+					     SCHARS (text), SBYTES (text), 0);
+	}
 
       /* Make sure the process marker's position is valid when the
 	 process buffer is changed in the signal_after_change above.
@@ -5283,6 +5719,30 @@ Otherwise it discards the output.  */)
       bset_read_only (current_buffer, old_read_only);
       SET_PT_BOTH (opoint, opoint_byte);
     }
+}
+
+/* Insert process output that has been read into the gap of the
+   process buffer.  ARGS is (PROCESS NCHARS NBYTES).  */
+
+static Lisp_Object
+insert_process_output_from_gap (Lisp_Object args)
+{
+  insert_process_output (XPROCESS (XCAR (args)), Qnil,
+			 XINT (XCAR (XCDR (args))),
+			 XINT (XCAR (XCDR (XCDR (args)))));
+  return Qnil;
+}
+
+DEFUN ("internal-default-process-filter", Finternal_default_process_filter,
+       Sinternal_default_process_filter, 2, 2, 0,
+       doc: /* Function used as default process filter.
+This inserts the process's output into its buffer, if there is one.
+Otherwise it discards the output.  */)
+  (Lisp_Object proc, Lisp_Object text)
+{
+  CHECK_PROCESS (proc);
+  CHECK_STRING (text);
+  insert_process_output (XPROCESS (proc), text, 0, 0);
   return Qnil;
 }
 
@@ -5894,6 +6354,7 @@ traffic.  */)
 	{
 	  FD_CLR (p->infd, &input_wait_mask);
 	  FD_CLR (p->infd, &non_keyboard_wait_mask);
+	  update_epoll_desc (p->infd);
 	}
       pset_command (p, Qt);
       return process;
@@ -5924,6 +6385,7 @@ traffic.  */)
 	{
 	  FD_SET (p->infd, &input_wait_mask);
 	  FD_SET (p->infd, &non_keyboard_wait_mask);
+	  update_epoll_desc (p->infd);
 #ifdef WINDOWSNT
 	  if (fd_info[ p->infd ].flags & FILE_SERIAL)
 	    PurgeComm (fd_info[ p->infd ].hnd, PURGE_RXABORT | PURGE_RXCLEAR);
@@ -6228,6 +6690,7 @@ handle_child_signal (int sig)
 		{
 		  FD_CLR (p->infd, &input_wait_mask);
 		  FD_CLR (p->infd, &non_keyboard_wait_mask);
+		  update_epoll_desc (p->infd);
 		}
 	    }
 	}
@@ -6844,6 +7307,7 @@ add_timer_wait_descriptor (int fd)
   FD_SET (fd, &input_wait_mask);
   FD_SET (fd, &non_keyboard_wait_mask);
   FD_SET (fd, &non_process_wait_mask);
+  update_epoll_desc (fd);
   fd_callback_info[fd].func = timerfd_callback;
   fd_callback_info[fd].data = NULL;
   fd_callback_info[fd].condition |= FOR_READ;
@@ -6861,6 +7325,7 @@ add_keyboard_wait_descriptor (int desc)
 #ifdef subprocesses /* actually means "not MSDOS" */
   FD_SET (desc, &input_wait_mask);
   FD_SET (desc, &non_process_wait_mask);
+  update_epoll_desc (desc);
   if (desc > max_input_desc)
     max_input_desc = desc;
 #endif
@@ -6874,6 +7339,7 @@ delete_keyboard_wait_descriptor (int desc)
 #ifdef subprocesses
   FD_CLR (desc, &input_wait_mask);
   FD_CLR (desc, &non_process_wait_mask);
+  update_epoll_desc (desc);
   delete_input_desc (desc);
 #endif
 }
@@ -7135,6 +7601,14 @@ init_process_emacs (void)
   max_process_desc = max_input_desc = -1;
   memset (fd_callback_info, 0, sizeof (fd_callback_info));
 
+#ifdef USE_EPOLL
+  /* If this fails, wait with pselect.  */
+  epoll_fd = epoll_create1 (EPOLL_CLOEXEC);
+  memset (epoll_wanted, 0, sizeof epoll_wanted);
+  memset (epoll_armed, 0, sizeof epoll_armed);
+  epoll_parked_count = 0;
+#endif
+
 #ifdef NON_BLOCKING_CONNECT
   FD_ZERO (&connect_wait_mask);
   num_pending_connects = 0;
@@ -7354,6 +7828,14 @@ The variable takes effect when `start-process' is called.  */);
   Vprocess_adaptive_read_buffering = Qt;
 #endif
 
+  DEFVAR_INT ("read-process-output-max", read_process_output_max,
+	      doc: /* Maximum number of bytes to read from a subprocess at once.
+Emacs reads process output in chunks that start at 4096 bytes and grow
+up to this size while the process keeps filling them.  The variable
+takes effect when a process is created; use `set-process-read-output-max'
+to change it for an existing process.  */);
+  read_process_output_max = 1024 * 1024;
+
   defsubr (&Sprocessp);
   defsubr (&Sget_process);
   defsubr (&Sdelete_process);
@@ -7374,6 +7856,8 @@ The variable takes effect when `start-process' is called.  */);
   defsubr (&Sset_process_inherit_coding_system_flag);
   defsubr (&Sset_process_query_on_exit_flag);
   defsubr (&Sprocess_query_on_exit_flag);
+  defsubr (&Sset_process_read_output_max);
+  defsubr (&Sprocess_read_output_max);
   defsubr (&Sprocess_contact);
   defsubr (&Sprocess_plist);
   defsubr (&Sset_process_plist);
@@ -155,8 +155,20 @@ struct Lisp_Process
        flag indicates that `raw_status' contains a new status that still
        needs to be synced to `status'.  */
     bool_bf raw_status_new : 1;
+    /* True if the last read from this process filled read_output_buf,
+       so that the buffer should grow before the next read.  */
+    bool_bf read_output_full : 1;
     int raw_status;
 
+    /* Buffer that output from this process is read into, or NULL if
+       nothing has been read yet.  It has room for read_output_size
+       bytes, plus the decoding carryover.  */
+    char *read_output_buf;
+    ptrdiff_t read_output_size;
+    /* Largest size that read_output_buf may grow to.  Initialized from
+       `read-process-output-max'.  */
+    ptrdiff_t read_output_max;
+
 #ifdef HAVE_GNUTLS
     gnutls_initstage_t gnutls_initstage;
     gnutls_session_t gnutls_state;
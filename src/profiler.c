@@ -120,7 +120,7 @@ static void evict_lower_half (log_t *log)
 	  XSET_HASH_TABLE (tmp, log); /* FIXME: Use make_lisp_ptr.  */
 	  Fremhash (key, tmp);
 	}
-	eassert (EQ (log->next_free, make_number (i)));
+	eassert (log->next_free == i);
 	{
 	  int j;
 	  eassert (VECTORP (key));
@@ -141,11 +141,11 @@ record_backtrace (log_t *log, EMACS_INT count)
   Lisp_Object backtrace;
   ptrdiff_t index;
 
-  if (!INTEGERP (log->next_free))
+  if (log->next_free < 0)
     /* FIXME: transfer the evicted counts to a special entry rather
        than dropping them on the floor.  */
     evict_lower_half (log);
-  index = XINT (log->next_free);
+  index = log->next_free;
 
   /* Get a "working memory" vector.  */
   backtrace = HASH_KEY (log, index);
@@ -165,9 +165,9 @@ record_backtrace (log_t *log, EMACS_INT count)
       }
     else
       { /* BEWARE!  hash_put in general can allocate memory.
-	   But currently it only does that if log->next_free is nil.  */
+	   But currently it only does that if log->next_free is -1.  */
 	int j;
-	eassert (!NILP (log->next_free));
+	eassert (log->next_free >= 0);
 	j = hash_put (log, backtrace, make_number (count), hash);
 	/* Let's make sure we've put `backtrace' right where it
 	   already was to start with.  */
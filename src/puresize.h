@@ -81,5 +81,18 @@ extern _Noreturn void pure_write_error (Lisp_Object);
 
 extern EMACS_INT pure[];
 
+/* Bytes of pure storage used by Lisp objects, which are allocated
+   from the start of `pure', and by other data, which is allocated
+   from its end.  */
+
+extern ptrdiff_t pure_bytes_used_lisp, pure_bytes_used_non_lisp;
+extern ptrdiff_t pure_bytes_used_before_overflow;
+
+/* The Lisp objects in pure storage, each as its offset from `pure'
+   times 8 plus its Lisp type, in the order of allocation.  */
+
+extern ptrdiff_t *pure_objects;
+extern ptrdiff_t pure_objects_used, pure_objects_size;
+
 #define PURE_P(obj) \
   ((uintptr_t) XPNTR (obj) - (uintptr_t) pure <= PURESIZE)
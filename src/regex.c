@@ -539,6 +539,19 @@ static regoff_t re_match_2_internal (struct re_pattern_buffer *bufp,
 				     ssize_t pos,
 				     struct re_registers *regs,
 				     ssize_t stop);
+
+#ifdef emacs
+static void find_required_literal (struct re_pattern_buffer *bufp);
+static ssize_t search_required_literal (re_char *literal, size_t size,
+					re_char *string1, size_t size1,
+					re_char *string2, ssize_t from,
+					ssize_t to, boolean backward);
+static struct re_dfa *dfa_compile (struct re_pattern_buffer *bufp);
+static ssize_t dfa_search (struct re_pattern_buffer *bufp,
+			   re_char *string1, size_t size1,
+			   re_char *string2, size_t size2,
+			   ssize_t startpos, ssize_t endpos, ssize_t stop);
+#endif
 
 /* These are the command codes that appear in compiled regular
    expressions.  Some opcodes are followed by argument bytes.  A
@@ -2496,6 +2509,11 @@ regex_compile (const_re_char *pattern, size_t size, reg_syntax_t syntax,
   bufp->fastmap_accurate = 0;
   bufp->not_bol = bufp->not_eol = 0;
   bufp->used_syntax = 0;
+#ifdef emacs
+  re_free_dfa (bufp);
+  bufp->must_size = 0;
+  bufp->must_start = 0;
+#endif
 
   /* Set `used' to zero, so that if we return an error, the pattern
      printer (for debugging) will think there's no pattern.  We reset it
@@ -3672,6 +3690,11 @@ regex_compile (const_re_char *pattern, size_t size, reg_syntax_t syntax,
   /* We have succeeded; set the length of the buffer.  */
   bufp->used = b - bufp->buffer;
 
+#ifdef emacs
+  find_required_literal (bufp);
+  bufp->dfa = dfa_compile (bufp);
+#endif
+
 #ifdef DEBUG
   if (debug > 0)
     {
@@ -4265,6 +4288,10 @@ re_search_2 (struct re_pattern_buffer *bufp, const char *str1, size_t size1,
   boolean anchored_start;
   /* Nonzero if we are searching multibyte string.  */
   const boolean multibyte = RE_TARGET_MULTIBYTE_P (bufp);
+#ifdef emacs
+  /* Nonzero if the lazy DFA can tell where matches may start.  */
+  boolean use_dfa;
+#endif
 
   /* Check for out-of-range STARTPOS.  */
   if (startpos < 0 || startpos > total_size)
@@ -4306,6 +4333,30 @@ re_search_2 (struct re_pattern_buffer *bufp, const char *str1, size_t size1,
   /* See whether the pattern is anchored.  */
   anchored_start = (bufp->buffer[0] == begline);
 
+#ifdef emacs
+  use_dfa = (bufp->dfa && stop <= total_size
+	     && startpos <= stop && startpos + range <= stop);
+
+  /* Give up right away if the string that every match contains does
+     not occur between the first place a match can start and STOP.
+     When searching forward for a match that starts with the string,
+     the loop below takes care of that.  */
+  if (bufp->must_size > 0 && !(bufp->must_start && range > 0)
+      && stop <= total_size)
+    {
+      ssize_t from = range < 0 ? startpos + range : startpos;
+
+      regexp_prefilter_scans++;
+      if (search_required_literal (bufp->buffer + bufp->must,
+				   bufp->must_size, string1, size1, string2,
+				   from, stop, range < 0) < 0)
+	{
+	  regexp_prefilter_skips += eabs (range) + 1;
+	  return -1;
+	}
+    }
+#endif
+
 #ifdef emacs
   gl_state.object = re_match_object; /* Used by SYNTAX_TABLE_BYTE_TO_CHAR. */
   {
@@ -4318,6 +4369,48 @@ re_search_2 (struct re_pattern_buffer *bufp, const char *str1, size_t size1,
   /* Loop through the string, looking for a place to start matching.  */
   for (;;)
     {
+#ifdef emacs
+      /* If every match starts with a string, skip to where it
+	 occurs.  */
+      if (bufp->must_start && range > 0 && stop <= total_size)
+	{
+	  ssize_t pos;
+
+	  regexp_prefilter_scans++;
+	  pos = search_required_literal (bufp->buffer + bufp->must,
+					 bufp->must_size, string1, size1,
+					 string2, startpos, stop, false);
+	  if (pos < 0 || pos > startpos + range)
+	    {
+	      regexp_prefilter_skips += range + 1;
+	      return -1;
+	    }
+	  regexp_prefilter_skips += pos - startpos;
+	  range -= pos - startpos;
+	  startpos = pos;
+	}
+
+      /* When searching forward, let the DFA find the first position
+	 where a match can start.  The checks below still apply there,
+	 so that the DFA never makes re_match_2_internal run at a
+	 position that the fastmap would have skipped.  */
+      if (use_dfa && range > 0)
+	{
+	  ssize_t pos = dfa_search (bufp, string1, size1, string2, size2,
+				    startpos, startpos + range, stop);
+
+	  if (pos == -1)
+	    return -1;
+	  if (pos >= 0)
+	    {
+	      range -= pos - startpos;
+	      startpos = pos;
+	    }
+	  else
+	    use_dfa = false;
+	}
+#endif
+
       /* If the pattern is anchored,
 	 skip quickly past places we cannot match.
 	 We don't bother to treat startpos == 0 specially
@@ -4434,6 +4527,20 @@ re_search_2 (struct re_pattern_buffer *bufp, const char *str1, size_t size1,
 	  && !bufp->can_be_null)
 	return -1;
 
+#ifdef emacs
+      /* When searching backward, let the DFA rule out this position
+	 quickly.  */
+      if (use_dfa && range <= 0)
+	{
+	  ssize_t pos = dfa_search (bufp, string1, size1, string2, size2,
+				    startpos, startpos, stop);
+
+	  if (pos == -1)
+	    goto advance;
+	  if (pos == -2)
+	    use_dfa = false;
+	}
+#endif
       val = re_match_2_internal (bufp, string1, size1, string2, size2,
 				 startpos, regs, stop);
 
@@ -4860,198 +4967,1649 @@ mutually_exclusive_p (struct re_pattern_buffer *bufp, const_re_char *p1,
   return 0;
 }
 
-
-/* Matching routines.  */
+/* Return true if C, a character of the target as fetched by
+   RE_STRING_CHAR_AND_LENGTH, matches the charset or charset_not
+   operation at P.  */
+static boolean
+execute_charset (const_re_char *p, unsigned int c, boolean target_multibyte,
+		 RE_TRANSLATE_TYPE translate)
+{
+  boolean not = (re_opcode_t) *p == charset_not;
 
-#ifndef emacs	/* Emacs never uses this.  */
-/* re_match is like re_match_2 except it takes only a single string.  */
+  /* Start of actual range_table, or end of bitmap if there is no
+     range table.  */
+  re_char *range_table IF_LINT (= NULL);
 
-regoff_t
-re_match (struct re_pattern_buffer *bufp, const char *string,
-	  size_t size, ssize_t pos, struct re_registers *regs)
-{
-  regoff_t result = re_match_2_internal (bufp, NULL, 0, (re_char*) string,
-					 size, pos, regs, size);
-  return result;
-}
-WEAK_ALIAS (__re_match, re_match)
-#endif /* not emacs */
+  /* Nonzero if there is a range table.  */
+  int range_table_exists = CHARSET_RANGE_TABLE_EXISTS_P (p);
 
-#ifdef emacs
-/* In Emacs, this is the string or buffer in which we
-   are matching.  It is used for looking up syntax properties.  */
-Lisp_Object re_match_object;
-#endif
+  /* Number of ranges of range table.  This is not included
+     in the initial byte-length of the command.  */
+  int count = 0;
 
-/* re_match_2 matches the compiled pattern in BUFP against the
-   the (virtual) concatenation of STRING1 and STRING2 (of length SIZE1
-   and SIZE2, respectively).  We start matching at POS, and stop
-   matching at STOP.
+  /* Whether matching against a unibyte character.  */
+  boolean unibyte_char = false;
 
-   If REGS is non-null and the `no_sub' field of BUFP is nonzero, we
-   store offsets for the substring each group matched in REGS.  See the
-   documentation for exactly how many groups we fill.
+  if (range_table_exists)
+    {
+      range_table = CHARSET_RANGE_TABLE (p); /* Past the bitmap.  */
+      EXTRACT_NUMBER_AND_INCR (count, range_table);
+    }
 
-   We return -1 if no match, -2 if an internal error (such as the
-   failure stack overflowing).  Otherwise, we return the length of the
-   matched substring.  */
+  if (target_multibyte)
+    {
+      int c1;
 
-regoff_t
-re_match_2 (struct re_pattern_buffer *bufp, const char *string1,
-	    size_t size1, const char *string2, size_t size2, ssize_t pos,
-	    struct re_registers *regs, ssize_t stop)
-{
-  regoff_t result;
+      c = TRANSLATE (c);
+      c1 = RE_CHAR_TO_UNIBYTE (c);
+      if (c1 >= 0)
+	{
+	  unibyte_char = true;
+	  c = c1;
+	}
+    }
+  else
+    {
+      int c1 = RE_CHAR_TO_MULTIBYTE (c);
+
+      if (! CHAR_BYTE8_P (c1))
+	{
+	  c1 = TRANSLATE (c1);
+	  c1 = RE_CHAR_TO_UNIBYTE (c1);
+	  if (c1 >= 0)
+	    {
+	      unibyte_char = true;
+	      c = c1;
+	    }
+	}
+      else
+	unibyte_char = true;
+    }
 
+  if (unibyte_char && c < (1 << BYTEWIDTH))
+    {			/* Lookup bitmap.  */
+      /* Cast to `unsigned' instead of `unsigned char' in
+	 case the bit list is a full 32 bytes long.  */
+      if (c < (unsigned) (CHARSET_BITMAP_SIZE (p) * BYTEWIDTH)
+	  && p[2 + c / BYTEWIDTH] & (1 << (c % BYTEWIDTH)))
+	not = !not;
+    }
 #ifdef emacs
-  ssize_t charpos;
-  gl_state.object = re_match_object; /* Used by SYNTAX_TABLE_BYTE_TO_CHAR. */
-  charpos = SYNTAX_TABLE_BYTE_TO_CHAR (POS_AS_IN_BUFFER (pos));
-  SETUP_SYNTAX_TABLE_FOR_OBJECT (re_match_object, charpos, 1);
-#endif
+  else if (range_table_exists)
+    {
+      int class_bits = CHARSET_RANGE_TABLE_BITS (p);
+
+      if (  (class_bits & BIT_LOWER && ISLOWER (c))
+	  | (class_bits & BIT_MULTIBYTE)
+	  | (class_bits & BIT_PUNCT && ISPUNCT (c))
+	  | (class_bits & BIT_SPACE && ISSPACE (c))
+	  | (class_bits & BIT_UPPER && ISUPPER (c))
+	  | (class_bits & BIT_WORD  && ISWORD (c)))
+	not = !not;
+      else
+	CHARSET_LOOKUP_RANGE_TABLE_RAW (not, c, range_table, count);
+    }
+#endif /* emacs */
 
-  result = re_match_2_internal (bufp, (re_char*) string1, size1,
-				(re_char*) string2, size2,
-				pos, regs, stop);
-  return result;
+  return not;
 }
-WEAK_ALIAS (__re_match_2, re_match_2)
 
+
+#ifdef emacs
 
-/* This is a separate function so that we can force an alloca cleanup
-   afterwards.  */
-static regoff_t
-re_match_2_internal (struct re_pattern_buffer *bufp, const_re_char *string1,
-		     size_t size1, const_re_char *string2, size_t size2,
-		     ssize_t pos, struct re_registers *regs, ssize_t stop)
+/* Required literals.
+
+   Many regexps can only match text that contains some literal string,
+   such as "defun" in "defun\\s-+\\(\\sw+\\)".  `re_search_2' looks
+   for that string first with `memchr' and `memcmp', which is much
+   faster than trying to match at each position.  If the string does
+   not occur where a match could be, the search fails at once; if every
+   match starts with it, the search skips to its next occurrence.
+
+   A character of an `exactn' operation is part of every match unless
+   some forward jump in the pattern skips over it: to take another
+   alternative, to leave out an optional part, or to run a loop zero
+   times.  Only runs of ASCII characters are used, as their bytes are
+   the same in unibyte and multibyte text, and only for patterns
+   without a translate table, since any character of the text might
+   translate to one of them.  */
+
+/* Find the longest run of ASCII characters that every match of the
+   pattern in BUFP contains, and record it in BUFP->must and
+   BUFP->must_size.  Set BUFP->must_start if every match starts with
+   it.  Runs of a single character are left to the fastmap.  */
+static void
+find_required_literal (struct re_pattern_buffer *bufp)
 {
-  /* General temporaries.  */
-  int mcnt;
-  size_t reg;
+  re_char *pattern = bufp->buffer;
+  re_char *pend = pattern + bufp->used;
+  re_char *p;
+  int *skipped;
+  size_t i;
+  boolean at_start = true;
+
+  if (RE_TRANSLATE_P (bufp->translate) || bufp->used == 0)
+    return;
+
+  /* First count, for each offset in the pattern, how many forward
+     jumps skip over it.  */
+  skipped = TALLOC (bufp->used + 1, int);
+  memset (skipped, 0, (bufp->used + 1) * sizeof *skipped);
+  for (p = pattern; p < pend; )
+    switch (*p)
+      {
+      case exactn:
+	p += 2 + p[1];
+	break;
 
-  /* Just past the end of the corresponding string.  */
-  re_char *end1, *end2;
+      case charset:
+      case charset_not:
+	p = skip_one_char (p);
+	break;
 
-  /* Pointers into string1 and string2, just past the last characters in
-     each to consider matching.  */
-  re_char *end_match_1, *end_match_2;
+      case start_memory:
+      case stop_memory:
+      case duplicate:
+      case syntaxspec:
+      case notsyntaxspec:
+      case categoryspec:
+      case notcategoryspec:
+	p += 2;
+	break;
 
-  /* Where we are in the data, and the end of the current string.  */
-  re_char *d, *dend;
+      case succeed:
+	/* The rest of the pattern is skipped.  */
+	skipped[p + 1 - pattern]++;
+	p++;
+	break;
 
-  /* Used sometimes to remember where we were before starting matching
-     an operator so that we can go back in case of failure.  This "atomic"
-     behavior of matching opcodes is indispensable to the correctness
-     of the on_failure_keep_string_jump optimization.  */
-  re_char *dfail;
+      case jump:
+      case on_failure_jump:
+      case on_failure_keep_string_jump:
+      case on_failure_jump_loop:
+      case on_failure_jump_nastyloop:
+      case on_failure_jump_smart:
+      case succeed_n:
+      case jump_n:
+	{
+	  re_char *target = p + 3 + extract_number (p + 1);
 
-  /* Where we are in the pattern, and the end of the pattern.  */
-  re_char *p = bufp->buffer;
-  re_char *pend = p + bufp->used;
+	  if (target > p)
+	    {
+	      skipped[p + 1 - pattern]++;
+	      skipped[min (target, pend) - pattern]--;
+	    }
+	  p += *p == succeed_n || *p == jump_n ? 5 : 3;
+	}
+	break;
 
-  /* We use this to map every character in the string.	*/
-  RE_TRANSLATE_TYPE translate = bufp->translate;
+      case set_number_at:
+	p += 5;
+	break;
 
-  /* Nonzero if BUFP is setup from a multibyte regex.  */
-  const boolean multibyte = RE_MULTIBYTE_P (bufp);
+      default:
+	p++;
+	break;
+      }
+  for (i = 1; i <= bufp->used; i++)
+    skipped[i] += skipped[i - 1];
 
-  /* Nonzero if STRING1/STRING2 are multibyte.  */
-  const boolean target_multibyte = RE_TARGET_MULTIBYTE_P (bufp);
+  /* Then look at the characters that no jump skips.  AT_START says
+     whether nothing before P matches a character or jumps.  */
+  for (p = pattern; p < pend; )
+    switch (*p)
+      {
+      case exactn:
+	{
+	  re_char *q = p + 2, *qend = q + p[1];
 
-  /* Failure point stack.  Each place that can handle a failure further
-     down the line pushes a failure point on this stack.  It consists of
-     regstart, and regend for all registers corresponding to
-     the subexpressions we're currently inside, plus the number of such
-     registers, and, finally, two char *'s.  The first char * is where
-     to resume scanning the pattern; the second one is where to resume
-     scanning the strings.  */
-#ifdef MATCH_MAY_ALLOCATE /* otherwise, this is global.  */
-  fail_stack_type fail_stack;
-#endif
-#ifdef DEBUG_COMPILES_ARGUMENTS
-  unsigned nfailure_points_pushed = 0, nfailure_points_popped = 0;
-#endif
+	  while (skipped[p - pattern] == 0 && q < qend)
+	    {
+	      re_char *run = q;
 
-#if defined REL_ALLOC && defined REGEX_MALLOC
-  /* This holds the pointer to the failure stack, when
-     it is allocated relocatably.  */
-  fail_stack_elt_t *failure_stack_ptr;
-#endif
+	      while (q < qend && ASCII_CHAR_P (*q))
+		q++;
+	      if (q - run > 1 && q - run > bufp->must_size)
+		{
+		  bufp->must = run - pattern;
+		  bufp->must_size = q - run;
+		  bufp->must_start = at_start && run == p + 2;
+		}
+	      /* Skip the non-ASCII character that ends the run.  */
+	      if (q < qend)
+		q += RE_MULTIBYTE_P (bufp) ? BYTES_BY_CHAR_HEAD (*q) : 1;
+	    }
+	  p = qend;
+	  at_start = false;
+	}
+	break;
 
-  /* We fill all the registers internally, independent of what we
-     return, for use in backreferences.  The number here includes
-     an element for register zero.  */
-  size_t num_regs = bufp->re_nsub + 1;
+      case charset:
+      case charset_not:
+	p = skip_one_char (p);
+	at_start = false;
+	break;
 
-  /* Information on the contents of registers. These are pointers into
-     the input strings; they record just what was matched (on this
-     attempt) by a subexpression part of the pattern, that is, the
-     regnum-th regstart pointer points to where in the pattern we began
-     matching and the regnum-th regend points to right after where we
-     stopped matching the regnum-th subexpression.  (The zeroth register
-     keeps track of what the whole pattern matches.)  */
-#ifdef MATCH_MAY_ALLOCATE /* otherwise, these are global.  */
-  re_char **regstart, **regend;
-#endif
+      case start_memory:
+      case stop_memory:
+	p += 2;
+	break;
 
-  /* The following record the register info as found in the above
-     variables when we find a match better than any we've seen before.
-     This happens as we backtrack through the failure points, which in
-     turn happens only if we have not yet matched the entire string. */
-  unsigned best_regs_set = false;
-#ifdef MATCH_MAY_ALLOCATE /* otherwise, these are global.  */
-  re_char **best_regstart, **best_regend;
-#endif
+      case duplicate:
+      case syntaxspec:
+      case notsyntaxspec:
+      case categoryspec:
+      case notcategoryspec:
+	p += 2;
+	at_start = false;
+	break;
 
-  /* Logically, this is `best_regend[0]'.  But we don't want to have to
-     allocate space for that if we're not allocating space for anything
-     else (see below).  Also, we never need info about register 0 for
-     any of the other register vectors, and it seems rather a kludge to
-     treat `best_regend' differently than the rest.  So we keep track of
-     the end of the best match so far in a separate variable.  We
-     initialize this to NULL so that when we backtrack the first time
-     and need to test it, it's not garbage.  */
-  re_char *match_end = NULL;
+      case jump:
+      case on_failure_jump:
+      case on_failure_keep_string_jump:
+      case on_failure_jump_loop:
+      case on_failure_jump_nastyloop:
+      case on_failure_jump_smart:
+	p += 3;
+	at_start = false;
+	break;
 
-#ifdef DEBUG_COMPILES_ARGUMENTS
-  /* Counts the total number of registers pushed.  */
-  unsigned num_regs_pushed = 0;
-#endif
+      case succeed_n:
+      case jump_n:
+      case set_number_at:
+	p += 5;
+	at_start = false;
+	break;
 
-  DEBUG_PRINT ("\n\nEntering re_match_2.\n");
+      case anychar:
+	p++;
+	at_start = false;
+	break;
 
-  REGEX_USE_SAFE_ALLOCA;
+      default:
+	/* The operations that match the empty string.  */
+	p++;
+	break;
+      }
 
-  INIT_FAIL_STACK ();
+  xfree (skipped);
+}
 
-#ifdef MATCH_MAY_ALLOCATE
-  /* Do not bother to initialize all the register variables if there are
-     no groups in the pattern, as it takes a fair amount of time.  If
-     there are groups, we include space for register 0 (the whole
-     pattern), even though we never use it, since it simplifies the
-     array indexing.  We should fix this.  */
-  if (bufp->re_nsub)
-    {
-      regstart = REGEX_TALLOC (num_regs, re_char *);
-      regend = REGEX_TALLOC (num_regs, re_char *);
-      best_regstart = REGEX_TALLOC (num_regs, re_char *);
-      best_regend = REGEX_TALLOC (num_regs, re_char *);
+/* Return true if the SIZE bytes at LITERAL occur at POS in the virtual
+   concatenation of STRING1 and STRING2.  */
+static boolean
+required_literal_at (re_char *literal, size_t size, re_char *string1,
+		     size_t size1, re_char *string2, ssize_t pos)
+{
+  size_t i;
 
-      if (!(regstart && regend && best_regstart && best_regend))
-	{
-	  FREE_VARIABLES ();
-	  return -2;
-	}
-    }
-  else
-    {
-      /* We must initialize all our variables to NULL, so that
-	 `FREE_VARIABLES' doesn't try to free them.  */
-      regstart = regend = best_regstart = best_regend = NULL;
-    }
-#endif /* MATCH_MAY_ALLOCATE */
+  if (pos + size <= size1)
+    return memcmp (string1 + pos, literal, size) == 0;
+  if (pos >= size1)
+    return memcmp (string2 + pos - size1, literal, size) == 0;
+  /* This occurrence would straddle STRING1 and STRING2.  */
+  for (i = 0; i < size; i++)
+    if ((pos + i < size1 ? string1[pos + i]
+	 : string2[pos + i - size1]) != literal[i])
+      return false;
+  return true;
+}
 
-  /* The starting position is bogus.  */
+/* Return the first position at or after FROM in the virtual
+   concatenation of STRING1 and STRING2 where the SIZE bytes at LITERAL
+   occur and end no later than TO, or -1 if there is none.  If
+   BACKWARD, return the last such position instead.  */
+static ssize_t
+search_required_literal (re_char *literal, size_t size,
+			 re_char *string1, size_t size1, re_char *string2,
+			 ssize_t from, ssize_t to, boolean backward)
+{
+  ssize_t last = to - (ssize_t) size;
+  ssize_t pos;
+
+  if (!backward)
+    for (pos = from; pos <= last; pos++)
+      {
+	re_char *base = pos < size1 ? string1 : string2 - size1;
+	ssize_t lim = pos < size1 ? min (last + 1, size1) : last + 1;
+	re_char *d = memchr (base + pos, literal[0], lim - pos);
+
+	if (!d)
+	  pos = lim - 1;
+	else
+	  {
+	    pos = d - base;
+	    if (required_literal_at (literal, size, string1, size1, string2,
+				     pos))
+	      return pos;
+	  }
+      }
+  else
+    for (pos = last; pos >= from; pos--)
+      {
+	re_char *base = pos < size1 ? string1 : string2 - size1;
+	ssize_t lim = pos < size1 ? from : max (from, size1);
+	re_char *d = memrchr (base + lim, literal[0], pos + 1 - lim);
+
+	if (!d)
+	  pos = lim;
+	else
+	  {
+	    pos = d - base;
+	    if (required_literal_at (literal, size, string1, size1, string2,
+				     pos))
+	      return pos;
+	  }
+      }
+  return -1;
+}
+
+
+/* Lazy DFA matching.
+
+   Most regexps have no back-references, and nothing that depends on
+   the syntax table, the category table or point.  For those,
+   `regex_compile' also builds an NFA whose nodes follow the compiled
+   pattern, and `re_search_2' runs it over the text to find where the
+   leftmost match starts, before it calls `re_match_2_internal' there
+   to fill in the registers.  The NFA keeps at most one thread per
+   node, so it takes linear time whatever the pattern.  The sets of
+   threads it goes through are cached as the states of a DFA, together
+   with the transitions between them, so that most characters cost a
+   table lookup.  The cache is flushed when it grows too big.
+
+   The NFA accepts everything that the pattern matches, and maybe more:
+   an interval such as \{2,3\} becomes a plain loop.  So the DFA can
+   report a start where `re_match_2_internal' then fails, in which case
+   `re_search_2' looks again from the next position, but it never
+   misses a match.
+
+   To find the leftmost start, the threads of a state are divided into
+   groups that started at the same position, earliest first.  A thread
+   that reaches a node which an earlier group reached already is
+   dropped, since the earlier group matches wherever it would.  Each
+   transition records which group of the old state each group of the
+   new state continues, so that the search can keep track of where the
+   groups started.  Once a group matches, the groups that started later
+   are dropped, and the search ends when no earlier group is left.  */
+
+/* The kinds of NFA nodes.  */
+enum dfa_node_type
+{
+  DFA_JUMP,			/* Go on to NEXT.  */
+  DFA_SPLIT,			/* Go on to both NEXT and ARG.  */
+  DFA_EXACT,			/* Match the pattern character at ARG.  */
+  DFA_ANYCHAR,			/* Match any character, as `anychar'.  */
+  DFA_CHARSET,			/* Match the charset at ARG.  */
+  DFA_BEGLINE,
+  DFA_ENDLINE,
+  DFA_BEGBUF,
+  DFA_ENDBUF,
+  DFA_MATCH			/* The end of the pattern.  */
+};
+
+struct dfa_node
+{
+  enum dfa_node_type type;
+
+  /* The node that follows this one.  */
+  int next;
+
+  /* The other successor of a DFA_SPLIT node, or the offset in the
+     compiled pattern of the character or charset that a DFA_EXACT or
+     DFA_CHARSET node matches.  */
+  int arg;
+
+  /* For nodes that match a character, the index of their bit in the
+     bit vectors of the character classes.  */
+  int test;
+};
+
+/* The threads of a DFA state, and where they go on each character.  */
+struct dfa_state
+{
+  struct dfa_state *hash_next;
+  unsigned hash;
+
+  /* DFA_RESTART if a new group starts after each character, DFA_BOL
+     if this is the beginning of a line, and DFA_BOB if this is the
+     beginning of the text.  */
+  int flags;
+
+  int ngroups;
+
+  /* The nodes of the threads, group after group, each group in
+     increasing order and followed by -1.  The nodes all match a
+     character, except for DFA_ENDLINE and DFA_ENDBUF nodes, which wait
+     for the next character.  */
+  int nthreads;
+  int *threads;
+
+  /* The transitions computed so far, indexed by character class.  */
+  int nedges;
+  struct dfa_edge *edges;
+};
+
+#define DFA_RESTART 1
+#define DFA_BOL 2
+#define DFA_BOB 4
+
+/* A transition between DFA states.  */
+struct dfa_edge
+{
+  /* The new state, or NULL if not computed yet.  */
+  struct dfa_state *to;
+
+  /* For each group of TO, the group of the old state that it
+     continues, or -1 for the group that starts after the character.
+     NULL if TO has no groups, or only the group that starts after
+     the character.  */
+  int *from;
+
+  /* The group of the old state that matched, -1 if the group that
+     starts after the character matched, or DFA_NO_MATCH.  */
+  int match;
+};
+
+#define DFA_NO_MATCH (-2)
+
+/* Values of LOOKAHEAD for `dfa_closure' other than a character.  */
+#define DFA_UNKNOWN (-1)
+#define DFA_END (-2)
+
+/* The size in bytes that the states and transitions of a DFA can take
+   before the cache is flushed.  */
+#define DFA_CACHE_SIZE (128 * 1024)
+
+#define DFA_TABLE_SIZE 256
+#define DFA_WIDE_CACHE_SIZE 256
+
+/* The maximum number of character classes.  */
+#define DFA_MAX_CLASSES 1024
+
+/* The number of bytes that `dfa_search' scans between quit checks.  */
+#define DFA_QUIT_INTERVAL 0x10000
+
+struct re_dfa
+{
+  int nnodes;
+  struct dfa_node *nodes;
+
+  /* The number of nodes that match a character.  */
+  int ntests;
+
+  /* Whether the pattern uses ^ and \`.  */
+  boolean has_begline, has_begbuf;
+
+  /* Whether a multibyte pattern matches a non-ASCII character
+     literally.  `re_match_2_internal' does not handle that the usual
+     way for unibyte targets, so the DFA does not try.  */
+  boolean multibyte_exact;
+
+  /* Characters are divided into classes that no node tells apart.
+     Each class has a bit vector of WORDS words, which tells the nodes
+     that match its characters, and whether they are newlines.  The
+     classes depend on whether the target is multibyte, as
+     CLASSES_MULTIBYTE says; it is -1 before the first search.  */
+  int classes_multibyte;
+  int nclasses, words;
+  unsigned *class_bits;
+  int byte_class[1 << BYTEWIDTH];
+
+  /* The classes of the last non-ASCII characters seen.  */
+  struct
+  {
+    re_wchar_t c;
+    int class;
+  } wide_class[DFA_WIDE_CACHE_SIZE];
+
+  /* The cache of states, hashed on their threads.  */
+  struct dfa_state *table[DFA_TABLE_SIZE];
+  int nstates;
+  size_t cache_size;
+
+  /* The initial states for each value of the flags, and whether the
+     pattern matches the empty string there.  */
+  struct dfa_state *initial[8];
+  boolean initial_match[8];
+
+  /* The state in which no match is under way, and the bytes that
+     leave it unchanged, which the search skips in a tight loop.  */
+  struct dfa_state *idle;
+  boolean idle_bytes[1 << BYTEWIDTH];
+
+  /* Work space, with room for a thread list or for one element per
+     node.  */
+  int *out, *pending, *stack, *from, *saved;
+  unsigned *mark_old, *mark_new, *bits;
+  unsigned generation;
+  ssize_t *starts, *new_starts;
+};
+
+#define DFA_WORD_BITS (BITS_PER_CHAR * sizeof (unsigned))
+#define DFA_BIT(bits, i) \
+  ((bits)[(i) / DFA_WORD_BITS] >> (i) % DFA_WORD_BITS & 1)
+
+/* Build the NFA of the pattern in BUFP, which `regex_compile' has just
+   compiled.  Return NULL if the pattern needs the backtracking matcher.
+   Since the pattern has not been run yet, the `on_failure_jump_smart'
+   operations in it have not been rewritten, and neither have the
+   counters of the intervals.  */
+static struct re_dfa *
+dfa_compile (struct re_pattern_buffer *bufp)
+{
+  re_char *pattern = bufp->buffer;
+  re_char *pend = pattern + bufp->used;
+  re_char *p;
+  int *node_at;
+  int nnodes = 0, ntests = 0, n;
+  size_t i;
+  boolean has_begline = false, has_begbuf = false, multibyte_exact = false;
+  struct dfa_node *nodes;
+  struct re_dfa *dfa;
+
+  /* First number the nodes, and give up on patterns that depend on
+     more than the text.  */
+  node_at = TALLOC (bufp->used + 1, int);
+  for (i = 0; i <= bufp->used; i++)
+    node_at[i] = -1;
+  for (p = pattern; p < pend; )
+    {
+      node_at[p - pattern] = nnodes;
+      switch (*p)
+	{
+	case exactn:
+	  {
+	    re_char *q = p + 2, *qend = q + p[1];
+
+	    for (; q < qend; nnodes++)
+	      if (RE_MULTIBYTE_P (bufp))
+		{
+		  multibyte_exact |= !ASCII_CHAR_P (*q);
+		  q += BYTES_BY_CHAR_HEAD (*q);
+		}
+	      else
+		q++;
+	    p = qend;
+	  }
+	  break;
+
+	case charset:
+	case charset_not:
+	  if (CHARSET_RANGE_TABLE_EXISTS_P (p)
+	      && CHARSET_RANGE_TABLE_BITS (p) & ~BIT_MULTIBYTE)
+	    goto ineligible;
+	  p = skip_one_char (p);
+	  nnodes++;
+	  break;
+
+	case begline:
+	  has_begline = true;
+	  p++;
+	  nnodes++;
+	  break;
+
+	case begbuf:
+	  has_begbuf = true;
+	  p++;
+	  nnodes++;
+	  break;
+
+	case no_op:
+	case succeed:
+	case anychar:
+	case endline:
+	case endbuf:
+	  p++;
+	  nnodes++;
+	  break;
+
+	case start_memory:
+	case stop_memory:
+	  p += 2;
+	  nnodes++;
+	  break;
+
+	case jump:
+	case on_failure_jump:
+	case on_failure_keep_string_jump:
+	case on_failure_jump_loop:
+	case on_failure_jump_nastyloop:
+	case on_failure_jump_smart:
+	  p += 3;
+	  nnodes++;
+	  break;
+
+	case succeed_n:
+	case jump_n:
+	case set_number_at:
+	  p += 5;
+	  nnodes++;
+	  break;
+
+	default:
+	  goto ineligible;
+	}
+    }
+  node_at[bufp->used] = nnodes++;
+
+  /* Then link them.  Each node but the jumps goes on to the next.  */
+  nodes = TALLOC (nnodes, struct dfa_node);
+  for (p = pattern; p < pend; )
+    {
+      re_opcode_t op = *p;
+      struct dfa_node *node;
+      int target = 0;
+
+      n = node_at[p - pattern];
+      node = &nodes[n];
+      node->next = n + 1;
+      node->arg = 0;
+      node->test = -1;
+
+      switch (op)
+	{
+	case exactn:
+	  {
+	    re_char *q = p + 2, *qend = q + p[1];
+
+	    for (; q < qend; node++, n++)
+	      {
+		node->type = DFA_EXACT;
+		node->next = n + 1;
+		node->arg = q - pattern;
+		node->test = ntests++;
+		q += RE_MULTIBYTE_P (bufp) ? BYTES_BY_CHAR_HEAD (*q) : 1;
+	      }
+	    p = qend;
+	  }
+	  continue;
+
+	case anychar:
+	case charset:
+	case charset_not:
+	  node->type = op == anychar ? DFA_ANYCHAR : DFA_CHARSET;
+	  node->arg = p - pattern;
+	  node->test = ntests++;
+	  p = op == anychar ? p + 1 : skip_one_char (p);
+	  continue;
+
+	case begline:
+	  node->type = DFA_BEGLINE;
+	  p++;
+	  continue;
+
+	case endline:
+	  node->type = DFA_ENDLINE;
+	  p++;
+	  continue;
+
+	case begbuf:
+	  node->type = DFA_BEGBUF;
+	  p++;
+	  continue;
+
+	case endbuf:
+	  node->type = DFA_ENDBUF;
+	  p++;
+	  continue;
+
+	case succeed:
+	  node->type = DFA_MATCH;
+	  p++;
+	  continue;
+
+	case no_op:
+	  node->type = DFA_JUMP;
+	  p++;
+	  continue;
+
+	case start_memory:
+	case stop_memory:
+	  node->type = DFA_JUMP;
+	  p += 2;
+	  continue;
+
+	case set_number_at:
+	  node->type = DFA_JUMP;
+	  p += 5;
+	  continue;
+
+	default:
+	  break;
+	}
+
+      /* The remaining operations jump to P + 3 plus their argument.
+	 Counted repetitions are treated as plain loops.  */
+      target = p + 3 - pattern + extract_number (p + 1);
+      if (target < 0 || target > bufp->used || node_at[target] < 0)
+	{
+	  xfree (nodes);
+	  goto ineligible;
+	}
+      if (op == jump)
+	{
+	  node->type = DFA_JUMP;
+	  node->next = node_at[target];
+	}
+      else
+	{
+	  node->type = DFA_SPLIT;
+	  node->arg = node_at[target];
+	}
+      p += op == succeed_n || op == jump_n ? 5 : 3;
+    }
+  nodes[nnodes - 1].type = DFA_MATCH;
+  nodes[nnodes - 1].next = nodes[nnodes - 1].arg = 0;
+  nodes[nnodes - 1].test = -1;
+  xfree (node_at);
+
+  dfa = xzalloc (sizeof *dfa);
+  dfa->nnodes = nnodes;
+  dfa->nodes = nodes;
+  dfa->ntests = ntests;
+  dfa->has_begline = has_begline;
+  dfa->has_begbuf = has_begbuf;
+  dfa->multibyte_exact = multibyte_exact && RE_MULTIBYTE_P (bufp);
+  dfa->classes_multibyte = -1;
+  dfa->words = ntests / DFA_WORD_BITS + 1;
+  dfa->bits = TALLOC (dfa->words, unsigned);
+  dfa->out = TALLOC (2 * nnodes + 2, int);
+  dfa->saved = TALLOC (2 * nnodes + 2, int);
+  dfa->pending = TALLOC (nnodes, int);
+  dfa->stack = TALLOC (nnodes, int);
+  dfa->from = TALLOC (nnodes + 1, int);
+  dfa->mark_old = xzalloc (nnodes * sizeof *dfa->mark_old);
+  dfa->mark_new = xzalloc (nnodes * sizeof *dfa->mark_new);
+  dfa->starts = TALLOC (nnodes + 1, ssize_t);
+  dfa->new_starts = TALLOC (nnodes + 1, ssize_t);
+  return dfa;
+
+ ineligible:
+  xfree (node_at);
+  return NULL;
+}
+
+/* Free the states of DFA and their transitions.  */
+static void
+dfa_flush (struct re_dfa *dfa)
+{
+  int i, j;
+
+  for (i = 0; i < DFA_TABLE_SIZE; i++)
+    while (dfa->table[i])
+      {
+	struct dfa_state *s = dfa->table[i];
+
+	dfa->table[i] = s->hash_next;
+	for (j = 0; j < s->nedges; j++)
+	  xfree (s->edges[j].from);
+	xfree (s->edges);
+	xfree (s->threads);
+	xfree (s);
+      }
+  dfa->nstates = 0;
+  dfa->cache_size = 0;
+  memset (dfa->initial, 0, sizeof dfa->initial);
+  dfa->idle = NULL;
+}
+
+void
+re_free_dfa (struct re_pattern_buffer *bufp)
+{
+  struct re_dfa *dfa = bufp->dfa;
+
+  if (!dfa)
+    return;
+  dfa_flush (dfa);
+  xfree (dfa->nodes);
+  xfree (dfa->class_bits);
+  xfree (dfa->bits);
+  xfree (dfa->out);
+  xfree (dfa->saved);
+  xfree (dfa->pending);
+  xfree (dfa->stack);
+  xfree (dfa->from);
+  xfree (dfa->mark_old);
+  xfree (dfa->mark_new);
+  xfree (dfa->starts);
+  xfree (dfa->new_starts);
+  xfree (dfa);
+  bufp->dfa = NULL;
+}
+
+/* Return true if the character C of the target matches NODE, which
+   must be a DFA_EXACT, DFA_ANYCHAR or DFA_CHARSET node.  This follows
+   what `re_match_2_internal' does for `exactn', `anychar' and
+   `charset'.  */
+static boolean
+dfa_node_matches (struct re_pattern_buffer *bufp, struct dfa_node *node,
+		  re_wchar_t c, boolean target_multibyte)
+{
+  RE_TRANSLATE_TYPE translate = bufp->translate;
+  re_char *p = bufp->buffer + node->arg;
+
+  switch (node->type)
+    {
+    case DFA_EXACT:
+      if (target_multibyte)
+	return (TRANSLATE (c)
+		== (RE_MULTIBYTE_P (bufp)
+		    ? STRING_CHAR (p) : RE_CHAR_TO_MULTIBYTE (*p)));
+      else
+	{
+	  int pat_ch = (RE_MULTIBYTE_P (bufp)
+			? RE_CHAR_TO_UNIBYTE (STRING_CHAR (p)) : *p);
+	  int buf_ch = RE_CHAR_TO_MULTIBYTE (c);
+
+	  if (! CHAR_BYTE8_P (buf_ch))
+	    {
+	      buf_ch = TRANSLATE (buf_ch);
+	      buf_ch = RE_CHAR_TO_UNIBYTE (buf_ch);
+	      if (buf_ch < 0)
+		buf_ch = c;
+	    }
+	  else
+	    buf_ch = c;
+	  return buf_ch == pat_ch;
+	}
+
+    case DFA_ANYCHAR:
+      c = TRANSLATE (c);
+      return !((!(bufp->syntax & RE_DOT_NEWLINE) && c == '\n')
+	       || ((bufp->syntax & RE_DOT_NOT_NULL) && c == '\000'));
+
+    case DFA_CHARSET:
+      return execute_charset (p, c, target_multibyte, translate);
+
+    default:
+      abort ();
+    }
+}
+
+/* Return the class of the character C, adding a class if needed.
+   Return -1 if there are too many classes.  */
+static int
+dfa_char_class (struct re_pattern_buffer *bufp, struct re_dfa *dfa,
+		re_wchar_t c, boolean target_multibyte)
+{
+  unsigned *bits = dfa->bits;
+  int i, class;
+
+  memset (bits, 0, dfa->words * sizeof *bits);
+  for (i = 0; i < dfa->nnodes; i++)
+    {
+      struct dfa_node *node = &dfa->nodes[i];
+
+      if (node->test >= 0
+	  && dfa_node_matches (bufp, node, c, target_multibyte))
+	bits[node->test / DFA_WORD_BITS] |= 1u << node->test % DFA_WORD_BITS;
+    }
+  if (c == '\n')
+    bits[dfa->ntests / DFA_WORD_BITS] |= 1u << dfa->ntests % DFA_WORD_BITS;
+
+  for (class = 0; class < dfa->nclasses; class++)
+    if (!memcmp (dfa->class_bits + class * dfa->words, bits,
+		 dfa->words * sizeof *bits))
+      return class;
+  if (dfa->nclasses == DFA_MAX_CLASSES)
+    return -1;
+  dfa->class_bits = xrealloc (dfa->class_bits,
+			      ((dfa->nclasses + 1) * dfa->words
+			       * sizeof *dfa->class_bits));
+  memcpy (dfa->class_bits + dfa->nclasses * dfa->words, bits,
+	  dfa->words * sizeof *bits);
+  return dfa->nclasses++;
+}
+
+/* Return the class of the character C, which is not a byte.  */
+static int
+dfa_wide_class (struct re_pattern_buffer *bufp, struct re_dfa *dfa,
+		re_wchar_t c)
+{
+  int i = c % DFA_WIDE_CACHE_SIZE;
+
+  if (dfa->wide_class[i].c != c)
+    {
+      dfa->wide_class[i].class = dfa_char_class (bufp, dfa, c, true);
+      dfa->wide_class[i].c = c;
+    }
+  return dfa->wide_class[i].class;
+}
+
+/* Compute the classes of the bytes, for targets that are multibyte if
+   TARGET_MULTIBYTE.  This discards the states, whose transitions
+   depend on the classes.  */
+static void
+dfa_compute_classes (struct re_pattern_buffer *bufp, struct re_dfa *dfa,
+		     boolean target_multibyte)
+{
+  int c;
+
+  dfa_flush (dfa);
+  dfa->nclasses = 0;
+  for (c = 0; c < DFA_WIDE_CACHE_SIZE; c++)
+    dfa->wide_class[c].c = -1;
+  for (c = 0; c < (1 << BYTEWIDTH); c++)
+    dfa->byte_class[c] = dfa_char_class (bufp, dfa, c, target_multibyte);
+  dfa->classes_multibyte = target_multibyte;
+}
+
+/* Start a new generation of marks, so that no node is marked.  */
+static void
+dfa_next_generation (struct re_dfa *dfa)
+{
+  if (++dfa->generation == 0)
+    {
+      memset (dfa->mark_old, 0, dfa->nnodes * sizeof *dfa->mark_old);
+      memset (dfa->mark_new, 0, dfa->nnodes * sizeof *dfa->mark_new);
+      dfa->generation = 1;
+    }
+}
+
+/* Follow the thread at node N through the nodes that match no
+   character, at a position where the conditions in FLAGS hold.
+   LOOKAHEAD is the first byte of the character at that position,
+   DFA_END at the end of the text, or DFA_UNKNOWN if not known yet.
+   Store the nodes that match a character at *OUT and advance *OUT, as
+   well as the DFA_ENDLINE and DFA_ENDBUF nodes whose fate depends on
+   LOOKAHEAD if it is unknown.  Skip the nodes marked in MARK, and mark
+   those reached.  Return true if the thread reaches the end of the
+   pattern.  */
+static boolean
+dfa_closure (struct re_pattern_buffer *bufp, struct re_dfa *dfa, int n,
+	     int flags, int lookahead, unsigned *mark, int **out)
+{
+  int *stack = dfa->stack, sp = 0;
+  boolean matched = false;
+
+#define DFA_PUSH(n)					\
+  do {							\
+    if (mark[n] != dfa->generation)			\
+      {							\
+	mark[n] = dfa->generation;			\
+	stack[sp++] = (n);				\
+      }							\
+  } while (0)
+
+  DFA_PUSH (n);
+  while (sp > 0)
+    {
+      struct dfa_node *node = &dfa->nodes[stack[--sp]];
+
+      switch (node->type)
+	{
+	case DFA_SPLIT:
+	  DFA_PUSH (node->arg);
+	  /* Fall through.  */
+	case DFA_JUMP:
+	  DFA_PUSH (node->next);
+	  break;
+
+	case DFA_BEGLINE:
+	  if (flags & DFA_BOL)
+	    DFA_PUSH (node->next);
+	  break;
+
+	case DFA_BEGBUF:
+	  if (flags & DFA_BOB)
+	    DFA_PUSH (node->next);
+	  break;
+
+	case DFA_ENDLINE:
+	  if (lookahead == DFA_UNKNOWN)
+	    *(*out)++ = node - dfa->nodes;
+	  else if (lookahead == '\n' || (lookahead == DFA_END && !bufp->not_eol))
+	    DFA_PUSH (node->next);
+	  break;
+
+	case DFA_ENDBUF:
+	  if (lookahead == DFA_UNKNOWN)
+	    *(*out)++ = node - dfa->nodes;
+	  else if (lookahead == DFA_END)
+	    DFA_PUSH (node->next);
+	  break;
+
+	case DFA_MATCH:
+	  matched = true;
+	  break;
+
+	default:
+	  *(*out)++ = node - dfa->nodes;
+	}
+    }
+
+#undef DFA_PUSH
+
+  return matched;
+}
+
+/* Sort the nodes from START to END in increasing order.  */
+static void
+dfa_sort_group (int *start, int *end)
+{
+  int *p, *q;
+
+  for (p = start + 1; p < end; p++)
+    {
+      int n = *p;
+
+      for (q = p; q > start && q[-1] > n; q--)
+	*q = q[-1];
+      *q = n;
+    }
+}
+
+/* Return the state with NTHREADS threads in NGROUPS groups at THREADS,
+   and FLAGS, adding it to the cache of DFA if needed.  Return NULL if
+   the cache is full.  */
+static struct dfa_state *
+dfa_intern (struct re_dfa *dfa, int *threads, int nthreads, int ngroups,
+	    int flags)
+{
+  unsigned hash = flags;
+  struct dfa_state *s;
+  size_t size;
+  int i;
+
+  for (i = 0; i < nthreads; i++)
+    hash = hash * 31 + threads[i];
+  for (s = dfa->table[hash % DFA_TABLE_SIZE]; s; s = s->hash_next)
+    if (s->hash == hash && s->flags == flags && s->nthreads == nthreads
+	&& !memcmp (s->threads, threads, nthreads * sizeof *threads))
+      return s;
+
+  size = sizeof *s + nthreads * sizeof *threads;
+  if (dfa->nstates > 0 && dfa->cache_size + size > DFA_CACHE_SIZE)
+    return NULL;
+  dfa->cache_size += size;
+  dfa->nstates++;
+  s = xzalloc (sizeof *s);
+  s->hash = hash;
+  s->flags = flags;
+  s->ngroups = ngroups;
+  s->nthreads = nthreads;
+  s->threads = TALLOC (nthreads, int);
+  memcpy (s->threads, threads, nthreads * sizeof *threads);
+  s->hash_next = dfa->table[hash % DFA_TABLE_SIZE];
+  dfa->table[hash % DFA_TABLE_SIZE] = s;
+  return s;
+}
+
+/* Return the initial state at a position where the conditions in
+   FLAGS hold, and set *MATCHED to whether the pattern matches the
+   empty string there.  Return NULL if the cache is full.  */
+static struct dfa_state *
+dfa_initial (struct re_pattern_buffer *bufp, struct re_dfa *dfa, int flags,
+	     boolean *matched)
+{
+  if (!dfa->initial[flags])
+    {
+      int *out = dfa->out;
+
+      dfa_next_generation (dfa);
+      dfa->initial_match[flags]
+	= dfa_closure (bufp, dfa, 0, flags, DFA_UNKNOWN, dfa->mark_new, &out);
+      dfa_sort_group (dfa->out, out);
+      if (out > dfa->out)
+	*out++ = -1;
+      dfa->initial[flags] = dfa_intern (dfa, dfa->out, out - dfa->out,
+					out > dfa->out, flags);
+    }
+  *matched = dfa->initial_match[flags];
+  return dfa->initial[flags];
+}
+
+/* Return the transition from state S on characters of class CLASS,
+   computing it if needed.  Return NULL if the cache is full.  */
+static struct dfa_edge *
+dfa_step (struct re_pattern_buffer *bufp, struct re_dfa *dfa,
+	  struct dfa_state *s, int class)
+{
+  unsigned *bits = dfa->class_bits + class * dfa->words;
+  boolean newline = DFA_BIT (bits, dfa->ntests);
+  int lookahead = newline ? '\n' : 0;
+  int flags = dfa->has_begline && newline ? DFA_BOL : 0;
+  int *t = s->threads, *tend = t + s->nthreads;
+  int *out = dfa->out;
+  int g, ngroups = 0, match = DFA_NO_MATCH;
+  struct dfa_state *to;
+  struct dfa_edge *e;
+
+  dfa_next_generation (dfa);
+  for (g = 0; t < tend && match == DFA_NO_MATCH; g++, t++)
+    {
+      int *group = out;
+      boolean matched = false;
+
+      for (; *t >= 0; t++)
+	{
+	  struct dfa_node *node = &dfa->nodes[*t];
+
+	  if (node->test < 0)
+	    {
+	      /* A DFA_ENDLINE or DFA_ENDBUF node.  Now that the next
+		 character is known, follow the thread further at the
+		 old position, and then over the character.  */
+	      int *pending = dfa->pending, *p;
+
+	      matched |= dfa_closure (bufp, dfa, *t, s->flags, lookahead,
+				      dfa->mark_old, &pending);
+	      for (p = dfa->pending; p < pending; p++)
+		if (DFA_BIT (bits, dfa->nodes[*p].test))
+		  matched |= dfa_closure (bufp, dfa, dfa->nodes[*p].next,
+					  flags, DFA_UNKNOWN, dfa->mark_new,
+					  &out);
+	    }
+	  else if (DFA_BIT (bits, node->test))
+	    matched |= dfa_closure (bufp, dfa, node->next, flags, DFA_UNKNOWN,
+				    dfa->mark_new, &out);
+	}
+
+      if (matched)
+	{
+	  /* This group and all later ones are done.  */
+	  match = g;
+	  out = group;
+	}
+      else if (out > group)
+	{
+	  dfa_sort_group (group, out);
+	  *out++ = -1;
+	  dfa->from[ngroups++] = g;
+	}
+    }
+
+  if (match == DFA_NO_MATCH && s->flags & DFA_RESTART)
+    {
+      int *group = out;
+
+      if (dfa_closure (bufp, dfa, 0, flags, DFA_UNKNOWN, dfa->mark_new, &out))
+	{
+	  match = -1;
+	  out = group;
+	}
+      else if (out > group)
+	{
+	  dfa_sort_group (group, out);
+	  *out++ = -1;
+	  dfa->from[ngroups++] = -1;
+	}
+      flags |= match == DFA_NO_MATCH ? DFA_RESTART : 0;
+    }
+
+  to = dfa_intern (dfa, dfa->out, out - dfa->out, ngroups, flags);
+  if (!to)
+    return NULL;
+
+  if (class >= s->nedges)
+    {
+      int nedges = dfa->nclasses;
+      size_t size = (nedges - s->nedges) * sizeof *s->edges;
+
+      if (dfa->cache_size + size > DFA_CACHE_SIZE)
+	return NULL;
+      dfa->cache_size += size;
+      s->edges = xrealloc (s->edges, nedges * sizeof *s->edges);
+      memset (s->edges + s->nedges, 0, size);
+      s->nedges = nedges;
+    }
+  e = &s->edges[class];
+  e->to = to;
+  e->match = match;
+  e->from = NULL;
+  if (ngroups > 1 || (ngroups == 1 && dfa->from[0] >= 0))
+    {
+      e->from = TALLOC (ngroups, int);
+      memcpy (e->from, dfa->from, ngroups * sizeof *e->from);
+      dfa->cache_size += ngroups * sizeof *e->from;
+    }
+  return e;
+}
+
+/* Compute the idle state of DFA, where the search is looking for the
+   start of a match, and the bytes on which it stays there.  Leave the
+   idle state unset if the cache is full.  */
+static void
+dfa_compute_idle (struct re_pattern_buffer *bufp, struct re_dfa *dfa)
+{
+  boolean matched;
+  struct dfa_state *s = dfa_initial (bufp, dfa, DFA_RESTART, &matched);
+  int c;
+
+  if (!s || matched)
+    return;
+  for (c = 0; c < (1 << BYTEWIDTH); c++)
+    {
+      int class = dfa->byte_class[c];
+      struct dfa_edge *e;
+
+      if (dfa->classes_multibyte && !ASCII_CHAR_P (c))
+	dfa->idle_bytes[c] = false;
+      else
+	{
+	  e = (class < s->nedges && s->edges[class].to
+	       ? &s->edges[class] : dfa_step (bufp, dfa, s, class));
+	  if (!e)
+	    return;
+	  dfa->idle_bytes[c] = (e->to == s && !e->from
+				&& e->match == DFA_NO_MATCH);
+	}
+    }
+  dfa->idle = s;
+}
+
+/* Return the state with the threads of S, but from which no new group
+   starts.  Return NULL if the cache is full.  */
+static struct dfa_state *
+dfa_no_restart (struct re_dfa *dfa, struct dfa_state *s)
+{
+  return dfa_intern (dfa, s->threads, s->nthreads, s->ngroups,
+		     s->flags & ~DFA_RESTART);
+}
+
+/* Flush the cache of DFA, but keep the state S, which a search is in.
+   Return the new copy of S.  */
+static struct dfa_state *
+dfa_flush_keeping (struct re_dfa *dfa, struct dfa_state *s)
+{
+  int nthreads = s->nthreads, ngroups = s->ngroups, flags = s->flags;
+
+  memcpy (dfa->saved, s->threads, nthreads * sizeof *s->threads);
+  dfa_flush (dfa);
+  return dfa_intern (dfa, dfa->saved, nthreads, ngroups, flags);
+}
+
+/* Using the DFA of BUFP, look for the first position from STARTPOS to
+   ENDPOS in the virtual concatenation of STRING1 and STRING2 where the
+   pattern may match, without going past STOP.  ENDPOS and STOP must
+   be between STARTPOS and SIZE1 + SIZE2, and ENDPOS must not exceed
+   STOP.  Return the position, -1 if the pattern cannot match, or -2 if
+   the DFA needs too many states and the search should use the
+   backtracking matcher.  */
+static ssize_t
+dfa_search (struct re_pattern_buffer *bufp, re_char *string1, size_t size1,
+	    re_char *string2, size_t size2, ssize_t startpos, ssize_t endpos,
+	    ssize_t stop)
+{
+  struct re_dfa *dfa = bufp->dfa;
+  const boolean multibyte = RE_TARGET_MULTIBYTE_P (bufp);
+  size_t total_size = size1 + size2;
+  ssize_t pos = startpos, best = -1, *starts, *new_starts;
+  ssize_t scanned = 0, quit_count = DFA_QUIT_INTERVAL;
+  re_char *d, *dend;
+  struct dfa_state *s;
+  boolean matched, flushed = false;
+  int flags = 0, g, lookahead;
+  int *t, *tend;
+
+  if (!multibyte && dfa->multibyte_exact)
+    return -2;
+  if (dfa->classes_multibyte != multibyte)
+    dfa_compute_classes (bufp, dfa, multibyte);
+
+  if (endpos > startpos)
+    flags |= DFA_RESTART;
+  if (startpos == 0)
+    {
+      if (dfa->has_begbuf)
+	flags |= DFA_BOB;
+      if (dfa->has_begline && !bufp->not_bol)
+	flags |= DFA_BOL;
+    }
+  else if (dfa->has_begline
+	   && (startpos <= size1 ? string1[startpos - 1]
+	       : string2[startpos - size1 - 1]) == '\n')
+    flags |= DFA_BOL;
+
+  s = dfa_initial (bufp, dfa, flags, &matched);
+  if (!s)
+    {
+      dfa_flush (dfa);
+      s = dfa_initial (bufp, dfa, flags, &matched);
+    }
+  if (matched)
+    return startpos;
+  if (!dfa->idle)
+    {
+      dfa_compute_idle (bufp, dfa);
+      s = dfa_initial (bufp, dfa, flags, &matched);
+      if (!s)
+	{
+	  dfa_flush (dfa);
+	  s = dfa_initial (bufp, dfa, flags, &matched);
+	}
+    }
+
+  starts = dfa->starts;
+  new_starts = dfa->new_starts;
+  starts[0] = startpos;
+
+  if (pos < size1)
+    {
+      d = string1 + pos;
+      dend = string1 + min (stop, size1);
+    }
+  else
+    {
+      d = string2 + pos - size1;
+      dend = string2 + stop - size1;
+    }
+
+  for (;;)
+    {
+      struct dfa_edge *e;
+      int class, len = 1;
+      re_wchar_t c;
+
+      if (s->flags & DFA_RESTART && pos >= endpos)
+	{
+	  struct dfa_state *s1 = dfa_no_restart (dfa, s);
+
+	  if (!s1)
+	    {
+	      s = dfa_flush_keeping (dfa, s);
+	      s1 = dfa_no_restart (dfa, s);
+	      if (!s1)
+		return -2;
+	    }
+	  s = s1;
+	}
+      if (s->ngroups == 0 && !(s->flags & DFA_RESTART))
+	return best;
+
+      if (s == dfa->idle)
+	{
+	  /* Skip the bytes where no match can start.  */
+	  re_char *d0 = d;
+	  re_char *dlim = dend - d < endpos - pos ? dend : d + endpos - pos;
+
+	  while (d < dlim && dfa->idle_bytes[*d])
+	    d++;
+	  if (d > d0)
+	    {
+	      pos += d - d0;
+	      starts[0] = pos;
+	    }
+	}
+
+      if (d == dend)
+	{
+	  if (pos == stop)
+	    break;
+	  /* The end of STRING1.  */
+	  d = string2;
+	  dend = string2 + stop - size1;
+	  continue;
+	}
+
+      c = *d;
+      if (multibyte && !ASCII_CHAR_P (c))
+	c = STRING_CHAR_AND_LENGTH (d, len);
+      class = (c < (1 << BYTEWIDTH) ? dfa->byte_class[c]
+	       : dfa_wide_class (bufp, dfa, c));
+      if (class < 0)
+	return -2;
+
+      if (class < s->nedges && s->edges[class].to)
+	e = &s->edges[class];
+      else
+	{
+	  e = dfa_step (bufp, dfa, s, class);
+	  if (!e)
+	    {
+	      /* The cache is full.  Give up if it was flushed already
+		 during this search, and did not last long enough to pay
+		 for itself.  */
+	      if (flushed && scanned < 10 * dfa->nstates)
+		return -2;
+	      s = dfa_flush_keeping (dfa, s);
+	      flushed = true;
+	      scanned = 0;
+	      continue;
+	    }
+	}
+
+      pos += len;
+      d += len;
+      scanned += len;
+      if (e->match != DFA_NO_MATCH)
+	best = e->match < 0 ? pos : starts[e->match];
+      if (e->from)
+	{
+	  ssize_t *tem;
+
+	  for (g = 0; g < e->to->ngroups; g++)
+	    new_starts[g] = e->from[g] < 0 ? pos : starts[e->from[g]];
+	  tem = starts;
+	  starts = new_starts;
+	  new_starts = tem;
+	}
+      else if (e->to->ngroups > 0)
+	starts[0] = pos;
+      s = e->to;
+
+      if ((quit_count -= len) <= 0)
+	{
+	  quit_count = DFA_QUIT_INTERVAL;
+	  IMMEDIATE_QUIT_CHECK;
+	}
+    }
+
+  /* At STOP, see whether the threads waiting for the end of a line or
+     of the text match.  */
+  lookahead = (stop == total_size ? DFA_END
+	       : *POS_ADDR_VSTRING (stop) == '\n' ? '\n' : 0);
+  dfa_next_generation (dfa);
+  t = s->threads;
+  tend = t + s->nthreads;
+  for (g = 0; t < tend; g++, t++)
+    for (; *t >= 0; t++)
+      {
+	int *pending = dfa->pending;
+
+	if (dfa->nodes[*t].test < 0
+	    && dfa_closure (bufp, dfa, *t, s->flags, lookahead,
+			    dfa->mark_old, &pending))
+	  return starts[g];
+      }
+  return best;
+}
+
+#endif /* emacs */
+
+
+/* Matching routines.  */
+
+#ifndef emacs	/* Emacs never uses this.  */
+/* re_match is like re_match_2 except it takes only a single string.  */
+
+regoff_t
+re_match (struct re_pattern_buffer *bufp, const char *string,
+	  size_t size, ssize_t pos, struct re_registers *regs)
+{
+  regoff_t result = re_match_2_internal (bufp, NULL, 0, (re_char*) string,
+					 size, pos, regs, size);
+  return result;
+}
+WEAK_ALIAS (__re_match, re_match)
+#endif /* not emacs */
+
+#ifdef emacs
+/* In Emacs, this is the string or buffer in which we
+   are matching.  It is used for looking up syntax properties.  */
+Lisp_Object re_match_object;
+#endif
+
+/* re_match_2 matches the compiled pattern in BUFP against the
+   the (virtual) concatenation of STRING1 and STRING2 (of length SIZE1
+   and SIZE2, respectively).  We start matching at POS, and stop
+   matching at STOP.
+
+   If REGS is non-null and the `no_sub' field of BUFP is nonzero, we
+   store offsets for the substring each group matched in REGS.  See the
+   documentation for exactly how many groups we fill.
+
+   We return -1 if no match, -2 if an internal error (such as the
+   failure stack overflowing).  Otherwise, we return the length of the
+   matched substring.  */
+
+regoff_t
+re_match_2 (struct re_pattern_buffer *bufp, const char *string1,
+	    size_t size1, const char *string2, size_t size2, ssize_t pos,
+	    struct re_registers *regs, ssize_t stop)
+{
+  regoff_t result;
+
+#ifdef emacs
+  ssize_t charpos;
+  gl_state.object = re_match_object; /* Used by SYNTAX_TABLE_BYTE_TO_CHAR. */
+  charpos = SYNTAX_TABLE_BYTE_TO_CHAR (POS_AS_IN_BUFFER (pos));
+  SETUP_SYNTAX_TABLE_FOR_OBJECT (re_match_object, charpos, 1);
+#endif
+
+  result = re_match_2_internal (bufp, (re_char*) string1, size1,
+				(re_char*) string2, size2,
+				pos, regs, stop);
+  return result;
+}
+WEAK_ALIAS (__re_match_2, re_match_2)
+
+
+/* This is a separate function so that we can force an alloca cleanup
+   afterwards.  */
+static regoff_t
+re_match_2_internal (struct re_pattern_buffer *bufp, const_re_char *string1,
+		     size_t size1, const_re_char *string2, size_t size2,
+		     ssize_t pos, struct re_registers *regs, ssize_t stop)
+{
+  /* General temporaries.  */
+  int mcnt;
+  size_t reg;
+
+  /* Just past the end of the corresponding string.  */
+  re_char *end1, *end2;
+
+  /* Pointers into string1 and string2, just past the last characters in
+     each to consider matching.  */
+  re_char *end_match_1, *end_match_2;
+
+  /* Where we are in the data, and the end of the current string.  */
+  re_char *d, *dend;
+
+  /* Used sometimes to remember where we were before starting matching
+     an operator so that we can go back in case of failure.  This "atomic"
+     behavior of matching opcodes is indispensable to the correctness
+     of the on_failure_keep_string_jump optimization.  */
+  re_char *dfail;
+
+  /* Where we are in the pattern, and the end of the pattern.  */
+  re_char *p = bufp->buffer;
+  re_char *pend = p + bufp->used;
+
+  /* We use this to map every character in the string.	*/
+  RE_TRANSLATE_TYPE translate = bufp->translate;
+
+  /* Nonzero if BUFP is setup from a multibyte regex.  */
+  const boolean multibyte = RE_MULTIBYTE_P (bufp);
+
+  /* Nonzero if STRING1/STRING2 are multibyte.  */
+  const boolean target_multibyte = RE_TARGET_MULTIBYTE_P (bufp);
+
+  /* Failure point stack.  Each place that can handle a failure further
+     down the line pushes a failure point on this stack.  It consists of
+     regstart, and regend for all registers corresponding to
+     the subexpressions we're currently inside, plus the number of such
+     registers, and, finally, two char *'s.  The first char * is where
+     to resume scanning the pattern; the second one is where to resume
+     scanning the strings.  */
+#ifdef MATCH_MAY_ALLOCATE /* otherwise, this is global.  */
+  fail_stack_type fail_stack;
+#endif
+#ifdef DEBUG_COMPILES_ARGUMENTS
+  unsigned nfailure_points_pushed = 0, nfailure_points_popped = 0;
+#endif
+
+#if defined REL_ALLOC && defined REGEX_MALLOC
+  /* This holds the pointer to the failure stack, when
+     it is allocated relocatably.  */
+  fail_stack_elt_t *failure_stack_ptr;
+#endif
+
+  /* We fill all the registers internally, independent of what we
+     return, for use in backreferences.  The number here includes
+     an element for register zero.  */
+  size_t num_regs = bufp->re_nsub + 1;
+
+  /* Information on the contents of registers. These are pointers into
+     the input strings; they record just what was matched (on this
+     attempt) by a subexpression part of the pattern, that is, the
+     regnum-th regstart pointer points to where in the pattern we began
+     matching and the regnum-th regend points to right after where we
+     stopped matching the regnum-th subexpression.  (The zeroth register
+     keeps track of what the whole pattern matches.)  */
+#ifdef MATCH_MAY_ALLOCATE /* otherwise, these are global.  */
+  re_char **regstart, **regend;
+#endif
+
+  /* The following record the register info as found in the above
+     variables when we find a match better than any we've seen before.
+     This happens as we backtrack through the failure points, which in
+     turn happens only if we have not yet matched the entire string. */
+  unsigned best_regs_set = false;
+#ifdef MATCH_MAY_ALLOCATE /* otherwise, these are global.  */
+  re_char **best_regstart, **best_regend;
+#endif
+
+  /* Logically, this is `best_regend[0]'.  But we don't want to have to
+     allocate space for that if we're not allocating space for anything
+     else (see below).  Also, we never need info about register 0 for
+     any of the other register vectors, and it seems rather a kludge to
+     treat `best_regend' differently than the rest.  So we keep track of
+     the end of the best match so far in a separate variable.  We
+     initialize this to NULL so that when we backtrack the first time
+     and need to test it, it's not garbage.  */
+  re_char *match_end = NULL;
+
+#ifdef DEBUG_COMPILES_ARGUMENTS
+  /* Counts the total number of registers pushed.  */
+  unsigned num_regs_pushed = 0;
+#endif
+
+  DEBUG_PRINT ("\n\nEntering re_match_2.\n");
+
+  REGEX_USE_SAFE_ALLOCA;
+
+  INIT_FAIL_STACK ();
+
+#ifdef MATCH_MAY_ALLOCATE
+  /* Do not bother to initialize all the register variables if there are
+     no groups in the pattern, as it takes a fair amount of time.  If
+     there are groups, we include space for register 0 (the whole
+     pattern), even though we never use it, since it simplifies the
+     array indexing.  We should fix this.  */
+  if (bufp->re_nsub)
+    {
+      regstart = REGEX_TALLOC (num_regs, re_char *);
+      regend = REGEX_TALLOC (num_regs, re_char *);
+      best_regstart = REGEX_TALLOC (num_regs, re_char *);
+      best_regend = REGEX_TALLOC (num_regs, re_char *);
+
+      if (!(regstart && regend && best_regstart && best_regend))
+	{
+	  FREE_VARIABLES ();
+	  return -2;
+	}
+    }
+  else
+    {
+      /* We must initialize all our variables to NULL, so that
+	 `FREE_VARIABLES' doesn't try to free them.  */
+      regstart = regend = best_regstart = best_regend = NULL;
+    }
+#endif /* MATCH_MAY_ALLOCATE */
+
+  /* The starting position is bogus.  */
   if (pos < 0 || pos > size1 + size2)
     {
       FREE_VARIABLES ();
@@ -5435,98 +6993,18 @@ re_match_2_internal (struct re_pattern_buffer *bufp, const_re_char *string1,
 	case charset:
 	case charset_not:
 	  {
-	    register unsigned int c;
-	    boolean not = (re_opcode_t) *(p - 1) == charset_not;
+	    re_wchar_t c;
 	    int len;
 
-	    /* Start of actual range_table, or end of bitmap if there is no
-	       range table.  */
-	    re_char *range_table IF_LINT (= NULL);
-
-	    /* Nonzero if there is a range table.  */
-	    int range_table_exists;
-
-	    /* Number of ranges of range table.  This is not included
-	       in the initial byte-length of the command.  */
-	    int count = 0;
-
-	    /* Whether matching against a unibyte character.  */
-	    boolean unibyte_char = false;
-
-	    DEBUG_PRINT ("EXECUTING charset%s.\n", not ? "_not" : "");
-
-	    range_table_exists = CHARSET_RANGE_TABLE_EXISTS_P (&p[-1]);
-
-	    if (range_table_exists)
-	      {
-		range_table = CHARSET_RANGE_TABLE (&p[-1]); /* Past the bitmap.  */
-		EXTRACT_NUMBER_AND_INCR (count, range_table);
-	      }
+	    DEBUG_PRINT ("EXECUTING charset%s.\n",
+			 (re_opcode_t) *(p - 1) == charset_not ? "_not" : "");
 
 	    PREFETCH ();
 	    c = RE_STRING_CHAR_AND_LENGTH (d, len, target_multibyte);
-	    if (target_multibyte)
-	      {
-		int c1;
-
-		c = TRANSLATE (c);
-		c1 = RE_CHAR_TO_UNIBYTE (c);
-		if (c1 >= 0)
-		  {
-		    unibyte_char = true;
-		    c = c1;
-		  }
-	      }
-	    else
-	      {
-		int c1 = RE_CHAR_TO_MULTIBYTE (c);
-
-		if (! CHAR_BYTE8_P (c1))
-		  {
-		    c1 = TRANSLATE (c1);
-		    c1 = RE_CHAR_TO_UNIBYTE (c1);
-		    if (c1 >= 0)
-		      {
-			unibyte_char = true;
-			c = c1;
-		      }
-		  }
-		else
-		  unibyte_char = true;
-	      }
-
-	    if (unibyte_char && c < (1 << BYTEWIDTH))
-	      {			/* Lookup bitmap.  */
-		/* Cast to `unsigned' instead of `unsigned char' in
-		   case the bit list is a full 32 bytes long.  */
-		if (c < (unsigned) (CHARSET_BITMAP_SIZE (&p[-1]) * BYTEWIDTH)
-		    && p[1 + c / BYTEWIDTH] & (1 << (c % BYTEWIDTH)))
-		  not = !not;
-	      }
-#ifdef emacs
-	    else if (range_table_exists)
-	      {
-		int class_bits = CHARSET_RANGE_TABLE_BITS (&p[-1]);
-
-		if (  (class_bits & BIT_LOWER && ISLOWER (c))
-		    | (class_bits & BIT_MULTIBYTE)
-		    | (class_bits & BIT_PUNCT && ISPUNCT (c))
-		    | (class_bits & BIT_SPACE && ISSPACE (c))
-		    | (class_bits & BIT_UPPER && ISUPPER (c))
-		    | (class_bits & BIT_WORD  && ISWORD (c)))
-		  not = !not;
-		else
-		  CHARSET_LOOKUP_RANGE_TABLE_RAW (not, c, range_table, count);
-	      }
-#endif /* emacs */
-
-	    if (range_table_exists)
-	      p = CHARSET_RANGE_TABLE_END (range_table, count);
-	    else
-	      p += CHARSET_BITMAP_SIZE (&p[-1]) + 1;
-
-	    if (!not) goto fail;
+	    if (!execute_charset (p - 1, c, target_multibyte, translate))
+	      goto fail;
 
+	    p = skip_one_char (p - 1);
 	    d += len;
 	  }
 	  break;
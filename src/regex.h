@@ -408,6 +408,18 @@ struct re_pattern_buffer
 
   /* Charset of unibyte characters at compiling time. */
   int charset_unibyte;
+
+  /* The lazy DFA that `re_search_2' uses to find where a match can
+     start, or NULL if the pattern needs the backtracking matcher.  */
+  struct re_dfa *dfa;
+
+  /* The offset in `buffer' and the size of a string that every match
+     contains, or a MUST_SIZE of zero.  */
+  size_t must;
+  int must_size;
+
+  /* If true, every match starts with that string.  */
+  unsigned must_start : 1;
 #endif
 
 /* [[[end pattern_buffer]]] */
@@ -624,6 +636,11 @@ typedef int re_wchar_t;
 
 extern void re_set_whitespace_regexp (const char *regexp);
 
+# ifdef emacs
+/* Free the lazy DFA of BUFFER, if it has one.  */
+extern void re_free_dfa (struct re_pattern_buffer *__buffer);
+# endif
+
 #endif /* not WIDE_CHAR_SUPPORT */
 
 #endif /* regex.h */
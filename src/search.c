@@ -28,6 +28,7 @@ along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.  */
 #include "syntax.h"
 #include "charset.h"
 #include "region-cache.h"
+#include "line-index.h"
 #include "commands.h"
 #include "blockinput.h"
 #include "intervals.h"
@@ -35,13 +36,19 @@ along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.  */
 #include <sys/types.h>
 #include "regex.h"
 
-#define REGEXP_CACHE_SIZE 20
-
 /* If the regexp is non-nil, then the buffer contains the compiled form
    of that regexp, suitable for searching.  */
 struct regexp_cache
 {
-  struct regexp_cache *next;
+  /* The neighbors of this entry in the list of all entries, which is
+     ordered from the most to the least recently used.  */
+  struct regexp_cache *next, *prev;
+  /* The next entry in the same bucket of searchbuf_table.  */
+  struct regexp_cache *hash_next;
+  /* The hash code of the regexp, see regexp_cache_hash.  */
+  EMACS_UINT hash;
+  /* True if this entry is in searchbuf_table.  */
+  bool hashed;
   Lisp_Object regexp, whitespace_regexp;
   /* Syntax table for which the regexp applies.  We need this because
      of character classes.  If this is t, then the compiled pattern is valid
@@ -53,11 +60,19 @@ struct regexp_cache
   bool posix;
 };
 
-/* The instances of that struct.  */
-static struct regexp_cache searchbufs[REGEXP_CACHE_SIZE];
+/* The head of the linked list; points to the most recently used buffer.
+   The tail is the least recently used one, which is reused first.  */
+static struct regexp_cache *searchbuf_head, *searchbuf_tail;
+
+/* The number of entries in that list.  The list grows until it has
+   `regexp-cache-size' entries.  */
+static EMACS_INT searchbufs_used;
 
-/* The head of the linked list; points to the most recently used buffer.  */
-static struct regexp_cache *searchbuf_head;
+/* Hash table of the entries that hold a compiled regexp, so that
+   compile_pattern need not compare the pattern with every entry.  Its
+   size is a power of 2, at least searchbufs_used.  */
+static struct regexp_cache **searchbuf_table;
+static ptrdiff_t searchbuf_table_size;
 
 
 /* Every call to re_match, etc., must pass &search_regs as the regs
@@ -108,6 +123,27 @@ matcher_overflow (void)
   error ("Stack overflow in regexp matcher");
 }
 
+/* The regexp matcher holds C pointers into the buffer text while it
+   runs, but it can allocate memory for its failure stack, which would
+   let ralloc.c relocate that text.  Bracket the code that matches
+   against buffer text with these two functions.  */
+
+static void
+freeze_buffer_relocation (void)
+{
+#ifdef REL_ALLOC
+  r_alloc_inhibit_buffer_relocation (1);
+#endif
+}
+
+static void
+thaw_buffer_relocation (void)
+{
+#ifdef REL_ALLOC
+  r_alloc_inhibit_buffer_relocation (0);
+#endif
+}
+
 /* Compile a regexp and signal a Lisp error if anything goes wrong.
    PATTERN is the pattern to compile.
    CP is the place to put the result.
@@ -180,6 +216,159 @@ shrink_regexp_cache (void)
     }
 }
 
+/* Mark the Lisp objects in the regexp cache.
+   This is called from garbage collection.  */
+
+void
+mark_regexp_cache (void)
+{
+  struct regexp_cache *cp;
+
+  for (cp = searchbuf_head; cp != 0; cp = cp->next)
+    {
+      mark_object (cp->regexp);
+      mark_object (cp->whitespace_regexp);
+      mark_object (cp->syntax_table);
+    }
+}
+
+/* Return the hash code under which a PATTERN compiled with TRANSLATE
+   and POSIX is found in searchbuf_table.  The syntax table is left
+   out, because a pattern compiled for syntax table t can be used with
+   any.  */
+
+static EMACS_UINT
+regexp_cache_hash (Lisp_Object pattern, Lisp_Object translate, bool posix)
+{
+  EMACS_UINT hash = hash_string (SSDATA (pattern), SBYTES (pattern));
+
+  hash = sxhash_combine (hash, STRING_MULTIBYTE (pattern));
+  hash = sxhash_combine (hash, posix);
+  return sxhash_combine (hash, XHASH (translate));
+}
+
+/* Remove CP from searchbuf_table, if it is there.  */
+
+static void
+regexp_cache_unhash (struct regexp_cache *cp)
+{
+  struct regexp_cache **cpp;
+
+  if (!cp->hashed)
+    return;
+  for (cpp = &searchbuf_table[cp->hash & (searchbuf_table_size - 1)];
+       *cpp != cp; cpp = &(*cpp)->hash_next)
+    eassert (*cpp);
+  *cpp = cp->hash_next;
+  cp->hashed = false;
+}
+
+/* Add CP to searchbuf_table under its hash code.  */
+
+static void
+regexp_cache_rehash (struct regexp_cache *cp)
+{
+  struct regexp_cache **bucket
+    = &searchbuf_table[cp->hash & (searchbuf_table_size - 1)];
+
+  cp->hash_next = *bucket;
+  *bucket = cp;
+  cp->hashed = true;
+}
+
+/* Take CP out of the list of all entries.  */
+
+static void
+regexp_cache_unlink (struct regexp_cache *cp)
+{
+  if (cp->prev)
+    cp->prev->next = cp->next;
+  else
+    searchbuf_head = cp->next;
+  if (cp->next)
+    cp->next->prev = cp->prev;
+  else
+    searchbuf_tail = cp->prev;
+}
+
+/* Put CP at the head of the list of all entries.  */
+
+static void
+regexp_cache_push (struct regexp_cache *cp)
+{
+  cp->prev = 0;
+  cp->next = searchbuf_head;
+  if (searchbuf_head)
+    searchbuf_head->prev = cp;
+  else
+    searchbuf_tail = cp;
+  searchbuf_head = cp;
+}
+
+/* Make searchbuf_table large enough for one more entry.  */
+
+static void
+grow_regexp_cache_table (void)
+{
+  struct regexp_cache *cp;
+  ptrdiff_t size = searchbuf_table_size;
+
+  if (searchbufs_used < size)
+    return;
+  while (size <= searchbufs_used)
+    size *= 2;
+  xfree (searchbuf_table);
+  searchbuf_table = xzalloc (size * sizeof *searchbuf_table);
+  searchbuf_table_size = size;
+  for (cp = searchbuf_head; cp != 0; cp = cp->next)
+    if (cp->hashed)
+      regexp_cache_rehash (cp);
+}
+
+/* Return an entry of the regexp cache to compile a new pattern into.
+   It is not in searchbuf_table.  Create a new entry while the cache
+   is smaller than `regexp-cache-size', and otherwise reuse the least
+   recently used one, first freeing the entries beyond that size.  */
+
+static struct regexp_cache *
+regexp_cache_entry (void)
+{
+  struct regexp_cache *cp;
+  EMACS_INT size = max (1, regexp_cache_size);
+
+  while (searchbufs_used > size)
+    {
+      cp = searchbuf_tail;
+      regexp_cache_unhash (cp);
+      regexp_cache_unlink (cp);
+      re_free_dfa (&cp->buf);
+      xfree (cp->buf.buffer);
+      xfree (cp);
+      searchbufs_used--;
+    }
+
+  if (searchbufs_used < size)
+    {
+      grow_regexp_cache_table ();
+      cp = xzalloc (sizeof *cp);
+      cp->buf.allocated = 100;
+      cp->buf.buffer = xmalloc (100);
+      cp->buf.fastmap = cp->fastmap;
+      cp->regexp = Qnil;
+      cp->whitespace_regexp = Qnil;
+      cp->syntax_table = Qnil;
+      regexp_cache_push (cp);
+      searchbufs_used++;
+    }
+  else
+    {
+      cp = searchbuf_tail;
+      regexp_cache_unhash (cp);
+    }
+
+  return cp;
+}
+
 /* Clear the regexp cache w.r.t. a particular syntax table,
    because it was changed.
    There is no danger of memory leak here because re_compile_pattern
@@ -188,14 +377,17 @@ shrink_regexp_cache (void)
 void
 clear_regexp_cache (void)
 {
-  int i;
+  struct regexp_cache *cp;
 
-  for (i = 0; i < REGEXP_CACHE_SIZE; ++i)
+  for (cp = searchbuf_head; cp != 0; cp = cp->next)
     /* It's tempting to compare with the syntax-table we've actually changed,
        but it's not sufficient because char-table inheritance means that
        modifying one syntax-table can change others at the same time.  */
-    if (!EQ (searchbufs[i].syntax_table, Qt))
-      searchbufs[i].regexp = Qnil;
+    if (!EQ (cp->syntax_table, Qt))
+      {
+	regexp_cache_unhash (cp);
+	cp->regexp = Qnil;
+      }
 }
 
 /* Compile a regexp if necessary, but first check to see if there's one in
@@ -213,46 +405,45 @@ struct re_pattern_buffer *
 compile_pattern (Lisp_Object pattern, struct re_registers *regp,
 		 Lisp_Object translate, bool posix, bool multibyte)
 {
-  struct regexp_cache *cp, **cpp;
-
-  for (cpp = &searchbuf_head; ; cpp = &cp->next)
+  struct regexp_cache *cp;
+  EMACS_UINT hash;
+
+  if (NILP (translate))
+    translate = make_number (0);
+  hash = regexp_cache_hash (pattern, translate, posix);
+
+  /* Only entries holding a valid pattern are in searchbuf_table, so
+     cp->regexp is a string here.  */
+  for (cp = searchbuf_table[hash & (searchbuf_table_size - 1)];
+       cp != 0; cp = cp->hash_next)
+    if (cp->hash == hash
+	&& SCHARS (cp->regexp) == SCHARS (pattern)
+	&& STRING_MULTIBYTE (cp->regexp) == STRING_MULTIBYTE (pattern)
+	&& !NILP (Fstring_equal (cp->regexp, pattern))
+	&& EQ (cp->buf.translate, translate)
+	&& cp->posix == posix
+	&& (EQ (cp->syntax_table, Qt)
+	    || EQ (cp->syntax_table, BVAR (current_buffer, syntax_table)))
+	&& !NILP (Fequal (cp->whitespace_regexp, Vsearch_spaces_regexp))
+	&& cp->buf.charset_unibyte == charset_unibyte)
+      break;
+
+  if (cp)
+    regexp_cache_hits++;
+  else
     {
-      cp = *cpp;
-      /* Entries are initialized to nil, and may be set to nil by
-	 compile_pattern_1 if the pattern isn't valid.  Don't apply
-	 string accessors in those cases.  However, compile_pattern_1
-	 is only applied to the cache entry we pick here to reuse.  So
-	 nil should never appear before a non-nil entry.  */
-      if (NILP (cp->regexp))
-	goto compile_it;
-      if (SCHARS (cp->regexp) == SCHARS (pattern)
-	  && STRING_MULTIBYTE (cp->regexp) == STRING_MULTIBYTE (pattern)
-	  && !NILP (Fstring_equal (cp->regexp, pattern))
-	  && EQ (cp->buf.translate, (! NILP (translate) ? translate : make_number (0)))
-	  && cp->posix == posix
-	  && (EQ (cp->syntax_table, Qt)
-	      || EQ (cp->syntax_table, BVAR (current_buffer, syntax_table)))
-	  && !NILP (Fequal (cp->whitespace_regexp, Vsearch_spaces_regexp))
-	  && cp->buf.charset_unibyte == charset_unibyte)
-	break;
-
-      /* If we're at the end of the cache, compile into the nil cell
-	 we found, or the last (least recently used) cell with a
-	 string value.  */
-      if (cp->next == 0)
-	{
-	compile_it:
-	  compile_pattern_1 (cp, pattern, translate, posix);
-	  break;
-	}
+      regexp_cache_misses++;
+      cp = regexp_cache_entry ();
+      compile_pattern_1 (cp, pattern, translate, posix);
+      cp->hash = hash;
+      regexp_cache_rehash (cp);
     }
 
-  /* When we get here, cp (aka *cpp) contains the compiled pattern,
+  /* When we get here, cp contains the compiled pattern,
      either because we found it in the cache or because we just compiled it.
      Move it to the front of the queue to mark it as most recently used.  */
-  *cpp = cp->next;
-  cp->next = searchbuf_head;
-  searchbuf_head = cp;
+  regexp_cache_unlink (cp);
+  regexp_cache_push (cp);
 
   /* Advise the searching functions about the space we have allocated
      for register data.  */
@@ -266,7 +457,7 @@ compile_pattern (Lisp_Object pattern, struct re_registers *regp,
   return &cp->buf;
 }
 
-
+
 static Lisp_Object
 looking_at_1 (Lisp_Object string, bool posix)
 {
@@ -316,11 +507,13 @@ looking_at_1 (Lisp_Object string, bool posix)
 
   re_match_object = Qnil;
 
+  freeze_buffer_relocation ();
   i = re_match_2 (bufp, (char *) p1, s1, (char *) p2, s2,
 		  PT_BYTE - BEGV_BYTE,
 		  (NILP (Vinhibit_changing_match_data)
 		   ? &search_regs : NULL),
 		  ZV_BYTE - BEGV_BYTE);
+  thaw_buffer_relocation ();
   immediate_quit = 0;
 
   if (i == -2)
@@ -588,8 +781,10 @@ fast_looking_at (Lisp_Object regexp, ptrdiff_t pos, ptrdiff_t pos_byte,
 
   buf = compile_pattern (regexp, 0, Qnil, 0, multibyte);
   immediate_quit = 1;
+  freeze_buffer_relocation ();
   len = re_match_2 (buf, (char *) p1, s1, (char *) p2, s2,
 		    pos_byte, NULL, limit_byte);
+  thaw_buffer_relocation ();
   immediate_quit = 0;
 
   return len;
@@ -694,6 +889,22 @@ find_newline (ptrdiff_t start, ptrdiff_t start_byte, ptrdiff_t end,
   if (end_byte == -1)
     end_byte = CHAR_TO_BYTE (end);
 
+  /* Ask the line index where the COUNTth newline is, if it might be
+     far away.  */
+  if (line_index_useful_p (start, end, count))
+    {
+      ptrdiff_t pos_byte, n;
+
+      if (start_byte == -1)
+	start_byte = CHAR_TO_BYTE (start);
+      pos_byte = line_index_find_newline (start_byte, end_byte, count, &n);
+      if (shortage)
+	*shortage = n;
+      if (bytepos)
+	*bytepos = pos_byte;
+      return n ? end : BYTE_TO_CHAR (pos_byte);
+    }
+
   newline_cache = newline_cache_on_off (current_buffer);
   if (current_buffer->base_buffer)
     cache_buffer = current_buffer->base_buffer;
@@ -1196,6 +1407,7 @@ search_buffer (Lisp_Object string, ptrdiff_t pos, ptrdiff_t pos_byte,
 				   can take too long. */
       QUIT;			/* Do a pending quit right away,
 				   to avoid paradoxical behavior */
+      freeze_buffer_relocation ();
       /* Get pointers and sizes of the two strings
 	 that make up the visible portion of the buffer. */
 
@@ -1228,6 +1440,7 @@ search_buffer (Lisp_Object string, ptrdiff_t pos, ptrdiff_t pos_byte,
 			     pos_byte - BEGV_BYTE);
 	  if (val == -2)
 	    {
+	      thaw_buffer_relocation ();
 	      matcher_overflow ();
 	    }
 	  if (val >= 0)
@@ -1256,6 +1469,7 @@ search_buffer (Lisp_Object string, ptrdiff_t pos, ptrdiff_t pos_byte,
 	    }
 	  else
 	    {
+	      thaw_buffer_relocation ();
 	      immediate_quit = 0;
 	      return (n);
 	    }
@@ -1272,6 +1486,7 @@ search_buffer (Lisp_Object string, ptrdiff_t pos, ptrdiff_t pos_byte,
 			     lim_byte - BEGV_BYTE);
 	  if (val == -2)
 	    {
+	      thaw_buffer_relocation ();
 	      matcher_overflow ();
 	    }
 	  if (val >= 0)
@@ -1298,11 +1513,13 @@ search_buffer (Lisp_Object string, ptrdiff_t pos, ptrdiff_t pos_byte,
 	    }
 	  else
 	    {
+	      thaw_buffer_relocation ();
 	      immediate_quit = 0;
 	      return (0 - n);
 	    }
 	  n--;
 	}
+      thaw_buffer_relocation ();
       immediate_quit = 0;
       return (pos);
     }
@@ -3294,22 +3511,8 @@ the buffer.  If the buffer doesn't have a cache, the value is nil.  */)
 void
 syms_of_search (void)
 {
-  register int i;
-
-  for (i = 0; i < REGEXP_CACHE_SIZE; ++i)
-    {
-      searchbufs[i].buf.allocated = 100;
-      searchbufs[i].buf.buffer = xmalloc (100);
-      searchbufs[i].buf.fastmap = searchbufs[i].fastmap;
-      searchbufs[i].regexp = Qnil;
-      searchbufs[i].whitespace_regexp = Qnil;
-      searchbufs[i].syntax_table = Qnil;
-      staticpro (&searchbufs[i].regexp);
-      staticpro (&searchbufs[i].whitespace_regexp);
-      staticpro (&searchbufs[i].syntax_table);
-      searchbufs[i].next = (i == REGEXP_CACHE_SIZE-1 ? 0 : &searchbufs[i+1]);
-    }
-  searchbuf_head = &searchbufs[0];
+  searchbuf_table_size = 32;
+  searchbuf_table = xzalloc (searchbuf_table_size * sizeof *searchbuf_table);
 
   DEFSYM (Qsearch_failed, "search-failed");
   DEFSYM (Qinvalid_regexp, "invalid-regexp");
@@ -3346,6 +3549,43 @@ do not set the match data.  The proper way to use this variable
 is to bind it with `let' around a small expression.  */);
   Vinhibit_changing_match_data = Qnil;
 
+  DEFVAR_INT ("regexp-cache-size", regexp_cache_size,
+	      doc: /* Maximum number of compiled regexps to keep.
+The searching and matching functions keep the regexps they compiled
+most recently, and reuse them when asked to search for the same regexp
+in the same way again.  When there are more than this many, the least
+recently used regexps are discarded.  See also `regexp-cache-hits'.  */);
+  regexp_cache_size = 100;
+
+  DEFVAR_INT ("regexp-cache-hits", regexp_cache_hits,
+	      doc: /* Number of regexps found already compiled.
+This counts the searches and matches whose regexp was found in the
+cache of compiled regexps, see `regexp-cache-size'.  See also
+`regexp-cache-misses'.  */);
+  regexp_cache_hits = 0;
+
+  DEFVAR_INT ("regexp-cache-misses", regexp_cache_misses,
+	      doc: /* Number of regexps that had to be compiled.
+This counts the searches and matches whose regexp was not found in the
+cache of compiled regexps, see `regexp-cache-size'.  See also
+`regexp-cache-hits'.  */);
+  regexp_cache_misses = 0;
+
+  DEFVAR_INT ("regexp-prefilter-scans", regexp_prefilter_scans,
+	      doc: /* Number of times a search looked for a required string.
+When every match of a regexp contains some literal string, a search
+for it first looks for that string, and fails right away if it does
+not occur.  If every match starts with the string, the search skips
+to where it occurs.  This counts those scans of the text.  See also
+`regexp-prefilter-skips'.  */);
+  regexp_prefilter_scans = 0;
+
+  DEFVAR_INT ("regexp-prefilter-skips", regexp_prefilter_skips,
+	      doc: /* Number of places ruled out by required strings.
+This counts the positions where a search did not have to try to match
+its regexp, because of the scans counted by `regexp-prefilter-scans'.  */);
+  regexp_prefilter_skips = 0;
+
   defsubr (&Slooking_at);
   defsubr (&Sposix_looking_at);
   defsubr (&Sstring_match);
@@ -213,6 +213,10 @@ enum event_kind
 
   , CONFIG_CHANGED_EVENT
 
+  /* A background worker job has finished; see worker.c.
+     .arg is a one-element list of the id of the job.  */
+  , WORKER_EVENT
+
 #ifdef HAVE_NTGUI
   /* Generated when an APPCOMMAND event is received, in response to
      Multimedia or Internet buttons on some keyboards.
@@ -6191,7 +6191,7 @@ the return value is nil.  Otherwise the value is t.  */)
 
       /* Don't do this within the main loop below: This may call Lisp
 	 code and is thus potentially unsafe while input is blocked.  */
-      for (k = 0; k < saved_windows->header.size; k++)
+      for (k = 0; k < ASIZE (data->saved_windows); k++)
 	{
 	  p = SAVED_WINDOW_N (saved_windows, k);
 	  window = p->window;
@@ -6245,7 +6245,7 @@ the return value is nil.  Otherwise the value is t.  */)
 	 dead.  */
       delete_all_child_windows (FRAME_ROOT_WINDOW (f));
 
-      for (k = 0; k < saved_windows->header.size; k++)
+      for (k = 0; k < ASIZE (data->saved_windows); k++)
 	{
 	  p = SAVED_WINDOW_N (saved_windows, k);
 	  window = p->window;
@@ -7196,10 +7196,10 @@ compare_window_configurations (Lisp_Object configuration1,
 	      || !EQ (d1->minibuf_selected_window, d2->minibuf_selected_window)))
       || !EQ (d1->focus_frame, d2->focus_frame)
       /* Verify that the two configurations have the same number of windows.  */
-      || sws1->header.size != sws2->header.size)
+      || ASIZE (d1->saved_windows) != ASIZE (d2->saved_windows))
     return 0;
 
-  for (i = 0; i < sws1->header.size; i++)
+  for (i = 0; i < ASIZE (d1->saved_windows); i++)
     {
       struct saved_window *sw1, *sw2;
 
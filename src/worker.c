@@ -0,0 +1,1195 @@
+/* Background worker threads for pure C work.
+
+Copyright (C) 2014 Free Software Foundation, Inc.
+
+This file is part of GNU Emacs.
+
+GNU Emacs is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+GNU Emacs is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.  */
+
+/* A worker job hashes or searches a copy of some text, or reads and
+   decodes a file, on a thread of its own while Emacs goes on with its
+   work.  The main thread makes the copy, and turns the outcome into
+   Lisp objects when the job is done; the worker threads never touch a
+   Lisp object and never call into the Lisp machinery, not even to
+   allocate memory, since none of it is safe to use from two threads.
+   A worker that finishes a job writes a byte to a pipe; the main
+   thread notices it in wait_reading_process_output, and puts a
+   `worker-event' for the job in the input queue, as inotify.c does
+   for file notifications.  `worker-handle-event' then runs the
+   callback of the job.
+
+   Without threads, a job runs to completion as soon as it is
+   started, and its event is queued right away.  */
+
+#include <config.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+#include "lisp.h"
+#include "character.h"
+#include "buffer.h"
+#include "coding.h"
+#include "process.h"
+#include "keyboard.h"
+#include "frame.h" /* Required for termhooks.h.  */
+#include "termhooks.h"
+#include "systime.h"
+
+#include "md5.h"
+#include "sha1.h"
+#include "sha256.h"
+#include "sha512.h"
+
+static Lisp_Object Qmd5, Qsha1, Qsha224, Qsha256, Qsha384, Qsha512;
+static Lisp_Object Qrunning, Qdone, Qfailed, Qcancelled;
+
+/* The maximum number of worker threads.  They are started as jobs
+   need them, and then wait for more work until Emacs exits.  */
+enum { WORKER_MAX_THREADS = 4 };
+
+/* Workers check whether their job has been cancelled after each chunk
+   of this many bytes.  */
+enum { WORKER_CHUNK = 1024 * 1024 };
+
+enum worker_op
+  {
+    WORKER_HASH,
+    WORKER_COUNT,
+    WORKER_DECODE
+  };
+
+enum worker_state
+  {
+    WORKER_QUEUED,
+    WORKER_RUNNING,
+    WORKER_DONE,
+    WORKER_FAILED,
+    WORKER_CANCELLED
+  };
+
+struct worker_job
+{
+  /* The next job in worker_queue, and the next job in worker_jobs.  */
+  struct worker_job *next_queued, *next;
+
+  EMACS_INT id;
+  enum worker_op op;
+
+  /* These are protected by worker_mutex once the job is started.  */
+  enum worker_state state;
+  bool cancel;
+  /* Whether the main thread has queued the event for the job.  */
+  bool announced;
+
+  /* The input of the job: a copy of the text to hash or search, or
+     once a WORKER_DECODE job is done, the contents of the file.  All
+     memory the job owns comes from malloc.  */
+  unsigned char *data;
+  ptrdiff_t size;
+
+  /* WORKER_HASH: the algorithm, as an index into hash_algorithms, and
+     whether DATA is multibyte text, to be encoded in UTF-8.  */
+  int algorithm;
+  bool multibyte;
+
+  /* WORKER_COUNT: the string to look for, in the same representation
+     as DATA.  */
+  unsigned char *needle;
+  ptrdiff_t needle_size;
+
+  /* WORKER_DECODE: the encoded name of the file, and how to decode it.
+     If UTF_8 is false, the main thread decodes the file when the job
+     is done.  BOM says whether to strip a UTF-8 signature.  */
+  char *file;
+  bool utf_8, bom;
+
+  /* The results.  ERRNO_VALUE is the errno of a failed job.  */
+  int errno_value;
+  EMACS_INT count;
+  unsigned char digest[SHA512_DIGEST_SIZE];
+  /* WORKER_DECODE: whether the worker decoded DATA, how many
+     characters it holds, and whether it has a newline.  */
+  bool decoded, newline;
+  ptrdiff_t nchars;
+};
+
+/* All jobs whose results have not been collected by the main thread,
+   newest first.  Only the main thread uses this list.  */
+static struct worker_job *worker_jobs;
+
+/* The jobs waiting for a worker, oldest first.  */
+static struct worker_job *worker_queue, *worker_queue_tail;
+
+/* The number of the next job.  */
+static EMACS_INT worker_next_id;
+
+/* An alist of the Lisp side of each job: (ID . RECORD).  RECORD is a
+   vector whose slots are described by enum worker_slot.  */
+static Lisp_Object worker_records;
+
+enum worker_slot
+  {
+    /* The function to call when the job is finished.  */
+    WORKER_CALLBACK,
+    /* nil while the job runs; then `done', `failed' or `cancelled'.  */
+    WORKER_STATUS,
+    /* The result of a job that is done.  */
+    WORKER_RESULT,
+    /* The error of a failed job, as (ERROR-SYMBOL . DATA).  */
+    WORKER_ERROR,
+    /* The file and coding system of a WORKER_DECODE job.  */
+    WORKER_FILE,
+    WORKER_CODING_SYSTEM,
+    WORKER_SLOTS
+  };
+
+static struct
+{
+  Lisp_Object *name;
+  int size;
+} const hash_algorithms[] =
+  {
+    { &Qmd5, MD5_DIGEST_SIZE },
+    { &Qsha1, SHA1_DIGEST_SIZE },
+    { &Qsha224, SHA224_DIGEST_SIZE },
+    { &Qsha256, SHA256_DIGEST_SIZE },
+    { &Qsha384, SHA384_DIGEST_SIZE },
+    { &Qsha512, SHA512_DIGEST_SIZE }
+  };
+
+
+/* The work itself.  Nothing here may use Lisp objects or anything
+   else that belongs to the main thread.  */
+
+/* Return true if JOB has been cancelled.  */
+static bool worker_cancelled_p (struct worker_job *job);
+
+/* Put the event that says JOB has finished in the input queue.  */
+
+static void
+worker_store_event (struct worker_job *job)
+{
+  struct input_event event;
+
+  job->announced = true;
+  EVENT_INIT (event);
+  event.kind = WORKER_EVENT;
+  event.frame_or_window = Qnil;
+  event.arg = list1 (make_number (job->id));
+  kbd_buffer_store_event (&event);
+}
+
+/* Hash the text of JOB into its digest.  */
+
+static bool
+worker_hash (struct worker_job *job)
+{
+  union
+  {
+    struct md5_ctx md5;
+    struct sha1_ctx sha1;
+    struct sha256_ctx sha256;
+    struct sha512_ctx sha512;
+  } ctx;
+  unsigned char *data = job->data;
+  ptrdiff_t i, size = job->size;
+
+  if (job->multibyte)
+    {
+      /* Encode the text in UTF-8, which only means turning the two
+	 bytes that represent each raw byte into that byte.  */
+      unsigned char *to = data;
+      for (i = 0; i < job->size; i++)
+	if (CHAR_BYTE8_HEAD_P (data[i]) && i + 1 < job->size)
+	  {
+	    *to++ = ((data[i] & 1) << 6) | (data[i + 1] & 0x3F) | 0x80;
+	    i++;
+	  }
+	else
+	  *to++ = data[i];
+      size = to - data;
+    }
+
+  switch (job->algorithm)
+    {
+    case 0: md5_init_ctx (&ctx.md5); break;
+    case 1: sha1_init_ctx (&ctx.sha1); break;
+    case 2: sha224_init_ctx (&ctx.sha256); break;
+    case 3: sha256_init_ctx (&ctx.sha256); break;
+    case 4: sha384_init_ctx (&ctx.sha512); break;
+    default: sha512_init_ctx (&ctx.sha512); break;
+    }
+
+  for (i = 0; i < size; i += WORKER_CHUNK)
+    {
+      unsigned char *p = data + i;
+      size_t len = min (size - i, WORKER_CHUNK);
+      if (worker_cancelled_p (job))
+	return false;
+      switch (job->algorithm)
+	{
+	case 0: md5_process_bytes (p, len, &ctx.md5); break;
+	case 1: sha1_process_bytes (p, len, &ctx.sha1); break;
+	case 2: case 3: sha256_process_bytes (p, len, &ctx.sha256); break;
+	default: sha512_process_bytes (p, len, &ctx.sha512); break;
+	}
+    }
+
+  switch (job->algorithm)
+    {
+    case 0: md5_finish_ctx (&ctx.md5, job->digest); break;
+    case 1: sha1_finish_ctx (&ctx.sha1, job->digest); break;
+    case 2: sha224_finish_ctx (&ctx.sha256, job->digest); break;
+    case 3: sha256_finish_ctx (&ctx.sha256, job->digest); break;
+    case 4: sha384_finish_ctx (&ctx.sha512, job->digest); break;
+    default: sha512_finish_ctx (&ctx.sha512, job->digest); break;
+    }
+  return true;
+}
+
+/* Count the occurrences of the needle of JOB in its text that do not
+   overlap.  Since multibyte text is self-synchronizing, a match of a
+   multibyte needle always starts at a character boundary.  */
+
+static bool
+worker_count (struct worker_job *job)
+{
+  unsigned char *p = job->data, *end = job->data + job->size;
+  unsigned char first = job->needle[0];
+  ptrdiff_t check = WORKER_CHUNK;
+  EMACS_INT count = 0;
+
+  while (end - p >= job->needle_size)
+    {
+      p = memchr (p, first, end - p - job->needle_size + 1);
+      if (!p)
+	break;
+      if (memcmp (p, job->needle, job->needle_size) == 0)
+	{
+	  count++;
+	  p += job->needle_size;
+	}
+      else
+	p++;
+      if (check <= p - job->data)
+	{
+	  if (worker_cancelled_p (job))
+	    return false;
+	  check = p - job->data + WORKER_CHUNK;
+	}
+    }
+  job->count = count;
+  return true;
+}
+
+/* Decode the SIZE bytes of UTF-8 at SRC into the internal
+   representation of multibyte text at DST, the way
+   decode_coding_utf_8 does.  If BOM, skip a UTF-8 signature at the
+   start.  If DST is null, just measure.  Store the number of
+   characters in *NCHARS, and return the number of bytes.  */
+
+static ptrdiff_t
+worker_decode_utf_8 (unsigned char const *src, ptrdiff_t size, bool bom,
+		     unsigned char *dst, ptrdiff_t *nchars)
+{
+  unsigned char const *p = src, *end = src + size;
+  ptrdiff_t nbytes = 0, chars = 0;
+
+  if (bom && size >= 3 && p[0] == 0xEF && p[1] == 0xBB && p[2] == 0xBF)
+    p += 3;
+
+  while (p < end)
+    {
+      int c1 = *p, len, i, c;
+
+      if (c1 < 0x80)
+	{
+	  /* Copy a run of ASCII in one go.  */
+	  unsigned char const *q = p + 1;
+	  while (q < end && *q < 0x80)
+	    q++;
+	  if (dst)
+	    memcpy (dst + nbytes, p, q - p);
+	  nbytes += q - p;
+	  chars += q - p;
+	  p = q;
+	  continue;
+	}
+
+      len = ((c1 & 0xE0) == 0xC0 ? 2 : (c1 & 0xF0) == 0xE0 ? 3
+	     : (c1 & 0xF8) == 0xF0 ? 4 : (c1 & 0xFC) == 0xF8 ? 5 : 0);
+      c = c1 & (0x7F >> len);
+      if (len == 0 || end - p < len)
+	goto invalid;
+      for (i = 1; i < len; i++)
+	{
+	  if ((p[i] & 0xC0) != 0x80)
+	    goto invalid;
+	  c = (c << 6) | (p[i] & 0x3F);
+	}
+      /* Reject overlong sequences and surrogates.  */
+      if ((len == 2 && c < 0x80)
+	  || (len == 3 && (c < 0x800 || (0xD800 <= c && c < 0xE000)))
+	  || (len == 4 && c < 0x10000)
+	  || (len == 5 && (c < 0x200000 || MAX_CHAR < c)))
+	goto invalid;
+
+      if (MAX_5_BYTE_CHAR < c)
+	{
+	  /* A raw byte, which has a shorter representation.  */
+	  if (dst)
+	    BYTE8_STRING (CHAR_TO_BYTE8 (c), dst + nbytes);
+	  nbytes += 2;
+	}
+      else
+	{
+	  /* The internal representation is the same as UTF-8.  */
+	  if (dst)
+	    memcpy (dst + nbytes, p, len);
+	  nbytes += len;
+	}
+      chars++;
+      p += len;
+      continue;
+
+    invalid:
+      if (dst)
+	BYTE8_STRING (c1, dst + nbytes);
+      nbytes += 2;
+      chars++;
+      p++;
+    }
+
+  *nchars = chars;
+  return nbytes;
+}
+
+/* Read the file of JOB into its data, and decode it if it is UTF-8
+   that needs no EOL conversion.  */
+
+static bool
+worker_decode (struct worker_job *job)
+{
+  struct stat st;
+  unsigned char *buf;
+  ptrdiff_t nread = 0;
+  int fd;
+
+  do
+    fd = open (job->file, O_RDONLY | O_CLOEXEC);
+  while (fd < 0 && errno == EINTR);
+  if (fd < 0)
+    goto fail;
+  if (fstat (fd, &st) != 0)
+    goto fail_close;
+  if (! S_ISREG (st.st_mode))
+    {
+      errno = S_ISDIR (st.st_mode) ? EISDIR : EINVAL;
+      goto fail_close;
+    }
+  if (min (PTRDIFF_MAX, SIZE_MAX) / 2 - 1 < st.st_size)
+    {
+      errno = EFBIG;
+      goto fail_close;
+    }
+  buf = malloc (st.st_size + 1);
+  if (!buf)
+    goto fail_close;
+  job->data = buf;
+
+  while (nread < st.st_size)
+    {
+      ssize_t n = read (fd, buf + nread, min (st.st_size - nread, WORKER_CHUNK));
+      if (n < 0 && errno == EINTR)
+	continue;
+      if (n < 0)
+	goto fail_close;
+      if (n == 0)
+	break;
+      nread += n;
+      if (worker_cancelled_p (job))
+	{
+	  close (fd);
+	  return false;
+	}
+    }
+  close (fd);
+  job->size = nread;
+
+  /* EOL conversion treats carriage returns in ways the workers do
+     not imitate, so leave files that have any to the main thread.  */
+  if (job->utf_8 && ! memchr (buf, '\r', nread))
+    {
+      ptrdiff_t nchars, nbytes;
+      unsigned char *decoded;
+
+      nbytes = worker_decode_utf_8 (buf, nread, job->bom, NULL, &nchars);
+      decoded = malloc (nbytes + 1);
+      if (!decoded)
+	goto fail;
+      worker_decode_utf_8 (buf, nread, job->bom, decoded, &nchars);
+      free (buf);
+      job->data = decoded;
+      job->size = nbytes;
+      job->nchars = nchars;
+      job->newline = memchr (decoded, '\n', nbytes) != NULL;
+      job->decoded = true;
+    }
+  return true;
+
+ fail_close:
+  {
+    int close_errno = errno;
+    close (fd);
+    errno = close_errno;
+  }
+ fail:
+  job->errno_value = errno;
+  return false;
+}
+
+/* Do JOB.  Return the state it ends in.  */
+
+static enum worker_state
+worker_run (struct worker_job *job)
+{
+  bool ok;
+
+  switch (job->op)
+    {
+    case WORKER_HASH: ok = worker_hash (job); break;
+    case WORKER_COUNT: ok = worker_count (job); break;
+    default: ok = worker_decode (job); break;
+    }
+  return (ok ? WORKER_DONE
+	  : job->errno_value ? WORKER_FAILED : WORKER_CANCELLED);
+}
+
+
+/* Running jobs on threads.  */
+
+#ifdef HAVE_PTHREAD
+
+/* This protects worker_queue and the state of the jobs.  */
+static pthread_mutex_t worker_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* The workers wait on WORKER_WORK for jobs in the queue, and the main
+   thread waits on WORKER_DONE in `worker-wait'.  */
+static pthread_cond_t worker_work = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t worker_done = PTHREAD_COND_INITIALIZER;
+
+/* The number of worker threads, and how many of them are idle.  */
+static int worker_threads, worker_idle;
+
+/* The pipe through which the workers wake up the main thread.  */
+static int worker_pipe[2];
+
+static bool
+worker_cancelled_p (struct worker_job *job)
+{
+  bool cancel;
+  pthread_mutex_lock (&worker_mutex);
+  cancel = job->cancel;
+  pthread_mutex_unlock (&worker_mutex);
+  return cancel;
+}
+
+static void *
+worker_thread (void *arg)
+{
+  pthread_mutex_lock (&worker_mutex);
+  while (true)
+    {
+      struct worker_job *job;
+      enum worker_state state;
+
+      while (!worker_queue)
+	{
+	  worker_idle++;
+	  pthread_cond_wait (&worker_work, &worker_mutex);
+	  worker_idle--;
+	}
+      job = worker_queue;
+      worker_queue = job->next_queued;
+      job->state = WORKER_RUNNING;
+      pthread_mutex_unlock (&worker_mutex);
+
+      state = worker_run (job);
+
+      pthread_mutex_lock (&worker_mutex);
+      job->state = state;
+      pthread_cond_broadcast (&worker_done);
+      /* If the pipe is full, the main thread has yet to read the
+	 wake-ups already in it, and will see this job too.  */
+      if (write (worker_pipe[1], "", 1) < 0 && errno != EAGAIN)
+	emacs_abort ();
+    }
+  return NULL;
+}
+
+/* Queue an event for each finished job that does not have one yet.
+   wait_reading_process_output calls this when a worker has written to
+   the pipe.  */
+
+static void
+worker_announce (int fd, void *data)
+{
+  char buf[256];
+  struct worker_job *job;
+
+  while (0 < read (fd, buf, sizeof buf))
+    continue;
+
+  for (job = worker_jobs; job; job = job->next)
+    {
+      bool finished;
+      pthread_mutex_lock (&worker_mutex);
+      finished = WORKER_DONE <= job->state;
+      pthread_mutex_unlock (&worker_mutex);
+      if (finished && !job->announced)
+	worker_store_event (job);
+    }
+}
+
+/* Queue JOB for a worker, starting a thread for it if need be.  */
+
+static void
+worker_start (struct worker_job *job)
+{
+  static bool pipe_open;
+
+  if (!pipe_open)
+    {
+      if (emacs_pipe (worker_pipe) != 0)
+	report_file_error ("Creating pipe for worker threads", Qnil);
+      fcntl (worker_pipe[0], F_SETFL, O_NONBLOCK);
+      fcntl (worker_pipe[1], F_SETFL, O_NONBLOCK);
+      add_read_fd (worker_pipe[0], worker_announce, NULL);
+      pipe_open = true;
+    }
+
+  pthread_mutex_lock (&worker_mutex);
+  if (worker_idle == 0 && worker_threads < WORKER_MAX_THREADS)
+    {
+      /* Keep signals from going to the worker; Emacs handles them in
+	 the main thread.  */
+      pthread_attr_t attr;
+      pthread_t thread;
+      sigset_t all, old;
+      sigfillset (&all);
+      pthread_sigmask (SIG_SETMASK, &all, &old);
+      pthread_attr_init (&attr);
+      pthread_attr_setdetachstate (&attr, PTHREAD_CREATE_DETACHED);
+      if (pthread_create (&thread, &attr, worker_thread, NULL) == 0)
+	worker_threads++;
+      pthread_attr_destroy (&attr);
+      pthread_sigmask (SIG_SETMASK, &old, NULL);
+    }
+  if (worker_threads == 0)
+    {
+      pthread_mutex_unlock (&worker_mutex);
+      error ("Cannot start a worker thread");
+    }
+
+  job->next_queued = NULL;
+  if (worker_queue)
+    worker_queue_tail->next_queued = job;
+  else
+    worker_queue = job;
+  worker_queue_tail = job;
+  pthread_cond_signal (&worker_work);
+  pthread_mutex_unlock (&worker_mutex);
+}
+
+/* Return the state of JOB.  */
+
+static enum worker_state
+worker_state (struct worker_job *job)
+{
+  enum worker_state state;
+  pthread_mutex_lock (&worker_mutex);
+  state = job->state;
+  pthread_mutex_unlock (&worker_mutex);
+  return state;
+}
+
+/* Cancel JOB.  A queued job never runs; a running one stops at the
+   next chunk of its work.  */
+
+static void
+worker_cancel (struct worker_job *job)
+{
+  pthread_mutex_lock (&worker_mutex);
+  job->cancel = true;
+  if (job->state == WORKER_QUEUED)
+    {
+      struct worker_job **p, *prev = NULL;
+      for (p = &worker_queue; *p != job; p = &(*p)->next_queued)
+	prev = *p;
+      *p = job->next_queued;
+      if (worker_queue_tail == job)
+	worker_queue_tail = prev;
+      job->state = WORKER_CANCELLED;
+      if (write (worker_pipe[1], "", 1) < 0 && errno != EAGAIN)
+	emacs_abort ();
+    }
+  pthread_mutex_unlock (&worker_mutex);
+}
+
+/* Wait until JOB is finished, letting the user quit.  */
+
+static void
+worker_wait (struct worker_job *job)
+{
+  pthread_mutex_lock (&worker_mutex);
+  while (job->state < WORKER_DONE)
+    {
+      struct timespec deadline
+	= timespec_add (current_timespec (), make_timespec (0, 100000000));
+      pthread_cond_timedwait (&worker_done, &worker_mutex, &deadline);
+      pthread_mutex_unlock (&worker_mutex);
+      QUIT;
+      pthread_mutex_lock (&worker_mutex);
+    }
+  pthread_mutex_unlock (&worker_mutex);
+}
+
+#else /* !HAVE_PTHREAD */
+
+static bool
+worker_cancelled_p (struct worker_job *job)
+{
+  return false;
+}
+
+static void
+worker_start (struct worker_job *job)
+{
+  job->state = worker_run (job);
+  worker_store_event (job);
+}
+
+static enum worker_state
+worker_state (struct worker_job *job)
+{
+  return job->state;
+}
+
+static void
+worker_cancel (struct worker_job *job)
+{
+}
+
+static void
+worker_wait (struct worker_job *job)
+{
+}
+
+#endif /* !HAVE_PTHREAD */
+
+
+/* The Lisp side of jobs.  */
+
+/* Free JOB and the memory it owns.  */
+
+static void
+worker_free_job (void *arg)
+{
+  struct worker_job *job = arg;
+  free (job->data);
+  xfree (job->needle);
+  xfree (job->file);
+  xfree (job);
+}
+
+/* Return a new job for OP, with no input yet.  Arrange to free it if
+   it is not submitted.  */
+
+static struct worker_job *
+worker_new_job (enum worker_op op)
+{
+  struct worker_job *job = xzalloc (sizeof *job);
+  job->op = op;
+  job->id = worker_next_id++;
+  job->state = WORKER_QUEUED;
+  record_unwind_protect_ptr (worker_free_job, job);
+  return job;
+}
+
+/* Start JOB, whose callback is CALLBACK, and return its record.
+COUNT is the binding depth before worker_new_job made JOB.  */
+
+static Lisp_Object
+worker_submit (struct worker_job *job, Lisp_Object callback, ptrdiff_t count)
+{
+  Lisp_Object record = Fmake_vector (make_number (WORKER_SLOTS), Qnil);
+
+  ASET (record, WORKER_CALLBACK, callback);
+  worker_start (job);
+  /* From now on the job belongs to the workers.  */
+  set_unwind_protect_ptr (count, xfree, NULL);
+  unbind_to (count, Qnil);
+
+  job->next = worker_jobs;
+  worker_jobs = job;
+  worker_records = Fcons (Fcons (make_number (job->id), record),
+			  worker_records);
+  return record;
+}
+
+/* Copy the text of OBJECT, a string or the accessible portion of a
+   buffer, into JOB, with malloc.  */
+
+static void
+worker_copy_text (struct worker_job *job, Lisp_Object object)
+{
+  unsigned char *data;
+
+  if (STRINGP (object))
+    {
+      job->size = SBYTES (object);
+      job->multibyte = STRING_MULTIBYTE (object);
+      data = malloc (job->size + 1);
+      if (!data)
+	memory_full (job->size + 1);
+      memcpy (data, SDATA (object), job->size);
+    }
+  else
+    {
+      struct buffer *b;
+      ptrdiff_t begv, gpt, zv, before;
+
+      CHECK_BUFFER (object);
+      b = XBUFFER (object);
+      if (!BUFFER_LIVE_P (b))
+	error ("Selecting deleted buffer");
+      begv = BUF_BEGV_BYTE (b);
+      zv = BUF_ZV_BYTE (b);
+      gpt = clip_to_bounds (begv, BUF_GPT_BYTE (b), zv);
+      job->size = zv - begv;
+      job->multibyte = !NILP (BVAR (b, enable_multibyte_characters));
+      data = malloc (job->size + 1);
+      if (!data)
+	memory_full (job->size + 1);
+      before = gpt - begv;
+      memcpy (data, BUF_BYTE_ADDRESS (b, begv), before);
+      memcpy (data + before, BUF_BYTE_ADDRESS (b, gpt), zv - gpt);
+    }
+  job->data = data;
+}
+
+/* Return the Lisp record of the job with id JOB, or signal an error
+   if there is none.  */
+
+static Lisp_Object
+worker_record (Lisp_Object job)
+{
+  Lisp_Object record;
+  CHECK_NUMBER (job);
+  record = Fassq (job, worker_records);
+  if (NILP (record))
+    error ("No worker job %"pI"d", XINT (job));
+  return XCDR (record);
+}
+
+/* If the job with id ID has finished, record its outcome in RECORD as
+   Lisp objects and free it.  */
+
+static void
+worker_collect (Lisp_Object id, Lisp_Object record)
+{
+  struct worker_job **p, *job;
+  enum worker_state state;
+  Lisp_Object status, result = Qnil;
+  ptrdiff_t count = SPECPDL_INDEX ();
+
+  for (p = &worker_jobs; *p && (*p)->id != XINT (id); p = &(*p)->next)
+    continue;
+  job = *p;
+  if (!job)
+    return;
+  state = worker_state (job);
+  if (state < WORKER_DONE)
+    return;
+
+  /* Take JOB off the list first, so that it is freed even if making
+     the result signals an error.  */
+  *p = job->next;
+  record_unwind_protect_ptr (worker_free_job, job);
+  /* The callback must run even if the result is collected before the
+     main thread has read the wake-up from the worker.  */
+  if (!job->announced)
+    worker_store_event (job);
+
+  if (state == WORKER_CANCELLED)
+    status = Qcancelled;
+  else if (state == WORKER_FAILED)
+    {
+      Lisp_Object errstring
+	= code_convert_string_norecord (build_unibyte_string
+					(emacs_strerror (job->errno_value)),
+					Vlocale_coding_system, 0);
+      status = Qfailed;
+      ASET (record, WORKER_ERROR,
+	    list4 (Qfile_error, build_string ("Reading file"), errstring,
+		   AREF (record, WORKER_FILE)));
+    }
+  else
+    {
+      status = Qdone;
+      switch (job->op)
+	{
+	case WORKER_HASH:
+	  {
+	    int i, size = hash_algorithms[job->algorithm].size;
+	    static char const hexdigit[16] = "0123456789abcdef";
+	    char hex[2 * SHA512_DIGEST_SIZE];
+	    for (i = 0; i < size; i++)
+	      {
+		hex[2 * i] = hexdigit[job->digest[i] >> 4];
+		hex[2 * i + 1] = hexdigit[job->digest[i] & 0xF];
+	      }
+	    result = make_unibyte_string (hex, 2 * size);
+	  }
+	  break;
+
+	case WORKER_COUNT:
+	  result = make_number (job->count);
+	  break;
+
+	case WORKER_DECODE:
+	  {
+	    Lisp_Object file = AREF (record, WORKER_FILE);
+	    Lisp_Object coding_system = AREF (record, WORKER_CODING_SYSTEM);
+
+	    result = Fget_buffer_create
+	      (Fgenerate_new_buffer_name (Ffile_name_nondirectory (file), Qnil));
+	    record_unwind_current_buffer ();
+	    set_buffer_internal (XBUFFER (result));
+	    if (job->decoded)
+	      {
+		Lisp_Object eol_type = AREF (CODING_SYSTEM_SPEC (coding_system),
+					     2);
+		insert_1_both ((char *) job->data, job->nchars, job->size,
+			       0, 0, 0);
+		/* Decoding text with a newline settles the EOL type.  */
+		if (VECTORP (eol_type) && job->newline)
+		  coding_system = AREF (eol_type, 0);
+		Vlast_coding_system_used = coding_system;
+	      }
+	    else
+	      {
+		Lisp_Object text
+		  = code_convert_string (make_unibyte_string ((char *) job->data,
+							      job->size),
+					 coding_system, Qt, false, true, false);
+		insert_from_string (text, 0, 0, SCHARS (text), SBYTES (text),
+				    false);
+	      }
+	    Fset (Qbuffer_file_coding_system, Vlast_coding_system_used);
+	    SET_PT_BOTH (BEG, BEG_BYTE);
+	    SAVE_MODIFF = MODIFF;
+	  }
+	  break;
+	}
+    }
+
+  ASET (record, WORKER_STATUS, status);
+  ASET (record, WORKER_RESULT, result);
+  unbind_to (count, Qnil);
+}
+
+DEFUN ("worker-secure-hash", Fworker_secure_hash, Sworker_secure_hash, 2, 3, 0,
+       doc: /* Hash OBJECT with ALGORITHM in a background thread.
+ALGORITHM is a symbol, one of those that `secure-hash' accepts.
+OBJECT is a string or a buffer; for a buffer, hash its accessible
+portion.  Multibyte text is hashed as it would be encoded in UTF-8,
+so for a string the result is the hexadecimal string that
+(secure-hash ALGORITHM (encode-coding-string OBJECT 'utf-8-unix))
+returns.
+
+Return the id of the job, to use with `worker-result' and the other
+worker functions.  When the job is finished, call CALLBACK, if
+non-nil, with the id as argument.  */)
+  (Lisp_Object algorithm, Lisp_Object object, Lisp_Object callback)
+{
+  struct worker_job *job;
+  ptrdiff_t count = SPECPDL_INDEX ();
+  int i;
+
+  CHECK_SYMBOL (algorithm);
+  for (i = 0; i < ARRAYELTS (hash_algorithms); i++)
+    if (EQ (algorithm, *hash_algorithms[i].name))
+      break;
+  if (i == ARRAYELTS (hash_algorithms))
+    error ("Invalid algorithm arg: %s", SDATA (SYMBOL_NAME (algorithm)));
+  if (!STRINGP (object))
+    CHECK_BUFFER (object);
+
+  job = worker_new_job (WORKER_HASH);
+  job->algorithm = i;
+  worker_copy_text (job, object);
+  worker_submit (job, callback, count);
+  return make_number (job->id);
+}
+
+DEFUN ("worker-count-matches", Fworker_count_matches, Sworker_count_matches,
+       2, 3, 0,
+       doc: /* Count the occurrences of STRING in OBJECT in a background thread.
+OBJECT is a string or a buffer; for a buffer, search its accessible
+portion.  Occurrences that overlap count once, as with `how-many'.
+STRING is matched literally and case-sensitively, whatever the value
+of `case-fold-search'.  The result is a number.
+
+Return the id of the job, to use with `worker-result' and the other
+worker functions.  When the job is finished, call CALLBACK, if
+non-nil, with the id as argument.  */)
+  (Lisp_Object string, Lisp_Object object, Lisp_Object callback)
+{
+  struct worker_job *job;
+  ptrdiff_t count = SPECPDL_INDEX ();
+  bool multibyte;
+
+  CHECK_STRING (string);
+  if (SCHARS (string) == 0)
+    error ("Empty search string");
+  if (!STRINGP (object))
+    CHECK_BUFFER (object);
+  multibyte = (STRINGP (object) ? STRING_MULTIBYTE (object)
+	       : !NILP (BVAR (XBUFFER (object), enable_multibyte_characters)));
+
+  /* Bring STRING to the representation of OBJECT.  */
+  if (multibyte)
+    string = string_to_multibyte (string);
+  else if (STRING_MULTIBYTE (string))
+    {
+      ptrdiff_t i, i_byte;
+      for (i = i_byte = 0; i < SCHARS (string); )
+	{
+	  int c;
+	  FETCH_STRING_CHAR_ADVANCE_NO_CHECK (c, string, i, i_byte);
+	  if (! (ASCII_CHAR_P (c) || CHAR_BYTE8_P (c)))
+	    break;
+	}
+      /* A character that is neither ASCII nor a raw byte cannot
+	 occur in unibyte text; look for something that is never
+	 there.  */
+      string = (i < SCHARS (string) ? Qnil : Fstring_as_unibyte (string));
+    }
+
+  job = worker_new_job (WORKER_COUNT);
+  if (NILP (string))
+    {
+      /* Search no text at all.  */
+      job->needle_size = 1;
+      job->needle = xzalloc (1);
+      worker_copy_text (job, empty_unibyte_string);
+    }
+  else
+    {
+      job->needle_size = SBYTES (string);
+      job->needle = xmalloc (job->needle_size);
+      memcpy (job->needle, SDATA (string), job->needle_size);
+      worker_copy_text (job, object);
+    }
+  worker_submit (job, callback, count);
+  return make_number (job->id);
+}
+
+DEFUN ("worker-decode-file", Fworker_decode_file, Sworker_decode_file,
+       1, 3, 0,
+       doc: /* Read FILE and decode it in a background thread.
+Decode the contents of FILE with CODING-SYSTEM, or detect the coding
+system if CODING-SYSTEM is nil, as `decode-coding-string' would.  The
+result is a new buffer that holds the text, with
+`buffer-file-coding-system' set to the coding system used.  A background
+thread reads the file, and decodes it too if it is in UTF-8 and has no
+carriage returns; other files are decoded when the result is collected.
+
+Return the id of the job, to use with `worker-result' and the other
+worker functions.  When the job is finished, call CALLBACK, if
+non-nil, with the id as argument.  */)
+  (Lisp_Object file, Lisp_Object coding_system, Lisp_Object callback)
+{
+  struct worker_job *job;
+  Lisp_Object encoded, attrs, bom, record;
+  ptrdiff_t count = SPECPDL_INDEX ();
+
+  CHECK_STRING (file);
+  file = Fexpand_file_name (file, Qnil);
+  if (!NILP (Ffind_file_name_handler (file, Qinsert_file_contents)))
+    xsignal2 (Qfile_error,
+	      build_string ("Cannot read remote files in the background"),
+	      file);
+  if (NILP (coding_system))
+    coding_system = Qundecided;
+  CHECK_CODING_SYSTEM (coding_system);
+  encoded = ENCODE_FILE (file);
+
+  job = worker_new_job (WORKER_DECODE);
+  job->file = xstrdup (SSDATA (encoded));
+
+  /* Let the worker decode UTF-8 itself when that is all decoding
+     does: no BOM detection, post-read conversion or translation.  */
+  attrs = AREF (CODING_SYSTEM_SPEC (coding_system), 0);
+  bom = AREF (attrs, coding_attr_utf_bom);
+  job->utf_8
+    = (EQ (CODING_ATTR_TYPE (attrs), Qutf_8)
+       && (NILP (bom) || EQ (bom, Qt))
+       && NILP (CODING_ATTR_POST_READ (attrs))
+       && (NILP (Venable_character_translation)
+	   || (NILP (CODING_ATTR_DECODE_TBL (attrs))
+	       && NILP (Vstandard_translation_table_for_decode))));
+  job->bom = EQ (bom, Qt);
+
+  record = worker_submit (job, callback, count);
+  ASET (record, WORKER_FILE, file);
+  ASET (record, WORKER_CODING_SYSTEM, coding_system);
+  return make_number (job->id);
+}
+
+DEFUN ("worker-status", Fworker_status, Sworker_status, 1, 1, 0,
+       doc: /* Return the status of the worker job JOB.
+The value is `running' if the job is queued or running, `done' if it
+has finished, `failed' if it has failed, and `cancelled' if
+`worker-cancel' stopped it.  */)
+  (Lisp_Object job)
+{
+  Lisp_Object record = worker_record (job);
+
+  worker_collect (job, record);
+  return NILP (AREF (record, WORKER_STATUS)) ? Qrunning
+	  : AREF (record, WORKER_STATUS);
+}
+
+DEFUN ("worker-result", Fworker_result, Sworker_result, 1, 1, 0,
+       doc: /* Return the result of the worker job JOB.
+Return nil if the job is still running, or has been cancelled.  If the
+job has failed, signal the error that made it fail.  */)
+  (Lisp_Object job)
+{
+  Lisp_Object record = worker_record (job);
+
+  worker_collect (job, record);
+  if (EQ (AREF (record, WORKER_STATUS), Qfailed))
+    xsignal (XCAR (AREF (record, WORKER_ERROR)),
+	     XCDR (AREF (record, WORKER_ERROR)));
+  return (EQ (AREF (record, WORKER_STATUS), Qdone)
+	  ? AREF (record, WORKER_RESULT) : Qnil);
+}
+
+DEFUN ("worker-wait", Fworker_wait, Sworker_wait, 1, 1, 0,
+       doc: /* Wait for the worker job JOB to finish, and return its result.
+This is like `worker-result', except that it does not return before the
+job has finished.  */)
+  (Lisp_Object job)
+{
+  struct worker_job *p;
+
+  worker_record (job);
+  for (p = worker_jobs; p; p = p->next)
+    if (p->id == XINT (job))
+      {
+	worker_wait (p);
+	break;
+      }
+  return Fworker_result (job);
+}
+
+DEFUN ("worker-cancel", Fworker_cancel, Sworker_cancel, 1, 1, 0,
+       doc: /* Cancel the worker job JOB.
+A job that has not started yet never runs, and a running job stops
+soon.  The callback of the job is still called; `worker-status' then
+returns `cancelled', unless the job finished before it could stop.  */)
+  (Lisp_Object job)
+{
+  struct worker_job *p;
+
+  worker_record (job);
+  for (p = worker_jobs; p; p = p->next)
+    if (p->id == XINT (job))
+      {
+	worker_cancel (p);
+	break;
+      }
+  return Qnil;
+}
+
+/* Forget the job with id JOB, once its callback has run.  */
+
+static void
+worker_forget (Lisp_Object job)
+{
+  worker_records = Fdelq (Fassq (job, worker_records), worker_records);
+}
+
+DEFUN ("worker-handle-event", Fworker_handle_event, Sworker_handle_event,
+       1, 1, "e",
+       doc: /* Handle the event EVENT that says a worker job has finished.
+EVENT has the form (worker-event JOB).  Call the callback of JOB with
+JOB as argument, and then forget JOB.  */)
+  (Lisp_Object event)
+{
+  Lisp_Object job, record, callback;
+  ptrdiff_t count = SPECPDL_INDEX ();
+
+  CHECK_CONS (event);
+  job = Fcar (XCDR (event));
+  CHECK_NUMBER (job);
+  record = Fassq (job, worker_records);
+  if (NILP (record))
+    return Qnil;
+  record_unwind_protect (worker_forget, job);
+  worker_collect (job, XCDR (record));
+  callback = AREF (XCDR (record), WORKER_CALLBACK);
+  if (!NILP (callback))
+    call1 (callback, job);
+  return unbind_to (count, Qnil);
+}
+
+void
+syms_of_worker (void)
+{
+  DEFSYM (Qmd5, "md5");
+  DEFSYM (Qsha1, "sha1");
+  DEFSYM (Qsha224, "sha224");
+  DEFSYM (Qsha256, "sha256");
+  DEFSYM (Qsha384, "sha384");
+  DEFSYM (Qsha512, "sha512");
+
+  DEFSYM (Qrunning, "running");
+  DEFSYM (Qdone, "done");
+  DEFSYM (Qfailed, "failed");
+  DEFSYM (Qcancelled, "cancelled");
+
+  staticpro (&worker_records);
+  worker_records = Qnil;
+
+  defsubr (&Sworker_secure_hash);
+  defsubr (&Sworker_count_matches);
+  defsubr (&Sworker_decode_file);
+  defsubr (&Sworker_status);
+  defsubr (&Sworker_result);
+  defsubr (&Sworker_wait);
+  defsubr (&Sworker_cancel);
+  defsubr (&Sworker_handle_event);
+}
@@ -6038,15 +6038,13 @@ face_at_buffer_position (struct window *w, ptrdiff_t pos,
   noverlays = sort_overlays (overlay_vec, noverlays, w);
   for (i = 0; i < noverlays; i++)
     {
-      Lisp_Object oend;
       ptrdiff_t oendpos;
 
       prop = Foverlay_get (overlay_vec[i], propname);
       if (!NILP (prop))
 	merge_face_ref (f, prop, attrs, 1, 0);
 
-      oend = OVERLAY_END (overlay_vec[i]);
-      oendpos = OVERLAY_POSITION (oend);
+      oendpos = OVERLAY_END (overlay_vec[i]);
       if (oendpos < endpos)
 	endpos = oendpos;
     }
@@ -6394,6 +6392,49 @@ DEFUN ("show-face-resources", Fshow_face_resources, Sshow_face_resources,
 			    Initialization
  ***********************************************************************/
 
+/* Set up faces after loading a portable dump.  Recompute the mapping
+   from Lisp face IDs to face names from the `face' properties of the
+   faces.  The frames that the dump reuses now have the Lisp faces that
+   were dumped, but their face caches are missing in batch mode, or
+   hold faces realized before the dump was loaded that refer to
+   objects the dump replaced; realize their faces anew.  */
+
+static void
+init_faces_after_pdumper_load (void)
+{
+  Lisp_Object tail, frame;
+
+  next_lface_id = 0;
+  for (tail = Vface_new_frame_defaults; CONSP (tail); tail = XCDR (tail))
+    {
+      Lisp_Object face = XCAR (XCAR (tail));
+      Lisp_Object id = Fget (face, Qface);
+
+      if (RANGED_INTEGERP (0, id, MAX_FACE_ID - 1))
+	{
+	  if (XINT (id) >= lface_id_to_name_size)
+	    lface_id_to_name =
+	      xpalloc (lface_id_to_name, &lface_id_to_name_size,
+		       XINT (id) + 1 - lface_id_to_name_size, MAX_FACE_ID,
+		       sizeof *lface_id_to_name);
+	  lface_id_to_name[XINT (id)] = face;
+	  next_lface_id = max (next_lface_id, XINT (id) + 1);
+	}
+    }
+  ++face_change_count;
+
+  FOR_EACH_FRAME (tail, frame)
+    {
+      struct frame *f = XFRAME (frame);
+
+      if (!NILP (f->face_alist))
+	{
+	  free_frame_faces (f);
+	  init_frame_faces (f);
+	}
+    }
+}
+
 void
 syms_of_xfaces (void)
 {
@@ -6598,6 +6639,8 @@ RESCALE-RATIO is a floating point number to specify how much larger
 a font of 10 point, we actually use a font of 10 * RESCALE-RATIO point.  */);
   Vface_font_rescale_alist = Qnil;
 
+  pdumper_do_after_load (init_faces_after_pdumper_load);
+
 #ifdef HAVE_WINDOW_SYSTEM
   defsubr (&Sbitmap_spec_p);
   defsubr (&Sx_list_fonts);
@@ -0,0 +1,98 @@
+;;; arith-benchmark.el --- micro-benchmarks for arithmetic -*- lexical-binding: t -*-
+
+;; Copyright (C) 2014 Free Software Foundation, Inc.
+
+;; Keywords:       internal
+;; Human-Keywords: internal
+
+;; This file is part of GNU Emacs.
+
+;; GNU Emacs is free software: you can redistribute it and/or modify
+;; it under the terms of the GNU General Public License as published by
+;; the Free Software Foundation, either version 3 of the License, or
+;; (at your option) any later version.
+
+;; GNU Emacs is distributed in the hope that it will be useful,
+;; but WITHOUT ANY WARRANTY; without even the implied warranty of
+;; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+;; GNU General Public License for more details.
+
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.
+
+;;; Commentary:
+
+;; Time the arithmetic and comparison byte codes, and the functions
+;; they fall back on.  Run the benchmarks with
+;;
+;;   emacs -batch -Q -l test/arith-benchmark.el -f arith-benchmark-batch
+;;
+;; or interactively with M-x arith-benchmark.  Each benchmark is a
+;; byte-compiled loop of `arith-benchmark-iterations' iterations.
+
+;;; Code:
+
+(require 'benchmark)
+
+(defvar arith-benchmark-iterations 2000000
+  "Number of iterations of each benchmark loop.")
+
+(defconst arith-benchmark-forms
+  '((empty-loop    nil)
+    (fixnum-plus   (setq x (+ x i)))
+    (fixnum-minus  (setq x (- x i)))
+    (fixnum-times  (setq x (* (logand i 1023) 3)))
+    (fixnum-quo    (setq x (/ i 7)))
+    (fixnum-less   (if (< x i) (setq x (1+ x))))
+    (fixnum-equal  (if (= x i) (setq x (1+ x))))
+    (float-plus    (setq f (+ f 0.5)))
+    (float-times   (setq f (* f 1.0000001)))
+    (mixed-plus    (setq f (+ f i)))
+    (float-less    (if (< f 1e10) (setq x (1+ x))))
+    (funcall-plus  (setq x (funcall plus x i)))
+    (marker-plus   (setq x (+ m i))))
+  "Benchmarks, each a name and a form to evaluate in the loop.
+The form can use the loop counter I, the fixnum X, the float F,
+the marker M and the function PLUS, which is `+'.  The time of
+`empty-loop' is the overhead of the loop itself.")
+
+(defun arith-benchmark-function (form)
+  "Return a compiled function that evaluates FORM in a loop."
+  (let ((lexical-binding t))
+    (byte-compile
+     `(lambda (n)
+        (let ((x 0) (f 1.0) (m (point-min-marker)) (plus #'+) (i 0))
+          (while (< i n)
+            ,form
+            (setq i (1+ i)))
+          (list x f m plus))))))
+
+(defun arith-benchmark-run ()
+  "Run the benchmarks, and return a list of (NAME SECONDS GCS)."
+  (mapcar (lambda (benchmark)
+            (let ((function (arith-benchmark-function (nth 1 benchmark))))
+              (garbage-collect)
+              (let ((result (benchmark-run 1
+                              (funcall function arith-benchmark-iterations))))
+                (list (car benchmark) (nth 0 result) (nth 1 result)))))
+          arith-benchmark-forms))
+
+(defun arith-benchmark-report (results)
+  "Return a string that shows RESULTS, as from `arith-benchmark-run'."
+  (mapconcat (lambda (result)
+               (format "%-14s %8.3fs %4d GCs" (nth 0 result) (nth 1 result)
+                       (nth 2 result)))
+             results "\n"))
+
+(defun arith-benchmark ()
+  "Run the arithmetic benchmarks and show the results."
+  (interactive)
+  (with-output-to-temp-buffer "*Arith Benchmark*"
+    (princ (arith-benchmark-report (arith-benchmark-run)))))
+
+(defun arith-benchmark-batch ()
+  "Run the arithmetic benchmarks and print the results."
+  (princ (arith-benchmark-report (arith-benchmark-run)))
+  (terpri))
+
+;;; arith-benchmark.el ends here
@@ -0,0 +1,201 @@
+;;; alloc-tests.el --- tests for src/alloc.c
+
+;; Copyright (C) 2014 Free Software Foundation, Inc.
+
+;; This file is part of GNU Emacs.
+
+;; This program is free software: you can redistribute it and/or
+;; modify it under the terms of the GNU General Public License as
+;; published by the Free Software Foundation, either version 3 of the
+;; License, or (at your option) any later version.
+;;
+;; This program is distributed in the hope that it will be useful, but
+;; WITHOUT ANY WARRANTY; without even the implied warranty of
+;; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+;; General Public License for more details.
+;;
+;; You should have received a copy of the GNU General Public License
+;; along with this program.  If not, see `http://www.gnu.org/licenses/'.
+
+;;; Commentary:
+
+;;; Code:
+
+(require 'ert)
+
+(ert-deftest gc-generational-old-to-young ()
+  "Check that young objects stored into old conses survive."
+  (let ((gc-generational t)
+        (old (make-list 1000 nil)))
+    ;; Make OLD part of the old generation.
+    (garbage-collect)
+    (let ((gc-cons-threshold 20000)
+          (minor gcs-minor-done))
+      (dotimes (round 50)
+        (let ((tail old) (i 0))
+          (while tail
+            (when (zerop (% (+ i round) 7))
+              ;; New conses, floats and strings, reachable only from
+              ;; an old cons.
+              (setcar tail (list i (* 1.5 i) (number-to-string i))))
+            (setq tail (cdr tail) i (1+ i))))
+        (dotimes (_ 2000)
+          (make-list 10 'garbage)))
+      (should (> gcs-minor-done minor)))
+    (garbage-collect)
+    (let ((i 0))
+      (dolist (elt old)
+        (when elt
+          (should (equal elt (list i (* 1.5 i) (number-to-string i)))))
+        (setq i (1+ i))))))
+
+;; Stores of new objects into old vectors, hash tables, char-tables,
+;; obarrays and symbols.
+(defvar alloc-tests--value)
+
+(ert-deftest gc-generational-old-vectors-and-symbols ()
+  "Check that young objects stored into old vectors and symbols survive."
+  (let ((gc-generational t)
+        (vec (make-vector 100 nil))
+        (table (make-hash-table :test 'equal))
+        (chars (make-char-table 'alloc-tests))
+        (ob (obarray-make))
+        (sym (make-symbol "alloc-tests"))
+        (alloc-tests--value nil))
+    ;; Make them part of the old generation.
+    (garbage-collect)
+    (let ((gc-cons-threshold 20000)
+          (minor gcs-minor-done))
+      (dotimes (i 100)
+        ;; New objects, each reachable only from an old one.
+        (aset vec i (vector i (make-symbol (number-to-string i))))
+        (puthash i (list (* 1.5 i)) table)
+        (aset chars (+ ?a i) (vector i))
+        (intern (format "alloc-tests-%d" i) ob)
+        (setq alloc-tests--value (cons i alloc-tests--value))
+        (fset sym (vector i))
+        (put sym 'alloc-tests (make-symbol (number-to-string i)))
+        (dotimes (_ 100)
+          (make-list 10 'garbage)))
+      (should (> gcs-minor-done minor)))
+    (dotimes (i 100)
+      (should (equal (aref (aref vec i) 0) i))
+      (should (equal (symbol-name (aref (aref vec i) 1))
+                     (number-to-string i)))
+      (should (equal (gethash i table) (list (* 1.5 i))))
+      (should (equal (aref chars (+ ?a i)) (vector i)))
+      (should (intern-soft (format "alloc-tests-%d" i) ob)))
+    (should (equal alloc-tests--value (nreverse (number-sequence 0 99))))
+    (should (equal (symbol-function sym) [99]))
+    (should (equal (symbol-name (get sym 'alloc-tests)) "99"))))
+
+(ert-deftest gc-generational-explicit-full ()
+  "Check that `garbage-collect' does not count as a minor collection."
+  (let ((gc-generational t)
+        (minor gcs-minor-done))
+    (garbage-collect)
+    (should (= gcs-minor-done minor))))
+
+(ert-deftest gc-parallel-sweep ()
+  "Check that sweeping with several threads keeps live objects."
+  (let ((gc-sweep-threads 3)
+        (keep nil))
+    (dotimes (round 5)
+      (dotimes (i 50000)
+        (let ((x (list i (* 1.5 i) (make-symbol (number-to-string i)))))
+          (when (zerop (% (+ i round) 5))
+            (push x keep))))
+      (garbage-collect))
+    (dolist (x keep)
+      (should (= (nth 1 x) (* 1.5 (car x))))
+      (should (equal (symbol-name (nth 2 x)) (number-to-string (car x)))))
+    (let ((sweep-time (assq 'sweep-time (garbage-collect))))
+      (should (floatp (nth 1 sweep-time))))))
+
+;; Stores into objects that were marked in an earlier step of an
+;; incremental collection.
+(defvar-local alloc-tests--local nil)
+
+(defun alloc-tests--step-until-done (fn)
+  "Call `garbage-collect-step' until it finishes, calling FN in between.
+FN is called with the number of steps done so far."
+  (let ((steps 0))
+    (while (not (garbage-collect-step 0))
+      (funcall fn steps)
+      (setq steps (1+ steps)))
+    steps))
+
+(defvar alloc-tests--old nil
+  "Objects that the marking steps reach through a global variable.
+The stack is only marked in the final step.")
+
+(ert-deftest gc-incremental-stores ()
+  "Check that objects stored between marking steps survive."
+  (let* ((lst (make-list 100 nil))
+         (vec (make-vector 100 nil))
+         (table (make-hash-table))
+         (sym (make-symbol "alloc-tests"))
+         (buf (generate-new-buffer " *alloc-tests*"))
+         (markers nil)
+         (alloc-tests--old (list lst vec table sym buf))
+         (gc-cons-threshold most-positive-fixnum))
+    (unwind-protect
+        (progn
+          (alloc-tests--step-until-done
+           (lambda (step)
+             (let ((i (% step 100)))
+               ;; New objects, each reachable only from an old one.
+               (setcar (nthcdr i lst) (list i (number-to-string i)))
+               (aset vec i (vector i (make-symbol (number-to-string i))))
+               (puthash i (list (* 1.5 i)) table)
+               (put sym 'alloc-tests (number-to-string i))
+               (with-current-buffer buf
+                 (setq alloc-tests--local (list (number-to-string i)))
+                 (insert "x")
+                 (push (point-marker) markers)))
+             (dotimes (_ 100)
+               (make-list 10 'garbage))))
+          (dotimes (_ 2)
+            (dotimes (i 100)
+              (let ((elt (nth i lst)))
+                (when elt
+                  (should (equal elt (list i (number-to-string i))))))
+              (let ((elt (aref vec i)))
+                (when elt
+                  (should (equal (aref elt 0) i))
+                  (should (equal (symbol-name (aref elt 1))
+                                 (number-to-string i)))))
+              (let ((elt (gethash i table)))
+                (when elt
+                  (should (equal elt (list (* 1.5 i)))))))
+            (should (stringp (get sym 'alloc-tests)))
+            (should (stringp (car (buffer-local-value 'alloc-tests--local
+                                                      buf))))
+            (dolist (m markers)
+              (should (eq (marker-buffer m) buf)))
+            (garbage-collect)))
+      (kill-buffer buf))))
+
+(ert-deftest gc-incremental-interrupted ()
+  "Check that full collections during an incremental one work."
+  (let ((keep (make-list 1000 nil)))
+    (should-not (garbage-collect-step 0))
+    (garbage-collect)
+    (should-not (garbage-collect-step 0))
+    ;; An automatic collection finishes the one under way.
+    (let ((gc-cons-threshold 20000)
+          (gcs gcs-done)
+          (tail keep)
+          (i 0))
+      (while tail
+        (setcar tail (list i (number-to-string i)))
+        (setq tail (cdr tail) i (1+ i))
+        (make-list 100 'garbage))
+      (should (> gcs-done gcs)))
+    (garbage-collect)
+    (let ((i 0))
+      (dolist (elt keep)
+        (should (equal elt (list i (number-to-string i))))
+        (setq i (1+ i))))))
+
+;;; alloc-tests.el ends here
@@ -0,0 +1,225 @@
+;;; buffer-tests.el --- tests for src/buffer.c
+
+;; Copyright (C) 2014 Free Software Foundation, Inc.
+
+;; This file is part of GNU Emacs.
+
+;; This program is free software: you can redistribute it and/or
+;; modify it under the terms of the GNU General Public License as
+;; published by the Free Software Foundation, either version 3 of the
+;; License, or (at your option) any later version.
+;;
+;; This program is distributed in the hope that it will be useful, but
+;; WITHOUT ANY WARRANTY; without even the implied warranty of
+;; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+;; General Public License for more details.
+;;
+;; You should have received a copy of the GNU General Public License
+;; along with this program.  If not, see `http://www.gnu.org/licenses/'.
+
+;;; Commentary:
+
+;;; Code:
+
+(require 'ert)
+(require 'cl-lib)
+
+(ert-deftest overlay-basic-positions ()
+  (with-temp-buffer
+    (insert "0123456789")
+    (let ((ov (make-overlay 3 7)))
+      (should (= (overlay-start ov) 3))
+      (should (= (overlay-end ov) 7))
+      (should (eq (overlay-buffer ov) (current-buffer)))
+      ;; Reversed and out of range arguments are normalized.
+      (move-overlay ov 20 5)
+      (should (= (overlay-start ov) 5))
+      (should (= (overlay-end ov) 11))
+      (delete-overlay ov)
+      (should-not (overlay-start ov))
+      (should-not (overlay-end ov))
+      (should-not (overlay-buffer ov)))))
+
+(ert-deftest overlay-queries ()
+  (with-temp-buffer
+    (insert (make-string 100 ?x))
+    (let ((a (make-overlay 10 20))
+          (b (make-overlay 15 30))
+          (c (make-overlay 40 40))
+          (d (make-overlay 50 60)))
+      (should (equal (sort (overlays-at 15) (lambda (x y)
+                                              (< (overlay-start x)
+                                                 (overlay-start y))))
+                     (list a b)))
+      (should (equal (overlays-at 20) (list b)))
+      (should-not (overlays-at 40))
+      (should (memq c (overlays-in 40 45)))
+      (should-not (memq d (overlays-in 40 45)))
+      (should (= (next-overlay-change 1) 10))
+      (should (= (next-overlay-change 10) 15))
+      (should (= (next-overlay-change 20) 30))
+      (should (= (next-overlay-change 30) 40))
+      (should (= (next-overlay-change 60) (point-max)))
+      (should (= (previous-overlay-change 55) 50))
+      (should (= (previous-overlay-change 50) 40))
+      (should (= (previous-overlay-change 25) 20))
+      (should (= (previous-overlay-change 10) (point-min)))
+      (should (= (length (car (overlay-lists))) 4)))))
+
+(ert-deftest overlay-insertion-types ()
+  (with-temp-buffer
+    (insert "abcdef")
+    (let ((plain (make-overlay 3 5))
+          (front (make-overlay 3 5 nil t))
+          (rear (make-overlay 3 5 nil nil t))
+          (empty (make-overlay 3 3 nil t nil)))
+      (goto-char 3)
+      (insert "XX")
+      (should (equal (list (overlay-start plain) (overlay-end plain))
+                     '(3 7)))
+      (should (equal (list (overlay-start front) (overlay-end front))
+                     '(5 7)))
+      (should (equal (list (overlay-start rear) (overlay-end rear))
+                     '(3 7)))
+      (should (equal (list (overlay-start empty) (overlay-end empty))
+                     '(3 3)))
+      (goto-char 7)
+      (insert-before-markers "YY")
+      (should (equal (list (overlay-start plain) (overlay-end plain))
+                     '(3 9)))
+      (delete-region 2 8)
+      (should (equal (list (overlay-start plain) (overlay-end plain))
+                     '(2 3)))
+      (should (equal (list (overlay-start empty) (overlay-end empty))
+                     '(2 2))))))
+
+(ert-deftest overlay-evaporate ()
+  (with-temp-buffer
+    (insert "abcdef")
+    (let ((ov (make-overlay 2 4)))
+      (overlay-put ov 'evaporate t)
+      (delete-region 2 4)
+      (should-not (overlay-buffer ov)))))
+
+(ert-deftest overlay-indirect-buffer ()
+  (with-temp-buffer
+    (insert "abcdef")
+    (let* ((base (current-buffer))
+           (indirect (make-indirect-buffer base " *overlay-indirect*"))
+           (ov (with-current-buffer indirect (make-overlay 3 5))))
+      (unwind-protect
+          (progn
+            (goto-char 1)
+            (insert "XX")
+            (should (= (overlay-start ov) 5))
+            (should (= (overlay-end ov) 7))
+            (transpose-regions 1 3 5 7)
+            (should (= (overlay-start ov) 1))
+            (should (= (overlay-end ov) 7)))
+        (kill-buffer indirect))
+      (should-not (overlay-buffer ov)))))
+
+(ert-deftest overlay-random-edits-like-markers ()
+  "Check that overlay ends move exactly like markers."
+  (with-temp-buffer
+    (let ((pairs nil))
+      (random "overlay-random-edits")
+      (insert (make-string 200 ?x))
+      (dotimes (_ 300)
+        (let* ((beg (1+ (random 200)))
+               (end (min (point-max) (+ beg (random 20))))
+               (front (zerop (random 2)))
+               (rear (zerop (random 2)))
+               (ov (make-overlay beg end nil front rear))
+               (mb (copy-marker beg front))
+               (me (copy-marker end rear)))
+          (push (list ov mb me) pairs)))
+      (dotimes (_ 500)
+        (let ((pos (1+ (random (point-max)))))
+          (pcase (random 3)
+            (0 (goto-char pos) (insert (make-string (1+ (random 5)) ?y)))
+            (1 (goto-char pos)
+               (insert-before-markers (make-string (1+ (random 5)) ?z)))
+            (2 (delete-region pos (min (point-max) (+ pos (random 10))))))))
+      (dolist (p pairs)
+        (let ((ov (nth 0 p)) (mb (nth 1 p)) (me (nth 2 p)))
+          (should (= (overlay-end ov) (marker-position me)))
+          ;; An empty overlay whose start advances but whose end
+          ;; doesn't keeps its start before inserted text.
+          (should (= (overlay-start ov)
+                     (min (marker-position mb) (marker-position me))))))
+      (let ((all (car (overlay-lists))))
+        (should (= (length all) 300))
+        (dolist (pos (number-sequence 1 (point-max) 7))
+          (should (= (length (overlays-at pos))
+                     (cl-count-if (lambda (ov)
+                                    (and (<= (overlay-start ov) pos)
+                                         (< pos (overlay-end ov))))
+                                  all))))))))
+
+;;; Conversions between character and byte positions.
+
+(ert-deftest position-index-random-edits ()
+  "Check `position-bytes' and `byte-to-position' in a large buffer."
+  (with-temp-buffer
+    (random "position-index")
+    (dotimes (_ 20000)
+      (insert (if (zerop (random 3)) "\u6f22\u5b57" "text ")))
+    (let ((position-index-hits 0))
+      (dotimes (i 300)
+        (when (zerop (% i 10))
+          (let ((pos (1+ (random (point-max)))))
+            (pcase (random 3)
+              (0 (goto-char pos) (insert "\u00c4\u20ac"))
+              (1 (delete-region pos (min (point-max) (+ pos (random 30)))))
+              (2 (when (< (+ pos 40) (point-max))
+                   (transpose-regions pos (+ pos 10) (+ pos 20) (+ pos 40)))))))
+        (let* ((pos (1+ (random (point-max))))
+               (byte (position-bytes pos)))
+          (should (= byte (1+ (string-bytes
+                               (buffer-substring-no-properties 1 pos)))))
+          (should (= (byte-to-position byte) pos))))
+      (should (> position-index-hits 0)))))
+
+;;; Counting lines.
+
+(defun buffer-tests--count-newlines (beg end)
+  (let ((n 0))
+    (save-excursion
+      (goto-char beg)
+      (while (search-forward "\n" end t)
+        (setq n (1+ n))))
+    n))
+
+(ert-deftest line-index-random-edits ()
+  "Check `count-lines' and `forward-line' in a large buffer."
+  (with-temp-buffer
+    (random "line-index")
+    (dotimes (_ 20000)
+      (insert (make-string (random 40) (if (zerop (random 4)) ?é ?x))
+              "\n"))
+    (dotimes (_ 100)
+      (let ((pos (1+ (random (point-max)))))
+        (pcase (random 4)
+          (0 (goto-char pos) (insert "ab\ncd\n\n"))
+          (1 (delete-region pos (min (point-max) (+ pos (random 3000)))))
+          (2 (subst-char-in-region pos (min (point-max) (+ pos 200)) ?\n ?y))
+          (3 (subst-char-in-region pos (min (point-max) (+ pos 200)) ?x ?\n))))
+      (let* ((a (1+ (random (point-max))))
+             (b (1+ (random (point-max))))
+             (n (buffer-tests--count-newlines (min a b) (max a b))))
+        (goto-char (max a b))
+        (should (= (count-lines a b)
+                   (if (or (= a b) (bolp)) n (1+ n))))
+        (when (> n 0)
+          (goto-char (min a b))
+          (should (= (forward-line n) 0))
+          (should (= (buffer-tests--count-newlines (min a b) (point)) n))
+          (should (= (char-before) ?\n)))))
+    (let ((stats (buffer-line-statistics)))
+      (should (= (car stats) (count-lines (point-min) (point-max))))
+      (should (= (nth 1 stats)
+                 (apply #'max (mapcar #'string-bytes
+                                      (split-string (buffer-string) "\n"))))))))
+
+;;; buffer-tests.el ends here
@@ -0,0 +1,195 @@
+;;; byte-native-tests.el --- Tests for byte-native.el -*- lexical-binding: t -*-
+
+;; Copyright (C) 2014 Free Software Foundation, Inc.
+
+;; This file is part of GNU Emacs.
+
+;; GNU Emacs is free software: you can redistribute it and/or modify
+;; it under the terms of the GNU General Public License as published by
+;; the Free Software Foundation, either version 3 of the License, or
+;; (at your option) any later version.
+
+;; GNU Emacs is distributed in the hope that it will be useful,
+;; but WITHOUT ANY WARRANTY; without even the implied warranty of
+;; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+;; GNU General Public License for more details.
+
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.
+
+;;; Commentary:
+
+;; These tests compile a file to native code, and check that its
+;; functions give the same results as interpreted code.  They are
+;; skipped if Emacs cannot load native code, or if there is no C
+;; compiler or no headers of this Emacs to compile it with.
+
+;;; Code:
+
+(require 'ert)
+(require 'bytecomp)
+(require 'byte-native)
+
+(defconst byte-native-tests--definitions
+  '((defvar byte-native-tests--var 1)
+    (defun byte-native-tests--sum (n)
+      (let ((sum 0) (i 0))
+        (while (< i n)
+          (setq sum (+ sum i) i (1+ i)))
+        sum))
+    (defun byte-native-tests--arith (a b)
+      (list (+ a b) (- a b) (* a b) (/ a b) (% a b) (max a b) (min a b)
+            (1+ a) (1- b) (- a) (= a b) (< a b) (<= a b) (> a b) (>= a b)))
+    (defun byte-native-tests--lists (l)
+      (let ((result nil))
+        (dolist (x l)
+          (push (if (consp x) (car-safe x) (list x (length l))) result))
+        (list (nreverse result) (nth 1 l) (nthcdr 2 l) (memq 'b l)
+              (member "c" l) (assq 'd l) (elt l 0) (cdr-safe l)
+              (listp l) (stringp l) (symbolp (car l)) (append l nil))))
+    (defun byte-native-tests--strings (s &optional n &rest more)
+      (list (concat s s) (concat s "-" (apply #'concat more))
+            (substring s (or n 0)) (upcase s) (downcase s)
+            (string= s "abc") (string< s "b") (equal s (copy-sequence s))
+            (aref s 0) (let ((v (make-vector 2 nil)))
+                         (aset v 1 s)
+                         v)))
+    (defun byte-native-tests--buffer (text)
+      (with-temp-buffer
+        (insert text)
+        (goto-char (point-min))
+        (let ((words 0))
+          (while (progn (skip-chars-forward "^a-z") (not (eobp)))
+            (setq words (1+ words))
+            (forward-word 1))
+          (save-excursion
+            (save-restriction
+              (narrow-to-region 2 4)
+              (list words (point-min) (point-max) (bobp) (eolp)
+                    (buffer-substring (point-min) (point-max))
+                    (char-syntax ?a) (following-char) (preceding-char)
+                    (current-column) (char-after 1)))))))
+    (defun byte-native-tests--dynamic (x)
+      (let ((byte-native-tests--var x))
+        (byte-native-tests--read-var)))
+    (defun byte-native-tests--read-var ()
+      (setq byte-native-tests--var (list byte-native-tests--var))
+      byte-native-tests--var)
+    (defun byte-native-tests--handlers (x)
+      (list (catch 'tag
+              (if (eq x 'throw) (throw 'tag 'thrown) 'normal))
+            (condition-case err
+                (if (eq x 'error) (car x) 'no-error)
+              (wrong-type-argument (list 'caught err)))
+            (let ((log nil))
+              (ignore-errors
+                (unwind-protect
+                    (if (eq x 'error) (error "Oops") (push 'body log))
+                  (push 'unwound log)))
+              log)))
+    (defun byte-native-tests--closure (n)
+      (let ((fs nil))
+        (dotimes (i n)
+          (push (lambda (x) (+ x i)) fs))
+        (mapcar (lambda (f) (funcall f 10)) fs)))
+    (defun byte-native-tests--signal (x)
+      (car x)))
+  "Functions to compile both to byte code and to native code.")
+
+(defconst byte-native-tests--calls
+  `((byte-native-tests--sum 0) (byte-native-tests--sum 1000)
+    (byte-native-tests--arith 7 3) (byte-native-tests--arith -7 2)
+    (byte-native-tests--arith 7.5 2) (byte-native-tests--arith 1 0)
+    (byte-native-tests--arith ,most-positive-fixnum 1)
+    (byte-native-tests--arith a 1)
+    (byte-native-tests--lists (a b "c" (d . 1) 5))
+    (byte-native-tests--lists nil)
+    (byte-native-tests--lists 1)
+    (byte-native-tests--strings "abc")
+    (byte-native-tests--strings "xyz" 1 "p" "q")
+    (byte-native-tests--strings "")
+    (byte-native-tests--buffer "one two\nthree") (byte-native-tests--buffer "")
+    (byte-native-tests--dynamic 5)
+    (byte-native-tests--handlers throw) (byte-native-tests--handlers error)
+    (byte-native-tests--handlers nil)
+    (byte-native-tests--closure 3)
+    (byte-native-tests--signal (1 . 2)) (byte-native-tests--signal 1))
+  "Calls of the functions in `byte-native-tests--definitions'.")
+
+(defun byte-native-tests--can-compile ()
+  "Return non-nil if this Emacs can compile byte code to native code."
+  (and (boundp 'load-native-code)
+       (executable-find byte-native-compiler)
+       (locate-file "config.h" byte-native-include-directories)
+       (locate-file "lisp.h" byte-native-include-directories)))
+
+(defun byte-native-tests--results ()
+  "Return the results of `byte-native-tests--calls', with any errors."
+  (mapcar (lambda (call)
+            (condition-case err
+                (list 'value (apply (car call) (cdr call)))
+              (error (list 'error err))))
+          byte-native-tests--calls))
+
+(defun byte-native-tests--check (lexical)
+  "Check that native code and interpreted code give the same results.
+Compile the test functions with `lexical-binding' set to LEXICAL."
+  (let* ((dir (make-temp-file "byte-native-tests" t))
+         (source (expand-file-name "byte-native-test-file.el" dir))
+         (elc (concat source "c"))
+         (byte-compile-warnings nil)
+         expected)
+    (unwind-protect
+        (progn
+          (dolist (form byte-native-tests--definitions)
+            (eval form lexical))
+          (setq expected (byte-native-tests--results))
+          (with-temp-file source
+            (insert (format ";;; -*- lexical-binding: %S -*-\n" lexical))
+            (dolist (form byte-native-tests--definitions)
+              (prin1 form (current-buffer))
+              (insert "\n")))
+          (should (equal (byte-native-compile-file source)
+                         (expand-file-name "byte-native-test-file.eln" dir)))
+          (load elc nil t)
+          (dolist (call byte-native-tests--calls)
+            (should (native-byte-code-p (symbol-function (car call)))))
+          (should (equal (byte-native-tests--results) expected)))
+      (delete-directory dir t))))
+
+(ert-deftest byte-native-tests-lexical ()
+  (skip-unless (byte-native-tests--can-compile))
+  (byte-native-tests--check t))
+
+(ert-deftest byte-native-tests-dynamic ()
+  (skip-unless (byte-native-tests--can-compile))
+  (byte-native-tests--check nil))
+
+(ert-deftest byte-native-tests-new-handlers ()
+  "Check the handler instructions that the byte compiler can emit."
+  (skip-unless (byte-native-tests--can-compile))
+  (let ((byte-compile--use-old-handlers nil))
+    (byte-native-tests--check t)))
+
+(ert-deftest byte-native-tests-unsupported ()
+  "Check that functions with unsupported instructions stay byte code."
+  ;; Bsave_window_excursion is not handled.
+  (should (stringp (catch 'byte-native-unsupported
+                     (byte-native--function-c "f" (unibyte-string #o213 #o207)
+                                              1))))
+  ;; The stack is deeper at the join after the `goto-if-nil'.
+  (should (stringp (catch 'byte-native-unsupported
+                     (byte-native--function-c
+                      "f" (unibyte-string #o300 #o203 5 0 #o300 #o300 #o207)
+                      0))))
+  ;; Falling off the end.
+  (should (stringp (catch 'byte-native-unsupported
+                     (byte-native--function-c "f" (unibyte-string #o300)
+                                              0))))
+  (should (stringp (catch 'byte-native-unsupported
+                     (byte-native--function-c "f" (unibyte-string #o207)
+                                              0)))))
+
+(provide 'byte-native-tests)
+
+;;; byte-native-tests.el ends here
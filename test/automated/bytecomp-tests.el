@@ -394,6 +394,71 @@ Subtests signal errors if something goes wrong."
       (defun def () (m))))
   (should (equal (funcall 'def) 4)))
 
+(defvar bytecomp-tests--list nil)
+
+(ert-deftest bytecomp-tests-decoded-loops ()
+  "Check loops that use the superinstructions of decoded byte code."
+  (dolist (lexical-binding '(nil t))
+    (let ((count (byte-compile
+                  '(lambda (l x)
+                     (let ((n 0))
+                       (while l
+                         (if (eq (car l) x) (setq n (1+ n)))
+                         (setq l (cdr l)))
+                       n))))
+          (first (byte-compile
+                  '(lambda ()
+                     (if bytecomp-tests--list (car bytecomp-tests--list)
+                       'empty)))))
+      (should (= (funcall count '(a b a c a) 'a) 3))
+      (should (= (funcall count '(a b a c a) 'd) 0))
+      (should-error (funcall count '(a . b) 'a) :type 'wrong-type-argument)
+      (let ((bytecomp-tests--list nil))
+        (should (eq (funcall first) 'empty)))
+      (let ((bytecomp-tests--list '(x y)))
+        (should (eq (funcall first) 'x)))
+      (let ((bytecomp-tests--list 'x))
+        (should-error (funcall first) :type 'wrong-type-argument)))))
+
+(ert-deftest bytecomp-tests-decoded-handlers ()
+  "Check that a handler resumes at the right instruction."
+  (let ((f (byte-compile
+            '(lambda (n)
+               (let ((caught 0) (thrown 0))
+                 (dotimes (i n)
+                   (condition-case nil
+                       (if (= (% i 2) 0) (error "Even"))
+                     (error (setq caught (1+ caught))))
+                   (setq thrown (+ thrown (catch 'tag
+                                            (if (= (% i 3) 0) (throw 'tag 1))
+                                            0))))
+                 (list caught thrown))))))
+    (should (equal (funcall f 12) '(6 4)))))
+
+(ert-deftest bytecomp-tests-hand-written-byte-code ()
+  "Check byte code that the compiler does not produce."
+  ;; Bconstant 0, BRgotoifnil 5, Bconstant 1, Breturn, Bconstant 2, Breturn.
+  (should (eq (byte-code "\300\253\202\301\207\302\207" [nil a b] 2) 'b))
+  (should (eq (byte-code "\300\253\202\301\207\302\207" [t a b] 2) 'a))
+  ;; A byte-code string that has been made multibyte.
+  (should (eq (byte-code (string-to-multibyte "\300\207") [a] 1) 'a))
+  ;; Bstack_ref 0 is not valid, and neither is running off the end.
+  (should (equal (condition-case err (byte-code "\0" [] 1) (error err))
+                 '(error "Invalid byte opcode: op=0, ptr=0")))
+  (should (equal (condition-case err (byte-code "\300" [a] 1) (error err))
+                 '(error "Invalid byte opcode: op=0, ptr=1"))))
+
+(ert-deftest bytecomp-tests-changed-byte-code ()
+  "Check that changing a byte-code string in place takes effect."
+  ;; Bconstant 0, Breturn; then Bconstant 1, Breturn.
+  (let* ((s (unibyte-string 192 135))
+         (f (make-byte-code 0 s [1 2] 2)))
+    (should (= (funcall f) 1))
+    (aset s 0 193)
+    (should (= (funcall f) 2))
+    (fillarray s 192)
+    (aset s 1 135)
+    (should (= (funcall f) 1))))
 
 ;; Local Variables:
 ;; no-byte-compile: t
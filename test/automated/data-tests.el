@@ -74,6 +74,47 @@
   ;; Short circuits before getting to bad arg
   (should-not (>= 8 9 'foo)))
 
+(defconst data-tests--numbers
+  (list 0 1 -1 7 most-positive-fixnum most-negative-fixnum
+        0.0 -0.0 2.5 -1.5 1.0e+INF -1.0e+INF 0.0e+NaN)
+  "Numbers that are edge cases for arithmetic.")
+
+(ert-deftest data-tests-arith-two-args ()
+  "Check that arithmetic on two numbers agrees with the general case.
+Two arguments take a fast path, both in byte code and in
+`funcall'; adding the identity as a third argument does not."
+  (dolist (op '((+ . 0) (- . 0) (* . 1) (/ . 1)))
+    (let ((compiled (byte-compile `(lambda (x y) (,(car op) x y)))))
+      (dolist (x data-tests--numbers)
+        (dolist (y data-tests--numbers)
+          (let ((expected (condition-case nil
+                              (format "%S" (funcall (car op) x y (cdr op)))
+                            (arith-error 'arith-error))))
+            (dolist (f (list (car op) compiled))
+              (should (equal (list (car op) x y
+                                   (condition-case nil
+                                       (format "%S" (funcall f x y))
+                                     (arith-error 'arith-error)))
+                             (list (car op) x y expected))))))))))
+
+(ert-deftest data-tests-arith-two-args-other ()
+  "Check arithmetic on two arguments that are not both numbers."
+  (let ((plus (byte-compile '(lambda (x y) (+ x y))))
+        (less (byte-compile '(lambda (x y) (< x y)))))
+    (with-temp-buffer
+      (insert "abc")
+      (let ((m (copy-marker 3)))
+        (should (= (funcall plus m 1) 4))
+        (should (= (funcall plus 1.5 m) 4.5))
+        (should (funcall less m 4))
+        (should-not (funcall less m 2.5))))
+    (should-error (funcall plus 'a 1) :type 'wrong-type-argument)
+    (should-error (funcall less 1 nil) :type 'wrong-type-argument)
+    (should-not (funcall less 1 0.0e+NaN))
+    (should-not (funcall less 0.0e+NaN 1))
+    (should-not (= 0.0e+NaN 0.0e+NaN))
+    (should (/= 0.0e+NaN 0.0e+NaN))))
+
 ;; Bool vector tests.  Compactly represent bool vectors as hex
 ;; strings.
 
@@ -255,3 +296,55 @@ comparing the subr with a much slower lisp implementation."
          (v2 (test-bool-vector-bv-from-hex-string "0000C"))
          (v3 (bool-vector-not v1)))
     (should (equal v2 v3))))
+
+(defvar data-tests--local nil)
+(defvar data-tests--auto-local nil)
+(make-variable-buffer-local 'data-tests--auto-local)
+
+(ert-deftest data-tests-local-variables-switching-buffers ()
+  "Check buffer-local bindings while switching between buffers."
+  (let ((a (generate-new-buffer "a"))
+        (b (generate-new-buffer "b")))
+    (unwind-protect
+        (progn
+          (with-current-buffer a
+            (set (make-local-variable 'data-tests--local) 'a)
+            (setq data-tests--auto-local 'a))
+          (dotimes (i 100)
+            (with-current-buffer b
+              (should (eq data-tests--local nil))
+              (should (eq data-tests--auto-local nil))
+              (should-not (local-variable-p 'data-tests--local)))
+            (with-current-buffer a
+              (should (eq data-tests--local 'a))
+              (should (eq data-tests--auto-local (if (= i 0) 'a (1- i))))
+              (should (local-variable-p 'data-tests--local))
+              (setq data-tests--auto-local i))
+            (should (eq (buffer-local-value 'data-tests--auto-local a) i)))
+          ;; Bindings made and removed while the other buffer is current.
+          (with-current-buffer b
+            (set (make-local-variable 'data-tests--local) 'b)
+            (should (local-variable-p 'data-tests--local a))
+            (should (eq (buffer-local-value 'data-tests--local a) 'a))
+            (with-current-buffer a
+              (kill-local-variable 'data-tests--local))
+            (should-not (local-variable-p 'data-tests--local a))
+            (should (eq (buffer-local-value 'data-tests--local a) nil))
+            (should (eq data-tests--local 'b)))
+          (with-current-buffer a
+            (should (eq data-tests--local nil))
+            (setq data-tests--local 'global)
+            (put 'data-tests--auto-local 'permanent-local t)
+            (unwind-protect
+                (kill-all-local-variables)
+              (put 'data-tests--auto-local 'permanent-local nil))
+            (should (eq data-tests--auto-local 99))
+            (should (local-variable-p 'data-tests--auto-local)))
+          (with-current-buffer b
+            (should (eq data-tests--local 'b))
+            (kill-all-local-variables)
+            (should (eq data-tests--local 'global))
+            (should-not (local-variable-p 'data-tests--auto-local))))
+      (setq data-tests--local nil)
+      (kill-buffer a)
+      (kill-buffer b))))
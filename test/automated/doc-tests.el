@@ -0,0 +1,92 @@
+;;; doc-tests.el --- Tests for doc.c -*- lexical-binding: t -*-
+
+;; Copyright (C) 2014 Free Software Foundation, Inc.
+
+;; This file is part of GNU Emacs.
+
+;; GNU Emacs is free software: you can redistribute it and/or modify
+;; it under the terms of the GNU General Public License as published by
+;; the Free Software Foundation, either version 3 of the License, or
+;; (at your option) any later version.
+
+;; GNU Emacs is distributed in the hope that it will be useful,
+;; but WITHOUT ANY WARRANTY; without even the implied warranty of
+;; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+;; GNU General Public License for more details.
+
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.
+
+;;; Code:
+
+(require 'ert)
+
+(defun doc-tests--docs ()
+  "Return the raw doc strings of some preloaded functions and variables."
+  (list (documentation 'car t)
+        (documentation 'find-file t)
+        (documentation-property 'fill-column 'variable-documentation t)
+        (documentation-property 'load-path 'variable-documentation t)))
+
+(defun doc-tests--snarf-copy (index)
+  "Snarf a copy of the DOC file, with INDEX as the contents of its index.
+INDEX nil means leave the copy without an index.  Return the doc strings
+that `doc-tests--docs' finds in the copy."
+  (let* ((dir (file-name-as-directory (make-temp-file "doc-tests" t)))
+         (doc (expand-file-name internal-doc-file-name doc-directory)))
+    (unwind-protect
+        (progn
+          (copy-file doc dir)
+          (when index
+            (with-temp-file (concat dir internal-doc-file-name ".idx")
+              (insert index)))
+          (let ((doc-directory dir))
+            (Snarf-documentation internal-doc-file-name)
+            (doc-tests--docs)))
+      (Snarf-documentation internal-doc-file-name)
+      (delete-directory dir t))))
+
+(ert-deftest doc-tests-builtin ()
+  (should (integerp (get 'fill-column 'variable-documentation)))
+  (let ((docs (doc-tests--docs)))
+    (should (string-match "\\`Return the car of LIST" (nth 0 docs)))
+    (should (string-match "\\`Edit file FILENAME" (nth 1 docs)))
+    (should (string-match "\\`Column beyond which" (nth 2 docs)))
+    (should (string-match "\\`List of directories to search" (nth 3 docs)))
+    ;; Fetching the same doc strings again gives the same result.
+    (should (equal (doc-tests--docs) docs))))
+
+(ert-deftest doc-tests-snarf ()
+  "Check that the DOC file gives the same doc strings with or
+without its index, and when the index is out of date."
+  (let ((docs (doc-tests--docs)))
+    (should (equal (doc-tests--snarf-copy nil) docs))
+    (should (equal (doc-tests--snarf-copy "1\nFcar 1\n") docs))
+    (should (equal (doc-tests--snarf-copy "junk") docs))
+    (should (equal (doc-tests--docs) docs))))
+
+(ert-deftest doc-tests-file-after-doc ()
+  "Check fetching a doc string from a byte-compiled file after one
+from the DOC file, which leaves a small doc string buffer."
+  (let ((file (make-temp-file "doc-tests" nil ".elc"))
+        pos)
+    (unwind-protect
+        (progn
+          (with-temp-file file
+            (dotimes (_ 500)
+              (insert "#@26 " (make-string 25 ?x) "\037\n"))
+            (insert "#@31 ")
+            (setq pos (1- (point)))
+            (insert "Doc string in a compiled file.\037\n"))
+          (should (> (% pos (* 8 1024)) 1024))
+          (documentation 'car t)
+          (should (equal (documentation
+                          (make-byte-code () "\300\207" [nil] 1
+                                          (cons file pos))
+                          t)
+                         "Doc string in a compiled file.")))
+      (delete-file file))))
+
+(provide 'doc-tests)
+
+;;; doc-tests.el ends here
@@ -0,0 +1,131 @@
+;;; emacs-module-tests.el --- Tests for emacs-module.c -*- lexical-binding: t -*-
+
+;; Copyright (C) 2014 Free Software Foundation, Inc.
+
+;; This file is part of GNU Emacs.
+
+;; GNU Emacs is free software: you can redistribute it and/or modify
+;; it under the terms of the GNU General Public License as published by
+;; the Free Software Foundation, either version 3 of the License, or
+;; (at your option) any later version.
+
+;; GNU Emacs is distributed in the hope that it will be useful,
+;; but WITHOUT ANY WARRANTY; without even the implied warranty of
+;; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+;; GNU General Public License for more details.
+
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.
+
+;;; Commentary:
+
+;; These tests load the sample module in modules/mod-test, which the
+;; Makefile builds when Emacs is configured --with-modules.  They are
+;; skipped if Emacs cannot load modules.
+
+;;; Code:
+
+(require 'ert)
+
+(defconst emacs-module-tests--module
+  (and (boundp 'module-file-suffix)
+       (expand-file-name (concat "../../modules/mod-test/mod-test"
+                                 module-file-suffix)))
+  "The file name of the sample module.")
+
+(defun emacs-module-tests--load ()
+  "Load the sample module unless it is loaded already.
+Return nil if Emacs cannot load it."
+  (and (fboundp 'module-load)
+       (file-exists-p emacs-module-tests--module)
+       (or (featurep 'mod-test)
+           (module-load emacs-module-tests--module))))
+
+(ert-deftest emacs-module-tests-load ()
+  (skip-unless (emacs-module-tests--load))
+  (should (featurep 'mod-test))
+  ;; Loading a module again runs its initialization again.
+  (should (eq (module-load emacs-module-tests--module) t))
+  (should (functionp 'mod-test-sum))
+  (should (equal (documentation 'mod-test-sum) "Return A + B.\n\n(fn A B)"))
+  (should (eq (car (should-error
+                    (module-load (expand-file-name "no-such-module.so"
+                                                   temporary-file-directory))))
+              'module-open-failed))
+  (should (memq 'module-error (get 'module-not-gpl-compatible
+                                   'error-conditions))))
+
+(ert-deftest emacs-module-tests-call ()
+  (skip-unless (emacs-module-tests--load))
+  (should (eq (mod-test-return-t 'x) t))
+  (should (= (mod-test-sum 1 2) 3))
+  (should (= (mod-test-sum most-positive-fixnum (- most-positive-fixnum))
+             0))
+  (should (= (funcall #'mod-test-sum -4 5) 1))
+  (should (= (apply #'mod-test-sum '(10 20)) 30))
+  (should (= (mod-test-data) 42))
+  (should (= (mod-test-float-sum) 0.0))
+  (should (= (mod-test-float-sum 1 2.5 -0.5) 3.0))
+  (should (eq (car (should-error (mod-test-sum 1))) 'wrong-number-of-arguments))
+  (should (eq (car (should-error (mod-test-sum 1 2 3)))
+              'wrong-number-of-arguments))
+  (should-error (mod-test-sum 1 "2") :type 'wrong-type-argument)
+  (should-error (mod-test-float-sum 1 'a) :type 'wrong-type-argument)
+  (should-error (mod-test-sum most-positive-fixnum 1) :type 'overflow-error))
+
+(ert-deftest emacs-module-tests-non-local-exit ()
+  (skip-unless (emacs-module-tests--load))
+  (should (equal (should-error (mod-test-signal)) '(error 56)))
+  (should (equal (catch 'tag (mod-test-throw) 'not-thrown) 65))
+  (should (equal (mod-test-non-local-exit-funcall (lambda () 23))
+                 '(normal . 23)))
+  (should (equal (mod-test-non-local-exit-funcall
+                  (lambda () (signal 'error '(32))))
+                 '(signal error 32)))
+  (should (equal (mod-test-non-local-exit-funcall
+                  (lambda () (throw 'tag 32)))
+                 '(throw tag . 32)))
+  ;; The innermost module function sees the throw first.
+  (should (equal (catch 'outer
+                   (mod-test-non-local-exit-funcall
+                    (lambda ()
+                      (mod-test-non-local-exit-funcall
+                       (lambda () (throw 'outer 1))))))
+                 '(normal throw outer . 1)))
+  ;; A throw without a catch still signals `no-catch'.
+  (should (equal (should-error (mod-test-throw)) '(no-catch tag 65)))
+  ;; Module functions nest.
+  (should (equal (mod-test-non-local-exit-funcall
+                  (lambda () (mod-test-sum 3 4)))
+                 '(normal . 7)))
+  (should (equal (mod-test-non-local-exit-funcall #'mod-test-signal)
+                 '(signal error 56))))
+
+(ert-deftest emacs-module-tests-values ()
+  (skip-unless (emacs-module-tests--load))
+  (let ((string (mod-test-globref-make)))
+    (garbage-collect)
+    (should (equal string (make-string 100 ?x))))
+  (should (equal (mod-test-string-a-to-b "aaa") "bbb"))
+  (should (equal (mod-test-string-a-to-b "") ""))
+  (should (equal (mod-test-string-a-to-b "été à la plage") "été à lb plbge"))
+  ;; Unibyte strings go to modules as raw bytes, and invalid UTF-8
+  ;; comes back as raw bytes.
+  (should (equal (mod-test-string-a-to-b "caf\351")
+                 (string-to-multibyte "cbf\351")))
+  (should (eq (mod-test-flex-match "fb" "foo-bar") 3))
+  (should (eq (mod-test-flex-match "foo" "foo") 0))
+  (should (null (mod-test-flex-match "bf" "foo-bar")))
+  (should-error (mod-test-flex-match "f" (make-string 300 ?f))
+                :type 'args-out-of-range)
+  (let ((v (make-vector 1000 nil)))
+    (should (eq (mod-test-vector-fill v 'x) t))
+    (should (equal v (make-vector 1000 'x)))
+    (should (eq (mod-test-vector-eq v 'x) t))
+    (aset v 999 'y)
+    (should-not (mod-test-vector-eq v 'x)))
+  (should-error (mod-test-vector-fill "abc" 1) :type 'wrong-type-argument))
+
+(provide 'emacs-module-tests)
+
+;;; emacs-module-tests.el ends here
@@ -189,3 +189,54 @@
 	      (string-collate-lessp
 	       a b (if (eq system-type 'windows-nt) "enu_USA" "en_US.UTF-8")))))
     '("Adrian" "Ævar" "Agustín" "Eli"))))
+
+(ert-deftest fns-tests-hash-table-grow-and-remove ()
+  (let ((h (make-hash-table :test 'equal :size 3)))
+    (dotimes (i 1000)
+      (puthash (number-to-string i) i h))
+    (should (= (hash-table-count h) 1000))
+    (should (>= (hash-table-size h) 1000))
+    (dotimes (i 1000)
+      (when (zerop (% i 3))
+        (remhash (number-to-string i) h)))
+    (dotimes (i 1000)
+      (should (eq (gethash (number-to-string i) h 'none)
+                  (if (zerop (% i 3)) 'none i))))
+    ;; Removed entries are reused by new ones.
+    (let ((size (hash-table-size h)))
+      (dotimes (i 300)
+        (puthash (list i) i h))
+      (should (= (hash-table-size h) size)))
+    (let ((copy (copy-hash-table h)))
+      (clrhash h)
+      (should (= (hash-table-count h) 0))
+      (should (= (hash-table-count copy) 966))
+      (should (= (gethash '(7) copy) 7))
+      (should (= (gethash "1" copy) 1)))))
+
+(ert-deftest fns-tests-hash-table-print-read ()
+  (let ((h (make-hash-table :test 'eq :size 4)))
+    (puthash 'a 1 h)
+    (puthash 'b 2 h)
+    (puthash 'c 3 h)
+    (remhash 'b h)
+    (should (equal (prin1-to-string h)
+                   "#s(hash-table size 4 test eq rehash-size 1.5 rehash-threshold 0.8 data (a 1 c 3))"))
+    (let ((r (read (prin1-to-string h))))
+      (should (= (hash-table-count r) 2))
+      (should (= (gethash 'c r) 3)))))
+
+(ert-deftest fns-tests-hash-table-weak ()
+  (let ((h (make-hash-table :test 'equal :weakness 'key))
+        (keep (list 'keep)))
+    (puthash keep 1 h)
+    (dotimes (i 100)
+      (puthash (list i) i h))
+    (garbage-collect)
+    ;; Conservative stack scanning may keep a few keys alive.
+    (should (< (hash-table-count h) 50))
+    (should (= (gethash keep h) 1))
+    (dotimes (i 100)
+      (puthash (list i) i h))
+    (should (= (gethash (list 42) h) 42))
+    (should (= (gethash keep h) 1))))
@@ -0,0 +1,261 @@
+;;; json-tests.el --- Tests for json.c -*- lexical-binding: t -*-
+
+;; Copyright (C) 2014 Free Software Foundation, Inc.
+
+;; This file is part of GNU Emacs.
+
+;; GNU Emacs is free software: you can redistribute it and/or modify
+;; it under the terms of the GNU General Public License as published by
+;; the Free Software Foundation, either version 3 of the License, or
+;; (at your option) any later version.
+
+;; GNU Emacs is distributed in the hope that it will be useful,
+;; but WITHOUT ANY WARRANTY; without even the implied warranty of
+;; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+;; GNU General Public License for more details.
+
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.
+
+;;; Code:
+
+(require 'ert)
+(require 'cl-lib)
+(require 'json)
+
+(ert-deftest json-tests-parse-values ()
+  (should (equal (json-parse-string "[true, false, null]") [t :false :null]))
+  (should (equal (json-parse-string "[true, false, null]"
+                                    :false-object nil :null-object 'null)
+                 [t nil null]))
+  (should (equal (json-parse-string " [0, -0, 17, -42, 1.5, 2e3, -1E-2] ")
+                 [0 0 17 -42 1.5 2000.0 -0.01]))
+  (should (equal (json-parse-string (format "[%d, %d]" most-positive-fixnum
+                                            most-negative-fixnum))
+                 (vector most-positive-fixnum most-negative-fixnum)))
+  (should (floatp (json-parse-string (format "%d0" most-positive-fixnum))))
+  (should (equal (json-parse-string
+                  "\"a\\\"\\\\\\/\\b\\f\\n\\r\\t\\u00e9\\u2603\\ud83d\\ude00\\u0000\"")
+                 "a\"\\/\b\f\n\r\té☃😀\0"))
+  (should (equal (json-parse-string "\"caf\303\251\"") "café"))
+  (should (equal (json-parse-string "\"café\"") "café"))
+  (should (equal (json-parse-string "[]") []))
+  (should (equal (json-parse-string "[[1], [[]]]" :array-type 'list)
+                 '((1) (nil)))))
+
+(ert-deftest json-tests-parse-objects ()
+  (let ((table (json-parse-string "{\"a\": 1, \"é\": [2], \"a\": 3, \"\": {}}")))
+    (should (hash-table-p table))
+    (should (eq (hash-table-test table) 'equal))
+    (should (equal (hash-table-count table) 3))
+    (should (equal (gethash "a" table) 3))
+    (should (equal (gethash "é" table) [2]))
+    (should (equal (hash-table-count (gethash "" table)) 0)))
+  (should (equal (json-parse-string "{\"a\": 1, \"é\": {\"b\": 2}, \"a\": 3}"
+                                    :object-type 'alist)
+                 '((a . 1) (é (b . 2)) (a . 3))))
+  (should (equal (json-parse-string "{\"a\": 1, \"é\": {\"b\": 2}}"
+                                    :object-type 'plist)
+                 '(:a 1 :é (:b 2))))
+  (should (equal (json-parse-string "{}" :object-type 'alist) nil))
+  (should-error (json-parse-string "{}" :object-type 'vector))
+  (should-error (json-parse-string "{}" :array-type 'vector))
+  (should-error (json-parse-string "{}" :object-type))
+  (should-error (json-parse-string "{}" :foo 1)))
+
+(ert-deftest json-tests-parse-errors ()
+  (dolist (test '(("" json-end-of-file 0)
+                  ("  " json-end-of-file 2)
+                  ("[1, 2" json-end-of-file 5)
+                  ("\"abc" json-end-of-file 4)
+                  ("{\"a\": 1" json-end-of-file 7)
+                  ("[1] 2" json-trailing-content 4)
+                  ("{\"é\": x}" json-parse-error 7)
+                  ("[1,]" json-parse-error 4)
+                  ("{a: 1}" json-parse-error 2)
+                  ("[01]" json-parse-error 3)
+                  ("[1.]" json-parse-error 3)
+                  ("[-]" json-parse-error 3)
+                  ("tru" json-end-of-file 3)
+                  ("nul1" json-parse-error 4)
+                  ("\"\\x\"" json-parse-error 3)
+                  ("\"\\u12g4\"" json-parse-error 6)
+                  ("\"\\ud800\"" json-parse-error 8)
+                  ("\"\\udc00\"" json-parse-error 7)
+                  ("\"a\nb\"" json-parse-error 3)
+                  ("\"\377\"" json-parse-error 1)
+                  ("\"\355\240\200\"" json-parse-error 1)
+                  ("\"\300\257\"" json-parse-error 1)))
+    (let ((err (should-error (json-parse-string (car test)))))
+      (should (eq (car err) (nth 1 test)))
+      (should (equal (nth 2 err) (nth 2 test)))
+      (should (memq 'json-parse-error (get (car err) 'error-conditions)))))
+  (let ((deep (concat (make-string 20000 ?\[) (make-string 20000 ?\]))))
+    (should (eq (car (should-error (json-parse-string deep)))
+                'json-object-too-deep)))
+  (should-error (json-parse-string 'a) :type 'wrong-type-argument)
+  ;; Raw bytes in multibyte text are not UTF-8.
+  (should-error (json-parse-string (string-to-multibyte "\"\377\""))
+                :type 'json-parse-error))
+
+(ert-deftest json-tests-parse-buffer ()
+  (let ((text "  {\"é\": [1, \"ab☃c\", {\"x\": null}], \"y\": -12.5e1}  [2]"))
+    (dotimes (split (1+ (length text)))
+      (with-temp-buffer
+        (insert text)
+        ;; Put the gap at SPLIT.
+        (goto-char (1+ split))
+        (insert "x")
+        (delete-char -1)
+        (goto-char (point-min))
+        (should (equal (json-parse-buffer :object-type 'alist)
+                       '((é . [1 "ab☃c" ((x . :null))]) (y . -125.0))))
+        (should (= (point) (- (point-max) 5)))
+        (should (equal (json-parse-buffer) [2]))
+        (should (eobp))
+        (should (eq (car (should-error (json-parse-buffer)))
+                    'json-end-of-file)))))
+  (with-temp-buffer
+    (insert "abc [1, x]")
+    (goto-char 5)
+    (should (equal (should-error (json-parse-buffer))
+                   '(json-parse-error "Invalid value" 10)))
+    (should (= (point) 5))
+    (narrow-to-region 5 8)
+    (should (eq (car (should-error (json-parse-buffer)))
+                'json-end-of-file))))
+
+(ert-deftest json-tests-serialize ()
+  (should (equal (json-serialize [t :false :null 1 -2.5 1e100 3.0 ""])
+                 "[true,false,null,1,-2.5,1e+100,3.0,\"\"]"))
+  (should (equal (json-serialize [nil :f] :null-object :f :false-object nil)
+                 "[false,null]"))
+  (should (equal (json-serialize "a\"\\/\b\f\n\r\t\1é☃😀")
+                 "\"a\\\"\\\\/\\b\\f\\n\\r\\t\\u0001é☃😀\""))
+  (should (equal (json-serialize "caf\303\251") "\"café\""))
+  (should (equal (json-serialize nil) "{}"))
+  (should (equal (json-serialize '((a . 1) (b . [2]) (a . 3) (é . ((c . 4)))))
+                 "{\"a\":1,\"b\":[2],\"é\":{\"c\":4}}"))
+  (should (equal (json-serialize '(:a 1 b 2 :a 3))
+                 "{\"a\":1,\"b\":2}"))
+  (let ((alist (mapcar (lambda (i) (cons (intern (format "k%d" (% i 30))) i))
+                       (number-sequence 0 99))))
+    (should (equal (json-parse-string (json-serialize alist)
+                                      :object-type 'alist)
+                   (cl-subseq alist 0 30))))
+  (let ((table (make-hash-table :test 'equal)))
+    (puthash "a" 1 table)
+    (puthash "b" [t] table)
+    (should (member (json-serialize table)
+                    '("{\"a\":1,\"b\":[true]}" "{\"b\":[true],\"a\":1}")))
+    (puthash 'c 2 table)
+    (should-error (json-serialize table) :type 'wrong-type-argument))
+  (with-temp-buffer
+    (insert "<>")
+    (goto-char 2)
+    (json-insert '(:k "é") :null-object 'x)
+    (should (equal (buffer-string) "<{\"k\":\"é\"}>"))
+    (should (= (point) 11))))
+
+(ert-deftest json-tests-serialize-errors ()
+  (dolist (value (list 'a '(1 2) '((a . 1) 2) '(:a) '(("a" . 1))
+                       (/ 0.0 0.0) (/ 1.0 0.0) (make-bool-vector 1 t)
+                       (string-to-multibyte "\377") "\377" "\355\240\200"
+                       (string #x110000) (list 1)))
+    (should-error (json-serialize value) :type 'wrong-type-argument)
+    (should-error (json-serialize (vector value)) :type 'wrong-type-argument))
+  (let ((circular (list '(a . 1))))
+    (setcdr circular circular)
+    (should-error (json-serialize circular)))
+  (let ((v (vector 1)))
+    (aset v 0 v)
+    (should (eq (car (should-error (json-serialize v)))
+                'json-object-too-deep)))
+  (should-error (json-serialize [] :object-type 'alist))
+  (with-temp-buffer
+    (should-error (json-insert [a]))
+    (should (equal (buffer-string) ""))))
+
+
+;;; Comparison with json.el.
+
+(defun json-tests--random-value (depth)
+  "Return a random Lisp value for JSON, nesting at most DEPTH deep.
+Arrays are vectors, objects are alists, false is `:json-false' and
+null is nil, as with the defaults of json.el."
+  (let ((kind (random (if (> depth 0) 8 6))))
+    (cond
+     ((= kind 0) (- (random 2000000) 1000000))
+     ((= kind 1) (/ (- (random 2000000) 1000000) 64.0))
+     ((= kind 2) (nth (random 3) '(t :json-false nil)))
+     ((< kind 6)
+      (apply #'string
+             (mapcar (lambda (_) (aref "ab\"\\/\n\t é☃" (random 10)))
+                     (make-list (random 12) nil))))
+     ((= kind 6)
+      (apply #'vector (mapcar (lambda (_) (json-tests--random-value (1- depth)))
+                              (make-list (random 6) nil))))
+     (t
+      (let (alist)
+        (dotimes (i (random 6))
+          (push (cons (intern (format "key%d" i))
+                      (json-tests--random-value (1- depth)))
+                alist))
+        alist)))))
+
+(defun json-tests--sort-objects (value)
+  "Sort the members of the alists in VALUE, which json.el reverses."
+  (cond ((vectorp value) (apply #'vector (mapcar #'json-tests--sort-objects
+                                                 value)))
+        ((consp value)
+         (sort (mapcar (lambda (member)
+                         (cons (car member)
+                               (json-tests--sort-objects (cdr member))))
+                       value)
+               (lambda (a b) (string< (car a) (car b)))))
+        (t value)))
+
+(ert-deftest json-tests-json-el ()
+  "Check that json.c and json.el agree."
+  (dotimes (_ 50)
+    (let* ((value (json-tests--random-value 4))
+           (text (json-encode value)))
+      (should (equal (json-tests--sort-objects
+                      (json-parse-string text :object-type 'alist
+                                         :false-object :json-false
+                                         :null-object nil))
+                     (json-tests--sort-objects (json-read-from-string text))))
+      (should (equal (json-tests--sort-objects
+                      (json-read-from-string
+                       (json-serialize value :false-object :json-false
+                                       :null-object nil)))
+                     (json-tests--sort-objects
+                      (json-read-from-string text)))))))
+
+
+;;; The following is for benchmarking json.c against json.el, not for
+;;; regression testing.  Run it with
+;;;
+;;;   emacs -batch -Q -l test/automated/json-tests.el -f json-tests-benchmark
+
+(defun json-tests-benchmark (&optional size)
+  "Compare the speed of json.c and json.el on a document of SIZE values."
+  (let* ((value (apply #'vector
+                       (mapcar (lambda (_) (json-tests--random-value 4))
+                               (make-list (or size 20000) nil))))
+         (text (json-encode value))
+         (gc-cons-threshold 4000000))
+    (message "Document of %d bytes" (string-bytes text))
+    (message "json-read-from-string: %S"
+             (benchmark-run 3 (json-read-from-string text)))
+    (message "json-parse-string:     %S"
+             (benchmark-run 3 (json-parse-string text :object-type 'alist)))
+    (message "json-encode:           %S"
+             (benchmark-run 3 (json-encode value)))
+    (message "json-serialize:        %S"
+             (benchmark-run 3 (json-serialize value :false-object :json-false
+                                              :null-object nil)))))
+
+(provide 'json-tests)
+
+;;; json-tests.el ends here
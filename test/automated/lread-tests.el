@@ -0,0 +1,100 @@
+;;; lread-tests.el --- Tests for lread.c -*- lexical-binding: t -*-
+
+;; Copyright (C) 2014 Free Software Foundation, Inc.
+
+;; This file is part of GNU Emacs.
+
+;; GNU Emacs is free software: you can redistribute it and/or modify
+;; it under the terms of the GNU General Public License as published by
+;; the Free Software Foundation, either version 3 of the License, or
+;; (at your option) any later version.
+
+;; GNU Emacs is distributed in the hope that it will be useful,
+;; but WITHOUT ANY WARRANTY; without even the implied warranty of
+;; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+;; GNU General Public License for more details.
+
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.
+
+;;; Code:
+
+(require 'ert)
+
+(defconst lread-tests--strings
+  (list "plain ASCII" "with \"quotes\" and \\backslashes\\"
+        "multibyte: é中" (string-to-unibyte "raw \377\200 bytes")
+        (make-string 5000 ?x) "")
+  "Strings to write to a byte-compiled file and read back.")
+
+(defun lread-tests--compile-and-load (forms check &optional force-doc-strings)
+  "Byte-compile FORMS in a temporary file, load it and call CHECK.
+Bind `load-force-doc-strings' to FORCE-DOC-STRINGS while loading.
+The file is deleted after CHECK returns."
+  (let* ((dir (make-temp-file "lread-tests" t))
+         (file (expand-file-name "lread-tests-input.el" dir)))
+    (unwind-protect
+        (progn
+          (with-temp-file file
+            (insert ";;; -*- lexical-binding: t -*-\n")
+            (dolist (form forms)
+              (prin1 form (current-buffer))
+              (insert "\n")))
+          (let ((byte-compile-dest-file-function nil))
+            (should (byte-compile-file file)))
+          (let ((load-force-doc-strings force-doc-strings))
+            (load (concat file "c") nil t t))
+          (funcall check))
+      (delete-directory dir t))))
+
+(ert-deftest lread-tests-load-compiled-file ()
+  "Check that a byte-compiled file reads back the same objects."
+  (let ((stats (load-statistics)))
+    (lread-tests--compile-and-load
+     `((defvar lread-tests--value ',lread-tests--strings)
+       (defun lread-tests--function (x)
+         "A doc string with \"quotes\" and é."
+         (list x ,@lread-tests--strings (symbol-name 'a\ b))))
+     (lambda ()
+       (should (string-prefix-p "A doc string with \"quotes\" and é."
+                                (documentation 'lread-tests--function)))))
+    (should (equal lread-tests--value lread-tests--strings))
+    (should (equal (mapcar #'multibyte-string-p lread-tests--value)
+                   (mapcar #'multibyte-string-p lread-tests--strings)))
+    (should (byte-code-function-p (symbol-function 'lread-tests--function)))
+    (should (equal (lread-tests--function 1)
+                   `(1 ,@lread-tests--strings "a b")))
+    (let ((new-stats (load-statistics)))
+      (should (> (plist-get new-stats :files)
+                 (plist-get stats :files)))
+      (should (>= (plist-get new-stats :mapped-files)
+                  (plist-get stats :mapped-files)))
+      (should (>= (plist-get new-stats :read-time)
+                  (plist-get stats :read-time))))))
+
+(ert-deftest lread-tests-load-force-doc-strings ()
+  "Check loading a file with lazy doc strings forced into memory."
+  (lread-tests--compile-and-load
+   '((defun lread-tests--documented ()
+       "First doc string."
+       1)
+     (defvar lread-tests--documented-var 2
+       "Second doc string."))
+   (lambda ()
+     ;; The doc strings were read along with the file.
+     (should (stringp (aref (symbol-function 'lread-tests--documented) 4))))
+   t)
+  (should (equal (documentation 'lread-tests--documented)
+                 "First doc string."))
+  (should (equal (documentation-property 'lread-tests--documented-var
+                                         'variable-documentation)
+                 "Second doc string.")))
+
+(ert-deftest lread-tests-load-statistics-reset ()
+  (load-statistics t)
+  (should (equal (load-statistics)
+                 '(:files 0 :mapped-files 0 :mapped-bytes 0 :read-time 0.0))))
+
+(provide 'lread-tests)
+
+;;; lread-tests.el ends here
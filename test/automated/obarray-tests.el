@@ -0,0 +1,131 @@
+;;; obarray-tests.el --- Tests for obarrays -*- lexical-binding: t -*-
+
+;; Copyright (C) 2014 Free Software Foundation, Inc.
+
+;; This file is part of GNU Emacs.
+
+;; GNU Emacs is free software: you can redistribute it and/or modify
+;; it under the terms of the GNU General Public License as published by
+;; the Free Software Foundation, either version 3 of the License, or
+;; (at your option) any later version.
+
+;; GNU Emacs is distributed in the hope that it will be useful,
+;; but WITHOUT ANY WARRANTY; without even the implied warranty of
+;; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+;; GNU General Public License for more details.
+
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.
+
+;;; Code:
+
+(require 'ert)
+
+(defun obarray-tests--fill (ob n)
+  "Intern the symbols s0 ... sN-1 in OB, and return OB."
+  (dotimes (i n)
+    (intern (format "s%d" i) ob))
+  ob)
+
+(defun obarray-tests--symbols (ob)
+  "Return the names of the symbols in OB, sorted."
+  (let ((names ()))
+    (mapatoms (lambda (s) (push (symbol-name s) names)) ob)
+    (sort names #'string<)))
+
+(ert-deftest obarray-tests-make ()
+  (let ((ob (obarray-make)))
+    (should (obarrayp ob))
+    (should (eq (type-of ob) 'obarray))
+    (should-not (obarrayp (make-vector 7 0)))
+    (should (obarrayp obarray))
+    (should (equal (plist-get (obarray-statistics ob) :symbols) 0))
+    (should (obarrayp (obarray-make 1000)))
+    (should-error (obarray-make -1) :type 'wrong-type-argument)
+    (should-error (intern "x" 5) :type 'wrong-type-argument)
+    (should-error (intern "x" []) :type 'wrong-type-argument)))
+
+(ert-deftest obarray-tests-grow ()
+  "Check that an obarray grows and keeps all its symbols."
+  (let* ((ob (obarray-tests--fill (obarray-make) 5000))
+         (stats (obarray-statistics ob)))
+    (should (= (plist-get stats :symbols) 5000))
+    (should (<= (plist-get stats :load-factor) 1.0))
+    (should (> (plist-get stats :buckets) 31))
+    (dotimes (i 5000)
+      (let ((sym (intern-soft (format "s%d" i) ob)))
+        (should sym)
+        (should (eq sym (intern (format "s%d" i) ob)))))
+    (should-not (intern-soft "s5000" ob))
+    (should (= (plist-get (obarray-statistics ob) :symbols) 5000))))
+
+(ert-deftest obarray-tests-unintern ()
+  (let* ((ob (obarray-tests--fill (obarray-make) 100))
+         (sym (intern-soft "s42" ob)))
+    ;; A symbol of the same name from elsewhere is not deleted.
+    (should-not (unintern (make-symbol "s42") ob))
+    (should (unintern sym ob))
+    (should-not (intern-soft "s42" ob))
+    (should-not (unintern "s42" ob))
+    (should (= (plist-get (obarray-statistics ob) :symbols) 99))
+    (should-not (eq (intern "s42" ob) sym))
+    (should (= (plist-get (obarray-statistics ob) :symbols) 100))))
+
+(ert-deftest obarray-tests-mapatoms ()
+  "Check that `mapatoms' visits each symbol once, even if it interns."
+  (let ((ob (obarray-tests--fill (obarray-make) 200))
+        (seen (make-hash-table :test 'eq))
+        (i 0))
+    (mapatoms (lambda (s)
+                (should-not (gethash s seen))
+                (puthash s t seen)
+                ;; Intern enough symbols to make the obarray grow.
+                (when (string-prefix-p "s" (symbol-name s))
+                  (dotimes (_ 10)
+                    (intern (format "new%d" (setq i (1+ i))) ob))))
+              ob)
+    (dotimes (n 200)
+      (should (gethash (intern-soft (format "s%d" n) ob) seen)))
+    (should (= (length (obarray-tests--symbols ob)) 2200))
+    ;; The obarray grew once `mapatoms' returned.
+    (intern "last" ob)
+    (should (<= (plist-get (obarray-statistics ob) :load-factor) 1.0))))
+
+(ert-deftest obarray-tests-vector ()
+  "Check that a vector still serves as an obarray."
+  (let ((ob (obarray-tests--fill (make-vector 7 0) 100)))
+    (should (= (length ob) 7))
+    (should (equal (obarray-statistics ob)
+                   (list :symbols 100 :buckets 7
+                         :load-factor (/ 100.0 7)
+                         :longest-chain
+                         (plist-get (obarray-statistics ob) :longest-chain)
+                         :empty-buckets 0)))
+    (should (eq (intern-soft "s99" ob) (intern "s99" ob)))
+    (should (unintern "s99" ob))
+    (should (= (length (obarray-tests--symbols ob)) 99))))
+
+(ert-deftest obarray-tests-completion ()
+  (dolist (ob (list (obarray-tests--fill (obarray-make) 1000)
+                    (obarray-tests--fill (make-vector 31 0) 1000)))
+    (should (equal (sort (all-completions "s99" ob) #'string<)
+                   '("s99" "s990" "s991" "s992" "s993" "s994" "s995"
+                     "s996" "s997" "s998" "s999")))
+    (should (equal (try-completion "s99" ob) "s99"))
+    (should (eq (try-completion "s999" ob) t))
+    (should (test-completion "s5" ob))
+    (should-not (test-completion "s1000" ob))
+    (let ((completion-ignore-case t))
+      (should (test-completion "S5" ob)))
+    (should (equal (all-completions
+                    "s1" ob (lambda (s)
+                              (intern (concat "x" (symbol-name s)) ob)
+                              (= (length (symbol-name s)) 2)))
+                   '("s1")))
+    (should (equal (completion-table-with-context
+                    "p-" ob "s99" (lambda (s) (equal s "p-s99")) t)
+                   '("s99")))))
+
+(provide 'obarray-tests)
+
+;;; obarray-tests.el ends here
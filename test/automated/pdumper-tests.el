@@ -0,0 +1,195 @@
+;;; pdumper-tests.el --- Tests for pdumper.c -*- lexical-binding: t -*-
+
+;; Copyright (C) 2014 Free Software Foundation, Inc.
+
+;; This file is part of GNU Emacs.
+
+;; GNU Emacs is free software: you can redistribute it and/or modify
+;; it under the terms of the GNU General Public License as published by
+;; the Free Software Foundation, either version 3 of the License, or
+;; (at your option) any later version.
+
+;; GNU Emacs is distributed in the hope that it will be useful,
+;; but WITHOUT ANY WARRANTY; without even the implied warranty of
+;; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+;; GNU General Public License for more details.
+
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.
+
+;;; Commentary:
+
+;; These tests need the temacs and the emacs.pdmp of the build tree
+;; that the tests run from; make the dump with `make -C src emacs.pdmp'.
+
+;;; Code:
+
+(require 'ert)
+
+(defconst pdumper-tests--temacs
+  (expand-file-name "temacs" invocation-directory)
+  "The temacs executable of the Emacs running the tests.")
+
+(defconst pdumper-tests--dump
+  (expand-file-name "emacs.pdmp" invocation-directory)
+  "The portable dump made by `make emacs.pdmp'.")
+
+(defun pdumper-tests--available-p ()
+  (and (file-executable-p pdumper-tests--temacs)
+       (file-readable-p pdumper-tests--dump)))
+
+(defvar pdumper-tests--prefix nil
+  "The command and arguments that `pdumper-tests--run' runs temacs with.")
+
+(defun pdumper-tests--aslr-prefix ()
+  "Return a command that runs a program with its address space laid
+out at random, even if the environment of the tests turned that off."
+  (let ((setarch (executable-find "setarch"))
+        (arch (car (split-string system-configuration "-"))))
+    (and setarch
+         (eq (call-process setarch nil nil nil arch "true") 0)
+         (list setarch arch))))
+
+(defun pdumper-tests--run (dump &rest forms)
+  "Start temacs from DUMP in batch mode, evaluate FORMS, and return the
+value of the last form, as read from what temacs prints."
+  (with-temp-buffer
+    (let ((status (apply
+                   #'call-process
+                   (car (append pdumper-tests--prefix
+                                (list pdumper-tests--temacs)))
+                   nil t nil
+                   (append (cdr pdumper-tests--prefix)
+                           (and pdumper-tests--prefix
+                                (list pdumper-tests--temacs))
+                           (list "--dump-file" dump "-batch" "-Q"
+                                 "--eval"
+                                 (prin1-to-string
+                                  `(prin1 (progn ,@forms)
+                                          #'external-debugging-output)))))))
+      (should (eq status 0))
+      (goto-char (point-max))
+      (backward-sexp)
+      (read (current-buffer)))))
+
+(ert-deftest pdumper-tests-start ()
+  (skip-unless (pdumper-tests--available-p))
+  (let ((value (pdumper-tests--run
+                pdumper-tests--dump
+                '(list (plist-get (pdumper-stats) :dump-file)
+                       (> (plist-get (pdumper-stats) :objects) 0)
+                       emacs-major-version (subrp (symbol-function 'car))
+                       (featurep 'mule) (buffer-name) purify-flag))))
+    (should (equal value (list pdumper-tests--dump t emacs-major-version
+                               t t "*scratch*" nil)))))
+
+(ert-deftest pdumper-tests-dump-again ()
+  "Check that the state of the Lisp world survives a dump and a load."
+  (skip-unless (pdumper-tests--available-p))
+  (let* ((dir (make-temp-file "pdumper-tests" t))
+         (dump (expand-file-name "test.pdmp" dir)))
+    (unwind-protect
+        (progn
+          (pdumper-tests--run
+           pdumper-tests--dump
+           '(with-current-buffer (get-buffer-create "pdumper-tests")
+              (insert "abc" (propertize "def" 'face 'bold) "\nghi")
+              (overlay-put (make-overlay 2 6) 'pdumper-tests 42)
+              (setq-local pdumper-tests--local 'local)
+              (narrow-to-region 2 8)
+              (goto-char 5))
+           '(defvar pdumper-tests--marker
+              (with-current-buffer "pdumper-tests" (copy-marker 4 t)))
+           '(defvar pdumper-tests--table (make-hash-table :test 'equal))
+           '(puthash "key" 'value pdumper-tests--table)
+           '(puthash '(1 2) "list" pdumper-tests--table)
+           '(defvar pdumper-tests--values
+              (list (propertize "str" 'face 'italic) 1.5
+                    (make-bool-vector 70 t) (make-symbol "uninterned")))
+           '(defalias 'pdumper-tests--double
+              (byte-compile (lambda (x) (* x 2))))
+           `(dump-emacs-portable ,dump))
+          (should (equal
+                   (pdumper-tests--run
+                    dump
+                    '(with-current-buffer "pdumper-tests"
+                       (list (buffer-string) (point) (point-min) (point-max)
+                             pdumper-tests--local
+                             (mapcar (lambda (o)
+                                       (list (overlay-start o) (overlay-end o)
+                                             (overlay-get o 'pdumper-tests)))
+                                     (overlays-in 1 100))
+                             (marker-position pdumper-tests--marker)
+                             (marker-insertion-type pdumper-tests--marker)
+                             (gethash "key" pdumper-tests--table)
+                             (gethash (list 1 2) pdumper-tests--table)
+                             (mapcar #'prin1-to-string pdumper-tests--values)
+                             (intern-soft "uninterned")
+                             (pdumper-tests--double 21)
+                             (progn (garbage-collect)
+                                    (widen)
+                                    (buffer-string)))))
+                   `("bcdef\n" 5 2 8 local ((2 6 42))
+                     4 t value "list"
+                     ("#(\"str\" 0 3 (face italic))" "1.5"
+                      ,(prin1-to-string (make-bool-vector 70 t))
+                      "uninterned")
+                     nil 42 "abcdef\nghi"))))
+      (delete-directory dir t))))
+
+(ert-deftest pdumper-tests-aslr ()
+  "Check that a dump loads wherever the executable ends up in memory.
+Objects in pure storage that only C variables point to must be
+relocated too."
+  (skip-unless (pdumper-tests--available-p))
+  (let* ((pdumper-tests--prefix (pdumper-tests--aslr-prefix))
+         (dir (make-temp-file "pdumper-tests" t))
+         (dump (expand-file-name "test.pdmp" dir))
+         (form '(list (make-string 0 ?é) (make-string 0 ?a)
+                      (concat "abc" (make-string 0 ?é))
+                      (string-to-multibyte "") (number-to-string 1.5)
+                      (string-match "\\`Return the car" (documentation 'car))
+                      (progn (garbage-collect) (symbol-name 'car))))
+         (value (eval form t)))
+    (unwind-protect
+        (progn
+          (dotimes (_ 3)
+            (should (equal (pdumper-tests--run pdumper-tests--dump form)
+                           value)))
+          ;; A dump written by Emacs started from a dump loads too.
+          (pdumper-tests--run pdumper-tests--dump
+                              `(dump-emacs-portable ,dump))
+          (dotimes (_ 3)
+            (should (equal (pdumper-tests--run dump form) value))))
+      (delete-directory dir t))))
+
+(ert-deftest pdumper-tests-faces ()
+  "Check that faces can be realized after loading the dump."
+  (skip-unless (pdumper-tests--available-p))
+  (should (equal (pdumper-tests--run
+                  pdumper-tests--dump
+                  '(modify-frame-parameters
+                    nil (list (cons 'foreground-color "black")))
+                  '(face-attribute 'default :foreground))
+                 "black"))
+  ;; Reporting an error at top level realizes the faces too.
+  (with-temp-buffer
+    (should (eq (call-process pdumper-tests--temacs nil t nil
+                              "--dump-file" pdumper-tests--dump
+                              "-batch" "-Q" "--eval" "(car 1)")
+                255))
+    (should (string-match "Wrong type argument: listp, 1"
+                          (buffer-string)))))
+
+(ert-deftest pdumper-tests-errors ()
+  (should-not (pdumper-stats))
+  (should-error (dump-emacs-portable 1) :type 'wrong-type-argument)
+  (skip-unless (file-executable-p pdumper-tests--temacs))
+  (should-not (eq (call-process pdumper-tests--temacs nil nil nil
+                                "--dump-file" "/nonexistent/emacs.pdmp"
+                                "-batch")
+                  0)))
+
+(provide 'pdumper-tests)
+
+;;; pdumper-tests.el ends here
@@ -22,6 +22,7 @@
 ;;; Code:
 
 (require 'ert)
+(require 'cl-lib)
 
 ;; Timeout in seconds; the test fails if the timeout is reached.
 (defvar process-test-sentinel-wait-timeout 2.0)
@@ -50,4 +51,94 @@
   (should
    (process-test-sentinel-wait-function-working-p (lambda () (sit-for 0.01 t)))))
 
+(ert-deftest process-test-many-processes-output ()
+  "Check that output from many processes at once is all delivered."
+  (let ((procs
+         (mapcar (lambda (i)
+                   (let ((proc (start-process
+                                "test" nil "bash" "-c"
+                                (format "sleep 0.1; echo out%d" i))))
+                     (process-put proc 'expected (format "out%d\n" i))
+                     (process-put proc 'output "")
+                     (set-process-filter
+                      proc (lambda (proc string)
+                             (process-put proc 'output
+                                          (concat (process-get proc 'output)
+                                                  string))))
+                     proc))
+                 (number-sequence 1 40)))
+        (start-time (float-time)))
+    ;; Wait for the output rather than for the processes to exit,
+    ;; since a process can exit before its last output is read.
+    (while (and (cl-some (lambda (proc)
+                           (not (equal (process-get proc 'output)
+                                       (process-get proc 'expected))))
+                         procs)
+                (< (- (float-time) start-time) 10))
+      (accept-process-output nil 0.05))
+    (dolist (proc procs)
+      (should (equal (process-get proc 'output)
+                     (process-get proc 'expected))))))
+
+(ert-deftest process-test-read-output-max ()
+  "Check that output is read in chunks no larger than the maximum."
+  (let* ((read-process-output-max 512)
+         (process-connection-type nil)
+         (size 100000)
+         (proc (start-process "test" nil "head" "-c" (number-to-string size)
+                              "/dev/zero"))
+         (start-time (float-time)))
+    (set-process-coding-system proc 'binary 'binary)
+    (should (= (process-read-output-max proc) 512))
+    (should-error (set-process-read-output-max proc 0))
+    (process-put proc 'chunks nil)
+    (set-process-filter proc (lambda (proc string)
+                               (process-put proc 'chunks
+                                            (cons (length string)
+                                                  (process-get proc 'chunks)))))
+    (while (and (< (apply #'+ (process-get proc 'chunks)) size)
+                (< (- (float-time) start-time) 10))
+      (accept-process-output proc 0.05))
+    (should (= (apply #'+ (process-get proc 'chunks)) size))
+    (should (<= (apply #'max (process-get proc 'chunks)) 512))))
+
+(ert-deftest process-test-output-into-buffer ()
+  "Check that output from a process without a filter is inserted intact."
+  (let* ((text (apply #'concat (make-list 500 "h\u00e9llo \u2603 w\u00f6rld\n")))
+         (file (make-temp-file "process-test"))
+         (buf (generate-new-buffer "*process-test*"))
+         (changed 0)
+         marker)
+    (unwind-protect
+        (progn
+          (let ((coding-system-for-write 'utf-8-unix))
+            (write-region text nil file nil 'silent))
+          (with-current-buffer buf
+            (insert "start\n")
+            (setq marker (point-marker))
+            (add-hook 'after-change-functions
+                      (lambda (beg end _len)
+                        (setq changed (+ changed (- end beg))))
+                      nil t))
+          ;; Small blocks split some multibyte characters between reads.
+          (let* ((process-connection-type nil)
+                 (proc (start-process
+                        "test" buf "sh" "-c"
+                        (format "dd if=%s bs=7 2>/dev/null"
+                                (shell-quote-argument file)))))
+            (set-process-coding-system proc 'utf-8-unix 'utf-8-unix)
+            (set-process-sentinel proc #'ignore)
+            (while (process-live-p proc)
+              (accept-process-output proc 0.05))
+            (accept-process-output proc 0.05)
+            (with-current-buffer buf
+              (let ((output (buffer-substring (1+ (length "start\n"))
+                                              (process-mark proc))))
+                (should (equal output text)))
+              (should (= changed (length text)))
+              ;; Output is inserted before markers.
+              (should (= marker (process-mark proc))))))
+      (kill-buffer buf)
+      (delete-file file))))
+
 (provide 'process-tests)
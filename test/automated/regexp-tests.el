@@ -28,4 +28,187 @@
 The test data is in `compile-tests--test-regexps-data'."
   (should (string-match (regexp-opt-charset '(?^)) "a^b")))
 
+;; Tests for the cache of compiled regexps in search.c.
+
+(ert-deftest regexp-test-cache-hits ()
+  (let ((case-fold-search nil)
+        (hits regexp-cache-hits)
+        (misses regexp-cache-misses)
+        (re (format "x\\(y+\\)\\|%d" (random 1000000))))
+    (should (string-match re "axyy"))
+    (should (= regexp-cache-misses (1+ misses)))
+    (dotimes (_ 10)
+      (should (string-match re "axyyy")))
+    (should (= regexp-cache-hits (+ hits 10)))
+    (should (= regexp-cache-misses (1+ misses)))
+    ;; Case folding compiles the pattern again.
+    (let ((case-fold-search t))
+      (should (string-match re "AXYY")))
+    (should (= regexp-cache-misses (+ misses 2)))))
+
+(ert-deftest regexp-test-cache-size ()
+  (let ((regexp-cache-size 4)
+        (regexps (mapcar (lambda (i) (format "[0-9]+%c\\'" i))
+                         (number-sequence ?a ?z))))
+    (dotimes (_ 3)
+      (dolist (re regexps)
+        (should (string-match re (concat "12" (substring re -3 -2))))
+        (should-not (string-match re "12"))))
+    ;; Only the most recent regexps are kept.
+    (let ((misses regexp-cache-misses))
+      (should (string-match (car (last regexps)) "1z"))
+      (should (= regexp-cache-misses misses))
+      (should (string-match (car regexps) "1a"))
+      (should (= regexp-cache-misses (1+ misses))))
+    (should-error (string-match "\\(" "(") :type 'invalid-regexp)
+    (should (string-match (car regexps) "1a"))))
+
+;; Tests for the lazy DFA in regex.c.  A pattern with a back-reference
+;; never uses it, so each search is checked against the same search
+;; with an empty back-reference in front of the pattern.
+
+(defun regexp-tests--without-dfa (regexp)
+  "Return a regexp that matches like REGEXP, without the lazy DFA.
+Its first group is empty, and the groups of REGEXP come after it."
+  (concat "\\(\\)\\1\\(?:" regexp "\\)"))
+
+(defun regexp-tests--match-data (found twin)
+  "Return FOUND and the match data of the search that found it.
+If TWIN is non-nil, remove the first group from the match data."
+  (let ((data (and found (match-data t))))
+    (list found (if (and twin data)
+                    (append (list (nth 0 data) (nth 1 data))
+                            (nthcdr 4 data))
+                  data))))
+
+(defun regexp-tests--check-dfa (regexp text)
+  "Check that searches for REGEXP in TEXT find the same matches with
+and without the lazy DFA."
+  (let ((twin (regexp-tests--without-dfa regexp)))
+    (dolist (start (list 0 1 (/ (length text) 2)))
+      (when (<= start (length text))
+        (should (equal (list regexp text start
+                             (regexp-tests--match-data
+                              (string-match regexp text start) nil))
+                       (list regexp text start
+                             (regexp-tests--match-data
+                              (string-match twin text start) t))))))
+    (with-temp-buffer
+      (insert text)
+      (dolist (search '(re-search-forward re-search-backward
+                        posix-search-forward posix-search-backward))
+        (let ((forward (memq search '(re-search-forward
+                                      posix-search-forward)))
+              (results nil))
+          (dolist (re (list regexp twin))
+            (goto-char (if forward (point-min) (point-max)))
+            (let ((found nil))
+              (while (and (funcall search re nil t)
+                          (progn
+                            (push (regexp-tests--match-data
+                                   (point) (eq re twin))
+                                  found)
+                            ;; Step past empty matches.
+                            (or (/= (match-beginning 0) (match-end 0))
+                                (not (if forward (eobp) (bobp))))))
+                (when (= (match-beginning 0) (match-end 0))
+                  (forward-char (if forward 1 -1))))
+              (push found results)))
+          (should (equal (list regexp text search (nth 1 results))
+                         (list regexp text search (nth 0 results)))))))))
+
+(ert-deftest regexp-test-dfa ()
+  (let ((texts '("" "a" "foo bar baz" "xxfoofoo\nbar\n\nfoo" "aaaa aa a"
+                 "abab\nbaba\n" "12 34.5 .6 7." "café\nÉté à la plage"
+                 "tab\there  \n  end"))
+        (regexps '("foo" "o" "a*" "a+b" "\\(a\\|ab\\)\\(c\\|bcd\\)"
+                   "[a-c]+" "[^a\n]+" "^" "$" "^$" "^foo" "foo$" "\\`a"
+                   "[az]\\'" "\\`\\'" "a\\{2,3\\}" "\\(?:a\\|b\\)\\{2\\}"
+                   "a.*b" ".*" "[0-9]+\\.[0-9]*" "\\(o\\)\\(o\\)?"
+                   "[[:alpha:]]+" "[[:space:]]+$" "é+" "[é-ü]" "[^é]+"
+                   "\\(?:fo\\|f\\)o*" "x*?a" "\\(ba\\)+?" "a\\|$" "\n\n"
+                   "[^z]\\{3\\}\\'")))
+    (dolist (case-fold-search '(nil t))
+      (dolist (regexp regexps)
+        (dolist (text texts)
+          (regexp-tests--check-dfa regexp text)
+          (regexp-tests--check-dfa regexp (upcase text))
+          (regexp-tests--check-dfa regexp (encode-coding-string
+                                           text 'utf-8))
+          (regexp-tests--check-dfa regexp (string-to-multibyte
+                                           (encode-coding-string
+                                            text 'latin-1))))))))
+
+(ert-deftest regexp-test-dfa-linear ()
+  "Check that the lazy DFA does not backtrack."
+  (let ((text (make-string 5000 ?a)))
+    (should-not (string-match "\\(?:a\\|aa\\)*c" text))
+    (should (= (string-match "\\(?:a\\|aa\\)*c" (concat text "c")) 0))
+    (should-not (string-match "\\(?:a*\\)*b" text))
+    (with-temp-buffer
+      (insert text "\n" text)
+      (goto-char (point-min))
+      (should-not (re-search-forward "\\(?:a\\|aa\\)+\nb" nil t)))))
+
+(ert-deftest regexp-test-dfa-fastmap ()
+  "Check that the lazy DFA does not start matches the fastmap skips.
+The backtracking matcher overflows its stack on these regexps where
+they match the empty string."
+  (should-not (string-match "\\(?:\\(x?\\)\\{2,\\}\\)+" "yyy"))
+  (should-not (string-match "\\(?:\\([0-9]?\\)\\{0,3\\}\\)\\{2,\\}" "xyz"))
+  (should-not (string-match "\\(^\\)\\{2,\\}+" "abc"))
+  (should-not (string-match "\\(\\`\\)\\{2,\\}+" "abc"))
+  (should-not (string-match "\\(a*\\)\\{2,\\}" "b"))
+  (should (= (string-match "\\(a*\\)\\{2,\\}" "ba") 1)))
+
+;; Tests for the strings that every match of a regexp contains.
+
+(ert-deftest regexp-test-prefilter ()
+  (let ((case-fold-search nil)
+        (scans regexp-prefilter-scans)
+        (skips regexp-prefilter-skips))
+    ;; Each regexp matches like the one after it, which has no
+    ;; literal strings.
+    (dolist (pair '(("defun\\s-+\\(\\sw+\\)"
+                     "[d][e][f][u][n]\\s-+\\(\\sw+\\)")
+                    ("x*foo" "x*[f][o][o]")
+                    ("\\(?:ab\\)?cd" "\\(?:[a][b]\\)?[c][d]")
+                    ("\\(?:ab\\)+cd" "\\(?:[a][b]\\)+[c][d]")
+                    ("a\\{2\\}bc" "[a]\\{2\\}[b][c]")
+                    ("^ab$" "^[a][b]$")
+                    ("\\(ab\\)\\1" "\\([a][b]\\)\\1")
+                    ("é+ab" "é+[a][b]")
+                    ("ab\\|cd" "[a][b]\\|[c][d]")))
+      (dolist (text '("(defun foo)" "xxfooab cd abab abcd" "aabc aaabc"
+                      "é ééab" "ab\nab" "\351ab" "cd"))
+        (dolist (start '(0 2))
+          (when (<= start (length text))
+            (should (equal (list (car pair) text start
+                                 (string-match (car pair) text start)
+                                 (match-data t))
+                           (list (car pair) text start
+                                 (string-match (cadr pair) text start)
+                                 (match-data t))))))))
+    (with-temp-buffer
+      (insert "(defun foo ()\n  (defun-bar)\n  defun  baz)")
+      ;; Put the gap in the middle of the first "defun".
+      (goto-char 5)
+      (insert "x")
+      (delete-char -1)
+      (goto-char (point-min))
+      (let ((names nil))
+        (while (re-search-forward "defun\\s-+\\(\\sw+\\)" nil t)
+          (push (match-string 1) names))
+        (should (equal names '("baz" "foo")))
+        (while (re-search-backward "(\\(defun\\)" nil t)
+          (push (point) names))
+        (should (equal names '(1 17 "baz" "foo"))))
+      (should (> regexp-prefilter-scans scans))
+      (setq skips regexp-prefilter-skips)
+      (goto-char (point-min))
+      (should-not (re-search-forward "fun.*qux" nil t))
+      (should (> regexp-prefilter-skips skips))
+      (goto-char (point-max))
+      (should-not (re-search-backward "ba[rz]()" nil t)))))
+
 ;;; regexp-tests.el ends here.
@@ -0,0 +1,162 @@
+;;; worker-tests.el --- Tests for worker.c -*- lexical-binding: t -*-
+
+;; Copyright (C) 2014 Free Software Foundation, Inc.
+
+;; This file is part of GNU Emacs.
+
+;; GNU Emacs is free software: you can redistribute it and/or modify
+;; it under the terms of the GNU General Public License as published by
+;; the Free Software Foundation, either version 3 of the License, or
+;; (at your option) any later version.
+
+;; GNU Emacs is distributed in the hope that it will be useful,
+;; but WITHOUT ANY WARRANTY; without even the implied warranty of
+;; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+;; GNU General Public License for more details.
+
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.
+
+;;; Commentary:
+
+;; Batch Emacs does not read the events that announce finished jobs,
+;; so these tests wait for the jobs with `worker-wait', and run
+;; `worker-handle-event' themselves.
+
+;;; Code:
+
+(require 'ert)
+
+(defconst worker-tests--texts
+  (list "" "abc" "abcé" (make-string 3000 ?x)
+        (string-to-multibyte "raw \377 byte\200")
+        (concat "mixed ☃ " (string-to-multibyte "\351") " text")
+        (string-to-unibyte "unibyte \377\200"))
+  "Strings to hash and search.")
+
+(ert-deftest worker-tests-secure-hash ()
+  (dolist (text worker-tests--texts)
+    (dolist (algorithm '(md5 sha1 sha224 sha256 sha384 sha512))
+      (let ((expected (secure-hash algorithm
+                                   (if (multibyte-string-p text)
+                                       (encode-coding-string text 'utf-8-unix)
+                                     text))))
+        (should (equal (worker-wait (worker-secure-hash algorithm text))
+                       expected))
+        (with-temp-buffer
+          (set-buffer-multibyte (multibyte-string-p text))
+          (insert "before" text "after")
+          ;; Move the gap into the text.
+          (goto-char 4)
+          (insert "x")
+          (delete-char -1)
+          (narrow-to-region 7 (- (point-max) 5))
+          (should (equal (worker-wait
+                          (worker-secure-hash algorithm (current-buffer)))
+                         expected))))))
+  (should-error (worker-secure-hash 'sha0 "abc"))
+  (should-error (worker-secure-hash 'md5 42) :type 'wrong-type-argument))
+
+(ert-deftest worker-tests-count-matches ()
+  (dolist (text worker-tests--texts)
+    (dolist (string '("a" "x" "xx" "é" "\351" "\377" "b" "text"))
+      (with-temp-buffer
+        (set-buffer-multibyte (multibyte-string-p text))
+        (insert text)
+        (let ((expected
+               (let ((case-fold-search nil))
+                 (goto-char (point-min))
+                 (how-many (regexp-quote string)))))
+          (should (equal (worker-wait
+                          (worker-count-matches string (current-buffer)))
+                         expected))
+          (should (equal (worker-wait (worker-count-matches string text))
+                         expected))))))
+  (should (equal (worker-wait (worker-count-matches "aa" "aaaaa")) 2))
+  (should (equal (worker-wait (worker-count-matches "A" "aAa")) 1))
+  (should-error (worker-count-matches "" "abc")))
+
+(defun worker-tests--decode (contents coding-system)
+  "Write CONTENTS, a unibyte string, to a file and decode it with
+CODING-SYSTEM both in a worker and with `decode-coding-string'.
+Return the two results, each as a list of the text, the coding system
+used, and where point is and whether the buffer is modified after
+decoding into a buffer."
+  (let ((file (make-temp-file "worker-tests")))
+    (unwind-protect
+        (let ((coding-system-for-write 'no-conversion))
+          (write-region contents nil file nil 'silent)
+          (list (with-current-buffer
+                    (worker-wait (worker-decode-file file coding-system))
+                  (prog1 (list (buffer-string) buffer-file-coding-system
+                               (point) (buffer-modified-p))
+                    (kill-buffer)))
+                (list (string-to-multibyte
+                       (decode-coding-string contents
+                                             (or coding-system 'undecided)))
+                      last-coding-system-used 1 nil)))
+      (delete-file file))))
+
+(ert-deftest worker-tests-decode-file ()
+  (let ((tests (list "" "plain ascii\n" "caf\303\251\nna\303\257ve"
+                     "\357\273\277with bom\n" "dos\r\nlines\r\n"
+                     "overlong \300\257 and \355\240\200 surrogate"
+                     "cut short \342\230" "\370\210\200\200\200 five"
+                     "bad \377\376 bytes \200")))
+    (dotimes (_ 20)
+      (push (apply #'unibyte-string
+                   (mapcar (lambda (_)
+                             (nth (random 6) '(?a ?\n #xc3 #xa9 #xe2 #x98)))
+                           (make-list (random 40) nil)))
+            tests))
+    (dolist (contents tests)
+      (dolist (coding-system '(utf-8 utf-8-unix utf-8-dos utf-8-with-signature
+                               nil latin-1 raw-text))
+        (let ((results (worker-tests--decode contents coding-system)))
+          (should (equal (car results) (cadr results))))))))
+
+(ert-deftest worker-tests-errors ()
+  (let* ((dir (make-temp-file "worker-tests" t))
+         (job (worker-decode-file (expand-file-name "missing" dir))))
+    (unwind-protect
+        (progn
+          (should (eq (car (should-error (worker-wait job)))
+                      'file-error))
+          (should (eq (worker-status job) 'failed))
+          (should-error (worker-result job) :type 'file-error)
+          (should (eq (car (should-error (worker-wait (worker-decode-file dir))))
+                      'file-error)))
+      (delete-directory dir t)))
+  (should-error (worker-status -1))
+  (should-error (worker-decode-file "x" 'no-such-coding-system)))
+
+(ert-deftest worker-tests-cancel ()
+  (let ((jobs (mapcar (lambda (_)
+                        (worker-secure-hash 'sha512 (make-string 5000000 ?x)))
+                      (make-list 10 nil))))
+    (mapc #'worker-cancel jobs)
+    (dolist (job jobs)
+      (let ((result (worker-wait job)))
+        (should (if (eq (worker-status job) 'cancelled)
+                    (null result)
+                  (stringp result)))))))
+
+(ert-deftest worker-tests-event ()
+  (let* ((called nil)
+         (job (worker-count-matches "b" "abcb"
+                                    (lambda (id)
+                                      (push (list id (worker-result id))
+                                            called)))))
+    (should (eq (lookup-key special-event-map [worker-event])
+                'worker-handle-event))
+    (should (equal (worker-wait job) 2))
+    (worker-handle-event (list 'worker-event job))
+    (should (equal called (list (list job 2))))
+    ;; The job is forgotten once its callback has run.
+    (should-error (worker-status job))
+    (should-not (worker-handle-event (list 'worker-event job)))
+    (should (equal called (list (list job 2))))))
+
+(provide 'worker-tests)
+
+;;; worker-tests.el ends here